@@ -0,0 +1,159 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* A tiny benchmarking harness for ff_wrapper, in the spirit of test_util.h.
+* 
+* Each benchmark is a callable that does one iteration of work and returns how many items
+* (frames, packets, ...) it processed. The suite keeps calling it until a minimum time has passed,
+* and records the time per iteration and the items per second.
+* The results are written as JSON so that runs can be compared.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ff_bench
+{
+	struct result
+	{
+		std::string name;
+		// What an item is (e.g. "frames", "packets", "bytes").
+		std::string unit;
+		uint64_t iterations;
+		uint64_t items;
+		double seconds;
+
+		double ns_per_iteration() const noexcept { return seconds * 1e9 / iterations; }
+		double items_per_second() const noexcept { return seconds > 0.0 ? items / seconds : 0.0; }
+	};
+
+	class suite final
+	{
+	public:
+		/*
+		* @param min_seconds how long each benchmark runs at least.
+		* @param filter only the benchmarks whose names contain it are run. Empty to run all.
+		*/
+		explicit suite(double min_seconds = 0.5, std::string filter = std::string())
+			: min_seconds(min_seconds), filter(std::move(filter)) {}
+
+		/*
+		* Runs the benchmark once to warm up, then until min_seconds have passed.
+		* If it throws, the benchmark is reported as skipped and not recorded
+		* (e.g. a codec missing from the FFmpeg build).
+		* 
+		* @param fn does one iteration and returns the number of items it processed.
+		*/
+		void run(const std::string& name, const std::string& unit, const std::function<uint64_t()>& fn)
+		{
+			if (!filter.empty() && std::string::npos == name.find(filter))
+			{
+				return;
+			}
+
+			using clock = std::chrono::steady_clock;
+			try
+			{
+				fn();
+
+				result r{ name, unit, 0, 0, 0.0 };
+				const auto start = clock::now();
+				do
+				{
+					r.items += fn();
+					++r.iterations;
+					r.seconds = std::chrono::duration<double>(clock::now() - start).count();
+				} while (r.seconds < min_seconds);
+
+				std::cerr << std::left << std::setw(48) << name << ' '
+					<< std::right << std::setw(14) << std::fixed << std::setprecision(1) << r.ns_per_iteration() << " ns/iter "
+					<< std::setw(14) << r.items_per_second() << ' ' << unit << "/s\n";
+				results.push_back(std::move(r));
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << std::left << std::setw(48) << name << " skipped: " << e.what() << '\n';
+			}
+		}
+
+		const std::vector<result>& get_results() const noexcept { return results; }
+
+		/*
+		* Writes the results as
+		* {"benchmarks":[{"name":..., "unit":..., "iterations":..., "items":..., "seconds":...,
+		* "ns_per_iteration":..., "items_per_second":...}, ...]}
+		*/
+		void write_json(std::ostream& os) const
+		{
+			os << "{\n  \"min_seconds\": " << min_seconds << ",\n  \"benchmarks\": [";
+			for (size_t i = 0; i < results.size(); ++i)
+			{
+				const result& r = results[i];
+				os << (0 == i ? "\n" : ",\n")
+					<< "    {\"name\": " << quoted(r.name)
+					<< ", \"unit\": " << quoted(r.unit)
+					<< ", \"iterations\": " << r.iterations
+					<< ", \"items\": " << r.items
+					<< std::setprecision(9)
+					<< ", \"seconds\": " << r.seconds
+					<< ", \"ns_per_iteration\": " << r.ns_per_iteration()
+					<< ", \"items_per_second\": " << r.items_per_second() << '}';
+			}
+			os << "\n  ]\n}\n";
+		}
+
+	private:
+		static std::string quoted(const std::string& s)
+		{
+			std::ostringstream os;
+			os << '"';
+			for (char c : s)
+			{
+				switch (c)
+				{
+				case '"': os << "\\\""; break;
+				case '\\': os << "\\\\"; break;
+				case '\n': os << "\\n"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20)
+					{
+						os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+					}
+					else
+					{
+						os << c;
+					}
+				}
+			}
+			os << '"';
+			return os.str();
+		}
+
+	private:
+		double min_seconds;
+		std::string filter;
+		std::vector<result> results;
+	};
+}
@@ -0,0 +1,559 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* ff_wrapper_bench: measures the hot paths of ff_wrapper and writes the results as JSON.
+* 
+* Usage: ff_wrapper_bench [--out results.json] [--filter substring] [--min-time seconds]
+* 
+* Covers frame and packet allocation/copying, the frame_ops kernels at each SIMD level against scalar,
+* frame_transformer::convert_frame per format pair and resolution,
+* decoder/encoder throughput per codec, decoding replayed packet traces without demuxing,
+* and demuxing/muxing packet rates.
+* The media used are generated by the FFmpeg CLI in the working directory,
+* and so are their packet traces (see ff_wrapper_trace), so that the same ones can be replayed across runs.
+*/
+
+#include "../bench_util.h"
+
+#include "../../ff_wrapper/data/frame.h"
+#include "../../ff_wrapper/data/frame_pool.h"
+#include "../../ff_wrapper/data/frame_ops.h"
+#include "../../ff_wrapper/data/packet.h"
+#include "../../ff_wrapper/data/packet_pool.h"
+#include "../../ff_wrapper/sws/frame_transformer.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/codec/encoder.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/formats/muxer.h"
+#include "../../ff_wrapper/formats/custom_io.h"
+#include "../../ff_wrapper/formats/stream.h"
+#include "../../ff_wrapper/formats/packet_trace.h"
+
+#include <cstdlib> // For std::system().
+#include <filesystem>
+#include <format> // For std::format().
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	struct resolution
+	{
+		int w, h;
+		std::string name() const { return std::format("{}x{}", w, h); }
+	};
+
+	const resolution resolutions[] = { { 640, 480 }, { 1920, 1080 } };
+
+	// The codecs whose throughput is measured, by encoder name, and the container used for them.
+	struct codec_case
+	{
+		const char* encoder_name;
+		const char* extension;
+	};
+	const codec_case codec_cases[] = { { "mpeg4", "avi" }, { "libx264", "mkv" }, { "mjpeg", "avi" } };
+
+	constexpr int media_duration = 2;
+	constexpr int media_rate = 25;
+
+	/*
+	* Creates a test video encoded by encoder_name with the FFmpeg CLI, unless it is already there.
+	* @returns the path to it.
+	* @throws std::runtime_error if it could not be created (e.g. the encoder is not in the build).
+	*/
+	fs::path ensure_media(const codec_case& c, const resolution& r)
+	{
+		fs::path p(fs::current_path() / std::format("bench_{}_{}.{}", c.encoder_name, r.name(), c.extension));
+		if (!fs::exists(p))
+		{
+			// mjpeg wants full-range pixels.
+			const char* pix_fmt = std::string("mjpeg") == c.encoder_name ? "yuvj420p" : "yuv420p";
+			std::string cmd
+			(
+				std::format(FFMPEG_EXECUTABLE_PATH " -loglevel error -f lavfi -i testsrc=duration={}:size={}x{}:rate={} "
+					"-c:v {} -pix_fmt {} -y ",
+					media_duration, r.w, r.h, media_rate, c.encoder_name, pix_fmt)
+			);
+			cmd += std::string("\"") + p.generic_string() + '\"';
+
+			if (0 != std::system(cmd.c_str()) || !fs::exists(p))
+			{
+				throw std::runtime_error(std::string("Could not create the media for ") + c.encoder_name);
+			}
+		}
+		return p;
+	}
+
+	/*
+	* Decodes the whole video stream of dem with dec.
+	* @returns the number of frames decoded.
+	*/
+	uint64_t decode_all(ff::demuxer& dem, ff::decoder& dec, std::vector<ff::frame>* out = nullptr)
+	{
+		uint64_t n = 0;
+		const int iv = dem.get_video_ind(0);
+		ff::packet pkt;
+		ff::frame f(true);
+		auto drain = [&]()
+		{
+			while (dec.decode_frame(f))
+			{
+				++n;
+				if (out)
+				{
+					out->push_back(f.shared_ref());
+				}
+			}
+		};
+
+		while (dem.demux_next_packet(pkt))
+		{
+			if (pkt->stream_index != iv)
+			{
+				continue;
+			}
+			dec.feed_packet(pkt);
+			drain();
+		}
+		dec.signal_no_more_food();
+		drain();
+
+		return n;
+	}
+
+	void bench_frames(ff_bench::suite& s)
+	{
+		for (const auto& r : resolutions)
+		{
+			const ff::frame::data_properties dp(AV_PIX_FMT_YUV420P, r.w, r.h);
+
+			s.run("frame/alloc/" + r.name(), "frames", [&]() -> uint64_t
+			{
+				ff::frame f(true);
+				f.allocate_data(dp);
+				return 1;
+			});
+
+			ff::frame_pool pool(dp);
+			s.run("frame/alloc_pooled/" + r.name(), "frames", [&]() -> uint64_t
+			{
+				ff::frame f(pool.get_frame(dp));
+				return 1;
+			});
+
+			ff::frame src(true);
+			src.allocate_data(dp);
+			s.run("frame/shared_ref/" + r.name(), "frames", [&]() -> uint64_t
+			{
+				ff::frame f(src.shared_ref());
+				return 1;
+			});
+			s.run("frame/deep_copy/" + r.name(), "frames", [&]() -> uint64_t
+			{
+				ff::frame f(src.deep_copy());
+				return 1;
+			});
+		}
+	}
+
+	const char* simd_level_name(ff::frame_ops::simd_level level)
+	{
+		switch (level)
+		{
+		case ff::frame_ops::simd_level::sse4:
+			return "sse4";
+		case ff::frame_ops::simd_level::avx2:
+			return "avx2";
+		case ff::frame_ops::simd_level::neon:
+			return "neon";
+		default:
+			return "scalar";
+		}
+	}
+
+	void bench_frame_ops(ff_bench::suite& s)
+	{
+		namespace ops = ff::frame_ops;
+
+		std::vector<ops::simd_level> levels{ ops::simd_level::scalar };
+		if (ops::simd_level::avx2 == ops::supported_simd_level())
+		{
+			levels.push_back(ops::simd_level::sse4);
+		}
+		if (ops::simd_level::scalar != ops::supported_simd_level())
+		{
+			levels.push_back(ops::supported_simd_level());
+		}
+
+		ff::frame wm(true);
+		wm.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUVA420P, 320, 96));
+		ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUVA420P, 0>(wm), 235);
+		ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUVA420P, 1>(wm), 128);
+		ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUVA420P, 2>(wm), 128);
+		ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUVA420P, 3>(wm), 96);
+
+		for (const auto& r : resolutions)
+		{
+			ff::frame src(true);
+			src.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, r.w, r.h));
+			ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 0>(src), 100);
+			ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 1>(src), 128);
+			ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 2>(src), 128);
+			ff::frame deep(ops::convert_depth(src, AV_PIX_FMT_YUV420P10LE));
+
+			for (auto level : levels)
+			{
+				ops::set_simd_level(level);
+				const std::string suffix = std::format("{}/{}", simd_level_name(level), r.name());
+
+				// src stays the only reference to its data, so this blends in place without copying.
+				s.run("frame_ops/overlay/" + suffix, "frames", [&]() -> uint64_t
+				{
+					ops::overlay(src, wm, 16, 16);
+					return 1;
+				});
+				s.run("frame_ops/to_10bit/" + suffix, "frames", [&]() -> uint64_t
+				{
+					ff::frame f(ops::convert_depth(src, AV_PIX_FMT_YUV420P10LE));
+					return 1;
+				});
+				s.run("frame_ops/to_8bit/" + suffix, "frames", [&]() -> uint64_t
+				{
+					ff::frame f(ops::convert_depth(deep, AV_PIX_FMT_YUV420P));
+					return 1;
+				});
+			}
+			ops::set_simd_level(ops::supported_simd_level());
+
+			// These don't depend on the level.
+			s.run("frame_ops/pad/" + r.name(), "frames", [&]() -> uint64_t
+			{
+				ff::frame f(ops::pad(src, 0, 16, 0, 16));
+				return 1;
+			});
+			s.run("frame_ops/luma_histogram/" + r.name(), "frames", [&]() -> uint64_t
+			{
+				ops::luma_histogram(src);
+				return 1;
+			});
+		}
+	}
+
+	void bench_packets(ff_bench::suite& s)
+	{
+		for (int size : { 4 << 10, 256 << 10 })
+		{
+			const std::string size_name(std::format("{}KiB", size >> 10));
+
+			s.run("packet/alloc/" + size_name, "packets", [&]() -> uint64_t
+			{
+				ff::packet pkt(true);
+				pkt.allocate_resources_memory(size);
+				return 1;
+			});
+
+			ff::packet_pool pool;
+			s.run("packet/alloc_pooled/" + size_name, "packets", [&]() -> uint64_t
+			{
+				ff::packet pkt(pool.get_packet(size));
+				pool.recycle(pkt);
+				return 1;
+			});
+
+			ff::packet src(true);
+			src.allocate_resources_memory(size);
+			s.run("packet/clone/" + size_name, "packets", [&]() -> uint64_t
+			{
+				ff::packet pkt(src);
+				return 1;
+			});
+		}
+	}
+
+	void bench_transformer(ff_bench::suite& s)
+	{
+		struct format_pair
+		{
+			AVPixelFormat src, dst;
+			const char* name;
+		};
+		const format_pair pairs[] =
+		{
+			{ AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGB24, "yuv420p-rgb24" },
+			{ AV_PIX_FMT_RGB24, AV_PIX_FMT_YUV420P, "rgb24-yuv420p" },
+			{ AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12, "yuv420p-nv12" },
+			{ AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P, "yuv420p-yuv420p_half" }
+		};
+
+		for (const auto& r : resolutions)
+		{
+			for (const auto& p : pairs)
+			{
+				// The last pair scales down by half. The others only convert the format.
+				const bool scale = p.src == p.dst;
+				const ff::frame::data_properties src_dp(p.src, r.w, r.h);
+				const ff::frame::data_properties dst_dp(p.dst, scale ? r.w / 2 : r.w, scale ? r.h / 2 : r.h);
+
+				ff::frame_transformer t(dst_dp, src_dp);
+				ff::frame src(true);
+				src.allocate_data(src_dp);
+				ff::frame dst(true);
+				dst.allocate_data(dst_dp);
+
+				s.run(std::format("convert_frame/{}/{}", p.name, r.name()), "frames", [&]() -> uint64_t
+				{
+					t.convert_frame(dst, src);
+					return 1;
+				});
+			}
+		}
+	}
+
+	void bench_codecs(ff_bench::suite& s)
+	{
+		const resolution r = resolutions[0];
+		for (const auto& c : codec_cases)
+		{
+			fs::path media;
+			try
+			{
+				media = ensure_media(c, r);
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << c.encoder_name << " skipped: " << e.what() << '\n';
+				continue;
+			}
+
+			s.run(std::format("decode/{}/{}", c.encoder_name, r.name()), "frames", [&]() -> uint64_t
+			{
+				ff::demuxer dem(media);
+				ff::decoder dec(dem.get_video(0));
+				return decode_all(dem, dec);
+			});
+
+			// Encode the decoded frames again, so that they are realistic.
+			std::vector<ff::frame> frames;
+			AVPixelFormat pix_fmt;
+			{
+				ff::demuxer dem(media);
+				ff::decoder dec(dem.get_video(0));
+				decode_all(dem, dec, &frames);
+				pix_fmt = dec.get_codec_properties().v_pixel_format();
+			}
+
+			s.run(std::format("encode/{}/{}", c.encoder_name, r.name()), "frames", [&]() -> uint64_t
+			{
+				ff::encoder enc(c.encoder_name);
+				ff::codec_properties p(enc.get_codec_properties());
+				p.set_type_video();
+				p.set_id(enc.get_id());
+				p.set_v_width(r.w);
+				p.set_v_height(r.h);
+				p.set_v_sar(ff::rational(1, 1));
+				p.set_v_pixel_format(pix_fmt);
+				p.set_v_frame_rate(ff::rational(media_rate));
+				p.set_time_base(ff::rational(1, media_rate));
+				enc.set_codec_properties(p);
+				enc.create_codec_context();
+
+				ff::packet pkt;
+				int64_t pts = 0;
+				for (auto& f : frames)
+				{
+					f->pts = pts++;
+					enc.feed_frame(f);
+					while (enc.encode_packet(pkt)) {}
+				}
+				enc.signal_no_more_food();
+				while (enc.encode_packet(pkt)) {}
+
+				return frames.size();
+			});
+		}
+	}
+
+	/*
+	* Records the video of media into a trace next to it, unless it is already there.
+	* @returns the path to it.
+	*/
+	fs::path ensure_trace(const fs::path& media)
+	{
+		fs::path p(media);
+		p.replace_extension(".ffwtrace");
+		if (!fs::exists(p))
+		{
+			ff::demuxer dem(media);
+			ff::packet_trace::record(dem, dem.get_video_ind(0), p);
+		}
+		return p;
+	}
+
+	void bench_replay(ff_bench::suite& s)
+	{
+		const resolution r = resolutions[0];
+		for (const auto& c : codec_cases)
+		{
+			fs::path trace_path;
+			try
+			{
+				trace_path = ensure_trace(ensure_media(c, r));
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << c.encoder_name << " replay skipped: " << e.what() << '\n';
+				continue;
+			}
+
+			const ff::packet_trace trace(trace_path);
+			// Single threaded and with the default policy, to see what the threads bring.
+			const std::pair<const char*, ff::codec_base::threading_policy> policies[] =
+			{
+				{ "single", ff::codec_base::threading_policy::single_threaded() },
+				{ "auto", ff::codec_base::threading_policy() }
+			};
+			for (const auto& p : policies)
+			{
+				s.run(std::format("replay/{}/{}/{}", c.encoder_name, p.first, r.name()), "frames", [&]() -> uint64_t
+				{
+					ff::decoder dec(trace.make_decoder(p.second));
+					return trace.replay(dec).frames;
+				});
+			}
+		}
+	}
+
+	void bench_formats(ff_bench::suite& s)
+	{
+		fs::path media;
+		try
+		{
+			media = ensure_media(codec_cases[0], resolutions[0]);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "demux/mux skipped: " << e.what() << '\n';
+			return;
+		}
+
+		s.run("demux/" + media.extension().string().substr(1), "packets", [&]() -> uint64_t
+		{
+			ff::demuxer dem(media);
+			ff::packet pkt;
+			uint64_t n = 0;
+			while (dem.demux_next_packet(pkt))
+			{
+				++n;
+			}
+			return n;
+		});
+
+		// Mux into memory so that the disk is not measured.
+		std::vector<ff::packet> pkts;
+		{
+			ff::demuxer dem(media);
+			ff::packet pkt;
+			while (dem.demux_next_packet(pkt))
+			{
+				pkts.push_back(pkt);
+			}
+		}
+		ff::demuxer dem(media);
+		const ff::stream in_s(dem.get_stream(0));
+
+		s.run("mux/matroska", "packets", [&]() -> uint64_t
+		{
+			ff::memory_io io;
+			ff::muxer mux(io, "matroska");
+			mux.add_stream(in_s);
+			mux.prepare_muxer();
+			for (const auto& p : pkts)
+			{
+				// The muxer takes over what it's given.
+				ff::packet copy(p);
+				copy->stream_index = 0;
+				mux.mux_packet_auto(copy);
+			}
+			mux.finalize();
+			return pkts.size();
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	fs::path out_path;
+	std::string filter;
+	double min_time = 0.5;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+		if ("--out" == arg && i + 1 < argc)
+		{
+			out_path = argv[++i];
+		}
+		else if ("--filter" == arg && i + 1 < argc)
+		{
+			filter = argv[++i];
+		}
+		else if ("--min-time" == arg && i + 1 < argc)
+		{
+			min_time = std::stod(argv[++i]);
+		}
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--out results.json] [--filter substring] [--min-time seconds]\n";
+			return 1;
+		}
+	}
+
+	ff_bench::suite s(min_time, filter);
+	try
+	{
+		bench_frames(s);
+		bench_frame_ops(s);
+		bench_packets(s);
+		bench_transformer(s);
+		bench_codecs(s);
+		bench_replay(s);
+		bench_formats(s);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Unexpected exception thrown during benchmarking with message:\n" << e.what() << '\n';
+		return -1;
+	}
+
+	if (out_path.empty())
+	{
+		s.write_json(std::cout);
+	}
+	else
+	{
+		std::ofstream ofs(out_path);
+		s.write_json(ofs);
+	}
+
+	return 0;
+}
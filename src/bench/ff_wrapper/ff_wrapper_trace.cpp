@@ -0,0 +1,158 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* ff_wrapper_trace: records packet traces and replays them into decoders (see packet_trace).
+*
+* Usage:
+*	ff_wrapper_trace record <media> <trace> [--stream index] [--max-packets n]
+*		Records the stream (by default, the first video stream) of media into trace.
+*	ff_wrapper_trace replay <trace> [--rate packets_per_second] [--loops n] [--threads n]
+*		Replays trace into a new decoder and writes the results as JSON to stdout.
+*/
+
+#include "../../ff_wrapper/formats/packet_trace.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	int usage(const char* name)
+	{
+		std::cerr << "Usage:\n"
+			<< "  " << name << " record <media> <trace> [--stream index] [--max-packets n]\n"
+			<< "  " << name << " replay <trace> [--rate packets_per_second] [--loops n] [--threads n]\n";
+		return 1;
+	}
+
+	int record(int argc, char** argv)
+	{
+		if (argc < 4)
+		{
+			return usage(argv[0]);
+		}
+		const fs::path media(fs::absolute(argv[2]));
+		const fs::path trace(argv[3]);
+
+		int stream_ind = -1;
+		size_t max_packets = 0;
+		for (int i = 4; i < argc; ++i)
+		{
+			const std::string arg(argv[i]);
+			if ("--stream" == arg && i + 1 < argc)
+			{
+				stream_ind = std::stoi(argv[++i]);
+			}
+			else if ("--max-packets" == arg && i + 1 < argc)
+			{
+				max_packets = std::stoull(argv[++i]);
+			}
+			else
+			{
+				return usage(argv[0]);
+			}
+		}
+
+		ff::demuxer dem(media);
+		if (stream_ind < 0)
+		{
+			stream_ind = dem.get_video_ind(0);
+		}
+		const size_t n = ff::packet_trace::record(dem, stream_ind, trace, max_packets);
+		std::cerr << "Recorded " << n << " packets of stream " << stream_ind << " into " << trace.generic_string() << '\n';
+		return 0;
+	}
+
+	int replay(int argc, char** argv)
+	{
+		if (argc < 3)
+		{
+			return usage(argv[0]);
+		}
+		const fs::path trace_path(argv[2]);
+
+		ff::packet_trace::replay_options options;
+		int threads = 0;
+		for (int i = 3; i < argc; ++i)
+		{
+			const std::string arg(argv[i]);
+			if ("--rate" == arg && i + 1 < argc)
+			{
+				options.packets_per_second = std::stod(argv[++i]);
+			}
+			else if ("--loops" == arg && i + 1 < argc)
+			{
+				options.loops = std::stoi(argv[++i]);
+			}
+			else if ("--threads" == arg && i + 1 < argc)
+			{
+				threads = std::stoi(argv[++i]);
+			}
+			else
+			{
+				return usage(argv[0]);
+			}
+		}
+
+		ff::packet_trace trace(trace_path);
+		ff::decoder dec(trace.make_decoder(ff::codec_base::threading_policy(threads)));
+		const auto r = trace.replay(dec, options);
+
+		std::cout << "{\"trace\": \"" << trace_path.generic_string() << '"'
+			<< ", \"packets\": " << r.packets
+			<< ", \"frames\": " << r.frames
+			<< ", \"seconds\": " << r.seconds
+			<< ", \"frames_per_second\": " << r.frames_per_second()
+			<< ", \"latency_p50_ns\": " << r.latency_p50_ns
+			<< ", \"latency_p90_ns\": " << r.latency_p90_ns
+			<< ", \"latency_p99_ns\": " << r.latency_p99_ns
+			<< ", \"latency_max_ns\": " << r.latency_max_ns
+			<< ", \"frame_buffers\": " << r.frame_buffers << "}\n";
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		return usage(argv[0]);
+	}
+
+	try
+	{
+		const std::string command(argv[1]);
+		if ("record" == command)
+		{
+			return record(argc, argv);
+		}
+		if ("replay" == command)
+		{
+			return replay(argc, argv);
+		}
+		return usage(argv[0]);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Failed with message:\n" << e.what() << '\n';
+		return -1;
+	}
+}
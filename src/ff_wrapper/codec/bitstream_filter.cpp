@@ -0,0 +1,287 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "bitstream_filter.h"
+#include "../formats/stream.h"
+#include "../util/ff_helpers.h"
+
+extern "C"
+{
+#include <libavcodec/bsf.h>
+#include <libavcodec/packet.h>
+}
+
+#include <stdexcept>
+
+ff::bitstream_filter::bitstream_filter(const std::string& filters, const codec_properties& in_properties, rational in_time_base)
+{
+	internal_create(filters, in_properties, in_time_base);
+}
+
+ff::bitstream_filter::bitstream_filter(const std::string& filters, const stream& s)
+{
+	internal_create(filters, s.properties(), s.time_base());
+}
+
+ff::bitstream_filter::bitstream_filter(bitstream_filter&& other) noexcept
+	: p_bsf_ctx(other.p_bsf_ctx), p_in(other.p_in),
+	eof_signaled(other.eof_signaled), is_drained(other.is_drained)
+{
+	other.p_bsf_ctx = nullptr;
+	other.p_in = nullptr;
+}
+
+ff::bitstream_filter& ff::bitstream_filter::operator=(bitstream_filter&& right) noexcept
+{
+	if (this == &right)
+	{
+		return *this;
+	}
+
+	av_bsf_free(&p_bsf_ctx);
+	av_packet_free(&p_in);
+
+	p_bsf_ctx = right.p_bsf_ctx;
+	p_in = right.p_in;
+	eof_signaled = right.eof_signaled;
+	is_drained = right.is_drained;
+	right.p_bsf_ctx = nullptr;
+	right.p_in = nullptr;
+
+	return *this;
+}
+
+ff::bitstream_filter::~bitstream_filter() noexcept
+{
+	// Both do nothing if it's nullptr.
+	av_bsf_free(&p_bsf_ctx);
+	av_packet_free(&p_in);
+}
+
+bool ff::bitstream_filter::feed_packet(const packet& pkt)
+{
+	FF_ASSERT(nullptr != p_bsf_ctx, "Should not be used after being moved.");
+
+	if (eof_signaled)
+	{
+		throw std::logic_error("No more food has been signaled.");
+	}
+	if (!pkt.ready())
+	{
+		throw std::invalid_argument("The packet must be ready.");
+	}
+
+	int ret = av_packet_ref(p_in, pkt.av_packet());
+	if (ret < 0)
+	{
+		throw std::bad_alloc();
+	}
+
+	// On success, the filters take over the reference and p_in is blank again.
+	ret = av_bsf_send_packet(p_bsf_ctx, p_in);
+	if (ret < 0)
+	{
+		av_packet_unref(p_in);
+		switch (ret)
+		{
+		case AVERROR(EAGAIN):
+			return false;
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		case AVERROR(EINVAL):
+		case AVERROR_INVALIDDATA:
+			throw std::invalid_argument("The filters reject the packet.");
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Could not feed the packet to the bitstream filters", ret);
+		}
+	}
+
+	return true;
+}
+
+bool ff::bitstream_filter::filter_packet(packet& pkt)
+{
+	FF_ASSERT(nullptr != p_bsf_ctx, "Should not be used after being moved.");
+
+	switch (pkt.get_object_state())
+	{
+	case ff_object::DESTROYED:
+		pkt.allocate_object_memory();
+		[[fallthrough]];
+	case ff_object::OBJECT_CREATED:
+		break;
+	case ff_object::READY:
+		pkt.release_resources_memory();
+		break;
+	}
+
+	const int ret = av_bsf_receive_packet(p_bsf_ctx, pkt.av_packet());
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(EAGAIN):
+			return false;
+		case AVERROR_EOF:
+			is_drained = true;
+			return false;
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("A bitstream filter failed", ret);
+		}
+	}
+
+	pkt.av_packet()->time_base = p_bsf_ctx->time_base_out;
+	pkt.state = ff_object::READY;
+	return true;
+}
+
+ff::packet ff::bitstream_filter::filter_packet()
+{
+	packet pkt(true);
+	if (filter_packet(pkt))
+	{
+		return pkt;
+	}
+
+	return packet(false);
+}
+
+void ff::bitstream_filter::signal_no_more_food()
+{
+	FF_ASSERT(nullptr != p_bsf_ctx, "Should not be used after being moved.");
+
+	if (eof_signaled)
+	{
+		throw std::logic_error("No more food has already been signaled.");
+	}
+
+	// A nullptr packet signals the end. It can't fail for EAGAIN.
+	const int ret = av_bsf_send_packet(p_bsf_ctx, nullptr);
+	if (ret < 0)
+	{
+		ON_FF_ERROR_WITH_CODE("Could not signal the end to the bitstream filters", ret);
+	}
+	eof_signaled = true;
+}
+
+void ff::bitstream_filter::reset() noexcept
+{
+	FF_ASSERT(nullptr != p_bsf_ctx, "Should not be used after being moved.");
+
+	av_bsf_flush(p_bsf_ctx);
+	eof_signaled = false;
+	is_drained = false;
+}
+
+ff::codec_properties ff::bitstream_filter::out_properties() const
+{
+	FF_ASSERT(nullptr != p_bsf_ctx, "Should not be used after being moved.");
+
+	return codec_properties(p_bsf_ctx->par_out, p_bsf_ctx->time_base_out);
+}
+
+ff::rational ff::bitstream_filter::out_time_base() const noexcept
+{
+	FF_ASSERT(nullptr != p_bsf_ctx, "Should not be used after being moved.");
+
+	return p_bsf_ctx->time_base_out;
+}
+
+bool ff::bitstream_filter::exists(const std::string& name) noexcept
+{
+	return nullptr != av_bsf_get_by_name(name.c_str());
+}
+
+std::string ff::bitstream_filter::annexb_filter_for(const codec_properties& p)
+{
+	const AVCodecParameters* par = p.av_codec_parameters();
+	// The length-prefixed form keeps its parameter sets in an avcC/hvcC record, which starts with 1.
+	// The Annex B form has start codes (0 0 1 or 0 0 0 1) in the extradata, or none at all.
+	const bool length_prefixed = par->extradata_size > 0 && 1 == par->extradata[0];
+	if (!length_prefixed)
+	{
+		return std::string();
+	}
+
+	switch (p.id())
+	{
+	case AV_CODEC_ID_H264:
+		return "h264_mp4toannexb";
+	case AV_CODEC_ID_HEVC:
+		return "hevc_mp4toannexb";
+	default:
+		return std::string();
+	}
+}
+
+void ff::bitstream_filter::internal_create(const std::string& filters, const codec_properties& in_properties, rational in_time_base)
+{
+	if (in_time_base <= zero_rational)
+	{
+		throw std::invalid_argument("The time base must be positive.");
+	}
+
+	p_in = av_packet_alloc();
+	if (nullptr == p_in)
+	{
+		throw std::bad_alloc();
+	}
+
+	// An empty string gives the null filter, which passes the packets through.
+	int ret = av_bsf_list_parse_str(filters.c_str(), &p_bsf_ctx);
+	if (ret < 0)
+	{
+		av_packet_free(&p_in);
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			throw std::invalid_argument("The bitstream filters cannot be parsed, or one does not exist.");
+		}
+	}
+
+	ret = avcodec_parameters_copy(p_bsf_ctx->par_in, in_properties.av_codec_parameters());
+	if (ret >= 0)
+	{
+		p_bsf_ctx->time_base_in = in_time_base.av_rational();
+		ret = av_bsf_init(p_bsf_ctx);
+	}
+	if (ret < 0)
+	{
+		av_bsf_free(&p_bsf_ctx);
+		av_packet_free(&p_in);
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		case AVERROR(EINVAL):
+		case AVERROR(ENOSYS):
+		case AVERROR_INVALIDDATA:
+			throw std::invalid_argument("The bitstream filters do not support the stream.");
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Could not initialize the bitstream filters", ret);
+		}
+	}
+}
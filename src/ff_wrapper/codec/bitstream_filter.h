@@ -0,0 +1,175 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/ff_math.h"
+#include "../data/packet.h"
+#include "codec_properties.h"
+
+extern "C"
+{
+#include <libavcodec/codec_id.h>
+}
+
+#include <string>
+
+struct AVBSFContext;
+struct AVPacket;
+
+namespace ff
+{
+	class stream;
+
+	/*
+	* Represents a chain of bitstream filters (e.g. h264_mp4toannexb, hevc_mp4toannexb, aac_adtstoasc),
+	* which rewrite the packets of a stream without decoding them,
+	* e.g. to remux MP4 into MPEG-TS or to feed raw H.264 into a hardware decoder.
+	* Put it here because FFmpeg put bitstream filters in libavcodec.
+	* 
+	* It's fed like a decoder:
+	* feed_packet() with each packet, and take out what it gives with filter_packet() until it gives nothing.
+	* After the last packet, signal_no_more_food(), and take out the rest.
+	* 
+	* Packets are passed by reference, so nothing is copied unless a filter rewrites the payload.
+	* An empty chain passes the packets through unchanged.
+	* 
+	* The filters may change the properties of the stream (e.g. the extradata).
+	* Give out_properties() to the output stream, e.g. through remuxer::set_bitstream_filter() or muxer::add_stream().
+	* 
+	* Invariants: p_bsf_ctx != nullptr unless the object has been moved.
+	*/
+	class FF_WRAPPER_API bitstream_filter final
+	{
+	public:
+		bitstream_filter() = delete;
+
+		/*
+		* @param filters the chain, e.g. "h264_mp4toannexb" or "h264_metadata=level=4.1,h264_mp4toannexb".
+		* Empty for none (passthrough).
+		* @param in_properties the properties of the stream, including its extradata.
+		* @param in_time_base the time base of the packets fed.
+		* @throws std::invalid_argument if filters cannot be parsed, names a filter that doesn't exist,
+		* or if a filter doesn't support the codec.
+		* @throws std::invalid_argument if in_time_base <= 0.
+		*/
+		bitstream_filter(const std::string& filters, const codec_properties& in_properties, rational in_time_base);
+		/*
+		* Same as the one above, with the properties and the time base of s (e.g. from a demuxer).
+		*/
+		bitstream_filter(const std::string& filters, const stream& s);
+
+		bitstream_filter(const bitstream_filter&) = delete;
+		bitstream_filter& operator=(const bitstream_filter&) = delete;
+
+		/*
+		* Takes over other and sets other's pointers to nullptr.
+		*/
+		bitstream_filter(bitstream_filter&& other) noexcept;
+		bitstream_filter& operator=(bitstream_filter&& right) noexcept;
+
+		~bitstream_filter() noexcept;
+
+	public:
+/////////////////////////////// The filtering process ///////////////////////////////
+		/*
+		* Feeds a packet into the filters. It's referenced, not copied.
+		* 
+		* @returns true if fed; false if the filters are full, in which case
+		* take out their packets through filter_packet() and feed it again.
+		* @throws std::logic_error if signal_no_more_food() has been called.
+		* @throws std::invalid_argument if pkt is not ready, or if the filters reject it (e.g. it's malformed).
+		*/
+		bool feed_packet(const packet& pkt);
+
+		/*
+		* Takes out the next filtered packet.
+		* 
+		* @param pkt where the packet goes. It's made ready with the data, or is left created with no data
+		* if nothing is given. Its time base is set to out_time_base().
+		* @returns true if a packet is given; false if the filters need more food,
+		* or if they are drained after signal_no_more_food().
+		* @throws std::runtime_error if a filter fails.
+		*/
+		bool filter_packet(packet& pkt);
+		/*
+		* Same as the one above, but returns a new packet, which is DESTROYED if nothing is given.
+		*/
+		packet filter_packet();
+
+		/*
+		* Tells the filters that no more packets will be fed, so that they give out what they hold.
+		* 
+		* @throws std::logic_error if it has been called.
+		*/
+		void signal_no_more_food();
+
+		/*
+		* Discards what the filters hold, e.g. after seeking, and lets them be fed again.
+		*/
+		void reset() noexcept;
+
+		/*
+		* @returns true iff signal_no_more_food() has been called since construction or reset().
+		*/
+		bool no_more_food() const noexcept { return eof_signaled; }
+		/*
+		* @returns true iff the filters have given out everything after signal_no_more_food().
+		*/
+		bool drained() const noexcept { return is_drained; }
+
+	public:
+		/*
+		* @returns the properties of the filtered stream.
+		*/
+		codec_properties out_properties() const;
+		/*
+		* @returns the time base of the filtered packets.
+		*/
+		rational out_time_base() const noexcept;
+
+		AVBSFContext* av_bsf_context() noexcept { return p_bsf_ctx; }
+		const AVBSFContext* av_bsf_context() const noexcept { return p_bsf_ctx; }
+
+	public:
+		/*
+		* @returns true iff this build of FFmpeg has a bitstream filter of the name.
+		*/
+		static bool exists(const std::string& name) noexcept;
+
+		/*
+		* @returns the filter that turns packets of the properties from the length-prefixed form of MP4/MKV
+		* into the Annex B form (start codes) that MPEG-TS, raw files, and many hardware decoders expect,
+		* i.e. h264_mp4toannexb or hevc_mp4toannexb. Empty if none is needed:
+		* the codec is neither, or the extradata shows the packets already are Annex B.
+		*/
+		static std::string annexb_filter_for(const codec_properties& p);
+
+	private:
+		/*
+		* Common code of the constructors.
+		*/
+		void internal_create(const std::string& filters, const codec_properties& in_properties, rational in_time_base);
+
+	private:
+		::AVBSFContext* p_bsf_ctx = nullptr;
+		// A reference to each packet fed, which the filters take over.
+		::AVPacket* p_in = nullptr;
+
+		bool eof_signaled = false;
+		bool is_drained = false;
+	};
+}
@@ -0,0 +1,354 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "capability_registry.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	// Each list in an AVCodec has its own terminator.
+
+	size_t count_pixel_formats(const AVPixelFormat* p)
+	{
+		size_t n = 0;
+		while (p && p[n] != -1) // the array is -1-terminated.
+		{
+			++n;
+		}
+		return n;
+	}
+
+	size_t count_sample_formats(const AVSampleFormat* p)
+	{
+		size_t n = 0;
+		while (p && p[n] != -1) // the array is -1-terminated.
+		{
+			++n;
+		}
+		return n;
+	}
+
+	size_t count_sample_rates(const int* p)
+	{
+		size_t n = 0;
+		while (p && p[n] != 0) // terminated by 0
+		{
+			++n;
+		}
+		return n;
+	}
+
+	size_t count_channel_layouts(const AVChannelLayout* p)
+	{
+		size_t n = 0;
+		while (p && (p[n].nb_channels != 0 || p[n].order != 0)) // terminated by a zeroed layout
+		{
+			++n;
+		}
+		return n;
+	}
+
+	bool muxer_picks_codec_from_url(const AVOutputFormat* fmt)
+	{
+		// The ones av_guess_codec() treats specially.
+		for (const char* name : { "image2", "image2pipe", "segment", "ssegment" })
+		{
+			if (0 == std::strcmp(name, fmt->name))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+/////////////////////////////// codec_capabilities ///////////////////////////////
+
+ff::codec_capabilities::codec_capabilities(const AVCodec* codec)
+	: p_codec(codec),
+	pixel_formats(codec->pix_fmts, count_pixel_formats(codec->pix_fmts)),
+	sample_formats(codec->sample_fmts, count_sample_formats(codec->sample_fmts)),
+	sample_rates(codec->supported_samplerates, count_sample_rates(codec->supported_samplerates)),
+	channel_layouts(codec->ch_layouts, count_channel_layouts(codec->ch_layouts))
+{
+	// the array is {0,0}-terminated. And a valid frame rate cannot have den = 0.
+	for (const AVRational* pf = codec->supported_framerates; pf && pf->den != 0; ++pf)
+	{
+		frame_rates.emplace_back(*pf);
+	}
+
+	if (!pixel_formats.empty())
+	{
+		pixel_format_set.resize(AV_PIX_FMT_NB);
+		for (AVPixelFormat f : pixel_formats)
+		{
+			if (f >= 0 && f < AV_PIX_FMT_NB)
+			{
+				pixel_format_set[f] = true;
+			}
+		}
+	}
+	if (!sample_formats.empty())
+	{
+		sample_format_set.resize(AV_SAMPLE_FMT_NB);
+		for (AVSampleFormat f : sample_formats)
+		{
+			if (f >= 0 && f < AV_SAMPLE_FMT_NB)
+			{
+				sample_format_set[f] = true;
+			}
+		}
+	}
+}
+
+const char* ff::codec_capabilities::name() const noexcept
+{
+	return p_codec->name;
+}
+
+AVCodecID ff::codec_capabilities::id() const noexcept
+{
+	return p_codec->id;
+}
+
+AVMediaType ff::codec_capabilities::type() const noexcept
+{
+	return p_codec->type;
+}
+
+bool ff::codec_capabilities::is_encoder() const noexcept
+{
+	return 0 != av_codec_is_encoder(p_codec);
+}
+
+bool ff::codec_capabilities::supports_v_pixel_format(AVPixelFormat fmt) const noexcept
+{
+	return fmt >= 0 && static_cast<size_t>(fmt) < pixel_format_set.size() && pixel_format_set[fmt];
+}
+
+bool ff::codec_capabilities::supports_a_sample_format(AVSampleFormat fmt) const noexcept
+{
+	return fmt >= 0 && static_cast<size_t>(fmt) < sample_format_set.size() && sample_format_set[fmt];
+}
+
+bool ff::codec_capabilities::supports_v_frame_rate(ff::rational fr) const noexcept
+{
+	return frame_rates.end() != std::find(frame_rates.begin(), frame_rates.end(), fr);
+}
+
+bool ff::codec_capabilities::supports_a_sample_rate(int rate) const noexcept
+{
+	return sample_rates.end() != std::find(sample_rates.begin(), sample_rates.end(), rate);
+}
+
+bool ff::codec_capabilities::supports_a_channel_layout(const AVChannelLayout& layout) const noexcept
+{
+	for (const AVChannelLayout& l : channel_layouts)
+	{
+		if (0 == av_channel_layout_compare(&l, &layout))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/////////////////////////////// muxer_capabilities ///////////////////////////////
+
+ff::muxer_capabilities::muxer_capabilities(const AVOutputFormat* fmt, const std::vector<AVCodecID>& encoder_ids)
+	: p_fmt(fmt),
+	v_default(fmt->video_codec), a_default(fmt->audio_codec), s_default(fmt->subtitle_codec),
+	depends_on_url(muxer_picks_codec_from_url(fmt)),
+	codecs_known(true)
+{
+	for (AVCodecID id : encoder_ids)
+	{
+		const int ret = avformat_query_codec(fmt, id, FF_COMPLIANCE_NORMAL);
+		if (ret < 0)
+		{
+			// The muxer has neither a tag table nor a query function.
+			codecs_known = false;
+			codecs.clear();
+			codec_set.clear();
+			break;
+		}
+		if (ret > 0)
+		{
+			// encoder_ids are in ascending order, so are they.
+			codecs.push_back(id);
+			codec_set.insert(id);
+		}
+	}
+}
+
+const char* ff::muxer_capabilities::name() const noexcept
+{
+	return p_fmt->name;
+}
+
+AVCodecID ff::muxer_capabilities::default_codec(AVMediaType type) const noexcept
+{
+	switch (type)
+	{
+	case AVMEDIA_TYPE_VIDEO:
+		return v_default;
+	case AVMEDIA_TYPE_AUDIO:
+		return a_default;
+	case AVMEDIA_TYPE_SUBTITLE:
+		return s_default;
+	default:
+		return AV_CODEC_ID_NONE;
+	}
+}
+
+bool ff::muxer_capabilities::supports_codec(AVCodecID id) const
+{
+	if (!codecs_known)
+	{
+		throw std::domain_error("Don't know which codecs the muxer supports.");
+	}
+
+	return codec_set.contains(id);
+}
+
+/////////////////////////////// capability_registry ///////////////////////////////
+
+const ff::capability_registry& ff::capability_registry::get()
+{
+	// Built on the first call. C++ guarantees that happens once even if several threads call it.
+	static const capability_registry registry;
+	return registry;
+}
+
+ff::capability_registry::capability_registry()
+{
+	// Collect first, so that the vector never reallocates after pointers are handed out.
+	std::vector<const AVCodec*> all_codecs;
+	void* it = nullptr;
+	for (const AVCodec* c = av_codec_iterate(&it); nullptr != c; c = av_codec_iterate(&it))
+	{
+		all_codecs.push_back(c);
+	}
+
+	codecs.reserve(all_codecs.size());
+	for (const AVCodec* c : all_codecs)
+	{
+		const size_t i = codecs.size();
+		codecs.push_back(codec_capabilities(c));
+		codec_by_ptr.emplace(c, i);
+
+		// The first one of a name wins, like avcodec_find_..._by_name().
+		if (av_codec_is_encoder(c))
+		{
+			encoder_by_name.emplace(c->name, i);
+			enc_ids.push_back(c->id);
+		}
+		else
+		{
+			decoder_by_name.emplace(c->name, i);
+		}
+	}
+
+	std::sort(enc_ids.begin(), enc_ids.end());
+	enc_ids.erase(std::unique(enc_ids.begin(), enc_ids.end()), enc_ids.end());
+
+	// Let FFmpeg choose for each ID, as it prefers non-experimental codecs.
+	for (const codec_capabilities& c : codecs)
+	{
+		const AVCodecID id = c.id();
+		if (!encoder_by_id.contains(id))
+		{
+			if (const AVCodec* enc = avcodec_find_encoder(id))
+			{
+				encoder_by_id.emplace(id, codec_by_ptr.at(enc));
+			}
+		}
+		if (!decoder_by_id.contains(id))
+		{
+			if (const AVCodec* dec = avcodec_find_decoder(id))
+			{
+				decoder_by_id.emplace(id, codec_by_ptr.at(dec));
+			}
+		}
+	}
+
+	std::vector<const AVOutputFormat*> all_muxers;
+	it = nullptr;
+	for (const AVOutputFormat* f = av_muxer_iterate(&it); nullptr != f; f = av_muxer_iterate(&it))
+	{
+		all_muxers.push_back(f);
+	}
+
+	muxers.reserve(all_muxers.size());
+	for (const AVOutputFormat* f : all_muxers)
+	{
+		const size_t i = muxers.size();
+		muxers.push_back(muxer_capabilities(f, enc_ids));
+		muxer_by_ptr.emplace(f, i);
+		muxer_by_name.emplace(f->name, i);
+	}
+}
+
+const ff::codec_capabilities* ff::capability_registry::codec(const AVCodec* codec) const noexcept
+{
+	const auto it = codec_by_ptr.find(codec);
+	return codec_by_ptr.end() == it ? nullptr : &codecs[it->second];
+}
+
+const ff::codec_capabilities* ff::capability_registry::encoder(AVCodecID id) const noexcept
+{
+	const auto it = encoder_by_id.find(id);
+	return encoder_by_id.end() == it ? nullptr : &codecs[it->second];
+}
+
+const ff::codec_capabilities* ff::capability_registry::encoder(const std::string& name) const noexcept
+{
+	const auto it = encoder_by_name.find(name);
+	return encoder_by_name.end() == it ? nullptr : &codecs[it->second];
+}
+
+const ff::codec_capabilities* ff::capability_registry::decoder(AVCodecID id) const noexcept
+{
+	const auto it = decoder_by_id.find(id);
+	return decoder_by_id.end() == it ? nullptr : &codecs[it->second];
+}
+
+const ff::codec_capabilities* ff::capability_registry::decoder(const std::string& name) const noexcept
+{
+	const auto it = decoder_by_name.find(name);
+	return decoder_by_name.end() == it ? nullptr : &codecs[it->second];
+}
+
+const ff::muxer_capabilities* ff::capability_registry::muxer(const AVOutputFormat* fmt) const noexcept
+{
+	const auto it = muxer_by_ptr.find(fmt);
+	return muxer_by_ptr.end() == it ? nullptr : &muxers[it->second];
+}
+
+const ff::muxer_capabilities* ff::capability_registry::muxer(const std::string& name) const noexcept
+{
+	const auto it = muxer_by_name.find(name);
+	return muxer_by_name.end() == it ? nullptr : &muxers[it->second];
+}
@@ -0,0 +1,261 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/ff_math.h"
+
+extern "C"
+{
+#include <libavcodec/codec_id.h>
+#include <libavutil/avutil.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/pixfmt.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct AVCodec;
+struct AVOutputFormat;
+
+namespace ff
+{
+	/*
+	* What a codec supports, as its description in FFmpeg says.
+	* The spans refer to storage that lives as long as the program, so they can be kept.
+	*
+	* FFmpeg leaves a list out when the codec doesn't know what it supports,
+	* in which case the knows_...() of it returns false and the span is empty.
+	*/
+	class FF_WRAPPER_API codec_capabilities final
+	{
+		friend class capability_registry;
+
+	public:
+		codec_capabilities() = delete;
+
+	public:
+		const AVCodec* av_codec() const noexcept { return p_codec; }
+		const char* name() const noexcept;
+		AVCodecID id() const noexcept;
+		AVMediaType type() const noexcept;
+		bool is_encoder() const noexcept;
+
+		bool knows_v_pixel_formats() const noexcept { return !pixel_formats.empty(); }
+		bool knows_v_frame_rates() const noexcept { return !frame_rates.empty(); }
+		bool knows_a_sample_formats() const noexcept { return !sample_formats.empty(); }
+		bool knows_a_sample_rates() const noexcept { return !sample_rates.empty(); }
+		bool knows_a_channel_layouts() const noexcept { return !channel_layouts.empty(); }
+
+		/*
+		* In the order of the codec's description, so the first is usually the best.
+		* Empty if unknown.
+		*/
+		std::span<const AVPixelFormat> v_pixel_formats() const noexcept { return pixel_formats; }
+		std::span<const ff::rational> v_frame_rates() const noexcept { return frame_rates; }
+		std::span<const AVSampleFormat> a_sample_formats() const noexcept { return sample_formats; }
+		std::span<const int> a_sample_rates() const noexcept { return sample_rates; }
+		std::span<const AVChannelLayout> a_channel_layouts() const noexcept { return channel_layouts; }
+
+		/*
+		* O(1).
+		* @returns false if fmt is not supported or if the supported ones are unknown.
+		*/
+		bool supports_v_pixel_format(AVPixelFormat fmt) const noexcept;
+		/*
+		* O(1).
+		* @returns false if fmt is not supported or if the supported ones are unknown.
+		*/
+		bool supports_a_sample_format(AVSampleFormat fmt) const noexcept;
+		/*
+		* Linear, but the lists are a handful long.
+		* @returns false if it is not supported or if the supported ones are unknown.
+		*/
+		bool supports_v_frame_rate(ff::rational fr) const noexcept;
+		/*
+		* Linear, but the lists are a handful long.
+		* @returns false if it is not supported or if the supported ones are unknown.
+		*/
+		bool supports_a_sample_rate(int rate) const noexcept;
+		/*
+		* Linear, but the lists are a handful long.
+		* @returns false if it is not supported or if the supported ones are unknown.
+		*/
+		bool supports_a_channel_layout(const AVChannelLayout& layout) const noexcept;
+
+	private:
+		explicit codec_capabilities(const AVCodec* codec);
+
+	private:
+		const AVCodec* p_codec;
+
+		// Point into the codec's description.
+		std::span<const AVPixelFormat> pixel_formats;
+		std::span<const AVSampleFormat> sample_formats;
+		std::span<const int> sample_rates;
+		std::span<const AVChannelLayout> channel_layouts;
+
+		// AVRational converted once.
+		std::vector<ff::rational> frame_rates;
+
+		// Indexed by the format, for O(1) membership tests.
+		std::vector<bool> pixel_format_set;
+		std::vector<bool> sample_format_set;
+	};
+
+	/*
+	* What a muxer supports: its default codecs and the codecs it can store.
+	*/
+	class FF_WRAPPER_API muxer_capabilities final
+	{
+		friend class capability_registry;
+
+	public:
+		muxer_capabilities() = delete;
+
+	public:
+		const AVOutputFormat* av_output_format() const noexcept { return p_fmt; }
+		const char* name() const noexcept;
+
+		/*
+		* @returns the ID the muxer would pick for a stream of type, as av_guess_codec() does without a url.
+		* AV_CODEC_ID_NONE if the muxer does not take the type.
+		*/
+		AVCodecID default_codec(AVMediaType type) const noexcept;
+
+		/*
+		* Some muxers (e.g. image2 and segment) pick their default codecs from the url.
+		* For them, default_codec() is only the fallback and av_guess_codec() should be asked with the url.
+		*/
+		bool default_codec_depends_on_url() const noexcept { return depends_on_url; }
+
+		/*
+		* @returns false if the muxer doesn't say which codecs it can store,
+		* in which case supports_codec() throws.
+		*/
+		bool knows_codecs() const noexcept { return codecs_known; }
+
+		/*
+		* @returns the IDs of the codecs with an encoder that the muxer can store, in ascending order.
+		* Empty if !knows_codecs().
+		*/
+		std::span<const AVCodecID> supported_codecs() const noexcept { return codecs; }
+
+		/*
+		* O(1).
+		* @returns true iff the muxer can store a stream of codec id.
+		* @throws std::domain_error if !knows_codecs().
+		*/
+		bool supports_codec(AVCodecID id) const;
+
+	private:
+		/*
+		* @param encoder_ids the IDs of all the encoders, against which the muxer is queried.
+		*/
+		muxer_capabilities(const AVOutputFormat* fmt, const std::vector<AVCodecID>& encoder_ids);
+
+	private:
+		const AVOutputFormat* p_fmt;
+
+		AVCodecID v_default, a_default, s_default;
+		bool depends_on_url;
+
+		bool codecs_known;
+		std::vector<AVCodecID> codecs;
+		std::unordered_set<AVCodecID> codec_set;
+	};
+
+	/*
+	* A process-wide index of what every codec and muxer in this build of FFmpeg supports,
+	* so that negotiating formats doesn't walk FFmpeg's descriptions or build vectors every time.
+	*
+	* It's built once, on the first call to get(), and never changes after that,
+	* so any number of threads can read it without locking.
+	* Every lookup is a hash of a pointer, an ID, or a name.
+	*/
+	class FF_WRAPPER_API capability_registry final
+	{
+	public:
+		/*
+		* @returns the registry, building it if this is the first call. Thread-safe.
+		*/
+		static const capability_registry& get();
+
+		capability_registry(const capability_registry&) = delete;
+		capability_registry& operator=(const capability_registry&) = delete;
+
+	public:
+		/*
+		* @returns the capabilities of the codec (an encoder or a decoder), or nullptr if it's unknown.
+		*/
+		const codec_capabilities* codec(const AVCodec* codec) const noexcept;
+		/*
+		* @returns the capabilities of the encoder FFmpeg would pick for id (avcodec_find_encoder()),
+		* or nullptr if there's none.
+		*/
+		const codec_capabilities* encoder(AVCodecID id) const noexcept;
+		/*
+		* @returns the capabilities of the encoder named name, or nullptr if there's none.
+		*/
+		const codec_capabilities* encoder(const std::string& name) const noexcept;
+		/*
+		* @returns the capabilities of the decoder FFmpeg would pick for id (avcodec_find_decoder()),
+		* or nullptr if there's none.
+		*/
+		const codec_capabilities* decoder(AVCodecID id) const noexcept;
+		/*
+		* @returns the capabilities of the decoder named name, or nullptr if there's none.
+		*/
+		const codec_capabilities* decoder(const std::string& name) const noexcept;
+
+		/*
+		* @returns the capabilities of the muxer, or nullptr if it's unknown.
+		*/
+		const muxer_capabilities* muxer(const AVOutputFormat* fmt) const noexcept;
+		/*
+		* @returns the capabilities of the muxer named name (e.g. "mp4"), or nullptr if there's none.
+		*/
+		const muxer_capabilities* muxer(const std::string& name) const noexcept;
+
+		/*
+		* @returns the IDs of all the codecs that have an encoder, in ascending order.
+		*/
+		std::span<const AVCodecID> encoder_ids() const noexcept { return enc_ids; }
+
+	private:
+		// Walks all the codecs and muxers.
+		capability_registry();
+
+	private:
+		// The capabilities themselves. Never changed after construction, so pointers to them stay valid.
+		std::vector<codec_capabilities> codecs;
+		std::vector<muxer_capabilities> muxers;
+
+		// Indices into the vectors above.
+		std::unordered_map<const AVCodec*, size_t> codec_by_ptr;
+		std::unordered_map<AVCodecID, size_t> encoder_by_id, decoder_by_id;
+		std::unordered_map<std::string, size_t> encoder_by_name, decoder_by_name;
+		std::unordered_map<const AVOutputFormat*, size_t> muxer_by_ptr;
+		std::unordered_map<std::string, size_t> muxer_by_name;
+
+		std::vector<AVCodecID> enc_ids;
+	};
+}
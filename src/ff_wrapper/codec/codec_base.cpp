@@ -17,20 +17,43 @@
 #include "codec_base.h"
 #include "../util/ff_helpers.h"
 #include "../util/channel_layout.h"
+#include "capability_registry.h"
 
 extern "C"
 {
 #include <libavcodec/avcodec.h>
 }
 
+namespace
+{
+	/*
+	* @returns the capabilities of c.
+	* @throws std::logic_error if c is destroyed, or if it is not for type.
+	*/
+	const ff::codec_capabilities& capabilities_of_type(const ff::codec_base& c, AVMediaType type)
+	{
+		const ff::codec_capabilities& caps = c.capabilities();
+		if (caps.type() != type)
+		{
+			throw std::logic_error(AVMEDIA_TYPE_VIDEO == type ?
+				"The codec is not for videos." : "The codec is not for audios.");
+		}
+
+		return caps;
+	}
+}
+
 ff::codec_base::codec_base(codec_base&& other) noexcept
 	: ff_object(std::move(other)),
 	codec_id(other.codec_id), codec_name(other.codec_name),
 	p_codec_desc(other.p_codec_desc), p_codec_ctx(other.p_codec_ctx),
-	is_full(other.is_full), is_hungry(other.is_hungry), signaled_no_more_food(other.signaled_no_more_food)
+	is_full(other.is_full), is_hungry(other.is_hungry), signaled_no_more_food(other.signaled_no_more_food),
+	threading(other.threading),
+	lent_by(other.lent_by), pool_key(std::move(other.pool_key))
 {
 	other.p_codec_ctx = nullptr;
 	other.p_codec_desc = nullptr;
+	other.lent_by = nullptr;
 }
 
 ff::codec_base& ff::codec_base::operator=(codec_base&& right) noexcept
@@ -44,9 +67,13 @@ ff::codec_base& ff::codec_base::operator=(codec_base&& right) noexcept
 	is_full = right.is_full;
 	is_hungry = right.is_hungry;
 	signaled_no_more_food = right.signaled_no_more_food;
+	threading = right.threading;
+	lent_by = right.lent_by;
+	pool_key = std::move(right.pool_key);
 
 	right.p_codec_ctx = nullptr;
 	right.p_codec_desc = nullptr;
+	right.lent_by = nullptr;
 
 	return *this;
 }
@@ -103,10 +130,70 @@ void ff::codec_base::set_codec_properties(const codec_properties& p)
 	}
 }
 
+void ff::codec_base::set_threading_policy(const threading_policy& p)
+{
+	if (!created())
+	{
+		throw std::logic_error("The threading policy can only be set when the codec is just created.");
+	}
+	if (p.num_threads < 0)
+	{
+		throw std::invalid_argument("The number of threads cannot be negative.");
+	}
+	if (p.types & ~FF_THREADING_BOTH)
+	{
+		throw std::invalid_argument("Unknown threading types.");
+	}
+
+	threading = p;
+}
+
+int ff::codec_base::active_num_threads() const
+{
+	if (!ready())
+	{
+		throw std::logic_error("The codec is not ready.");
+	}
+
+	return p_codec_ctx->thread_count;
+}
+
+int ff::codec_base::active_threading_types() const
+{
+	if (!ready())
+	{
+		throw std::logic_error("The codec is not ready.");
+	}
+
+	return p_codec_ctx->active_thread_type;
+}
+
+int ff::codec_base::frame_threading_delay() const
+{
+	if (!ready())
+	{
+		throw std::logic_error("The codec is not ready.");
+	}
+
+	// With frame threading, FFmpeg hands one frame to each thread before it returns anything,
+	// so the first output comes out thread_count - 1 food later.
+	if ((p_codec_ctx->active_thread_type & FF_THREAD_FRAME) && p_codec_ctx->thread_count > 1)
+	{
+		return p_codec_ctx->thread_count - 1;
+	}
+
+	return 0;
+}
+
 void ff::codec_base::internal_allocate_resources_memory(uint64_t size, void* additional_information)
 {
 	auto ppavd = static_cast<::AVDictionary**>(additional_information);
 
+	// Apply the threading policy. Must be done before avcodec_open2(),
+	// and the options passed in can still override it.
+	p_codec_ctx->thread_count = threading.num_threads;
+	p_codec_ctx->thread_type = threading.types;
+
 	// Open the codec ctx in the context with the options.
 	int ret = avcodec_open2(p_codec_ctx, p_codec_desc, ppavd);
 	if (ret < 0)
@@ -138,303 +225,136 @@ void ff::codec_base::internal_release_resources_memory() noexcept
 	avcodec_close(p_codec_ctx);
 }
 
-bool ff::codec_base::is_v_pixel_format_supported(AVPixelFormat fmt) const
+const ff::codec_capabilities& ff::codec_base::capabilities() const
 {
 	if (destroyed())
 	{
 		throw std::logic_error("The codec is destroyed.");
 	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_VIDEO)
-	{
-		throw std::logic_error("The codec is not for videos.");
-	}
 
-	if (!p_codec_desc->pix_fmts) // unknown
+	const codec_capabilities* caps = capability_registry::get().codec(p_codec_desc);
+	FF_ASSERT(nullptr != caps, "Every codec FFmpeg can find should be in the registry.");
+	return *caps;
+}
+
+bool ff::codec_base::is_v_pixel_format_supported(AVPixelFormat fmt) const
+{
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_VIDEO);
+	if (!caps.knows_v_pixel_formats())
 	{
 		throw std::domain_error("Don't know which pix fmts are supported.");
 	}
-	else
-	{
-		const AVPixelFormat* pf = p_codec_desc->pix_fmts;
-		while (*pf != -1) // the array is -1-terminated.
-		{
-			if (fmt == *pf)
-			{
-				return true;
-			}
-			++pf;
-		}
-	}
 
-	return false;
+	return caps.supports_v_pixel_format(fmt);
 }
 
 bool ff::codec_base::is_v_frame_rate_supported(ff::rational fr) const
 {
-	if (destroyed())
-	{
-		throw std::logic_error("The codec is destroyed.");
-	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_VIDEO)
-	{
-		throw std::logic_error("The codec is not for videos.");
-	}
-
-	if (!p_codec_desc->supported_framerates) // unknown
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_VIDEO);
+	if (!caps.knows_v_frame_rates())
 	{
 		throw std::domain_error("Don't know which frame rates are supported.");
 	}
-	else
-	{
-		const AVRational* pf = p_codec_desc->supported_framerates;
-		while (pf->den != 0) // the array is {0,0}-terminated. And a valid frame rate cannot have den = 0.
-		{
-			if (fr == *pf)
-			{
-				return true;
-			}
-			++pf;
-		}
-	}
 
-	return false;
+	return caps.supports_v_frame_rate(fr);
 }
 
 bool ff::codec_base::is_a_sample_format_supported(AVSampleFormat fmt) const
 {
-	if (destroyed())
-	{
-		throw std::logic_error("The codec is destroyed.");
-	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_AUDIO)
-	{
-		throw std::logic_error("The codec is not for audios.");
-	}
-
-	if (!p_codec_desc->sample_fmts) // unknown
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_AUDIO);
+	if (!caps.knows_a_sample_formats())
 	{
 		throw std::domain_error("Don't know which sample fmts are supported.");
 	}
-	else
-	{
-		const AVSampleFormat* pf = p_codec_desc->sample_fmts;
-		while (*pf != -1) // the array is -1-terminated.
-		{
-			if ((AVSampleFormat)fmt == *pf)
-			{
-				return true;
-			}
-			++pf;
-		}
-	}
 
-	return false;
+	return caps.supports_a_sample_format(fmt);
 }
 
 bool ff::codec_base::is_a_sample_rate_supported(int rate) const
 {
-	if (destroyed())
-	{
-		throw std::logic_error("The codec is destroyed.");
-	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_AUDIO)
-	{
-		throw std::logic_error("The codec is not for audios.");
-	}
-
-	if (!p_codec_desc->supported_samplerates) // unknown
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_AUDIO);
+	if (!caps.knows_a_sample_rates())
 	{
 		throw std::domain_error("Don't know which sample rates are supported.");
 	}
-	else
-	{
-		const int* psr = p_codec_desc->supported_samplerates;
-		while (*psr != 0) // terminated by 0
-		{
-			if (rate == *psr)
-			{
-				return true;
-			}
-			++psr;
-		}
-	}
 
-	return false;
+	return caps.supports_a_sample_rate(rate);
 }
+
 bool ff::codec_base::is_a_channel_layout_supported(const AVChannelLayout& layout) const
 {
-	if (destroyed())
-	{
-		throw std::logic_error("The codec is destroyed.");
-	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_AUDIO)
-	{
-		throw std::logic_error("The codec is not for audios.");
-	}
-
-	if (!p_codec_desc->ch_layouts)
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_AUDIO);
+	if (!caps.knows_a_channel_layouts())
 	{
 		throw std::domain_error("Don't know which channel layouts are supported.");
 	}
-	else
-	{
-		const AVChannelLayout* pcl = p_codec_desc->ch_layouts;
-		while (pcl->nb_channels != 0 || pcl->order != 0) // terminated by a zeroed layout
-		{
-			if (layout == *pcl)
-			{
-				return true;
-			}
-			++pcl;
-		}
-	}
 
-	return false;
+	return caps.supports_a_channel_layout(layout);
 }
 
 std::vector<AVPixelFormat> ff::codec_base::supported_v_pixel_formats() const
 {
-	if (destroyed())
-	{
-		throw std::logic_error("The codec is destroyed.");
-	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_VIDEO)
-	{
-		throw std::logic_error("The codec is not for videos.");
-	}
-
-	if (!p_codec_desc->pix_fmts) // unknown
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_VIDEO);
+	if (!caps.knows_v_pixel_formats())
 	{
 		throw std::domain_error("Don't know which pix fmts are supported.");
 	}
-	else
-	{
-		std::vector<AVPixelFormat> res;
-		const AVPixelFormat* pf = p_codec_desc->pix_fmts;
-		while (*pf != -1) // the array is -1-terminated.
-		{
-			res.push_back(*pf);
-			++pf;
-		}
 
-		return res;
-	}
+	const auto s = caps.v_pixel_formats();
+	return std::vector<AVPixelFormat>(s.begin(), s.end());
 }
 
 std::vector<ff::rational> ff::codec_base::supported_v_frame_rates() const
 {
-	if (destroyed())
-	{
-		throw std::logic_error("The codec is destroyed.");
-	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_VIDEO)
-	{
-		throw std::logic_error("The codec is not for videos.");
-	}
-
-	if (!p_codec_desc->supported_framerates) // unknown
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_VIDEO);
+	if (!caps.knows_v_frame_rates())
 	{
 		throw std::domain_error("Don't know which frame_rates are supported.");
 	}
-	else
-	{
-		std::vector<ff::rational> res;
-		const AVRational* pf = p_codec_desc->supported_framerates;
-		while (pf->den != 0) // the array is {0,0}-terminated. And a valid frame rate cannot have den = 0.
-		{
-			res.emplace_back(*pf);
-			++pf;
-		}
 
-		return res;
-	}
+	const auto s = caps.v_frame_rates();
+	return std::vector<ff::rational>(s.begin(), s.end());
 }
 
 std::vector<AVSampleFormat> ff::codec_base::supported_a_sample_formats() const
 {
-	if (destroyed())
-	{
-		throw std::logic_error("The codec is destroyed.");
-	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_AUDIO)
-	{
-		throw std::logic_error("The codec is not for audios.");
-	}
-
-	if (!p_codec_desc->sample_fmts) // unknown
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_AUDIO);
+	if (!caps.knows_a_sample_formats())
 	{
 		throw std::domain_error("Don't know which sample fmts are supported.");
 	}
-	else
-	{
-		std::vector<AVSampleFormat> res;
-		const AVSampleFormat* pf = p_codec_desc->sample_fmts;
-		while (*pf != -1) // the array is -1-terminated.
-		{
-			res.push_back(*pf);
-			++pf;
-		}
 
-		return res;
-	}
+	const auto s = caps.a_sample_formats();
+	return std::vector<AVSampleFormat>(s.begin(), s.end());
 }
 
 std::vector<int> ff::codec_base::supported_a_sample_rates() const
 {
-	if (destroyed())
-	{
-		throw std::logic_error("The codec is destroyed.");
-	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_AUDIO)
-	{
-		throw std::logic_error("The codec is not for audios.");
-	}
-
-	if (!p_codec_desc->supported_samplerates) // unknown
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_AUDIO);
+	if (!caps.knows_a_sample_rates())
 	{
 		throw std::domain_error("Don't know which sample rates are supported.");
 	}
-	else
-	{
-		std::vector<int> res;
-		const int* psr = p_codec_desc->supported_samplerates;
-		while (*psr != 0) // terminated by 0
-		{
-			res.push_back(*psr);
-			++psr;
-		}
-		
-		return res;
-	}
+
+	const auto s = caps.a_sample_rates();
+	return std::vector<int>(s.begin(), s.end());
 }
 
 std::vector<const AVChannelLayout*> ff::codec_base::supported_a_channel_layouts() const
 {
-	if (destroyed())
-	{
-		throw std::logic_error("The codec is destroyed.");
-	}
-	if (p_codec_desc->type != AVMediaType::AVMEDIA_TYPE_AUDIO)
+	const codec_capabilities& caps = capabilities_of_type(*this, AVMEDIA_TYPE_AUDIO);
+	if (!caps.knows_a_channel_layouts())
 	{
-		throw std::logic_error("The codec is not for audios.");
+		throw std::domain_error("Don't know which channel layouts are supported.");
 	}
 
-	if (!p_codec_desc->ch_layouts)
+	std::vector<const AVChannelLayout*> res;
+	for (const AVChannelLayout& l : caps.a_channel_layouts())
 	{
-		throw std::domain_error("Don't know which channel layouts are supported.");
+		res.push_back(&l);
 	}
-	else
-	{
-		std::vector<const AVChannelLayout*> res;
-		const AVChannelLayout* pcl = p_codec_desc->ch_layouts;
-		while (pcl->nb_channels != 0 || pcl->order != 0) // terminated by a zeroed layout
-		{
-			res.push_back(pcl);
-			++pcl;
-		}
 
-		return res;
-	}
+	return res;
 }
 
 AVPixelFormat ff::codec_base::first_supported_v_pixel_format() const
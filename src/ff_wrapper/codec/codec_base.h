@@ -25,6 +25,7 @@ extern "C"
 #include <libavcodec/codec_id.h>
 }
 
+#include <string>
 #include <vector>
 
 struct AVCodec;
@@ -33,6 +34,8 @@ struct AVCodecContext;
 namespace ff
 {
 	class channel_layout;
+	class codec_capabilities;
+	class codec_pool;
 
 	/*
 	* Encapsulates the basic functions of a FFmpeg codec.
@@ -74,6 +77,15 @@ namespace ff
 	After that, repeatedly call decode_frame() for it to pop out what's left in its stomach 
 	until that returns a DESTROYED frame (then it has no more in its stomach).
 	*
+	* Threading:
+	* Before the context is created, you can choose how many threads the codec uses and
+	* whether it splits the work by frames, by slices, or both, through set_threading_policy().
+	* By default, FFmpeg decides the number of threads and both kinds are allowed.
+	* Frame threading keeps several frames in flight, one per thread, so a frame-threaded codec
+	* may stay hungry for up to frame_threading_delay() more food before it produces the first output,
+	* and will have as many outputs left in its stomach when you drain it. The process above
+	* still works without change; only expect more hungry() at the beginning and more outputs at the end.
+	*
 	* Invariants:
 	*	1. those of ff_object.
 	*	2. when ready(), !(hungry && full); no_more_food -> !hungry.
@@ -134,6 +146,87 @@ namespace ff
 		bool is_audio() const noexcept;
 		bool is_subtitle() const noexcept;
 
+	public:
+		/*
+		* The kinds of threading a codec can use.
+		* Copied from FFmpeg's FF_THREAD_* macros. Combine them with bitwise or.
+		*/
+		enum threading_types : int
+		{
+			FF_THREADING_NONE = 0,
+			FF_THREADING_FRAME = 1, // Decodes/Encodes more than one frame at once.
+			FF_THREADING_SLICE = 2, // Decodes/Encodes more than one part of a single frame at once.
+			FF_THREADING_BOTH = FF_THREADING_FRAME | FF_THREADING_SLICE
+		};
+
+		/*
+		* Describes how a codec should use threads.
+		* It is only a request. The codec uses the kinds it supports among those requested.
+		*/
+		struct threading_policy
+		{
+			/*
+			* @param num the number of threads. 0 means FFmpeg decides it automatically.
+			* @param t the kinds of threading allowed.
+			*/
+			constexpr threading_policy(int num = 0, int t = FF_THREADING_BOTH) noexcept
+				: num_threads(num), types(t) {}
+
+			// Uses only the calling thread.
+			static constexpr threading_policy single_threaded() noexcept
+			{
+				return threading_policy(1, FF_THREADING_NONE);
+			}
+
+			int num_threads;
+			int types;
+		};
+
+		/*
+		* Sets how the codec will use threads once its context is created.
+		* Options passed to create_codec_context() (e.g. "threads") override the policy.
+		*
+		* @throws std::logic_error if not created().
+		* @throws std::invalid_argument if p.num_threads < 0 or if p.types has unknown bits.
+		*/
+		void set_threading_policy(const threading_policy& p);
+		/*
+		* @returns the policy requested through set_threading_policy() or the default one.
+		*/
+		inline threading_policy get_threading_policy() const noexcept { return threading; }
+
+		/*
+		* @returns the number of threads the codec actually uses.
+		* @throws std::logic_error if not ready().
+		*/
+		int active_num_threads() const;
+		/*
+		* @returns the kinds of threading the codec actually uses (a combination of threading_types).
+		* @throws std::logic_error if not ready().
+		*/
+		int active_threading_types() const;
+		/*
+		* Frame threading keeps one frame per thread in flight.
+		* 
+		* @returns how many more food the codec may eat before it can produce the first output
+		* because of frame threading. 0 if frame threading is not used.
+		* @throws std::logic_error if not ready().
+		*/
+		int frame_threading_delay() const;
+
+	public:
+		/*
+		* What the batch methods (decoder::decode_frames(), encoder::encode_packets()) report.
+		*/
+		struct batch_result
+		{
+			// How many frames/packets were produced.
+			size_t count;
+			// Whether the batch stopped because the codec became hungry.
+			// If not, either the container was filled, or the codec has been drained.
+			bool hungry;
+		};
+
 	public:
 		/*
 		* See the comments for this class for what being hungry means.
@@ -166,6 +259,7 @@ namespace ff
 		* Opens the codec ctx based on the description found through allocate_object_memory()
 		the properties set through 
 		and the options passed in as a pointer of a dictionary through the parameter additional_information
+		* The threading policy is applied before the options, so that the options can override it.
 		*/
 		void internal_allocate_resources_memory(uint64_t size, void* additional_information) override;
 
@@ -181,6 +275,16 @@ namespace ff
 
 	public:
 /////////////////////////////// codec property methods ///////////////////////////////
+		/*
+		* The methods below look the codec up in the capability_registry.
+		* Prefer the spans of the capabilities to the supported_...() methods,
+		* which copy them into new vectors.
+		* 
+		* @returns what the codec supports. It lives as long as the program.
+		* @throws std::logic_error if destroyed().
+		*/
+		const codec_capabilities& capabilities() const;
+
 		/*
 		* @returns if the video pixel format is supported by this codec
 		* @throws std::logic_error if destroyed().
@@ -381,6 +485,16 @@ namespace ff
 		bool is_full = false;
 		bool signaled_no_more_food = false;
 
+		// Applied right before the context is opened.
+		threading_policy threading;
+
+	private:
+		friend class codec_pool;
+		// The codec_pool that lent me out, and the key I'm kept under there.
+		// Kept here rather than in the pool, so that they go away with me if I'm destroyed instead of recycled.
+		const codec_pool* lent_by = nullptr;
+		std::string pool_key;
+
 	protected:
 		// I should only call them inside 
 		// feed_packet(), decode_frame(), signal_no_more_food(), and reset().
@@ -0,0 +1,376 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "codec_pool.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/dict.h>
+#include <libavutil/channel_layout.h>
+}
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+ff::codec_pool::codec_pool(size_t max_idle_per_key)
+	: max_idle_per_key(max_idle_per_key)
+{
+}
+
+template <typename Codec>
+void ff::codec_pool::internal_open(Codec& c, const codec_properties& p, const dict& options, const threading_policy& policy)
+{
+	c.set_threading_policy(policy);
+	c.set_codec_properties(p);
+	c.create_codec_context(options);
+}
+
+void ff::codec_pool::internal_lend(codec_base& c, const std::string& key) const
+{
+	c.pool_key = key;
+	c.lent_by = this;
+}
+
+bool ff::codec_pool::internal_take_back(codec_base& c, std::string& key) const noexcept
+{
+	if (this != c.lent_by)
+	{
+		return false;
+	}
+	key = std::move(c.pool_key);
+	c.lent_by = nullptr;
+	return true;
+}
+
+ff::encoder ff::codec_pool::get_encoder(const char* name, const codec_properties& p, const dict& options, const threading_policy& policy)
+{
+	if (nullptr == name || nullptr == avcodec_find_encoder_by_name(name))
+	{
+		throw std::invalid_argument("No encoder has the name.");
+	}
+
+	return internal_get_encoder(name, p, options, policy);
+}
+
+ff::encoder ff::codec_pool::get_encoder(AVCodecID id, const codec_properties& p, const dict& options, const threading_policy& policy)
+{
+	const AVCodec* c = avcodec_find_encoder(id);
+	if (nullptr == c)
+	{
+		throw std::invalid_argument("No encoder has the ID.");
+	}
+
+	return internal_get_encoder(c->name, p, options, policy);
+}
+
+ff::decoder ff::codec_pool::get_decoder(const codec_properties& p, const dict& options, const threading_policy& policy)
+{
+	const AVCodec* c = avcodec_find_decoder(p.id());
+	if (nullptr == c)
+	{
+		throw std::invalid_argument("No decoder has the ID.");
+	}
+
+	const std::string key = internal_make_key(false, c->name, p, options, policy);
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = idle_decoders.find(key);
+		if (it != idle_decoders.end() && !it->second.empty())
+		{
+			decoder dec(std::move(it->second.back()));
+			it->second.pop_back();
+			--num_idle;
+			++num_hits;
+			internal_lend(dec, key);
+			return dec;
+		}
+		++num_misses;
+	}
+
+	// Opened outside the lock.
+	decoder dec(p.id());
+	internal_open(dec, p, options, policy);
+
+	internal_lend(dec, key);
+	return dec;
+}
+
+void ff::codec_pool::warm_up_encoders(size_t n, const char* name, const codec_properties& p, const dict& options, const threading_policy& policy)
+{
+	if (nullptr == name || nullptr == avcodec_find_encoder_by_name(name))
+	{
+		throw std::invalid_argument("No encoder has the name.");
+	}
+
+	const std::string key = internal_make_key(true, name, p, options, policy);
+	for (size_t i = 0; i < n; ++i)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (idle_encoders[key].size() >= max_idle_per_key)
+			{
+				return;
+			}
+		}
+
+		// A fresh encoder holds nothing, so it can be kept even if it can't be flushed.
+		encoder enc(name);
+		internal_open(enc, p, options, policy);
+
+		std::lock_guard<std::mutex> lock(mtx);
+		auto& idle = idle_encoders[key];
+		if (idle.size() >= max_idle_per_key)
+		{
+			return;
+		}
+		idle.push_back(std::move(enc));
+		++num_idle;
+	}
+}
+
+void ff::codec_pool::warm_up_decoders(size_t n, const codec_properties& p, const dict& options, const threading_policy& policy)
+{
+	const AVCodec* c = avcodec_find_decoder(p.id());
+	if (nullptr == c)
+	{
+		throw std::invalid_argument("No decoder has the ID.");
+	}
+
+	const std::string key = internal_make_key(false, c->name, p, options, policy);
+	for (size_t i = 0; i < n; ++i)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (idle_decoders[key].size() >= max_idle_per_key)
+			{
+				return;
+			}
+		}
+
+		decoder dec(p.id());
+		internal_open(dec, p, options, policy);
+
+		std::lock_guard<std::mutex> lock(mtx);
+		auto& idle = idle_decoders[key];
+		if (idle.size() >= max_idle_per_key)
+		{
+			return;
+		}
+		idle.push_back(std::move(dec));
+		++num_idle;
+	}
+}
+
+void ff::codec_pool::recycle(encoder& enc) noexcept
+{
+	if (enc.destroyed())
+	{
+		return;
+	}
+
+	// Moved out so that enc is destroyed in any case.
+	encoder taken(std::move(enc));
+
+	std::string key;
+	if (!internal_take_back(taken, key))
+	{
+		return;
+	}
+
+	// FFmpeg ignores avcodec_flush_buffers() on encoders that don't support it.
+	if (!taken.ready() || !(taken->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH))
+	{
+		return;
+	}
+
+	try
+	{
+		taken.reset();
+
+		std::lock_guard<std::mutex> lock(mtx);
+		// operator[] may throw std::bad_alloc, in which case the encoder is just closed.
+		auto& idle = idle_encoders[key];
+		if (idle.size() < max_idle_per_key)
+		{
+			idle.push_back(std::move(taken));
+			++num_idle;
+		}
+	}
+	catch (...)
+	{
+		// Closed by taken's destructor.
+	}
+}
+
+void ff::codec_pool::recycle(decoder& dec) noexcept
+{
+	if (dec.destroyed())
+	{
+		return;
+	}
+
+	decoder taken(std::move(dec));
+
+	std::string key;
+	if (!internal_take_back(taken, key))
+	{
+		return;
+	}
+
+	if (!taken.ready())
+	{
+		return;
+	}
+
+	try
+	{
+		taken.reset();
+
+		std::lock_guard<std::mutex> lock(mtx);
+		auto& idle = idle_decoders[key];
+		if (idle.size() < max_idle_per_key)
+		{
+			idle.push_back(std::move(taken));
+			++num_idle;
+		}
+	}
+	catch (...)
+	{
+		// Closed by taken's destructor.
+	}
+}
+
+void ff::codec_pool::clear() noexcept
+{
+	// Closed outside the lock.
+	std::unordered_map<std::string, std::vector<encoder>> encoders;
+	std::unordered_map<std::string, std::vector<decoder>> decoders;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		encoders.swap(idle_encoders);
+		decoders.swap(idle_decoders);
+		num_idle = 0;
+	}
+}
+
+size_t ff::codec_pool::number_idle_codecs() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return num_idle;
+}
+
+size_t ff::codec_pool::number_hits() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return num_hits;
+}
+
+size_t ff::codec_pool::number_misses() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return num_misses;
+}
+
+std::string ff::codec_pool::internal_make_key
+(
+	bool is_encoder, const char* codec_name, const codec_properties& p,
+	const dict& options, const threading_policy& policy
+)
+{
+	const AVCodecParameters* par = p.av_codec_parameters();
+	const ff::rational tb = p.time_base();
+
+	std::string key = std::format
+	(
+		"{}:{}|t{}|f{}|b{}|tb{}/{}|p{}/{}|th{}/{}",
+		is_encoder ? 'e' : 'd', codec_name,
+		static_cast<int>(par->codec_type), par->format, par->bit_rate,
+		tb.get_num(), tb.get_den(),
+		par->profile, par->level,
+		policy.num_threads, policy.types
+	);
+
+	if (AVMEDIA_TYPE_VIDEO == par->codec_type)
+	{
+		key += std::format
+		(
+			"|v{}x{}|fr{}/{}|sar{}/{}|fo{}|c{},{},{},{},{}",
+			par->width, par->height,
+			par->framerate.num, par->framerate.den,
+			par->sample_aspect_ratio.num, par->sample_aspect_ratio.den,
+			static_cast<int>(par->field_order),
+			static_cast<int>(par->color_range), static_cast<int>(par->color_space),
+			static_cast<int>(par->color_primaries), static_cast<int>(par->color_trc),
+			static_cast<int>(par->chroma_location)
+		);
+	}
+	else if (AVMEDIA_TYPE_AUDIO == par->codec_type)
+	{
+		char layout[128] = {};
+		av_channel_layout_describe(&par->ch_layout, layout, sizeof(layout));
+		key += std::format("|a{}|l{}|n{}", par->sample_rate, layout, par->frame_size);
+	}
+
+	// Decoders are configured by the extradata (e.g. SPS/PPS).
+	key += std::format("|x{}:", par->extradata_size);
+	if (par->extradata_size > 0)
+	{
+		key.append(reinterpret_cast<const char*>(par->extradata), static_cast<size_t>(par->extradata_size));
+	}
+
+	// Sorted, so that the same options in different orders give the same key.
+	std::vector<std::pair<std::string, std::string>> opts;
+	const AVDictionaryEntry* e = nullptr;
+	while (nullptr != (e = av_dict_iterate(options.get_av_dict(), e)))
+	{
+		opts.emplace_back(e->key, e->value);
+	}
+	std::sort(opts.begin(), opts.end());
+	for (const auto& [k, v] : opts)
+	{
+		key += std::format("|o{}={}", k, v);
+	}
+
+	return key;
+}
+
+ff::encoder ff::codec_pool::internal_get_encoder(const char* name, const codec_properties& p, const dict& options, const threading_policy& policy)
+{
+	const std::string key = internal_make_key(true, name, p, options, policy);
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = idle_encoders.find(key);
+		if (it != idle_encoders.end() && !it->second.empty())
+		{
+			encoder enc(std::move(it->second.back()));
+			it->second.pop_back();
+			--num_idle;
+			++num_hits;
+			internal_lend(enc, key);
+			return enc;
+		}
+		++num_misses;
+	}
+
+	// Opened outside the lock.
+	encoder enc(name);
+	internal_open(enc, p, options, policy);
+
+	internal_lend(enc, key);
+	return enc;
+}
@@ -0,0 +1,238 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/dict.h"
+#include "codec_properties.h"
+#include "encoder.h"
+#include "decoder.h"
+
+extern "C"
+{
+#include <libavcodec/codec_id.h>
+}
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* Keeps opened encoders and decoders so that jobs don't have to open them again.
+	* 
+	* Opening a codec (i.e. create_codec_context(), which runs avcodec_open2) can take
+	* tens of milliseconds for encoders like libx264 and libx265, which is a noticeable
+	* share of the time of a job on a short clip. Instead, a job gets a ready codec from
+	* the pool, uses it, and gives it back through recycle(), which reset()s it for the next job.
+	* 
+	* Codecs are keyed by
+	*	1. encoder or decoder, and the codec (its name),
+	*	2. the codec_properties it's opened with (including the time base and the extradata),
+	*	3. the options dict it's opened with,
+	*	4. the threading policy.
+	* A codec given out is only given again to one who asks for exactly the same.
+	* 
+	* Which codecs can be reused:
+	*	Decoders always can.
+	*	An encoder only can if it supports flushing (AV_CODEC_CAP_ENCODER_FLUSH), because
+	*	FFmpeg won't reset those who don't, once they are drained or hold frames.
+	*	recycle() simply closes the others, so for them the pool works as if it weren't there.
+	* 
+	* Only what the key describes is restored. If you change a codec after getting it
+	* (e.g. encoder::use_packet_pool() or its context fields directly), recycle() will not undo that.
+	* Hardware codecs are not supported, as the key doesn't describe the devices.
+	* 
+	* A codec given out carries its key itself, so one destroyed instead of recycled leaves nothing in the pool,
+	* and one recycled to another pool is simply closed.
+	* Codecs may outlive the pool; recycling one to the pool after the pool's gone is undefined.
+	* All the methods can be called from multiple threads at the same time.
+	* Codecs are opened outside the lock, so jobs opening codecs at the same time don't wait for each other.
+	*/
+	class FF_WRAPPER_API codec_pool final
+	{
+	public:
+		using threading_policy = codec_base::threading_policy;
+
+		/*
+		* @param max_idle_per_key at most how many codecs given back will be kept for each key.
+		* The rest are closed.
+		*/
+		explicit codec_pool(size_t max_idle_per_key = 4);
+
+		codec_pool(const codec_pool&) = delete;
+		codec_pool& operator=(const codec_pool&) = delete;
+
+		/*
+		* Closes the codecs kept.
+		* Codecs still in use are not affected.
+		*/
+		~codec_pool() noexcept = default;
+
+	public:
+		/*
+		* Gets a ready encoder, opened if none is kept for the same key.
+		* 
+		* @param name the name of the encoder.
+		* @param p the properties to open it with. See encoder::set_codec_properties().
+		* @param options the options to open it with. Can be empty.
+		* @param policy the threading policy to open it with.
+		* @returns a ready, hungry encoder.
+		* @throws std::invalid_argument if no encoder has the name.
+		* @throws what encoder::set_codec_properties() and create_codec_context() throw.
+		*/
+		encoder get_encoder
+		(
+			const char* name, const codec_properties& p,
+			const dict& options = dict(), const threading_policy& policy = threading_policy()
+		);
+		/*
+		* The same as get_encoder(name, ...), except the encoder is identified by its ID.
+		*
+		* @throws std::invalid_argument if no encoder has the ID.
+		*/
+		encoder get_encoder
+		(
+			AVCodecID id, const codec_properties& p,
+			const dict& options = dict(), const threading_policy& policy = threading_policy()
+		);
+
+		/*
+		* Gets a ready decoder, opened if none is kept for the same key.
+		* The decoder is identified by p.id().
+		* 
+		* @param p the properties to open it with, e.g. stream::properties().
+		* @param options the options to open it with. Can be empty.
+		* @param policy the threading policy to open it with.
+		* @returns a ready, hungry decoder.
+		* @throws std::invalid_argument if no decoder has p.id().
+		* @throws what decoder::set_codec_properties() and create_codec_context() throw.
+		*/
+		decoder get_decoder
+		(
+			const codec_properties& p,
+			const dict& options = dict(), const threading_policy& policy = threading_policy()
+		);
+
+		/*
+		* Opens n encoders ahead of the jobs and keeps them,
+		* so that the first get_encoder() calls of the jobs don't have to wait.
+		* At most max_idle_per_key are kept, as usual.
+		* 
+		* @throws what get_encoder() throws.
+		*/
+		void warm_up_encoders
+		(
+			size_t n, const char* name, const codec_properties& p,
+			const dict& options = dict(), const threading_policy& policy = threading_policy()
+		);
+		/*
+		* Opens n decoders ahead of the jobs and keeps them.
+		* At most max_idle_per_key are kept, as usual.
+		* 
+		* @throws what get_decoder() throws.
+		*/
+		void warm_up_decoders
+		(
+			size_t n, const codec_properties& p,
+			const dict& options = dict(), const threading_policy& policy = threading_policy()
+		);
+
+		/*
+		* Gives an encoder back for reuse. It's reset() and kept if it can be reused
+		* (see the comments for the class) and there's room; otherwise it's closed.
+		* 
+		* @param enc an encoder from get_encoder() of this pool. It will be destroyed afterwards.
+		* Nothing happens if it's already destroyed.
+		*/
+		void recycle(encoder& enc) noexcept;
+		/*
+		* Gives a decoder back for reuse. It's reset() and kept if there's room; otherwise it's closed.
+		*
+		* @param dec a decoder from get_decoder() of this pool. It will be destroyed afterwards.
+		* Nothing happens if it's already destroyed.
+		*/
+		void recycle(decoder& dec) noexcept;
+
+		/*
+		* Closes all the codecs kept.
+		*/
+		void clear() noexcept;
+
+	public:
+		/*
+		* @returns the number of codecs kept for reuse now.
+		*/
+		size_t number_idle_codecs() const;
+		/*
+		* @returns how many get_*() calls were served by a kept codec.
+		*/
+		size_t number_hits() const;
+		/*
+		* @returns how many get_*() calls had to open a codec.
+		*/
+		size_t number_misses() const;
+
+	private:
+		/*
+		* @returns the key a codec opened with the arguments is kept under.
+		*/
+		static std::string internal_make_key
+		(
+			bool is_encoder, const char* codec_name, const codec_properties& p,
+			const dict& options, const threading_policy& policy
+		);
+
+		/*
+		* Common piece of code of the get_encoder() methods.
+		*/
+		encoder internal_get_encoder
+		(
+			const char* name, const codec_properties& p,
+			const dict& options, const threading_policy& policy
+		);
+
+		/*
+		* Opens a codec with the arguments.
+		*/
+		template <typename Codec>
+		static void internal_open(Codec& c, const codec_properties& p, const dict& options, const threading_policy& policy);
+
+		/*
+		* Marks c as lent out by me under key, in c itself.
+		*/
+		void internal_lend(codec_base& c, const std::string& key) const;
+
+		/*
+		* Takes the key out of c if I lent it out.
+		* @returns false if c is not lent out by me.
+		*/
+		bool internal_take_back(codec_base& c, std::string& key) const noexcept;
+
+	private:
+		mutable std::mutex mtx;
+		size_t max_idle_per_key;
+
+		std::unordered_map<std::string, std::vector<encoder>> idle_encoders;
+		std::unordered_map<std::string, std::vector<decoder>> idle_decoders;
+
+		size_t num_idle = 0;
+		size_t num_hits = 0, num_misses = 0;
+	};
+}
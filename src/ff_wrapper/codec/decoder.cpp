@@ -18,10 +18,67 @@
 #include "../util/ff_helpers.h"
 #include "../data/packet.h"
 #include "../formats/stream.h"
+#include "../util/hw_device.h"
+#include "../util/metrics.h"
 
 extern "C"
 {
 #include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <cstdint>
+
+namespace
+{
+	/*
+	* The get_format callback used for hardware decoding.
+	* The hardware pixel format wanted is stored in ctx->opaque,
+	* so that the callback doesn't depend on the address of the decoder, which can be moved.
+	* 
+	* @returns the hardware pixel format if FFmpeg offers it; otherwise the first software format
+	* so that decoding falls back to software.
+	*/
+	AVPixelFormat hw_get_format(AVCodecContext* ctx, const AVPixelFormat* fmts)
+	{
+		auto wanted = static_cast<AVPixelFormat>(reinterpret_cast<intptr_t>(ctx->opaque));
+
+		for (const AVPixelFormat* p = fmts; *p != AV_PIX_FMT_NONE; ++p)
+		{
+			if (*p == wanted)
+			{
+				return *p;
+			}
+		}
+
+		// Fall back to software.
+		for (const AVPixelFormat* p = fmts; *p != AV_PIX_FMT_NONE; ++p)
+		{
+			if (!(av_pix_fmt_desc_get(*p)->flags & AV_PIX_FMT_FLAG_HWACCEL))
+			{
+				return *p;
+			}
+		}
+
+		return AV_PIX_FMT_NONE;
+	}
+
+	bool is_valid_discard(AVDiscard d) noexcept
+	{
+		switch (d)
+		{
+		case AVDISCARD_NONE:
+		case AVDISCARD_DEFAULT:
+		case AVDISCARD_NONREF:
+		case AVDISCARD_BIDIR:
+		case AVDISCARD_NONINTRA:
+		case AVDISCARD_NONKEY:
+		case AVDISCARD_ALL:
+			return true;
+		default:
+			return false;
+		}
+	}
 }
 
 ff::decoder::decoder(AVCodecID ID)
@@ -38,23 +95,34 @@ ff::decoder::decoder(const char* name)
 	allocate_object_memory();
 }
 
-ff::decoder::decoder(const stream& s)
+ff::decoder::decoder(const stream& s, const threading_policy& policy)
 	: decoder(s.codec_id())
 {
 	set_codec_properties(s.properties());
+	set_threading_policy(policy);
 	// Create the decoder context for it to be ready.
 	create_codec_context();
 }
 
 ff::decoder::decoder(decoder&& other) noexcept
-	: codec_base(std::move(other))
+	: codec_base(std::move(other)), hw_pix_fmt(other.hw_pix_fmt)
+#ifdef FF_WRAPPER_ENABLE_METRICS
+	, metrics_probe(std::move(other.metrics_probe))
+#endif // FF_WRAPPER_ENABLE_METRICS
 {
+	other.hw_pix_fmt = AV_PIX_FMT_NONE;
 }
 
 ff::decoder& ff::decoder::operator=(decoder&& right) noexcept
 {
 	ff::codec_base::operator=(std::move(right));
 
+	hw_pix_fmt = right.hw_pix_fmt;
+	right.hw_pix_fmt = AV_PIX_FMT_NONE;
+#ifdef FF_WRAPPER_ENABLE_METRICS
+	metrics_probe = std::move(right.metrics_probe);
+#endif // FF_WRAPPER_ENABLE_METRICS
+
 	return *this;
 }
 
@@ -124,15 +192,19 @@ bool ff::decoder::feed_packet(const packet& pkt)
 		throw std::invalid_argument("The packet is not ready.");
 	}
 
+	FF_METRICS_SAMPLE(metrics_probe, 0);
+
 	// Full can only be set here and cancelled in decode_frame().
 	if (full())
 	{
+		FF_METRICS_REFUSE();
 		return false;
 	}
 
 	// The user has signaled that no more packet is coming.
 	if (no_more_food())
 	{
+		FF_METRICS_REFUSE();
 		return false;
 	}
 
@@ -140,6 +212,7 @@ bool ff::decoder::feed_packet(const packet& pkt)
 	if (0 == ret) // Success
 	{
 		cancel_hungry();
+		FF_METRICS_ADD(1, pkt->size);
 		return true;
 	}
 
@@ -149,6 +222,7 @@ bool ff::decoder::feed_packet(const packet& pkt)
 	case AVERROR(EAGAIN):
 		// The decoder is full.
 		become_full();
+		FF_METRICS_REFUSE();
 		return false;
 	case AVERROR_EOF:
 		// I detect this already with no_more_food() earlier.
@@ -177,9 +251,12 @@ ff::frame ff::decoder::decode_frame()
 		throw std::logic_error("The decoder is not ready.");
 	}
 
+	FF_METRICS_SAMPLE(metrics_probe, 1);
+
 	// Hungry can only be set here and cancelled in feed_packet()
 	if (hungry())
 	{
+		FF_METRICS_REFUSE();
 		return ff::frame(false);
 	}
 
@@ -193,11 +270,13 @@ ff::frame ff::decoder::decode_frame()
 	if (internal_decode_frame(pf))
 	{
 		// Success
+		FF_METRICS_ADD(1, 0);
 		return frame(pf, is_video());
 	}
 	else
 	{
 		// Failure
+		FF_METRICS_REFUSE();
 		// Free the AVFrame
 		av_frame_free(&pf);
 		return ff::frame(false);
@@ -211,40 +290,98 @@ bool ff::decoder::decode_frame(frame& f)
 		throw std::logic_error("The decoder is not ready.");
 	}
 
-	// Handle f so that it's always created before avcodec_receive_frame()
-	switch (f.get_object_state())
+	FF_METRICS_SAMPLE(metrics_probe, 1);
+
+	bool ret = internal_decode_into(f);
+	if (ret) // Success
 	{
-	case ff_object::DESTROYED:
-		f.allocate_object_memory();
-		[[fallthrough]];
-	case ff_object::OBJECT_CREATED:
-		// Do nothing.
-		break;
-	case ff_object::READY:
-		// Release its previous data.
-		f.release_resources_memory();
-		break;
+		FF_METRICS_ADD(1, 0);
+	}
+	else
+	{
+		FF_METRICS_REFUSE();
 	}
 
-	// Hungry can only be set here and cancelled in feed_packet()
-	if (hungry())
+	return ret;
+}
+
+ff::codec_base::batch_result ff::decoder::decode_frames(std::span<frame> frames)
+{
+	if (!ready())
 	{
-		return false;
+		throw std::logic_error("The decoder is not ready.");
 	}
 
-	bool ret = internal_decode_frame(f.av_frame());
+	FF_METRICS_SAMPLE(metrics_probe, 1);
 
-	if (ret) // Success
+	size_t n = 0;
+	while (n < frames.size() && internal_decode_into(frames[n]))
 	{
-		// Don't forget to make f ready
-		// and set its internal fields
-		f.internal_find_num_planes();
-		f.set_v_or_a(is_video());
-		f.state = ff_object::READY;
+		++n;
 	}
 
-	return ret;
+	FF_METRICS_ADD(n, 0);
+	if (n < frames.size())
+	{
+		FF_METRICS_REFUSE();
+	}
 
+	return batch_result{ n, hungry() };
+}
+
+bool ff::decoder::enable_hardware_decoding(const hw_device& device)
+{
+	if (!created())
+	{
+		throw std::logic_error("Hardware decoding can only be enabled when the decoder is just created.");
+	}
+	if (!is_video())
+	{
+		throw std::logic_error("Only videos can be decoded on hardware devices.");
+	}
+	if (hardware_decoding_enabled())
+	{
+		throw std::logic_error("Hardware decoding is already enabled.");
+	}
+	if (nullptr == device.av_device_ref())
+	{
+		throw std::invalid_argument("The device has been moved.");
+	}
+
+	// Find a configuration of the decoder that works with the device.
+	AVPixelFormat fmt = AV_PIX_FMT_NONE;
+	for (int i = 0;; ++i)
+	{
+		const AVCodecHWConfig* config = avcodec_get_hw_config(p_codec_desc, i);
+		if (nullptr == config)
+		{
+			break;
+		}
+
+		if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) &&
+			config->device_type == device.type())
+		{
+			fmt = config->pix_fmt;
+			break;
+		}
+	}
+
+	if (AV_PIX_FMT_NONE == fmt)
+	{
+		// The decoder cannot use the device at all.
+		return false;
+	}
+
+	p_codec_ctx->hw_device_ctx = av_buffer_ref(device.av_device_ref());
+	if (nullptr == p_codec_ctx->hw_device_ctx)
+	{
+		throw std::bad_alloc();
+	}
+	p_codec_ctx->opaque = reinterpret_cast<void*>(static_cast<intptr_t>(fmt));
+	p_codec_ctx->get_format = hw_get_format;
+
+	hw_pix_fmt = fmt;
+	return true;
 }
 
 void ff::decoder::start_draining()
@@ -274,6 +411,43 @@ void ff::decoder::start_draining()
 	}
 }
 
+bool ff::decoder::internal_decode_into(frame& f)
+{
+	// Handle f so that it's always created before avcodec_receive_frame()
+	switch (f.get_object_state())
+	{
+	case ff_object::DESTROYED:
+		f.allocate_object_memory();
+		[[fallthrough]];
+	case ff_object::OBJECT_CREATED:
+		// Do nothing.
+		break;
+	case ff_object::READY:
+		// Release its previous data.
+		f.release_resources_memory();
+		break;
+	}
+
+	// Hungry can only be set here and cancelled in feed_packet()
+	if (hungry())
+	{
+		return false;
+	}
+
+	bool ret = internal_decode_frame(f.av_frame());
+
+	if (ret) // Success
+	{
+		// Don't forget to make f ready
+		// and set its internal fields
+		f.internal_find_num_planes();
+		f.set_v_or_a(is_video());
+		f.state = ff_object::READY;
+	}
+
+	return ret;
+}
+
 bool ff::decoder::internal_decode_frame(AVFrame* f)
 {
 	int ret = avcodec_receive_frame(p_codec_ctx, f);
@@ -308,3 +482,89 @@ bool ff::decoder::internal_decode_frame(AVFrame* f)
 
 	return false;
 }
+
+void ff::decoder::set_skip_policy(const skip_policy& p)
+{
+	if (destroyed())
+	{
+		throw std::logic_error("The decoder is destroyed.");
+	}
+	if (!is_valid_discard(p.frames) || !is_valid_discard(p.loop_filter) || !is_valid_discard(p.idct))
+	{
+		throw std::invalid_argument("Invalid discard level.");
+	}
+
+	// The decoders read these fields for every packet, so
+	// they can be set before or after the context is opened.
+	p_codec_ctx->skip_frame = p.frames;
+	p_codec_ctx->skip_loop_filter = p.loop_filter;
+	p_codec_ctx->skip_idct = p.idct;
+}
+
+ff::decoder::skip_policy ff::decoder::get_skip_policy() const
+{
+	if (destroyed())
+	{
+		throw std::logic_error("The decoder is destroyed.");
+	}
+
+	return skip_policy(p_codec_ctx->skip_frame, p_codec_ctx->skip_loop_filter, p_codec_ctx->skip_idct);
+}
+
+int ff::decoder::max_lowres() const
+{
+	if (destroyed())
+	{
+		throw std::logic_error("The decoder is destroyed.");
+	}
+
+	return p_codec_desc->max_lowres;
+}
+
+void ff::decoder::set_lowres(int factor)
+{
+	if (!created())
+	{
+		throw std::logic_error("The lowres factor can only be set when the decoder is just created.");
+	}
+	if (factor < 0 || factor > p_codec_desc->max_lowres)
+	{
+		throw std::invalid_argument("The lowres factor is out of range.");
+	}
+
+	// Read when the context is opened.
+	p_codec_ctx->lowres = factor;
+}
+
+int ff::decoder::get_lowres() const
+{
+	if (destroyed())
+	{
+		throw std::logic_error("The decoder is destroyed.");
+	}
+
+	return p_codec_ctx->lowres;
+}
+
+int ff::decoder::lowres_for_size(int src_w, int src_h, int dst_w, int dst_h, int max_factor)
+{
+	if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0)
+	{
+		throw std::invalid_argument("The sizes must be positive.");
+	}
+	if (max_factor < 0)
+	{
+		throw std::invalid_argument("The max factor cannot be negative.");
+	}
+
+	int factor = 0;
+	// The decoders round the reduced sizes up, like AV_CEIL_RSHIFT.
+	while (factor < max_factor
+		&& AV_CEIL_RSHIFT(src_w, factor + 1) >= dst_w
+		&& AV_CEIL_RSHIFT(src_h, factor + 1) >= dst_h)
+	{
+		++factor;
+	}
+
+	return factor;
+}
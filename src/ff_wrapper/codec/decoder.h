@@ -17,11 +17,20 @@
 
 #include "codec_base.h"
 #include "../data/frame.h"
+#include "../util/metrics.h"
+
+#include <span>
+
+extern "C"
+{
+#include <libavcodec/defs.h> // For AVDiscard
+}
 
 namespace ff
 {
 	class packet;
 	class stream;
+	class hw_device;
 
 	/*
 	* Represents a decoder, which is just an implementation of codec_base,
@@ -30,6 +39,24 @@ namespace ff
 	* 
 	* Read the comments for codec_base for how to decode.
 	* 
+	* Hardware decoding:
+	* Before the context is created, you can call enable_hardware_decoding() with a hw_device.
+	* Then, whenever FFmpeg negotiates the output format with me, I choose the device's format if it is offered.
+	* If it is not (e.g. the device cannot decode the profile of the stream), I choose a software format,
+	* and decoding silently continues in software.
+	* Frames decoded on the device stay in its memory (frame::is_hardware()).
+	* Call frame::transfer_to_software() when you need their data in the system memory.
+	* 
+	* Skipping work:
+	* When you only need some frames (e.g. keyframes for thumbnails or scene scans),
+	* call set_skip_policy() so that FFmpeg does not decode the others at all.
+	* Pair it with demuxer::set_discard() so that the skipped packets are not even read.
+	* 
+	* Reduced resolution:
+	* Decoders of some codecs (e.g. MJPEG, MPEG-2, JPEG 2000) can decode at 1/2, 1/4, or 1/8
+	* of the resolution, doing only a fraction of the work. Before the context is created, call set_lowres().
+	* For frames of an exact size (e.g. for previews), see preview_decoder, which adds a small scaling pass.
+	* 
 	* Invariants: those of codec_base.
 	*/
 	class FF_WRAPPER_API decoder final : public codec_base
@@ -56,9 +83,12 @@ namespace ff
 		* After this constructor returns, the decoder will immediately be ready.
 		* The behaviour is undefined if the stream does not come from a demuxer.
 		* 
+		* @param s the stream
+		* @param policy how the decoder uses threads. By default, it uses as many threads as FFmpeg thinks best.
 		* @throws std::invalid_argument if the codec that encoded the stream is not supported.
+		* @throws std::invalid_argument if the policy is invalid.
 		*/
-		explicit decoder(const stream& s);
+		explicit decoder(const stream& s, const threading_policy& policy = threading_policy());
 
 		// Even if the properties can be copied,
 		// the internal state and buffers of a decoder cannot.
@@ -122,6 +152,132 @@ namespace ff
 		*/
 		bool decode_frame(frame& f);
 
+		/*
+		* Decodes as many frames as the decoder has ready, until it becomes hungry, it is drained,
+		* or frames is filled. Same as calling decode_frame(f) on each of frames in order until it returns false,
+		* but the state of the decoder is checked once for the whole batch.
+		* Reuse the frames across calls, so that their AVFrames are only allocated once.
+		*
+		* @param frames where the decoded frames are stored.
+		*	The first result.count of them are ready with the decoded data afterwards.
+		*	The one after them, if any, is created with no data. The rest are untouched.
+		* @returns how many frames were decoded and whether the decoder became hungry.
+		* @throws std::logic_error if the decoder is not ready.
+		*/
+		batch_result decode_frames(std::span<frame> frames);
+
+/////////////////////////////// Hardware decoding ///////////////////////////////
+		/*
+		* Lets the decoder decode on a hardware device. See the comments for the class.
+		* The decoder keeps a reference to the device.
+		*
+		* @param device the device.
+		* @returns true if the decoder can decode on the device type; false if the decoder
+		* cannot, in which case the decoder stays unchanged and decodes in software.
+		* @throws std::logic_error if the decoder is not created.
+		* @throws std::logic_error if the decoder is not for videos.
+		* @throws std::logic_error if you have already enabled it.
+		* @throws std::invalid_argument if device has been moved.
+		*/
+		bool enable_hardware_decoding(const hw_device& device);
+
+		/*
+		* @returns true iff enable_hardware_decoding() has returned true.
+		* Even so, some frames may still be decoded in software. Check frame::is_hardware() to know.
+		*/
+		inline bool hardware_decoding_enabled() const noexcept { return AV_PIX_FMT_NONE != hw_pix_fmt; }
+
+		/*
+		* @returns the pixel format of the frames decoded on the device (e.g. AV_PIX_FMT_CUDA),
+		* or AV_PIX_FMT_NONE if hardware decoding is not enabled.
+		*/
+		inline AVPixelFormat hardware_pixel_format() const noexcept { return hw_pix_fmt; }
+
+/////////////////////////////// Skipping work ///////////////////////////////
+		/*
+		* Describes which work the decoder skips, each in terms of which frames it is skipped for.
+		* E.g. frames = AVDISCARD_NONKEY means only keyframes are decoded,
+		* and loop_filter = AVDISCARD_ALL means the loop filter is never applied,
+		* which is faster but gives worse pictures.
+		* 
+		* The decoders of some codecs ignore some of the fields.
+		*/
+		struct skip_policy
+		{
+			constexpr skip_policy
+			(
+				AVDiscard frames = AVDISCARD_DEFAULT,
+				AVDiscard loop_filter = AVDISCARD_DEFAULT,
+				AVDiscard idct = AVDISCARD_DEFAULT
+			) noexcept
+				: frames(frames), loop_filter(loop_filter), idct(idct) {}
+
+			// Decodes only the keyframes, at full quality.
+			static constexpr skip_policy keyframes_only() noexcept
+			{
+				return skip_policy(AVDISCARD_NONKEY);
+			}
+
+			// Decodes only the keyframes, and skips the loop filter for them. Good enough for thumbnails.
+			static constexpr skip_policy fast_keyframes() noexcept
+			{
+				return skip_policy(AVDISCARD_NONKEY, AVDISCARD_ALL);
+			}
+
+			// Which frames are not decoded at all.
+			AVDiscard frames;
+			// For which frames the loop (deblocking) filter is skipped.
+			AVDiscard loop_filter;
+			// For which frames the IDCT (and thus most of the reconstruction) is skipped.
+			AVDiscard idct;
+		};
+
+		/*
+		* Sets which work the decoder skips. Unlike the threading policy, it can be changed
+		* in the middle of decoding, and takes effect from the next packet decoded.
+		* 
+		* Keep in mind that frames that depend on skipped ones can't be decoded correctly,
+		* so if you skip some frames and later want all of them, seek to a keyframe after restoring the default.
+		* 
+		* @throws std::logic_error if the decoder is destroyed.
+		* @throws std::invalid_argument if any field is not a valid AVDiscard.
+		*/
+		void set_skip_policy(const skip_policy& p);
+		/*
+		* @returns the policy currently in effect.
+		* @throws std::logic_error if the decoder is destroyed.
+		*/
+		skip_policy get_skip_policy() const;
+
+/////////////////////////////// Reduced resolution ///////////////////////////////
+		/*
+		* @returns the largest factor set_lowres() accepts. 0 if the decoder can only decode at full size.
+		* @throws std::logic_error if the decoder is destroyed.
+		*/
+		int max_lowres() const;
+
+		/*
+		* Makes the decoder decode at 1/2^factor of the resolution of the stream in each dimension
+		* (rounded up), which is much less work. The frames decoded are of that size.
+		* 
+		* @param factor 0 (full size) to max_lowres().
+		* @throws std::logic_error if the decoder is not created (i.e. destroyed or already ready).
+		* @throws std::invalid_argument if factor is out of range.
+		*/
+		void set_lowres(int factor);
+		/*
+		* @returns the factor in effect. 0 by default.
+		* @throws std::logic_error if the decoder is destroyed.
+		*/
+		int get_lowres() const;
+
+		/*
+		* @returns the largest factor <= max_factor with which frames of src_w x src_h are decoded
+		* no smaller than dst_w x dst_h, so that only a downscaling pass is left. 0 if there is none.
+		* @throws std::invalid_argument if any size <= 0 or if max_factor < 0.
+		*/
+		static int lowres_for_size(int src_w, int src_h, int dst_w, int dst_h, int max_factor);
+
 	private:
 /////////////////////////////// Derived from ff_object ///////////////////////////////
 		/*
@@ -140,6 +296,24 @@ namespace ff
 		* @returns true iff a frame has been decoded.
 		*/
 		bool internal_decode_frame(AVFrame* f);
+
+		/*
+		* Common piece of code of decode_frame(frame&) and decode_frames().
+		* Decodes into f, after making it created with no data, assuming the decoder is ready.
+		* 
+		* @returns true iff a frame has been decoded.
+		*/
+		bool internal_decode_into(frame& f);
+
+	private:
+		// The pixel format of frames decoded on the hardware device.
+		// AV_PIX_FMT_NONE if hardware decoding is not enabled.
+		AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
+
+#ifdef FF_WRAPPER_ENABLE_METRICS
+		// Stages: feed_packet, decode_frame. See metrics.h.
+		metrics::probe metrics_probe{ "decoder", { "feed_packet", "decode_frame" } };
+#endif // FF_WRAPPER_ENABLE_METRICS
 	};
 
 }
\ No newline at end of file
@@ -16,6 +16,7 @@
 */
 
 #include "../data/frame.h"
+#include "../data/packet_pool.h"
 #include "../util/ff_helpers.h"
 #include "decoder.h"
 #include "../formats/muxer.h"
@@ -23,6 +24,25 @@
 extern "C"
 {
 #include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/opt.h>
+}
+
+#include <initializer_list>
+
+namespace
+{
+	/*
+	* The get_encode_buffer callback used when the encoder uses a packet_pool.
+	* The pool is stored in ctx->opaque.
+	*/
+	int pooled_get_encode_buffer(AVCodecContext* ctx, AVPacket* pkt, int flags)
+	{
+		// The payloads from the pool are always ref-counted, so flags doesn't matter.
+		(void)flags;
+		return static_cast<ff::packet_pool*>(ctx->opaque)->av_allocate_payload(pkt, pkt->size);
+	}
 }
 
 ff::encoder::encoder(const muxer& muxer, AVMediaType type)
@@ -41,16 +61,27 @@ bool ff::encoder::feed_frame(const ff::frame& frame)
 	{
 		throw std::invalid_argument("The frame is not ready.");
 	}
+	if (frame.is_hardware() != hardware_encoding_enabled())
+	{
+		throw std::invalid_argument(frame.is_hardware() ?
+			"Hardware encoding is not enabled. Call transfer_to_software() on the frame first." :
+			"Hardware encoding is enabled so only hardware frames can be fed."
+		);
+	}
+
+	FF_METRICS_SAMPLE(metrics_probe, 0);
 
 	// Full can only be set here and cancelled in decode_frame().
 	if (full())
 	{
+		FF_METRICS_REFUSE();
 		return false;
 	}
 
 	// The user has signaled that no more frame is coming.
 	if (no_more_food())
 	{
+		FF_METRICS_REFUSE();
 		return false;
 	}
 
@@ -58,6 +89,7 @@ bool ff::encoder::feed_frame(const ff::frame& frame)
 	if (0 == ret) // Success
 	{
 		cancel_hungry();
+		FF_METRICS_ADD(1, 0);
 		return true;
 	}
 
@@ -67,6 +99,7 @@ bool ff::encoder::feed_frame(const ff::frame& frame)
 	case AVERROR(EAGAIN):
 		// The encoder is full.
 		become_full();
+		FF_METRICS_REFUSE();
 		return false;
 	case AVERROR_EOF:
 		// I detect this already with no_more_food() earlier.
@@ -95,9 +128,12 @@ ff::packet ff::encoder::encode_packet()
 		throw std::logic_error("The encoder is not ready.");
 	}
 
+	FF_METRICS_SAMPLE(metrics_probe, 1);
+
 	// Hungry can only be set here and cancelled in feed_frame()
 	if (hungry())
 	{
+		FF_METRICS_REFUSE();
 		return ff::packet(false);
 	}
 
@@ -110,11 +146,13 @@ ff::packet ff::encoder::encode_packet()
 
 	if (internal_encode_packet(pkt))
 	{
+		FF_METRICS_ADD(1, pkt->size);
 		return ff::packet(pkt);
 	}
 	else
 	{
 		// Failure
+		FF_METRICS_REFUSE();
 		// destroy pkt.
 		av_packet_free(&pkt);
 		return packet(false);
@@ -128,37 +166,162 @@ bool ff::encoder::encode_packet(packet& pkt)
 		throw std::logic_error("The encoder is not ready.");
 	}
 
-	// Handle pkt so that it's always created before avcodec_receive_packet()
-	switch (pkt.get_object_state())
+	FF_METRICS_SAMPLE(metrics_probe, 1);
+
+	bool ret = internal_encode_into(pkt);
+	if (ret) // Success
 	{
-	case ff_object::DESTROYED:
-		pkt.allocate_object_memory();
-		[[fallthrough]];
-	case ff_object::OBJECT_CREATED:
-		// Do nothing.
-		break;
-	case ff_object::READY:
-		// Release its previous data.
-		pkt.release_resources_memory();
-		break;
+		FF_METRICS_ADD(1, pkt->size);
+	}
+	else
+	{
+		FF_METRICS_REFUSE();
+	}
+
+	return ret;
+}
+
+ff::codec_base::batch_result ff::encoder::encode_packets(std::vector<packet>& pkts, size_t max_packets)
+{
+	if (!ready())
+	{
+		throw std::logic_error("The encoder is not ready.");
+	}
+
+	FF_METRICS_SAMPLE(metrics_probe, 1);
+
+	size_t n = 0;
+	while (n < max_packets)
+	{
+		if (n == pkts.size())
+		{
+			pkts.emplace_back(true);
+		}
+		if (!internal_encode_into(pkts[n]))
+		{
+			break;
+		}
+
+		FF_METRICS_ADD(1, pkts[n]->size);
+		++n;
 	}
 
+	if (n < max_packets)
+	{
+		FF_METRICS_REFUSE();
+	}
+
+	return batch_result{ n, hungry() };
+}
+
+ff::packet ff::encoder::encode_packet(packet_pool& pool)
+{
+	if (!ready())
+	{
+		throw std::logic_error("The encoder is not ready.");
+	}
+
+	FF_METRICS_SAMPLE(metrics_probe, 1);
+
 	// Hungry can only be set here and cancelled in feed_frame()
 	if (hungry())
 	{
+		FF_METRICS_REFUSE();
+		return ff::packet(false);
+	}
+
+	packet pkt = pool.get_packet();
+	if (internal_encode_packet(pkt.av_packet()))
+	{
+		pkt.state = ff_object::READY;
+		FF_METRICS_ADD(1, pkt->size);
+		return pkt;
+	}
+	else
+	{
+		// Failure
+		FF_METRICS_REFUSE();
+		// Give it back.
+		pool.recycle(pkt);
+		return packet(false);
+	}
+}
+
+bool ff::encoder::use_packet_pool(packet_pool& pool)
+{
+	if (!created())
+	{
+		throw std::logic_error("The packet pool can only be set when the encoder is just created.");
+	}
+
+	if (!(p_codec_desc->capabilities & AV_CODEC_CAP_DR1))
+	{
+		// The encoder always allocates the packets itself.
 		return false;
 	}
 
-	bool ret = internal_encode_packet(pkt.av_packet());
+	p_codec_ctx->opaque = &pool;
+	p_codec_ctx->get_encode_buffer = pooled_get_encode_buffer;
+	return true;
+}
 
-	if (ret) // Success
+void ff::encoder::set_low_latency()
+{
+	if (!created())
 	{
-		// Don't forget to make pkt ready
-		// and set its internal fields (if needed in the future).
-		pkt.state = ff_object::READY;
+		throw std::logic_error("Low latency can only be set when the encoder is just created.");
 	}
 
-	return ret;
+	p_codec_ctx->max_b_frames = 0;
+	p_codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+
+	// Frame threading delays each output by as many frames as threads.
+	if (threading.types & FF_THREADING_FRAME)
+	{
+		threading.types = FF_THREADING_SLICE;
+	}
+
+	if (nullptr == p_codec_ctx->priv_data)
+	{
+		return;
+	}
+
+	// The private options of the common encoders that hold frames.
+	// For each key, the first value the encoder accepts is used.
+	struct option
+	{
+		const char* key;
+		std::initializer_list<const char*> values;
+	};
+	static const option options[] =
+	{
+		// libx264, libx265: zerolatency; nvenc: ultra low latency.
+		{ "tune", { "zerolatency", "ull" } },
+		// nvenc
+		{ "zerolatency", { "1" } },
+		{ "delay", { "0" } },
+		{ "rc-lookahead", { "0" } },
+		// libvpx, libaom
+		{ "lag-in-frames", { "0" } },
+		{ "deadline", { "realtime" } },
+		{ "usage", { "realtime" } }
+	};
+	for (const auto& o : options)
+	{
+		for (const char* v : o.values)
+		{
+			// Fails if the encoder doesn't have the option or doesn't accept the value.
+			if (av_opt_set(p_codec_ctx->priv_data, o.key, v, 0) >= 0)
+			{
+				break;
+			}
+		}
+	}
+}
+
+bool ff::encoder::low_latency() const noexcept
+{
+	return nullptr != p_codec_ctx && (p_codec_ctx->flags & AV_CODEC_FLAG_LOW_DELAY);
 }
 
 bool ff::encoder::set_properties_from_decoder(const decoder& dec)
@@ -181,6 +344,24 @@ bool ff::encoder::set_properties_from_decoder(const decoder& dec)
 	// Then query each of the potentially unsupported properties.
 	if (dp.is_video())
 	{
+		// If dec decodes on a hardware device, then its pixel format is the device's.
+		// Try to keep the frames on the device.
+		const AVBufferRef* dec_frames_ref = dec.av_codec_ctx()->hw_frames_ctx;
+		if (nullptr != dec_frames_ref)
+		{
+			auto dec_frames_ctx = reinterpret_cast<const AVHWFramesContext*>(dec_frames_ref->data);
+			if (internal_set_hw_frames_context(dec_frames_ref))
+			{
+				ep.set_v_pixel_format(dec_frames_ctx->format);
+			}
+			else
+			{
+				// The frames will have to be transferred to software.
+				ep.set_v_pixel_format(dec_frames_ctx->sw_format);
+			}
+			dp.set_v_pixel_format(ep.v_pixel_format());
+		}
+
 		// fmt and frame_rate
 		// might be unsupported
 		try
@@ -191,9 +372,8 @@ bool ff::encoder::set_properties_from_decoder(const decoder& dec)
 				// Use one of the supported ones
 				options_changed = true;
 
-				auto supported = supported_v_pixel_formats();
 				// Use the first one for now until I have better heuristics.
-				ep.set_v_pixel_format(supported[0]);
+				ep.set_v_pixel_format(first_supported_v_pixel_format());
 			}
 		}
 		catch (const std::domain_error&) 
@@ -210,9 +390,8 @@ bool ff::encoder::set_properties_from_decoder(const decoder& dec)
 				// Use one of the supported ones
 				options_changed = true;
 
-				auto supported = supported_v_frame_rates();
 				// Use the first one for now until I have better heuristics.
-				ep.set_v_frame_rate(supported[0]);
+				ep.set_v_frame_rate(first_supported_v_frame_rate());
 			}
 		}
 		catch (const std::domain_error&)
@@ -235,9 +414,8 @@ bool ff::encoder::set_properties_from_decoder(const decoder& dec)
 				// Use one of the supported ones
 				options_changed = true;
 
-				auto supported = supported_a_sample_formats();
 				// Use the first one for now until I have better heuristics.
-				ep.set_a_sample_format(supported[0]);
+				ep.set_a_sample_format(first_supported_a_sample_format());
 			}
 		}
 		catch (const std::domain_error&)
@@ -254,9 +432,8 @@ bool ff::encoder::set_properties_from_decoder(const decoder& dec)
 				// Use one of the supported ones
 				options_changed = true;
 
-				auto supported = supported_a_sample_rates();
 				// Use the first one for now until I have better heuristics.
-				ep.set_a_sample_rate(supported[0]);
+				ep.set_a_sample_rate(first_supported_a_sample_rate());
 			}
 		}
 		catch (const std::domain_error&)
@@ -273,9 +450,8 @@ bool ff::encoder::set_properties_from_decoder(const decoder& dec)
 				// Use one of the supported ones
 				options_changed = true;
 
-				auto supported = supported_a_channel_layouts();
 				// Use the first one for now until I have better heuristics.
-				ep.set_a_channel_layout(*supported[0]);
+				ep.set_a_channel_layout(first_supported_a_channel_layout());
 			}
 		}
 		catch (const std::domain_error&)
@@ -291,6 +467,82 @@ bool ff::encoder::set_properties_from_decoder(const decoder& dec)
 	return !options_changed;
 }
 
+bool ff::encoder::set_hw_frames_context(const frame& hw_frame)
+{
+	if (!created())
+	{
+		throw std::logic_error("The hardware frames context can only be set when the encoder is just created.");
+	}
+	if (!is_video())
+	{
+		throw std::logic_error("Only videos can be encoded on hardware devices.");
+	}
+	if (!hw_frame.is_hardware())
+	{
+		throw std::invalid_argument("hw_frame is not a hardware frame.");
+	}
+
+	const AVBufferRef* frames_ref = hw_frame.av_frame()->hw_frames_ctx;
+	if (!internal_set_hw_frames_context(frames_ref))
+	{
+		return false;
+	}
+
+	auto frames_ctx = reinterpret_cast<const AVHWFramesContext*>(frames_ref->data);
+	p_codec_ctx->pix_fmt = frames_ctx->format;
+	p_codec_ctx->width = frames_ctx->width;
+	p_codec_ctx->height = frames_ctx->height;
+
+	return true;
+}
+
+bool ff::encoder::hardware_encoding_enabled() const noexcept
+{
+	return nullptr != p_codec_ctx && nullptr != p_codec_ctx->hw_frames_ctx;
+}
+
+bool ff::encoder::internal_set_hw_frames_context(const AVBufferRef* frames_ref)
+{
+	FF_ASSERT(created(), "Should only be called before the context is created.");
+	FF_ASSERT(nullptr != frames_ref, "Should be given a hardware frames context.");
+
+	auto frames_ctx = reinterpret_cast<const AVHWFramesContext*>(frames_ref->data);
+
+	// Find a configuration of the encoder that accepts frames from the context.
+	bool supported = false;
+	for (int i = 0;; ++i)
+	{
+		const AVCodecHWConfig* config = avcodec_get_hw_config(p_codec_desc, i);
+		if (nullptr == config)
+		{
+			break;
+		}
+
+		if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_FRAMES_CTX) &&
+			config->pix_fmt == frames_ctx->format)
+		{
+			supported = true;
+			break;
+		}
+	}
+
+	if (!supported)
+	{
+		return false;
+	}
+
+	AVBufferRef* new_ref = av_buffer_ref(frames_ref);
+	if (nullptr == new_ref)
+	{
+		throw std::bad_alloc();
+	}
+	// In case one has been set before.
+	av_buffer_unref(&p_codec_ctx->hw_frames_ctx);
+	p_codec_ctx->hw_frames_ctx = new_ref;
+
+	return true;
+}
+
 void ff::encoder::internal_allocate_object_memory()
 {
 	// A constructor either identifies the encoder by ID or by name.
@@ -368,6 +620,41 @@ void ff::encoder::start_draining()
 	}
 }
 
+bool ff::encoder::internal_encode_into(packet& pkt)
+{
+	// Handle pkt so that it's always created before avcodec_receive_packet()
+	switch (pkt.get_object_state())
+	{
+	case ff_object::DESTROYED:
+		pkt.allocate_object_memory();
+		[[fallthrough]];
+	case ff_object::OBJECT_CREATED:
+		// Do nothing.
+		break;
+	case ff_object::READY:
+		// Release its previous data.
+		pkt.release_resources_memory();
+		break;
+	}
+
+	// Hungry can only be set here and cancelled in feed_frame()
+	if (hungry())
+	{
+		return false;
+	}
+
+	bool ret = internal_encode_packet(pkt.av_packet());
+
+	if (ret) // Success
+	{
+		// Don't forget to make pkt ready
+		// and set its internal fields (if needed in the future).
+		pkt.state = ff_object::READY;
+	}
+
+	return ret;
+}
+
 bool ff::encoder::internal_encode_packet(AVPacket* pkt)
 {
 	int ret = avcodec_receive_packet(p_codec_ctx, pkt);
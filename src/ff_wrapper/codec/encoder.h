@@ -17,12 +17,19 @@
 
 #include "codec_base.h"
 #include "../data/packet.h"
+#include "../util/metrics.h"
+
+#include <cstdint> // For SIZE_MAX
+#include <vector>
+
+struct AVBufferRef;
 
 namespace ff
 {
 	class frame;
 	class decoder;
 	class muxer;
+	class packet_pool;
 
 	/*
 	* Represents an encoder, which is just an implementation of codec_base,
@@ -32,6 +39,15 @@ namespace ff
 	* 
 	* Read the comments for codec_base for how to encode.
 	* 
+	* Hardware encoding:
+	* A hardware encoder (e.g. h264_nvenc, hevc_qsv, h264_vaapi) can encode hardware frames
+	* (frame::is_hardware()) directly, without their data ever leaving the device.
+	* To do that, before the context is created, give it the hardware frames context 
+	* the frames come from, either through set_properties_from_decoder()
+	* or through set_hw_frames_context(). 
+	* After that, only hardware frames from that context can be fed to it; 
+	* without it, only software frames can be.
+	* 
 	* Invariants: those of codec_base.
 	*/
 	class FF_WRAPPER_API encoder final : public codec_base
@@ -78,11 +94,18 @@ namespace ff
 		encoder& operator=(const encoder&) = delete;
 
 		inline encoder(encoder&& other) noexcept
-			: codec_base(std::move(other)) {}
+			: codec_base(std::move(other))
+#ifdef FF_WRAPPER_ENABLE_METRICS
+			, metrics_probe(std::move(other.metrics_probe))
+#endif // FF_WRAPPER_ENABLE_METRICS
+		{}
 
 		inline encoder& operator=(encoder&& right) noexcept
 		{
 			codec_base::operator=(std::move(right));
+#ifdef FF_WRAPPER_ENABLE_METRICS
+			metrics_probe = std::move(right.metrics_probe);
+#endif // FF_WRAPPER_ENABLE_METRICS
 
 			return *this;
 		}
@@ -103,6 +126,8 @@ namespace ff
 		* @throws std::logic_error if the encoder is not ready.
 		* @throws std::invalid_argument if the frame is not ready or if the frame does not agree with
 		* the properties of the encoder or with previous frames fed to it.
+		* @throws std::invalid_argument if the frame is a hardware frame but hardware encoding is not enabled,
+		* or if it's a software frame but hardware encoding is enabled.
 		*/
 		bool feed_frame(const ff::frame& frame);
 
@@ -147,6 +172,69 @@ namespace ff
 		*/
 		bool encode_packet(packet& pkt);
 
+		/*
+		* Same as encode_packet(), except that the packet comes from pool,
+		* so that you can recycle() it after use (e.g. after muxing it).
+		* Call use_packet_pool() as well to also draw the payloads from a pool.
+		*
+		* @returns a packet encoded; a DESTROYED packet if the encoder is hungry, or
+		* if the encoder has nothing left in its stomach after you started draining it.
+		* @throws std::logic_error if the encoder is not ready.
+		*/
+		ff::packet encode_packet(packet_pool& pool);
+
+		/*
+		* Encodes as many packets as the encoder has ready, until it becomes hungry or it is drained.
+		* Same as calling encode_packet(pkt) on pkts[0], pkts[1], ... until it returns false,
+		* but the state of the encoder is checked once for the whole batch.
+		* Reuse pkts across calls, so that their AVPackets are only allocated once.
+		* 
+		* The same note as encode_packet(packet&) on the properties of the packets applies.
+		*
+		* @param pkts where the encoded packets are stored. The first result.count of them
+		*	are ready with the encoded data afterwards. I append packets when it has too few, and
+		*	never remove any, so the packets after the first result.count ones are left created with no data
+		*	for reuse. Only look at the first result.count.
+		* @param max_packets at most how many packets are encoded.
+		* @returns how many packets were encoded and whether the encoder became hungry.
+		* @throws std::logic_error if the encoder is not ready.
+		*/
+		batch_result encode_packets(std::vector<packet>& pkts, size_t max_packets = SIZE_MAX);
+
+		/*
+		* Lets the encoder allocate the payloads of the packets it encodes from pool,
+		* instead of allocating new memory for each.
+		* Only works for encoders that let users allocate their packets (AV_CODEC_CAP_DR1).
+		* NOTE: pool must outlive the encoder.
+		*
+		* @returns true if the encoder will use pool; false if it can't.
+		* @throws std::logic_error if the encoder is not created.
+		*/
+		bool use_packet_pool(packet_pool& pool);
+
+	public:
+///////////////////////////// Latency /////////////////////////////
+		/*
+		* Sets the encoder up for live streams, so that it gives out the packet of a frame
+		* as soon as the frame is fed, instead of holding frames to encode them better. That is,
+		*	1. no B-frames, and AV_CODEC_FLAG_LOW_DELAY,
+		*	2. slice threading only, because frame threading keeps one frame per thread in flight,
+		*	3. the private options of the common encoders that turn their lookahead off:
+		*	tune=zerolatency (libx264, libx265), tune=ull, zerolatency, and delay=0 (nvenc),
+		*	lag-in-frames=0 and deadline/usage=realtime (libvpx, libaom). Those the encoder doesn't have are skipped.
+		* 
+		* Call it before create_codec_context() and after set_threading_policy().
+		* Options passed to create_codec_context() still override these.
+		* 
+		* @throws std::logic_error if the encoder is not just created (i.e. destroyed or already ready).
+		*/
+		void set_low_latency();
+
+		/*
+		* @returns true iff set_low_latency() has been called (AV_CODEC_FLAG_LOW_DELAY is set).
+		*/
+		bool low_latency() const noexcept;
+
 	public:
 ///////////////////////////// Transcoding /////////////////////////////
 		/*
@@ -157,6 +245,12 @@ namespace ff
 		* The definition of essential properties are given in the comment for
 		* codec_properties::essential_properties().
 		* 
+		* If dec decodes on a hardware device and has already decoded hardware frames,
+		* then I also carry over its hardware frames context if this can encode such frames,
+		* so that you can feed them here directly. If this cannot, then I use the software
+		* format of the frames instead, and you must transfer_to_software() them before feeding them.
+		* Call hardware_encoding_enabled() to know which happened.
+		* 
 		* @returns true if all the options checked are supported by the decoder; false if any of them 
 		* is not supported and is changed to one of the supported.
 		* @throws std::logic_error if dec is not ready or if this is not created.
@@ -166,6 +260,23 @@ namespace ff
 		*/
 		bool set_properties_from_decoder(const decoder& dec);
 
+		/*
+		* Lets the encoder encode hardware frames from the same hardware frames context 
+		* as hw_frame's directly. See the comments for the class.
+		* Also sets the pixel format, width, and height of the encoder to those of the frames.
+		*
+		* @param hw_frame a hardware frame, typically the first one decoded by a hardware decoder.
+		* @returns true if the encoder can encode such frames; false if it cannot, and nothing is changed.
+		* @throws std::logic_error if this is not created or not for videos.
+		* @throws std::invalid_argument if hw_frame is not a hardware frame.
+		*/
+		bool set_hw_frames_context(const frame& hw_frame);
+
+		/*
+		* @returns true iff a hardware frames context has been set for the encoder.
+		*/
+		bool hardware_encoding_enabled() const noexcept;
+
 	private:
 
 		// Inherited via ff_object
@@ -180,5 +291,26 @@ namespace ff
 		* @returns true iff a packet has been encoded.
 		*/
 		bool internal_encode_packet(AVPacket* pkt);
+
+		/*
+		* Common piece of code of encode_packet(packet&) and encode_packets().
+		* Encodes into pkt, after making it created with no data, assuming the encoder is ready.
+		* 
+		* @returns true iff a packet has been encoded.
+		*/
+		bool internal_encode_into(packet& pkt);
+
+		/*
+		* Common piece of code of set_properties_from_decoder() and set_hw_frames_context().
+		* 
+		* @returns false if the encoder cannot encode frames from frames_ref.
+		*/
+		bool internal_set_hw_frames_context(const AVBufferRef* frames_ref);
+
+	private:
+#ifdef FF_WRAPPER_ENABLE_METRICS
+		// Stages: feed_frame, encode_packet. See metrics.h.
+		metrics::probe metrics_probe{ "encoder", { "feed_frame", "encode_packet" } };
+#endif // FF_WRAPPER_ENABLE_METRICS
 	};
 }
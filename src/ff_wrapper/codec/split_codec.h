@@ -0,0 +1,224 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* split_codec.h:
+* Defines split_codec, which lets one thread feed a decoder/encoder while another takes its outputs.
+*
+* Header only.
+*/
+
+#include "decoder.h"
+#include "encoder.h"
+#include "../data/frame.h"
+#include "../data/packet.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+
+namespace ff
+{
+	/*
+	* Splits the feeding and the outputting of a ready decoder or encoder between two threads:
+	* one producer calls feed() and then signal_no_more_food(), and one consumer calls receive() until it returns false.
+	*
+	* Used from one thread, the hungry/full protocol of codec_base leaves the feeding idle while the outputs are taken
+	* and the other way round. Split, the producer prepares the next food (e.g. demuxes or scales it)
+	* while the consumer handles the last output (e.g. muxes or transforms it),
+	* and a codec with its own threads or a deep lookahead is kept busy by both.
+	*
+	* libavcodec doesn't allow two calls on one context at once, so each call into the codec is made under a lock,
+	* and only for as long as the call itself. Everything else the two threads do runs in parallel.
+	* Instead of being refused, feed() waits while the codec is full, and receive() waits while it's hungry.
+	*
+	* If either thread fails, call abort() so that the other one stops waiting.
+	* Don't touch the codec yourself while I'm in use, and destroy me before the codec.
+	*
+	* No need to be DLL imported/exported, because this is a template
+	* and header only.
+	*/
+	template <typename C>
+	requires std::is_same_v<C, decoder> || std::is_same_v<C, encoder>
+	class split_codec final
+	{
+	public:
+		static constexpr bool is_decoder = std::is_same_v<C, decoder>;
+		// packet for a decoder, frame for an encoder.
+		using food_type = std::conditional_t<is_decoder, packet, frame>;
+		// frame for a decoder, packet for an encoder.
+		using output_type = std::conditional_t<is_decoder, frame, packet>;
+
+		/*
+		* @param codec a ready codec that has not been signaled.
+		* @throws std::logic_error if codec is not ready, or if it has been signaled.
+		*/
+		explicit split_codec(C& codec)
+			: c(&codec)
+		{
+			if (!codec.ready())
+			{
+				throw std::logic_error("The codec is not ready.");
+			}
+			if (codec.no_more_food())
+			{
+				throw std::logic_error("The codec has been signaled.");
+			}
+		}
+
+		split_codec(const split_codec&) = delete;
+		split_codec& operator=(const split_codec&) = delete;
+
+	public:
+		/*
+		* Feeds food to the codec, waiting while it's full. Only the producer calls it.
+		*
+		* @returns true if fed; false if aborted.
+		* @throws std::logic_error if signal_no_more_food() has been called.
+		* @throws what feed_packet()/feed_frame() throws.
+		*/
+		bool feed(const food_type& food)
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			if (c->no_more_food())
+			{
+				throw std::logic_error("signal_no_more_food() has been called.");
+			}
+
+			while (!aborted)
+			{
+				if (internal_feed(food))
+				{
+					lock.unlock();
+					can_receive.notify_one();
+					return true;
+				}
+
+				// Full. Only a receive() empties it.
+				can_feed.wait(lock, [this] { return aborted || !c->full(); });
+			}
+			return false;
+		}
+
+		/*
+		* Tells the codec no more food is coming, so that receive() drains it. Only the producer calls it.
+		*
+		* @throws std::logic_error if it has been called.
+		*/
+		void signal_no_more_food()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				c->signal_no_more_food();
+			}
+			can_receive.notify_one();
+		}
+
+		/*
+		* Takes the next output of the codec, waiting while it's hungry. Only the consumer calls it.
+		*
+		* @param out where the output goes. See decode_frame(frame&)/encode_packet(packet&).
+		* @returns true if out has an output; false if the codec is drained after signal_no_more_food(), or if aborted.
+		* @throws what decode_frame()/encode_packet() throws.
+		*/
+		bool receive(output_type& out)
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			while (!aborted)
+			{
+				const bool got = internal_receive(out);
+				// Whatever it returned, it's not full any more.
+				can_feed.notify_one();
+				if (got)
+				{
+					return true;
+				}
+				if (c->no_more_food())
+				{
+					// Drained.
+					return false;
+				}
+
+				// Hungry. Only a feed() or signal_no_more_food() feeds it.
+				can_receive.wait(lock, [this] { return aborted || !c->hungry(); });
+			}
+			return false;
+		}
+
+		/*
+		* Makes those waiting in feed() and receive() return false, and any later calls, too.
+		* Any thread can call it. The codec is left as it is; reset() it before using it again.
+		*/
+		void abort() noexcept
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				aborted = true;
+			}
+			can_feed.notify_all();
+			can_receive.notify_all();
+		}
+
+		bool is_aborted() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return aborted;
+		}
+
+		C& get_codec() noexcept { return *c; }
+
+	private:
+		bool internal_feed(const food_type& food)
+		{
+			if constexpr (is_decoder)
+			{
+				return c->feed_packet(food);
+			}
+			else
+			{
+				return c->feed_frame(food);
+			}
+		}
+
+		bool internal_receive(output_type& out)
+		{
+			if constexpr (is_decoder)
+			{
+				return c->decode_frame(out);
+			}
+			else
+			{
+				return c->encode_packet(out);
+			}
+		}
+
+	private:
+		C* c;
+
+		// Held for each call into the codec, and for its flags.
+		mutable std::mutex mtx;
+		// Tells the producer the codec may no longer be full.
+		std::condition_variable can_feed;
+		// Tells the consumer the codec may no longer be hungry.
+		std::condition_variable can_receive;
+		bool aborted = false;
+	};
+
+	using split_decoder = split_codec<decoder>;
+	using split_encoder = split_codec<encoder>;
+}
@@ -15,11 +15,14 @@
 */
 
 #include "frame.h"
+#include "frame_pool.h"
 #include "../util/ff_helpers.h"
 
 extern "C"
 {
 #include <libavutil/channel_layout.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
 }
 
 #include <stdexcept>
@@ -82,6 +85,188 @@ void ff::frame::reset_time(int64_t pts, ff::rational time_base, int64_t duration
 	p_frame->time_base = time_base.av_rational();
 }
 
+bool ff::frame::is_hardware() const noexcept
+{
+	return ready() && nullptr != p_frame->hw_frames_ctx;
+}
+
+AVPixelFormat ff::frame::hardware_sw_format() const
+{
+	if (!is_hardware())
+	{
+		throw std::logic_error("The frame is not a hardware frame.");
+	}
+
+	return reinterpret_cast<const AVHWFramesContext*>(p_frame->hw_frames_ctx->data)->sw_format;
+}
+
+ff::frame ff::frame::transfer_to_software() const
+{
+	if (!is_hardware())
+	{
+		throw std::logic_error("The frame is not a hardware frame.");
+	}
+
+	frame sw(true);
+	// With no buffer in dst, FFmpeg allocates one in a format the device can transfer to.
+	int ret = av_hwframe_transfer_data(sw.p_frame, p_frame, 0);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error: could not transfer the data from the device", ret);
+		}
+	}
+	av_frame_copy_props(*sw.p_frame, *p_frame);
+
+	sw.video_or_audio = true;
+	sw.state = ff_object::READY;
+	sw.internal_find_num_planes();
+
+	return sw;
+}
+
+void ff::frame::allocate_data(const data_properties& dp, frame_pool& pool)
+{
+	if (!created())
+	{
+		throw std::logic_error("Can only allocate data when the frame is created.");
+	}
+
+	pool.get_frame(*this, dp);
+}
+
+ff::frame ff::frame::deep_copy() const
+{
+	if (is_hardware())
+	{
+		throw std::logic_error("Cannot deeply copy a hardware frame.");
+	}
+
+	frame copy(false);
+	copy.state = state;
+	copy.video_or_audio = video_or_audio;
+	copy.num_planes = num_planes;
+
+	if (destroyed())
+	{
+		return copy;
+	}
+
+	copy.internal_allocate_object_memory();
+	// Copy properties that do not affect the data.
+	av_frame_copy_props(*copy.p_frame, *p_frame);
+
+	if (created())
+	{
+		return copy;
+	}
+
+	// Must allocate memory as av_frame_copy doesn't allocate anything.
+	auto dp = get_data_properties();
+	copy.internal_allocate_resources_memory(0, &dp);
+	int ret = av_frame_copy(copy.p_frame, p_frame);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error: could not copy avframe's data", ret);
+		}
+	}
+
+	return copy;
+}
+
+ff::frame ff::frame::crop_view(int x, int y, int w, int h) const
+{
+	if (!ready() || !video_or_audio)
+	{
+		throw std::logic_error("Only ready video frames can be cropped.");
+	}
+	if (is_hardware())
+	{
+		throw std::logic_error("Cannot crop a hardware frame.");
+	}
+	if (x < 0 || y < 0 || w <= 0 || h <= 0 || x > p_frame->width - w || y > p_frame->height - h)
+	{
+		throw std::out_of_range("The rectangle is not inside the frame.");
+	}
+
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)p_frame->format);
+	FF_ASSERT(desc != nullptr, "A ready video frame must have a valid pixel format.");
+	if (desc->flags & AV_PIX_FMT_FLAG_BITSTREAM)
+	{
+		throw std::domain_error("Frames of bitstream pixel formats cannot be cropped without copying.");
+	}
+	if ((x & ((1 << desc->log2_chroma_w) - 1)) || (y & ((1 << desc->log2_chroma_h) - 1)))
+	{
+		throw std::invalid_argument("x and y must be multiples of the chroma subsampling.");
+	}
+
+	frame view = shared_ref();
+	// Relative to what this shows now, which may have been cropped before.
+	view.p_frame->crop_left = x;
+	view.p_frame->crop_top = y;
+	view.p_frame->crop_right = p_frame->width - x - w;
+	view.p_frame->crop_bottom = p_frame->height - y - h;
+
+	// Unaligned, or FFmpeg would crop less on the left to keep the pointers aligned.
+	int ret = av_frame_apply_cropping(view.p_frame, AV_FRAME_CROP_UNALIGNED);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOSYS):
+			throw std::domain_error("The pixel format cannot be cropped without copying.");
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error happened during cropping a frame", ret);
+		}
+	}
+
+	return view;
+}
+
+bool ff::frame::is_writable() const
+{
+	if (!ready())
+	{
+		throw std::logic_error("The frame is not ready.");
+	}
+
+	return 0 != av_frame_is_writable(const_cast<AVFrame*>(p_frame));
+}
+
+void ff::frame::make_writable()
+{
+	if (!ready())
+	{
+		throw std::logic_error("The frame is not ready.");
+	}
+
+	int ret = av_frame_make_writable(p_frame);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error: could not make the avframe writable", ret);
+		}
+	}
+	// The new buffer may have different pointers, but the planes are the same.
+}
+
 void ff::frame::av_frame_copy_props(AVFrame& dst, const AVFrame& src)
 {
 	int ret = ::av_frame_copy_props(&dst, &src);
@@ -157,6 +342,31 @@ void ff::frame::internal_allocate_resources_memory(uint64_t size, void* addition
 	internal_find_num_planes();
 }
 
+void ff::frame::internal_ref(const frame& other)
+{
+	FF_ASSERT(nullptr != p_frame && nullptr == p_frame->buf[0], "Should only be called right after the avframe is allocated.");
+
+	if (other.created())
+	{
+		// Nothing to reference. av_frame_ref() would try to allocate data for it.
+		av_frame_copy_props(*p_frame, *other.p_frame);
+		return;
+	}
+
+	int ret = av_frame_ref(p_frame, other.p_frame);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error: could not reference avframe's data", ret);
+		}
+	}
+}
+
 void ff::frame::internal_release_object_memory() noexcept
 {
 	ffhelpers::safely_free_frame(&p_frame);
@@ -175,6 +385,20 @@ void ff::frame::internal_find_num_planes() noexcept(FF_ASSERTION_DISABLED)
 	// 2. Ready (after a copy, resource take over, etc.)
 	FF_ASSERT(!destroyed(), "I should not call it when destroyed.");
 
+	if (nullptr != p_frame->hw_frames_ctx)
+	{
+		// Hardware frames store device handles, not necessarily from data[0] on
+		// (e.g. VAAPI only uses data[3]). Count up to the last one.
+		num_planes = AV_NUM_DATA_POINTERS;
+		while (num_planes > 0 && nullptr == p_frame->data[num_planes - 1])
+		{
+			--num_planes;
+		}
+
+		FF_ASSERT(0 != num_planes, "Should have some data.");
+		return;
+	}
+
 	// AV_NUM_DATA_POINTERS = max number of possible planes
 	for (num_planes = 0; num_planes < AV_NUM_DATA_POINTERS; ++num_planes)
 	{
@@ -222,29 +446,7 @@ ff::frame::frame(const frame& other)
 	}
 
 	internal_allocate_object_memory();
-	// Copy properties that do not affect the data.
-	av_frame_copy_props(*p_frame, *other.p_frame);
-
-	if (other.created())
-	{
-		return;
-	}
-
-	// Must allocate memory as av_frame_copy doesn't allocate anything.
-	auto dp = other.get_data_properties();
-	internal_allocate_resources_memory(0, const_cast<data_properties*>(&dp));
-	int ret = av_frame_copy(p_frame, other.p_frame);
-	if (ret < 0)
-	{
-		switch (ret)
-		{
-		case AVERROR(ENOMEM):
-			throw std::bad_alloc();
-			break;
-		default:
-			ON_FF_ERROR_WITH_CODE("Unexpected error: could not copy avframe's data", ret);
-		}
-	}
+	internal_ref(other);
 }
 
 ff::frame::frame(frame&& other) noexcept
@@ -263,33 +465,11 @@ ff::frame& ff::frame::operator=(const frame& right)
 		return *this;
 	}
 
-	internal_allocate_object_memory();
-	// Copy properties that do not affect the data.
-	av_frame_copy_props(*p_frame, *right.p_frame);
-
-	if (right.created())
-	{
-		return *this;
-	}
-
 	video_or_audio = right.video_or_audio;
 	num_planes = right.num_planes;
 
-	// Must allocate memory as av_frame_copy doesn't allocate anything.
-	auto dp = right.get_data_properties();
-	internal_allocate_resources_memory(0, const_cast<data_properties*>(&dp));
-	int ret = av_frame_copy(p_frame, right.p_frame);
-	if (ret < 0)
-	{
-		switch (ret)
-		{
-		case AVERROR(ENOMEM):
-			throw std::bad_alloc();
-			break;
-		default:
-			ON_FF_ERROR_WITH_CODE("Unexpected error: could not copy avframe's data", ret);
-		}
-	}
+	internal_allocate_object_memory();
+	internal_ref(right);
 
 	return *this;
 }
@@ -317,6 +497,29 @@ void ff::frame::set_v_or_a(bool new_v_or_a)
 	video_or_audio = new_v_or_a;
 }
 
+size_t ff::frame::memory_size() const noexcept
+{
+	if (!ready())
+	{
+		return 0;
+	}
+
+	size_t size = 0;
+	for (const auto* buf : p_frame->buf)
+	{
+		if (nullptr != buf)
+		{
+			size += buf->size;
+		}
+	}
+	for (int i = 0; i < p_frame->nb_extended_buf; ++i)
+	{
+		size += p_frame->extended_buf[i]->size;
+	}
+
+	return size;
+}
+
 int ff::frame::number_planes() const
 {
 	if (!ready())
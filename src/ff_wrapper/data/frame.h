@@ -27,6 +27,8 @@ extern "C"
 
 namespace ff
 {
+	class frame_pool;
+
 	/*
 	* Represents either a video or an audio frame.
 	* 
@@ -46,6 +48,17 @@ namespace ff
 	* For such frame data, the pointer returned by data() points to the end of a data plane,
 	* and line_size() returns a negative number, so that ptr+line_size always navigates to the next line.
 	* 
+	* A video frame may also be a hardware frame (is_hardware()), whose data lies in the memory of a 
+	* hardware device (e.g. decoded by a decoder on a GPU). Its pixel format is the device's (e.g. AV_PIX_FMT_CUDA),
+	* and what data() returns are handles of the device that you cannot read directly.
+	* hardware_sw_format() tells how the data is laid out on the device,
+	* and transfer_to_software() gives you a copy of it in the system memory.
+	* 
+	* Copying a frame is cheap: the copy references the same data as the original, like a packet.
+	* Hence, before you write to the data of a frame that may be shared, call make_writable(),
+	* which copies the data only if someone else also references it.
+	* If you really need a frame with its own data, call deep_copy().
+	* 
 	* Invariants: 
 	*	those of ff_object, and
 	*	if READY, then data is ref counted through AVBuffer (i.e. it cannot store custom data).
@@ -54,6 +67,10 @@ namespace ff
 	{
 		// Decoder needs to set it up during decoding
 		friend class decoder;
+		// frame_pool needs to set it up after giving it pooled buffers
+		friend class frame_pool;
+		// filter_graph needs to set it up after filtering
+		friend class filter_graph;
 
 	public:
 		/*
@@ -169,9 +186,9 @@ namespace ff
 		frame(::AVFrame* frame, bool v_or_a, bool has_data = true);
 
 		/*
-		* Copies another frame and its data, if it contains any.
+		* Copies another frame with av_frame_ref(), which makes this refer to the same data as other.
+		* NOTE: it does NOT copy other's data! Call deep_copy() for that.
 		* If other's DESTROYED, set this to nullptr, too.
-		* NOTE: Different from packet(const packet&), this copies the data as well.
 		*/
 		frame(const frame& other);
 		/*
@@ -201,6 +218,13 @@ namespace ff
 		*/
 		void set_v_or_a(bool new_v_or_a);
 
+		/*
+		* @returns how many bytes the buffers I reference hold. 0 if I'm not ready.
+		* A buffer shared with other frames is counted in full by each.
+		* For a hardware frame, it's what the reference to the surface takes, not the surface.
+		*/
+		size_t memory_size() const noexcept;
+
 		/*
 		* @returns number of data planes.
 		* @throws std::logic_error if the frame is not ready.
@@ -266,12 +290,59 @@ namespace ff
 
 		/*
 		* Note: It is highly recommended to use the copy ctor/ass operator to copy a frame.
+		* They do the same thing now.
 		*
 		* @returns a frame that references the same data as this does.
 		* @throws std::logic_error if this isn't ready.
 		*/
 		frame shared_ref() const;
 
+		/*
+		* Copies the frame and its data, so that the copy does not share the data with anyone.
+		* 
+		* @returns the copy. Its state is the same as this's.
+		* @throws std::logic_error if this is a hardware frame. Call transfer_to_software() instead.
+		*/
+		frame deep_copy() const;
+
+		/*
+		* Crops the frame without copying anything: the view references the same data,
+		* with its data pointers moved to the top-left of the rectangle and its width and height
+		* being the rectangle's. Other properties are the same as this's.
+		* It is an ordinary frame, so you can feed it to an encoder or convert it with a frame_transformer
+		* of the cropped size.
+		* 
+		* Writing to the data of one also changes the other. Call make_writable() on the view
+		* first if you want to write to the view only.
+		* The planes of the view may not be aligned as SIMD code likes, which can slow down what uses them.
+		* 
+		* @param x, y the top-left of the rectangle. Must be multiples of the chroma subsampling
+		* (e.g. even for yuv420p) so that the chroma planes can be cropped at the same place.
+		* @param w, h the size of the rectangle.
+		* @returns the view.
+		* @throws std::logic_error if this is not a ready video frame, or if it is a hardware frame.
+		* @throws std::out_of_range if the rectangle is empty or not inside the frame.
+		* @throws std::invalid_argument if x or y doesn't agree with the chroma subsampling.
+		* @throws std::domain_error if the pixel format can't be cropped (e.g. a bitstream format).
+		*/
+		frame crop_view(int x, int y, int w, int h) const;
+
+		/*
+		* @returns true iff this is the only reference to its data, so that
+		* writing to the data will not affect other frames.
+		* @throws std::logic_error if the frame is not ready.
+		*/
+		bool is_writable() const;
+
+		/*
+		* Ensures that the data is writable (see is_writable()).
+		* If it's not, then I copy the data to a new buffer and let the frame reference it.
+		* Other frames that referenced the previous data still reference it, unchanged.
+		* 
+		* @throws std::logic_error if the frame is not ready.
+		*/
+		void make_writable();
+
 		/*
 		* Resets the time fields to the given arguments.
 		*
@@ -283,6 +354,27 @@ namespace ff
 		*/
 		void reset_time(int64_t pts, ff::rational time_base, int64_t duration = 0);
 
+	public:
+		/*
+		* @returns true iff the frame is ready and its data lies in the memory of a hardware device.
+		*/
+		bool is_hardware() const noexcept;
+
+		/*
+		* @returns the (software) pixel format in which the data is laid out on the device.
+		* @throws std::logic_error if !is_hardware().
+		*/
+		AVPixelFormat hardware_sw_format() const;
+
+		/*
+		* Copies the data of a hardware frame into the system memory.
+		* The properties (e.g. time) are copied as well.
+		*
+		* @returns a ready software frame with the data.
+		* @throws std::logic_error if !is_hardware().
+		*/
+		frame transfer_to_software() const;
+
 	public:
 		/*
 		* Clears all data it stores so it can be reused to store some other data.
@@ -301,6 +393,15 @@ namespace ff
 		{
 			allocate_resources_memory(0, const_cast<data_properties*>(&dp));
 		}
+
+		/*
+		* Same as allocate_data(dp), except that the data is allocated from pool,
+		* which avoids allocating new memory when pool has unused buffers of dp.
+		*
+		* @throws std::logic_error if the frame is not CREATED.
+		* @throws std::invalid_argument if dp is invalid.
+		*/
+		void allocate_data(const data_properties& dp, frame_pool& pool);
 		
 	public:
 		/*
@@ -337,6 +438,13 @@ namespace ff
 		*/
 		void internal_find_num_planes() noexcept(FF_ASSERTION_DISABLED);
 
+		/*
+		* Common piece of code of the copy ctor and the copy ass operator.
+		* Lets the newly allocated avframe reference other's data, or 
+		* only copies other's properties if it has no data.
+		*/
+		void internal_ref(const frame& other);
+
 	private:
 		::AVFrame* p_frame;
 
@@ -0,0 +1,1422 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "frame_ops.h"
+
+extern "C"
+{
+#include <libavutil/cpu.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define FF_FRAME_OPS_X86 1
+	#include <immintrin.h>
+	// GCC and Clang only emit an instruction set for functions that ask for it.
+	// MSVC emits any intrinsic anywhere.
+	#if defined(__GNUC__) || defined(__clang__)
+		#define FF_TARGET(isa) __attribute__((target(isa)))
+	#else
+		#define FF_TARGET(isa)
+	#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+	#define FF_FRAME_OPS_NEON 1
+	#include <arm_neon.h>
+#endif
+
+namespace
+{
+	using ff::frame;
+	using ff::plane_view;
+	using ff::frame_ops::simd_level;
+	using ff::frame_ops::quality_score;
+
+	/*
+	* The row loops that have vectorized versions.
+	* Every version gives exactly the same results as the scalar one.
+	*/
+	struct row_kernels
+	{
+		// d[i] = (s[i] * a[i] + d[i] * (255 - a[i])) / 255, rounded to nearest.
+		void (*blend)(uint8_t* d, const uint8_t* s, const uint8_t* a, int n);
+		// d[i] = s[i] << 2.
+		void (*widen)(uint16_t* d, const uint8_t* s, int n);
+		// d[i] = min((s[i] + 2) >> 2, 255).
+		void (*narrow)(uint8_t* d, const uint16_t* s, int n);
+		// The sum of (a[i] - b[i])^2.
+		uint64_t (*sse8)(const uint8_t* a, const uint8_t* b, int n);
+		uint64_t (*sse16)(const uint16_t* a, const uint16_t* b, int n);
+		// Adds a[i], b[i], a[i]^2 + b[i]^2, and a[i] * b[i] to s[i], s[n + i], s[2n + i], and s[3n + i].
+		void (*ssim_sums)(uint32_t* s, const uint8_t* a, const uint8_t* b, int n);
+		// The sum of |a[i] - b[i]|.
+		uint64_t (*sad)(const uint8_t* a, const uint8_t* b, int n);
+	};
+
+	/////////////////////////////// Scalar ///////////////////////////////
+
+	void blend_row_scalar(uint8_t* d, const uint8_t* s, const uint8_t* a, int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			// x / 255 rounded, without a division. Exact for x in [0, 255 * 255].
+			const unsigned t = s[i] * a[i] + d[i] * (255u - a[i]) + 128u;
+			d[i] = static_cast<uint8_t>((t + (t >> 8)) >> 8);
+		}
+	}
+
+	void widen_row_scalar(uint16_t* d, const uint8_t* s, int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			d[i] = static_cast<uint16_t>(s[i] << 2);
+		}
+	}
+
+	void narrow_row_scalar(uint8_t* d, const uint16_t* s, int n)
+	{
+		for (int i = 0; i < n; ++i)
+		{
+			d[i] = static_cast<uint8_t>(std::min((s[i] + 2u) >> 2, 255u));
+		}
+	}
+
+	uint64_t sse8_row_scalar(const uint8_t* a, const uint8_t* b, int n)
+	{
+		uint64_t res = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			const int d = a[i] - b[i];
+			res += static_cast<unsigned>(d * d);
+		}
+		return res;
+	}
+
+	uint64_t sse16_row_scalar(const uint16_t* a, const uint16_t* b, int n)
+	{
+		uint64_t res = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			const int64_t d = static_cast<int64_t>(a[i]) - b[i];
+			res += static_cast<uint64_t>(d * d);
+		}
+		return res;
+	}
+
+	// ssim_sums for elements [from, n), so that the vectorized versions can finish their tails.
+	template <typename T>
+	void ssim_sums_from_scalar(uint32_t* s, const T* a, const T* b, int from, int n)
+	{
+		for (int i = from; i < n; ++i)
+		{
+			const uint32_t x = a[i], y = b[i];
+			s[i] += x;
+			s[n + i] += y;
+			s[2 * n + i] += x * x + y * y;
+			s[3 * n + i] += x * y;
+		}
+	}
+
+	template <typename T>
+	void ssim_sums_row_scalar(uint32_t* s, const T* a, const T* b, int n)
+	{
+		ssim_sums_from_scalar(s, a, b, 0, n);
+	}
+
+	uint64_t sad_row_scalar(const uint8_t* a, const uint8_t* b, int n)
+	{
+		uint64_t res = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			res += static_cast<unsigned>(a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]);
+		}
+		return res;
+	}
+
+	constexpr row_kernels scalar_kernels
+	{
+		blend_row_scalar, widen_row_scalar, narrow_row_scalar,
+		sse8_row_scalar, sse16_row_scalar, ssim_sums_row_scalar<uint8_t>,
+		sad_row_scalar
+	};
+
+#ifdef FF_FRAME_OPS_X86
+	/////////////////////////////// SSE4.1 ///////////////////////////////
+
+	// Blends 8 pixels widened to 16 bits.
+	FF_TARGET("sse4.1") inline __m128i blend8_sse4(__m128i s, __m128i d, __m128i a)
+	{
+		const __m128i x = _mm_add_epi16
+		(
+			_mm_mullo_epi16(s, a),
+			_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a))
+		);
+		const __m128i t = _mm_add_epi16(x, _mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+	}
+
+	FF_TARGET("sse4.1") void blend_row_sse4(uint8_t* d, const uint8_t* s, const uint8_t* a, int n)
+	{
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			const __m128i vs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+			const __m128i vd = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+			const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+
+			const __m128i lo = blend8_sse4(_mm_cvtepu8_epi16(vs), _mm_cvtepu8_epi16(vd), _mm_cvtepu8_epi16(va));
+			const __m128i hi = blend8_sse4
+			(
+				_mm_cvtepu8_epi16(_mm_srli_si128(vs, 8)),
+				_mm_cvtepu8_epi16(_mm_srli_si128(vd, 8)),
+				_mm_cvtepu8_epi16(_mm_srli_si128(va, 8))
+			);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm_packus_epi16(lo, hi));
+		}
+		blend_row_scalar(d + i, s + i, a + i, n - i);
+	}
+
+	FF_TARGET("sse4.1") void widen_row_sse4(uint16_t* d, const uint8_t* s, int n)
+	{
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(d + i), _mm_slli_epi16(_mm_cvtepu8_epi16(v), 2));
+		}
+		widen_row_scalar(d + i, s + i, n - i);
+	}
+
+	FF_TARGET("sse4.1") void narrow_row_sse4(uint8_t* d, const uint16_t* s, int n)
+	{
+		// Saturating add, so that values above 10 bits stay large and are packed to 255.
+		const __m128i two = _mm_set1_epi16(2);
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+			const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + 8));
+			_mm_storeu_si128
+			(
+				reinterpret_cast<__m128i*>(d + i),
+				_mm_packus_epi16
+				(
+					_mm_srli_epi16(_mm_adds_epu16(lo, two), 2),
+					_mm_srli_epi16(_mm_adds_epu16(hi, two), 2)
+				)
+			);
+		}
+		narrow_row_scalar(d + i, s + i, n - i);
+	}
+
+	FF_TARGET("sse4.1") inline uint64_t sum_epi64_sse4(__m128i v)
+	{
+		alignas(16) uint64_t lanes[2];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+		return lanes[0] + lanes[1];
+	}
+
+	FF_TARGET("sse4.1") uint64_t sse8_row_sse4(const uint8_t* a, const uint8_t* b, int n)
+	{
+		__m128i acc = _mm_setzero_si128();
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			const __m128i lo = _mm_sub_epi16(_mm_cvtepu8_epi16(va), _mm_cvtepu8_epi16(vb));
+			const __m128i hi = _mm_sub_epi16
+			(
+				_mm_cvtepu8_epi16(_mm_srli_si128(va, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(vb, 8))
+			);
+			// Each 32 bit lane holds 4 squares, at most 4 * 255^2, before it's widened.
+			const __m128i sq = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+			acc = _mm_add_epi64(acc, _mm_cvtepu32_epi64(sq));
+			acc = _mm_add_epi64(acc, _mm_cvtepu32_epi64(_mm_srli_si128(sq, 8)));
+		}
+		return sum_epi64_sse4(acc) + sse8_row_scalar(a + i, b + i, n - i);
+	}
+
+	// Adds the squares of the 4 unsigned 32 bit lanes of d to the 2 64 bit lanes of acc.
+	FF_TARGET("sse4.1") inline __m128i add_squares_epu32_sse4(__m128i acc, __m128i d)
+	{
+		acc = _mm_add_epi64(acc, _mm_mul_epu32(d, d));
+		const __m128i odd = _mm_srli_epi64(d, 32);
+		return _mm_add_epi64(acc, _mm_mul_epu32(odd, odd));
+	}
+
+	FF_TARGET("sse4.1") uint64_t sse16_row_sse4(const uint16_t* a, const uint16_t* b, int n)
+	{
+		// |a - b| fits 16 bits, and its square fits 32 unsigned bits, so nothing can overflow.
+		__m128i acc = _mm_setzero_si128();
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			const __m128i d = _mm_sub_epi16(_mm_max_epu16(va, vb), _mm_min_epu16(va, vb));
+			acc = add_squares_epu32_sse4(acc, _mm_cvtepu16_epi32(d));
+			acc = add_squares_epu32_sse4(acc, _mm_cvtepu16_epi32(_mm_srli_si128(d, 8)));
+		}
+		return sum_epi64_sse4(acc) + sse16_row_scalar(a + i, b + i, n - i);
+	}
+
+	// Adds v to the 4 elements at p.
+	FF_TARGET("sse4.1") inline void accumulate_epi32_sse4(uint32_t* p, __m128i v)
+	{
+		__m128i* q = reinterpret_cast<__m128i*>(p);
+		_mm_storeu_si128(q, _mm_add_epi32(_mm_loadu_si128(q), v));
+	}
+
+	FF_TARGET("sse4.1") void ssim_sums_row_sse4(uint32_t* s, const uint8_t* a, const uint8_t* b, int n)
+	{
+		int i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			int32_t wa, wb;
+			std::memcpy(&wa, a + i, 4);
+			std::memcpy(&wb, b + i, 4);
+			const __m128i x = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(wa));
+			const __m128i y = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(wb));
+			accumulate_epi32_sse4(s + i, x);
+			accumulate_epi32_sse4(s + n + i, y);
+			accumulate_epi32_sse4(s + 2 * n + i, _mm_add_epi32(_mm_mullo_epi32(x, x), _mm_mullo_epi32(y, y)));
+			accumulate_epi32_sse4(s + 3 * n + i, _mm_mullo_epi32(x, y));
+		}
+		ssim_sums_from_scalar(s, a, b, i, n);
+	}
+
+	FF_TARGET("sse4.1") uint64_t sad_row_sse4(const uint8_t* a, const uint8_t* b, int n)
+	{
+		// psadbw sums 8 absolute differences into each 64 bit lane.
+		__m128i acc = _mm_setzero_si128();
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+		}
+		return sum_epi64_sse4(acc) + sad_row_scalar(a + i, b + i, n - i);
+	}
+
+	constexpr row_kernels sse4_kernels
+	{
+		blend_row_sse4, widen_row_sse4, narrow_row_sse4,
+		sse8_row_sse4, sse16_row_sse4, ssim_sums_row_sse4,
+		sad_row_sse4
+	};
+
+	/////////////////////////////// AVX2 ///////////////////////////////
+
+	// Blends 16 pixels widened to 16 bits.
+	FF_TARGET("avx2") inline __m256i blend16_avx2(__m256i s, __m256i d, __m256i a)
+	{
+		const __m256i x = _mm256_add_epi16
+		(
+			_mm256_mullo_epi16(s, a),
+			_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), a))
+		);
+		const __m256i t = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+		return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+	}
+
+	// Packs two vectors of 16 bit values to bytes, in order.
+	// _mm256_packus_epi16 packs within each 128 bit lane, hence the permute.
+	FF_TARGET("avx2") inline __m256i pack_in_order_avx2(__m256i lo, __m256i hi)
+	{
+		return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+	}
+
+	FF_TARGET("avx2") inline __m256i load_widened_avx2(const uint8_t* p)
+	{
+		return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+	}
+
+	FF_TARGET("avx2") void blend_row_avx2(uint8_t* d, const uint8_t* s, const uint8_t* a, int n)
+	{
+		int i = 0;
+		for (; i + 32 <= n; i += 32)
+		{
+			const __m256i lo = blend16_avx2(load_widened_avx2(s + i), load_widened_avx2(d + i), load_widened_avx2(a + i));
+			const __m256i hi = blend16_avx2
+			(
+				load_widened_avx2(s + i + 16), load_widened_avx2(d + i + 16), load_widened_avx2(a + i + 16)
+			);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), pack_in_order_avx2(lo, hi));
+		}
+		blend_row_sse4(d + i, s + i, a + i, n - i);
+	}
+
+	FF_TARGET("avx2") void widen_row_avx2(uint16_t* d, const uint8_t* s, int n)
+	{
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(d + i), _mm256_slli_epi16(load_widened_avx2(s + i), 2));
+		}
+		widen_row_sse4(d + i, s + i, n - i);
+	}
+
+	FF_TARGET("avx2") void narrow_row_avx2(uint8_t* d, const uint16_t* s, int n)
+	{
+		const __m256i two = _mm256_set1_epi16(2);
+		int i = 0;
+		for (; i + 32 <= n; i += 32)
+		{
+			const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+			const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + 16));
+			_mm256_storeu_si256
+			(
+				reinterpret_cast<__m256i*>(d + i),
+				pack_in_order_avx2
+				(
+					_mm256_srli_epi16(_mm256_adds_epu16(lo, two), 2),
+					_mm256_srli_epi16(_mm256_adds_epu16(hi, two), 2)
+				)
+			);
+		}
+		narrow_row_sse4(d + i, s + i, n - i);
+	}
+
+	FF_TARGET("avx2") inline uint64_t sum_epi64_avx2(__m256i v)
+	{
+		return sum_epi64_sse4(_mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+	}
+
+	FF_TARGET("avx2") uint64_t sse8_row_avx2(const uint8_t* a, const uint8_t* b, int n)
+	{
+		__m256i acc = _mm256_setzero_si256();
+		int i = 0;
+		for (; i + 32 <= n; i += 32)
+		{
+			const __m256i lo = _mm256_sub_epi16(load_widened_avx2(a + i), load_widened_avx2(b + i));
+			const __m256i hi = _mm256_sub_epi16(load_widened_avx2(a + i + 16), load_widened_avx2(b + i + 16));
+			const __m256i sq = _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi));
+			acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sq)));
+			acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sq, 1)));
+		}
+		return sum_epi64_avx2(acc) + sse8_row_sse4(a + i, b + i, n - i);
+	}
+
+	FF_TARGET("avx2") inline __m256i add_squares_epu32_avx2(__m256i acc, __m256i d)
+	{
+		acc = _mm256_add_epi64(acc, _mm256_mul_epu32(d, d));
+		const __m256i odd = _mm256_srli_epi64(d, 32);
+		return _mm256_add_epi64(acc, _mm256_mul_epu32(odd, odd));
+	}
+
+	FF_TARGET("avx2") uint64_t sse16_row_avx2(const uint16_t* a, const uint16_t* b, int n)
+	{
+		__m256i acc = _mm256_setzero_si256();
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+			const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+			const __m256i d = _mm256_sub_epi16(_mm256_max_epu16(va, vb), _mm256_min_epu16(va, vb));
+			acc = add_squares_epu32_avx2(acc, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(d)));
+			acc = add_squares_epu32_avx2(acc, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(d, 1)));
+		}
+		return sum_epi64_avx2(acc) + sse16_row_sse4(a + i, b + i, n - i);
+	}
+
+	FF_TARGET("avx2") inline void accumulate_epi32_avx2(uint32_t* p, __m256i v)
+	{
+		__m256i* q = reinterpret_cast<__m256i*>(p);
+		_mm256_storeu_si256(q, _mm256_add_epi32(_mm256_loadu_si256(q), v));
+	}
+
+	FF_TARGET("avx2") void ssim_sums_row_avx2(uint32_t* s, const uint8_t* a, const uint8_t* b, int n)
+	{
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + i)));
+			const __m256i y = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i)));
+			accumulate_epi32_avx2(s + i, x);
+			accumulate_epi32_avx2(s + n + i, y);
+			accumulate_epi32_avx2(s + 2 * n + i, _mm256_add_epi32(_mm256_mullo_epi32(x, x), _mm256_mullo_epi32(y, y)));
+			accumulate_epi32_avx2(s + 3 * n + i, _mm256_mullo_epi32(x, y));
+		}
+		ssim_sums_from_scalar(s, a, b, i, n);
+	}
+
+	FF_TARGET("avx2") uint64_t sad_row_avx2(const uint8_t* a, const uint8_t* b, int n)
+	{
+		__m256i acc = _mm256_setzero_si256();
+		int i = 0;
+		for (; i + 32 <= n; i += 32)
+		{
+			const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+			const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+			acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+		}
+		return sum_epi64_avx2(acc) + sad_row_sse4(a + i, b + i, n - i);
+	}
+
+	constexpr row_kernels avx2_kernels
+	{
+		blend_row_avx2, widen_row_avx2, narrow_row_avx2,
+		sse8_row_avx2, sse16_row_avx2, ssim_sums_row_avx2,
+		sad_row_avx2
+	};
+#endif // FF_FRAME_OPS_X86
+
+#ifdef FF_FRAME_OPS_NEON
+	/////////////////////////////// NEON ///////////////////////////////
+
+	// Blends 8 pixels.
+	inline uint8x8_t blend8_neon(uint8x8_t s, uint8x8_t d, uint8x8_t a)
+	{
+		uint16x8_t x = vmull_u8(s, a);
+		x = vmlal_u8(x, d, vsub_u8(vdup_n_u8(255), a));
+		const uint16x8_t t = vaddq_u16(x, vdupq_n_u16(128));
+		return vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+	}
+
+	void blend_row_neon(uint8_t* d, const uint8_t* s, const uint8_t* a, int n)
+	{
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			const uint8x16_t vs = vld1q_u8(s + i), vd = vld1q_u8(d + i), va = vld1q_u8(a + i);
+			vst1q_u8
+			(
+				d + i,
+				vcombine_u8
+				(
+					blend8_neon(vget_low_u8(vs), vget_low_u8(vd), vget_low_u8(va)),
+					blend8_neon(vget_high_u8(vs), vget_high_u8(vd), vget_high_u8(va))
+				)
+			);
+		}
+		blend_row_scalar(d + i, s + i, a + i, n - i);
+	}
+
+	void widen_row_neon(uint16_t* d, const uint8_t* s, int n)
+	{
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			const uint8x16_t v = vld1q_u8(s + i);
+			vst1q_u16(d + i, vshll_n_u8(vget_low_u8(v), 2));
+			vst1q_u16(d + i + 8, vshll_n_u8(vget_high_u8(v), 2));
+		}
+		widen_row_scalar(d + i, s + i, n - i);
+	}
+
+	void narrow_row_neon(uint8_t* d, const uint16_t* s, int n)
+	{
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			// Rounding, saturating shift right and narrow: exactly min((v + 2) >> 2, 255).
+			vst1q_u8(d + i, vcombine_u8(vqrshrn_n_u16(vld1q_u16(s + i), 2), vqrshrn_n_u16(vld1q_u16(s + i + 8), 2)));
+		}
+		narrow_row_scalar(d + i, s + i, n - i);
+	}
+
+	uint64_t sse8_row_neon(const uint8_t* a, const uint8_t* b, int n)
+	{
+		uint64x2_t acc = vdupq_n_u64(0);
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			const uint8x16_t d = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+			const uint16x8_t lo = vmull_u8(vget_low_u8(d), vget_low_u8(d));
+			const uint16x8_t hi = vmull_u8(vget_high_u8(d), vget_high_u8(d));
+			acc = vpadalq_u32(acc, vpadalq_u16(vpaddlq_u16(lo), hi));
+		}
+		return vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1) + sse8_row_scalar(a + i, b + i, n - i);
+	}
+
+	uint64_t sse16_row_neon(const uint16_t* a, const uint16_t* b, int n)
+	{
+		// |a - b| fits 16 bits, and its square fits 32 unsigned bits.
+		uint64x2_t acc = vdupq_n_u64(0);
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const uint16x8_t d = vabdq_u16(vld1q_u16(a + i), vld1q_u16(b + i));
+			acc = vpadalq_u32(acc, vmull_u16(vget_low_u16(d), vget_low_u16(d)));
+			acc = vpadalq_u32(acc, vmull_u16(vget_high_u16(d), vget_high_u16(d)));
+		}
+		return vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1) + sse16_row_scalar(a + i, b + i, n - i);
+	}
+
+	inline void accumulate_u32_neon(uint32_t* p, uint32x4_t v)
+	{
+		vst1q_u32(p, vaddq_u32(vld1q_u32(p), v));
+	}
+
+	void ssim_sums_row_neon(uint32_t* s, const uint8_t* a, const uint8_t* b, int n)
+	{
+		int i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			const uint16x8_t x = vmovl_u8(vld1_u8(a + i));
+			const uint16x8_t y = vmovl_u8(vld1_u8(b + i));
+			for (int half = 0; half < 2; ++half)
+			{
+				const uint16x4_t xh = 0 == half ? vget_low_u16(x) : vget_high_u16(x);
+				const uint16x4_t yh = 0 == half ? vget_low_u16(y) : vget_high_u16(y);
+				const int j = i + 4 * half;
+				accumulate_u32_neon(s + j, vmovl_u16(xh));
+				accumulate_u32_neon(s + n + j, vmovl_u16(yh));
+				accumulate_u32_neon(s + 2 * n + j, vmlal_u16(vmull_u16(xh, xh), yh, yh));
+				accumulate_u32_neon(s + 3 * n + j, vmull_u16(xh, yh));
+			}
+		}
+		ssim_sums_from_scalar(s, a, b, i, n);
+	}
+
+	uint64_t sad_row_neon(const uint8_t* a, const uint8_t* b, int n)
+	{
+		uint64x2_t acc = vdupq_n_u64(0);
+		int i = 0;
+		for (; i + 16 <= n; i += 16)
+		{
+			const uint8x16_t d = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+			acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(d)));
+		}
+		return vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1) + sad_row_scalar(a + i, b + i, n - i);
+	}
+
+	constexpr row_kernels neon_kernels
+	{
+		blend_row_neon, widen_row_neon, narrow_row_neon,
+		sse8_row_neon, sse16_row_neon, ssim_sums_row_neon,
+		sad_row_neon
+	};
+#endif // FF_FRAME_OPS_NEON
+
+	/////////////////////////////// Dispatching ///////////////////////////////
+
+	simd_level detect_simd_level() noexcept
+	{
+		[[maybe_unused]] const int flags = av_get_cpu_flags();
+#if defined(FF_FRAME_OPS_X86)
+		if (flags & AV_CPU_FLAG_AVX2)
+		{
+			return simd_level::avx2;
+		}
+		if (flags & AV_CPU_FLAG_SSE4)
+		{
+			return simd_level::sse4;
+		}
+#elif defined(FF_FRAME_OPS_NEON)
+		if (flags & AV_CPU_FLAG_NEON)
+		{
+			return simd_level::neon;
+		}
+#endif
+		return simd_level::scalar;
+	}
+
+	std::atomic<simd_level>& current_level() noexcept
+	{
+		static std::atomic<simd_level> level(ff::frame_ops::supported_simd_level());
+		return level;
+	}
+
+	const row_kernels& kernels() noexcept
+	{
+		switch (current_level().load(std::memory_order_relaxed))
+		{
+#if defined(FF_FRAME_OPS_X86)
+		case simd_level::sse4:
+			return sse4_kernels;
+		case simd_level::avx2:
+			return avx2_kernels;
+#elif defined(FF_FRAME_OPS_NEON)
+		case simd_level::neon:
+			return neon_kernels;
+#endif
+		default:
+			return scalar_kernels;
+		}
+	}
+
+	/////////////////////////////// Frames ///////////////////////////////
+
+	/*
+	* @returns the pixel format of f.
+	* @throws std::logic_error if f is not a ready video frame, or if it is a hardware frame.
+	*/
+	int video_format(const frame& f)
+	{
+		if (!f.ready() || !f.v_or_a())
+		{
+			throw std::logic_error("Only a ready video frame can be processed.");
+		}
+		if (f.is_hardware())
+		{
+			throw std::logic_error("The data of a hardware frame cannot be processed.");
+		}
+
+		return f.get_data_properties().fmt;
+	}
+
+	/*
+	* @returns a frame with new data of fmt, w, h, and the properties of src.
+	*/
+	frame new_frame_like(const frame& src, AVPixelFormat fmt, int w, int h)
+	{
+		frame dst(true);
+		dst.allocate_data(frame::data_properties(fmt, w, h));
+		frame::av_frame_copy_props(dst, src);
+		return dst;
+	}
+
+	template <typename T>
+	void copy_rows(plane_view<const T> src, plane_view<T> dst)
+	{
+		if (src.width() != dst.width() || src.height() != dst.height())
+		{
+			throw std::invalid_argument("The sizes of the planes differ.");
+		}
+
+		for (int i = 0; i < src.height(); ++i)
+		{
+			std::memcpy(dst.row(i), src.row(i), sizeof(T) * src.width());
+		}
+	}
+
+	template <typename T>
+	void fill_rows(plane_view<T> dst, T v)
+	{
+		for (int i = 0; i < dst.height(); ++i)
+		{
+			std::fill_n(dst.row(i), dst.width(), v);
+		}
+	}
+
+	/*
+	* Writes src into dst at (left, top) and v around it.
+	* memcpy and memset (which fill_n becomes for bytes) are vectorized by the C library already.
+	*/
+	void pad_rows(plane_view<const uint8_t> src, plane_view<uint8_t> dst, int left, int top, uint8_t v)
+	{
+		const int right = dst.width() - left - src.width();
+		for (int i = 0; i < dst.height(); ++i)
+		{
+			uint8_t* row = dst.row(i);
+			if (i < top || i >= top + src.height())
+			{
+				std::fill_n(row, dst.width(), v);
+				continue;
+			}
+
+			std::fill_n(row, left, v);
+			std::memcpy(row + left, src.row(i - top), src.width());
+			std::fill_n(row + left + src.width(), right, v);
+		}
+	}
+
+	template <AVPixelFormat From, AVPixelFormat To, int Plane, typename RowKernel>
+	void convert_rows(const frame& src, frame& dst, RowKernel k)
+	{
+		auto s = ff::view_plane<From, Plane>(src);
+		auto d = ff::view_plane<To, Plane>(dst);
+		for (int i = 0; i < s.height(); ++i)
+		{
+			k(d.row(i), s.row(i), s.width());
+		}
+	}
+
+	/////////////////////////////// Quality ///////////////////////////////
+
+	// How many rows of pixels a task of measuring quality covers.
+	// It doesn't depend on the number of threads, so neither do the results.
+	constexpr int quality_band_rows = 64;
+
+	/*
+	* Threads kept for the whole process to help run_tasks(), so that measuring every frame
+	* (as quality_meter does on its encoding thread) doesn't start and join threads each time.
+	* They are started as they are first needed, up to the number of hardware threads.
+	* I'm never destroyed, as joining threads while the process exits can deadlock (e.g. under the loader lock of a DLL);
+	* the helpers just wait until then.
+	*/
+	class task_helpers final
+	{
+	public:
+		// The tasks of a run_tasks() call, which its thread and the helpers take in turn.
+		struct batch
+		{
+			const std::function<void(int)>* task = nullptr;
+			int num_tasks = 0;
+			std::atomic<int> next{ 0 };
+			// How many helpers are working on it. Guarded by the mutex of the helpers.
+			int num_helping = 0;
+			std::condition_variable helpers_done;
+
+			std::exception_ptr first_error;
+			std::mutex error_mtx;
+
+			void work() noexcept
+			{
+				int t;
+				while ((t = next.fetch_add(1, std::memory_order_relaxed)) < num_tasks)
+				{
+					try
+					{
+						(*task)(t);
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> lock(error_mtx);
+						if (nullptr == first_error)
+						{
+							first_error = std::current_exception();
+						}
+					}
+				}
+			}
+		};
+
+		static task_helpers& instance()
+		{
+			static task_helpers* helpers = new task_helpers();
+			return *helpers;
+		}
+
+		/*
+		* Works on b on the calling thread and on up to num_helpers helpers,
+		* and returns once nobody is working on it any more.
+		*/
+		void run(batch& b, int num_helpers)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				internal_grow(num_helpers);
+				for (int i = 0; i < std::min(num_helpers, static_cast<int>(threads.size())); ++i)
+				{
+					waiting.push_back(&b);
+				}
+			}
+			work_available.notify_all();
+
+			b.work();
+
+			std::unique_lock<std::mutex> lock(mtx);
+			// All the tasks are taken, so the helpers that haven't come yet are not needed.
+			std::erase(waiting, &b);
+			b.helpers_done.wait(lock, [&b]() { return 0 == b.num_helping; });
+		}
+
+	private:
+		task_helpers() = default;
+
+		// Called with mtx held.
+		void internal_grow(int num_helpers) noexcept
+		{
+			const int most = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+			while (static_cast<int>(threads.size()) < std::min(num_helpers, most))
+			{
+				try
+				{
+					threads.emplace_back(&task_helpers::internal_help, this);
+				}
+				catch (...)
+				{
+					// Could not start a thread. Those there and the calling one take all the tasks.
+					return;
+				}
+			}
+		}
+
+		void internal_help() noexcept
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			while (true)
+			{
+				work_available.wait(lock, [this]() { return !waiting.empty(); });
+				batch* b = waiting.front();
+				waiting.pop_front();
+				++b->num_helping;
+
+				lock.unlock();
+				b->work();
+				lock.lock();
+
+				// Notified under the lock, so that b lives until I'm done with it.
+				if (0 == --b->num_helping)
+				{
+					b->helpers_done.notify_all();
+				}
+			}
+		}
+
+	private:
+		std::mutex mtx;
+		std::condition_variable work_available;
+		// One entry for each helper a batch asks for.
+		std::deque<batch*> waiting;
+		std::vector<std::thread> threads;
+	};
+
+	/*
+	* Runs task(0), ..., task(num_tasks - 1) on up to num_threads threads, the calling one included.
+	* The other threads are the process-wide helpers (see task_helpers), so none is started per call.
+	* @throws what the first failing task throws, after all the threads have finished.
+	*/
+	template <typename F>
+	void run_tasks(int num_tasks, int num_threads, const F& task)
+	{
+		const std::function<void(int)> f(std::cref(task));
+		task_helpers::batch b;
+		b.task = &f;
+		b.num_tasks = num_tasks;
+
+		const int num_helpers = std::min(num_threads, num_tasks) - 1;
+		if (num_helpers > 0)
+		{
+			task_helpers::instance().run(b, num_helpers);
+		}
+		else
+		{
+			b.work();
+		}
+
+		if (nullptr != b.first_error)
+		{
+			std::rethrow_exception(b.first_error);
+		}
+	}
+
+	template <typename T>
+	struct plane_pair
+	{
+		plane_view<const T> ref;
+		plane_view<const T> dist;
+	};
+
+	template <AVPixelFormat Fmt, int Plane>
+	auto pair_planes(const frame& ref, const frame& dist)
+	{
+		using T = typename ff::pixel_format_traits<Fmt>::element_type;
+		return plane_pair<T>{ ff::view_plane<Fmt, Plane>(ref), ff::view_plane<Fmt, Plane>(dist) };
+	}
+
+	// A band of rows of a plane.
+	struct quality_task
+	{
+		int plane;
+		int begin;
+		int end;
+	};
+
+	/*
+	* Cuts rows [0, num_rows[p]) of each plane p into bands of band_rows.
+	*/
+	template <size_t N>
+	std::vector<quality_task> make_quality_tasks(const std::array<int, N>& num_rows, int band_rows)
+	{
+		std::vector<quality_task> res;
+		for (int p = 0; p < static_cast<int>(N); ++p)
+		{
+			for (int i = 0; i < num_rows[p]; i += band_rows)
+			{
+				res.push_back(quality_task{ p, i, std::min(i + band_rows, num_rows[p]) });
+			}
+		}
+		return res;
+	}
+
+	double psnr_of(uint64_t sse, uint64_t num_samples, int max_value)
+	{
+		if (0 == sse)
+		{
+			return std::numeric_limits<double>::infinity();
+		}
+		const double peak = static_cast<double>(max_value) * max_value;
+		return 10.0 * std::log10(peak * static_cast<double>(num_samples) / static_cast<double>(sse));
+	}
+
+	struct psnr_metric
+	{
+		template <typename T, size_t N>
+		quality_score operator()(const std::array<plane_pair<T>, N>& planes, int max_value, int num_threads) const
+		{
+			std::array<int, N> num_rows;
+			for (size_t p = 0; p < N; ++p)
+			{
+				num_rows[p] = planes[p].ref.height();
+			}
+			const auto tasks = make_quality_tasks(num_rows, quality_band_rows);
+
+			const row_kernels& k = kernels();
+			std::vector<uint64_t> sse(tasks.size());
+			run_tasks
+			(
+				static_cast<int>(tasks.size()), num_threads,
+				[&](int t)
+				{
+					const quality_task& task = tasks[t];
+					const plane_pair<T>& pp = planes[task.plane];
+					uint64_t res = 0;
+					for (int i = task.begin; i < task.end; ++i)
+					{
+						if constexpr (1 == sizeof(T))
+						{
+							res += k.sse8(pp.ref.row(i), pp.dist.row(i), pp.ref.width());
+						}
+						else
+						{
+							res += k.sse16(pp.ref.row(i), pp.dist.row(i), pp.ref.width());
+						}
+					}
+					sse[t] = res;
+				}
+			);
+
+			std::array<uint64_t, N> plane_sse{};
+			for (size_t t = 0; t < tasks.size(); ++t)
+			{
+				plane_sse[tasks[t].plane] += sse[t];
+			}
+
+			quality_score res;
+			res.num_planes = static_cast<int>(N);
+			uint64_t total_sse = 0, total_samples = 0;
+			for (size_t p = 0; p < N; ++p)
+			{
+				const uint64_t num_samples = static_cast<uint64_t>(planes[p].ref.width()) * planes[p].ref.height();
+				res.planes[p] = psnr_of(plane_sse[p], num_samples, max_value);
+				total_sse += plane_sse[p];
+				total_samples += num_samples;
+			}
+			res.combined = psnr_of(total_sse, total_samples, max_value);
+			return res;
+		}
+	};
+
+	/*
+	* The SSIM of an 8x8 window from the sums of its a, b, a^2 + b^2, and a * b.
+	* c1 and c2 are the constants of the SSIM paper, scaled as libavfilter's vf_ssim scales them.
+	*/
+	double ssim_of_window(const std::array<uint32_t, 4>& s, double c1, double c2)
+	{
+		const double s1 = s[0], s2 = s[1], ss = s[2], s12 = s[3];
+		const double vars = ss * 64 - s1 * s1 - s2 * s2;
+		const double covar = s12 * 64 - s1 * s2;
+		return (2 * s1 * s2 + c1) * (2 * covar + c2) / ((s1 * s1 + s2 * s2 + c1) * (vars + c2));
+	}
+
+	struct ssim_metric
+	{
+		template <typename T, size_t N>
+		quality_score operator()(const std::array<plane_pair<T>, N>& planes, int max_value, int num_threads) const
+		{
+			// The windows are 2x2 blocks of 4x4 pixels and step by a block, as in libavfilter's vf_ssim.
+			std::array<int, N> num_window_rows;
+			for (size_t p = 0; p < N; ++p)
+			{
+				if (planes[p].ref.width() < 8 || planes[p].ref.height() < 8)
+				{
+					throw std::invalid_argument("Every plane must be at least 8x8 to measure SSIM.");
+				}
+				num_window_rows[p] = planes[p].ref.height() / 4 - 1;
+			}
+			const auto tasks = make_quality_tasks(num_window_rows, quality_band_rows / 4);
+
+			// Those of vf_ssim, which rounds them to integers for 8 bit samples.
+			double c1 = 0.01 * 0.01 * max_value * max_value * 64;
+			double c2 = 0.03 * 0.03 * max_value * max_value * 64 * 63;
+			if constexpr (1 == sizeof(T))
+			{
+				c1 = std::floor(c1 + 0.5);
+				c2 = std::floor(c2 + 0.5);
+			}
+			const row_kernels& k = kernels();
+			std::vector<double> sums(tasks.size());
+			run_tasks
+			(
+				static_cast<int>(tasks.size()), num_threads,
+				[&](int t)
+				{
+					const quality_task& task = tasks[t];
+					const plane_pair<T>& pp = planes[task.plane];
+					const int num_blocks = pp.ref.width() / 4;
+					const int n = 4 * num_blocks;
+
+					// The sums of each column, then of each block, over 4 rows.
+					std::vector<uint32_t> columns(4 * static_cast<size_t>(n));
+					std::vector<std::array<uint32_t, 4>> above(num_blocks), below(num_blocks);
+					auto sum_block_row = [&](int block_row, std::vector<std::array<uint32_t, 4>>& out)
+					{
+						std::fill(columns.begin(), columns.end(), 0u);
+						for (int i = 4 * block_row; i < 4 * block_row + 4; ++i)
+						{
+							if constexpr (1 == sizeof(T))
+							{
+								k.ssim_sums(columns.data(), pp.ref.row(i), pp.dist.row(i), n);
+							}
+							else
+							{
+								// Only the 8 bit sums are vectorized.
+								ssim_sums_row_scalar(columns.data(), pp.ref.row(i), pp.dist.row(i), n);
+							}
+						}
+						for (int j = 0; j < num_blocks; ++j)
+						{
+							for (int q = 0; q < 4; ++q)
+							{
+								const uint32_t* c = columns.data() + q * n + 4 * j;
+								out[j][q] = c[0] + c[1] + c[2] + c[3];
+							}
+						}
+					};
+
+					double res = 0.0;
+					sum_block_row(task.begin, above);
+					for (int r = task.begin; r < task.end; ++r)
+					{
+						sum_block_row(r + 1, below);
+						for (int j = 0; j + 1 < num_blocks; ++j)
+						{
+							std::array<uint32_t, 4> window;
+							for (int q = 0; q < 4; ++q)
+							{
+								window[q] = above[j][q] + above[j + 1][q] + below[j][q] + below[j + 1][q];
+							}
+							res += ssim_of_window(window, c1, c2);
+						}
+						std::swap(above, below);
+					}
+					sums[t] = res;
+				}
+			);
+
+			std::array<double, N> plane_sums{};
+			for (size_t t = 0; t < tasks.size(); ++t)
+			{
+				plane_sums[tasks[t].plane] += sums[t];
+			}
+
+			quality_score res;
+			res.num_planes = static_cast<int>(N);
+			double total = 0.0, total_windows = 0.0;
+			for (size_t p = 0; p < N; ++p)
+			{
+				const double num_windows =
+					static_cast<double>(num_window_rows[p]) * (planes[p].ref.width() / 4 - 1);
+				res.planes[p] = plane_sums[p] / num_windows;
+				total += plane_sums[p];
+				total_windows += num_windows;
+			}
+			res.combined = total / total_windows;
+			return res;
+		}
+	};
+
+	/*
+	* Checks ref and dist, views their planes, and measures them by m.
+	*/
+	template <typename Metric>
+	quality_score measure_quality(const frame& ref, const frame& dist, int num_threads, const Metric& m)
+	{
+		const int fmt = video_format(ref);
+		video_format(dist);
+		if (ref.get_data_properties() != dist.get_data_properties())
+		{
+			throw std::invalid_argument("The data properties of the frames differ.");
+		}
+		if (num_threads < 1)
+		{
+			throw std::invalid_argument("At least one thread is needed.");
+		}
+
+		switch (fmt)
+		{
+		case AV_PIX_FMT_YUV420P:
+			return m
+			(
+				std::array
+				{
+					pair_planes<AV_PIX_FMT_YUV420P, 0>(ref, dist),
+					pair_planes<AV_PIX_FMT_YUV420P, 1>(ref, dist),
+					pair_planes<AV_PIX_FMT_YUV420P, 2>(ref, dist)
+				},
+				255, num_threads
+			);
+		case AV_PIX_FMT_YUVA420P:
+			return m
+			(
+				std::array
+				{
+					pair_planes<AV_PIX_FMT_YUVA420P, 0>(ref, dist),
+					pair_planes<AV_PIX_FMT_YUVA420P, 1>(ref, dist),
+					pair_planes<AV_PIX_FMT_YUVA420P, 2>(ref, dist),
+					pair_planes<AV_PIX_FMT_YUVA420P, 3>(ref, dist)
+				},
+				255, num_threads
+			);
+		case AV_PIX_FMT_YUV420P10LE:
+			return m
+			(
+				std::array
+				{
+					pair_planes<AV_PIX_FMT_YUV420P10LE, 0>(ref, dist),
+					pair_planes<AV_PIX_FMT_YUV420P10LE, 1>(ref, dist),
+					pair_planes<AV_PIX_FMT_YUV420P10LE, 2>(ref, dist)
+				},
+				1023, num_threads
+			);
+		default:
+			throw std::domain_error("Quality can only be measured on yuv420p, yuva420p, or yuv420p10le.");
+		}
+	}
+}
+
+ff::frame_ops::simd_level ff::frame_ops::supported_simd_level() noexcept
+{
+	static const simd_level level = detect_simd_level();
+	return level;
+}
+
+ff::frame_ops::simd_level ff::frame_ops::active_simd_level() noexcept
+{
+	return current_level().load(std::memory_order_relaxed);
+}
+
+void ff::frame_ops::set_simd_level(simd_level level)
+{
+	const simd_level supported = supported_simd_level();
+	const bool ok =
+		simd_level::scalar == level || supported == level ||
+		(simd_level::sse4 == level && simd_level::avx2 == supported);
+	if (!ok)
+	{
+		throw std::invalid_argument("The SIMD level is not supported.");
+	}
+
+	current_level().store(level, std::memory_order_relaxed);
+}
+
+void ff::frame_ops::copy_plane(plane_view<const uint8_t> src, plane_view<uint8_t> dst)
+{
+	copy_rows(src, dst);
+}
+
+void ff::frame_ops::copy_plane(plane_view<const uint16_t> src, plane_view<uint16_t> dst)
+{
+	copy_rows(src, dst);
+}
+
+void ff::frame_ops::fill_plane(plane_view<uint8_t> dst, uint8_t v)
+{
+	fill_rows(dst, v);
+}
+
+void ff::frame_ops::fill_plane(plane_view<uint16_t> dst, uint16_t v)
+{
+	fill_rows(dst, v);
+}
+
+ff::frame ff::frame_ops::pad(const frame& src, int left, int top, int right, int bottom, std::array<uint8_t, 3> yuv)
+{
+	if (AV_PIX_FMT_YUV420P != video_format(src))
+	{
+		throw std::domain_error("Only yuv420p frames can be padded.");
+	}
+	if (left < 0 || top < 0 || right < 0 || bottom < 0)
+	{
+		throw std::invalid_argument("The borders cannot be negative.");
+	}
+	if ((left | top | right | bottom) & 1)
+	{
+		throw std::invalid_argument("The borders must be even.");
+	}
+
+	auto dp = src.get_data_properties();
+	frame dst = new_frame_like(src, AV_PIX_FMT_YUV420P, left + dp.width + right, top + dp.height + bottom);
+
+	pad_rows(view_plane<AV_PIX_FMT_YUV420P, 0>(src), view_plane<AV_PIX_FMT_YUV420P, 0>(dst), left, top, yuv[0]);
+	pad_rows(view_plane<AV_PIX_FMT_YUV420P, 1>(src), view_plane<AV_PIX_FMT_YUV420P, 1>(dst), left / 2, top / 2, yuv[1]);
+	pad_rows(view_plane<AV_PIX_FMT_YUV420P, 2>(src), view_plane<AV_PIX_FMT_YUV420P, 2>(dst), left / 2, top / 2, yuv[2]);
+
+	return dst;
+}
+
+void ff::frame_ops::overlay(frame& dst, const frame& watermark, int x, int y)
+{
+	if (AV_PIX_FMT_YUV420P != video_format(dst))
+	{
+		throw std::domain_error("Can only overlay onto yuv420p frames.");
+	}
+	if (AV_PIX_FMT_YUVA420P != video_format(watermark))
+	{
+		throw std::domain_error("The watermark must be yuva420p.");
+	}
+	if ((x | y) & 1)
+	{
+		throw std::invalid_argument("x and y must be even.");
+	}
+	auto ddp = dst.get_data_properties();
+	auto wdp = watermark.get_data_properties();
+	if (x < 0 || y < 0 || x + wdp.width > ddp.width || y + wdp.height > ddp.height)
+	{
+		throw std::out_of_range("The watermark is not inside the frame.");
+	}
+
+	dst.make_writable();
+	const row_kernels& k = kernels();
+
+	auto wm_a = view_plane<AV_PIX_FMT_YUVA420P, 3>(watermark);
+	{
+		auto wm_y = view_plane<AV_PIX_FMT_YUVA420P, 0>(watermark);
+		auto dst_y = view_plane<AV_PIX_FMT_YUV420P, 0>(dst);
+		for (int i = 0; i < wm_y.height(); ++i)
+		{
+			k.blend(dst_y.row(y + i) + x, wm_y.row(i), wm_a.row(i), wm_y.width());
+		}
+	}
+
+	auto wm_u = view_plane<AV_PIX_FMT_YUVA420P, 1>(watermark);
+	auto wm_v = view_plane<AV_PIX_FMT_YUVA420P, 2>(watermark);
+	auto dst_u = view_plane<AV_PIX_FMT_YUV420P, 1>(dst);
+	auto dst_v = view_plane<AV_PIX_FMT_YUV420P, 2>(dst);
+	std::vector<uint8_t> chroma_alpha(wm_u.width());
+	for (int i = 0; i < wm_u.height(); ++i)
+	{
+		// The last row and column of an odd sized watermark pair with themselves.
+		const uint8_t* a0 = wm_a.row(2 * i);
+		const uint8_t* a1 = wm_a.row(std::min(2 * i + 1, wm_a.height() - 1));
+		for (int j = 0; j < wm_u.width(); ++j)
+		{
+			const int j1 = std::min(2 * j + 1, wm_a.width() - 1);
+			chroma_alpha[j] = static_cast<uint8_t>((a0[2 * j] + a0[j1] + a1[2 * j] + a1[j1] + 2) >> 2);
+		}
+
+		k.blend(dst_u.row(y / 2 + i) + x / 2, wm_u.row(i), chroma_alpha.data(), wm_u.width());
+		k.blend(dst_v.row(y / 2 + i) + x / 2, wm_v.row(i), chroma_alpha.data(), wm_v.width());
+	}
+}
+
+ff::frame ff::frame_ops::convert_depth(const frame& src, AVPixelFormat fmt)
+{
+	const int src_fmt = video_format(src);
+	auto dp = src.get_data_properties();
+	const row_kernels& k = kernels();
+
+	if (AV_PIX_FMT_YUV420P == src_fmt && AV_PIX_FMT_YUV420P10LE == fmt)
+	{
+		frame dst = new_frame_like(src, fmt, dp.width, dp.height);
+		convert_rows<AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P10LE, 0>(src, dst, k.widen);
+		convert_rows<AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P10LE, 1>(src, dst, k.widen);
+		convert_rows<AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P10LE, 2>(src, dst, k.widen);
+		return dst;
+	}
+	if (AV_PIX_FMT_YUV420P10LE == src_fmt && AV_PIX_FMT_YUV420P == fmt)
+	{
+		frame dst = new_frame_like(src, fmt, dp.width, dp.height);
+		convert_rows<AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P, 0>(src, dst, k.narrow);
+		convert_rows<AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P, 1>(src, dst, k.narrow);
+		convert_rows<AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P, 2>(src, dst, k.narrow);
+		return dst;
+	}
+
+	throw std::domain_error("Only yuv420p <-> yuv420p10le is supported.");
+}
+
+uint64_t ff::frame_ops::sad(plane_view<const uint8_t> a, plane_view<const uint8_t> b)
+{
+	if (a.width() != b.width() || a.height() != b.height())
+	{
+		throw std::invalid_argument("The sizes of the planes differ.");
+	}
+
+	const row_kernels& k = kernels();
+	uint64_t res = 0;
+	for (int i = 0; i < a.height(); ++i)
+	{
+		res += k.sad(a.row(i), b.row(i), a.width());
+	}
+	return res;
+}
+
+std::array<uint64_t, 256> ff::frame_ops::luma_histogram(const frame& src)
+{
+	plane_view<const uint8_t> luma;
+	switch (video_format(src))
+	{
+	case AV_PIX_FMT_YUV420P:
+		luma = view_plane<AV_PIX_FMT_YUV420P, 0>(src);
+		break;
+	case AV_PIX_FMT_YUVA420P:
+		luma = view_plane<AV_PIX_FMT_YUVA420P, 0>(src);
+		break;
+	case AV_PIX_FMT_NV12:
+		luma = view_plane<AV_PIX_FMT_NV12, 0>(src);
+		break;
+	default:
+		throw std::domain_error("The format has no 8 bit luma plane.");
+	}
+
+	// Histograms don't vectorize (the increments scatter),
+	// but counting into 4 tables breaks the dependency between neighbors of the same value.
+	std::vector<std::array<uint64_t, 256>> counts(4);
+	for (int i = 0; i < luma.height(); ++i)
+	{
+		const uint8_t* row = luma.row(i);
+		int j = 0;
+		for (; j + 4 <= luma.width(); j += 4)
+		{
+			++counts[0][row[j]];
+			++counts[1][row[j + 1]];
+			++counts[2][row[j + 2]];
+			++counts[3][row[j + 3]];
+		}
+		for (; j < luma.width(); ++j)
+		{
+			++counts[0][row[j]];
+		}
+	}
+
+	std::array<uint64_t, 256> res{};
+	for (const auto& c : counts)
+	{
+		for (size_t v = 0; v < res.size(); ++v)
+		{
+			res[v] += c[v];
+		}
+	}
+	return res;
+}
+
+ff::frame_ops::quality_score ff::frame_ops::psnr(const frame& ref, const frame& dist, int num_threads)
+{
+	return measure_quality(ref, dist, num_threads, psnr_metric());
+}
+
+ff::frame_ops::quality_score ff::frame_ops::ssim(const frame& ref, const frame& dist, int num_threads)
+{
+	return measure_quality(ref, dist, num_threads, ssim_metric());
+}
@@ -0,0 +1,191 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* frame_ops.h:
+* Pixel kernels that we keep needing on decoded frames:
+* padding, watermark overlay, plane copying, bit depth conversion, luma histograms,
+* differences between planes, and quality metrics (PSNR and SSIM) between two frames.
+* 
+* The row loops have SSE4.1, AVX2 and NEON versions, and which ones run is decided
+* at run time from what the CPU supports (through av_get_cpu_flags()).
+*/
+
+#include "../util/util.h"
+#include "frame.h"
+#include "plane_view.h"
+
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+
+#include <array>
+#include <cstdint>
+
+namespace ff::frame_ops
+{
+	/*
+	* Which instruction set the kernels use.
+	*/
+	enum class simd_level
+	{
+		scalar,
+		sse4,
+		avx2,
+		neon
+	};
+
+	/*
+	* @returns the best level that both the CPU and this build support.
+	*/
+	FF_WRAPPER_API simd_level supported_simd_level() noexcept;
+
+	/*
+	* @returns the level the kernels use now. It's supported_simd_level() unless set_simd_level() has been called.
+	*/
+	FF_WRAPPER_API simd_level active_simd_level() noexcept;
+
+	/*
+	* Makes the kernels use level, e.g. scalar to compare against the vectorized ones.
+	* It affects all threads, and calls that are running may not see it.
+	* 
+	* @throws std::invalid_argument if the CPU or this build doesn't support level.
+	* scalar is always supported, and sse4 is if avx2 is.
+	*/
+	FF_WRAPPER_API void set_simd_level(simd_level level);
+
+	/*
+	* Copies src to dst row by row.
+	* 
+	* @throws std::invalid_argument if the sizes of the two differ.
+	*/
+	FF_WRAPPER_API void copy_plane(plane_view<const uint8_t> src, plane_view<uint8_t> dst);
+	FF_WRAPPER_API void copy_plane(plane_view<const uint16_t> src, plane_view<uint16_t> dst);
+
+	/*
+	* Sets every element of dst to v.
+	*/
+	FF_WRAPPER_API void fill_plane(plane_view<uint8_t> dst, uint8_t v);
+	FF_WRAPPER_API void fill_plane(plane_view<uint16_t> dst, uint16_t v);
+
+	/*
+	* Pads a yuv420p frame with borders of a color.
+	* The properties other than the size (e.g. time) are copied from src.
+	* 
+	* @param left, top, right, bottom the widths of the borders. Must be even, as the chroma is halved.
+	* @param yuv the color of the borders. Black by default.
+	* @returns a new frame of size (left + width + right) x (top + height + bottom).
+	* @throws std::logic_error if src is not a ready video frame, or if it is a hardware frame.
+	* @throws std::domain_error if src is not yuv420p.
+	* @throws std::invalid_argument if any border is negative or odd.
+	*/
+	FF_WRAPPER_API frame pad
+	(
+		const frame& src, int left, int top, int right, int bottom,
+		std::array<uint8_t, 3> yuv = { 16, 128, 128 }
+	);
+
+	/*
+	* Alpha blends a yuva420p watermark onto a yuv420p frame in place.
+	* The alpha of the chroma is the average of the 2x2 luma alphas it covers.
+	* 
+	* dst is made writable first (see frame::make_writable()), so frames it shared data with are untouched.
+	* 
+	* @param x, y where the top-left of watermark goes. Must be even.
+	* @throws std::logic_error if either is not a ready video frame, or if either is a hardware frame.
+	* @throws std::domain_error if dst is not yuv420p, or if watermark is not yuva420p.
+	* @throws std::invalid_argument if x or y is odd.
+	* @throws std::out_of_range if the watermark doesn't lie inside dst at (x, y).
+	*/
+	FF_WRAPPER_API void overlay(frame& dst, const frame& watermark, int x, int y);
+
+	/*
+	* Converts between yuv420p and yuv420p10le.
+	* 8 to 10 bits shifts left by 2. 10 to 8 bits rounds to nearest and saturates.
+	* The properties (e.g. time) are copied from src.
+	* 
+	* @param fmt the format to convert to.
+	* @returns a new frame of fmt.
+	* @throws std::logic_error if src is not a ready video frame, or if it is a hardware frame.
+	* @throws std::domain_error if it's not one of the two conversions.
+	*/
+	FF_WRAPPER_API frame convert_depth(const frame& src, AVPixelFormat fmt);
+
+	/*
+	* @returns the sum of absolute differences between a and b.
+	* @throws std::invalid_argument if the sizes of the two differ.
+	*/
+	FF_WRAPPER_API uint64_t sad(plane_view<const uint8_t> a, plane_view<const uint8_t> b);
+
+	/*
+	* @returns how many luma samples of each value src has.
+	* @throws std::logic_error if src is not a ready video frame, or if it is a hardware frame.
+	* @throws std::domain_error if src is not yuv420p, yuva420p, or nv12.
+	*/
+	FF_WRAPPER_API std::array<uint64_t, 256> luma_histogram(const frame& src);
+
+	/*
+	* How alike two frames are by a metric, plane by plane (see psnr() and ssim()).
+	*/
+	struct quality_score
+	{
+		// The score of each plane. Only the first num_planes are used.
+		std::array<double, 4> planes{};
+		int num_planes = 0;
+		// The score of all the planes together.
+		double combined = 0.0;
+	};
+
+	/*
+	* Measures the peak signal-to-noise ratio of dist against ref, in dB.
+	* A plane that is the same in both scores infinity.
+	* combined is from the mean squared error over the samples of all the planes, so larger planes count more.
+	* 
+	* The planes are cut into bands of rows, which are measured in parallel.
+	* The results don't depend on num_threads or on the SIMD level.
+	* 
+	* @param ref the reference, e.g. the source frame.
+	* @param dist the distorted one, e.g. the frame decoded from the encoded one.
+	* @param num_threads up to how many threads to use, the calling one included. See psnr().
+	* The others are kept for the whole process and shared by all calls, so none is started per call.
+	* @throws std::logic_error if either is not a ready video frame, or if either is a hardware frame.
+	* @throws std::invalid_argument if their data properties differ, or if num_threads < 1.
+	* @throws std::domain_error if they are not yuv420p, yuva420p, or yuv420p10le.
+	*/
+	FF_WRAPPER_API quality_score psnr(const frame& ref, const frame& dist, int num_threads = 1);
+
+	/*
+	* Measures the structural similarity of dist to ref, which is 1 if they are the same.
+	* As in FFmpeg's ssim filter, the score of a plane is the mean over 8x8 windows that step by 4 pixels,
+	* and the pixels right of or below the last whole 4x4 block are not looked at.
+	* The constants are the filter's too, so the planes score as it scores them, up to its float rounding.
+	* combined is the mean over the windows of all the planes.
+	* 
+	* The planes are cut into bands of rows, which are measured in parallel.
+	* The results don't depend on num_threads or on the SIMD level.
+	* 
+	* @param ref the reference, e.g. the source frame.
+	* @param dist the distorted one, e.g. the frame decoded from the encoded one.
+	* @param num_threads up to how many threads to use, the calling one included.
+	* @throws std::logic_error if either is not a ready video frame, or if either is a hardware frame.
+	* @throws std::invalid_argument if their data properties differ, if num_threads < 1,
+	* or if any plane is smaller than 8x8.
+	* @throws std::domain_error if they are not yuv420p, yuva420p, or yuv420p10le.
+	*/
+	FF_WRAPPER_API quality_score ssim(const frame& ref, const frame& dist, int num_threads = 1);
+}
@@ -0,0 +1,272 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "frame_pool.h"
+#include "../util/ff_helpers.h"
+
+extern "C"
+{
+#include <libavutil/buffer.h>
+#include <libavutil/cpu.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include <stdexcept>
+
+namespace
+{
+	/*
+	* @returns a copy of dp that doesn't weakly ref dp's channel layout.
+	*/
+	ff::frame::data_properties copy_properties(const ff::frame::data_properties& dp)
+	{
+		if (dp.v_or_a)
+		{
+			return ff::frame::data_properties(dp.fmt, dp.width, dp.height, dp.align);
+		}
+		else
+		{
+			// This one copies the channel layout.
+			return ff::frame::data_properties(dp.fmt, dp.num_samples, dp.ch_layout, dp.align);
+		}
+	}
+}
+
+ff::frame_pool::frame_pool(const frame::data_properties& dp)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	internal_find_pools(dp);
+}
+
+ff::frame ff::frame_pool::get_frame(const frame::data_properties& dp)
+{
+	frame f(true);
+	get_frame(f, dp);
+	return f;
+}
+
+void ff::frame_pool::get_frame(frame& f, const frame::data_properties& dp)
+{
+	// Handle f so that it's always created before I give it the buffers.
+	switch (f.get_object_state())
+	{
+	case ff_object::DESTROYED:
+		f.allocate_object_memory();
+		break;
+	case ff_object::OBJECT_CREATED:
+		// Do nothing.
+		break;
+	case ff_object::READY:
+		// Release its previous data.
+		f.release_resources_memory();
+		break;
+	}
+
+	std::lock_guard<std::mutex> lock(mtx);
+	const plane_pools& pp = internal_find_pools(dp);
+	AVFrame* p_frame = f.av_frame();
+
+	for (int i = 0; i < pp.num_planes; ++i)
+	{
+		p_frame->buf[i] = av_buffer_pool_get(pp.pools[i]);
+		if (nullptr == p_frame->buf[i])
+		{
+			// Leave f created.
+			for (int j = 0; j < i; ++j)
+			{
+				av_buffer_unref(&p_frame->buf[j]);
+			}
+			throw std::bad_alloc();
+		}
+
+		p_frame->data[i] = p_frame->buf[i]->data;
+	}
+
+	p_frame->format = dp.fmt;
+	if (dp.v_or_a) // Video
+	{
+		p_frame->width = dp.width;
+		p_frame->height = dp.height;
+		for (int i = 0; i < pp.num_planes; ++i)
+		{
+			p_frame->linesize[i] = pp.line_sizes[i];
+		}
+	}
+	else // Audio
+	{
+		p_frame->nb_samples = dp.num_samples;
+		channel_layout::av_channel_layout_copy(p_frame->ch_layout, pp.properties.ch_layout.av_ch_layout());
+		// Each plane has the same size, and only linesize[0] is used.
+		p_frame->linesize[0] = pp.line_sizes[0];
+	}
+	// I never have more planes than AV_NUM_DATA_POINTERS.
+	p_frame->extended_data = p_frame->data;
+
+	// Don't forget to make f ready
+	// and set its internal fields.
+	f.video_or_audio = dp.v_or_a;
+	f.state = ff_object::READY;
+	f.internal_find_num_planes();
+}
+
+size_t ff::frame_pool::number_properties() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return pools.size();
+}
+
+void ff::frame_pool::clear() noexcept
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	pools.clear();
+}
+
+ff::frame_pool::plane_pools& ff::frame_pool::internal_find_pools(const frame::data_properties& dp)
+{
+	for (auto& p : pools)
+	{
+		if (p->matches(dp))
+		{
+			return *p;
+		}
+	}
+
+	pools.push_back(std::make_unique<plane_pools>(dp));
+	return *pools.back();
+}
+
+ff::frame_pool::plane_pools::plane_pools(const frame::data_properties& dp)
+	: properties(copy_properties(dp))
+{
+	// The same default as av_frame_get_buffer()'s.
+	const int align = dp.align > 0 ? dp.align : static_cast<int>(av_cpu_max_align());
+	size_t sizes[AV_NUM_DATA_POINTERS] = {};
+
+	if (dp.v_or_a) // Video
+	{
+		if (dp.width <= 0 || dp.height <= 0)
+		{
+			throw std::invalid_argument("The width and height must be > 0.");
+		}
+
+		auto fmt = static_cast<AVPixelFormat>(dp.fmt);
+		const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(fmt);
+		if (nullptr == desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+		{
+			throw std::invalid_argument("The pixel format is invalid or is for hardware frames.");
+		}
+
+		// Pad the width until every line size is aligned, like av_frame_get_buffer() does.
+		for (int w_align = 1; w_align <= align; w_align += w_align)
+		{
+			int ret = av_image_fill_linesizes(line_sizes, fmt, FFALIGN(dp.width, w_align));
+			if (ret < 0)
+			{
+				throw std::invalid_argument("Could not find the line sizes of the properties.");
+			}
+
+			bool all_aligned = true;
+			for (int i = 0; i < 4; ++i)
+			{
+				if (0 != line_sizes[i] % align)
+				{
+					all_aligned = false;
+					break;
+				}
+			}
+			if (all_aligned)
+			{
+				break;
+			}
+		}
+
+		ptrdiff_t ptr_line_sizes[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			ptr_line_sizes[i] = line_sizes[i];
+		}
+		int ret = av_image_fill_plane_sizes(sizes, fmt, dp.height, ptr_line_sizes);
+		if (ret < 0)
+		{
+			throw std::invalid_argument("Could not find the plane sizes of the properties.");
+		}
+
+		while (num_planes < 4 && 0 != sizes[num_planes])
+		{
+			// The same padding as av_frame_get_buffer()'s, 
+			// since some SIMD code reads a little beyond the planes.
+			sizes[num_planes] += 16 + align - 1;
+			++num_planes;
+		}
+	}
+	else // Audio
+	{
+		auto fmt = static_cast<AVSampleFormat>(dp.fmt);
+		const int num_channels = dp.ch_layout.av_ch_layout().nb_channels;
+		if (dp.num_samples <= 0 || num_channels <= 0 || av_get_bytes_per_sample(fmt) <= 0)
+		{
+			throw std::invalid_argument("The properties are invalid.");
+		}
+
+		const int planes = av_sample_fmt_is_planar(fmt) ? num_channels : 1;
+		if (planes > AV_NUM_DATA_POINTERS)
+		{
+			throw std::invalid_argument("Too many channels. Only up to AV_NUM_DATA_POINTERS planes can be pooled.");
+		}
+
+		int ret = av_samples_get_buffer_size(&line_sizes[0], num_channels, dp.num_samples, fmt, align);
+		if (ret < 0)
+		{
+			throw std::invalid_argument("Could not find the size of the samples.");
+		}
+
+		num_planes = planes;
+		for (int i = 0; i < num_planes; ++i)
+		{
+			sizes[i] = static_cast<size_t>(line_sizes[0]);
+		}
+	}
+
+	for (int i = 0; i < num_planes; ++i)
+	{
+		pools[i] = av_buffer_pool_init(sizes[i], nullptr);
+		if (nullptr == pools[i])
+		{
+			// The destructor won't be called.
+			for (int j = 0; j < i; ++j)
+			{
+				av_buffer_pool_uninit(&pools[j]);
+			}
+			throw std::bad_alloc();
+		}
+	}
+}
+
+ff::frame_pool::plane_pools::~plane_pools() noexcept
+{
+	// The memory is freed after all the buffers return.
+	for (int i = 0; i < num_planes; ++i)
+	{
+		av_buffer_pool_uninit(&pools[i]);
+	}
+}
+
+bool ff::frame_pool::plane_pools::matches(const frame::data_properties& dp) const noexcept
+{
+	return properties == dp && properties.align == dp.align;
+}
@@ -0,0 +1,150 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "frame.h"
+
+extern "C"
+{
+#include <libavutil/frame.h> // For AV_NUM_DATA_POINTERS
+}
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct AVBufferPool;
+
+namespace ff
+{
+	/*
+	* A pool of frame data buffers, so that frames of the same data_properties
+	* can reuse the buffers of previous frames, instead of allocating new ones every time
+	* like frame::allocate_data() does.
+	* 
+	* Internally, for each data_properties (including align) I have seen, 
+	* I keep one AVBufferPool per data plane.
+	* A buffer returns to its pool when the last frame referencing it releases it,
+	* so in a steady state (e.g. a transcoding loop), no memory is allocated or freed per frame.
+	* 
+	* The frames you get are ordinary ready frames. They may outlive the pool: 
+	* the memory of a plane's pool is freed after both the pool and all the frames using it are gone.
+	* 
+	* All the methods can be called from multiple threads at the same time.
+	* 
+	* Invariants:
+	*	Each entry of pools has a different set of properties.
+	*/
+	class FF_WRAPPER_API frame_pool final
+	{
+	public:
+		/*
+		* Creates an empty pool. Buffers are pooled for new properties as you get frames of them.
+		*/
+		frame_pool() = default;
+
+		/*
+		* Creates a pool and prepares the buffer pools for frames of dp,
+		* so that invalid properties are found early.
+		* 
+		* @throws std::invalid_argument if dp is invalid.
+		*/
+		explicit frame_pool(const frame::data_properties& dp);
+
+		// Frames hold references to the buffer pools, not to this.
+		// Still, there is no point in copying one.
+		frame_pool(const frame_pool&) = delete;
+		frame_pool& operator=(const frame_pool&) = delete;
+
+		/*
+		* Releases all the pools. Frames still using the buffers are not affected.
+		*/
+		~frame_pool() noexcept = default;
+
+	public:
+		/*
+		* Gets a frame whose data of dp is allocated from a pool.
+		* Like frame::allocate_data(), the content of the data is undefined.
+		* 
+		* @returns a ready frame, with v_or_a and the properties in dp set, whose data is
+		* writable (frame::is_writable()).
+		* @throws std::invalid_argument if dp is invalid.
+		*/
+		frame get_frame(const frame::data_properties& dp);
+
+		/*
+		* Lets f hold data of dp allocated from a pool.
+		* This version allows you to reuse a frame for a whole loop.
+		* 
+		* @param f If f is destroyed, then it will be created first.
+		*	If f is ready, then its previous data will be released first.
+		*	Afterwards, f will be ready with the new data. Its other properties are kept.
+		* @throws std::invalid_argument if dp is invalid.
+		*/
+		void get_frame(frame& f, const frame::data_properties& dp);
+
+		/*
+		* @returns the number of different data_properties I have pools for.
+		*/
+		size_t number_properties() const;
+
+		/*
+		* Releases all the pools. Frames still using the buffers are not affected.
+		* Useful when the properties of the frames change for good (e.g. the stream is resized).
+		*/
+		void clear() noexcept;
+
+	private:
+		/*
+		* The buffer pools for one set of data_properties.
+		*/
+		struct plane_pools
+		{
+			/*
+			* Finds the layout of the data planes and creates a pool for each of them.
+			* 
+			* @throws std::invalid_argument if dp is invalid.
+			*/
+			explicit plane_pools(const frame::data_properties& dp);
+
+			plane_pools(const plane_pools&) = delete;
+			plane_pools& operator=(const plane_pools&) = delete;
+
+			~plane_pools() noexcept;
+
+			// @returns true iff dp is the same as mine, including align.
+			bool matches(const frame::data_properties& dp) const noexcept;
+
+			// A copy of the data_properties. The channel layout is not a weak ref.
+			frame::data_properties properties;
+
+			int num_planes = 0;
+			int line_sizes[AV_NUM_DATA_POINTERS] = {};
+			::AVBufferPool* pools[AV_NUM_DATA_POINTERS] = {};
+		};
+
+		/*
+		* Finds the pools for dp, or creates them if there is none yet.
+		* Must be called with mtx locked.
+		*/
+		plane_pools& internal_find_pools(const frame::data_properties& dp);
+
+	private:
+		mutable std::mutex mtx;
+		std::vector<std::unique_ptr<plane_pools>> pools;
+	};
+}
@@ -123,6 +123,16 @@ void ff::packet::internal_release_resources_memory() noexcept
 	av_packet_unref(p_packet);
 }
 
+size_t ff::packet::memory_size() const noexcept
+{
+	if (!ready())
+	{
+		return 0;
+	}
+
+	return nullptr != p_packet->buf ? p_packet->buf->size : static_cast<size_t>(p_packet->size);
+}
+
 int ff::packet::data_size() const
 {
 	if (!ready())
@@ -249,33 +259,28 @@ void ff::packet::change_time_base(ff::rational new_tb)
 		throw std::logic_error("Current time base is not valid.");
 	}
 	ff::rational tb(p_packet->time_base);
-	if (tb < 0)
+	if (tb <= 0)
 	{
 		throw std::logic_error("Current time base is non-positive.");
 	}
 
-	// Get pts and dts, and additionally duration
-	auto pts = ff::time(p_packet->pts, tb);
-	auto dts = ff::time(p_packet->dts, tb);
-	auto duration = ff::time(p_packet->duration, tb);
-
-	// Update their time base
 	// std::invalid_argument is thrown if new_tb <= 0.
-	pts.change_time_base(new_tb);
-	dts.change_time_base(new_tb);
-
-	// Update the fields
-	p_packet->pts = pts.timestamp_approximate();
-	p_packet->dts = dts.timestamp_approximate();
-
-	p_packet->time_base = new_tb.av_rational();
+	change_time_base(ff::time_rescaler(tb, new_tb));
+}
 
-	// Do it for duration, too, if it's valid.
-	if (duration > 0)
+void ff::packet::change_time_base(const ff::time_rescaler& rescaler)
+{
+	if (destroyed())
+	{
+		throw std::logic_error("The packet is destroyed.");
+	}
+	if (p_packet->time_base.den == 0 || rescaler.from_time_base() != p_packet->time_base)
 	{
-		duration.change_time_base(new_tb);
-		p_packet->duration = duration.timestamp_approximate();
+		throw std::invalid_argument("The packet's time base is not the one the rescaler converts from.");
 	}
+
+	rescaler.rescale(p_packet->pts, p_packet->dts, p_packet->duration);
+	p_packet->time_base = rescaler.to_time_base().av_rational();
 }
 
 void ff::packet::reset_time(int64_t dts, int64_t pts, int64_t duration, ff::rational time_base)
@@ -313,6 +318,18 @@ void ff::packet::prepare_for_muxing(const stream& muxer_stream)
 	p_packet->stream_index = muxer_stream.index();
 }
 
+void ff::packet::prepare_for_muxing(const stream& muxer_stream, const ff::time_rescaler& rescaler)
+{
+	if (rescaler.to_time_base() != muxer_stream.time_base())
+	{
+		throw std::invalid_argument("The rescaler doesn't convert to the stream's time base.");
+	}
+
+	// Throws std::invalid_argument if the packet's time base is not the rescaler's.
+	change_time_base(rescaler);
+	p_packet->stream_index = muxer_stream.index();
+}
+
 void ff::packet::av_packet_copy_props(AVPacket& dst, const AVPacket& src)
 {
 	int ret = ::av_packet_copy_props(&dst, &src);
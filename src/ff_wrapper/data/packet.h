@@ -44,6 +44,10 @@ namespace ff
 		friend class encoder;
 		// Demuxer needs to set it up during demuxing.
 		friend class demuxer;
+		// packet_pool needs to take its AVPacket back for reuse.
+		friend class packet_pool;
+		// bitstream_filter needs to set it up during filtering.
+		friend class bitstream_filter;
 
 	public:
 		inline ~packet() { destroy(); }
@@ -143,6 +147,11 @@ namespace ff
 		*/
 		int data_size() const;
 		/*
+		* @returns how many bytes the buffer I reference holds (with the padding),
+		* or the size of the data if it's not ref-counted. 0 if I'm not ready.
+		*/
+		size_t memory_size() const noexcept;
+		/*
 		* @returns a pointer to the start of the data the packet holds.
 		* @throws std::logic_error if the packet is not READY, if the data does not come from
 		* a demuxer/encoder, or if the data is not allocated through allocate_resources_memory().
@@ -192,6 +201,19 @@ namespace ff
 		* @throws std::invalid_argument if the new time base's not valid (i.e. non-positive).
 		*/
 		void change_time_base(ff::rational new_tb);
+		/*
+		* Changes the time base of the packet from rescaler.from_time_base() to rescaler.to_time_base().
+		* pts and dts are updated, and so is duration if it's set (i.e. > 0).
+		* AV_NOPTS_VALUE stays AV_NOPTS_VALUE.
+		* 
+		* Prefer it to change_time_base(ff::rational) when many packets go between the same time bases,
+		* as the factor is only worked out once, in the rescaler.
+		* 
+		* @param rescaler the conversion.
+		* @throws std::logic_error if the packet is destroyed.
+		* @throws std::invalid_argument if the packet's time base is not rescaler.from_time_base().
+		*/
+		void change_time_base(const ff::time_rescaler& rescaler);
 
 		/*
 		* Resets the time fields to the given arguments.
@@ -225,6 +247,16 @@ namespace ff
 		* @param muxer_stream the stream that the packet will belong to.
 		*/
 		void prepare_for_muxing(const stream& muxer_stream);
+		/*
+		* The same as prepare_for_muxing(muxer_stream), but rescales the time fields with rescaler,
+		* which should convert to the stream's time base.
+		* 
+		* @param muxer_stream the stream that the packet will belong to.
+		* @param rescaler the conversion from the packet's time base to that of muxer_stream.
+		* @throws std::invalid_argument if rescaler doesn't convert to the stream's time base,
+		* or if the packet's time base is not rescaler.from_time_base().
+		*/
+		void prepare_for_muxing(const stream& muxer_stream, const ff::time_rescaler& rescaler);
 
 		/*
 		* My wrapper for ::av_packet_copy_props()
@@ -0,0 +1,177 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "packet_pool.h"
+#include "../util/ff_helpers.h"
+
+extern "C"
+{
+#include <libavcodec/packet.h>
+#include <libavcodec/avcodec.h> // For AV_INPUT_BUFFER_PADDING_SIZE
+#include <libavutil/buffer.h>
+}
+
+#include <cstring>
+#include <stdexcept>
+
+ff::packet_pool::packet_pool(size_t max_free_packets)
+	: max_free_packets(max_free_packets)
+{
+	free_packets.reserve(max_free_packets);
+}
+
+ff::packet_pool::~packet_pool() noexcept
+{
+	for (auto* p : free_packets)
+	{
+		av_packet_free(&p);
+	}
+
+	// The memory is freed after all the buffers return.
+	for (auto*& pool : payload_pools)
+	{
+		av_buffer_pool_uninit(&pool);
+	}
+}
+
+ff::packet ff::packet_pool::get_packet()
+{
+	::AVPacket* p = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (!free_packets.empty())
+		{
+			p = free_packets.back();
+			free_packets.pop_back();
+		}
+	}
+
+	if (nullptr == p)
+	{
+		p = av_packet_alloc();
+		if (nullptr == p)
+		{
+			throw std::bad_alloc();
+		}
+	}
+
+	return packet(p, ff::zero_rational, false);
+}
+
+ff::packet ff::packet_pool::get_packet(int size)
+{
+	if (size <= 0)
+	{
+		throw std::invalid_argument("The size must be > 0.");
+	}
+
+	packet pkt = get_packet();
+	if (0 != av_allocate_payload(pkt.av_packet(), size))
+	{
+		recycle(pkt);
+		throw std::bad_alloc();
+	}
+	pkt.state = ff_object::READY;
+
+	return pkt;
+}
+
+void ff::packet_pool::recycle(packet& pkt) noexcept
+{
+	if (pkt.destroyed())
+	{
+		return;
+	}
+
+	::AVPacket* p = pkt.p_packet;
+	pkt.p_packet = nullptr;
+	pkt.state = ff_object::DESTROYED;
+
+	// Makes it blank. The payload returns to its pool if it came from one.
+	av_packet_unref(p);
+
+	std::lock_guard<std::mutex> lock(mtx);
+	if (free_packets.size() < max_free_packets)
+	{
+		// Won't allocate as I reserved the space.
+		free_packets.push_back(p);
+	}
+	else
+	{
+		av_packet_free(&p);
+	}
+}
+
+size_t ff::packet_pool::number_free_packets() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return free_packets.size();
+}
+
+int ff::packet_pool::av_allocate_payload(AVPacket* pkt, int size) noexcept
+{
+	FF_ASSERT(nullptr == pkt->buf, "pkt should have no payload.");
+
+	if (size < 0)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	AVBufferRef* buf = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		buf = internal_get_buffer(size);
+	}
+	if (nullptr == buf)
+	{
+		return AVERROR(ENOMEM);
+	}
+
+	// Like av_new_packet() does.
+	std::memset(buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+	pkt->buf = buf;
+	pkt->data = buf->data;
+	pkt->size = size;
+
+	return 0;
+}
+
+AVBufferRef* ff::packet_pool::internal_get_buffer(int size) noexcept
+{
+	int class_log2 = min_class_log2;
+	while (class_log2 <= max_class_log2 && (1 << class_log2) < size)
+	{
+		++class_log2;
+	}
+
+	if (class_log2 > max_class_log2)
+	{
+		// Too large to be pooled. Such packets are rare.
+		return av_buffer_alloc(static_cast<size_t>(size) + AV_INPUT_BUFFER_PADDING_SIZE);
+	}
+
+	auto*& pool = payload_pools[class_log2 - min_class_log2];
+	if (nullptr == pool)
+	{
+		pool = av_buffer_pool_init((size_t(1) << class_log2) + AV_INPUT_BUFFER_PADDING_SIZE, nullptr);
+		if (nullptr == pool)
+		{
+			return nullptr;
+		}
+	}
+
+	return av_buffer_pool_get(pool);
+}
@@ -0,0 +1,129 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "packet.h"
+
+#include <mutex>
+#include <vector>
+
+struct AVPacket;
+struct AVBufferRef;
+struct AVBufferPool;
+
+namespace ff
+{
+	/*
+	* A pool of packets that recycles two things:
+	*	1. The packets themselves (AVPacket), which you give back through recycle().
+	*	2. Their payloads, if allocated by me, which return by themselves when the last packet 
+	*	referencing them releases them.
+	* 
+	* Payloads are pooled by size classes (powers of 2), so that packets of similar sizes 
+	* (e.g. many small audio packets) share one AVBufferPool.
+	* Payloads larger than the largest class are allocated normally.
+	* 
+	* Where the packets come from:
+	*	get_packet(), demuxer::demux_next_packet(packet_pool&), and 
+	*	encoder::encode_packet(packet_pool&) give you recycled packets.
+	*	The payloads of encoded packets come from the pool if you also call encoder::use_packet_pool().
+	*	Those of demuxed packets are always allocated inside FFmpeg.
+	* 
+	* Packets and payloads may outlive the pool.
+	* All the methods can be called from multiple threads at the same time.
+	* 
+	* Invariants:
+	*	Every AVPacket in free_packets is blank (as if it came from av_packet_alloc()).
+	*/
+	class FF_WRAPPER_API packet_pool final
+	{
+	public:
+		/*
+		* @param max_free_packets at most how many packets given back will be kept for reuse.
+		* The rest are freed.
+		*/
+		explicit packet_pool(size_t max_free_packets = 64);
+
+		packet_pool(const packet_pool&) = delete;
+		packet_pool& operator=(const packet_pool&) = delete;
+
+		/*
+		* Frees the packets kept and releases the payload pools.
+		* Packets and payloads still in use are not affected.
+		*/
+		~packet_pool() noexcept;
+
+	public:
+		/*
+		* @returns a created packet without data.
+		*/
+		packet get_packet();
+
+		/*
+		* Like packet::allocate_resources_memory(size), except the payload comes from the pool.
+		* 
+		* @returns a ready packet with a payload of size bytes. Its content is undefined
+		* except that the padding after it is zeroed.
+		* @throws std::invalid_argument if size <= 0.
+		*/
+		packet get_packet(int size);
+
+		/*
+		* Gives a packet back for reuse. Any data it holds is released.
+		* Call it after muxing a packet, for example.
+		* 
+		* @param pkt the packet. It will be destroyed afterwards. Nothing happens if it's already destroyed.
+		*/
+		void recycle(packet& pkt) noexcept;
+
+		/*
+		* @returns the number of packets kept for reuse now.
+		*/
+		size_t number_free_packets() const;
+
+	public:
+		/*
+		* Gives pkt a ref-counted payload of size bytes from the pool.
+		* The low-level version for FFmpeg's callbacks (e.g. AVCodecContext::get_encode_buffer).
+		* 
+		* @param pkt a packet with no payload.
+		* @returns 0 on success, AVERROR(EINVAL) if size < 0, or AVERROR(ENOMEM) if there's no memory.
+		*/
+		int av_allocate_payload(AVPacket* pkt, int size) noexcept;
+
+	private:
+		/*
+		* Gets a buffer of at least size bytes plus padding.
+		* Must be called with mtx locked.
+		* 
+		* @returns the buffer or nullptr if there's no memory.
+		*/
+		AVBufferRef* internal_get_buffer(int size) noexcept;
+
+	private:
+		// Size class i holds payloads of up to (1 << (min_class_log2 + i)) bytes.
+		static constexpr int min_class_log2 = 8;
+		static constexpr int max_class_log2 = 24;
+		static constexpr int num_classes = max_class_log2 - min_class_log2 + 1;
+
+		mutable std::mutex mtx;
+		size_t max_free_packets;
+		std::vector<::AVPacket*> free_packets;
+		// Created on demand.
+		::AVBufferPool* payload_pools[num_classes] = {};
+	};
+}
@@ -0,0 +1,300 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* plane_view.h:
+* Defines typed views of the planes of video frames,
+* which are checked once when created instead of on every access.
+* 
+* Header only.
+*/
+
+#include "frame.h"
+
+extern "C"
+{
+#include <libavutil/common.h> // For AV_CEIL_RSHIFT
+#include <libavutil/pixfmt.h>
+}
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+namespace ff
+{
+	/*
+	* A 2D view of one plane of video data: height rows of width elements of type T,
+	* each row starting line_size bytes after the previous one.
+	* It is like a std::mdspan (which is C++ 23) with a layout_stride, except that the stride is in bytes,
+	* as the line size of a frame may not be a multiple of sizeof(T).
+	* 
+	* Nothing is checked on access, which is the point: what is checked when the view is created
+	* (see view_plane()) doesn't change while the frame lives, so in a loop the compiler only sees
+	* pointer arithmetic and can vectorize the inner one.
+	* 
+	* The view doesn't own anything. It's invalid once the frame it views
+	* is destroyed, cleared, or gets new data.
+	* If the frame is stored up-side-down, line_size is negative and the view works all the same.
+	* 
+	* No need to be DLL imported/exported, because this is a template
+	* and header only.
+	*/
+	template <typename T>
+	class plane_view final
+	{
+	private:
+		// Steps by bytes, keeping the constness of T.
+		using byte_pointer = std::conditional_t<std::is_const_v<T>, const std::byte*, std::byte*>;
+
+	public:
+		using element_type = T;
+
+		/*
+		* An empty view.
+		*/
+		constexpr plane_view() noexcept = default;
+
+		/*
+		* Views width * height elements starting at data.
+		* Nothing is checked.
+		* 
+		* @param line_size how many bytes row y + 1 starts after row y. Can be negative.
+		*/
+		constexpr plane_view(T* data, std::ptrdiff_t line_size, int width, int height) noexcept
+			: p_data(data), stride(line_size), w(width), h(height) {}
+
+		/*
+		* Views mutable data as const.
+		*/
+		template <typename U>
+			requires std::is_same_v<const U, T> && (!std::is_same_v<U, T>)
+		constexpr plane_view(const plane_view<U>& other) noexcept
+			: p_data(other.data()), stride(other.line_size()), w(other.width()), h(other.height()) {}
+
+	public:
+		/*
+		* @returns a pointer to the first element of row y. y is not checked.
+		*/
+		T* row(int y) const noexcept
+		{
+			return reinterpret_cast<T*>(reinterpret_cast<byte_pointer>(p_data) + y * stride);
+		}
+
+		/*
+		* @returns row y as a span of width() elements. y is not checked.
+		*/
+		std::span<T> row_span(int y) const noexcept
+		{
+			return std::span<T>(row(y), static_cast<size_t>(w));
+		}
+
+		/*
+		* @returns element x of row y. Neither is checked.
+		*/
+		T& operator()(int y, int x) const noexcept
+		{
+			return row(y)[x];
+		}
+
+		/*
+		* @returns a pointer to the first element of row 0.
+		*/
+		constexpr T* data() const noexcept { return p_data; }
+		/*
+		* @returns how many bytes a row starts after the previous one.
+		*/
+		constexpr std::ptrdiff_t line_size() const noexcept { return stride; }
+		/*
+		* @returns how many elements are in a row.
+		*/
+		constexpr int width() const noexcept { return w; }
+		/*
+		* @returns how many rows there are.
+		*/
+		constexpr int height() const noexcept { return h; }
+		/*
+		* @returns true iff there is no element.
+		*/
+		constexpr bool empty() const noexcept { return 0 == w || 0 == h; }
+
+	private:
+		T* p_data = nullptr;
+		std::ptrdiff_t stride = 0;
+		int w = 0, h = 0;
+	};
+
+	/*
+	* How one plane of a pixel format is laid out, relative to the size of the picture.
+	*/
+	struct plane_layout
+	{
+		// The width of the plane is the width of the picture >> log2_w, rounded up.
+		int log2_w;
+		// The height of the plane is the height of the picture >> log2_h, rounded up.
+		int log2_h;
+		// How many elements a pixel of the plane takes (e.g. 2 for interleaved U and V).
+		int elements_per_pixel;
+	};
+
+	/*
+	* Describes at compile time how a pixel format stores its planes.
+	* Only the formats that the kernels in this library work on are specialized.
+	* For others, view the data through frame::data() and frame::line_size().
+	* 
+	* Each specialization has
+	*	element_type, the type of one element of any plane,
+	*	num_planes, and
+	*	planes, the plane_layout of each plane.
+	*/
+	template <AVPixelFormat Fmt>
+	struct pixel_format_traits;
+
+	// Planar Y, U, V; U and V halved in both directions.
+	template <>
+	struct pixel_format_traits<AV_PIX_FMT_YUV420P>
+	{
+		using element_type = uint8_t;
+		static constexpr int num_planes = 3;
+		static constexpr plane_layout planes[num_planes] = { {0, 0, 1}, {1, 1, 1}, {1, 1, 1} };
+	};
+
+	// YUV420P with a full size alpha plane.
+	template <>
+	struct pixel_format_traits<AV_PIX_FMT_YUVA420P>
+	{
+		using element_type = uint8_t;
+		static constexpr int num_planes = 4;
+		static constexpr plane_layout planes[num_planes] = { {0, 0, 1}, {1, 1, 1}, {1, 1, 1}, {0, 0, 1} };
+	};
+
+	// Like YUV420P, but each element is 16 bits little endian, of which the low 10 are used.
+	template <>
+	struct pixel_format_traits<AV_PIX_FMT_YUV420P10LE>
+	{
+		using element_type = uint16_t;
+		static constexpr int num_planes = 3;
+		static constexpr plane_layout planes[num_planes] = { {0, 0, 1}, {1, 1, 1}, {1, 1, 1} };
+	};
+
+	// Planar Y and interleaved UV; UV halved in both directions.
+	template <>
+	struct pixel_format_traits<AV_PIX_FMT_NV12>
+	{
+		using element_type = uint8_t;
+		static constexpr int num_planes = 2;
+		static constexpr plane_layout planes[num_planes] = { {0, 0, 1}, {1, 1, 2} };
+	};
+
+	// Packed R, G, B, A.
+	template <>
+	struct pixel_format_traits<AV_PIX_FMT_RGBA>
+	{
+		using element_type = uint8_t;
+		static constexpr int num_planes = 1;
+		static constexpr plane_layout planes[num_planes] = { {0, 0, 4} };
+	};
+
+	// Like NV12, but each element is 16 bits little endian, of which the high 10 are used.
+	template <>
+	struct pixel_format_traits<AV_PIX_FMT_P010LE>
+	{
+		using element_type = uint16_t;
+		static constexpr int num_planes = 2;
+		static constexpr plane_layout planes[num_planes] = { {0, 0, 1}, {1, 1, 2} };
+	};
+
+	/*
+	* Checks that f has data of format fmt that can be viewed.
+	* 
+	* @throws std::logic_error if f is not a ready video frame, or if it is a hardware frame.
+	* @throws std::invalid_argument if f's format is not fmt.
+	*/
+	inline void internal_check_viewable(const frame& f, AVPixelFormat fmt)
+	{
+		if (!f.ready() || !f.v_or_a())
+		{
+			throw std::logic_error("Only a ready video frame can be viewed.");
+		}
+		if (f.is_hardware())
+		{
+			throw std::logic_error("The data of a hardware frame cannot be viewed.");
+		}
+		if (f.get_data_properties().fmt != fmt)
+		{
+			throw std::invalid_argument("The frame is not of the format.");
+		}
+	}
+
+	/*
+	* Views plane Plane of f, which must be of format Fmt.
+	* The element type, and the size of the plane relative to the picture
+	* are known at compile time from pixel_format_traits<Fmt>.
+	* The width of the view is in elements, so e.g. that of an RGBA plane is 4 * the width of the picture.
+	* 
+	* Call it once outside of a loop, and then access the view in the loop. For example,
+	*	auto y = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(f);
+	*	for (int i = 0; i < y.height(); ++i)
+	*		for (uint8_t& v : y.row_span(i)) ...
+	* 
+	* Note: writing to the view writes to the data f may share with other frames.
+	* Call f.make_writable() first if it's not writable.
+	* 
+	* @throws std::logic_error if f is not a ready video frame, or if it is a hardware frame.
+	* @throws std::invalid_argument if f's format is not Fmt.
+	*/
+	template <AVPixelFormat Fmt, int Plane>
+	plane_view<typename pixel_format_traits<Fmt>::element_type> view_plane(frame& f)
+	{
+		using traits = pixel_format_traits<Fmt>;
+		static_assert(Plane >= 0 && Plane < traits::num_planes, "The format doesn't have the plane.");
+		constexpr plane_layout layout = traits::planes[Plane];
+
+		internal_check_viewable(f, Fmt);
+		auto dp = f.get_data_properties();
+
+		return plane_view<typename traits::element_type>
+		(
+			f.data<typename traits::element_type>(Plane), f.line_size(Plane),
+			AV_CEIL_RSHIFT(dp.width, layout.log2_w) * layout.elements_per_pixel,
+			AV_CEIL_RSHIFT(dp.height, layout.log2_h)
+		);
+	}
+
+	/*
+	* Same as view_plane(frame&), except that the view is read only.
+	*/
+	template <AVPixelFormat Fmt, int Plane>
+	plane_view<const typename pixel_format_traits<Fmt>::element_type> view_plane(const frame& f)
+	{
+		using traits = pixel_format_traits<Fmt>;
+		static_assert(Plane >= 0 && Plane < traits::num_planes, "The format doesn't have the plane.");
+		constexpr plane_layout layout = traits::planes[Plane];
+
+		internal_check_viewable(f, Fmt);
+		auto dp = f.get_data_properties();
+
+		return plane_view<const typename traits::element_type>
+		(
+			static_cast<const typename traits::element_type*>(f.data(Plane)), f.line_size(Plane),
+			AV_CEIL_RSHIFT(dp.width, layout.log2_w) * layout.elements_per_pixel,
+			AV_CEIL_RSHIFT(dp.height, layout.log2_h)
+		);
+	}
+}
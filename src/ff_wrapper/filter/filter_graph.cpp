@@ -0,0 +1,524 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "filter_graph.h"
+#include "../util/ff_helpers.h"
+#include "../codec/decoder.h"
+
+extern "C"
+{
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/mem.h>
+}
+
+#include <stdexcept>
+
+ff::filter_graph::filter_graph
+(
+	const std::string& filters,
+	const frame::data_properties& src_properties, ff::rational time_base,
+	int num_threads, ff::rational sar
+)
+	: video_or_audio(true), src_fmt(src_properties.fmt),
+	src_time_base(time_base), num_threads(num_threads)
+{
+	if (!src_properties.v_or_a)
+	{
+		throw std::invalid_argument("The src properties are not for video.");
+	}
+	internal_check_arguments(time_base, num_threads);
+
+	src_w = src_properties.width;
+	src_h = src_properties.height;
+	src_sar = sar;
+
+	internal_create_graph(filters, AVRational{ 0, 1 });
+}
+
+ff::filter_graph::filter_graph
+(
+	const std::string& filters,
+	const frame::data_properties& src_properties, int sample_rate, ff::rational time_base,
+	int num_threads
+)
+	: video_or_audio(false), src_fmt(src_properties.fmt),
+	src_time_base(time_base), num_threads(num_threads)
+{
+	if (src_properties.v_or_a)
+	{
+		throw std::invalid_argument("The src properties are not for audio.");
+	}
+	if (sample_rate <= 0)
+	{
+		throw std::invalid_argument("The sample rate must be > 0.");
+	}
+	internal_check_arguments(time_base, num_threads);
+
+	src_sample_rate = sample_rate;
+	// Copies it.
+	src_ch_layout = src_properties.ch_layout;
+
+	internal_create_graph(filters, AVRational{ 0, 1 });
+}
+
+ff::filter_graph::filter_graph(const std::string& filters, const decoder& dec, ff::rational time_base, int num_threads)
+	: video_or_audio(true), src_fmt(-1),
+	src_time_base(time_base), num_threads(num_threads)
+{
+	if (!dec.ready())
+	{
+		throw std::logic_error("The decoder is not ready.");
+	}
+	internal_check_arguments(time_base, num_threads);
+
+	if (dec.is_video())
+	{
+		src_fmt = dec->pix_fmt;
+		src_w = dec->width;
+		src_h = dec->height;
+		if (!av_rational_invalid_or_zero(dec->sample_aspect_ratio))
+		{
+			src_sar = dec->sample_aspect_ratio;
+		}
+
+		internal_create_graph(filters, dec->framerate);
+	}
+	else if (dec.is_audio())
+	{
+		video_or_audio = false;
+		src_fmt = dec->sample_fmt;
+		src_sample_rate = dec->sample_rate;
+		// Copies it, as the decoder may go before the graph.
+		src_ch_layout = channel_layout(dec->ch_layout, false);
+
+		internal_create_graph(filters, AVRational{ 0, 1 });
+	}
+	else
+	{
+		throw std::invalid_argument("The decoder is neither for video nor audio.");
+	}
+}
+
+ff::filter_graph::filter_graph(const std::string& filters, const frame& hw_frame, ff::rational time_base, int num_threads)
+	: video_or_audio(true), src_fmt(-1),
+	src_time_base(time_base), num_threads(num_threads)
+{
+	if (!hw_frame.is_hardware())
+	{
+		throw std::invalid_argument("The frame is not a hardware frame.");
+	}
+	internal_check_arguments(time_base, num_threads);
+
+	src_fmt = hw_frame->format;
+	src_w = hw_frame->width;
+	src_h = hw_frame->height;
+	if (!av_rational_invalid_or_zero(hw_frame->sample_aspect_ratio))
+	{
+		src_sar = hw_frame->sample_aspect_ratio;
+	}
+
+	internal_create_graph(filters, AVRational{ 0, 1 }, hw_frame->hw_frames_ctx);
+}
+
+ff::filter_graph::~filter_graph() noexcept
+{
+	// Frees the filters in it, too.
+	avfilter_graph_free(&graph);
+}
+
+void ff::filter_graph::feed_frame(const frame& f)
+{
+	if (signaled_no_more_food)
+	{
+		throw std::logic_error("No more frames can be fed after signal_no_more_food().");
+	}
+	if (!f.ready())
+	{
+		throw std::invalid_argument("The frame is not ready.");
+	}
+	if (f.v_or_a() != video_or_audio)
+	{
+		throw std::invalid_argument("The frame is not of the media type of the graph.");
+	}
+	// The buffer source only logs when the properties change, and most filters then misbehave.
+	if (video_or_audio)
+	{
+		if (f->format != src_fmt || f->width != src_w || f->height != src_h)
+		{
+			throw std::invalid_argument("The frame doesn't match the source properties.");
+		}
+	}
+	else
+	{
+		if (f->format != src_fmt || !(src_ch_layout == f->ch_layout))
+		{
+			throw std::invalid_argument("The frame doesn't match the source properties.");
+		}
+	}
+
+	FF_METRICS_SAMPLE(metrics_probe, 0);
+
+	// KEEP_REF makes the graph take a new reference to the data instead of f's.
+	int ret = av_buffersrc_add_frame_flags(src_ctx, const_cast<AVFrame*>(f.av_frame()), AV_BUFFERSRC_FLAG_KEEP_REF);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		case AVERROR(EINVAL):
+			throw std::invalid_argument("The frame is invalid for the graph.");
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Could not feed the frame to the graph", ret);
+		}
+	}
+
+	FF_METRICS_ADD(1, 0);
+}
+
+void ff::filter_graph::signal_no_more_food()
+{
+	if (signaled_no_more_food)
+	{
+		return;
+	}
+
+	// A nullptr frame closes the source.
+	int ret = av_buffersrc_add_frame_flags(src_ctx, nullptr, 0);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Could not close the source of the graph", ret);
+		}
+	}
+
+	signaled_no_more_food = true;
+}
+
+bool ff::filter_graph::filter_frame(frame& f)
+{
+	// Handle f so that it's always created before av_buffersink_get_frame()
+	switch (f.get_object_state())
+	{
+	case ff_object::DESTROYED:
+		f.allocate_object_memory();
+		[[fallthrough]];
+	case ff_object::OBJECT_CREATED:
+		// Do nothing.
+		break;
+	case ff_object::READY:
+		// Release its previous data.
+		f.release_resources_memory();
+		break;
+	}
+
+	if (is_drained)
+	{
+		return false;
+	}
+
+	FF_METRICS_SAMPLE(metrics_probe, 1);
+
+	int ret = av_buffersink_get_frame(sink_ctx, f.av_frame());
+	if (0 == ret) // Success
+	{
+		f->time_base = av_buffersink_get_time_base(sink_ctx);
+
+		// Don't forget to make f ready
+		// and set its internal fields
+		f.internal_find_num_planes();
+		f.set_v_or_a(video_or_audio);
+		f.state = ff_object::READY;
+
+		FF_METRICS_ADD(1, 0);
+		return true;
+	}
+
+	switch (ret)
+	{
+	case AVERROR(EAGAIN):
+		// Needs more frames.
+		FF_METRICS_REFUSE();
+		return false;
+		break;
+	case AVERROR_EOF:
+		// Everything has come out after signal_no_more_food().
+		is_drained = true;
+		return false;
+		break;
+	case AVERROR(ENOMEM):
+		throw std::bad_alloc();
+		break;
+	default:
+		ON_FF_ERROR_WITH_CODE("Could not filter a frame", ret);
+	}
+
+	// Never reaches here.
+	return false;
+}
+
+ff::frame ff::filter_graph::filter_frame()
+{
+	frame f;
+	if (!filter_frame(f))
+	{
+		f.destroy();
+	}
+
+	return f;
+}
+
+ff::frame::data_properties ff::filter_graph::src_properties() const
+{
+	if (video_or_audio)
+	{
+		return frame::data_properties(src_fmt, src_w, src_h);
+	}
+	else
+	{
+		return frame::data_properties(src_fmt, 0, src_ch_layout);
+	}
+}
+
+ff::frame::data_properties ff::filter_graph::dst_properties() const
+{
+	if (video_or_audio)
+	{
+		return frame::data_properties
+		(
+			av_buffersink_get_format(sink_ctx),
+			av_buffersink_get_w(sink_ctx), av_buffersink_get_h(sink_ctx)
+		);
+	}
+
+	AVChannelLayout layout{};
+	int ret = av_buffersink_get_ch_layout(sink_ctx, &layout);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Could not get the channel layout of the graph", ret);
+		}
+	}
+
+	// The properties copy the layout.
+	frame::data_properties dp(av_buffersink_get_format(sink_ctx), 0, channel_layout(layout, true));
+	av_channel_layout_uninit(&layout);
+	return dp;
+}
+
+ff::rational ff::filter_graph::dst_time_base() const noexcept
+{
+	return av_buffersink_get_time_base(sink_ctx);
+}
+
+ff::rational ff::filter_graph::dst_frame_rate() const noexcept
+{
+	AVRational fr = av_buffersink_get_frame_rate(sink_ctx);
+	return av_rational_invalid_or_zero(fr) ? ff::zero_rational : ff::rational(fr);
+}
+
+int ff::filter_graph::dst_sample_rate() const noexcept
+{
+	return video_or_audio ? 0 : av_buffersink_get_sample_rate(sink_ctx);
+}
+
+void ff::filter_graph::internal_check_arguments(ff::rational time_base, int num_threads)
+{
+	if (time_base <= 0)
+	{
+		throw std::invalid_argument("The time base must be > 0.");
+	}
+	if (num_threads < 0)
+	{
+		throw std::invalid_argument("The number of threads cannot be negative.");
+	}
+}
+
+void ff::filter_graph::internal_create_graph(const std::string& filters, const AVRational& frame_rate, AVBufferRef* hw_frames)
+{
+	graph = avfilter_graph_alloc();
+	if (nullptr == graph)
+	{
+		throw std::bad_alloc();
+	}
+
+	AVFilterInOut* outputs = nullptr;
+	AVFilterInOut* inputs = nullptr;
+	try
+	{
+		// Must be set before the filters are created.
+		graph->nb_threads = num_threads;
+		graph->thread_type = AVFILTER_THREAD_SLICE;
+
+		// The source.
+		src_ctx = avfilter_graph_alloc_filter(graph, avfilter_get_by_name(video_or_audio ? "buffer" : "abuffer"), "in");
+		if (nullptr == src_ctx)
+		{
+			throw std::bad_alloc();
+		}
+
+		AVBufferSrcParameters* par = av_buffersrc_parameters_alloc();
+		if (nullptr == par)
+		{
+			throw std::bad_alloc();
+		}
+		par->format = src_fmt;
+		par->time_base = src_time_base.av_rational();
+		if (video_or_audio)
+		{
+			par->width = src_w;
+			par->height = src_h;
+			par->sample_aspect_ratio = src_sar.av_rational();
+			if (!av_rational_invalid_or_zero(frame_rate))
+			{
+				par->frame_rate = frame_rate;
+			}
+			// The source takes its own reference. The filters after it find the device through it.
+			par->hw_frames_ctx = hw_frames;
+		}
+		else
+		{
+			par->sample_rate = src_sample_rate;
+			if (av_channel_layout_copy(&par->ch_layout, &src_ch_layout.av_ch_layout()) < 0)
+			{
+				av_free(par);
+				throw std::bad_alloc();
+			}
+		}
+
+		int ret = av_buffersrc_parameters_set(src_ctx, par);
+		av_channel_layout_uninit(&par->ch_layout);
+		av_free(par);
+		if (ret >= 0)
+		{
+			ret = avfilter_init_str(src_ctx, nullptr);
+		}
+		if (ret < 0)
+		{
+			switch (ret)
+			{
+			case AVERROR(ENOMEM):
+				throw std::bad_alloc();
+				break;
+			case AVERROR(EINVAL):
+				throw std::invalid_argument("The source properties are invalid.");
+				break;
+			default:
+				ON_FF_ERROR_WITH_CODE("Could not create the source of the graph", ret);
+			}
+		}
+
+		// The sink.
+		ret = avfilter_graph_create_filter
+		(
+			&sink_ctx, avfilter_get_by_name(video_or_audio ? "buffersink" : "abuffersink"),
+			"out", nullptr, nullptr, graph
+		);
+		if (ret < 0)
+		{
+			switch (ret)
+			{
+			case AVERROR(ENOMEM):
+				throw std::bad_alloc();
+				break;
+			default:
+				ON_FF_ERROR_WITH_CODE("Could not create the sink of the graph", ret);
+			}
+		}
+
+		// The description's unlabeled input is fed by the source,
+		// and its unlabeled output feeds the sink.
+		outputs = avfilter_inout_alloc();
+		inputs = avfilter_inout_alloc();
+		if (nullptr == outputs || nullptr == inputs)
+		{
+			throw std::bad_alloc();
+		}
+		outputs->name = av_strdup("in");
+		outputs->filter_ctx = src_ctx;
+		outputs->pad_idx = 0;
+		outputs->next = nullptr;
+		inputs->name = av_strdup("out");
+		inputs->filter_ctx = sink_ctx;
+		inputs->pad_idx = 0;
+		inputs->next = nullptr;
+		if (nullptr == outputs->name || nullptr == inputs->name)
+		{
+			throw std::bad_alloc();
+		}
+
+		const char* description = filters.empty() ? (video_or_audio ? "null" : "anull") : filters.c_str();
+		ret = avfilter_graph_parse_ptr(graph, description, &inputs, &outputs, nullptr);
+		avfilter_inout_free(&inputs);
+		avfilter_inout_free(&outputs);
+		if (ret < 0)
+		{
+			switch (ret)
+			{
+			case AVERROR(ENOMEM):
+				throw std::bad_alloc();
+				break;
+			case AVERROR(EINVAL):
+			case AVERROR_FILTER_NOT_FOUND:
+			case AVERROR_OPTION_NOT_FOUND:
+				throw std::invalid_argument("Could not parse the filters.");
+				break;
+			default:
+				ON_FF_ERROR_WITH_CODE("Could not parse the filters", ret);
+			}
+		}
+
+		ret = avfilter_graph_config(graph, nullptr);
+		if (ret < 0)
+		{
+			switch (ret)
+			{
+			case AVERROR(ENOMEM):
+				throw std::bad_alloc();
+				break;
+			case AVERROR(EINVAL):
+			case AVERROR(ENOSYS):
+				throw std::invalid_argument("The filters cannot work on such frames.");
+				break;
+			default:
+				ON_FF_ERROR_WITH_CODE("Could not configure the graph", ret);
+			}
+		}
+	}
+	catch (...)
+	{
+		avfilter_inout_free(&inputs);
+		avfilter_inout_free(&outputs);
+		avfilter_graph_free(&graph);
+		src_ctx = sink_ctx = nullptr;
+		throw;
+	}
+}
@@ -0,0 +1,252 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class filter_graph
+*/
+
+#include "../util/util.h"
+#include "../util/ff_math.h"
+#include "../util/channel_layout.h"
+#include "../util/metrics.h"
+#include "../data/frame.h"
+
+#include <string>
+
+struct AVFilterGraph;
+struct AVFilterContext;
+struct AVBufferRef;
+
+namespace ff
+{
+	class decoder;
+
+	/*
+	* Runs frames through a graph of libavfilter filters (e.g. yadif, hqdn3d, overlay),
+	* described the same way as for the -vf/-af option of the FFmpeg CLI, e.g. "yadif,hqdn3d=4".
+	* The graph has one input and one output, and is fixed once constructed.
+	* 
+	* Frames are passed in and out by reference (av_frame_ref), so nothing is copied
+	* unless a filter itself needs to write to a frame that's shared.
+	* 
+	* How to use it is like a codec (see codec_base):
+	*	1. feed_frame() each source frame.
+	*	2. After each feeding, call filter_frame() until it returns false/a DESTROYED frame,
+	*	which means the graph is hungry for more.
+	*	3. When there are no more source frames, call signal_no_more_food(), and then
+	*	filter_frame() until it returns false/a DESTROYED frame. Then drained() is true.
+	* Unlike a codec, a graph is never full. It buffers whatever it needs
+	* (e.g. yadif holds back a frame or two).
+	* 
+	* Threading:
+	* Filters that support it (e.g. yadif, hqdn3d, scale) cut each frame into
+	* slices that are filtered on num_threads threads at once, num_threads being what you give to a constructor.
+	* 0 (the default) lets FFmpeg decide, and 1 uses only the calling thread.
+	* 
+	* Timestamps:
+	* The source frames must have pts in the time base you give to a constructor.
+	* The filtered frames have pts in dst_time_base(), which is also set as their time_base.
+	* 
+	* Invariants:
+	*	graph != nullptr and is configured,
+	*	src_ctx and sink_ctx are the input and output of graph.
+	*/
+	class FF_WRAPPER_API filter_graph final
+	{
+	public:
+		// You must describe the graph and its source.
+		filter_graph() = delete;
+
+		/*
+		* Builds a graph that filters video frames of src_properties.
+		* 
+		* @param filters the description of the graph. Empty to pass the frames through unchanged.
+		* @param time_base the time base of the pts of the source frames.
+		* @param num_threads see the comments for the class.
+		* @param sar the sample aspect ratio of the source frames. Zero if unknown.
+		* @throws std::invalid_argument if src_properties is not for video, if time_base <= 0,
+		* or if num_threads < 0.
+		* @throws std::invalid_argument if filters cannot be parsed (e.g. no filter has a name),
+		* or if the filters cannot work on such frames.
+		*/
+		filter_graph
+		(
+			const std::string& filters,
+			const frame::data_properties& src_properties, ff::rational time_base,
+			int num_threads = 0, ff::rational sar = ff::zero_rational
+		);
+
+		/*
+		* Builds a graph that filters audio frames of src_properties at sample_rate.
+		* num_samples of src_properties doesn't matter.
+		* 
+		* @param filters the description of the graph. Empty to pass the frames through unchanged.
+		* @param time_base the time base of the pts of the source frames.
+		* @param num_threads see the comments for the class.
+		* @throws std::invalid_argument if src_properties is not for audio, if sample_rate <= 0,
+		* if time_base <= 0, or if num_threads < 0.
+		* @throws std::invalid_argument if filters cannot be parsed (e.g. no filter has a name),
+		* or if the filters cannot work on such frames.
+		*/
+		filter_graph
+		(
+			const std::string& filters,
+			const frame::data_properties& src_properties, int sample_rate, ff::rational time_base,
+			int num_threads = 0
+		);
+
+		/*
+		* Builds a graph that filters the frames dec decodes.
+		* 
+		* @param time_base the time base of the pts of the decoded frames,
+		* which is usually that of the stream dec decodes.
+		* @throws std::logic_error if dec is not ready.
+		* @throws std::invalid_argument if dec is neither for video nor audio.
+		* @throws the same as the other constructors.
+		*/
+		filter_graph(const std::string& filters, const decoder& dec, ff::rational time_base, int num_threads = 0);
+
+		/*
+		* Builds a graph that filters hardware frames like hw_frame (e.g. "scale_cuda=1280:720"),
+		* which stay on the device of hw_frame. The source frames must come from the same device
+		* and be of the same hardware pixel format and size as hw_frame.
+		* 
+		* @param time_base the time base of the pts of the source frames.
+		* @throws std::invalid_argument if hw_frame is not a hardware frame.
+		* @throws the same as the other constructors.
+		*/
+		filter_graph(const std::string& filters, const frame& hw_frame, ff::rational time_base, int num_threads = 0);
+
+		filter_graph(const filter_graph&) = delete;
+		filter_graph& operator=(const filter_graph&) = delete;
+
+		~filter_graph() noexcept;
+
+	public:
+		/*
+		* Feeds a source frame into the graph. The graph references the frame's data, and doesn't copy it.
+		* 
+		* @throws std::logic_error if signal_no_more_food() has been called.
+		* @throws std::invalid_argument if f is not ready, or if it doesn't match the properties of the source.
+		*/
+		void feed_frame(const frame& f);
+
+		/*
+		* Tells the graph that no more frames will be fed,
+		* so that it outputs what it has held back. Does nothing if it's been called.
+		*/
+		void signal_no_more_food();
+
+		/*
+		* Takes out the next filtered frame.
+		* 
+		* @param f where the frame goes. If it's destroyed, created, or ready, it will be ready with the frame.
+		* If there's no frame (i.e. it returns false), then f will be created with no data.
+		* @returns true if a frame has been taken out; false if the graph is hungry, or has been drained.
+		*/
+		bool filter_frame(frame& f);
+
+		/*
+		* Same as filter_frame(frame&), except that the frame is returned.
+		* 
+		* @returns the frame; a DESTROYED frame if the graph is hungry, or has been drained.
+		*/
+		frame filter_frame();
+
+	public:
+		/*
+		* @returns true iff the graph is for video frames.
+		*/
+		inline bool v_or_a() const noexcept { return video_or_audio; }
+
+		/*
+		* @returns true iff signal_no_more_food() has been called.
+		*/
+		inline bool no_more_food() const noexcept { return signaled_no_more_food; }
+
+		/*
+		* @returns true iff everything has been taken out after signal_no_more_food().
+		*/
+		inline bool drained() const noexcept { return is_drained; }
+
+		/*
+		* @returns the number of threads you gave to the constructor. 0 means FFmpeg decides.
+		*/
+		inline int get_num_threads() const noexcept { return num_threads; }
+
+		/*
+		* @returns what the source frames must be like. For audio, num_samples is 0.
+		*/
+		frame::data_properties src_properties() const;
+
+		/*
+		* @returns what the filtered frames are like. For audio, num_samples is 0.
+		*/
+		frame::data_properties dst_properties() const;
+
+		/*
+		* @returns the time base of the pts of the filtered frames.
+		*/
+		ff::rational dst_time_base() const noexcept;
+
+		/*
+		* @returns the frame rate of the filtered video frames. Zero if unknown or for audio.
+		*/
+		ff::rational dst_frame_rate() const noexcept;
+
+		/*
+		* @returns the sample rate of the filtered audio frames. 0 for video.
+		*/
+		int dst_sample_rate() const noexcept;
+
+	private:
+		/*
+		* Creates and configures the graph based on the source fields.
+		* hw_frames is the AVHWFramesContext of hardware source frames, or nullptr.
+		* Frees everything it created if it throws.
+		*/
+		void internal_create_graph(const std::string& filters, const AVRational& frame_rate, AVBufferRef* hw_frames = nullptr);
+
+		/*
+		* Common checks of the constructors.
+		*/
+		static void internal_check_arguments(ff::rational time_base, int num_threads);
+
+	private:
+		::AVFilterGraph* graph = nullptr;
+		::AVFilterContext* src_ctx = nullptr;
+		::AVFilterContext* sink_ctx = nullptr;
+
+		// The source
+		bool video_or_audio;
+		int src_fmt;
+		int src_w = 0, src_h = 0;
+		ff::rational src_sar = ff::zero_rational;
+		int src_sample_rate = 0;
+		channel_layout src_ch_layout;
+		ff::rational src_time_base;
+
+		int num_threads;
+		bool signaled_no_more_food = false;
+		bool is_drained = false;
+
+#ifdef FF_WRAPPER_ENABLE_METRICS
+		// Stages: feed_frame, filter_frame. See metrics.h.
+		metrics::probe metrics_probe{ "filter_graph", { "feed_frame", "filter_frame" } };
+#endif // FF_WRAPPER_ENABLE_METRICS
+	};
+}
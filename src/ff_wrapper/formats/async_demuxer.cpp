@@ -0,0 +1,379 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "async_demuxer.h"
+#include "../util/ff_helpers.h"
+
+extern "C"
+{
+#include <libavcodec/packet.h>
+}
+
+#include <filesystem>
+#include <stdexcept>
+
+ff::async_demuxer::async_demuxer
+(
+	const std::filesystem::path& file_path,
+	const read_ahead_budget& budget,
+	const std::vector<int>& stream_indices,
+	bool probe_stream_info,
+	const dict& options
+)
+	: dem(file_path, probe_stream_info, options), budget(budget)
+{
+	if (0 == budget.max_packets_per_stream || 0 == budget.max_bytes)
+	{
+		throw std::invalid_argument("The budget cannot be 0.");
+	}
+
+	queues.resize(dem.num_streams());
+	if (stream_indices.empty())
+	{
+		for (auto& q : queues)
+		{
+			q = std::make_unique<spsc_queue<queued_packet>>(budget.max_packets_per_stream);
+		}
+	}
+	else
+	{
+		for (int ind : stream_indices)
+		{
+			if (ind < 0 || ind >= dem.num_streams())
+			{
+				throw std::out_of_range("Stream index is out of range.");
+			}
+			if (nullptr == queues[ind])
+			{
+				queues[ind] = std::make_unique<spsc_queue<queued_packet>>(budget.max_packets_per_stream);
+			}
+		}
+	}
+
+	reader = std::thread(&async_demuxer::reader_loop, this);
+}
+
+ff::async_demuxer::~async_demuxer() noexcept
+{
+	internal_control_reader(READER_STOP);
+	reader.join();
+}
+
+ff::packet ff::async_demuxer::demux_next_packet()
+{
+	while (true)
+	{
+		const uint32_t events = reader_events.load(std::memory_order_acquire);
+		const uint64_t published = published_seq.load(std::memory_order_acquire);
+
+		// The front of each queue is the earliest packet of its stream,
+		// so the one with the smallest seq is the next in the file.
+		// Only those with seq < published are sure to be visible, so a packet
+		// before them cannot be missed.
+		int next_ind = -1;
+		uint64_t next_seq_found = published;
+		for (size_t i = 0; i < queues.size(); ++i)
+		{
+			if (nullptr == queues[i])
+			{
+				continue;
+			}
+
+			const queued_packet* f = queues[i]->front();
+			if (nullptr != f && f->seq < next_seq_found)
+			{
+				next_seq_found = f->seq;
+				next_ind = static_cast<int>(i);
+			}
+		}
+
+		if (-1 != next_ind)
+		{
+			return internal_pop(next_ind);
+		}
+
+		if (internal_check_finished())
+		{
+			// Packets may have been queued right before it finished. Check again.
+			if (published != published_seq.load(std::memory_order_acquire))
+			{
+				continue;
+			}
+
+			eof_reached = true;
+			return packet(false);
+		}
+
+		// Wait for the reader.
+		reader_events.wait(events, std::memory_order_acquire);
+	}
+}
+
+ff::packet ff::async_demuxer::demux_next_packet(int stream_ind)
+{
+	if (stream_ind < 0 || stream_ind >= static_cast<int>(queues.size()) || nullptr == queues[stream_ind])
+	{
+		throw std::out_of_range("The stream is not read.");
+	}
+
+	while (true)
+	{
+		const uint32_t events = reader_events.load(std::memory_order_acquire);
+
+		if (nullptr != queues[stream_ind]->front())
+		{
+			return internal_pop(stream_ind);
+		}
+
+		if (internal_check_finished())
+		{
+			// Packets may have been queued right before it finished. Check again.
+			if (nullptr != queues[stream_ind]->front())
+			{
+				continue;
+			}
+
+			return packet(false);
+		}
+
+		// Wait for the reader.
+		reader_events.wait(events, std::memory_order_acquire);
+	}
+}
+
+void ff::async_demuxer::seek(int stream_ind, int64_t timestamp, bool direction)
+{
+	if (stream_ind < 0 || stream_ind >= dem.num_streams())
+	{
+		throw std::out_of_range("Stream index is out of range.");
+	}
+
+	pause_reader();
+
+	// Now it's safe to touch everything.
+	// Discard everything read ahead.
+	for (auto& q : queues)
+	{
+		if (nullptr == q)
+		{
+			continue;
+		}
+
+		while (nullptr != q->front())
+		{
+			q->pop();
+		}
+	}
+	num_queued_bytes.store(0, std::memory_order_relaxed);
+	reader_finished.store(false, std::memory_order_relaxed);
+	reader_error = nullptr;
+	eof_reached = false;
+
+	try
+	{
+		dem.seek(stream_ind, timestamp, direction);
+	}
+	catch (...)
+	{
+		resume_reader();
+		throw;
+	}
+
+	resume_reader();
+}
+
+size_t ff::async_demuxer::queued_packets(int stream_ind) const
+{
+	if (stream_ind < 0 || stream_ind >= static_cast<int>(queues.size()))
+	{
+		throw std::out_of_range("Stream index is out of range.");
+	}
+
+	return nullptr == queues[stream_ind] ? 0 : queues[stream_ind]->size();
+}
+
+void ff::async_demuxer::reader_loop() noexcept
+{
+	while (true)
+	{
+		if (READER_RUN != reader_control.load(std::memory_order_acquire))
+		{
+			std::unique_lock<std::mutex> lock(ctl_mtx);
+			if (READER_STOP == reader_control.load(std::memory_order_relaxed))
+			{
+				return;
+			}
+
+			// Paused. Tell the consumer it's safe now.
+			reader_paused = true;
+			ctl_cv.notify_all();
+			ctl_cv.wait(lock, [this] { return READER_PAUSE != reader_control.load(std::memory_order_relaxed); });
+			reader_paused = false;
+			continue;
+		}
+
+		if (reader_finished.load(std::memory_order_relaxed))
+		{
+			// Nothing to do until a seek or the destructor.
+			std::unique_lock<std::mutex> lock(ctl_mtx);
+			ctl_cv.wait(lock, [this] { return READER_RUN != reader_control.load(std::memory_order_relaxed); });
+			continue;
+		}
+
+		packet pkt;
+		try
+		{
+			if (!dem.demux_next_packet(pkt))
+			{
+				// EOF
+				reader_finished.store(true, std::memory_order_release);
+				notify(reader_events);
+				continue;
+			}
+		}
+		catch (...)
+		{
+			reader_error = std::current_exception();
+			reader_finished.store(true, std::memory_order_release);
+			notify(reader_events);
+			continue;
+		}
+
+		const int ind = pkt->stream_index;
+		if (ind < 0 || ind >= static_cast<int>(queues.size()) || nullptr == queues[ind])
+		{
+			// Not read.
+			continue;
+		}
+
+		reader_push(std::move(pkt));
+	}
+}
+
+bool ff::async_demuxer::reader_push(packet&& pkt)
+{
+	queued_packet qp;
+	qp.size = static_cast<size_t>(pkt->size);
+	qp.seq = next_seq;
+	const int ind = pkt->stream_index;
+	qp.pkt = std::move(pkt);
+
+	if (nullptr != budget.memory)
+	{
+		// Held back by whatever else is charged to it, too, so wait on it rather than on the consumer.
+		qp.charge = budget.memory->acquire
+		(
+			qp.pkt.memory_size(),
+			[this] { return READER_RUN != reader_control.load(std::memory_order_acquire); }
+		);
+		if (qp.charge.empty())
+		{
+			return false;
+		}
+	}
+
+	auto& q = *queues[ind];
+	while (true)
+	{
+		const uint32_t events = consumer_events.load(std::memory_order_acquire);
+		if (READER_RUN != reader_control.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		const size_t bytes = num_queued_bytes.load(std::memory_order_relaxed);
+		const bool bytes_ok = 0 == bytes || bytes + qp.size <= budget.max_bytes;
+		if (bytes_ok)
+		{
+			// Count it first, so that the consumer never sees a negative count.
+			num_queued_bytes.fetch_add(qp.size, std::memory_order_relaxed);
+			const size_t size = qp.size;
+			if (q.try_push(std::move(qp)))
+			{
+				++next_seq;
+				published_seq.store(next_seq, std::memory_order_release);
+				notify(reader_events);
+				return true;
+			}
+			num_queued_bytes.fetch_sub(size, std::memory_order_relaxed);
+		}
+
+		// Wait for the consumer to take some out.
+		consumer_events.wait(events, std::memory_order_acquire);
+	}
+}
+
+void ff::async_demuxer::pause_reader()
+{
+	internal_control_reader(READER_PAUSE);
+
+	std::unique_lock<std::mutex> lock(ctl_mtx);
+	ctl_cv.wait(lock, [this] { return reader_paused; });
+}
+
+void ff::async_demuxer::resume_reader()
+{
+	internal_control_reader(READER_RUN);
+}
+
+void ff::async_demuxer::internal_control_reader(reader_controls control)
+{
+	{
+		std::lock_guard<std::mutex> lock(ctl_mtx);
+		reader_control.store(control, std::memory_order_release);
+	}
+	ctl_cv.notify_all();
+	// In case it's waiting for room.
+	notify(consumer_events);
+	if (nullptr != budget.memory)
+	{
+		memory_budget::wake_waiters();
+	}
+}
+
+ff::packet ff::async_demuxer::internal_pop(int stream_ind)
+{
+	auto& q = *queues[stream_ind];
+	queued_packet* f = q.front();
+	FF_ASSERT(nullptr != f, "Should only pop a non-empty queue.");
+
+	packet pkt = std::move(f->pkt);
+	const size_t size = f->size;
+	q.pop();
+
+	num_queued_bytes.fetch_sub(size, std::memory_order_relaxed);
+	notify(consumer_events);
+
+	return pkt;
+}
+
+bool ff::async_demuxer::internal_check_finished()
+{
+	if (!reader_finished.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	if (nullptr != reader_error)
+	{
+		// Only throw it once.
+		auto e = reader_error;
+		reader_error = nullptr;
+		std::rethrow_exception(e);
+	}
+
+	return true;
+}
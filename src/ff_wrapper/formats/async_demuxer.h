@@ -0,0 +1,282 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/dict.h"
+#include "../util/spsc_queue.h"
+#include "../util/memory_budget.h"
+#include "../data/packet.h"
+#include "demuxer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* How much the reader may read ahead.
+	* The reader waits when either limit is reached.
+	*/
+	struct async_read_ahead_budget
+	{
+		// At most how many packets of a stream can be queued.
+		size_t max_packets_per_stream = 512;
+		// At most how many bytes of payloads of all streams can be queued.
+		// Even so, one packet is always allowed so that a huge one doesn't stop the reader forever.
+		size_t max_bytes = 64 * 1024 * 1024;
+		// If not nullptr, the queued packets are also charged to it,
+		// and the reader waits while it is at its hard cap (see memory_budget). It must outlive the demuxer.
+		memory_budget* memory = nullptr;
+	};
+
+	/*
+	* A demuxer that reads ahead on a background thread,
+	* so that slow reads (e.g. from network file systems) overlap with your decoding.
+	* 
+	* The reader thread demuxes packets into a bounded lock-free queue per stream,
+	* until the budget (see read_ahead_budget) is used up, and continues as you take packets out.
+	* 
+	* Take packets out by either:
+	*	1. demux_next_packet(), which gives you packets in the order they are stored in the file,
+	*	just like demuxer::demux_next_packet(), or
+	*	2. demux_next_packet(stream_ind), which gives you the next packet of a stream.
+	*	If you do this, keep taking packets of all the streams you read,
+	*	or the reader will stop when the queue of the stream you don't take from is full.
+	*	Pass only the streams you need to the constructor.
+	* 
+	* Use seek() to seek. It stops the reader, discards everything read ahead, seeks, and restarts the reader.
+	* 
+	* Errors the reader thread runs into are thrown to you from demux_next_packet() 
+	* after you have taken all the packets read before them.
+	* 
+	* You may only call the methods from one thread at a time.
+	* The streams (get_demuxer().get_stream() etc.) can be read at any time.
+	* 
+	* Invariants:
+	*	The reader thread is running until the destructor,
+	*	and it's the only one that demuxes from dem, except during seek(), when it's paused.
+	*/
+	class FF_WRAPPER_API async_demuxer final
+	{
+	public:
+		using read_ahead_budget = async_read_ahead_budget;
+
+	public:
+		async_demuxer() = delete;
+
+		/*
+		* Opens a local multimedia file pointed to by path and starts reading ahead.
+		* 
+		* @param file_path the absolute path to the multimedia file.
+		* @param budget how much the reader may read ahead.
+		* @param stream_indices the streams to read. Packets of the others are discarded.
+		* Empty to read all.
+		* @param probe_stream_info see demuxer::demuxer().
+		* @param options see demuxer::demuxer().
+		* @throws std::invalid_argument if budget.max_packets_per_stream or budget.max_bytes is 0.
+		* @throws std::out_of_range if any of stream_indices is out of range.
+		* @throws std::filesystem::filesystem_error if file not found.
+		*/
+		explicit async_demuxer
+		(
+			const std::filesystem::path& file_path,
+			const read_ahead_budget& budget = read_ahead_budget(),
+			const std::vector<int>& stream_indices = std::vector<int>(),
+			bool probe_stream_info = true,
+			const dict& options = dict()
+		);
+
+		// The reader thread refers to this.
+		async_demuxer(const async_demuxer&) = delete;
+		async_demuxer& operator=(const async_demuxer&) = delete;
+
+		/*
+		* Stops the reader thread and releases everything read ahead.
+		*/
+		~async_demuxer() noexcept;
+
+	public:
+		/*
+		* Takes out the next packet, in the order they are stored in the file.
+		* Waits for the reader if it has not read one yet.
+		* 
+		* @returns the packet, or a DESTROYED packet if eof has been reached.
+		* Since then, eof() remains true until you seek().
+		* @throws what demuxer::demux_next_packet() throws, if the reader ran into an error.
+		*/
+		packet demux_next_packet();
+
+		/*
+		* Takes out the next packet of a stream.
+		* Waits for the reader if it has not read one yet.
+		* 
+		* @returns the packet, or a DESTROYED packet if there is no more packet of the stream.
+		* @throws std::out_of_range if the stream is not read.
+		* @throws what demuxer::demux_next_packet() throws, if the reader ran into an error.
+		*/
+		packet demux_next_packet(int stream_ind);
+
+		/*
+		* Discards everything read ahead and seeks. See demuxer::seek().
+		* The reader starts reading from the new position afterwards, even if the seek fails.
+		* 
+		* @throws std::out_of_range if stream ind is wrong
+		*/
+		void seek(int stream_ind, int64_t timestamp, bool direction = true);
+
+		/*
+		* @returns true iff demux_next_packet() has returned a DESTROYED packet for eof.
+		*/
+		bool eof() const noexcept { return eof_reached; }
+
+		/*
+		* @returns how many packets of the stream are read ahead now. 0 if the stream is not read.
+		* @throws std::out_of_range if stream ind is wrong
+		*/
+		size_t queued_packets(int stream_ind) const;
+
+		/*
+		* @returns how many bytes of payloads are read ahead now.
+		*/
+		size_t queued_bytes() const noexcept { return num_queued_bytes.load(std::memory_order_relaxed); }
+
+		/*
+		* @returns the demuxer. Only to read the information of the file (e.g. its streams).
+		* Don't demux or seek with it.
+		*/
+		const demuxer& get_demuxer() const noexcept { return dem; }
+
+	private:
+		/*
+		* What a queue holds.
+		*/
+		struct queued_packet
+		{
+			// Declared so that spsc_queue can check it inside this class.
+			queued_packet() noexcept : seq(0), size(0) {}
+
+			packet pkt;
+			// Its order in the file (since the reader started).
+			uint64_t seq;
+			// Its payload's size.
+			size_t size;
+			// Empty if budget.memory is nullptr.
+			memory_budget::charge charge;
+		};
+
+
+		// What the reader thread should do.
+		enum reader_controls : int
+		{
+			READER_RUN,
+			READER_PAUSE,
+			READER_STOP
+		};
+
+	private:
+		/*
+		* What the reader thread runs.
+		*/
+		void reader_loop() noexcept;
+
+		/*
+		* Called by the reader thread.
+		* Waits until pkt can be queued and queues it.
+		* 
+		* @returns false if the reader is asked to pause or stop before it can be queued. Then pkt is discarded.
+		*/
+		bool reader_push(packet&& pkt);
+
+		/*
+		* Pauses the reader thread and waits until it acknowledges.
+		*/
+		void pause_reader();
+
+		/*
+		* Lets a paused reader thread run again.
+		*/
+		void resume_reader();
+
+		/*
+		* Sets reader_control and wakes up the reader wherever it waits.
+		*/
+		void internal_control_reader(reader_controls control);
+
+		/*
+		* Pops the front of the stream's queue.
+		*/
+		packet internal_pop(int stream_ind);
+
+		/*
+		* Called when there is no packet to take out.
+		* 
+		* @returns true if the reader has finished, so that there will be none.
+		* Rethrows the reader's error, if any.
+		*/
+		bool internal_check_finished();
+
+		// Bumps events and wakes up who's waiting for it.
+		static void notify(std::atomic<uint32_t>& events) noexcept
+		{
+			events.fetch_add(1, std::memory_order_release);
+			events.notify_all();
+		}
+
+	private:
+		demuxer dem;
+		read_ahead_budget budget;
+
+		// One per stream. nullptr for streams not read.
+		std::vector<std::unique_ptr<spsc_queue<queued_packet>>> queues;
+
+		std::atomic<size_t> num_queued_bytes = 0;
+		// 1 + the seq of the last packet queued.
+		// Packets with smaller seqs are all visible in the queues after you load it.
+		std::atomic<uint64_t> published_seq = 0;
+
+		// Bumped by the reader whenever it queues a packet or finishes.
+		std::atomic<uint32_t> reader_events = 0;
+		// Bumped by the consumer whenever it takes a packet out or changes reader_control.
+		std::atomic<uint32_t> consumer_events = 0;
+
+		// Controlling the reader is rare, so a mutex is fine.
+		// reader_control is only written with ctl_mtx locked, but the reader checks it without locking.
+		std::mutex ctl_mtx;
+		std::condition_variable ctl_cv;
+		std::atomic<int> reader_control = READER_RUN;
+		// Guarded by ctl_mtx.
+		bool reader_paused = false;
+		// Set by the reader at eof or error.
+		std::atomic<bool> reader_finished = false;
+		// Written by the reader before it sets reader_finished.
+		std::exception_ptr reader_error;
+
+		// Only used by the reader.
+		uint64_t next_seq = 0;
+
+		bool eof_reached = false;
+
+		// Started last in the constructor.
+		std::thread reader;
+	};
+}
@@ -0,0 +1,275 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "custom_io.h"
+
+extern "C"
+{
+#include <libavformat/avio.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#include <algorithm>
+#include <cstdio> // For SEEK_SET etc
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	// The callbacks FFmpeg calls. opaque is the custom_io.
+	// Nothing may be thrown into FFmpeg's C code.
+
+	int read_callback(void* opaque, uint8_t* buf, int buf_size) noexcept
+	{
+		try
+		{
+			int ret = static_cast<ff::custom_io*>(opaque)->read(buf, buf_size);
+			// FFmpeg wants AVERROR_EOF instead of 0 at the end.
+			return 0 == ret ? AVERROR_EOF : ret;
+		}
+		catch (...)
+		{
+			return AVERROR(EIO);
+		}
+	}
+
+	int write_callback(void* opaque, uint8_t* buf, int buf_size) noexcept
+	{
+		try
+		{
+			return static_cast<ff::custom_io*>(opaque)->write(buf, buf_size);
+		}
+		catch (...)
+		{
+			return AVERROR(EIO);
+		}
+	}
+
+	int64_t seek_callback(void* opaque, int64_t offset, int whence) noexcept
+	{
+		try
+		{
+			// FFmpeg may OR AVSEEK_FORCE into whence, which is only a hint.
+			return static_cast<ff::custom_io*>(opaque)->seek(offset, whence & ~AVSEEK_FORCE);
+		}
+		catch (...)
+		{
+			return AVERROR(EIO);
+		}
+	}
+}
+
+ff::custom_io::custom_io(int buffer_size)
+	: buf_size(buffer_size)
+{
+	if (buffer_size <= 0)
+	{
+		throw std::invalid_argument("The buffer size must be positive.");
+	}
+}
+
+int ff::custom_io::read(uint8_t*, int)
+{
+	return AVERROR(ENOSYS);
+}
+
+int ff::custom_io::write(const uint8_t*, int)
+{
+	return AVERROR(ENOSYS);
+}
+
+int64_t ff::custom_io::seek(int64_t, int)
+{
+	return AVERROR(ENOSYS);
+}
+
+::AVIOContext* ff::custom_io::create_av_io_context(bool write_flag)
+{
+	// FFmpeg may reallocate the buffer, so it must be allocated by av_malloc().
+	auto* buffer = static_cast<unsigned char*>(av_malloc(buf_size));
+	if (nullptr == buffer)
+	{
+		throw std::bad_alloc();
+	}
+
+	AVIOContext* ret = avio_alloc_context
+	(
+		buffer, buf_size, write_flag ? 1 : 0, this,
+		write_flag ? nullptr : &read_callback,
+		write_flag ? &write_callback : nullptr,
+		// Without a seek function, FFmpeg knows it cannot seek.
+		seekable() ? &seek_callback : nullptr
+	);
+	if (nullptr == ret)
+	{
+		av_free(buffer);
+		throw std::bad_alloc();
+	}
+
+	return ret;
+}
+
+void ff::custom_io::free_av_io_context(::AVIOContext** ppioc) noexcept
+{
+	if (nullptr == *ppioc)
+	{
+		return;
+	}
+
+	// The buffer may not be the one I allocated now.
+	av_freep(&(*ppioc)->buffer);
+	avio_context_free(ppioc);
+}
+
+////////////////////////// memory_io //////////////////////////
+
+ff::memory_io::memory_io(int buffer_size)
+	: custom_io(buffer_size)
+{
+}
+
+ff::memory_io::memory_io(std::vector<uint8_t> bytes, int buffer_size)
+	: custom_io(buffer_size), owned(std::move(bytes))
+{
+}
+
+ff::memory_io::memory_io(const uint8_t* bytes, size_t size, int buffer_size)
+	: custom_io(buffer_size), p_ref(bytes), ref_size(size), referencing(true)
+{
+	if (nullptr == bytes && 0 != size)
+	{
+		throw std::invalid_argument("bytes cannot be nullptr unless size is 0.");
+	}
+}
+
+int ff::memory_io::read(uint8_t* buf, int size)
+{
+	const size_t total = this->size();
+	if (pos >= total)
+	{
+		return 0;
+	}
+
+	const size_t n = std::min(static_cast<size_t>(std::max(size, 0)), total - pos);
+	std::memcpy(buf, data() + pos, n);
+	pos += n;
+
+	return static_cast<int>(n);
+}
+
+int ff::memory_io::write(const uint8_t* buf, int size)
+{
+	if (referencing)
+	{
+		return AVERROR(EPERM);
+	}
+	if (size <= 0)
+	{
+		return 0;
+	}
+
+	if (pos + size > owned.size())
+	{
+		owned.resize(pos + size);
+	}
+	std::memcpy(owned.data() + pos, buf, size);
+	pos += size;
+
+	return size;
+}
+
+int64_t ff::memory_io::seek(int64_t offset, int whence)
+{
+	const int64_t total = static_cast<int64_t>(size());
+
+	int64_t new_pos = 0;
+	switch (whence)
+	{
+	case AVSEEK_SIZE:
+		return total;
+	case SEEK_SET:
+		new_pos = offset;
+		break;
+	case SEEK_CUR:
+		new_pos = static_cast<int64_t>(pos) + offset;
+		break;
+	case SEEK_END:
+		new_pos = total + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	// Only writing can go past the end, which fills the gap with zeros.
+	if (new_pos < 0 || (referencing && new_pos > total))
+	{
+		return AVERROR(EINVAL);
+	}
+
+	pos = static_cast<size_t>(new_pos);
+	return new_pos;
+}
+
+std::vector<uint8_t> ff::memory_io::take_data()
+{
+	std::vector<uint8_t> ret;
+	if (referencing)
+	{
+		ret.assign(p_ref, p_ref + ref_size);
+		p_ref = nullptr;
+		ref_size = 0;
+		referencing = false;
+	}
+	else
+	{
+		ret = std::move(owned);
+		owned.clear();
+	}
+	pos = 0;
+
+	return ret;
+}
+
+////////////////////////// callback_io //////////////////////////
+
+ff::callback_io::callback_io
+(
+	read_function read_fn, write_function write_fn,
+	seek_function seek_fn, int buffer_size
+)
+	: custom_io(buffer_size),
+	read_fn(std::move(read_fn)), write_fn(std::move(write_fn)), seek_fn(std::move(seek_fn))
+{
+	if (!this->read_fn && !this->write_fn)
+	{
+		throw std::invalid_argument("At least one of the read and write callbacks must be given.");
+	}
+}
+
+int ff::callback_io::read(uint8_t* buf, int size)
+{
+	return read_fn ? read_fn(buf, size) : custom_io::read(buf, size);
+}
+
+int ff::callback_io::write(const uint8_t* buf, int size)
+{
+	return write_fn ? write_fn(buf, size) : custom_io::write(buf, size);
+}
+
+int64_t ff::callback_io::seek(int64_t offset, int whence)
+{
+	return seek_fn ? seek_fn(offset, whence) : custom_io::seek(offset, whence);
+}
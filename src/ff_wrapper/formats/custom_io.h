@@ -0,0 +1,211 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains custom_io, the interface through which a demuxer can read and a muxer can write
+* something other than a local file, and some implementations of it.
+*/
+
+#include "../util/util.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct AVIOContext;
+
+namespace ff
+{
+	/*
+	* What a demuxer reads from or a muxer writes to, instead of a local file.
+	* Derive from it and override what's needed: read() for demuxers, write() for muxers,
+	* and seek() (with seekable()) if it can seek. Many formats need seeking (e.g. MP4 for both).
+	* For plain callbacks, use callback_io.
+	* 
+	* A custom_io is referenced by the demuxer or muxer and must outlive it.
+	* Only one demuxer or muxer may use a custom_io at a time.
+	* 
+	* The methods are called from FFmpeg's C code, so they must not throw.
+	* If one does, the exception is swallowed and FFmpeg sees an I/O error.
+	*/
+	class FF_WRAPPER_API custom_io
+	{
+	public:
+		static constexpr int default_buffer_size = 32 * 1024;
+
+		/*
+		* @param buffer_size how many bytes FFmpeg buffers between calls to read() or write().
+		* @throws std::invalid_argument if buffer_size <= 0.
+		*/
+		explicit custom_io(int buffer_size = default_buffer_size);
+
+		virtual ~custom_io() noexcept = default;
+
+		// Demuxers and muxers reference it.
+		custom_io(const custom_io&) = delete;
+		custom_io& operator=(const custom_io&) = delete;
+
+	public:
+		/*
+		* Reads at most size bytes into buf.
+		* By default, it cannot read.
+		* 
+		* @returns the number of bytes read, 0 at the end,
+		* or a negative AVERROR code on error.
+		*/
+		virtual int read(uint8_t* buf, int size);
+
+		/*
+		* Writes size bytes from buf.
+		* By default, it cannot write.
+		* 
+		* @returns the number of bytes written or a negative AVERROR code on error.
+		*/
+		virtual int write(const uint8_t* buf, int size);
+
+		/*
+		* Seeks like fseek(), with whence being SEEK_SET, SEEK_CUR, or SEEK_END.
+		* FFmpeg may also give AVSEEK_SIZE, to which it should return the size without seeking,
+		* or a negative value if unknown.
+		* By default, it cannot seek. If you override it, also override seekable().
+		* 
+		* @returns the new position, or a negative AVERROR code on error.
+		*/
+		virtual int64_t seek(int64_t offset, int whence);
+
+		/*
+		* @returns true iff seek() works.
+		*/
+		virtual bool seekable() const noexcept { return false; }
+
+		int buffer_size() const noexcept { return buf_size; }
+
+	private:
+		friend class demuxer;
+		friend class muxer;
+
+		/*
+		* Creates an AVIOContext that reads or writes through this.
+		* 
+		* @param write_flag true for writing (muxers), false for reading (demuxers).
+		* @returns the context. Free it with free_av_io_context().
+		*/
+		::AVIOContext* create_av_io_context(bool write_flag);
+
+		/*
+		* Frees a context created by create_av_io_context() and its buffer,
+		* and sets *ppioc to nullptr. Does nothing if *ppioc is nullptr.
+		*/
+		static void free_av_io_context(::AVIOContext** ppioc) noexcept;
+
+	private:
+		int buf_size;
+	};
+
+	/*
+	* Reads from or writes to bytes in memory.
+	* 
+	* For demuxing, give it the bytes (it either takes them or references them).
+	* For muxing, create an empty one and get the bytes with data() or take_data() after finalizing the muxer.
+	* It can always seek.
+	*/
+	class FF_WRAPPER_API memory_io final : public custom_io
+	{
+	public:
+		/*
+		* Starts empty, for writing.
+		*/
+		explicit memory_io(int buffer_size = default_buffer_size);
+
+		/*
+		* Reads from, and can write over, bytes it takes.
+		*/
+		explicit memory_io(std::vector<uint8_t> bytes, int buffer_size = default_buffer_size);
+
+		/*
+		* Reads from bytes it references, which must outlive it.
+		* It cannot write to them.
+		* 
+		* @throws std::invalid_argument if bytes is nullptr but size is not 0.
+		*/
+		memory_io(const uint8_t* bytes, size_t size, int buffer_size = default_buffer_size);
+
+	public:
+		int read(uint8_t* buf, int size) override;
+		/*
+		* Writes at the current position, growing the bytes when needed.
+		* Gives AVERROR(EPERM) if it references the bytes.
+		*/
+		int write(const uint8_t* buf, int size) override;
+		int64_t seek(int64_t offset, int whence) override;
+		bool seekable() const noexcept override { return true; }
+
+	public:
+		const uint8_t* data() const noexcept { return referencing ? p_ref : owned.data(); }
+		size_t size() const noexcept { return referencing ? ref_size : owned.size(); }
+
+		/*
+		* @returns the bytes, moved out if it owns them, or a copy if it references them.
+		* Afterwards, it's empty and at position 0.
+		*/
+		std::vector<uint8_t> take_data();
+
+	private:
+		std::vector<uint8_t> owned;
+
+		const uint8_t* p_ref = nullptr;
+		size_t ref_size = 0;
+		bool referencing = false;
+
+		size_t pos = 0;
+	};
+
+	/*
+	* Reads and writes through the callbacks given to it.
+	* Give those it doesn't need as empty. The callbacks must not throw.
+	*/
+	class FF_WRAPPER_API callback_io final : public custom_io
+	{
+	public:
+		using read_function = std::function<int(uint8_t* buf, int size)>;
+		using write_function = std::function<int(const uint8_t* buf, int size)>;
+		using seek_function = std::function<int64_t(int64_t offset, int whence)>;
+
+		/*
+		* See custom_io's methods for what each callback does.
+		* 
+		* @throws std::invalid_argument if both read_fn and write_fn are empty.
+		*/
+		callback_io
+		(
+			read_function read_fn, write_function write_fn = write_function(),
+			seek_function seek_fn = seek_function(), int buffer_size = default_buffer_size
+		);
+
+	public:
+		int read(uint8_t* buf, int size) override;
+		int write(const uint8_t* buf, int size) override;
+		int64_t seek(int64_t offset, int whence) override;
+		bool seekable() const noexcept override { return static_cast<bool>(seek_fn); }
+
+	private:
+		read_function read_fn;
+		write_function write_fn;
+		seek_function seek_fn;
+	};
+}
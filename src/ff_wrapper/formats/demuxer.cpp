@@ -17,8 +17,13 @@
 #include "demuxer.h"
 
 #include "../util/ff_helpers.h"
+#include "../data/packet_pool.h"
+#include "stream_info_cache.h"
+#include "custom_io.h"
 
 #include <filesystem>
+#include <algorithm>
+#include <iterator> // For std::prev
 using filesystem_error = std::filesystem::filesystem_error;
 
 extern "C"
@@ -77,9 +82,117 @@ ff::demuxer::demuxer(const std::filesystem::path& path, dict& options, bool prob
 	p_demuxer_desc = p_fmt_ctx->iformat;
 }
 
+ff::demuxer::demuxer(const std::filesystem::path& path, const cached_file_info& info, const dict& options)
+	: media_base(nullptr)
+{
+	const std::string path_str(path.generic_string());
+
+	if (path.empty())
+	{
+		throw std::invalid_argument("Path cannot be empty");
+	}
+
+	// Open the file, without probing
+	if (options.empty())
+	{
+		internal_open_format(path_str, false, nullptr);
+	}
+	else
+	{
+		// make a copy lest the dict be changed.
+		dict cpy(options);
+		auto* cpy_avd = cpy.get_av_dict();
+		internal_open_format(path_str, false, &cpy_avd);
+	}
+
+	// Post creation. Set other fields.
+	p_demuxer_desc = p_fmt_ctx->iformat;
+
+	try
+	{
+		// Instead, fill in what was probed before.
+		stream_info_cache::apply(info, p_fmt_ctx);
+		// The streams may be of other types now.
+		internal_register_streams();
+
+		if (!info.index.empty())
+		{
+			load_keyframe_index(info.index);
+		}
+	}
+	catch (...)
+	{
+		// The destructor will not be called.
+		ffhelpers::safely_close_input_format_context(&p_fmt_ctx);
+		throw;
+	}
+}
+
+ff::demuxer::demuxer(custom_io& io, bool probe_stream_info, const dict& options, const std::string& fmt_name)
+	: media_base(nullptr)
+{
+	const AVInputFormat* fmt = nullptr;
+	if (!fmt_name.empty())
+	{
+		fmt = av_find_input_format(fmt_name.c_str());
+		if (nullptr == fmt)
+		{
+			throw std::invalid_argument("No input format has the name.");
+		}
+	}
+
+	p_fmt_ctx = avformat_alloc_context();
+	if (nullptr == p_fmt_ctx)
+	{
+		throw std::bad_alloc();
+	}
+
+	try
+	{
+		p_custom_avio = io.create_av_io_context(false);
+	}
+	catch (...)
+	{
+		ffhelpers::safely_free_format_context(&p_fmt_ctx);
+		throw;
+	}
+	// Tell FFmpeg not to close the pb, as it's mine.
+	p_fmt_ctx->pb = p_custom_avio;
+	p_fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	try
+	{
+		// There is no path.
+		if (options.empty())
+		{
+			internal_open_format("", probe_stream_info, nullptr, fmt);
+		}
+		else
+		{
+			// make a copy lest the dict be changed.
+			dict cpy(options);
+			auto* cpy_avd = cpy.get_av_dict();
+			internal_open_format("", probe_stream_info, &cpy_avd, fmt);
+		}
+	}
+	catch (...)
+	{
+		// The destructor will not be called.
+		// avformat_open_input() frees the fmt ctx on failure, but the probing does not.
+		ffhelpers::safely_close_input_format_context(&p_fmt_ctx);
+		custom_io::free_av_io_context(&p_custom_avio);
+		throw;
+	}
+
+	// Post creation. Set other fields.
+	p_demuxer_desc = p_fmt_ctx->iformat;
+}
+
 ff::demuxer::~demuxer()
 {
 	ffhelpers::safely_close_input_format_context(&p_fmt_ctx);
+	// Does nothing if it reads a local file.
+	custom_io::free_av_io_context(&p_custom_avio);
 }
 
 void ff::demuxer::probe_stream_information(const dict& options)
@@ -165,6 +278,19 @@ bool ff::demuxer::demux_next_packet(packet& pkt)
 	return ret;
 }
 
+ff::packet ff::demuxer::demux_next_packet(packet_pool& pool)
+{
+	packet pkt = pool.get_packet();
+	if (demux_next_packet(pkt))
+	{
+		return pkt;
+	}
+
+	// EOF. Give the packet back.
+	pool.recycle(pkt);
+	return packet(false);
+}
+
 void ff::demuxer::seek(int stream_ind, int64_t timestamp, bool direction)
 {
 	FF_ASSERT(p_fmt_ctx != nullptr, "Must be ready after construction.");
@@ -205,9 +331,269 @@ void ff::demuxer::seek(int stream_ind, int64_t timestamp, bool direction)
 	}
 }
 
-void ff::demuxer::internal_open_format(const std::string& path, bool probe_stream_info, ::AVDictionary** dict)
+void ff::demuxer::set_discard(int stream_ind, AVDiscard level)
+{
+	if (stream_ind < 0 || stream_ind >= num_streams())
+	{
+		throw std::out_of_range("Stream index out of range.");
+	}
+
+	p_fmt_ctx->streams[stream_ind]->discard = level;
+}
+
+AVDiscard ff::demuxer::get_discard(int stream_ind) const
+{
+	if (stream_ind < 0 || stream_ind >= num_streams())
+	{
+		throw std::out_of_range("Stream index out of range.");
+	}
+
+	return p_fmt_ctx->streams[stream_ind]->discard;
+}
+
+void ff::demuxer::select_streams(const std::vector<int>& stream_inds, bool probe, const dict& options)
+{
+	if (stream_inds.empty())
+	{
+		throw std::invalid_argument("Select at least one stream.");
+	}
+	// Check all first, so that a wrong one doesn't leave the levels half changed.
+	for (int ind : stream_inds)
+	{
+		if (ind < 0 || ind >= num_streams())
+		{
+			throw std::out_of_range("Stream index out of range.");
+		}
+	}
+
+	const int num_before = num_streams();
+	for (int i = 0; i < num_before; ++i)
+	{
+		auto* st = p_fmt_ctx->streams[i];
+		if (std::find(stream_inds.begin(), stream_inds.end(), i) == stream_inds.end())
+		{
+			st->discard = AVDISCARD_ALL;
+		}
+		else if (st->discard >= AVDISCARD_ALL)
+		{
+			st->discard = AVDISCARD_DEFAULT;
+		}
+	}
+
+	if (probe)
+	{
+		probe_stream_information(options);
+
+		// Nobody selected what probing found.
+		for (int i = num_before; i < num_streams(); ++i)
+		{
+			p_fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+		}
+	}
+}
+
+void ff::demuxer::select_streams_by_type(int video_i, int audio_i, int subtitle_i, bool probe, const dict& options)
+{
+	if (-1 == video_i && -1 == audio_i && -1 == subtitle_i)
+	{
+		throw std::invalid_argument("Select at least one stream.");
+	}
+
+	std::vector<int> inds;
+	if (-1 != video_i)
+	{
+		inds.push_back(get_video_ind(video_i));
+	}
+	if (-1 != audio_i)
+	{
+		inds.push_back(get_audio_ind(audio_i));
+	}
+	if (-1 != subtitle_i)
+	{
+		inds.push_back(get_subtitle_ind(subtitle_i));
+	}
+
+	select_streams(inds, probe, options);
+}
+
+void ff::demuxer::select_all_streams() noexcept
+{
+	for (unsigned i = 0; i < p_fmt_ctx->nb_streams; ++i)
+	{
+		p_fmt_ctx->streams[i]->discard = AVDISCARD_DEFAULT;
+	}
+}
+
+namespace
+{
+	// pts may be missing in some containers. Then dts is the best guess.
+	int64_t pts_of(const ff::demuxer::index_entry& e) noexcept
+	{
+		return AV_NOPTS_VALUE != e.pts ? e.pts : e.dts;
+	}
+}
+
+void ff::demuxer::build_keyframe_index()
+{
+	FF_ASSERT(p_fmt_ctx != nullptr, "Must be ready after construction.");
+
+	keyframe_index index(p_fmt_ctx->nb_streams);
+
+	// Every packet has to be indexed, so lift the discard levels meanwhile.
+	std::vector<AVDiscard> levels(p_fmt_ctx->nb_streams);
+	for (unsigned i = 0; i < p_fmt_ctx->nb_streams; ++i)
+	{
+		levels[i] = p_fmt_ctx->streams[i]->discard;
+		p_fmt_ctx->streams[i]->discard = AVDISCARD_DEFAULT;
+	}
+	auto restore_levels = [&]() noexcept
+	{
+		for (unsigned i = 0; i < p_fmt_ctx->nb_streams; ++i)
+		{
+			p_fmt_ctx->streams[i]->discard = levels[i];
+		}
+	};
+
+	try
+	{
+		// Start from the start, wherever the demuxer is now.
+		seek_to_start();
+
+		packet pkt;
+		while (demux_next_packet(pkt))
+		{
+			index[pkt->stream_index].push_back
+			(
+				index_entry
+				{
+					pkt->pts, pkt->dts, pkt->pos,
+					0 != (pkt->flags & AV_PKT_FLAG_KEY)
+				}
+			);
+		}
+
+		seek_to_start();
+	}
+	catch (...)
+	{
+		restore_levels();
+		throw;
+	}
+
+	restore_levels();
+	kf_index = std::move(index);
+	internal_sort_keyframes();
+}
+
+void ff::demuxer::load_keyframe_index(keyframe_index index)
+{
+	if (index.size() != streams.size())
+	{
+		throw std::invalid_argument("The index must have one vector per stream.");
+	}
+
+	kf_index = std::move(index);
+	internal_sort_keyframes();
+}
+
+ff::demuxer::accurate_seek_result ff::demuxer::seek_accurate(int stream_ind, int64_t timestamp)
+{
+	if (!has_keyframe_index())
+	{
+		throw std::logic_error("The keyframe index has not been built or loaded.");
+	}
+	if (stream_ind < 0 || stream_ind >= num_streams())
+	{
+		throw std::out_of_range("Stream index is out of range.");
+	}
+
+	const auto& entries = kf_index[stream_ind];
+	const auto& keys = kf_sorted[stream_ind];
+	if (keys.empty())
+	{
+		throw std::invalid_argument("The stream has no keyframes.");
+	}
+
+	// The last keyframe whose pts <= timestamp, or the first one.
+	auto it = std::upper_bound
+	(
+		keys.begin(), keys.end(), timestamp,
+		[](int64_t ts, const keyframe_pos& k) { return ts < k.pts; }
+	);
+	const size_t key = keys.begin() == it ? keys.front().entry : std::prev(it)->entry;
+
+	// Count the frames to discard. Once dts >= timestamp, all later pts are, too.
+	int num_discard = 0;
+	for (size_t i = key; i < entries.size(); ++i)
+	{
+		if (AV_NOPTS_VALUE != entries[i].dts && entries[i].dts >= timestamp)
+		{
+			break;
+		}
+		if (pts_of(entries[i]) < timestamp)
+		{
+			++num_discard;
+		}
+	}
+
+	// The keyframe is exactly there, so a backward seek lands on it.
+	const auto& k = entries[key];
+	seek(stream_ind, AV_NOPTS_VALUE != k.dts ? k.dts : k.pts, false);
+
+	return accurate_seek_result{ pts_of(k), num_discard };
+}
+
+void ff::demuxer::internal_sort_keyframes()
+{
+	std::vector<std::vector<keyframe_pos>> sorted(kf_index.size());
+	for (size_t s = 0; s < kf_index.size(); ++s)
+	{
+		const auto& entries = kf_index[s];
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			if (entries[i].keyframe)
+			{
+				sorted[s].push_back(keyframe_pos{ pts_of(entries[i]), i });
+			}
+		}
+		// Stable, so that keyframes of the same pts stay in the file order.
+		std::stable_sort
+		(
+			sorted[s].begin(), sorted[s].end(),
+			[](const keyframe_pos& a, const keyframe_pos& b) { return a.pts < b.pts; }
+		);
+	}
+	kf_sorted = std::move(sorted);
+}
+
+void ff::demuxer::seek_to_start()
 {
-	int ret = avformat_open_input(&p_fmt_ctx, path.c_str(), nullptr, dict);
+	const int64_t start = AV_NOPTS_VALUE != p_fmt_ctx->start_time ? p_fmt_ctx->start_time : 0;
+
+	int ret = av_seek_frame(p_fmt_ctx, -1, start, AVSEEK_FLAG_BACKWARD);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error happened during seeking to the start", ret);
+			break;
+		}
+	}
+
+	eof_reached = false;
+}
+
+void ff::demuxer::internal_open_format
+(
+	const std::string& path, bool probe_stream_info, ::AVDictionary** dict,
+	const AVInputFormat* fmt
+)
+{
+	int ret = avformat_open_input(&p_fmt_ctx, path.c_str(), fmt, dict);
 
 	if (ret < 0)
 	{
@@ -235,6 +621,11 @@ void ff::demuxer::internal_open_format(const std::string& path, bool probe_strea
 	{
 		probe_stream_information();
 	}
+	else
+	{
+		// The streams in the header are there even without probing.
+		internal_register_streams();
+	}
 }
 
 void ff::demuxer::internal_probe_stream_info(::AVDictionary** dict)
@@ -252,6 +643,17 @@ void ff::demuxer::internal_probe_stream_info(::AVDictionary** dict)
 		}
 	}
 
+	// Probing may have found more streams.
+	internal_register_streams();
+}
+
+void ff::demuxer::internal_register_streams()
+{
+	streams.clear();
+	v_indices.clear();
+	a_indices.clear();
+	s_indices.clear();
+
 	streams.reserve(p_fmt_ctx->nb_streams);
 	for (int i = 0; i < p_fmt_ctx->nb_streams; ++i)
 	{
@@ -276,12 +678,21 @@ void ff::demuxer::internal_probe_stream_info(::AVDictionary** dict)
 
 bool ff::demuxer::internal_demux_packet(AVPacket* pkt)
 {
-	int ret = av_read_frame(p_fmt_ctx, pkt);
-	// ret=0 -> success
-	if (0 == ret)
+	int ret;
+	while (0 == (ret = av_read_frame(p_fmt_ctx, pkt)))
 	{
-		pkt->time_base = streams[pkt->stream_index]->time_base;
-		return true;
+		// ret=0 -> success, unless the packet is to be discarded.
+		const AVDiscard level = p_fmt_ctx->streams[pkt->stream_index]->discard;
+		const bool drop =
+			level >= AVDISCARD_ALL ||
+			(level >= AVDISCARD_NONINTRA && !(pkt->flags & AV_PKT_FLAG_KEY));
+		if (!drop)
+		{
+			pkt->time_base = streams[pkt->stream_index]->time_base;
+			return true;
+		}
+
+		av_packet_unref(pkt);
 	}
 	// ret<0 -> Error or EOF
 
@@ -20,10 +20,16 @@
 #include "stream.h" // A demuxer has info about all streams in a file
 #include "../data/packet.h" // A demuxer demuxes a file into packets
 
+extern "C"
+{
+#include <libavcodec/defs.h> // For AVDiscard
+}
+
 #include <string>
 #include <vector> // Streams are stored in a vector
 
 struct AVInputFormat;
+struct AVIOContext;
 namespace std
 {
 	namespace filesystem
@@ -34,17 +40,70 @@ namespace std
 
 namespace ff
 {
+	class packet_pool;
+	struct cached_file_info;
+	class custom_io;
+
 	/*
-	* Demuxer for local files.
+	* Demuxer for local files, or anything else through a custom_io (e.g. bytes in memory).
 	* 
-	* Create a useable demuxer by giving it the path to the file you want to demux.
+	* Create a useable demuxer by giving it the path to the file you want to demux,
+	* or the custom_io to read from.
 	* Then, it is ready to be used.
 	* 
 	* Demux by calling demux_next_packet() until eof().
 	* Use seek() to seek.
+	* 
+	* Accurate seeking:
+	* seek() lands on a keyframe near the timestamp, and to get the exact frame you have to decode
+	* from there and discard frames, not knowing how many, while some containers even seek by scanning.
+	* Instead, build_keyframe_index() once (or load_keyframe_index() one built before),
+	* and then seek_accurate() jumps right to the keyframe before the timestamp
+	* and tells you how many frames to discard.
+	* 
+	* Reopening:
+	* Probing the stream information, and indexing, read much of the file.
+	* To do them once per file, save what they find with stream_info_cache,
+	* and later give what it loads to the constructor that takes a cached_file_info.
+	* 
+	* Discarding:
+	* set_discard() makes me drop the packets of a stream you don't need (e.g. all of them,
+	* or all but the keyframes for thumbnails) before you ever see them.
+	* Some containers then skip reading them too.
+	* select_streams() keeps only the streams you want and drops all of the others.
 	*/
 	class FF_WRAPPER_API demuxer : public media_base
 	{
+	public:
+		/*
+		* What the keyframe index records about a packet.
+		*/
+		struct index_entry
+		{
+			// In the time base of the stream. AV_NOPTS_VALUE if unknown.
+			int64_t pts;
+			int64_t dts;
+			// The byte position in the file. -1 if unknown.
+			int64_t pos;
+			bool keyframe;
+		};
+		/*
+		* One vector per stream, each with an entry for every packet of the stream in the file order.
+		*/
+		using keyframe_index = std::vector<std::vector<index_entry>>;
+
+		/*
+		* What seek_accurate() tells you.
+		*/
+		struct accurate_seek_result
+		{
+			// The pts of the keyframe the demuxer is now at.
+			int64_t keyframe_pts;
+			// How many frames to discard after decoding from the keyframe
+			// before you get the first one at or after the timestamp.
+			int num_frames_to_discard;
+		};
+
 	public:
 		/*
 		* A demuxer must be associated with an existing local file.
@@ -88,6 +147,49 @@ namespace ff
 			bool probe_stream_info = true
 		);
 
+		/*
+		* Opens a local multimedia file pointed to by path without probing the stream information;
+		* instead, the information and the keyframe index (if it has one) are taken from info
+		* (see stream_info_cache).
+		* The demuxer will be ready after the call.
+		* 
+		* @param path the absolute path to the multimedia file.
+		* @param info what was found about the same file before. Make sure it's about the file as it is now,
+		* e.g. by loading it with stream_info_cache::load().
+		* @param options specifies how the demuxer works. Is empty by default.
+		* @throws std::invalid_argument if path is empty,
+		* or if info has a different number of streams than the file.
+		* @throws std::filesystem::filesystem_error if file not found.
+		*/
+		demuxer
+		(
+			const std::filesystem::path& path,
+			const cached_file_info& info,
+			const dict& options = dict()
+		);
+
+		/*
+		* Demuxes what is read through io instead of a local file.
+		* The demuxer will be ready after the call.
+		* 
+		* @param io what to read from. It must outlive the demuxer and can only be used by it.
+		* Seeking the demuxer requires io to be seekable.
+		* @param probe_stream_info: if set to true, then after the format is opened,
+		the ctor probes the stream information by reading and potentially decoding a few packets.
+		* @param options specifies how the demuxer works. Is empty by default.
+		* @param fmt_name optional. The short name of the input format,
+		* for formats FFmpeg cannot detect from the first bytes (e.g. raw streams).
+		* @throws std::invalid_argument if fmt_name is not empty but no input format has the name.
+		* @throws std::runtime_error if the format could not be opened.
+		*/
+		explicit demuxer
+		(
+			custom_io& io,
+			bool probe_stream_info = true,
+			const dict& options = dict(),
+			const std::string& fmt_name = ""
+		);
+
 		/*
 		* Releases all resources and sets all pointers to nullptr.
 		*/
@@ -149,6 +251,17 @@ namespace ff
 		*/
 		bool demux_next_packet(packet& pkt);
 
+		/*
+		* Demuxes a packet from the currently location in the file.
+		* The packet comes from pool, so that you can recycle() it after use.
+		* Its payload is still allocated by FFmpeg.
+		* 
+		* @returns the packet demuxed, or a DESTROYED packet if eof has been reached.
+		* Since then, eof() remains true until it is reset by another related method.
+		* If the packet is not DESTROYED, then it is linked to its corresponding stream.
+		*/
+		packet demux_next_packet(packet_pool& pool);
+
 		/*
 		* Seeks to the first frame of the stream in the file that is
 		* the first one beyond/before timestamp for direction true/false.
@@ -161,8 +274,110 @@ namespace ff
 		*/
 		void seek(int stream_ind, int64_t timestamp, bool direction = true);
 
+		/*
+		* Reads the whole file once to record every packet of every stream in the keyframe index.
+		* Afterwards, the demuxer is at the start of the file.
+		* 
+		* @throws std::filesystem::filesystem_error on I/O error.
+		*/
+		void build_keyframe_index();
+
+		/*
+		* Uses an index built before for the same file (e.g. by another demuxer, or stored from get_keyframe_index()),
+		* instead of building it again.
+		* 
+		* @throws std::invalid_argument if index doesn't have one vector per stream.
+		*/
+		void load_keyframe_index(keyframe_index index);
+
+		/*
+		* @returns the keyframe index. Empty if it has not been built or loaded.
+		*/
+		const keyframe_index& get_keyframe_index() const noexcept { return kf_index; }
+
+		bool has_keyframe_index() const noexcept { return !kf_index.empty(); }
+
+		/*
+		* Seeks to the last keyframe of the stream whose pts <= timestamp
+		* (or the first keyframe if there is none), using the keyframe index.
+		* 
+		* Decode the stream from there, and discard the first result.num_frames_to_discard frames.
+		* The next one is the first at or after timestamp. It counts every packet of the stream
+		* after the keyframe whose pts < timestamp, assuming the decoder outputs one frame for each.
+		* 
+		* @param stream_ind which stream
+		* @param timestamp seek to where, in the time base of the stream.
+		* @throws std::logic_error if there is no keyframe index.
+		* @throws std::out_of_range if stream ind is wrong.
+		* @throws std::invalid_argument if the stream has no keyframes.
+		*/
+		accurate_seek_result seek_accurate(int stream_ind, int64_t timestamp);
+
 		bool eof() const noexcept { return eof_reached; }
 
+		/*
+		* Sets which packets of a stream I drop when demuxing.
+		* AVDISCARD_NONKEY (or AVDISCARD_NONINTRA) drops all but the keyframes, and AVDISCARD_ALL drops all packets.
+		* Other levels are only passed to the container, since I can't tell
+		* from the packets which frames are references; give them to decoder::set_skip_policy() instead.
+		* 
+		* build_keyframe_index() ignores the levels and indexes every packet.
+		* 
+		* @param stream_ind which stream
+		* @param level AVDISCARD_DEFAULT to keep all packets again.
+		* @throws std::out_of_range if stream ind is wrong.
+		*/
+		void set_discard(int stream_ind, AVDiscard level);
+		/*
+		* @returns the level set by set_discard(), or AVDISCARD_DEFAULT.
+		* @throws std::out_of_range if stream ind is wrong.
+		*/
+		AVDiscard get_discard(int stream_ind) const;
+
+		/*
+		* Keeps only the streams you need and drops all packets of the others (AVDISCARD_ALL),
+		* so that files with many audio languages or subtitle tracks cost you only what you demux.
+		* The selected streams stay at the level set_discard() gave them,
+		* or go back to AVDISCARD_DEFAULT if they were dropped.
+		* 
+		* Probing reads packets of all streams that are not dropped,
+		* so to probe only the selected ones, construct me with probe_stream_info = false,
+		* and select with probe = true.
+		* Streams that probing then finds are dropped too.
+		* 
+		* @param stream_inds the indices of the streams to keep.
+		* @param probe if true, I probe the stream information after selecting.
+		* @param options to pass to the decoders when probing.
+		* @throws std::invalid_argument if stream_inds is empty.
+		* @throws std::out_of_range if any of stream_inds is wrong. Then, no level is changed.
+		*/
+		void select_streams(const std::vector<int>& stream_inds, bool probe = false, const dict& options = dict());
+		/*
+		* Keeps at most one stream of each type, by its order among the streams of the type
+		* (i.e. what get_video_ind(), get_audio_ind(), and get_subtitle_ind() take),
+		* and drops all packets of the others. See select_streams().
+		* 
+		* @param video_i the i^th video stream to keep, or -1 to keep none.
+		* @param audio_i the i^th audio stream to keep, or -1 to keep none.
+		* @param subtitle_i the i^th subtitle stream to keep, or -1 to keep none.
+		* @throws std::invalid_argument if all are -1.
+		* @throws std::out_of_range if any is neither -1 nor in range. Then, no level is changed.
+		*/
+		void select_streams_by_type
+		(
+			int video_i, int audio_i, int subtitle_i = -1,
+			bool probe = false, const dict& options = dict()
+		);
+		/*
+		* Keeps all streams again, by setting every level to AVDISCARD_DEFAULT.
+		*/
+		void select_all_streams() noexcept;
+		/*
+		* @returns true iff I don't drop all packets of the stream.
+		* @throws std::out_of_range if stream ind is wrong.
+		*/
+		bool is_selected(int stream_ind) const { return get_discard(stream_ind) < AVDISCARD_ALL; }
+
 	public:
 		inline const ::AVInputFormat* av_input_fmt() const noexcept { return p_demuxer_desc; }
 		inline const ::AVInputFormat* av_input_fmt() noexcept { return p_demuxer_desc; }
@@ -268,12 +483,43 @@ namespace ff
 	private:
 		const AVInputFormat* p_demuxer_desc = nullptr;
 
+		/*
+		* The AVIOContext created for the custom_io the demuxer reads from.
+		* nullptr if it reads a local file.
+		*/
+		::AVIOContext* p_custom_avio = nullptr;
+
 		/*
 		* I will set to true during a call to demux_next_packet()
 		* if the demuxer detects the eof.
 		*/
 		bool eof_reached = false;
 
+		/*
+		* See build_keyframe_index(). Empty if not built or loaded.
+		*/
+		keyframe_index kf_index;
+		/*
+		* Where a keyframe is in kf_index, by its pts.
+		*/
+		struct keyframe_pos
+		{
+			int64_t pts;
+			// Into the stream's vector in kf_index.
+			size_t entry;
+		};
+		/*
+		* The keyframes of each stream in kf_index, sorted by pts,
+		* so that seek_accurate() finds the one it needs by a binary search.
+		* Made whenever kf_index is set.
+		*/
+		std::vector<std::vector<keyframe_pos>> kf_sorted;
+
+		/*
+		* Makes kf_sorted out of kf_index.
+		*/
+		void internal_sort_keyframes();
+
 	private:
 		// Because of the two versions of methods that use dict,
 		// here are these private methods that contain the common pieces of code between the versions.
@@ -281,18 +527,32 @@ namespace ff
 		/*
 		* common piece of code used in the constructors
 		*/
-		void internal_open_format(const std::string& path, bool probe_stream_info, ::AVDictionary** dict);
+		void internal_open_format
+		(
+			const std::string& path, bool probe_stream_info, ::AVDictionary** dict,
+			const AVInputFormat* fmt = nullptr
+		);
 		/*
 		* common piece of code used in probe_stream_information()
 		*/
 		void internal_probe_stream_info(::AVDictionary** dict);
+		/*
+		* (Re)creates streams and the indices from the streams in the fmt ctx.
+		*/
+		void internal_register_streams();
 
 		/*
-		* common piece of code used in the demux_next_packet()'s
+		* common piece of code used in the demux_next_packet()'s.
+		* It drops the packets that the discard levels say to.
 		* @returns true iff a packet has been demuxed.
 		*/
 		bool internal_demux_packet(AVPacket* pkt);
 
+		/*
+		* Seeks to the start of the file.
+		*/
+		void seek_to_start();
+
 	public:
 		// Inherited via media_base
 		virtual std::string description() const override;
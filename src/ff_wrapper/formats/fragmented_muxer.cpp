@@ -0,0 +1,170 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "fragmented_muxer.h"
+
+#include "../codec/encoder.h"
+#include "../data/packet.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+}
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+	// frag_custom: a fragment is written only when I flush the muxer,
+	// which lets me cut on the keyframes I choose.
+	// empty_moov: the init segment holds no samples.
+	// default_base_moof: every fragment can be used without the others (required by CMAF).
+	// skip_trailer: there's no mfra after the last fragment.
+	constexpr const char* fragmented_movflags = "+frag_custom+empty_moov+default_base_moof+skip_trailer+cmaf";
+
+	// Allow a little rounding when comparing seconds.
+	constexpr double time_epsilon = 1e-6;
+}
+
+ff::fragmented_muxer::fragmented_muxer(segment_callback on_segment, double target_duration)
+	: on_segment(std::move(on_segment)), target_duration(target_duration),
+	sink
+	(
+		callback_io::read_function(),
+		[this](const uint8_t* buf, int size)
+		{
+			pending.insert(pending.end(), buf, buf + size);
+			return size;
+		}
+	),
+	mux(sink, "mp4")
+{
+	if (!this->on_segment)
+	{
+		throw std::invalid_argument("The segment callback cannot be empty.");
+	}
+	if (!(target_duration > 0.0))
+	{
+		throw std::invalid_argument("The target duration must be positive.");
+	}
+}
+
+void ff::fragmented_muxer::prepare_muxer(const dict& options)
+{
+	dict opts(options);
+	opts.insert_entry("movflags", opts.get_value("movflags") + fragmented_movflags);
+
+	mux.prepare_muxer(opts);
+
+	// The reference stream is the first video stream, or the first stream.
+	ref_stream = mux.num_videos() > 0 ? mux.get_video_ind(0) : 0;
+
+	// The header is the init segment.
+	internal_cut_segment(true, 0.0);
+}
+
+void ff::fragmented_muxer::mux_packet(packet& pkt)
+{
+	if (ref_stream < 0)
+	{
+		throw std::logic_error("You must prepare the muxer first.");
+	}
+	if (finalized)
+	{
+		throw std::logic_error("The muxer has been finalized.");
+	}
+
+	if (pkt->stream_index == ref_stream)
+	{
+		const int64_t ts = AV_NOPTS_VALUE != pkt->pts ? pkt->pts : pkt->dts;
+		if (AV_NOPTS_VALUE != ts)
+		{
+			const double tb = av_q2d(mux.get_stream(ref_stream)->time_base);
+			const double t = ts * tb;
+
+			if (!seg_has_ref_packet)
+			{
+				seg_start = t;
+				seg_has_ref_packet = true;
+			}
+			else if ((pkt->flags & AV_PKT_FLAG_KEY) && t - seg_start + time_epsilon >= target_duration)
+			{
+				// The keyframe starts the next one.
+				internal_cut_segment(false, t);
+				seg_start = t;
+			}
+
+			last_end = std::max(last_end, t + pkt->duration * tb);
+		}
+	}
+
+	mux.mux_packet_auto(pkt);
+}
+
+void ff::fragmented_muxer::finalize()
+{
+	if (ref_stream < 0)
+	{
+		throw std::logic_error("You must prepare the muxer first.");
+	}
+	if (finalized)
+	{
+		throw std::logic_error("The muxer has been finalized.");
+	}
+	finalized = true;
+
+	// Writing the trailer writes the last fragment.
+	mux.finalize();
+	avio_flush(mux.av_fmt_ctx()->pb);
+	if (!pending.empty())
+	{
+		muxed_segment seg;
+		seg.index = next_index++;
+		seg.start_time = seg_start;
+		seg.duration = std::max(0.0, last_end - seg_start);
+		seg.data = std::move(pending);
+		pending.clear();
+
+		on_segment(seg);
+	}
+}
+
+void ff::fragmented_muxer::internal_cut_segment(bool is_init, double end_time)
+{
+	if (!is_init)
+	{
+		// Everything before the packet that starts the next segment must be in this one,
+		// including those held for interleaving.
+		mux.flush_interleaving();
+		mux.flush_demuxer();
+	}
+	avio_flush(mux.av_fmt_ctx()->pb);
+
+	muxed_segment seg;
+	seg.index = next_index++;
+	seg.is_init = is_init;
+	if (!is_init)
+	{
+		seg.start_time = seg_start;
+		seg.duration = end_time - seg_start;
+	}
+	seg.data = std::move(pending);
+	pending.clear();
+
+	on_segment(seg);
+}
@@ -0,0 +1,166 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class fragmented_muxer.
+*/
+
+#include "../util/util.h"
+#include "../util/dict.h"
+#include "muxer.h"
+#include "custom_io.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace ff
+{
+	class encoder;
+	class packet;
+
+	/*
+	* What a fragmented_muxer gives you each time a segment is done.
+	*/
+	struct muxed_segment
+	{
+		// 0 for the init segment, and then 1, 2, ... for the media segments.
+		int index = 0;
+		// The init segment (ftyp + moov) holds no media, and every media segment
+		// (moof + mdat) needs it in front to be played.
+		bool is_init = false;
+		// In seconds, of the segment's first packet of the reference stream.
+		// 0 for the init segment.
+		double start_time = 0.0;
+		double duration = 0.0;
+		std::vector<uint8_t> data;
+	};
+
+	/*
+	* Muxes into fragmented MP4 (CMAF), cut into segments on keyframes of the reference stream,
+	* and gives you each segment as soon as it's done, instead of one file after finalizing.
+	* The segments can be published directly as HLS (fMP4) or DASH segments.
+	* 
+	* A segment ends at the first keyframe of the reference stream (the first video stream,
+	* or the first stream if there's no video) that is at least the target duration after its start.
+	* Thus segments are at least the target duration long, except maybe the last.
+	* 
+	* Use it like a muxer: add_stream() for all streams, prepare_muxer(), mux_packet() all packets,
+	* and finalize(). The segments are given to the callback from the calls to these.
+	*/
+	class FF_WRAPPER_API fragmented_muxer final
+	{
+	public:
+		/*
+		* Called when a segment is done. You may move the data out.
+		* It must not call the fragmented_muxer.
+		*/
+		using segment_callback = std::function<void(muxed_segment& seg)>;
+
+	public:
+		fragmented_muxer() = delete;
+
+		/*
+		* Creates the muxer. Add the streams then.
+		* 
+		* @param on_segment called when a segment is done.
+		* @param target_duration in seconds, the shortest length of a segment.
+		* @throws std::invalid_argument if on_segment is empty or target_duration <= 0.
+		*/
+		fragmented_muxer(segment_callback on_segment, double target_duration);
+
+		// The muxer references the sink, and the sink this.
+		fragmented_muxer(const fragmented_muxer&) = delete;
+		fragmented_muxer& operator=(const fragmented_muxer&) = delete;
+
+	public:
+		/*
+		* See muxer::add_stream(const encoder&).
+		*/
+		stream add_stream(const encoder& enc) { return mux.add_stream(enc); }
+		/*
+		* See muxer::add_stream(const stream&).
+		*/
+		stream add_stream(const stream& dem_s) { return mux.add_stream(dem_s); }
+
+		/*
+		* Prepares the muxer and gives the init segment.
+		* 
+		* @param options The options to give the MP4 muxer. May be empty.
+		* The movflags that make it fragmented are added to those in them.
+		* @throws std::logic_error if you have not added any stream, or have already called it.
+		*/
+		void prepare_muxer(const dict& options = dict());
+
+		/*
+		* Mux a packet, ending the current segment before it if it starts a new one.
+		* See muxer::mux_packet_auto() for what pkt must be like.
+		* 
+		* @throws std::logic_error if you have not called prepare_muxer() or have called finalize().
+		*/
+		void mux_packet(packet& pkt);
+
+		/*
+		* Ends the last segment and gives it.
+		* 
+		* @throws std::logic_error if you have not called prepare_muxer() or have called it.
+		*/
+		void finalize();
+
+	public:
+		/*
+		* @returns how many segments (including the init one) have been given.
+		*/
+		int num_segments() const noexcept { return next_index; }
+
+		double get_target_duration() const noexcept { return target_duration; }
+
+		/*
+		* @returns the stream index of the reference stream, or -1 before prepare_muxer().
+		*/
+		int get_reference_stream() const noexcept { return ref_stream; }
+
+		const muxer& get_muxer() const noexcept { return mux; }
+
+	private:
+		/*
+		* Flushes the fragment and gives all bytes written since the last segment
+		* as the next segment.
+		*/
+		void internal_cut_segment(bool is_init, double end_time);
+
+	private:
+		segment_callback on_segment;
+		double target_duration;
+
+		// The bytes written since the last segment.
+		std::vector<uint8_t> pending;
+		// Not seekable, so that the MP4 muxer never goes back to what's given.
+		callback_io sink;
+		muxer mux;
+
+		int ref_stream = -1;
+		int next_index = 0;
+		bool finalized = false;
+
+		// In seconds. Of the current segment's first packet of the reference stream,
+		// and the end of the last packet of it.
+		double seg_start = 0.0;
+		double last_end = 0.0;
+		bool seg_has_ref_packet = false;
+	};
+}
@@ -0,0 +1,453 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "frame_spill.h"
+#include "mmap_io.h"
+#include "../codec/encoder.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h> // For accessing AVCodecContext.
+#include <libavutil/buffer.h>
+#include <libavutil/common.h> // For AV_CEIL_RSHIFT
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <algorithm>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	// Change the version whenever the layout of a spill changes.
+	constexpr char magic[8] = { 'F', 'F', 'W', 'S', 'P', 'I', 'L', 'L' };
+	constexpr uint32_t version = 1;
+	// Read in the other byte order, it's different.
+	constexpr uint32_t byte_order_mark = 0x01020304;
+
+	// Planes start, and lines are padded, at multiples of it.
+	constexpr uint64_t alignment = 64;
+
+	struct spill_header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order_mark;
+
+		int32_t format;
+		int32_t width, height;
+		int32_t tb_num, tb_den;
+		int32_t color_range, color_primaries, color_trc, colorspace, chroma_location;
+		int32_t sar_num, sar_den;
+		int32_t num_planes;
+
+		int64_t linesizes[4];
+		uint64_t plane_offsets[4];
+		uint64_t frame_bytes;
+		uint64_t data_offset;
+		uint64_t num_frames;
+		uint64_t table_offset;
+	};
+
+	uint64_t align_up(uint64_t v)
+	{
+		return (v + alignment - 1) / alignment * alignment;
+	}
+
+	/*
+	* Works out where each plane of a frame of props lies in the frame's bytes.
+	*
+	* @returns how many bytes a frame takes, with a line of padding at the end for SIMD code that reads past it.
+	* @throws std::invalid_argument if props is not for video, or if its pixel format can't be laid out so
+	* (e.g. a hardware, bitstream or palette one).
+	*/
+	uint64_t lay_out(const ff::frame::data_properties& props, int& num_planes, int64_t linesizes[4], uint64_t offsets[4], int rows[4])
+	{
+		if (!props.v_or_a || props.width <= 0 || props.height <= 0)
+		{
+			throw std::invalid_argument("The properties are not for video.");
+		}
+		const AVPixelFormat fmt = (AVPixelFormat)props.fmt;
+		const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(fmt);
+		if (nullptr == desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL)))
+		{
+			throw std::invalid_argument("Frames of the pixel format can't be spilled.");
+		}
+
+		num_planes = av_pix_fmt_count_planes(fmt);
+		uint64_t bytes = 0;
+		for (int p = 0; p < num_planes; ++p)
+		{
+			const int line = av_image_get_linesize(fmt, props.width, p);
+			if (line <= 0)
+			{
+				throw std::invalid_argument("Frames of the pixel format can't be spilled.");
+			}
+			// The same as av_image_copy() works them out.
+			rows[p] = (1 == p || 2 == p) ? AV_CEIL_RSHIFT(props.height, desc->log2_chroma_h) : props.height;
+			linesizes[p] = static_cast<int64_t>(align_up(line));
+			offsets[p] = bytes;
+			bytes += static_cast<uint64_t>(linesizes[p]) * rows[p];
+		}
+		return bytes + alignment;
+	}
+
+	// Keeps the mapping for as long as a frame refers to it.
+	void release_mapping(void* opaque, uint8_t*) noexcept
+	{
+		delete static_cast<std::shared_ptr<ff::mmap_io>*>(opaque);
+	}
+
+	/*
+	* @throws std::logic_error if enc is not ready.
+	* @throws std::invalid_argument if enc is not for video.
+	*/
+	const ff::encoder& check_encoder(const ff::encoder& enc)
+	{
+		if (!enc.ready())
+		{
+			throw std::logic_error("The encoder is not ready.");
+		}
+		if (!enc.is_video())
+		{
+			throw std::invalid_argument("The encoder is not for video.");
+		}
+		return enc;
+	}
+}
+
+ff::frame_spill::frame_spill(const fs::path& path)
+	: map(std::make_shared<mmap_io>(path))
+{
+	const uint8_t* base = map->data();
+	const uint64_t size = map->size();
+
+	spill_header h;
+	if (size < sizeof(h))
+	{
+		throw std::invalid_argument("The file is too small to be a spill.");
+	}
+	std::copy(base, base + sizeof(h), reinterpret_cast<uint8_t*>(&h));
+	if (!std::equal(magic, magic + sizeof(magic), h.magic)
+		|| version != h.version || byte_order_mark != h.byte_order_mark)
+	{
+		throw std::invalid_argument("The file is not a spill of this version and byte order.");
+	}
+	if (h.tb_num <= 0 || h.tb_den <= 0)
+	{
+		throw std::invalid_argument("The time base of the spill is broken.");
+	}
+
+	fmt = h.format;
+	width = h.width;
+	height = h.height;
+	tb = ff::rational(h.tb_num, h.tb_den);
+
+	// The layout must be what I'd work out, so that no plane goes outside of its frame.
+	int rows[4] = {};
+	try
+	{
+		stride = lay_out(properties(), num_planes, linesizes, plane_offsets, rows);
+	}
+	catch (const std::invalid_argument&)
+	{
+		throw std::invalid_argument("The properties of the spill are broken.");
+	}
+	if (stride != h.frame_bytes || num_planes != h.num_planes
+		|| !std::equal(linesizes, linesizes + num_planes, h.linesizes)
+		|| !std::equal(plane_offsets, plane_offsets + num_planes, h.plane_offsets))
+	{
+		throw std::invalid_argument("The layout of the spill is broken.");
+	}
+
+	if (h.table_offset > size || 0 != h.table_offset % alignof(entry)
+		|| h.num_frames > (size - h.table_offset) / sizeof(entry))
+	{
+		throw std::invalid_argument("The index of the spill is broken.");
+	}
+	if (0 != h.data_offset % alignment || h.data_offset > h.table_offset
+		|| h.num_frames > (h.table_offset - h.data_offset) / stride)
+	{
+		throw std::invalid_argument("The frames of the spill are broken.");
+	}
+	// The mapping starts at a page, so the table is aligned as its offset is.
+	table = reinterpret_cast<const entry*>(base + h.table_offset);
+	n = static_cast<size_t>(h.num_frames);
+	data_offset = h.data_offset;
+
+	color_range = h.color_range;
+	color_primaries = h.color_primaries;
+	color_trc = h.color_trc;
+	colorspace = h.colorspace;
+	chroma_location = h.chroma_location;
+	if (h.sar_den > 0)
+	{
+		sar = ff::rational(h.sar_num, h.sar_den);
+	}
+}
+
+ff::frame_spill::~frame_spill() noexcept = default;
+
+ff::frame ff::frame_spill::get_frame(size_t i) const
+{
+	const entry& e = get_entry(i);
+
+	AVFrame* f = av_frame_alloc();
+	if (nullptr == f)
+	{
+		throw std::bad_alloc();
+	}
+	auto* keep = new(std::nothrow) std::shared_ptr<mmap_io>(map);
+	// FFmpeg never writes to a read only buffer; it copies it first if it must.
+	uint8_t* p_data = const_cast<uint8_t*>(map->data() + data_offset + i * stride);
+	f->buf[0] = nullptr == keep ? nullptr :
+		av_buffer_create(p_data, static_cast<size_t>(stride), release_mapping, keep, AV_BUFFER_FLAG_READONLY);
+	if (nullptr == f->buf[0])
+	{
+		delete keep;
+		av_frame_free(&f);
+		throw std::bad_alloc();
+	}
+
+	for (int p = 0; p < num_planes; ++p)
+	{
+		f->data[p] = p_data + plane_offsets[p];
+		f->linesize[p] = static_cast<int>(linesizes[p]);
+	}
+	f->format = fmt;
+	f->width = width;
+	f->height = height;
+
+	f->pts = e.pts;
+	f->best_effort_timestamp = e.pts;
+	f->duration = e.duration;
+	f->time_base = tb.av_rational();
+	f->flags = e.flags;
+	f->pict_type = static_cast<AVPictureType>(e.pict_type);
+
+	f->color_range = static_cast<AVColorRange>(color_range);
+	f->color_primaries = static_cast<AVColorPrimaries>(color_primaries);
+	f->color_trc = static_cast<AVColorTransferCharacteristic>(color_trc);
+	f->colorspace = static_cast<AVColorSpace>(colorspace);
+	f->chroma_location = static_cast<AVChromaLocation>(chroma_location);
+	f->sample_aspect_ratio = sar.av_rational();
+
+	return frame(f, true);
+}
+
+size_t ff::frame_spill::find(int64_t pts) const
+{
+	if (0 == n || pts < table[0].pts)
+	{
+		throw std::out_of_range("No frame is shown at the pts.");
+	}
+
+	// The pts increase, as the writer makes sure.
+	const entry* it = std::upper_bound
+	(
+		table, table + n, pts,
+		[](int64_t v, const entry& e) { return v < e.pts; }
+	);
+	return static_cast<size_t>(it - table) - 1;
+}
+
+ff::frame_spill_writer::frame_spill_writer
+(
+	const fs::path& dst,
+	const frame::data_properties& properties, ff::rational time_base,
+	frame_transformer::algorithms algorithm
+)
+	: dst_path(dst), props(properties), tb(time_base), algo(algorithm)
+{
+	if (time_base <= 0)
+	{
+		throw std::invalid_argument("The time base must be > 0.");
+	}
+	stride = lay_out(props, num_planes, linesizes, plane_offsets, plane_rows);
+
+	tmp_path = dst;
+	tmp_path += ".tmp";
+	os.open(tmp_path, std::ios::binary | std::ios::trunc);
+	if (!os.is_open())
+	{
+		throw fs::filesystem_error
+		(
+			"Could not create the spill.", tmp_path,
+			std::make_error_code(std::errc::io_error)
+		);
+	}
+
+	// Written again by finish(), when it's known.
+	const char zeros[sizeof(spill_header) + alignment] = {};
+	os.write(zeros, align_up(sizeof(spill_header)));
+	internal_check_stream();
+}
+
+ff::frame_spill_writer::frame_spill_writer(const fs::path& dst, const encoder& enc, frame_transformer::algorithms algorithm)
+	: frame_spill_writer
+	(
+		dst,
+		frame::data_properties(check_encoder(enc)->pix_fmt, enc->width, enc->height),
+		enc->time_base, algorithm
+	)
+{}
+
+ff::frame_spill_writer::~frame_spill_writer() noexcept
+{
+	if (!finished)
+	{
+		os.close();
+		std::error_code ec;
+		fs::remove(tmp_path, ec);
+	}
+}
+
+void ff::frame_spill_writer::write_frame(const frame& f)
+{
+	if (finished)
+	{
+		throw std::logic_error("The spill has been finished.");
+	}
+	if (!f.ready() || !f.v_or_a())
+	{
+		throw std::invalid_argument("The frame is not a ready video frame.");
+	}
+	if (AV_NOPTS_VALUE == f->pts)
+	{
+		throw std::invalid_argument("The frame has no pts.");
+	}
+	if (!entries.empty() && f->pts <= entries.back().pts)
+	{
+		throw std::invalid_argument("The pts must increase.");
+	}
+
+	frame src(f.is_hardware() ? f.transfer_to_software() : f);
+	const frame::data_properties src_props(src.get_data_properties());
+	if (src_props != props)
+	{
+		if (!trans || trans->src_properties() != src_props)
+		{
+			trans = std::make_unique<frame_transformer>(props, src_props, algo);
+		}
+		src = trans->convert_frame(src);
+	}
+
+	if (entries.empty())
+	{
+		color_range = src->color_range;
+		color_primaries = src->color_primaries;
+		color_trc = src->color_trc;
+		colorspace = src->colorspace;
+		chroma_location = src->chroma_location;
+		sar = av_rational_invalid_or_zero(src->sample_aspect_ratio) ? ff::zero_rational : ff::rational(src->sample_aspect_ratio);
+	}
+
+	const char zeros[alignment] = {};
+	const AVPixelFormat fmt = (AVPixelFormat)props.fmt;
+	for (int p = 0; p < num_planes; ++p)
+	{
+		const int64_t line = av_image_get_linesize(fmt, props.width, p);
+		if (src->linesize[p] == linesizes[p])
+		{
+			// Laid out the same, so the plane goes in one write.
+			// The padding at the end of the last line is not the frame's, so it's written as zeros.
+			os.write
+			(
+				reinterpret_cast<const char*>(src->data[p]),
+				linesizes[p] * (plane_rows[p] - 1) + line
+			);
+		}
+		else
+		{
+			for (int y = 0; y < plane_rows[p]; ++y)
+			{
+				os.write(reinterpret_cast<const char*>(src->data[p] + (ptrdiff_t)y * src->linesize[p]), line);
+				if (y != plane_rows[p] - 1)
+				{
+					os.write(zeros, linesizes[p] - line);
+				}
+			}
+		}
+		os.write(zeros, linesizes[p] - line);
+	}
+	os.write(zeros, alignment);
+	internal_check_stream();
+
+	// From f, in case converting it has lost them.
+	entries.push_back(frame_spill::entry
+	{
+		f->pts, f->duration,
+		static_cast<int32_t>(f->flags), static_cast<int32_t>(f->pict_type)
+	});
+}
+
+size_t ff::frame_spill_writer::finish()
+{
+	if (finished)
+	{
+		throw std::logic_error("The spill has been finished.");
+	}
+
+	spill_header h{};
+	std::copy(magic, magic + sizeof(magic), h.magic);
+	h.version = version;
+	h.byte_order_mark = byte_order_mark;
+	h.format = props.fmt;
+	h.width = props.width;
+	h.height = props.height;
+	h.tb_num = tb.get_num();
+	h.tb_den = tb.get_den();
+	h.color_range = color_range;
+	h.color_primaries = color_primaries;
+	h.color_trc = color_trc;
+	h.colorspace = colorspace;
+	h.chroma_location = chroma_location;
+	h.sar_num = sar.get_num();
+	h.sar_den = sar.get_den();
+	h.num_planes = num_planes;
+	std::copy(linesizes, linesizes + 4, h.linesizes);
+	std::copy(plane_offsets, plane_offsets + 4, h.plane_offsets);
+	h.frame_bytes = stride;
+	h.data_offset = align_up(sizeof(spill_header));
+	h.num_frames = entries.size();
+	// The frames are multiples of the alignment, so the table is aligned, too.
+	h.table_offset = h.data_offset + entries.size() * stride;
+
+	os.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(frame_spill::entry));
+	os.seekp(0);
+	os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	os.flush();
+	internal_check_stream();
+	os.close();
+
+	fs::rename(tmp_path, dst_path);
+	finished = true;
+	return entries.size();
+}
+
+void ff::frame_spill_writer::internal_check_stream()
+{
+	if (!os.good())
+	{
+		throw fs::filesystem_error
+		(
+			"Could not write the spill.", tmp_path,
+			std::make_error_code(std::errc::io_error)
+		);
+	}
+}
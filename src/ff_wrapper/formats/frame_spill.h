@@ -0,0 +1,259 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* frame_spill.h:
+* Spills decoded frames into a raw file once, and maps them back for each later pass of an encode
+* (e.g. the second pass of a two-pass encode, or the other rungs of a ladder) without demuxing or decoding again.
+*/
+
+#include "../util/util.h"
+#include "../util/ff_math.h"
+#include "../data/frame.h"
+#include "../sws/frame_transformer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace ff
+{
+	class encoder;
+	class mmap_io;
+
+	/*
+	* A spill file of raw video frames, all of the same properties, with their times.
+	* Write it with a frame_spill_writer as the frames are decoded in the first pass,
+	* and then open it in each later pass to get the frames back.
+	*
+	* The file is mapped into memory, and the frames I give out refer to the mapped data without copying them.
+	* In the file, every plane starts at a multiple of 64 bytes, and every line is padded to a multiple of 64 bytes,
+	* so the frames are aligned as an encoder or libswscale likes, as if they had been allocated.
+	* Their data are read only: frame::make_writable() copies them first.
+	* Each frame holds a reference to the mapping, so it stays valid after I am destroyed.
+	*
+	* The layout, in the byte order of the machine (like packet_trace, it's for the same kind of machine only):
+	*	header | frames, each of frame_bytes() | one entry per frame
+	*
+	* Only the data, the times, the flags, the picture type, and (of the first frame) the colour properties are kept.
+	* Side data are not.
+	*
+	* Once constructed, nothing in me changes, so everything can be called from several threads at once.
+	*/
+	class FF_WRAPPER_API frame_spill final
+	{
+	public:
+		/*
+		* What's kept of a frame besides its data. Times are in time_base().
+		*/
+		struct entry
+		{
+			int64_t pts;
+			int64_t duration;
+			// AVFrame::flags, e.g. AV_FRAME_FLAG_KEY.
+			int32_t flags;
+			// AVPictureType.
+			int32_t pict_type;
+		};
+
+	public:
+		frame_spill() = delete;
+
+		/*
+		* Maps a spill file made by a frame_spill_writer.
+		*
+		* @throws std::filesystem::filesystem_error if the file cannot be opened or mapped.
+		* @throws std::invalid_argument if it's not a valid spill of this version and byte order.
+		*/
+		explicit frame_spill(const std::filesystem::path& path);
+
+		frame_spill(const frame_spill&) = delete;
+		frame_spill& operator=(const frame_spill&) = delete;
+
+		/*
+		* Drops my reference to the mapping. The file is unmapped once the frames I gave out are gone, too.
+		*/
+		~frame_spill() noexcept;
+
+	public:
+		size_t num_frames() const noexcept { return n; }
+		frame::data_properties properties() const noexcept { return frame::data_properties(fmt, width, height); }
+		ff::rational time_base() const noexcept { return tb; }
+		// How many bytes each frame takes in the file, padding included.
+		uint64_t frame_bytes() const noexcept { return stride; }
+
+		/*
+		* @throws std::out_of_range if i >= num_frames().
+		*/
+		const entry& get_entry(size_t i) const
+		{
+			if (i >= n)
+			{
+				throw std::out_of_range("No such frame in the spill.");
+			}
+			return table[i];
+		}
+
+		/*
+		* @returns the i-th frame, ready. Its data are the mapped ones, read only.
+		* @throws std::out_of_range if i >= num_frames().
+		*/
+		frame get_frame(size_t i) const;
+
+		/*
+		* Looks up the timestamp index.
+		*
+		* @returns the index of the frame shown at pts, i.e. the last one whose pts is not after it.
+		* @throws std::out_of_range if pts is before the first frame, or if there's no frame.
+		*/
+		size_t find(int64_t pts) const;
+
+	private:
+		// Shared with the frames given out.
+		std::shared_ptr<mmap_io> map;
+		const entry* table = nullptr;
+		size_t n = 0;
+
+		int fmt = -1;
+		int width = 0, height = 0;
+		ff::rational tb;
+		uint64_t stride = 0;
+		uint64_t data_offset = 0;
+		int num_planes = 0;
+		int64_t linesizes[4] = {};
+		uint64_t plane_offsets[4] = {};
+
+		// Of the first frame written.
+		int color_range = 0, color_primaries = 0, color_trc = 0, colorspace = 0, chroma_location = 0;
+		ff::rational sar;
+	};
+
+	/*
+	* Writes a spill file of frames (see frame_spill).
+	* The file is written to a temporary file first and renamed by finish(), so that no one ever maps half of it.
+	*
+	* The frames written are made into the properties of the spill first if they are not:
+	* hardware frames are transferred to the system memory, and others are scaled/converted by a frame_transformer.
+	* So giving it the encoder's properties spills the frames ready for the encoder.
+	*/
+	class FF_WRAPPER_API frame_spill_writer final
+	{
+	public:
+		frame_spill_writer() = delete;
+
+		/*
+		* Starts writing.
+		*
+		* @param dst where the spill goes.
+		* @param properties of the frames in the spill.
+		* @param time_base of the pts of the frames written.
+		* @param algorithm used if frames need scaling.
+		* @throws std::invalid_argument if properties is not for video, if it's of a hardware or bitstream pixel format,
+		* or if time_base <= 0.
+		* @throws std::filesystem::filesystem_error if the temporary file cannot be created.
+		*/
+		frame_spill_writer
+		(
+			const std::filesystem::path& dst,
+			const frame::data_properties& properties, ff::rational time_base,
+			frame_transformer::algorithms algorithm = frame_transformer::FF_SWS_BICUBIC
+		);
+
+		/*
+		* Starts writing frames of the properties and time base enc takes.
+		*
+		* @throws std::logic_error if enc is not ready.
+		* @throws std::invalid_argument if enc is not for video.
+		* @throws the same as the other constructor.
+		*/
+		frame_spill_writer
+		(
+			const std::filesystem::path& dst, const encoder& enc,
+			frame_transformer::algorithms algorithm = frame_transformer::FF_SWS_BICUBIC
+		);
+
+		frame_spill_writer(const frame_spill_writer&) = delete;
+		frame_spill_writer& operator=(const frame_spill_writer&) = delete;
+
+		/*
+		* If finish() hasn't been called, the temporary file is removed and nothing is spilled.
+		*/
+		~frame_spill_writer() noexcept;
+
+	public:
+		/*
+		* Appends f to the spill.
+		*
+		* @param f a ready video frame, whose pts is after that of the last one written.
+		* @throws std::invalid_argument if f is not a ready video frame, if it has no pts,
+		* or if its pts is not after the last one's.
+		* @throws std::logic_error if finish() has been called.
+		* @throws std::filesystem::filesystem_error on I/O error.
+		* @throws what frame_transformer throws if f has to be converted.
+		*/
+		void write_frame(const frame& f);
+
+		/*
+		* Writes the timestamp index and renames the temporary file to dst.
+		*
+		* @returns how many frames are spilled.
+		* @throws std::logic_error if it's been called.
+		* @throws std::filesystem::filesystem_error on I/O error.
+		*/
+		size_t finish();
+
+	public:
+		size_t num_frames() const noexcept { return entries.size(); }
+		// How many bytes each frame takes in the file, padding included.
+		uint64_t frame_bytes() const noexcept { return stride; }
+
+	private:
+		/*
+		* @throws std::filesystem::filesystem_error if the stream has failed.
+		*/
+		void internal_check_stream();
+
+	private:
+		std::filesystem::path dst_path;
+		std::filesystem::path tmp_path;
+		std::ofstream os;
+		bool finished = false;
+
+		frame::data_properties props;
+		ff::rational tb;
+		frame_transformer::algorithms algo;
+		// Made when a frame of other properties comes.
+		std::unique_ptr<frame_transformer> trans;
+
+		uint64_t stride = 0;
+		int num_planes = 0;
+		int64_t linesizes[4] = {};
+		uint64_t plane_offsets[4] = {};
+		int plane_rows[4] = {};
+
+		// The timestamp index, written at the end.
+		std::vector<frame_spill::entry> entries;
+
+		// Of the first frame.
+		int color_range = 0, color_primaries = 0, color_trc = 0, colorspace = 0, chroma_location = 0;
+		ff::rational sar;
+	};
+}
@@ -0,0 +1,159 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "mmap_io.h"
+
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+using filesystem_error = std::filesystem::filesystem_error;
+
+namespace
+{
+	/*
+	* @returns the error of the last failed system call.
+	* Take it before any clean up, whose calls may overwrite it.
+	*/
+	std::error_code last_error() noexcept
+	{
+#ifdef _WIN32
+		return std::error_code(::GetLastError(), std::system_category());
+#else
+		return std::error_code(errno, std::generic_category());
+#endif // _WIN32
+	}
+}
+
+ff::mmap_io::mmap_io(const std::filesystem::path& path, int buffer_size)
+	: custom_io(buffer_size)
+{
+	if (path.empty())
+	{
+		throw std::invalid_argument("Path cannot be empty");
+	}
+
+#ifdef _WIN32
+	h_file = ::CreateFileW
+	(
+		path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+	);
+	if (INVALID_HANDLE_VALUE == h_file)
+	{
+		const std::error_code ec = last_error();
+		h_file = nullptr;
+		throw filesystem_error("Could not open the file to map.", path, ec);
+	}
+
+	LARGE_INTEGER file_size;
+	if (!::GetFileSizeEx(h_file, &file_size))
+	{
+		const std::error_code ec = last_error();
+		::CloseHandle(h_file);
+		throw filesystem_error("Could not get the size of the file to map.", path, ec);
+	}
+	map_size = static_cast<size_t>(file_size.QuadPart);
+
+	// An empty file cannot be mapped, but there's nothing to map then.
+	if (0 != map_size)
+	{
+		h_mapping = ::CreateFileMappingW(h_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (nullptr == h_mapping)
+		{
+			const std::error_code ec = last_error();
+			::CloseHandle(h_file);
+			throw filesystem_error("Could not map the file.", path, ec);
+		}
+
+		p_map = static_cast<const uint8_t*>(::MapViewOfFile(h_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (nullptr == p_map)
+		{
+			const std::error_code ec = last_error();
+			::CloseHandle(h_mapping);
+			::CloseHandle(h_file);
+			throw filesystem_error("Could not map the file.", path, ec);
+		}
+	}
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		const std::error_code ec = last_error();
+		throw filesystem_error("Could not open the file to map.", path, ec);
+	}
+
+	struct stat st;
+	if (::fstat(fd, &st) < 0)
+	{
+		const std::error_code ec = last_error();
+		::close(fd);
+		throw filesystem_error("Could not get the size of the file to map.", path, ec);
+	}
+	map_size = static_cast<size_t>(st.st_size);
+
+	// An empty file cannot be mapped, but there's nothing to map then.
+	if (0 != map_size)
+	{
+		void* p = ::mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED == p)
+		{
+			const std::error_code ec = last_error();
+			::close(fd);
+			throw filesystem_error("Could not map the file.", path, ec);
+		}
+		p_map = static_cast<const uint8_t*>(p);
+
+		// Demuxers mostly read forward.
+		::madvise(p, map_size, MADV_SEQUENTIAL);
+	}
+	// The mapping stays after the fd is closed.
+	::close(fd);
+#endif // _WIN32
+
+	view = std::make_unique<memory_io>(p_map, map_size, buffer_size);
+}
+
+ff::mmap_io::~mmap_io() noexcept
+{
+#ifdef _WIN32
+	if (nullptr != p_map)
+	{
+		::UnmapViewOfFile(p_map);
+	}
+	if (nullptr != h_mapping)
+	{
+		::CloseHandle(h_mapping);
+	}
+	if (nullptr != h_file)
+	{
+		::CloseHandle(h_file);
+	}
+#else
+	if (nullptr != p_map)
+	{
+		::munmap(const_cast<uint8_t*>(p_map), map_size);
+	}
+#endif // _WIN32
+}
@@ -0,0 +1,73 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "custom_io.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace std { namespace filesystem { class path; } }
+
+namespace ff
+{
+	/*
+	* Reads a local file by mapping it into memory,
+	* so that demuxing it copies from the page cache instead of making a read call per buffer.
+	* It can seek, but not write.
+	* 
+	* The file is mapped for the whole lifetime of the object.
+	* Do not change the file while it's mapped.
+	*/
+	class FF_WRAPPER_API mmap_io final : public custom_io
+	{
+	public:
+		/*
+		* Maps the file.
+		* 
+		* @throws std::invalid_argument if path is empty.
+		* @throws std::filesystem::filesystem_error if the file cannot be opened or mapped.
+		*/
+		explicit mmap_io(const std::filesystem::path& path, int buffer_size = default_buffer_size);
+
+		/*
+		* Unmaps the file.
+		*/
+		~mmap_io() noexcept;
+
+	public:
+		int read(uint8_t* buf, int size) override { return view->read(buf, size); }
+		int64_t seek(int64_t offset, int whence) override { return view->seek(offset, whence); }
+		bool seekable() const noexcept override { return true; }
+
+	public:
+		const uint8_t* data() const noexcept { return p_map; }
+		size_t size() const noexcept { return map_size; }
+
+	private:
+		const uint8_t* p_map = nullptr;
+		size_t map_size = 0;
+
+#ifdef _WIN32
+		void* h_file = nullptr;
+		void* h_mapping = nullptr;
+#endif // _WIN32
+
+		// Reads and seeks in the mapped bytes.
+		std::unique_ptr<memory_io> view;
+	};
+}
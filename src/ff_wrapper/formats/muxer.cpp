@@ -2,12 +2,16 @@
 
 #include "../util/ff_helpers.h"
 #include "../codec/encoder.h"
+#include "../codec/capability_registry.h"
+#include "custom_io.h"
 
 extern "C"
 {
 #include <libavformat/avformat.h>
 }
 
+#include <algorithm>
+#include <climits>
 #include <filesystem>
 
 ff::muxer::muxer
@@ -38,6 +42,32 @@ ff::muxer::muxer
 	internal_create_muxer(path_str);
 }
 
+ff::muxer::muxer
+(
+	custom_io& io,
+	const std::string& fmt_name, const std::string& fmt_mime_type
+)
+	: media_base()
+{
+	if (fmt_name.empty() && fmt_mime_type.empty())
+	{
+		throw std::invalid_argument("Without a file path, the format name or the MIME type must be given.");
+	}
+
+	p_muxer_desc = av_guess_format
+	(
+		fmt_name.empty() ? nullptr : fmt_name.c_str(),
+		nullptr,
+		fmt_mime_type.empty() ? nullptr : fmt_mime_type.c_str()
+	);
+	if (nullptr == p_muxer_desc)
+	{
+		throw std::invalid_argument("The names you gave could not identify a muxer.");
+	}
+
+	internal_create_muxer(io);
+}
+
 std::string ff::muxer::description() const
 {
 	if (nullptr == p_muxer_desc)
@@ -85,7 +115,11 @@ bool ff::muxer::supports_subtitle() const noexcept
 
 AVCodecID ff::muxer::desired_encoder_id(AVMediaType type) const
 {
-	auto ret = av_guess_codec(p_muxer_desc, nullptr, p_fmt_ctx->url, nullptr, type);
+	// Only a few muxers look at the url. Skip av_guess_codec() for the rest.
+	const muxer_capabilities* caps = capability_registry::get().muxer(p_muxer_desc);
+	const auto ret = (nullptr != caps && !caps->default_codec_depends_on_url()) ?
+		caps->default_codec(type) :
+		av_guess_codec(p_muxer_desc, nullptr, p_fmt_ctx->url, nullptr, type);
 	if (AVCodecID::AV_CODEC_ID_NONE == ret)
 	{
 		throw std::domain_error("Could not obtain the ID for the desired encoder.");
@@ -134,12 +168,57 @@ void ff::muxer::internal_create_muxer(const std::string& path)
 	::strcpy_s(p_fmt_ctx->url, path_len, path.c_str());
 }
 
+void ff::muxer::internal_create_muxer(custom_io& io)
+{
+	p_fmt_ctx = avformat_alloc_context();
+	if (nullptr == p_fmt_ctx)
+	{
+		throw std::bad_alloc();
+	}
+
+	// Assign the desc identified by the names given to the constructor
+	FF_ASSERT(nullptr != p_muxer_desc, "Now the desc should be available.");
+	p_fmt_ctx->oformat = p_muxer_desc;
+
+	try
+	{
+		p_custom_avio = io.create_av_io_context(true);
+	}
+	catch (...)
+	{
+		// The destructor will not be called.
+		ffhelpers::safely_free_format_context(&p_fmt_ctx);
+		throw;
+	}
+	p_fmt_ctx->pb = p_custom_avio;
+	p_fmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	// There is no path, but the errors use p_fmt_ctx->url as one,
+	// so it must not be nullptr. It must be freeable by av_free().
+	p_fmt_ctx->url = reinterpret_cast<char*>(av_mallocz(1));
+	if (nullptr == p_fmt_ctx->url)
+	{
+		destroy();
+		throw std::bad_alloc();
+	}
+}
+
 void ff::muxer::destroy()
 {
 	FF_ASSERT(nullptr != p_fmt_ctx, "Should have been created.");
 
 	// Close the file first.
-	ffhelpers::safely_free_avio_context(&p_fmt_ctx->pb);
+	if (nullptr != p_custom_avio)
+	{
+		// Not avio_closep(), which would close it as if FFmpeg opened it.
+		avio_flush(p_custom_avio);
+		custom_io::free_av_io_context(&p_custom_avio);
+		p_fmt_ctx->pb = nullptr;
+	}
+	else
+	{
+		ffhelpers::safely_free_avio_context(&p_fmt_ctx->pb);
+	}
 	// Then free the fmt ctx.
 	ffhelpers::safely_free_format_context(&p_fmt_ctx);
 }
@@ -239,7 +318,46 @@ void ff::muxer::prepare_muxer(dict& options)
 	options = pavd;
 }
 
+void ff::muxer::set_low_latency(int64_t max_interleave_delay_us)
+{
+	if (ready)
+	{
+		throw std::logic_error("Low latency must be set before the muxer is prepared.");
+	}
+	if (max_interleave_delay_us <= 0)
+	{
+		throw std::invalid_argument("The interleave delay must be positive.");
+	}
+
+	p_fmt_ctx->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+	p_fmt_ctx->flush_packets = 1;
+	// 0 would mean waiting for a packet of every stream, however long it takes.
+	p_fmt_ctx->max_interleave_delta = max_interleave_delay_us;
+	// In AV_TIME_BASE units, too.
+	p_fmt_ctx->max_delay = static_cast<int>(std::min<int64_t>(max_interleave_delay_us, INT_MAX));
+}
+
+bool ff::muxer::low_latency() const noexcept
+{
+	return nullptr != p_fmt_ctx && (p_fmt_ctx->flags & AVFMT_FLAG_FLUSH_PACKETS);
+}
+
 void ff::muxer::mux_packet_auto(packet& pkt)
+{
+	internal_check_auto_muxing();
+	internal_mux_packet_auto(pkt);
+}
+
+void ff::muxer::mux_packets_auto(std::span<packet> pkts)
+{
+	internal_check_auto_muxing();
+	for (auto& pkt : pkts)
+	{
+		internal_mux_packet_auto(pkt);
+	}
+}
+
+void ff::muxer::internal_check_auto_muxing()
 {
 	if (!ready)
 	{
@@ -252,6 +370,12 @@ void ff::muxer::mux_packet_auto(packet& pkt)
 	}
 
 	auto_muxing_called = true;
+}
+
+void ff::muxer::internal_mux_packet_auto(packet& pkt)
+{
+	FF_METRICS_SAMPLE(metrics_probe, 0);
+	FF_METRICS_ADD(1, pkt->size);
 
 	internal_sync_packet(pkt);
 
@@ -293,6 +417,9 @@ void ff::muxer::mux_packet_manual(packet& pkt)
 
 	manual_muxing_called = true;
 
+	FF_METRICS_SAMPLE(metrics_probe, 0);
+	FF_METRICS_ADD(1, pkt->size);
+
 	internal_sync_packet(pkt);
 
 	int ret = av_write_frame(p_fmt_ctx, pkt.av_packet());
@@ -348,6 +475,35 @@ void ff::muxer::flush_demuxer()
 	}
 }
 
+void ff::muxer::flush_interleaving()
+{
+	if (!ready)
+	{
+		throw std::logic_error("You must prepare the muxer first.");
+	}
+
+	// Pass nullptr to write what is held for interleaving.
+	int ret = av_interleaved_write_frame(p_fmt_ctx, nullptr);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		case AVERROR(EIO):
+			throw std::filesystem::filesystem_error
+			(
+				"Unexpected I/O error happened when flushing the interleaving queue.", p_fmt_ctx->url,
+				std::make_error_code(std::errc::io_error)
+			);
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error happened when flushing the interleaving queue", ret);
+		}
+	}
+}
+
 void ff::muxer::finalize()
 {
 	if (!ready)
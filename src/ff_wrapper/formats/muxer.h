@@ -18,22 +18,27 @@
 #include "media_base.h"
 #include "stream.h"
 #include "../util/dict.h"
+#include "../util/metrics.h"
 
+#include <span>
 #include <string>
 
 struct AVOutputFormat;
+struct AVIOContext;
 namespace std { namespace filesystem { class path; } }
 
 namespace ff
 {
 	class packet;
 	class encoder;
+	class custom_io;
 
 	/*
-	* A muxer of this class muxes packets into a local file.
+	* A muxer of this class muxes packets into a local file,
+	* or anything else through a custom_io (e.g. bytes in memory).
 	* 
 	* Muxer states:
-	*	1. Can only be constructed if you give a path to the output file.
+	*	1. Can only be constructed if you give a path to the output file, or a custom_io to write to.
 	*	2. After that you fill all additional information. Mostly you create the streams.
 	*	3. Then call prepare_muxer() to make it ready. The method also writes the file header.
 	* 
@@ -73,6 +78,24 @@ namespace ff
 			const std::string& fmt_mime_type = ""
 		);
 
+		/*
+		* Creates a muxer that writes through io instead of to a local file.
+		* As there is no file extension, the format must be given by its name or MIME type.
+		* The muxer will be CREATED after the call.
+		* 
+		* @param io what to write to. It must outlive the muxer and can only be used by it.
+		* Many formats need io to be seekable (e.g. MP4, unless it's fragmented).
+		* @param fmt_name Unique format name used in FFmpeg for the format.
+		* @param fmt_mime_type optional. MIME type for the format.
+		* @throws std::invalid_argument if the names together provide no information on the format.
+		*/
+		muxer
+		(
+			custom_io& io,
+			const std::string& fmt_name,
+			const std::string& fmt_mime_type = ""
+		);
+
 		/*
 		* Destroys the muxer completely.
 		*/
@@ -148,6 +171,27 @@ namespace ff
 		*/
 		void prepare_muxer(dict& options);
 
+		/*
+		* Sets the muxer up for live streams, so that each packet reaches the output as soon as it's muxed:
+		*	1. The output is flushed after every packet (AVFMT_FLAG_FLUSH_PACKETS),
+		*	2. mux_packet_auto() holds packets for interleaving for at most max_interleave_delay_us,
+		*	3. formats that delay muxing by themselves (e.g. mpegts) do so for at most max_interleave_delay_us, too.
+		* 
+		* For the lowest latency, use mux_packet_manual() as well, which doesn't hold packets at all,
+		* and interleave the streams by feeding them in the order they are encoded.
+		* Call it before prepare_muxer(), as some formats read the settings when writing the header.
+		* 
+		* @param max_interleave_delay_us in microseconds.
+		* @throws std::invalid_argument if max_interleave_delay_us <= 0.
+		* @throws std::logic_error if you have already called prepare_muxer().
+		*/
+		void set_low_latency(int64_t max_interleave_delay_us = 50000);
+
+		/*
+		* @returns true iff set_low_latency() has been called.
+		*/
+		bool low_latency() const noexcept;
+
 		/*
 		* Mux a packet into the file.
 		* The interleaving of packets will automatically be managed by the muxer.
@@ -159,6 +203,8 @@ namespace ff
 		* except in rare situations the dts can be non-decreasing. This parameter is nonconst because 
 		* its properties (not data) may be modified by the method. In addition, the FFmpeg av_interleaved_write_frame()
 		* requires a non-const pointer to it.
+		* Afterwards, the muxer owns pkt's data and pkt is blank.
+		* You can give it back to a packet_pool with packet_pool::recycle().
 		* @throws std::invalid_argument if the packet is invalid.
 		* @throws std::logic_error if you have already called mux_packet_manual().
 		* @throws std::logic_error if you have not prepared the demuxer yet.
@@ -166,6 +212,15 @@ namespace ff
 		*/
 		void mux_packet_auto(packet& pkt);
 
+		/*
+		* Same as calling mux_packet_auto() for each of pkts in order,
+		* but the state of the muxer is only checked once.
+		* If one fails, those after it are not muxed.
+		* 
+		* @throws what mux_packet_auto() throws.
+		*/
+		void mux_packets_auto(std::span<packet> pkts);
+
 		/*
 		* Mux a packet into the file.
 		* The interleaving of packets must have already been managed by you.
@@ -177,6 +232,8 @@ namespace ff
 		* except in rare situations the dts can be non-decreasing. This parameter is nonconst because 
 		* its properties (not data) may be modified by the method. In addition, the FFmpeg av_interleaved_write_frame()
 		* requires a non-const pointer to it.
+		* Afterwards, pkt still holds its data.
+		* You can give it back to a packet_pool with packet_pool::recycle().
 		* @throws std::invalid_argument if the packet is invalid.
 		* @throws std::logic_error if you have already called mux_packet_auto().
 		* @throws std::logic_error if you have not prepared the demuxer yet.
@@ -191,6 +248,15 @@ namespace ff
 		*/
 		void flush_demuxer();
 
+		/*
+		* Writes all the packets that mux_packet_auto() holds for interleaving,
+		* e.g. before flush_demuxer() when a fragment must hold every packet given so far.
+		* Muxing can continue afterwards.
+		* @throws std::logic_error if you have not prepared the demuxer yet.
+		* @throws std::filesystem::filesystem_error on I/O error.
+		*/
+		void flush_interleaving();
+
 		/*
 		* After you have no packets to give, you MUST call this method
 		* to finalize the muxing.
@@ -327,6 +393,12 @@ namespace ff
 
 		const AVOutputFormat* p_muxer_desc = nullptr;
 
+		/*
+		* The AVIOContext created for the custom_io the muxer writes to.
+		* nullptr if it writes a local file.
+		*/
+		::AVIOContext* p_custom_avio = nullptr;
+
 		// pts of the last demuxed pkt
 		int64_t last_pts = AV_NOPTS_VALUE;
 		// pts of the last demuxed pkt
@@ -339,6 +411,11 @@ namespace ff
 		// if mux_packet_manual() has been called.
 		bool manual_muxing_called = false;
 
+#ifdef FF_WRAPPER_ENABLE_METRICS
+		// Stages: mux_packet (either way). See metrics.h.
+		metrics::probe metrics_probe{ "muxer", { "mux_packet" } };
+#endif // FF_WRAPPER_ENABLE_METRICS
+
 ////////////////////////// Internal helper methods //////////////////////////
 	private:
 		/*
@@ -347,6 +424,10 @@ namespace ff
 		* prepare_muxer().
 		*/
 		void internal_create_muxer(const std::string& path);
+		/*
+		* Like above, but the muxer writes to io.
+		*/
+		void internal_create_muxer(custom_io& io);
 
 		/*
 		* Closes the output file, and completely destroys the muxer and any resource it holds.
@@ -358,6 +439,15 @@ namespace ff
 		*/
 		void internal_prepare_muxer(::AVDictionary** ppavd);
 
+		/*
+		* Checks the state for mux_packet(s)_auto() and records that it's called.
+		*/
+		void internal_check_auto_muxing();
+		/*
+		* Common piece of code for mux_packet(s)_auto(), after the checks.
+		*/
+		void internal_mux_packet_auto(packet& pkt);
+
 		/*
 		* Common piece of code for the two add_stream methods.
 		* @param properties to set to the new stream.
@@ -0,0 +1,352 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "packet_trace.h"
+#include "mmap_io.h"
+#include "../data/frame.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	// Change the version whenever the layout of a trace changes.
+	constexpr char magic[8] = { 'F', 'F', 'W', 'T', 'R', 'A', 'C', 'E' };
+	constexpr uint32_t version = 1;
+	// Read in the other byte order, it's different.
+	constexpr uint32_t byte_order_mark = 0x01020304;
+
+	// Payloads start at multiples of it, so that each one starts on its own cache line.
+	constexpr uint64_t payload_alignment = 64;
+
+	struct trace_header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order_mark;
+		uint64_t num_packets;
+		uint64_t payload_bytes;
+		uint64_t info_offset;
+		uint64_t info_size;
+		uint64_t table_offset;
+	};
+
+	uint64_t align_up(uint64_t v)
+	{
+		return (v + payload_alignment - 1) / payload_alignment * payload_alignment;
+	}
+
+	// Keeps the mapping for as long as a packet, or a frame a decoder made from it, refers to it.
+	void release_mapping(void* opaque, uint8_t*) noexcept
+	{
+		delete static_cast<std::shared_ptr<ff::mmap_io>*>(opaque);
+	}
+
+	/*
+	* @param sorted not empty.
+	* @returns the q-quantile of sorted, as the nearest rank.
+	*/
+	uint64_t quantile(const std::vector<uint64_t>& sorted, double q)
+	{
+		const size_t rank = static_cast<size_t>(std::ceil(q * sorted.size()));
+		return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+	}
+}
+
+ff::packet_trace::packet_trace(const fs::path& path)
+	: map(std::make_shared<mmap_io>(path))
+{
+	const uint8_t* base = map->data();
+	const uint64_t size = map->size();
+
+	trace_header h;
+	if (size < sizeof(h))
+	{
+		throw std::invalid_argument("The file is too small to be a trace.");
+	}
+	std::copy(base, base + sizeof(h), reinterpret_cast<uint8_t*>(&h));
+	if (!std::equal(magic, magic + sizeof(magic), h.magic)
+		|| version != h.version || byte_order_mark != h.byte_order_mark)
+	{
+		throw std::invalid_argument("The file is not a trace of this version and byte order.");
+	}
+
+	if (h.info_offset > size || h.info_size > size - h.info_offset)
+	{
+		throw std::invalid_argument("The stream info of the trace is broken.");
+	}
+	std::istringstream is(std::string(reinterpret_cast<const char*>(base + h.info_offset), h.info_size));
+	if (!stream_info_cache::read(is, info))
+	{
+		throw std::invalid_argument("The stream info of the trace is broken.");
+	}
+
+	if (h.table_offset > size || 0 != h.table_offset % alignof(entry)
+		|| h.num_packets > (size - h.table_offset) / sizeof(entry))
+	{
+		throw std::invalid_argument("The packet table of the trace is broken.");
+	}
+	// The mapping starts at a page, so the table is aligned as its offset is.
+	table = reinterpret_cast<const entry*>(base + h.table_offset);
+	n = static_cast<size_t>(h.num_packets);
+	bytes = h.payload_bytes;
+
+	// So that get_packet() never reads outside of the mapping.
+	for (size_t i = 0; i < n; ++i)
+	{
+		const entry& e = table[i];
+		if (e.offset > h.table_offset || e.size + uint64_t(AV_INPUT_BUFFER_PADDING_SIZE) > h.table_offset - e.offset)
+		{
+			throw std::invalid_argument("A packet of the trace is broken.");
+		}
+	}
+}
+
+ff::packet_trace::~packet_trace() noexcept = default;
+
+size_t ff::packet_trace::record(demuxer& dem, int stream_ind, const fs::path& dst, size_t max_packets)
+{
+	const cached_stream_info s_info = stream_info_cache::capture(dem.get_stream(stream_ind));
+
+	fs::path tmp = dst;
+	tmp += ".tmp";
+
+	std::vector<entry> entries;
+	{
+		std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+		const char zeros[payload_alignment + AV_INPUT_BUFFER_PADDING_SIZE] = {};
+		// Pads to the next payload.
+		auto pad = [&]()
+		{
+			const uint64_t pos = static_cast<uint64_t>(os.tellp());
+			os.write(zeros, align_up(pos) - pos);
+		};
+
+		trace_header h{};
+		std::copy(magic, magic + sizeof(magic), h.magic);
+		h.version = version;
+		h.byte_order_mark = byte_order_mark;
+		// Written again at the end, when it's known.
+		os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+		h.info_offset = sizeof(h);
+		stream_info_cache::write(os, s_info);
+		h.info_size = static_cast<uint64_t>(os.tellp()) - h.info_offset;
+		pad();
+
+		packet pkt;
+		while ((0 == max_packets || entries.size() < max_packets) && os.good() && dem.demux_next_packet(pkt))
+		{
+			if (stream_ind != pkt->stream_index)
+			{
+				continue;
+			}
+
+			entry e;
+			e.pts = pkt->pts;
+			e.dts = pkt->dts;
+			e.duration = pkt->duration;
+			e.offset = static_cast<uint64_t>(os.tellp());
+			e.size = static_cast<uint32_t>(pkt->size);
+			e.flags = static_cast<uint32_t>(pkt->flags);
+			entries.push_back(e);
+
+			os.write(reinterpret_cast<const char*>(pkt->data), pkt->size);
+			os.write(zeros, AV_INPUT_BUFFER_PADDING_SIZE);
+			h.payload_bytes += e.size;
+			pad();
+		}
+
+		h.num_packets = entries.size();
+		h.table_offset = static_cast<uint64_t>(os.tellp());
+		os.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(entry));
+
+		os.seekp(0);
+		os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+		os.flush();
+		if (!os.good())
+		{
+			os.close();
+			std::error_code ec;
+			fs::remove(tmp, ec);
+			throw fs::filesystem_error
+			(
+				"Could not write the trace.", tmp,
+				std::make_error_code(std::errc::io_error)
+			);
+		}
+	}
+
+	fs::rename(tmp, dst);
+	return entries.size();
+}
+
+ff::decoder ff::packet_trace::make_decoder(const codec_base::threading_policy& policy) const
+{
+	decoder dec(static_cast<AVCodecID>(info.codec_id));
+	dec.set_codec_properties(stream_info_cache::to_properties(info));
+	dec.set_threading_policy(policy);
+	dec.create_codec_context();
+	return dec;
+}
+
+ff::packet ff::packet_trace::get_packet(size_t i) const
+{
+	const entry& e = get_entry(i);
+
+	AVPacket* p = av_packet_alloc();
+	if (nullptr == p)
+	{
+		throw std::bad_alloc();
+	}
+	auto* keep = new(std::nothrow) std::shared_ptr<mmap_io>(map);
+	// FFmpeg never writes to a read only buffer; it copies it first if it must.
+	p->buf = nullptr == keep ? nullptr : av_buffer_create
+	(
+		const_cast<uint8_t*>(map->data() + e.offset), e.size + AV_INPUT_BUFFER_PADDING_SIZE,
+		release_mapping, keep, AV_BUFFER_FLAG_READONLY
+	);
+	if (nullptr == p->buf)
+	{
+		delete keep;
+		av_packet_free(&p);
+		throw std::bad_alloc();
+	}
+	p->data = p->buf->data;
+	p->size = static_cast<int>(e.size);
+	p->pts = e.pts;
+	p->dts = e.dts;
+	p->duration = e.duration;
+	p->flags = static_cast<int>(e.flags);
+	p->stream_index = 0;
+
+	return packet(p, time_base(), true);
+}
+
+ff::packet_trace::replay_results ff::packet_trace::replay(decoder& dec, const replay_options& options) const
+{
+	if (!dec.ready())
+	{
+		throw std::logic_error("The decoder is not ready.");
+	}
+	if (dec.no_more_food())
+	{
+		throw std::logic_error("The decoder has been signaled.");
+	}
+	if (options.loops < 1 || options.packets_per_second < 0.0)
+	{
+		throw std::invalid_argument("Invalid replay options.");
+	}
+
+	using clock = std::chrono::steady_clock;
+
+	replay_results res;
+	// When the packet of each pts still on its way was fed.
+	std::unordered_map<int64_t, clock::time_point> fed_at;
+	std::vector<uint64_t> latencies;
+	latencies.reserve(n * options.loops);
+	std::unordered_set<const uint8_t*> buffers;
+
+	frame f(true);
+	auto drain = [&]()
+	{
+		while (dec.decode_frame(f))
+		{
+			const clock::time_point now = clock::now();
+			++res.frames;
+
+			auto it = fed_at.find(f->best_effort_timestamp);
+			if (fed_at.end() != it)
+			{
+				latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - it->second).count());
+				fed_at.erase(it);
+			}
+			if (nullptr != f->buf[0])
+			{
+				buffers.insert(f->buf[0]->data);
+			}
+		}
+	};
+
+	const clock::time_point start = clock::now();
+	for (int loop = 0; loop < options.loops; ++loop)
+	{
+		if (0 != loop)
+		{
+			dec.reset();
+			fed_at.clear();
+		}
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			if (options.packets_per_second > 0.0)
+			{
+				std::this_thread::sleep_until
+				(
+					start + std::chrono::duration_cast<clock::duration>
+					(std::chrono::duration<double>(res.packets / options.packets_per_second))
+				);
+			}
+
+			const packet pkt(get_packet(i));
+			const clock::time_point now = clock::now();
+			while (!dec.feed_packet(pkt))
+			{
+				// Full. Taking frames out makes room.
+				drain();
+			}
+			if (AV_NOPTS_VALUE != pkt->pts)
+			{
+				fed_at.emplace(pkt->pts, now);
+			}
+			++res.packets;
+
+			drain();
+		}
+
+		dec.signal_no_more_food();
+		drain();
+	}
+	res.seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+	if (!latencies.empty())
+	{
+		std::sort(latencies.begin(), latencies.end());
+		res.latency_p50_ns = quantile(latencies, 0.50);
+		res.latency_p90_ns = quantile(latencies, 0.90);
+		res.latency_p99_ns = quantile(latencies, 0.99);
+		res.latency_max_ns = latencies.back();
+	}
+	res.frame_buffers = buffers.size();
+
+	return res;
+}
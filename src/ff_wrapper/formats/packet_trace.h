@@ -0,0 +1,187 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* packet_trace.h:
+* Records the packets of a stream into a trace file, and replays them into a decoder
+* without demuxing or reading the disk.
+*/
+
+#include "../util/util.h"
+#include "../codec/decoder.h"
+#include "../data/packet.h"
+#include "demuxer.h"
+#include "stream_info_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+namespace ff
+{
+	class mmap_io;
+
+	/*
+	* A recorded stream of packets: their payloads and times, and what a decoder needs to know of the stream
+	* (see cached_stream_info). It takes the demuxer and the disk out of decoder benchmarks:
+	* record() a stream once, then open the trace and replay() it into decoders as many times as needed,
+	* each time with exactly the same packets.
+	*
+	* The trace file is mapped into memory, and the packets I give out refer to the mapped payloads without copying them.
+	* Each packet holds a reference to the mapping, so it (and a frame a decoder made from it) stays valid after I am destroyed.
+	* In the file, each payload is followed by FFmpeg's input padding, so decoders can read them as they are.
+	*
+	* The layout, in the byte order of the machine (like stream_info_cache's sidecar, it's for the same kind of machine only):
+	*	header | stream info | payloads, each padded and aligned to 64 bytes | one entry per packet
+	*
+	* The side data of the packets are not recorded.
+	*
+	* Once constructed, nothing in me changes, so get_packet() and the accessors can be called from several threads at once.
+	*/
+	class FF_WRAPPER_API packet_trace final
+	{
+	public:
+		/*
+		* What's recorded of a packet besides its payload. Times are in the time base of the stream.
+		*/
+		struct entry
+		{
+			int64_t pts;
+			int64_t dts;
+			int64_t duration;
+			// Of the payload, from the start of the file.
+			uint64_t offset;
+			uint32_t size;
+			// AV_PKT_FLAG_...
+			uint32_t flags;
+		};
+
+		struct replay_options
+		{
+			// At most how many packets are fed per second, to see how a decoder does in real time.
+			// 0 to feed them as fast as the decoder takes them.
+			double packets_per_second = 0.0;
+			// How many times the trace is fed. The decoder is reset() between loops.
+			int loops = 1;
+		};
+
+		struct replay_results
+		{
+			uint64_t packets = 0;
+			uint64_t frames = 0;
+			// From the first feed to the last frame.
+			double seconds = 0.0;
+
+			// From feeding a packet to getting the frame of its pts, in ns.
+			// Frames that match no packet fed (e.g. those whose timestamps the decoder makes up) are not counted.
+			uint64_t latency_p50_ns = 0;
+			uint64_t latency_p90_ns = 0;
+			uint64_t latency_p99_ns = 0;
+			uint64_t latency_max_ns = 0;
+
+			// How many different data buffers the frames came in:
+			// as many as the frames if each one was allocated anew, and only a few if the decoder reuses them.
+			// An allocation that lands where an earlier one was freed counts as reuse.
+			uint64_t frame_buffers = 0;
+
+			double frames_per_second() const noexcept { return seconds > 0.0 ? frames / seconds : 0.0; }
+		};
+
+	public:
+		packet_trace() = delete;
+
+		/*
+		* Maps a trace file made by record().
+		*
+		* @throws std::filesystem::filesystem_error if the file cannot be opened or mapped.
+		* @throws std::invalid_argument if it's not a valid trace of this version and byte order.
+		*/
+		explicit packet_trace(const std::filesystem::path& path);
+
+		packet_trace(const packet_trace&) = delete;
+		packet_trace& operator=(const packet_trace&) = delete;
+
+		/*
+		* Drops my reference to the mapping. The file is unmapped once the packets I gave out are gone, too.
+		*/
+		~packet_trace() noexcept;
+
+	public:
+		/*
+		* Demuxes dem from where it is, and records the packets of the stream stream_ind into a trace at dst.
+		* The trace is written to a temporary file first and then renamed, so that others never map half of it.
+		*
+		* @param max_packets at most how many to record. 0 for all.
+		* @returns how many packets are recorded.
+		* @throws std::out_of_range if stream_ind is not of dem.
+		* @throws std::filesystem::filesystem_error on I/O error.
+		* @throws what demuxer::demux_next_packet() throws.
+		*/
+		static size_t record(demuxer& dem, int stream_ind, const std::filesystem::path& dst, size_t max_packets = 0);
+
+	public:
+		size_t num_packets() const noexcept { return n; }
+		// Of all the payloads, without the padding.
+		uint64_t payload_bytes() const noexcept { return bytes; }
+		const cached_stream_info& stream_info() const noexcept { return info; }
+		ff::rational time_base() const noexcept { return ff::rational(info.tb_num, info.tb_den); }
+
+		/*
+		* @throws std::out_of_range if i >= num_packets().
+		*/
+		const entry& get_entry(size_t i) const
+		{
+			if (i >= n)
+			{
+				throw std::out_of_range("No such packet in the trace.");
+			}
+			return table[i];
+		}
+
+		/*
+		* @returns a ready decoder of the stream.
+		* @throws std::invalid_argument if the codec is not supported, or if the policy is invalid.
+		*/
+		decoder make_decoder(const codec_base::threading_policy& policy = codec_base::threading_policy()) const;
+
+		/*
+		* @returns the i-th packet, ready. Its payload is the mapped one, read only.
+		* @throws std::out_of_range if i >= num_packets().
+		*/
+		packet get_packet(size_t i) const;
+
+		/*
+		* Feeds all packets to dec, taking the frames out as it goes, and then signals and drains it.
+		*
+		* @param dec a ready decoder of the stream (e.g. from make_decoder()) that has not been signaled.
+		* @throws std::logic_error if dec is not ready, or if it has been signaled.
+		* @throws std::invalid_argument if options.loops < 1 or options.packets_per_second < 0.
+		* @throws what the decoder throws.
+		*/
+		replay_results replay(decoder& dec, const replay_options& options = replay_options()) const;
+
+	private:
+		// Shared with the packets given out.
+		std::shared_ptr<mmap_io> map;
+		const entry* table = nullptr;
+		size_t n = 0;
+		uint64_t bytes = 0;
+		cached_stream_info info;
+	};
+}
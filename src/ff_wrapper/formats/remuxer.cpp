@@ -0,0 +1,233 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "remuxer.h"
+#include "demuxer.h"
+#include "muxer.h"
+#include "../data/packet.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <span>
+#include <stdexcept>
+
+ff::remuxer::remuxer(demuxer& dem, muxer& mux, const std::vector<int>& in_streams)
+	: dem(&dem), mux(&mux), routes(dem.num_streams())
+{
+	std::vector<int> to_copy(in_streams);
+	if (to_copy.empty())
+	{
+		for (int i = 0; i < dem.num_streams(); ++i)
+		{
+			const stream s = dem.get_stream(i);
+			if ((s.is_video() && mux.supports_video())
+				|| (s.is_audio() && mux.supports_audio())
+				|| (s.is_subtitle() && mux.supports_subtitle()))
+			{
+				to_copy.push_back(i);
+			}
+		}
+	}
+
+	for (int i : to_copy)
+	{
+		if (i < 0 || i >= dem.num_streams())
+		{
+			throw std::out_of_range("Stream index out of range.");
+		}
+		if (routes[i].out_index >= 0)
+		{
+			throw std::invalid_argument("A stream cannot be copied twice.");
+		}
+
+		// Throws std::logic_error if mux is prepared.
+		routes[i].out_index = mux.add_stream(dem.get_stream(i)).index();
+	}
+}
+
+void ff::remuxer::set_bitstream_filter(int in_stream, const std::string& filters)
+{
+	if (ran)
+	{
+		throw std::logic_error("Bitstream filters cannot be set after the remuxer runs.");
+	}
+	if (in_stream < 0 || in_stream >= static_cast<int>(routes.size()))
+	{
+		throw std::out_of_range("Stream index out of range.");
+	}
+
+	route& r = routes[in_stream];
+	if (r.out_index < 0)
+	{
+		throw std::invalid_argument("The stream is dropped.");
+	}
+
+	auto bsf = std::make_unique<bitstream_filter>(filters, dem->get_stream(in_stream));
+
+	// The muxer hasn't been prepared, so the output stream can still be changed.
+	stream out_s = mux->get_stream(r.out_index);
+	codec_properties::avcodec_parameters_copy(*out_s->codecpar, *bsf->out_properties().av_codec_parameters());
+	// The tag of the input may not suit what the filters give out.
+	out_s->codecpar->codec_tag = 0;
+
+	r.bsf = std::move(bsf);
+}
+
+size_t ff::remuxer::run(const dict& options, size_t batch_size)
+{
+	if (ran)
+	{
+		throw std::logic_error("A remuxer can only run once.");
+	}
+	if (0 == batch_size)
+	{
+		throw std::invalid_argument("The batch size cannot be 0.");
+	}
+	ran = true;
+
+	mux->prepare_muxer(options);
+	internal_compute_routes();
+
+	// Reused for every batch. After muxing, they are blank and can be demuxed into again.
+	std::vector<packet> batch(batch_size);
+	// Where the filtered packets come out.
+	packet filtered(true);
+	size_t num_muxed = 0;
+
+	bool eof = false;
+	while (!eof)
+	{
+		size_t n = 0;
+		while (n < batch_size)
+		{
+			packet& pkt = batch[n];
+			if (!dem->demux_next_packet(pkt))
+			{
+				eof = true;
+				break;
+			}
+
+			AVPacket* p = pkt.av_packet();
+			const int in = p->stream_index;
+			if (in < 0 || in >= static_cast<int>(routes.size()) || routes[in].out_index < 0)
+			{
+				// Dropped. Reuse the packet.
+				continue;
+			}
+
+			route& r = routes[in];
+			if (r.bsf)
+			{
+				// The filters reference the payload, so the packet can be reused.
+				while (!r.bsf->feed_packet(pkt))
+				{
+					num_muxed += internal_mux_filtered(r, filtered);
+				}
+				num_muxed += internal_mux_filtered(r, filtered);
+				continue;
+			}
+
+			internal_route_packet(r, pkt);
+			++n;
+		}
+
+		mux->mux_packets_auto(std::span<packet>(batch.data(), n));
+		num_muxed += n;
+	}
+
+	// Take out what the filters hold.
+	for (route& r : routes)
+	{
+		if (r.bsf)
+		{
+			r.bsf->signal_no_more_food();
+			num_muxed += internal_mux_filtered(r, filtered);
+		}
+	}
+
+	mux->finalize();
+
+	return num_muxed;
+}
+
+int ff::remuxer::output_index(int in_stream) const
+{
+	if (in_stream < 0 || in_stream >= static_cast<int>(routes.size()))
+	{
+		throw std::out_of_range("Stream index out of range.");
+	}
+
+	return routes[in_stream].out_index;
+}
+
+void ff::remuxer::internal_compute_routes()
+{
+	for (int i = 0; i < static_cast<int>(routes.size()); ++i)
+	{
+		route& r = routes[i];
+		if (r.out_index < 0)
+		{
+			continue;
+		}
+
+		// The filters may change the time base.
+		const AVRational in_tb = r.bsf ? r.bsf->out_time_base().av_rational() : dem->get_stream(i)->time_base;
+		const AVRational out_tb = mux->get_stream(r.out_index)->time_base;
+
+		r.rescaler = ff::time_rescaler(in_tb, out_tb);
+	}
+}
+
+void ff::remuxer::internal_route_packet(route& r, packet& pkt)
+{
+	AVPacket* p = pkt.av_packet();
+
+	r.rescaler.rescale(p->pts, p->dts, p->duration);
+	// Keep the dts of each stream increasing, which the muxer requires.
+	if (AV_NOPTS_VALUE != p->dts)
+	{
+		if (INT64_MIN != r.last_dts && p->dts <= r.last_dts)
+		{
+			p->dts = r.last_dts + 1;
+			if (AV_NOPTS_VALUE != p->pts && p->pts < p->dts)
+			{
+				p->pts = p->dts;
+			}
+		}
+		r.last_dts = p->dts;
+	}
+
+	p->time_base = mux->get_stream(r.out_index)->time_base;
+	p->stream_index = r.out_index;
+	// The position is that in the input.
+	p->pos = -1;
+}
+
+size_t ff::remuxer::internal_mux_filtered(route& r, packet& out)
+{
+	size_t n = 0;
+	while (r.bsf->filter_packet(out))
+	{
+		internal_route_packet(r, out);
+		// Leaves out blank for the next one.
+		mux->mux_packet_auto(out);
+		++n;
+	}
+
+	return n;
+}
@@ -0,0 +1,149 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class remuxer.
+*/
+
+#include "../util/util.h"
+#include "../util/dict.h"
+#include "../util/ff_time.h"
+#include "../codec/bitstream_filter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ff
+{
+	class demuxer;
+	class muxer;
+
+	/*
+	* Copies the streams of a demuxer into a muxer without decoding (e.g. MKV to MP4).
+	* 
+	* Streams are mapped once at construction and the time base conversions
+	* are worked out once the muxer is prepared, so that per packet only
+	* the index is changed and the time fields are multiplied by a reduced fraction.
+	* Packets are demuxed in batches into packets that are reused,
+	* and their payloads are moved into the muxer without copying.
+	* 
+	* A stream can be passed through bitstream filters on the way
+	* (e.g. h264_mp4toannexb for MP4 to MPEG-TS), see set_bitstream_filter().
+	* 
+	* I don't own the demuxer or the muxer, and they must outlive me.
+	*/
+	class FF_WRAPPER_API remuxer final
+	{
+	public:
+		static constexpr size_t default_batch_size = 64;
+
+	public:
+		remuxer() = delete;
+
+		/*
+		* Adds the output streams to mux.
+		* 
+		* @param dem where the packets come from. It should be at the start.
+		* @param mux where the packets go. It must not be prepared yet.
+		* @param in_streams the indices of the streams of dem to copy, in the order of the output streams.
+		* Empty for all the video, audio, and subtitle streams that mux supports.
+		* @throws std::out_of_range if an index is out of range.
+		* @throws std::invalid_argument if an index is given twice.
+		* @throws std::logic_error if mux has been prepared.
+		*/
+		remuxer(demuxer& dem, muxer& mux, const std::vector<int>& in_streams = std::vector<int>());
+
+		remuxer(const remuxer&) = delete;
+		remuxer& operator=(const remuxer&) = delete;
+
+	public:
+		/*
+		* Passes the packets of an input stream through bitstream filters before muxing them,
+		* and gives the filtered properties (e.g. the extradata) to its output stream.
+		* 
+		* @param in_stream the index of the input stream.
+		* @param filters the chain, e.g. "h264_mp4toannexb". See bitstream_filter.
+		* Empty to pass the packets through unchanged.
+		* Use bitstream_filter::annexb_filter_for() to find what a stream needs for MPEG-TS.
+		* @throws std::logic_error if run() has been called.
+		* @throws std::out_of_range if in_stream is out of range.
+		* @throws std::invalid_argument if in_stream is dropped, or if the filters cannot be created for it.
+		*/
+		void set_bitstream_filter(int in_stream, const std::string& filters);
+
+		/*
+		* Prepares the muxer, copies all the packets, and finalizes the muxer.
+		* Can only be called once.
+		* 
+		* @param options given to muxer::prepare_muxer().
+		* @param batch_size at most how many packets are demuxed before they are muxed.
+		* @returns how many packets are muxed.
+		* @throws std::logic_error if it has been called.
+		* @throws std::invalid_argument if batch_size is 0.
+		* @throws what the demuxer/muxer throws.
+		*/
+		size_t run(const dict& options = dict(), size_t batch_size = default_batch_size);
+
+		/*
+		* @returns the index of the output stream the input stream goes to, or -1 if it's dropped.
+		* @throws std::out_of_range if in_stream is out of range.
+		*/
+		int output_index(int in_stream) const;
+
+	private:
+		/*
+		* How a packet of an input stream is changed.
+		*/
+		struct route
+		{
+			// -1 if the stream is dropped.
+			int out_index = -1;
+			// From the input stream's time base to the output stream's.
+			time_rescaler rescaler{ rational(1, 1), rational(1, 1) };
+			// To keep the dts increasing.
+			int64_t last_dts = INT64_MIN;
+			// nullptr if the packets are muxed as they are.
+			std::unique_ptr<bitstream_filter> bsf;
+		};
+
+		/*
+		* Works out the conversions after the muxer is prepared, when the output time bases are final.
+		*/
+		void internal_compute_routes();
+
+		/*
+		* Changes the fields of pkt for its output stream, as r says.
+		*/
+		void internal_route_packet(route& r, packet& pkt);
+
+		/*
+		* Muxes what r's filters give out right away.
+		* 
+		* @returns how many packets are muxed.
+		*/
+		size_t internal_mux_filtered(route& r, packet& out);
+
+	private:
+		demuxer* dem;
+		muxer* mux;
+		std::vector<route> routes;
+		bool ran = false;
+	};
+}
@@ -0,0 +1,511 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "stream_info_cache.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+}
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	// Change the version whenever the format of the sidecar changes.
+	constexpr char magic[8] = { 'F', 'F', 'W', 'I', 'N', 'F', 'O', '\0' };
+	constexpr uint32_t version = 1;
+	// Read in the other byte order, it's different.
+	constexpr uint32_t byte_order_mark = 0x01020304;
+
+	// Guards against reading a huge size from a broken sidecar.
+	constexpr uint64_t max_element_count = uint64_t(1) << 32;
+
+	/*
+	* What a sidecar is keyed by.
+	*/
+	struct file_key
+	{
+		std::string path;
+		uint64_t size = 0;
+		int64_t mtime = 0;
+
+		bool operator==(const file_key&) const = default;
+	};
+
+	file_key make_key(const fs::path& media)
+	{
+		file_key key;
+		key.path = fs::absolute(media).generic_string();
+		key.size = fs::file_size(media);
+		key.mtime = fs::last_write_time(media).time_since_epoch().count();
+		return key;
+	}
+
+	// One list of the fields for both writing and reading, so that they cannot go out of sync.
+	// Arc is either writer or reader, and T is either const or not, respectively.
+
+	template <typename Arc, typename T>
+		requires std::is_same_v<std::remove_const_t<T>, file_key>
+	void transfer(Arc& ar, T& k)
+	{
+		ar(k.path); ar(k.size); ar(k.mtime);
+	}
+
+	template <typename Arc, typename T>
+		requires std::is_same_v<std::remove_const_t<T>, ff::demuxer::index_entry>
+	void transfer(Arc& ar, T& e)
+	{
+		ar(e.pts); ar(e.dts); ar(e.pos); ar(e.keyframe);
+	}
+
+	template <typename Arc, typename T>
+		requires std::is_same_v<std::remove_const_t<T>, std::vector<ff::demuxer::index_entry>>
+	void transfer(Arc& ar, T& v)
+	{
+		ar(v);
+	}
+
+	template <typename Arc, typename T>
+		requires std::is_same_v<std::remove_const_t<T>, ff::cached_stream_info>
+	void transfer(Arc& ar, T& s)
+	{
+		ar(s.codec_type); ar(s.codec_id); ar(s.codec_tag); ar(s.extradata);
+		ar(s.format); ar(s.bit_rate); ar(s.bits_per_coded_sample); ar(s.bits_per_raw_sample);
+		ar(s.profile); ar(s.level); ar(s.width); ar(s.height); ar(s.sar_num); ar(s.sar_den);
+		ar(s.field_order); ar(s.color_range); ar(s.color_primaries); ar(s.color_trc);
+		ar(s.color_space); ar(s.chroma_location); ar(s.video_delay);
+		ar(s.ch_order); ar(s.ch_nb_channels); ar(s.ch_mask);
+		ar(s.sample_rate); ar(s.block_align); ar(s.frame_size);
+		ar(s.initial_padding); ar(s.trailing_padding); ar(s.seek_preroll);
+
+		ar(s.tb_num); ar(s.tb_den); ar(s.start_time); ar(s.duration); ar(s.nb_frames);
+		ar(s.avg_fr_num); ar(s.avg_fr_den); ar(s.r_fr_num); ar(s.r_fr_den); ar(s.disposition);
+	}
+
+	template <typename Arc, typename T>
+		requires std::is_same_v<std::remove_const_t<T>, ff::cached_file_info>
+	void transfer(Arc& ar, T& f)
+	{
+		ar(f.streams);
+		ar(f.duration); ar(f.start_time); ar(f.bit_rate);
+		ar(f.index);
+	}
+
+	/*
+	* @returns what's stored of st.
+	*/
+	ff::cached_stream_info capture_stream(const AVStream* st)
+	{
+		const AVCodecParameters* par = st->codecpar;
+		ff::cached_stream_info s;
+
+		s.codec_type = par->codec_type;
+		s.codec_id = par->codec_id;
+		s.codec_tag = par->codec_tag;
+		if (nullptr != par->extradata && par->extradata_size > 0)
+		{
+			s.extradata.assign(par->extradata, par->extradata + par->extradata_size);
+		}
+		s.format = par->format;
+		s.bit_rate = par->bit_rate;
+		s.bits_per_coded_sample = par->bits_per_coded_sample;
+		s.bits_per_raw_sample = par->bits_per_raw_sample;
+		s.profile = par->profile;
+		s.level = par->level;
+		s.width = par->width;
+		s.height = par->height;
+		s.sar_num = par->sample_aspect_ratio.num;
+		s.sar_den = par->sample_aspect_ratio.den;
+		s.field_order = par->field_order;
+		s.color_range = par->color_range;
+		s.color_primaries = par->color_primaries;
+		s.color_trc = par->color_trc;
+		s.color_space = par->color_space;
+		s.chroma_location = par->chroma_location;
+		s.video_delay = par->video_delay;
+		s.ch_order = par->ch_layout.order;
+		s.ch_nb_channels = par->ch_layout.nb_channels;
+		// Custom maps cannot be stored.
+		// Storing them as unspecified keeps at least the number of channels.
+		if (AV_CHANNEL_ORDER_CUSTOM == par->ch_layout.order)
+		{
+			s.ch_order = AV_CHANNEL_ORDER_UNSPEC;
+		}
+		else
+		{
+			s.ch_mask = par->ch_layout.u.mask;
+		}
+		s.sample_rate = par->sample_rate;
+		s.block_align = par->block_align;
+		s.frame_size = par->frame_size;
+		s.initial_padding = par->initial_padding;
+		s.trailing_padding = par->trailing_padding;
+		s.seek_preroll = par->seek_preroll;
+
+		s.tb_num = st->time_base.num;
+		s.tb_den = st->time_base.den;
+		s.start_time = st->start_time;
+		s.duration = st->duration;
+		s.nb_frames = st->nb_frames;
+		s.avg_fr_num = st->avg_frame_rate.num;
+		s.avg_fr_den = st->avg_frame_rate.den;
+		s.r_fr_num = st->r_frame_rate.num;
+		s.r_fr_den = st->r_frame_rate.den;
+		s.disposition = st->disposition;
+
+		return s;
+	}
+
+	/*
+	* Fills par with what's stored in s, except what's of the AVStream.
+	* @throws std::bad_alloc if the extradata cannot be allocated. par is unchanged then.
+	*/
+	void apply_parameters(const ff::cached_stream_info& s, AVCodecParameters* par)
+	{
+		// Allocate first, so that nothing is changed if it fails.
+		uint8_t* extradata = nullptr;
+		if (!s.extradata.empty())
+		{
+			// FFmpeg requires the padding.
+			extradata = static_cast<uint8_t*>(av_mallocz(s.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+			if (nullptr == extradata)
+			{
+				throw std::bad_alloc();
+			}
+			std::copy(s.extradata.begin(), s.extradata.end(), extradata);
+		}
+		av_freep(&par->extradata);
+		par->extradata = extradata;
+		par->extradata_size = static_cast<int>(s.extradata.size());
+
+		par->codec_type = static_cast<AVMediaType>(s.codec_type);
+		par->codec_id = static_cast<AVCodecID>(s.codec_id);
+		par->codec_tag = s.codec_tag;
+		par->format = s.format;
+		par->bit_rate = s.bit_rate;
+		par->bits_per_coded_sample = s.bits_per_coded_sample;
+		par->bits_per_raw_sample = s.bits_per_raw_sample;
+		par->profile = s.profile;
+		par->level = s.level;
+		par->width = s.width;
+		par->height = s.height;
+		par->sample_aspect_ratio = AVRational{ s.sar_num, s.sar_den };
+		par->field_order = static_cast<AVFieldOrder>(s.field_order);
+		par->color_range = static_cast<AVColorRange>(s.color_range);
+		par->color_primaries = static_cast<AVColorPrimaries>(s.color_primaries);
+		par->color_trc = static_cast<AVColorTransferCharacteristic>(s.color_trc);
+		par->color_space = static_cast<AVColorSpace>(s.color_space);
+		par->chroma_location = static_cast<AVChromaLocation>(s.chroma_location);
+		par->video_delay = s.video_delay;
+
+		av_channel_layout_uninit(&par->ch_layout);
+		par->ch_layout.order = static_cast<AVChannelOrder>(s.ch_order);
+		par->ch_layout.nb_channels = s.ch_nb_channels;
+		par->ch_layout.u.mask = s.ch_mask;
+
+		par->sample_rate = s.sample_rate;
+		par->block_align = s.block_align;
+		par->frame_size = s.frame_size;
+		par->initial_padding = s.initial_padding;
+		par->trailing_padding = s.trailing_padding;
+		par->seek_preroll = s.seek_preroll;
+	}
+
+	/*
+	* Writes everything given to it. See transfer().
+	*/
+	class writer final
+	{
+	public:
+		explicit writer(std::ostream& os) : os(os) {}
+
+		template <typename T>
+			requires std::is_arithmetic_v<T>
+		void operator()(const T& v)
+		{
+			os.write(reinterpret_cast<const char*>(&v), sizeof(T));
+		}
+
+		void operator()(const std::string& s)
+		{
+			write_count(s.size());
+			os.write(s.data(), s.size());
+		}
+
+		void operator()(const std::vector<uint8_t>& v)
+		{
+			write_count(v.size());
+			os.write(reinterpret_cast<const char*>(v.data()), v.size());
+		}
+
+		template <typename T>
+		void operator()(const std::vector<T>& v)
+		{
+			write_count(v.size());
+			for (const auto& e : v)
+			{
+				transfer(*this, e);
+			}
+		}
+
+		bool good() const { return os.good(); }
+
+	private:
+		void write_count(uint64_t n) { (*this)(n); }
+
+	private:
+		std::ostream& os;
+	};
+
+	/*
+	* Reads everything given to it. See transfer().
+	* Once something fails, it reads nothing more and good() returns false.
+	*/
+	class reader final
+	{
+	public:
+		explicit reader(std::istream& is) : is(is) {}
+
+		template <typename T>
+			requires std::is_arithmetic_v<T>
+		void operator()(T& v)
+		{
+			is.read(reinterpret_cast<char*>(&v), sizeof(T));
+		}
+
+		void operator()(std::string& s)
+		{
+			s.resize(read_count());
+			is.read(s.data(), s.size());
+		}
+
+		void operator()(std::vector<uint8_t>& v)
+		{
+			v.resize(read_count());
+			is.read(reinterpret_cast<char*>(v.data()), v.size());
+		}
+
+		template <typename T>
+		void operator()(std::vector<T>& v)
+		{
+			v.resize(read_count());
+			for (auto& e : v)
+			{
+				if (!good())
+				{
+					return;
+				}
+				transfer(*this, e);
+			}
+		}
+
+		bool good() const { return is.good(); }
+
+	private:
+		size_t read_count()
+		{
+			uint64_t n = 0;
+			(*this)(n);
+			if (!good() || n > max_element_count)
+			{
+				is.setstate(std::ios::failbit);
+				return 0;
+			}
+			return static_cast<size_t>(n);
+		}
+
+	private:
+		std::istream& is;
+	};
+
+}
+
+ff::cached_file_info ff::stream_info_cache::capture(const demuxer& dem)
+{
+	const AVFormatContext* fmt_ctx = dem.av_fmt_ctx();
+
+	cached_file_info info;
+	info.duration = fmt_ctx->duration;
+	info.start_time = fmt_ctx->start_time;
+	info.bit_rate = fmt_ctx->bit_rate;
+	info.index = dem.get_keyframe_index();
+
+	info.streams.reserve(fmt_ctx->nb_streams);
+	for (unsigned i = 0; i < fmt_ctx->nb_streams; ++i)
+	{
+		info.streams.push_back(capture_stream(fmt_ctx->streams[i]));
+	}
+
+	return info;
+}
+
+void ff::stream_info_cache::save(const fs::path& media, const cached_file_info& info, const fs::path& sidecar)
+{
+	const fs::path dst = sidecar.empty() ? default_sidecar_path(media) : sidecar;
+	const file_key key = make_key(media);
+
+	fs::path tmp = dst;
+	tmp += ".tmp";
+	{
+		std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+		writer w(os);
+
+		os.write(magic, sizeof(magic));
+		w(version);
+		w(byte_order_mark);
+		transfer(w, key);
+		transfer(w, info);
+
+		os.flush();
+		if (!w.good())
+		{
+			os.close();
+			std::error_code ec;
+			fs::remove(tmp, ec);
+			throw fs::filesystem_error
+			(
+				"Could not write the sidecar.", tmp,
+				std::make_error_code(std::errc::io_error)
+			);
+		}
+	}
+
+	fs::rename(tmp, dst);
+}
+
+std::optional<ff::cached_file_info> ff::stream_info_cache::load(const fs::path& media, const fs::path& sidecar)
+{
+	const fs::path src = sidecar.empty() ? default_sidecar_path(media) : sidecar;
+
+	file_key current_key;
+	try
+	{
+		current_key = make_key(media);
+	}
+	catch (const fs::filesystem_error&)
+	{
+		// The file is gone or cannot be accessed.
+		return std::nullopt;
+	}
+
+	std::ifstream is(src, std::ios::binary);
+	if (!is)
+	{
+		return std::nullopt;
+	}
+	reader r(is);
+
+	char read_magic[sizeof(magic)] = {};
+	is.read(read_magic, sizeof(read_magic));
+	uint32_t read_version = 0, read_bom = 0;
+	r(read_version);
+	r(read_bom);
+	if (!r.good() || !std::equal(magic, magic + sizeof(magic), read_magic)
+		|| version != read_version || byte_order_mark != read_bom)
+	{
+		return std::nullopt;
+	}
+
+	file_key key;
+	transfer(r, key);
+	if (!r.good() || key != current_key)
+	{
+		// Stale.
+		return std::nullopt;
+	}
+
+	cached_file_info info;
+	transfer(r, info);
+	if (!r.good())
+	{
+		return std::nullopt;
+	}
+	// The index, if it's there, must be of the same streams.
+	if (!info.index.empty() && info.index.size() != info.streams.size())
+	{
+		return std::nullopt;
+	}
+
+	return info;
+}
+
+fs::path ff::stream_info_cache::default_sidecar_path(const fs::path& media)
+{
+	fs::path res = media;
+	res += ".ffwinfo";
+	return res;
+}
+
+ff::cached_stream_info ff::stream_info_cache::capture(const stream& s)
+{
+	return capture_stream(s.av_stream());
+}
+
+ff::codec_properties ff::stream_info_cache::to_properties(const cached_stream_info& s)
+{
+	codec_properties p;
+	apply_parameters(s, p.av_codec_parameters());
+	p.set_time_base(ff::rational(s.tb_num, s.tb_den));
+	return p;
+}
+
+void ff::stream_info_cache::write(std::ostream& os, const cached_stream_info& s)
+{
+	writer w(os);
+	transfer(w, s);
+}
+
+bool ff::stream_info_cache::read(std::istream& is, cached_stream_info& s)
+{
+	reader r(is);
+	transfer(r, s);
+	return r.good();
+}
+
+void ff::stream_info_cache::apply(const cached_file_info& info, AVFormatContext* fmt_ctx)
+{
+	if (info.streams.size() != fmt_ctx->nb_streams)
+	{
+		throw std::invalid_argument("The cached info has a different number of streams than the file.");
+	}
+
+	fmt_ctx->duration = info.duration;
+	fmt_ctx->start_time = info.start_time;
+	fmt_ctx->bit_rate = info.bit_rate;
+
+	for (unsigned i = 0; i < fmt_ctx->nb_streams; ++i)
+	{
+		AVStream* st = fmt_ctx->streams[i];
+		const cached_stream_info& s = info.streams[i];
+
+		apply_parameters(s, st->codecpar);
+
+		st->time_base = AVRational{ s.tb_num, s.tb_den };
+		st->start_time = s.start_time;
+		st->duration = s.duration;
+		st->nb_frames = s.nb_frames;
+		st->avg_frame_rate = AVRational{ s.avg_fr_num, s.avg_fr_den };
+		st->r_frame_rate = AVRational{ s.r_fr_num, s.r_fr_den };
+		st->disposition = s.disposition;
+	}
+}
@@ -0,0 +1,174 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class stream_info_cache
+* and what it stores.
+*/
+
+#include "../util/util.h"
+#include "demuxer.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <optional>
+#include <vector>
+
+struct AVFormatContext;
+
+namespace ff
+{
+	/*
+	* What the cache stores about a stream: the fields of its AVCodecParameters
+	* and those of its AVStream that probing fills in.
+	* The enums are stored as ints so that this header doesn't need FFmpeg's.
+	*/
+	struct cached_stream_info
+	{
+		// AVCodecParameters
+		int codec_type = -1;
+		int codec_id = 0;
+		uint32_t codec_tag = 0;
+		std::vector<uint8_t> extradata;
+		int format = -1;
+		int64_t bit_rate = 0;
+		int bits_per_coded_sample = 0, bits_per_raw_sample = 0;
+		int profile = 0, level = 0;
+		int width = 0, height = 0;
+		int sar_num = 0, sar_den = 1;
+		int field_order = 0;
+		int color_range = 0, color_primaries = 0, color_trc = 0, color_space = 0, chroma_location = 0;
+		int video_delay = 0;
+		// Only the order, the number of channels and the mask. Custom maps are not stored.
+		int ch_order = 0, ch_nb_channels = 0;
+		uint64_t ch_mask = 0;
+		int sample_rate = 0, block_align = 0, frame_size = 0;
+		int initial_padding = 0, trailing_padding = 0, seek_preroll = 0;
+
+		// AVStream
+		int tb_num = 0, tb_den = 1;
+		int64_t start_time = 0, duration = 0, nb_frames = 0;
+		int avg_fr_num = 0, avg_fr_den = 1;
+		int r_fr_num = 0, r_fr_den = 1;
+		int disposition = 0;
+	};
+
+	/*
+	* What the cache stores about a file.
+	*/
+	struct cached_file_info
+	{
+		std::vector<cached_stream_info> streams;
+		// Those of AVFormatContext.
+		int64_t duration = 0, start_time = 0, bit_rate = 0;
+		// Can be empty if the index was not built.
+		demuxer::keyframe_index index;
+	};
+
+	/*
+	* Stores what probing a file finds (see demuxer::probe_stream_information()),
+	* and the keyframe index if it's built, in a sidecar file next to it,
+	* so that opening the file again can skip probing and indexing
+	* by giving what's loaded to the demuxer constructor that takes a cached_file_info.
+	* 
+	* The sidecar is keyed by the path, the size, and the last write time of the file.
+	* If any of them changes, load() ignores the sidecar.
+	* 
+	* The sidecar is in a binary format only for this library on the same kind of machine.
+	* A sidecar with a wrong version, byte order, or that is broken is ignored.
+	* 
+	* how to use:
+	*	auto info = stream_info_cache::load(path);
+	*	if (info) open the demuxer with *info;
+	*	else open the demuxer as usual, (build_keyframe_index()), and then save(path, capture(demuxer)).
+	*/
+	class FF_WRAPPER_API stream_info_cache final
+	{
+	public:
+		// Everything is static.
+		stream_info_cache() = delete;
+
+	public:
+		/*
+		* @returns what the demuxer found about its file and streams, and its keyframe index.
+		*/
+		static cached_file_info capture(const demuxer& dem);
+
+		/*
+		* @returns what I store about s, e.g. to record it elsewhere (see packet_trace).
+		*/
+		static cached_stream_info capture(const stream& s);
+
+		/*
+		* @returns the codec properties, with the time base, that s describes,
+		* e.g. to make a decoder of a stream that is no longer there.
+		*/
+		static codec_properties to_properties(const cached_stream_info& s);
+
+		/*
+		* Writes s to os in the sidecar's format, and reads it back.
+		* 
+		* @returns whether s has been read completely.
+		*/
+		static void write(std::ostream& os, const cached_stream_info& s);
+		static bool read(std::istream& is, cached_stream_info& s);
+
+		/*
+		* Writes info to the sidecar of media.
+		* The sidecar is written to a temporary file first and then renamed,
+		* so that others never load half of it.
+		* 
+		* @param media the multimedia file info is about.
+		* @param sidecar where to write. Empty to use default_sidecar_path(media).
+		* @throws std::filesystem::filesystem_error if media doesn't exist or on I/O error.
+		*/
+		static void save
+		(
+			const std::filesystem::path& media, const cached_file_info& info,
+			const std::filesystem::path& sidecar = std::filesystem::path()
+		);
+
+		/*
+		* Reads the sidecar of media.
+		* 
+		* @param media the multimedia file.
+		* @param sidecar where to read. Empty to use default_sidecar_path(media).
+		* @returns what's stored, or nothing if there's no valid sidecar for media as it is now.
+		*/
+		static std::optional<cached_file_info> load
+		(
+			const std::filesystem::path& media,
+			const std::filesystem::path& sidecar = std::filesystem::path()
+		);
+
+		/*
+		* @returns media's path with ".ffwinfo" appended.
+		*/
+		static std::filesystem::path default_sidecar_path(const std::filesystem::path& media);
+
+	private:
+		friend class demuxer;
+
+		/*
+		* Fills the streams of fmt_ctx with info, as if they were probed.
+		* 
+		* @throws std::invalid_argument if info has a different number of streams.
+		*/
+		static void apply(const cached_file_info& info, ::AVFormatContext* fmt_ctx);
+	};
+}
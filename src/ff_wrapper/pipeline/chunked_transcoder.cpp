@@ -0,0 +1,446 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "chunked_transcoder.h"
+#include "../formats/muxer.h"
+#include "../codec/decoder.h"
+#include "../codec/encoder.h"
+#include "../sws/frame_transformer.h"
+
+extern "C"
+{
+#include <libavutil/mathematics.h>
+}
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+ff::chunked_transcoder::chunked_transcoder
+(
+	const std::filesystem::path& input, demuxer::keyframe_index index, int stream_ind,
+	encoder_factory make_encoder, transformer_factory make_transformer,
+	int num_workers
+)
+	: input(input), index(std::move(index)), stream_ind(stream_ind),
+	make_encoder(std::move(make_encoder)), make_transformer(std::move(make_transformer)),
+	num_workers(num_workers)
+{
+	if (!this->make_encoder)
+	{
+		throw std::invalid_argument("The encoder factory cannot be empty.");
+	}
+	if (num_workers < 0)
+	{
+		throw std::invalid_argument("The number of workers cannot be negative.");
+	}
+	if (stream_ind < 0 || stream_ind >= static_cast<int>(this->index.size()))
+	{
+		throw std::out_of_range("The index has no such stream.");
+	}
+
+	if (0 == this->num_workers)
+	{
+		this->num_workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+size_t ff::chunked_transcoder::run(const std::vector<chunk_description>& chunks, muxer& mux, const stream& out_stream)
+{
+	const size_t n = chunks.size();
+	// How far the workers can go ahead of the muxing.
+	const size_t max_ahead = 2 * static_cast<size_t>(num_workers);
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::vector<std::optional<encoded_chunk>> done(n);
+	size_t next_to_take = 0, next_to_mux = 0;
+	bool aborted = false;
+	std::exception_ptr first_error;
+
+	auto on_error = [&](std::exception_ptr e)
+	{
+		std::lock_guard lock(mtx);
+		if (nullptr == first_error)
+		{
+			first_error = e;
+		}
+		aborted = true;
+		cv.notify_all();
+	};
+
+	auto work = [&]() noexcept
+	{
+		while (true)
+		{
+			size_t i = 0;
+			{
+				std::unique_lock lock(mtx);
+				cv.wait(lock, [&] { return aborted || next_to_take >= n || next_to_take < next_to_mux + max_ahead; });
+				if (aborted || next_to_take >= n)
+				{
+					return;
+				}
+				i = next_to_take++;
+			}
+
+			try
+			{
+				auto res = transcode_chunk(input, index, stream_ind, chunks[i], make_encoder, make_transformer);
+
+				std::lock_guard lock(mtx);
+				done[i] = std::move(res);
+				cv.notify_all();
+			}
+			catch (...)
+			{
+				on_error(std::current_exception());
+				return;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(num_workers);
+	try
+	{
+		for (int i = 0; i < num_workers; ++i)
+		{
+			workers.emplace_back(work);
+		}
+	}
+	catch (...)
+	{
+		on_error(std::current_exception());
+	}
+
+	// Stitch them in order as they come.
+	size_t num_muxed = 0;
+	int64_t last_dts = INT64_MIN;
+	for (size_t i = 0; i < n; ++i)
+	{
+		std::optional<encoded_chunk> chunk;
+		{
+			std::unique_lock lock(mtx);
+			cv.wait(lock, [&] { return aborted || done[i].has_value(); });
+			if (aborted)
+			{
+				break;
+			}
+			chunk = std::move(done[i]);
+			done[i].reset();
+			next_to_mux = i + 1;
+			cv.notify_all();
+		}
+
+		try
+		{
+			num_muxed += chunk->packets.size();
+			stitch_chunk(*chunk, mux, out_stream, last_dts);
+		}
+		catch (...)
+		{
+			on_error(std::current_exception());
+			break;
+		}
+	}
+
+	for (auto& t : workers)
+	{
+		t.join();
+	}
+
+	if (nullptr != first_error)
+	{
+		std::rethrow_exception(first_error);
+	}
+
+	return num_muxed;
+}
+
+std::vector<ff::chunk_description> ff::chunked_transcoder::plan_chunks
+(
+	const demuxer::keyframe_index& index, int stream_ind, int64_t min_duration,
+	const std::vector<int64_t>& scene_cuts
+)
+{
+	if (min_duration <= 0)
+	{
+		throw std::invalid_argument("The minimal duration must be positive.");
+	}
+
+	// Where chunks can start.
+	const std::vector<int64_t> boundaries = closed_gop_boundaries(index, stream_ind);
+	const auto& entries = index[stream_ind];
+
+	std::vector<chunk_description> res;
+	if (boundaries.empty())
+	{
+		return res;
+	}
+
+	chunk_description cur;
+	cur.start_pts = boundaries[0];
+	for (size_t b = 1; b < boundaries.size(); ++b)
+	{
+		const int64_t duration = boundaries[b] - cur.start_pts;
+		bool ends = duration >= min_duration;
+		if (ends && !scene_cuts.empty() && duration < 2 * min_duration)
+		{
+			// Only if a scene begins after the boundary before this one and by this one.
+			auto cut = std::upper_bound(scene_cuts.begin(), scene_cuts.end(), boundaries[b - 1]);
+			ends = cut != scene_cuts.end() && *cut <= boundaries[b];
+		}
+
+		if (ends)
+		{
+			cur.end_pts = boundaries[b];
+			res.push_back(cur);
+
+			cur.index = static_cast<int>(res.size());
+			cur.start_pts = boundaries[b];
+		}
+	}
+	cur.end_pts = AV_NOPTS_VALUE;
+	res.push_back(cur);
+
+	for (const auto& e : entries)
+	{
+		if (AV_NOPTS_VALUE == e.pts || e.pts < res.front().start_pts)
+		{
+			continue;
+		}
+
+		// The chunks are ordered, so find the last that starts at or before it.
+		auto it = std::upper_bound
+		(
+			res.begin(), res.end(), e.pts,
+			[](int64_t pts, const chunk_description& c) { return pts < c.start_pts; }
+		);
+		++std::prev(it)->num_frames;
+	}
+
+	return res;
+}
+
+std::vector<int64_t> ff::chunked_transcoder::closed_gop_boundaries(const demuxer::keyframe_index& index, int stream_ind)
+{
+	if (stream_ind < 0 || stream_ind >= static_cast<int>(index.size()))
+	{
+		throw std::out_of_range("The index has no such stream.");
+	}
+
+	const auto& entries = index[stream_ind];
+	const size_t n = entries.size();
+
+	// Packets without pts don't take part.
+	// suffix_min[k] is the smallest pts of entries[k..n), and prefix_max[k] the largest of entries[0..k).
+	std::vector<int64_t> suffix_min(n + 1, std::numeric_limits<int64_t>::max());
+	std::vector<int64_t> prefix_max(n + 1, std::numeric_limits<int64_t>::min());
+	for (size_t k = n; k-- > 0;)
+	{
+		suffix_min[k] = suffix_min[k + 1];
+		if (AV_NOPTS_VALUE != entries[k].pts)
+		{
+			suffix_min[k] = std::min(suffix_min[k], entries[k].pts);
+		}
+	}
+	for (size_t k = 0; k < n; ++k)
+	{
+		prefix_max[k + 1] = prefix_max[k];
+		if (AV_NOPTS_VALUE != entries[k].pts)
+		{
+			prefix_max[k + 1] = std::max(prefix_max[k + 1], entries[k].pts);
+		}
+	}
+
+	// Where the stream can be cut.
+	std::vector<int64_t> boundaries;
+	for (size_t k = 0; k < n; ++k)
+	{
+		const auto& e = entries[k];
+		if (e.keyframe && AV_NOPTS_VALUE != e.pts && prefix_max[k] < e.pts && suffix_min[k] >= e.pts)
+		{
+			boundaries.push_back(e.pts);
+		}
+	}
+
+	return boundaries;
+}
+
+ff::encoded_chunk ff::chunked_transcoder::transcode_chunk
+(
+	const std::filesystem::path& input, const demuxer::keyframe_index& index, int stream_ind,
+	const chunk_description& chunk,
+	const encoder_factory& make_encoder, const transformer_factory& make_transformer
+)
+{
+	demuxer dem(input);
+	dem.load_keyframe_index(index);
+	// The chunk starts at a keyframe, so it lands right there.
+	dem.seek_accurate(stream_ind, chunk.start_pts);
+
+	decoder dec(dem.get_stream(stream_ind));
+	std::unique_ptr<encoder> enc = make_encoder(dec);
+	if (nullptr == enc || !enc->ready())
+	{
+		throw std::invalid_argument("The encoder factory must give a ready encoder.");
+	}
+	std::unique_ptr<frame_transformer> trans;
+	if (make_transformer)
+	{
+		trans = make_transformer(dec, *enc);
+	}
+
+	const AVRational stream_tb = dem.get_stream(stream_ind).time_base().av_rational();
+
+	encoded_chunk res;
+	res.desc = chunk;
+	res.time_base = enc->get_codec_properties().time_base();
+	const AVRational enc_tb = res.time_base.av_rational();
+	res.start = av_rescale_q(chunk.start_pts, stream_tb, enc_tb);
+
+	auto output_encoded = [&]()
+	{
+		while (true)
+		{
+			packet pkt = enc->encode_packet();
+			if (pkt.destroyed())
+			{
+				return;
+			}
+			res.packets.push_back(std::move(pkt));
+		}
+	};
+
+	auto encode = [&](frame& f)
+	{
+		// As if the chunk were a file by itself.
+		f->pts = av_rescale_q(f->pts - chunk.start_pts, stream_tb, enc_tb);
+		// Let the encoder choose the picture types by itself.
+		f->pict_type = AV_PICTURE_TYPE_NONE;
+
+		while (!enc->feed_frame(f))
+		{
+			output_encoded();
+		}
+		output_encoded();
+	};
+
+	// Set when a frame at or after the end comes.
+	// After that, all the frames in the chunk have come, because a decoder outputs in presentation order.
+	bool reached_end = false;
+	auto output_decoded = [&]()
+	{
+		while (!reached_end)
+		{
+			frame f = dec.decode_frame();
+			if (f.destroyed())
+			{
+				return;
+			}
+
+			if (AV_NOPTS_VALUE == f->pts || f->pts < chunk.start_pts)
+			{
+				continue;
+			}
+			if (AV_NOPTS_VALUE != chunk.end_pts && f->pts >= chunk.end_pts)
+			{
+				reached_end = true;
+				return;
+			}
+
+			if (nullptr != trans)
+			{
+				frame converted = trans->convert_frame(f);
+				encode(converted);
+			}
+			else
+			{
+				encode(f);
+			}
+		}
+	};
+
+	packet pkt;
+	while (!reached_end && dem.demux_next_packet(pkt))
+	{
+		if (pkt->stream_index != stream_ind)
+		{
+			continue;
+		}
+
+		// Once the end is reached, nothing more is taken out of the decoder,
+		// so a decoder that still holds frames (e.g. reordering B-frames) would refuse the packet forever.
+		while (!reached_end && !dec.feed_packet(pkt))
+		{
+			output_decoded();
+		}
+		if (reached_end)
+		{
+			break;
+		}
+		output_decoded();
+	}
+	if (!reached_end)
+	{
+		dec.signal_no_more_food();
+		output_decoded();
+	}
+
+	enc->signal_no_more_food();
+	output_encoded();
+
+	return res;
+}
+
+void ff::chunked_transcoder::stitch_chunk(encoded_chunk& chunk, muxer& mux, const stream& out_stream, int64_t& last_dts)
+{
+	for (auto& pkt : chunk.packets)
+	{
+		// Move it from the start of the chunk to where the chunk is in the whole stream.
+		pkt.reset_time
+		(
+			AV_NOPTS_VALUE == pkt->dts ? AV_NOPTS_VALUE : pkt->dts + chunk.start,
+			pkt->pts + chunk.start,
+			pkt->duration, chunk.time_base
+		);
+		pkt.prepare_for_muxing(out_stream);
+
+		// An encoder with B-frames starts the chunk before 0 in dts,
+		// so its first packets would go at or before the last of the previous chunk.
+		if (AV_NOPTS_VALUE != pkt->dts)
+		{
+			if (INT64_MIN != last_dts && pkt->dts <= last_dts)
+			{
+				pkt->dts = last_dts + 1;
+				if (AV_NOPTS_VALUE != pkt->pts && pkt->pts < pkt->dts)
+				{
+					pkt->pts = pkt->dts;
+				}
+			}
+			last_dts = pkt->dts;
+		}
+
+		mux.mux_packet_manual(pkt);
+	}
+
+	chunk.packets.clear();
+}
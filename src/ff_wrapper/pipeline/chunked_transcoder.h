@@ -0,0 +1,208 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class chunked_transcoder.
+*/
+
+#include "../util/util.h"
+#include "../util/ff_math.h"
+#include "../data/packet.h"
+#include "../formats/demuxer.h"
+#include "../formats/stream.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace ff
+{
+	class muxer;
+	class decoder;
+	class encoder;
+	class frame_transformer;
+
+	/*
+	* A part of a video stream that can be transcoded without the rest:
+	* it starts at a closed-GOP keyframe, so no frame in it references one outside.
+	*/
+	struct chunk_description
+	{
+		int index = 0;
+		// In the time base of the stream. The chunk has the frames with start_pts <= pts < end_pts.
+		int64_t start_pts = 0;
+		// AV_NOPTS_VALUE for the last chunk, which goes to the end.
+		int64_t end_pts = 0;
+		int num_frames = 0;
+	};
+
+	/*
+	* What transcoding a chunk gives.
+	*/
+	struct encoded_chunk
+	{
+		chunk_description desc;
+		// Their timestamps start from 0, as if the chunk were a file by itself.
+		std::vector<packet> packets;
+		// That of the encoder.
+		ff::rational time_base = ff::zero_rational;
+		// Where the chunk starts in the whole stream, in time_base.
+		int64_t start = 0;
+	};
+
+	/*
+	* Transcodes a video stream faster than one encoder can by cutting it into chunks
+	* at closed-GOP keyframes, and transcoding the chunks at the same time,
+	* each with its own demuxer, decoder, (transformer,) and encoder.
+	* The encoded chunks are then stitched together in order through muxer::mux_packet_manual().
+	* 
+	* The cutting uses the keyframe index of the demuxer (see demuxer::build_keyframe_index()).
+	* A keyframe is a closed-GOP boundary iff all packets before it (in the file order)
+	* are presented before it, and all after it are presented at or after it.
+	* 
+	* To transcode on other machines, use the static pieces:
+	* plan_chunks() here, transcode_chunk() on the workers, and stitch_chunk() here in order.
+	* 
+	* Notes:
+	*	1. Each chunk's encoder starts afresh, so rate control does not carry across chunks.
+	*	Give the chunks enough frames (e.g. several GOPs).
+	*	2. Only the video stream is transcoded. Mux other streams yourself.
+	*	3. The dts of the output are kept increasing across the chunks, which may move some by a tick.
+	*/
+	class FF_WRAPPER_API chunked_transcoder final
+	{
+	public:
+		/*
+		* Creates a ready encoder for a chunk, whose time base is what the packets will be in.
+		* Called from the worker threads. Every call must give an encoder with the same properties.
+		* 
+		* @param dec the chunk's ready decoder.
+		*/
+		using encoder_factory = std::function<std::unique_ptr<encoder>(const decoder& dec)>;
+		/*
+		* Creates the transformer between the chunk's decoder and encoder.
+		* Called from the worker threads.
+		*/
+		using transformer_factory = std::function<std::unique_ptr<frame_transformer>(const decoder& dec, const encoder& enc)>;
+
+	public:
+		chunked_transcoder() = delete;
+
+		/*
+		* @param input the file to transcode. Each worker opens it.
+		* @param index a keyframe index of the file (see demuxer::build_keyframe_index()).
+		* @param stream_ind which stream to transcode. It must be a video stream.
+		* @param make_encoder see encoder_factory.
+		* @param make_transformer see transformer_factory. Empty if the frames need no transforming.
+		* @param num_workers how many chunks can be transcoded at the same time.
+		* 0 means as many as the hardware threads.
+		* @throws std::invalid_argument if make_encoder is empty or num_workers < 0.
+		* @throws std::out_of_range if index has no stream of stream_ind.
+		*/
+		chunked_transcoder
+		(
+			const std::filesystem::path& input, demuxer::keyframe_index index, int stream_ind,
+			encoder_factory make_encoder, transformer_factory make_transformer = transformer_factory(),
+			int num_workers = 0
+		);
+
+		chunked_transcoder(const chunked_transcoder&) = delete;
+		chunked_transcoder& operator=(const chunked_transcoder&) = delete;
+
+	public:
+		/*
+		* Transcodes the chunks on the workers and muxes them in order into out_stream of mux.
+		* The muxer must be prepared, and is not finalized afterwards.
+		* At most 2 * num_workers chunks are held in memory.
+		* 
+		* @param chunks what plan_chunks() gives, in order.
+		* @param out_stream the stream of mux the packets go to.
+		* @returns how many packets are muxed.
+		* @throws whatever the first failing chunk throws, after all workers have stopped.
+		*/
+		size_t run(const std::vector<chunk_description>& chunks, muxer& mux, const stream& out_stream);
+
+		int get_num_workers() const noexcept { return num_workers; }
+
+	public:
+		/*
+		* Cuts a stream into chunks at closed-GOP keyframes.
+		* Each chunk is as short as possible, but not shorter than min_duration (except the last).
+		* 
+		* With scene cuts (e.g. from scene_detector), a chunk only ends at the first boundary at or after a cut,
+		* so that chunks start with new scenes and the encoders don't spend a keyframe in the middle of one.
+		* A chunk that has lasted 2 * min_duration without a cut ends at the next boundary anyway,
+		* so that long scenes still split into work for many workers.
+		* 
+		* @param index a keyframe index.
+		* @param stream_ind which stream of it to cut.
+		* @param min_duration in the time base of the stream.
+		* @param scene_cuts where scenes begin, in the time base of the stream, in ascending order.
+		* Empty to cut at any boundary.
+		* @returns the chunks. Empty if the stream has no packets.
+		* @throws std::out_of_range if index has no stream of stream_ind.
+		* @throws std::invalid_argument if min_duration <= 0.
+		*/
+		static std::vector<chunk_description> plan_chunks
+		(
+			const demuxer::keyframe_index& index, int stream_ind, int64_t min_duration,
+			const std::vector<int64_t>& scene_cuts = std::vector<int64_t>()
+		);
+
+		/*
+		* Finds where a stream can be cut without a frame referencing one across the cut:
+		* the pts of its closed-GOP keyframes, in the file order (which is also the presentation order).
+		* 
+		* @param index a keyframe index.
+		* @param stream_ind which stream of it.
+		* @throws std::out_of_range if index has no stream of stream_ind.
+		*/
+		static std::vector<int64_t> closed_gop_boundaries(const demuxer::keyframe_index& index, int stream_ind);
+
+		/*
+		* Transcodes one chunk.
+		* 
+		* @throws std::invalid_argument if make_encoder gives no encoder or one not ready.
+		*/
+		static encoded_chunk transcode_chunk
+		(
+			const std::filesystem::path& input, const demuxer::keyframe_index& index, int stream_ind,
+			const chunk_description& chunk,
+			const encoder_factory& make_encoder, const transformer_factory& make_transformer = transformer_factory()
+		);
+
+		/*
+		* Muxes the packets of a chunk into out_stream, moving their timestamps to where the chunk starts.
+		* Call it for the chunks in order. The packets are consumed.
+		* The dts are kept increasing across the chunks, which may move some by a tick.
+		* 
+		* @param last_dts the dts of the last packet muxed into out_stream, in its time base;
+		* INT64_MIN before the first chunk. I update it.
+		*/
+		static void stitch_chunk(encoded_chunk& chunk, muxer& mux, const stream& out_stream, int64_t& last_dts);
+
+	private:
+		std::filesystem::path input;
+		demuxer::keyframe_index index;
+		int stream_ind;
+		encoder_factory make_encoder;
+		transformer_factory make_transformer;
+		int num_workers;
+	};
+}
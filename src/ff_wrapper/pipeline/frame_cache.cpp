@@ -0,0 +1,394 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "frame_cache.h"
+#include "../data/packet.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+ff::frame_cache::frame_cache
+(
+	const std::filesystem::path& file, int stream_ind,
+	demuxer::keyframe_index index, size_t max_bytes,
+	int prefetch_radius, memory_budget* budget,
+	const codec_base::threading_policy& policy
+)
+	: dem(file), dec(dem.get_stream(stream_ind), policy),
+	stream_ind(stream_ind), max_bytes(max_bytes), radius(prefetch_radius), budget(budget)
+{
+	if (!dem.get_stream(stream_ind).is_video())
+	{
+		throw std::invalid_argument("The stream must be video.");
+	}
+	if (0 == max_bytes)
+	{
+		throw std::invalid_argument("max_bytes must be > 0.");
+	}
+	if (prefetch_radius < 0)
+	{
+		throw std::invalid_argument("prefetch_radius must be >= 0.");
+	}
+
+	if (index.empty())
+	{
+		dem.build_keyframe_index();
+	}
+	else
+	{
+		dem.load_keyframe_index(std::move(index));
+	}
+	tb = dem.get_stream(stream_ind).time_base();
+
+	for (const auto& e : dem.get_keyframe_index()[stream_ind])
+	{
+		if (!e.keyframe)
+		{
+			continue;
+		}
+		// pts may be missing in some containers. Then dts is the best guess.
+		const int64_t pts = AV_NOPTS_VALUE != e.pts ? e.pts : e.dts;
+		if (AV_NOPTS_VALUE != pts)
+		{
+			key_pts.push_back(pts);
+		}
+	}
+	if (key_pts.empty())
+	{
+		throw std::invalid_argument("The stream has no keyframes.");
+	}
+	std::sort(key_pts.begin(), key_pts.end());
+	key_pts.erase(std::unique(key_pts.begin(), key_pts.end()), key_pts.end());
+
+	worker = std::thread(&frame_cache::work_loop, this);
+}
+
+ff::frame_cache::~frame_cache() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	work_cv.notify_all();
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+}
+
+ff::frame ff::frame_cache::frame_at(const ff::time& t)
+{
+	return frame_at_pts(ff::time::change_time_base(t, tb).timestamp_approximate());
+}
+
+ff::frame ff::frame_cache::frame_at_pts(int64_t pts)
+{
+	const size_t g = gop_of(pts);
+
+	std::unique_lock<std::mutex> lock(mtx);
+	bool waited = false;
+	while (true)
+	{
+		auto it = gops.find(g);
+		if (gops.end() != it)
+		{
+			if (waited)
+			{
+				++misses;
+			}
+			else
+			{
+				++hits;
+			}
+
+			gop& found = it->second;
+			lru.splice(lru.begin(), lru, found.lru_pos);
+			pinned = g;
+			internal_schedule_prefetch(g);
+
+			if (found.frames.empty())
+			{
+				throw std::runtime_error("Nothing could be decoded from the GOP.");
+			}
+			// The last frame whose pts <= pts, or the first one.
+			auto after = std::upper_bound
+			(
+				found.frames.begin(), found.frames.end(), pts,
+				[](int64_t p, const frame& f) { return p < f->pts; }
+			);
+			// A reference to the cached data.
+			return found.frames.begin() == after ? found.frames.front() : *(after - 1);
+		}
+
+		auto e = errors.find(g);
+		if (errors.end() != e)
+		{
+			std::exception_ptr err = e->second;
+			errors.erase(e);
+			std::rethrow_exception(err);
+		}
+
+		if (!internal_pending(g))
+		{
+			requests.push_back(g);
+			work_cv.notify_all();
+		}
+		waited = true;
+		done_cv.wait(lock);
+	}
+}
+
+bool ff::frame_cache::cached(int64_t pts) const
+{
+	const size_t g = gop_of(pts);
+	std::lock_guard<std::mutex> lock(mtx);
+	return gops.contains(g);
+}
+
+size_t ff::frame_cache::num_cached_gops() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return gops.size();
+}
+
+size_t ff::frame_cache::bytes_cached() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return total_bytes;
+}
+
+size_t ff::frame_cache::num_hits() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return hits;
+}
+
+size_t ff::frame_cache::num_misses() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return misses;
+}
+
+size_t ff::frame_cache::gop_of(int64_t pts) const noexcept
+{
+	auto after = std::upper_bound(key_pts.begin(), key_pts.end(), pts);
+	return key_pts.begin() == after ? 0 : static_cast<size_t>(after - key_pts.begin()) - 1;
+}
+
+void ff::frame_cache::work_loop() noexcept
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true)
+	{
+		work_cv.wait(lock, [this] { return stopping || !requests.empty() || !prefetches.empty(); });
+		if (stopping)
+		{
+			return;
+		}
+
+		const bool requested = !requests.empty();
+		std::deque<size_t>& from = requested ? requests : prefetches;
+		const size_t g = from.front();
+		from.pop_front();
+		if (gops.contains(g))
+		{
+			continue;
+		}
+
+		decoding = g;
+		lock.unlock();
+
+		std::vector<frame> frames;
+		std::exception_ptr err;
+		try
+		{
+			frames = decode_gop(g);
+		}
+		catch (...)
+		{
+			err = std::current_exception();
+		}
+
+		lock.lock();
+		decoding.reset();
+		if (nullptr == err)
+		{
+			try
+			{
+				internal_insert(g, std::move(frames), requested);
+			}
+			catch (...)
+			{
+				err = std::current_exception();
+			}
+		}
+		// A failed prefetch is tried again when requested.
+		if (nullptr != err && requested)
+		{
+			errors[g] = err;
+		}
+		done_cv.notify_all();
+	}
+}
+
+std::vector<ff::frame> ff::frame_cache::decode_gop(size_t g)
+{
+	// Discard whatever the last GOP left in it.
+	dec.reset();
+	// The GOP starts at a keyframe, so it lands right there.
+	dem.seek_accurate(stream_ind, key_pts[g]);
+
+	const int64_t start = key_pts[g];
+	const int64_t end = g + 1 < key_pts.size() ? key_pts[g + 1] : AV_NOPTS_VALUE;
+
+	std::vector<frame> frames;
+	// Set when a frame at or after the end comes.
+	// After that, all the frames in the GOP have come, because a decoder outputs in presentation order.
+	bool reached_end = false;
+	auto output_decoded = [&]()
+	{
+		while (!reached_end)
+		{
+			frame f = dec.decode_frame();
+			if (f.destroyed())
+			{
+				return;
+			}
+
+			if (AV_NOPTS_VALUE == f->pts)
+			{
+				f->pts = f->best_effort_timestamp;
+			}
+			// The leading frames of an open GOP belong to the one before.
+			if (AV_NOPTS_VALUE == f->pts || f->pts < start)
+			{
+				continue;
+			}
+			if (AV_NOPTS_VALUE != end && f->pts >= end)
+			{
+				reached_end = true;
+				return;
+			}
+
+			frames.push_back(std::move(f));
+		}
+	};
+
+	packet pkt;
+	while (!reached_end && dem.demux_next_packet(pkt))
+	{
+		if (pkt->stream_index != stream_ind)
+		{
+			continue;
+		}
+
+		// Once the end comes, no more output is taken, so the decoder may never take the packet.
+		while (!reached_end && !dec.feed_packet(pkt))
+		{
+			output_decoded();
+		}
+		if (reached_end)
+		{
+			break;
+		}
+		output_decoded();
+	}
+	if (!reached_end)
+	{
+		dec.signal_no_more_food();
+		output_decoded();
+	}
+
+	return frames;
+}
+
+void ff::frame_cache::internal_insert(size_t g, std::vector<frame> frames, bool requested)
+{
+	size_t bytes = 0;
+	for (const auto& f : frames)
+	{
+		bytes += f.memory_size();
+	}
+
+	// Evict the least recently used, except the pinned one.
+	auto evict_one = [this]() -> bool
+	{
+		for (auto it = lru.rbegin(); it != lru.rend(); ++it)
+		{
+			if (pinned.has_value() && *it == *pinned)
+			{
+				continue;
+			}
+			auto victim = gops.find(*it);
+			total_bytes -= victim->second.bytes;
+			gops.erase(victim);
+			lru.erase(std::next(it).base());
+			return true;
+		}
+		return false;
+	};
+
+	if (requested)
+	{
+		pinned = g;
+	}
+	while (total_bytes + bytes > max_bytes && evict_one())
+	{
+	}
+	// Only the pinned one is left, and a prefetch must not push it out.
+	if (!requested && total_bytes + bytes > max_bytes && !lru.empty())
+	{
+		return;
+	}
+
+	lru.push_front(g);
+	gop& added = gops[g];
+	added.frames = std::move(frames);
+	added.bytes = bytes;
+	added.lru_pos = lru.begin();
+	if (nullptr != budget)
+	{
+		added.charge = budget->force_acquire(bytes);
+	}
+	total_bytes += bytes;
+}
+
+void ff::frame_cache::internal_schedule_prefetch(size_t g)
+{
+	prefetches.clear();
+	for (int d = 1; d <= radius; ++d)
+	{
+		// Forward first, as that's how playback and most scrubbing go.
+		if (g + d < key_pts.size() && !gops.contains(g + d) && !internal_pending(g + d))
+		{
+			prefetches.push_back(g + d);
+		}
+		if (g >= static_cast<size_t>(d) && !gops.contains(g - d) && !internal_pending(g - d))
+		{
+			prefetches.push_back(g - d);
+		}
+	}
+
+	if (!prefetches.empty())
+	{
+		work_cv.notify_all();
+	}
+}
+
+bool ff::frame_cache::internal_pending(size_t g) const
+{
+	return (decoding.has_value() && *decoding == g) ||
+		requests.end() != std::find(requests.begin(), requests.end(), g);
+}
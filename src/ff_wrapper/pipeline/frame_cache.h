@@ -0,0 +1,218 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/ff_time.h"
+#include "../util/memory_budget.h"
+#include "../data/frame.h"
+#include "../codec/decoder.h"
+#include "../formats/demuxer.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* Random access to the decoded frames of a video stream, for scrubbing (e.g. dragging a timeline).
+	*
+	* Seeking and decoding from the previous keyframe on every request is too slow for that.
+	* Instead, I decode whole GOPs (from one keyframe up to the next) and keep the recently used ones,
+	* least recently used out first, within a byte cap.
+	* A request that falls in a cached GOP takes a lookup and a reference to the frame, and no decoding.
+	* Whenever a GOP is requested, its neighbours are decoded ahead on my own thread,
+	* so that scrubbing on into them hits too.
+	*
+	* The frames given out reference the cached data, so they stay valid after I evict or am destroyed.
+	* Don't write into them.
+	*
+	* The GOPs are worked out from a keyframe index (see demuxer::build_keyframe_index()).
+	* The bytes cached are also charged to a memory_budget.
+	*
+	* All public methods are thread-safe.
+	*/
+	class FF_WRAPPER_API frame_cache final
+	{
+	public:
+		frame_cache() = delete;
+
+		/*
+		* Opens the file with a demuxer and a decoder of my own, and starts my thread.
+		*
+		* @param file the media file.
+		* @param stream_ind which stream of the file, which must be video.
+		* @param index the keyframe index of the file. If empty, I build it, which reads the whole file.
+		* @param max_bytes at most how many bytes of frames are cached.
+		* The GOP last requested is always kept, even if it alone is larger.
+		* @param prefetch_radius how many GOPs on each side of the one requested to decode ahead. 0 for none.
+		* @param budget what the cached bytes are charged to. nullptr for nothing. It must outlive me.
+		* @param policy how the decoder uses threads.
+		* @throws std::invalid_argument if the stream is not video or has no keyframes,
+		* if index is not of the file, if max_bytes is 0, or if prefetch_radius < 0.
+		* @throws std::out_of_range if stream_ind is out of range.
+		* @throws std::runtime_error if the file could not be opened.
+		*/
+		frame_cache
+		(
+			const std::filesystem::path& file, int stream_ind,
+			demuxer::keyframe_index index, size_t max_bytes,
+			int prefetch_radius = 1,
+			memory_budget* budget = &memory_budget::process_wide(),
+			const codec_base::threading_policy& policy = codec_base::threading_policy()
+		);
+
+		frame_cache(const frame_cache&) = delete;
+		frame_cache& operator=(const frame_cache&) = delete;
+
+		/*
+		* Stops my thread, and releases what's cached.
+		*/
+		~frame_cache() noexcept;
+
+	public:
+		/*
+		* @returns the frame shown at t, i.e. the last one whose pts <= t, or the first frame if t is before it.
+		* Waits for the GOP to be decoded if it's not cached.
+		* @throws std::runtime_error if decoding the GOP failed, or nothing could be decoded from it.
+		*/
+		frame frame_at(const ff::time& t);
+
+		/*
+		* Same as frame_at(), with pts in the time base of the stream.
+		*/
+		frame frame_at_pts(int64_t pts);
+
+		/*
+		* @returns true iff the GOP that pts falls in is cached, i.e. frame_at_pts(pts) would not wait.
+		*/
+		bool cached(int64_t pts) const;
+
+		/*
+		* @returns the time base of the stream.
+		*/
+		rational time_base() const noexcept { return tb; }
+
+		/*
+		* @returns how many GOPs the stream has.
+		*/
+		size_t num_gops() const noexcept { return key_pts.size(); }
+
+		size_t num_cached_gops() const;
+		size_t bytes_cached() const;
+
+		/*
+		* @returns how many requests were answered from the cache, and how many had to wait.
+		*/
+		size_t num_hits() const;
+		size_t num_misses() const;
+
+	private:
+		struct gop
+		{
+			// In presentation order.
+			std::vector<frame> frames;
+			size_t bytes = 0;
+			memory_budget::charge charge;
+			std::list<size_t>::iterator lru_pos;
+		};
+
+		/*
+		* @returns the index of the GOP pts falls in. Those before the first keyframe fall in the first.
+		*/
+		size_t gop_of(int64_t pts) const noexcept;
+
+		/*
+		* What my thread runs.
+		*/
+		void work_loop() noexcept;
+
+		/*
+		* Seeks to GOP g and decodes all of its frames. Only my thread calls it.
+		*/
+		std::vector<frame> decode_gop(size_t g);
+
+		/*
+		* Caches GOP g, and evicts the least recently used until it's within max_bytes.
+		* A prefetched GOP that doesn't fit without evicting the pinned one is not cached.
+		* Must hold the lock.
+		*/
+		void internal_insert(size_t g, std::vector<frame> frames, bool requested);
+
+		/*
+		* Queues the neighbours of g that are neither cached nor being decoded, dropping what was queued before.
+		* Must hold the lock.
+		*/
+		void internal_schedule_prefetch(size_t g);
+
+		/*
+		* Must hold the lock.
+		*/
+		bool internal_pending(size_t g) const;
+
+	private:
+		// Only my thread uses them after construction.
+		demuxer dem;
+		decoder dec;
+
+		const int stream_ind;
+		rational tb;
+		// The pts of each keyframe, ascending. GOP i is [key_pts[i], key_pts[i + 1]).
+		std::vector<int64_t> key_pts;
+
+		const size_t max_bytes;
+		const int radius;
+		memory_budget* const budget;
+
+		mutable std::mutex mtx;
+		// Tells my thread there's work, or to stop.
+		std::condition_variable work_cv;
+		// Tells those waiting in frame_at() that a GOP is done.
+		std::condition_variable done_cv;
+
+		std::unordered_map<size_t, gop> gops;
+		// The front is the most recently used.
+		std::list<size_t> lru;
+		size_t total_bytes = 0;
+		// The GOP last requested, never evicted.
+		std::optional<size_t> pinned;
+
+		// Requested and waited for, before any prefetch.
+		std::deque<size_t> requests;
+		std::deque<size_t> prefetches;
+		// What my thread is decoding now.
+		std::optional<size_t> decoding;
+		// Why decoding a requested GOP failed, until a waiter takes it.
+		std::unordered_map<size_t, std::exception_ptr> errors;
+
+		size_t hits = 0;
+		size_t misses = 0;
+		bool stopping = false;
+
+		// Declared last, so that it starts after everything else is constructed.
+		std::thread worker;
+	};
+}
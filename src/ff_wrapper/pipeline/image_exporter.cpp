@@ -0,0 +1,367 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "image_exporter.h"
+#include "../codec/codec_properties.h"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	const char* encoder_name(ff::image_exporter::image_format format)
+	{
+		switch (format)
+		{
+		case ff::image_exporter::image_format::webp:
+			return "libwebp";
+		case ff::image_exporter::image_format::jpeg:
+			return "mjpeg";
+		default:
+			return "png";
+		}
+	}
+
+	/*
+	* @returns the pixel format to encode images of format in. See the comments for the class.
+	* @throws std::invalid_argument if the encoder is not in the FFmpeg build.
+	*/
+	AVPixelFormat pick_pixel_format(ff::image_exporter::image_format format)
+	{
+		std::vector<AVPixelFormat> preferred;
+		switch (format)
+		{
+		case ff::image_exporter::image_format::webp:
+			preferred = { AV_PIX_FMT_YUV420P };
+			break;
+		case ff::image_exporter::image_format::jpeg:
+			preferred = { AV_PIX_FMT_YUVJ420P, AV_PIX_FMT_YUV420P };
+			break;
+		default:
+			preferred = { AV_PIX_FMT_RGB24, AV_PIX_FMT_RGBA };
+		}
+
+		ff::encoder probe(encoder_name(format));
+		std::vector<AVPixelFormat> supported;
+		try
+		{
+			supported = probe.supported_v_pixel_formats();
+		}
+		catch (const std::domain_error&)
+		{
+			// It doesn't say, so trust what I know.
+			return preferred.front();
+		}
+
+		for (AVPixelFormat f : preferred)
+		{
+			if (supported.end() != std::find(supported.begin(), supported.end(), f))
+			{
+				return f;
+			}
+		}
+		if (supported.empty())
+		{
+			return preferred.front();
+		}
+		return supported.front();
+	}
+
+	/*
+	* @returns src.
+	* @throws std::invalid_argument if src is not for video, or if dst_w or dst_h <= 0.
+	*/
+	const ff::frame::data_properties& check_arguments(const ff::frame::data_properties& src, int dst_w, int dst_h)
+	{
+		if (!src.v_or_a)
+		{
+			throw std::invalid_argument("The frames must be video frames.");
+		}
+		if (dst_w <= 0 || dst_h <= 0)
+		{
+			throw std::invalid_argument("The size of the images must be positive.");
+		}
+		return src;
+	}
+}
+
+ff::image_exporter::image_exporter
+(
+	const frame::data_properties& src,
+	int dst_w, int dst_h, image_format format,
+	const dict& options, int num_workers, size_t queue_capacity,
+	frame_transformer::algorithms algorithm
+)
+	: src_props(check_arguments(src, dst_w, dst_h)), dst_w(dst_w), dst_h(dst_h), format(format),
+	dst_fmt(pick_pixel_format(format)), options(options),
+	// frame_transformer checks the sizes and the formats.
+	transformer(frame::data_properties(dst_fmt, dst_w, dst_h), src, algorithm),
+	tasks(queue_capacity)
+{
+	if (num_workers < 0)
+	{
+		throw std::invalid_argument("num_workers cannot be negative.");
+	}
+
+	// The tiles of a sprite sheet are cropped from it at multiples of the size.
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(dst_fmt);
+	FF_ASSERT(desc != nullptr, "A supported pixel format must have a descriptor.");
+	if ((dst_w & ((1 << desc->log2_chroma_w) - 1)) || (dst_h & ((1 << desc->log2_chroma_h) - 1)))
+	{
+		throw std::invalid_argument("The size must be a multiple of the chroma subsampling of the images.");
+	}
+
+	if (0 == num_workers)
+	{
+		num_workers = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	}
+	workers.reserve(num_workers);
+	for (int i = 0; i < num_workers; ++i)
+	{
+		workers.emplace_back(&image_exporter::internal_work, this);
+	}
+}
+
+ff::image_exporter::~image_exporter() noexcept
+{
+	try
+	{
+		finish();
+	}
+	catch (...)
+	{
+		// Only joining can throw, and the workers are joinable.
+	}
+}
+
+std::future<ff::packet> ff::image_exporter::submit(const frame& f, const fs::path& path)
+{
+	internal_check(f);
+
+	task t;
+	t.frames.push_back(f);
+	t.path = path;
+	return internal_submit(std::move(t));
+}
+
+std::future<ff::packet> ff::image_exporter::submit_sprite_sheet(std::vector<frame> frames, int columns, const fs::path& path)
+{
+	if (frames.empty())
+	{
+		throw std::invalid_argument("A sprite sheet needs at least one frame.");
+	}
+	if (columns <= 0)
+	{
+		throw std::invalid_argument("columns must be > 0.");
+	}
+	for (const auto& f : frames)
+	{
+		internal_check(f);
+	}
+
+	task t;
+	t.frames = std::move(frames);
+	t.columns = columns;
+	t.path = path;
+	return internal_submit(std::move(t));
+}
+
+void ff::image_exporter::finish()
+{
+	std::lock_guard<std::mutex> lock(finish_mtx);
+
+	tasks.close();
+	for (auto& w : workers)
+	{
+		if (w.joinable())
+		{
+			w.join();
+		}
+	}
+}
+
+void ff::image_exporter::internal_work() noexcept
+{
+	// Kept for the worker's life. Usually one, and one more for sprite sheets.
+	std::vector<encoder> encoders;
+
+	task t;
+	while (tasks.pop(t))
+	{
+		try
+		{
+			t.result.set_value(internal_export(t, encoders));
+			num_exported.fetch_add(1, std::memory_order_relaxed);
+		}
+		catch (...)
+		{
+			t.result.set_exception(std::current_exception());
+		}
+		// Let go of the frames before waiting for the next task.
+		t = task();
+	}
+}
+
+ff::packet ff::image_exporter::internal_export(task& t, std::vector<encoder>& encoders)
+{
+	frame image(true);
+	if (0 == t.columns)
+	{
+		// From the transformer's pool.
+		std::lock_guard<std::mutex> lock(transformer_mtx);
+		image = transformer.convert_frame(t.frames.front());
+	}
+	else
+	{
+		const int num = static_cast<int>(t.frames.size());
+		const int columns = std::min(t.columns, num);
+		const int rows = (num + columns - 1) / columns;
+
+		// The only allocation. The tiles are scaled into it.
+		image.allocate_data(frame::data_properties(dst_fmt, columns * dst_w, rows * dst_h));
+		if (num < rows * columns)
+		{
+			const ptrdiff_t linesizes[4] =
+			{
+				image->linesize[0], image->linesize[1], image->linesize[2], image->linesize[3]
+			};
+			av_image_fill_black
+			(
+				image->data, linesizes, dst_fmt,
+				AV_PIX_FMT_YUVJ420P == dst_fmt ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG,
+				image->width, image->height
+			);
+		}
+
+		for (int i = 0; i < num; ++i)
+		{
+			frame tile(image.crop_view((i % columns) * dst_w, (i / columns) * dst_h, dst_w, dst_h));
+			internal_scale(tile, t.frames[i]);
+		}
+		// The tiles took the properties of their frames; the sheet takes those of the first.
+		frame::av_frame_copy_props(image, t.frames.front());
+	}
+	// Let go of the frames as soon as they are scaled.
+	t.frames.clear();
+
+	packet pkt(internal_encode(image, encoders));
+
+	if (!t.path.empty())
+	{
+		std::ofstream os(t.path, std::ios::binary | std::ios::trunc);
+		os.write(reinterpret_cast<const char*>(pkt->data), pkt->size);
+		os.flush();
+		if (!os.good())
+		{
+			throw fs::filesystem_error
+			(
+				"Could not write the image.", t.path,
+				std::make_error_code(std::errc::io_error)
+			);
+		}
+	}
+
+	return pkt;
+}
+
+void ff::image_exporter::internal_scale(frame& dst, const frame& src)
+{
+	std::lock_guard<std::mutex> lock(transformer_mtx);
+	transformer.convert_frame(dst, src);
+}
+
+ff::packet ff::image_exporter::internal_encode(frame& f, std::vector<encoder>& encoders)
+{
+	auto it = std::find_if(encoders.begin(), encoders.end(), [&f](const encoder& enc)
+		{
+			return enc->width == f->width && enc->height == f->height;
+		});
+	if (encoders.end() == it)
+	{
+		encoder enc(encoder_name(format));
+		codec_properties p(enc.get_codec_properties());
+		p.set_type_video();
+		p.set_id(enc.get_id());
+		p.set_v_width(f->width);
+		p.set_v_height(f->height);
+		p.set_v_sar(ff::rational(1, 1));
+		p.set_v_pixel_format(dst_fmt);
+		p.set_v_frame_rate(ff::rational(1));
+		p.set_time_base(ff::rational(1, 1));
+		enc.set_codec_properties(p);
+		// The images are encoded in parallel already.
+		enc.set_threading_policy(codec_base::threading_policy::single_threaded());
+		enc.create_codec_context(options);
+		num_opened.fetch_add(1, std::memory_order_relaxed);
+
+		encoders.push_back(std::move(enc));
+		it = encoders.end() - 1;
+	}
+
+	// Each image is encoded on its own.
+	f->pts = 0;
+	f->pict_type = AV_PICTURE_TYPE_NONE;
+
+	encoder& enc = *it;
+	const bool fed = enc.feed_frame(f);
+	FF_ASSERT(fed, "An encoder kept should always be hungry.");
+	packet pkt;
+	if (enc.encode_packet(pkt))
+	{
+		return pkt;
+	}
+
+	// It holds frames back (e.g. an animated encoder), so it has to be drained,
+	// and can't be used again.
+	enc.signal_no_more_food();
+	const bool got = enc.encode_packet(pkt);
+	encoders.erase(it);
+	if (!got)
+	{
+		throw std::runtime_error("The encoder gave no image.");
+	}
+	return pkt;
+}
+
+void ff::image_exporter::internal_check(const frame& f) const
+{
+	if (!f.ready() || !f.v_or_a() || f.get_data_properties() != src_props)
+	{
+		throw std::invalid_argument("The frame is not a ready video frame of the src properties.");
+	}
+}
+
+std::future<ff::packet> ff::image_exporter::internal_submit(task&& t)
+{
+	std::future<packet> res = t.result.get_future();
+	if (!tasks.push(std::move(t)))
+	{
+		throw std::logic_error("finish() has been called.");
+	}
+	return res;
+}
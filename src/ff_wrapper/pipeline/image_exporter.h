@@ -0,0 +1,221 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/dict.h"
+#include "../util/bounded_queue.h"
+#include "../data/frame.h"
+#include "../data/packet.h"
+#include "../codec/encoder.h"
+#include "../sws/frame_transformer.h"
+
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* Exports many frames as still images (e.g. the thumbnails of a video, or its sprite sheets for scrubbing),
+	* encoding them on a pool of workers instead of opening an encoder per image.
+	*
+	* Each frame submitted is referenced, not copied, and a worker then
+	*	1. scales it to the image size through one frame_transformer that all workers share,
+	*	2. and encodes it with its own encoder, which it opened at its first image of that size and keeps.
+	* So the encoders are opened once per worker, not once per image.
+	* The encoders are single threaded, as the images are encoded in parallel instead.
+	*
+	* A sprite sheet is allocated once, and each frame is scaled straight into its tile (see frame::crop_view()),
+	* so the tiles are never copied. The tiles are laid out row by row, and the tiles left over are black.
+	*
+	* All frames must be of the src properties given at construction.
+	* Images are encoded in the pixel format the encoder prefers among those I know suit it
+	* (rgb24 for PNG, yuv420p for WebP, yuvj420p for JPEG), or else the first one it supports.
+	*
+	* The submit methods can be called from several threads at once.
+	* They wait while queue_capacity images are waiting already, which bounds the frames held.
+	*/
+	class FF_WRAPPER_API image_exporter final
+	{
+	public:
+		enum class image_format
+		{
+			// The png encoder.
+			png,
+			// The libwebp encoder.
+			webp,
+			// The mjpeg encoder.
+			jpeg
+		};
+
+	public:
+		image_exporter() = delete;
+
+		/*
+		* Starts the workers.
+		*
+		* @param src the properties of the frames submitted.
+		* @param dst_w, dst_h the size of each image, or each tile of a sprite sheet.
+		* @param format of the images.
+		* @param options to open the encoders with (e.g. quality for libwebp, or compression_level for png). Can be empty.
+		* @param num_workers how many images are encoded at once. 0 for as many as the hardware threads.
+		* @param queue_capacity at most how many images can wait for the workers.
+		* @param algorithm the scaling algorithm. Area averaging suits large downscaling.
+		* @throws std::invalid_argument if src is not video, if dst_w or dst_h <= 0, if num_workers < 0,
+		* if queue_capacity is 0, if the encoder is not in the FFmpeg build,
+		* or if dst_w or dst_h is not a multiple of the chroma subsampling of the images (e.g. odd for JPEG).
+		* @throws std::domain_error if a pixel format cannot be scaled.
+		*/
+		image_exporter
+		(
+			const frame::data_properties& src,
+			int dst_w, int dst_h, image_format format,
+			const dict& options = dict(), int num_workers = 0, size_t queue_capacity = 64,
+			frame_transformer::algorithms algorithm = frame_transformer::FF_SWS_AREA
+		);
+
+		image_exporter(const image_exporter&) = delete;
+		image_exporter& operator=(const image_exporter&) = delete;
+
+		/*
+		* Same as finish(), except it doesn't throw.
+		*/
+		~image_exporter() noexcept;
+
+	public:
+		/*
+		* Exports f as an image.
+		*
+		* @param f a ready video frame of the src properties.
+		* @param path where to write the image. Empty to only give it back.
+		* @returns the image, encoded, as one packet. It holds what the scaling, encoding, or writing throws.
+		* @throws std::invalid_argument if f is not a ready video frame of the src properties.
+		* @throws std::logic_error if finish() has been called.
+		*/
+		std::future<packet> submit(const frame& f, const std::filesystem::path& path = std::filesystem::path());
+
+		/*
+		* Exports the frames as a sprite sheet of columns tiles a row, and as many rows as needed.
+		*
+		* @param frames ready video frames of the src properties.
+		* @param columns how many tiles a row.
+		* @param path where to write the image. Empty to only give it back.
+		* @returns the sprite sheet, encoded, as one packet. It holds what the scaling, encoding, or writing throws.
+		* @throws std::invalid_argument if frames is empty, if columns <= 0,
+		* or if any of frames is not a ready video frame of the src properties.
+		* @throws std::logic_error if finish() has been called.
+		*/
+		std::future<packet> submit_sprite_sheet
+		(
+			std::vector<frame> frames, int columns,
+			const std::filesystem::path& path = std::filesystem::path()
+		);
+
+		/*
+		* Waits for the images submitted, and stops the workers. Nothing can be submitted afterwards.
+		* Calling it again does nothing.
+		*/
+		void finish();
+
+	public:
+		int width() const noexcept { return dst_w; }
+		int height() const noexcept { return dst_h; }
+		image_format get_format() const noexcept { return format; }
+		// Of the images.
+		AVPixelFormat pixel_format() const noexcept { return dst_fmt; }
+		int num_workers() const noexcept { return static_cast<int>(workers.size()); }
+
+		/*
+		* @returns how many images (sprite sheets included) have been exported successfully.
+		*/
+		size_t number_exported() const noexcept { return num_exported.load(std::memory_order_relaxed); }
+		/*
+		* @returns how many encoders the workers have opened in total.
+		*/
+		size_t number_encoders_opened() const noexcept { return num_opened.load(std::memory_order_relaxed); }
+
+	private:
+		struct task
+		{
+			// One for an image; the tiles for a sprite sheet.
+			std::vector<frame> frames;
+			// 0 for an image.
+			int columns = 0;
+			std::filesystem::path path;
+			std::promise<packet> result;
+		};
+
+		/*
+		* What each worker runs.
+		*/
+		void internal_work() noexcept;
+
+		/*
+		* Scales and encodes what t says, and writes it if it has a path.
+		* encoders are those of the calling worker.
+		*/
+		packet internal_export(task& t, std::vector<encoder>& encoders);
+
+		/*
+		* Scales src into dst (e.g. a tile of a sprite sheet), which is of the dst properties, under the transformer's lock.
+		*/
+		void internal_scale(frame& dst, const frame& src);
+
+		/*
+		* @returns f encoded by the encoder of its size among encoders, opened if there's none.
+		*/
+		packet internal_encode(frame& f, std::vector<encoder>& encoders);
+
+		/*
+		* @throws std::invalid_argument if f is not a ready video frame of the src properties.
+		*/
+		void internal_check(const frame& f) const;
+
+		/*
+		* @throws std::logic_error if finish() has been called.
+		*/
+		std::future<packet> internal_submit(task&& t);
+
+	private:
+		const frame::data_properties src_props;
+		int dst_w, dst_h;
+		image_format format;
+		AVPixelFormat dst_fmt;
+		// Const, so that opening an encoder with them doesn't store the unused ones back.
+		const dict options;
+
+		// Shared by the workers, so only used under its lock.
+		frame_transformer transformer;
+		std::mutex transformer_mtx;
+
+		bounded_queue<task> tasks;
+		std::vector<std::thread> workers;
+		std::mutex finish_mtx;
+
+		std::atomic<size_t> num_exported{ 0 };
+		std::atomic<size_t> num_opened{ 0 };
+	};
+}
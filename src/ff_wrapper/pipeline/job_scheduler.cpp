@@ -0,0 +1,246 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "job_scheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+	// The scheduler and the worker the calling thread is, if it's a worker.
+	thread_local const ff::job_scheduler* current_scheduler = nullptr;
+	thread_local size_t current_worker = 0;
+}
+
+ff::job_scheduler::job_scheduler(int num_workers, int core_budget)
+	: core_budget(core_budget)
+{
+	if (num_workers < 0)
+	{
+		throw std::invalid_argument("The number of workers cannot be negative.");
+	}
+	if (core_budget < 0)
+	{
+		throw std::invalid_argument("The core budget cannot be negative.");
+	}
+
+	if (0 == this->core_budget)
+	{
+		this->core_budget = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	}
+	if (0 == num_workers)
+	{
+		num_workers = this->core_budget;
+	}
+	if (num_workers > this->core_budget)
+	{
+		throw std::invalid_argument("Each worker needs at least 1 core of the budget.");
+	}
+
+	queues.reserve(num_workers);
+	for (int i = 0; i < num_workers; ++i)
+	{
+		queues.push_back(std::make_unique<worker_queue>());
+	}
+
+	workers.reserve(num_workers);
+	try
+	{
+		for (int i = 0; i < num_workers; ++i)
+		{
+			workers.emplace_back(&job_scheduler::internal_work, this, static_cast<size_t>(i));
+		}
+	}
+	catch (...)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+		}
+		work_available.notify_all();
+		for (auto& w : workers)
+		{
+			w.join();
+		}
+		throw;
+	}
+}
+
+ff::job_scheduler::~job_scheduler() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	work_available.notify_all();
+
+	// The workers only stop after all the tasks are done.
+	for (auto& w : workers)
+	{
+		w.join();
+	}
+}
+
+std::future<void> ff::job_scheduler::submit(job j)
+{
+	if (!j)
+	{
+		throw std::invalid_argument("The job cannot be empty.");
+	}
+
+	task t(std::move(j));
+	std::future<void> res = t.get_future();
+
+	size_t ind = 0;
+	if (this == current_scheduler)
+	{
+		// Keep it near the job that submits it.
+		ind = current_worker;
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		ind = next_queue;
+		next_queue = (next_queue + 1) % queues.size();
+	}
+
+	{
+		// Counted in the same critical section as it's queued, so that no worker can take it
+		// (and count it off) before it's counted, which would wrap num_waiting around.
+		// Workers never lock mtx while holding a queue's lock, so the order is safe.
+		std::lock_guard<std::mutex> lock(mtx);
+		std::lock_guard<std::mutex> queue_lock(queues[ind]->mtx);
+		queues[ind]->tasks.push_back(std::move(t));
+		++num_waiting;
+	}
+	work_available.notify_one();
+
+	return res;
+}
+
+void ff::job_scheduler::wait_idle()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	all_done.wait(lock, [this]() { return 0 == num_waiting && 0 == num_running; });
+}
+
+size_t ff::job_scheduler::number_running() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return num_running;
+}
+
+size_t ff::job_scheduler::number_waiting() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return num_waiting;
+}
+
+int ff::job_scheduler::fair_share(int core_budget, int threads_in_use, size_t running, size_t waiting, size_t num_workers) noexcept
+{
+	waiting = std::max<size_t>(1, waiting);
+	running = std::min(running, num_workers - 1);
+
+	const size_t concurrent = std::min(running + waiting, num_workers);
+	const int share = static_cast<int>(std::max<size_t>(1, static_cast<size_t>(core_budget) / concurrent));
+
+	// Leave 1 for each of the other workers that are idle, so that the budget holds whenever they start.
+	const size_t others = num_workers - running - 1;
+	const int left = core_budget - threads_in_use - static_cast<int>(others);
+
+	return std::max(1, std::min(share, left));
+}
+
+void ff::job_scheduler::internal_work(size_t ind) noexcept
+{
+	current_scheduler = this;
+	current_worker = ind;
+
+	task t;
+	while (true)
+	{
+		if (!internal_take(ind, t))
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			// A task is counted as it's queued, so if one is counted here, it can be taken
+			// (or is being taken by another worker, which counts it off right after).
+			work_available.wait(lock, [this]() { return stopping || num_waiting > 0; });
+			if (0 == num_waiting)
+			{
+				// Stopping, and nothing is left.
+				return;
+			}
+			continue;
+		}
+
+		int granted = 0;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			// The task is counted as waiting until now.
+			FF_ASSERT(num_waiting > 0, "A task taken must have been counted.");
+			granted = fair_share(core_budget, threads_in_use, num_running, num_waiting, queues.size());
+			--num_waiting;
+			++num_running;
+			threads_in_use += granted;
+		}
+
+		// What the job throws goes to its future.
+		t(job_context(granted));
+		t = task();
+
+		bool idle = false;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			--num_running;
+			threads_in_use -= granted;
+			idle = 0 == num_running && 0 == num_waiting;
+		}
+		if (idle)
+		{
+			all_done.notify_all();
+		}
+	}
+}
+
+bool ff::job_scheduler::internal_take(size_t ind, task& t)
+{
+	{
+		auto& own = *queues[ind];
+		std::lock_guard<std::mutex> lock(own.mtx);
+		if (!own.tasks.empty())
+		{
+			t = std::move(own.tasks.front());
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+
+	// Steal the newest of another's, which its owner would run last.
+	for (size_t k = 1; k < queues.size(); ++k)
+	{
+		auto& other = *queues[(ind + k) % queues.size()];
+		std::lock_guard<std::mutex> lock(other.mtx);
+		if (!other.tasks.empty())
+		{
+			t = std::move(other.tasks.back());
+			other.tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
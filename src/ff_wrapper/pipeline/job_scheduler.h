@@ -0,0 +1,194 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../codec/codec_base.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* Runs many small jobs (e.g. one transcode per short file) on a fixed set of worker threads,
+	* and shares a budget of cores among the jobs running, so that the threads the codecs
+	* and transformers of the jobs start don't oversubscribe the machine.
+	* 
+	* Cores:
+	* When a job starts, I grant it a number of threads (job_context::num_threads()):
+	* its fair share of the budget among the jobs that can run now (those running and those waiting,
+	* but no more than the workers), and no more than what is left of the budget after the jobs running
+	* and 1 for each of the other workers, which may start a job at any time. It is always at least 1,
+	* and the total granted never exceeds the budget.
+	* So with many jobs waiting, each gets 1 thread and the jobs themselves are the parallelism.
+	* With fewer workers than the budget, the jobs get more each when there are few of them,
+	* so that the cores are not left idle; e.g. 2 workers with a budget of 8 grant a lone job 7.
+	* A job should open its decoders and encoders with job_context::codec_threading()
+	* and its frame_transformers with job_context::num_threads(). The grant is fixed for the job's life,
+	* as codecs can't change their threads once opened.
+	* 
+	* Work stealing:
+	* Each worker has its own queue. Jobs submitted from outside are dealt to the queues in turn,
+	* and those a job submits go to the queue of its worker. A worker runs the jobs of its own queue
+	* in order, and when it runs out, steals the last job of another's.
+	* 
+	* Don't wait inside a job for another job to finish, as all the workers may be waiting then.
+	* The destructor waits for all the jobs submitted.
+	*/
+	class FF_WRAPPER_API job_scheduler final
+	{
+	public:
+		/*
+		* What a job is told when it starts.
+		*/
+		class job_context final
+		{
+		public:
+			/*
+			* @returns the number of threads granted to the job. At least 1.
+			*/
+			int num_threads() const noexcept { return threads; }
+
+			/*
+			* @returns the threading policy for the codecs of the job, which uses num_threads() threads.
+			*/
+			codec_base::threading_policy codec_threading() const noexcept
+			{
+				return 1 == threads ? codec_base::threading_policy::single_threaded() : codec_base::threading_policy(threads);
+			}
+
+		private:
+			friend class job_scheduler;
+			explicit job_context(int threads) noexcept
+				: threads(threads) {}
+
+			int threads;
+		};
+
+		using job = std::function<void(const job_context&)>;
+
+	public:
+		/*
+		* Starts the workers.
+		* 
+		* @param num_workers how many jobs can run at the same time. 0 means as many as the core budget.
+		* @param core_budget how many threads all the jobs running may use in total.
+		* 0 means as many as the hardware threads.
+		* @throws std::invalid_argument if num_workers < 0 or core_budget < 0,
+		* or if there are more workers than the budget.
+		*/
+		explicit job_scheduler(int num_workers = 0, int core_budget = 0);
+
+		job_scheduler(const job_scheduler&) = delete;
+		job_scheduler& operator=(const job_scheduler&) = delete;
+
+		/*
+		* Waits for all the jobs submitted, and stops the workers.
+		*/
+		~job_scheduler() noexcept;
+
+	public:
+		/*
+		* Submits a job. It can be called from any thread, including from inside a job.
+		* 
+		* @param j the job.
+		* @returns a future that becomes ready when the job finishes, and holds what it throws.
+		* @throws std::invalid_argument if j is empty.
+		*/
+		std::future<void> submit(job j);
+
+		/*
+		* Waits until all the jobs submitted so far, and those they submit, have finished.
+		* Don't call it from inside a job.
+		*/
+		void wait_idle();
+
+	public:
+		int get_num_workers() const noexcept { return static_cast<int>(workers.size()); }
+		int get_core_budget() const noexcept { return core_budget; }
+
+		/*
+		* @returns how many jobs are running now.
+		*/
+		size_t number_running() const;
+		/*
+		* @returns how many jobs are waiting now.
+		*/
+		size_t number_waiting() const;
+
+		/*
+		* How many threads I grant a job that starts with the others.
+		* 
+		* @param core_budget the budget.
+		* @param threads_in_use how many threads are granted to the jobs running already.
+		* @param running how many jobs are running already.
+		* @param waiting how many jobs are waiting, including the one that starts.
+		* @param num_workers the number of workers.
+		* @returns the share of the job. At least 1.
+		*/
+		static int fair_share(int core_budget, int threads_in_use, size_t running, size_t waiting, size_t num_workers) noexcept;
+
+	private:
+		using task = std::packaged_task<void(const job_context&)>;
+
+		struct worker_queue
+		{
+			std::mutex mtx;
+			std::deque<task> tasks;
+		};
+
+		/*
+		* What each worker runs.
+		*/
+		void internal_work(size_t ind) noexcept;
+
+		/*
+		* Takes a task from the queue of worker ind, or steals one from another's.
+		* 
+		* @returns true iff one is taken.
+		*/
+		bool internal_take(size_t ind, task& t);
+
+	private:
+		int core_budget;
+
+		std::vector<std::unique_ptr<worker_queue>> queues;
+		std::vector<std::thread> workers;
+
+		// Guards the counters and stopping.
+		mutable std::mutex mtx;
+		// For workers waiting for tasks.
+		std::condition_variable work_available;
+		// For wait_idle().
+		std::condition_variable all_done;
+
+		size_t num_waiting = 0;
+		size_t num_running = 0;
+		int threads_in_use = 0;
+		bool stopping = false;
+
+		// Where the next task from outside goes.
+		size_t next_queue = 0;
+	};
+}
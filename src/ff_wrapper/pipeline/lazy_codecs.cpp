@@ -0,0 +1,71 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "lazy_codecs.h"
+#include "../formats/demuxer.h"
+
+namespace
+{
+	ff::generator<ff::frame> decode_lazily(ff::demuxer& dem, ff::decoder& dec, int stream_ind)
+	{
+		ff::packet pkt;
+		ff::frame f(true);
+		while (dem.demux_next_packet(pkt))
+		{
+			if (pkt->stream_index != stream_ind)
+			{
+				continue;
+			}
+
+			// Only fails when full.
+			while (!dec.feed_packet(pkt))
+			{
+				while (dec.decode_frame(f))
+				{
+					co_yield f;
+				}
+			}
+			while (dec.decode_frame(f))
+			{
+				co_yield f;
+			}
+		}
+
+		dec.signal_no_more_food();
+		while (dec.decode_frame(f))
+		{
+			co_yield f;
+		}
+	}
+}
+
+ff::generator<ff::frame> ff::decoded_frames(demuxer& dem, decoder& dec, int stream_ind)
+{
+	// Checked here so that they are thrown now instead of from the first iteration.
+	if (!dec.ready())
+	{
+		throw std::logic_error("The decoder is not ready.");
+	}
+	if (dec.no_more_food())
+	{
+		throw std::logic_error("No more food has been signaled to the decoder.");
+	}
+	if (stream_ind < 0 || stream_ind >= dem.num_streams())
+	{
+		throw std::out_of_range("Stream index out of range.");
+	}
+
+	return decode_lazily(dem, dec, stream_ind);
+}
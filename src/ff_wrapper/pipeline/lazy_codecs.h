@@ -0,0 +1,124 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Lazy, pull-based ranges over the feeding protocol of the codecs (see codec_base.h),
+* so that you write
+*	for (ff::frame& f : ff::decoded_frames(dem, dec, ind)) ...
+* instead of juggling hungry(), full(), and signal_no_more_food() yourself.
+* 
+* A packet is only demuxed, decoded, or encoded when the next element is asked for,
+* so stopping early (break, or std::views::take) does no wasted work.
+* Nothing is buffered beyond what the codecs themselves hold.
+*/
+
+#include "../util/util.h"
+#include "../util/generator.h"
+#include "../data/frame.h"
+#include "../data/packet.h"
+#include "../codec/decoder.h"
+#include "../codec/encoder.h"
+
+#include <ranges>
+#include <stdexcept>
+#include <utility>
+
+namespace ff
+{
+	class demuxer;
+
+	/*
+	* Decodes the stream of dem at stream_ind with dec.
+	* Packets of other streams are skipped (consider demuxer::set_discard() for them).
+	* At the end of the file, I signal no more food to dec and yield what it has left.
+	* 
+	* Each frame yielded is the same frame object, reused. Copy it (that only references its data)
+	* if you need it after asking for the next one.
+	* 
+	* If you stop early, dec is left in the middle of decoding. reset() it before decoding elsewhere,
+	* e.g. after seeking dem.
+	* dem and dec must outlive the generator, and must not be used while it's being iterated.
+	* 
+	* @throws std::logic_error if dec is not ready, or if no more food has been signaled to dec.
+	* @throws std::out_of_range if stream_ind is wrong.
+	* Iterating throws what demuxing and decoding throw.
+	*/
+	FF_WRAPPER_API generator<frame> decoded_frames(demuxer& dem, decoder& dec, int stream_ind);
+
+	namespace detail
+	{
+		/*
+		* See encoded_packets().
+		*/
+		template <std::ranges::input_range R>
+		generator<packet> internal_encoded_packets(encoder& enc, R frames)
+		{
+			packet pkt;
+			for (const frame& f : frames)
+			{
+				// Only fails when full.
+				while (!enc.feed_frame(f))
+				{
+					while (enc.encode_packet(pkt))
+					{
+						co_yield pkt;
+					}
+				}
+				while (enc.encode_packet(pkt))
+				{
+					co_yield pkt;
+				}
+			}
+
+			enc.signal_no_more_food();
+			while (enc.encode_packet(pkt))
+			{
+				co_yield pkt;
+			}
+		}
+	}
+
+	/*
+	* Encodes frames with enc. After the last frame, I signal no more food to enc
+	* and yield what it has left.
+	* The frames are pulled one by one as the packets are asked for, so if frames is itself lazy
+	* (e.g. decoded_frames() through a transformation), the whole chain is.
+	* 
+	* Each packet yielded is the same packet object, reused. Move it out (e.g. mux it) or copy it
+	* before asking for the next one. Its properties are what encoder::encode_packet() gives.
+	* 
+	* @param frames an input range of frames (or of what converts to const frame&), with pts set.
+	* An lvalue range is referenced, so it must outlive the generator. An rvalue one is moved in.
+	* @throws std::logic_error if enc is not ready, or if no more food has been signaled to enc.
+	* Iterating throws what the range and encoding throw.
+	*/
+	template <std::ranges::viewable_range R>
+		requires std::ranges::input_range<R>
+	generator<packet> encoded_packets(encoder& enc, R&& frames)
+	{
+		if (!enc.ready())
+		{
+			throw std::logic_error("The encoder is not ready.");
+		}
+		if (enc.no_more_food())
+		{
+			throw std::logic_error("No more food has been signaled to the encoder.");
+		}
+
+		return detail::internal_encoded_packets(enc, std::views::all(std::forward<R>(frames)));
+	}
+}
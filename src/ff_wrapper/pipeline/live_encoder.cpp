@@ -0,0 +1,140 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "live_encoder.h"
+#include "../data/frame.h"
+#include "../codec/encoder.h"
+#include "../formats/muxer.h"
+
+extern "C"
+{
+#include <libavcodec/packet.h>
+}
+
+#include <stdexcept>
+
+ff::live_encoder::live_encoder(encoder& enc, muxer& mux, const stream& out_stream)
+	: enc(&enc), mux(&mux), out_stream(out_stream)
+{
+	if (!enc.ready())
+	{
+		throw std::logic_error("The encoder must be ready.");
+	}
+}
+
+size_t ff::live_encoder::push_frame(const frame& f, clock::time_point arrived)
+{
+	if (finished)
+	{
+		throw std::logic_error("The live encoder has been finished.");
+	}
+
+	size_t n = 0;
+	// Only fails when full, which a low latency encoder should never be.
+	while (!enc->feed_frame(f))
+	{
+		n += internal_write_available();
+	}
+	in_flight.emplace_back(f->pts, arrived);
+
+	return n + internal_write_available();
+}
+
+size_t ff::live_encoder::finish()
+{
+	if (finished)
+	{
+		throw std::logic_error("The live encoder has been finished.");
+	}
+	finished = true;
+
+	enc->signal_no_more_food();
+	return internal_write_available();
+}
+
+size_t ff::live_encoder::internal_write_available()
+{
+	size_t n = 0;
+	while (enc->encode_packet(pkt))
+	{
+		const clock::time_point arrived = internal_take_arrival(pkt->pts);
+
+		if (!rescaler.has_value() && out_stream.time_base() > 0)
+		{
+			rescaler.emplace(pkt.time_base(), out_stream.time_base());
+		}
+		if (rescaler.has_value())
+		{
+			pkt.prepare_for_muxing(out_stream, *rescaler);
+		}
+		else
+		{
+			pkt.prepare_for_muxing(out_stream);
+		}
+
+		[[maybe_unused]] const int64_t bytes = pkt->size;
+		// Written at once, and pushed out of any buffer.
+		mux->mux_packet_manual(pkt);
+		mux->flush_demuxer();
+
+		const clock::time_point written = clock::now();
+		last = written - arrived;
+		if (last > largest)
+		{
+			largest = last;
+		}
+#ifdef FF_WRAPPER_ENABLE_METRICS
+		if (auto* s = metrics_probe.get(0))
+		{
+			s->record(arrived, written, 1, static_cast<uint64_t>(bytes), false);
+		}
+#endif // FF_WRAPPER_ENABLE_METRICS
+
+		++num_packets;
+		++n;
+	}
+
+	return n;
+}
+
+ff::live_encoder::clock::time_point ff::live_encoder::internal_take_arrival(int64_t pts)
+{
+	if (in_flight.empty())
+	{
+		return clock::now();
+	}
+
+	if (AV_NOPTS_VALUE == pts || AV_NOPTS_VALUE == in_flight.front().first)
+	{
+		// Can't match them. They come out in order without B-frames.
+		const clock::time_point t = in_flight.front().second;
+		in_flight.pop_front();
+		return t;
+	}
+
+	// Frames before pts that have no packet were dropped by the encoder.
+	while (!in_flight.empty() && in_flight.front().first < pts)
+	{
+		in_flight.pop_front();
+	}
+	if (!in_flight.empty() && in_flight.front().first == pts)
+	{
+		const clock::time_point t = in_flight.front().second;
+		in_flight.pop_front();
+		return t;
+	}
+
+	return clock::now();
+}
@@ -0,0 +1,149 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/ff_time.h"
+#include "../util/metrics.h"
+#include "../data/packet.h"
+#include "../formats/stream.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <utility>
+
+namespace ff
+{
+	class frame;
+	class encoder;
+	class muxer;
+
+	/*
+	* Encodes and muxes one live stream with as little latency as possible:
+	* each frame pushed is encoded at once, and each packet is written and flushed
+	* to the output (mux_packet_manual() and flush_demuxer()) as soon as the encoder gives it out,
+	* instead of going through the interleaving queue of mux_packet_auto().
+	* 
+	* For the latency to be low, the encoder and the muxer should be set up for it
+	* with encoder::set_low_latency() and muxer::set_low_latency(); otherwise it works all the same,
+	* only the encoder holds frames before it gives out their packets.
+	* 
+	* Latency:
+	* For each packet, I measure the time from when its frame was pushed (or the time you give)
+	* to when the packet has been written and flushed. The last and the largest are always available.
+	* With FF_WRAPPER_ENABLE_METRICS, each is also recorded in the stage frame_to_packet of the probe
+	* "live_encoder" (see metrics.h), whose histogram gives the percentiles.
+	* Packets are matched to their frames by pts, so give the frames distinct increasing pts.
+	* 
+	* With more than one stream (e.g. video and audio), use one live_encoder for each, all on the same muxer.
+	* Packets of different streams are then written in the order they are encoded,
+	* which for live inputs is close to the order of their timestamps.
+	* 
+	* enc and mux must outlive the object. It is not thread-safe.
+	*/
+	class FF_WRAPPER_API live_encoder final
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		/*
+		* @param enc a ready encoder. Frames pushed must be in its time base.
+		* @param mux the muxer. It must be prepared before the first push_frame().
+		* @param out_stream the stream in mux the packets go to.
+		*/
+		live_encoder(encoder& enc, muxer& mux, const stream& out_stream);
+
+		live_encoder(const live_encoder&) = delete;
+		live_encoder& operator=(const live_encoder&) = delete;
+
+	public:
+		/*
+		* Encodes f, and writes every packet the encoder gives out afterwards.
+		* 
+		* @param f a ready frame.
+		* @param arrived when f came in, e.g. when it was captured. Its latency is measured from it.
+		* @returns how many packets were written.
+		* @throws std::logic_error if finish() has been called.
+		* @throws what encoder::feed_frame(), encode_packet(), and muxer::mux_packet_manual() throw.
+		*/
+		size_t push_frame(const frame& f, clock::time_point arrived = clock::now());
+
+		/*
+		* Drains the encoder and writes what it has left.
+		* The muxer is not finalized; call muxer::finalize() after all the streams are finished.
+		* 
+		* @returns how many packets were written.
+		* @throws std::logic_error if it has been called.
+		*/
+		size_t finish();
+
+	public:
+		/*
+		* @returns how many packets have been written.
+		*/
+		size_t number_packets() const noexcept { return num_packets; }
+
+		/*
+		* @returns the latency of the last packet written. 0 if none.
+		*/
+		clock::duration last_latency() const noexcept { return last; }
+		/*
+		* @returns the largest latency of the packets written so far. 0 if none.
+		*/
+		clock::duration max_latency() const noexcept { return largest; }
+
+	private:
+		/*
+		* Writes the packets the encoder has ready now.
+		* 
+		* @returns how many packets were written.
+		*/
+		size_t internal_write_available();
+
+		/*
+		* @returns when the frame of a packet with pts was pushed,
+		* and forgets the frames before it. clock::now() if it's not found.
+		*/
+		clock::time_point internal_take_arrival(int64_t pts);
+
+	private:
+		encoder* enc;
+		muxer* mux;
+		stream out_stream;
+
+		// From the encoder's time base to the stream's. Worked out at the first packet,
+		// when the muxer is prepared and the time base of the stream is final.
+		std::optional<time_rescaler> rescaler;
+
+		// (pts, when it was pushed) of the frames whose packets are not written yet, in push order.
+		std::deque<std::pair<int64_t, clock::time_point>> in_flight;
+
+		// Reused for every packet.
+		packet pkt;
+
+		size_t num_packets = 0;
+		clock::duration last{ 0 }, largest{ 0 };
+		bool finished = false;
+
+#ifdef FF_WRAPPER_ENABLE_METRICS
+		// Stages: frame_to_packet. See metrics.h.
+		metrics::probe metrics_probe{ "live_encoder", { "frame_to_packet" } };
+#endif // FF_WRAPPER_ENABLE_METRICS
+	};
+}
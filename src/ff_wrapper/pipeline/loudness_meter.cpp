@@ -0,0 +1,732 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "loudness_meter.h"
+#include "../data/frame_ops.h"
+
+extern "C"
+{
+#include <libavutil/samplefmt.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define FF_LOUDNESS_X86 1
+	#include <immintrin.h>
+	// GCC and Clang only emit an instruction set for functions that ask for it.
+	// MSVC emits any intrinsic anywhere.
+	#if defined(__GNUC__) || defined(__clang__)
+		#define FF_TARGET(isa) __attribute__((target(isa)))
+	#else
+		#define FF_TARGET(isa)
+	#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	// 32-bit NEON has no doubles.
+	#define FF_LOUDNESS_NEON 1
+	#include <arm_neon.h>
+#endif
+
+namespace
+{
+	using ff::frame_ops::simd_level;
+
+	constexpr double neg_inf = -std::numeric_limits<double>::infinity();
+
+	/*
+	* Runs 4 lanes (channels) of n samples each through the K-weighting.
+	* k holds b0, b1, b2, a1, a2 of the pre-filter, then a1, a2 of the high-pass (whose b are 1, -2, 1).
+	* z1, z2, w1, w2 are the biquads' states, lane by lane.
+	* Adds the squares of the weighted samples to wsq and of the raw ones to rsq, and raises peak to the largest |x|.
+	* Every version does the same operations in the same order on each lane.
+	*/
+	using k_weight_kernel = void (*)
+	(
+		const float* const* x, int n, const double* k,
+		double* z1, double* z2, double* w1, double* w2,
+		double* wsq, double* rsq, double* peak
+	);
+
+	/////////////////////////////// Scalar ///////////////////////////////
+
+	void k_weight_scalar
+	(
+		const float* const* x, int n, const double* k,
+		double* z1, double* z2, double* w1, double* w2,
+		double* wsq, double* rsq, double* peak
+	)
+	{
+		for (int l = 0; l < 4; ++l)
+		{
+			double s1 = z1[l], s2 = z2[l], t1 = w1[l], t2 = w2[l];
+			double acc = wsq[l], racc = rsq[l], pk = peak[l];
+			const float* in = x[l];
+			for (int i = 0; i < n; ++i)
+			{
+				const double v = in[i];
+				const double y1 = k[0] * v + s1;
+				s1 = (k[1] * v - k[3] * y1) + s2;
+				s2 = k[2] * v - k[4] * y1;
+				const double y2 = y1 + t1;
+				t1 = (-2.0 * y1 - k[5] * y2) + t2;
+				t2 = y1 - k[6] * y2;
+
+				acc += y2 * y2;
+				racc += v * v;
+				pk = std::max(pk, std::fabs(v));
+			}
+			z1[l] = s1; z2[l] = s2; w1[l] = t1; w2[l] = t2;
+			wsq[l] = acc; rsq[l] = racc; peak[l] = pk;
+		}
+	}
+
+#ifdef FF_LOUDNESS_X86
+	/////////////////////////////// SSE2 ///////////////////////////////
+	// 2 lanes per register. What sse4 runs, as nothing here needs more.
+
+	FF_TARGET("sse2") void k_weight_sse2
+	(
+		const float* const* x, int n, const double* k,
+		double* z1, double* z2, double* w1, double* w2,
+		double* wsq, double* rsq, double* peak
+	)
+	{
+		const __m128d b0 = _mm_set1_pd(k[0]), b1 = _mm_set1_pd(k[1]), b2 = _mm_set1_pd(k[2]);
+		const __m128d a1 = _mm_set1_pd(k[3]), a2 = _mm_set1_pd(k[4]);
+		const __m128d c1 = _mm_set1_pd(k[5]), c2 = _mm_set1_pd(k[6]);
+		const __m128d minus_two = _mm_set1_pd(-2.0);
+		const __m128d abs_mask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+
+		for (int h = 0; h < 4; h += 2)
+		{
+			__m128d s1 = _mm_load_pd(z1 + h), s2 = _mm_load_pd(z2 + h);
+			__m128d t1 = _mm_load_pd(w1 + h), t2 = _mm_load_pd(w2 + h);
+			__m128d acc = _mm_load_pd(wsq + h), racc = _mm_load_pd(rsq + h), pk = _mm_load_pd(peak + h);
+			const float* lo = x[h];
+			const float* hi = x[h + 1];
+			for (int i = 0; i < n; ++i)
+			{
+				const __m128d v = _mm_set_pd(hi[i], lo[i]);
+				const __m128d y1 = _mm_add_pd(_mm_mul_pd(b0, v), s1);
+				s1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, v), _mm_mul_pd(a1, y1)), s2);
+				s2 = _mm_sub_pd(_mm_mul_pd(b2, v), _mm_mul_pd(a2, y1));
+				const __m128d y2 = _mm_add_pd(y1, t1);
+				t1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(minus_two, y1), _mm_mul_pd(c1, y2)), t2);
+				t2 = _mm_sub_pd(y1, _mm_mul_pd(c2, y2));
+
+				acc = _mm_add_pd(acc, _mm_mul_pd(y2, y2));
+				racc = _mm_add_pd(racc, _mm_mul_pd(v, v));
+				pk = _mm_max_pd(pk, _mm_and_pd(v, abs_mask));
+			}
+			_mm_store_pd(z1 + h, s1); _mm_store_pd(z2 + h, s2);
+			_mm_store_pd(w1 + h, t1); _mm_store_pd(w2 + h, t2);
+			_mm_store_pd(wsq + h, acc); _mm_store_pd(rsq + h, racc); _mm_store_pd(peak + h, pk);
+		}
+	}
+
+	/////////////////////////////// AVX2 ///////////////////////////////
+	// All 4 lanes in one register.
+
+	FF_TARGET("avx2") void k_weight_avx2
+	(
+		const float* const* x, int n, const double* k,
+		double* z1, double* z2, double* w1, double* w2,
+		double* wsq, double* rsq, double* peak
+	)
+	{
+		const __m256d b0 = _mm256_set1_pd(k[0]), b1 = _mm256_set1_pd(k[1]), b2 = _mm256_set1_pd(k[2]);
+		const __m256d a1 = _mm256_set1_pd(k[3]), a2 = _mm256_set1_pd(k[4]);
+		const __m256d c1 = _mm256_set1_pd(k[5]), c2 = _mm256_set1_pd(k[6]);
+		const __m256d minus_two = _mm256_set1_pd(-2.0);
+		const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+
+		__m256d s1 = _mm256_load_pd(z1), s2 = _mm256_load_pd(z2);
+		__m256d t1 = _mm256_load_pd(w1), t2 = _mm256_load_pd(w2);
+		__m256d acc = _mm256_load_pd(wsq), racc = _mm256_load_pd(rsq), pk = _mm256_load_pd(peak);
+		const float* x0 = x[0];
+		const float* x1 = x[1];
+		const float* x2 = x[2];
+		const float* x3 = x[3];
+		for (int i = 0; i < n; ++i)
+		{
+			const __m256d v = _mm256_cvtps_pd(_mm_set_ps(x3[i], x2[i], x1[i], x0[i]));
+			const __m256d y1 = _mm256_add_pd(_mm256_mul_pd(b0, v), s1);
+			s1 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(b1, v), _mm256_mul_pd(a1, y1)), s2);
+			s2 = _mm256_sub_pd(_mm256_mul_pd(b2, v), _mm256_mul_pd(a2, y1));
+			const __m256d y2 = _mm256_add_pd(y1, t1);
+			t1 = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(minus_two, y1), _mm256_mul_pd(c1, y2)), t2);
+			t2 = _mm256_sub_pd(y1, _mm256_mul_pd(c2, y2));
+
+			acc = _mm256_add_pd(acc, _mm256_mul_pd(y2, y2));
+			racc = _mm256_add_pd(racc, _mm256_mul_pd(v, v));
+			pk = _mm256_max_pd(pk, _mm256_and_pd(v, abs_mask));
+		}
+		_mm256_store_pd(z1, s1); _mm256_store_pd(z2, s2);
+		_mm256_store_pd(w1, t1); _mm256_store_pd(w2, t2);
+		_mm256_store_pd(wsq, acc); _mm256_store_pd(rsq, racc); _mm256_store_pd(peak, pk);
+	}
+#endif // FF_LOUDNESS_X86
+
+#ifdef FF_LOUDNESS_NEON
+	/////////////////////////////// NEON ///////////////////////////////
+	// 2 lanes per register.
+
+	void k_weight_neon
+	(
+		const float* const* x, int n, const double* k,
+		double* z1, double* z2, double* w1, double* w2,
+		double* wsq, double* rsq, double* peak
+	)
+	{
+		const float64x2_t b0 = vdupq_n_f64(k[0]), b1 = vdupq_n_f64(k[1]), b2 = vdupq_n_f64(k[2]);
+		const float64x2_t a1 = vdupq_n_f64(k[3]), a2 = vdupq_n_f64(k[4]);
+		const float64x2_t c1 = vdupq_n_f64(k[5]), c2 = vdupq_n_f64(k[6]);
+		const float64x2_t minus_two = vdupq_n_f64(-2.0);
+
+		for (int h = 0; h < 4; h += 2)
+		{
+			float64x2_t s1 = vld1q_f64(z1 + h), s2 = vld1q_f64(z2 + h);
+			float64x2_t t1 = vld1q_f64(w1 + h), t2 = vld1q_f64(w2 + h);
+			float64x2_t acc = vld1q_f64(wsq + h), racc = vld1q_f64(rsq + h), pk = vld1q_f64(peak + h);
+			const float* lo = x[h];
+			const float* hi = x[h + 1];
+			for (int i = 0; i < n; ++i)
+			{
+				const float64x2_t v = vcombine_f64(vdup_n_f64(lo[i]), vdup_n_f64(hi[i]));
+				const float64x2_t y1 = vaddq_f64(vmulq_f64(b0, v), s1);
+				s1 = vaddq_f64(vsubq_f64(vmulq_f64(b1, v), vmulq_f64(a1, y1)), s2);
+				s2 = vsubq_f64(vmulq_f64(b2, v), vmulq_f64(a2, y1));
+				const float64x2_t y2 = vaddq_f64(y1, t1);
+				t1 = vaddq_f64(vsubq_f64(vmulq_f64(minus_two, y1), vmulq_f64(c1, y2)), t2);
+				t2 = vsubq_f64(y1, vmulq_f64(c2, y2));
+
+				acc = vaddq_f64(acc, vmulq_f64(y2, y2));
+				racc = vaddq_f64(racc, vmulq_f64(v, v));
+				pk = vmaxq_f64(pk, vabsq_f64(v));
+			}
+			vst1q_f64(z1 + h, s1); vst1q_f64(z2 + h, s2);
+			vst1q_f64(w1 + h, t1); vst1q_f64(w2 + h, t2);
+			vst1q_f64(wsq + h, acc); vst1q_f64(rsq + h, racc); vst1q_f64(peak + h, pk);
+		}
+	}
+#endif // FF_LOUDNESS_NEON
+
+	k_weight_kernel k_weight_for(simd_level level) noexcept
+	{
+		switch (level)
+		{
+#if defined(FF_LOUDNESS_X86)
+		case simd_level::sse4:
+			return k_weight_sse2;
+		case simd_level::avx2:
+			return k_weight_avx2;
+#elif defined(FF_LOUDNESS_NEON)
+		case simd_level::neon:
+			return k_weight_neon;
+#endif
+		default:
+			return k_weight_scalar;
+		}
+	}
+
+	/////////////////////////////// Helpers ///////////////////////////////
+
+	// BS.1770: the loudness of a weighted mean square.
+	double to_loudness(double z) noexcept
+	{
+		return z > 0.0 ? -0.691 + 10.0 * std::log10(z) : neg_inf;
+	}
+
+	double to_db(double amplitude) noexcept
+	{
+		return amplitude > 0.0 ? 20.0 * std::log10(amplitude) : neg_inf;
+	}
+
+	// @returns the bin of the histograms that l falls in. l must be >= min_loudness.
+	int bin_of(double l) noexcept
+	{
+		const int b = static_cast<int>((l - ff::loudness_meter::min_loudness) * 10.0);
+		return std::clamp(b, 0, ff::loudness_meter::num_bins - 1);
+	}
+
+	double bin_center(int b) noexcept
+	{
+		return ff::loudness_meter::min_loudness + (b + 0.5) / 10.0;
+	}
+
+	// BS.1770: the low frequency effects channels are left out, and those around and behind count 1.41 times.
+	double weight_of(AVChannel ch) noexcept
+	{
+		switch (ch)
+		{
+		case AV_CHAN_LOW_FREQUENCY:
+		case AV_CHAN_LOW_FREQUENCY_2:
+			return 0.0;
+		case AV_CHAN_BACK_LEFT:
+		case AV_CHAN_BACK_RIGHT:
+		case AV_CHAN_BACK_CENTER:
+		case AV_CHAN_SIDE_LEFT:
+		case AV_CHAN_SIDE_RIGHT:
+		case AV_CHAN_TOP_BACK_LEFT:
+		case AV_CHAN_TOP_BACK_CENTER:
+		case AV_CHAN_TOP_BACK_RIGHT:
+		case AV_CHAN_SURROUND_DIRECT_LEFT:
+		case AV_CHAN_SURROUND_DIRECT_RIGHT:
+			return 1.41;
+		default:
+			return 1.0;
+		}
+	}
+
+	// Converts n samples of channel c from src (of the format of T, planar or interleaved) to float.
+	template <typename T>
+	void convert_samples(float* dst, const AVFrame* src, int c, int channels, bool planar, int n, double scale)
+	{
+		if (planar)
+		{
+			const T* p = reinterpret_cast<const T*>(src->extended_data[c]);
+			for (int i = 0; i < n; ++i)
+			{
+				dst[i] = static_cast<float>(p[i] * scale);
+			}
+		}
+		else
+		{
+			const T* p = reinterpret_cast<const T*>(src->data[0]) + c;
+			for (int i = 0; i < n; ++i)
+			{
+				dst[i] = static_cast<float>(p[static_cast<size_t>(i) * channels] * scale);
+			}
+		}
+	}
+}
+
+ff::loudness_meter::loudness_meter(int sample_rate, const channel_layout& layout)
+	: rate(sample_rate), channels(layout.num_channels()),
+	last_momentary(neg_inf), last_short_term(neg_inf),
+	max_momentary(neg_inf), max_short_term(neg_inf)
+{
+	if (sample_rate < 100)
+	{
+		throw std::invalid_argument("The sample rate must be >= 100.");
+	}
+	if (channels <= 0)
+	{
+		throw std::invalid_argument("The layout has no channels.");
+	}
+
+	weights.resize(channels);
+	for (int c = 0; c < channels; ++c)
+	{
+		weights[c] = weight_of(layout.channel_at(c));
+	}
+
+	// The K-weighting of BS.1770 at any rate, from the analog prototypes (as libebur128 does).
+	{
+		// The high shelf pre-filter.
+		const double f0 = 1681.974450955533;
+		const double g = 3.999843853973347;
+		const double q = 0.7071752369554196;
+		const double k = std::tan(std::numbers::pi * f0 / rate);
+		const double vh = std::pow(10.0, g / 20.0);
+		const double vb = std::pow(vh, 0.4996667741545416);
+		const double a0 = 1.0 + k / q + k * k;
+		coeffs[0] = (vh + vb * k / q + k * k) / a0;
+		coeffs[1] = 2.0 * (k * k - vh) / a0;
+		coeffs[2] = (vh - vb * k / q + k * k) / a0;
+		coeffs[3] = 2.0 * (k * k - 1.0) / a0;
+		coeffs[4] = (1.0 - k / q + k * k) / a0;
+	}
+	{
+		// The RLB high-pass.
+		const double f0 = 38.13547087602444;
+		const double q = 0.5003270373238773;
+		const double k = std::tan(std::numbers::pi * f0 / rate);
+		const double a0 = 1.0 + k / q + k * k;
+		coeffs[5] = 2.0 * (k * k - 1.0) / a0;
+		coeffs[6] = (1.0 - k / q + k * k) / a0;
+	}
+
+	groups.resize((channels + 3) / 4);
+	step_len = rate / 10;
+	zeros.assign(step_len, 0.0f);
+
+	momentary_count.assign(num_bins, 0);
+	momentary_energy.assign(num_bins, 0.0);
+	short_count.assign(num_bins, 0);
+	short_energy.assign(num_bins, 0.0);
+
+	// The true peak: enough oversampling to bring the rate to at least 192 kHz.
+	oversampling = rate < 96000 ? 4 : (rate < 192000 ? 2 : 1);
+	taps_per_phase = 12;
+	if (oversampling > 1)
+	{
+		// A Blackman windowed sinc low-pass at the original Nyquist, split into its phases.
+		const int num_taps = oversampling * taps_per_phase;
+		std::vector<double> proto(num_taps);
+		for (int i = 0; i < num_taps; ++i)
+		{
+			const double m = (i - (num_taps - 1) / 2.0) / oversampling;
+			const double sinc = 0.0 == m ? 1.0 : std::sin(std::numbers::pi * m) / (std::numbers::pi * m);
+			const double w = 2.0 * std::numbers::pi * i / (num_taps - 1);
+			proto[i] = sinc * (0.42 - 0.5 * std::cos(w) + 0.08 * std::cos(2.0 * w));
+		}
+
+		tp_filter.resize(num_taps);
+		for (int p = 0; p < oversampling; ++p)
+		{
+			double sum = 0.0;
+			for (int j = 0; j < taps_per_phase; ++j)
+			{
+				sum += proto[j * oversampling + p];
+			}
+			// Each phase passes DC unchanged.
+			for (int j = 0; j < taps_per_phase; ++j)
+			{
+				tp_filter[p * taps_per_phase + j] = proto[j * oversampling + p] / sum;
+			}
+		}
+		tp_history.assign(channels, std::vector<double>(2 * taps_per_phase, 0.0));
+	}
+	tp_pos.assign(channels, 0);
+	tp_peak.assign(channels, 0.0);
+
+	converted.resize(channels);
+	plane_ptrs.resize(channels);
+}
+
+void ff::loudness_meter::feed_frame(const frame& f)
+{
+	if (finished)
+	{
+		throw std::logic_error("signal_no_more_food() has been called.");
+	}
+	if (!f.ready() || f.v_or_a())
+	{
+		throw std::invalid_argument("The frame must be a ready audio frame.");
+	}
+	if (f->ch_layout.nb_channels != channels || (0 != f->sample_rate && f->sample_rate != rate))
+	{
+		throw std::invalid_argument("The frame is not of my sample rate and channels.");
+	}
+
+	const int n = f->nb_samples;
+	if (n <= 0)
+	{
+		return;
+	}
+
+	const AVSampleFormat fmt = static_cast<AVSampleFormat>(f->format);
+	if (AV_SAMPLE_FMT_FLTP == fmt)
+	{
+		for (int c = 0; c < channels; ++c)
+		{
+			plane_ptrs[c] = reinterpret_cast<const float*>(f->extended_data[c]);
+		}
+	}
+	else
+	{
+		const bool planar = av_sample_fmt_is_planar(fmt);
+		for (int c = 0; c < channels; ++c)
+		{
+			converted[c].resize(n);
+			float* dst = converted[c].data();
+			switch (av_get_packed_sample_fmt(fmt))
+			{
+			case AV_SAMPLE_FMT_FLT:
+				convert_samples<float>(dst, f.av_frame(), c, channels, planar, n, 1.0);
+				break;
+			case AV_SAMPLE_FMT_DBL:
+				convert_samples<double>(dst, f.av_frame(), c, channels, planar, n, 1.0);
+				break;
+			case AV_SAMPLE_FMT_S16:
+				convert_samples<int16_t>(dst, f.av_frame(), c, channels, planar, n, 1.0 / 32768.0);
+				break;
+			case AV_SAMPLE_FMT_S32:
+				convert_samples<int32_t>(dst, f.av_frame(), c, channels, planar, n, 1.0 / 2147483648.0);
+				break;
+			default:
+				throw std::domain_error("The sample format is not supported.");
+			}
+			plane_ptrs[c] = dst;
+		}
+	}
+
+	for (int c = 0; c < channels; ++c)
+	{
+		internal_true_peak(c, plane_ptrs[c], n);
+	}
+
+	// Split at the 100 ms steps.
+	std::vector<const float*> at(plane_ptrs);
+	int done = 0;
+	while (done < n)
+	{
+		const int len = std::min(n - done, step_len - step_filled);
+		internal_process(at.data(), len);
+		for (auto& p : at)
+		{
+			p += len;
+		}
+
+		done += len;
+		step_filled += len;
+		if (step_filled == step_len)
+		{
+			internal_step();
+			step_filled = 0;
+		}
+	}
+	num_samples += n;
+}
+
+const ff::loudness_meter::results& ff::loudness_meter::signal_no_more_food()
+{
+	if (finished)
+	{
+		throw std::logic_error("signal_no_more_food() has been called.");
+	}
+	finished = true;
+
+	res.num_samples = num_samples;
+	res.max_momentary = max_momentary;
+	res.max_short_term = max_short_term;
+	res.integrated = neg_inf;
+	res.range = neg_inf;
+
+	// Integrated: gate at -70 LUFS (already, by the histogram), then 10 LU below the mean of what's left.
+	{
+		uint64_t n = 0;
+		double e = 0.0;
+		for (int b = 0; b < num_bins; ++b)
+		{
+			n += momentary_count[b];
+			e += momentary_energy[b];
+		}
+		if (n > 0)
+		{
+			const double gate = to_loudness(e / n) - 10.0;
+			n = 0;
+			e = 0.0;
+			for (int b = gate < min_loudness ? 0 : bin_of(gate); b < num_bins; ++b)
+			{
+				n += momentary_count[b];
+				e += momentary_energy[b];
+			}
+			res.integrated = n > 0 ? to_loudness(e / n) : neg_inf;
+		}
+	}
+
+	// Range (EBU Tech 3342): the short-term loudness gated at -70 LUFS and 20 LU below its mean,
+	// from its 10th to its 95th percentile.
+	{
+		uint64_t n = 0;
+		double e = 0.0;
+		for (int b = 0; b < num_bins; ++b)
+		{
+			n += short_count[b];
+			e += short_energy[b];
+		}
+		if (n > 0)
+		{
+			const double gate = to_loudness(e / n) - 20.0;
+			const int from = gate < min_loudness ? 0 : bin_of(gate);
+			n = 0;
+			for (int b = from; b < num_bins; ++b)
+			{
+				n += short_count[b];
+			}
+
+			if (n > 0)
+			{
+				auto percentile = [&](double p)
+				{
+					const uint64_t ind = static_cast<uint64_t>((n - 1) * p + 0.5);
+					uint64_t seen = 0;
+					for (int b = from; b < num_bins; ++b)
+					{
+						seen += short_count[b];
+						if (seen > ind)
+						{
+							return bin_center(b);
+						}
+					}
+					return bin_center(num_bins - 1);
+				};
+				res.range = percentile(0.95) - percentile(0.10);
+			}
+		}
+	}
+
+	// Peaks and RMS.
+	res.channel_peak.resize(channels);
+	res.channel_rms.resize(channels);
+	double sample_peak = 0.0;
+	double true_peak = 0.0;
+	for (int c = 0; c < channels; ++c)
+	{
+		const lane_group& g = groups[c / 4];
+		const double pk = g.peak[c % 4];
+		res.channel_peak[c] = to_db(pk);
+		res.channel_rms[c] = num_samples > 0 ? to_db(std::sqrt(g.raw_sq[c % 4] / num_samples)) : neg_inf;
+
+		sample_peak = std::max(sample_peak, pk);
+		// The interpolation may round a peak that lies on a sample a bit under it.
+		true_peak = std::max(true_peak, std::max(pk, tp_peak[c]));
+	}
+	res.sample_peak = to_db(sample_peak);
+	res.true_peak = to_db(true_peak);
+
+	return res;
+}
+
+double ff::loudness_meter::normalization_gain(double target, double max_true_peak) const
+{
+	if (!finished)
+	{
+		throw std::logic_error("signal_no_more_food() has not been called.");
+	}
+	if (std::isinf(res.integrated))
+	{
+		throw std::logic_error("There is no integrated loudness to normalize.");
+	}
+
+	const double gain = target - res.integrated;
+	return std::isinf(res.true_peak) ? gain : std::min(gain, max_true_peak - res.true_peak);
+}
+
+void ff::loudness_meter::internal_process(const float* const* planes, int n)
+{
+	const k_weight_kernel kernel = k_weight_for(ff::frame_ops::active_simd_level());
+
+	const float* lanes[4];
+	for (size_t g = 0; g < groups.size(); ++g)
+	{
+		for (int l = 0; l < 4; ++l)
+		{
+			const int c = static_cast<int>(g) * 4 + l;
+			lanes[l] = c < channels ? planes[c] : zeros.data();
+		}
+
+		lane_group& lg = groups[g];
+		kernel(lanes, n, coeffs.data(), lg.z1, lg.z2, lg.w1, lg.w2, lg.weighted_sq, lg.raw_sq, lg.peak);
+	}
+}
+
+void ff::loudness_meter::internal_step()
+{
+	double e = 0.0;
+	for (size_t g = 0; g < groups.size(); ++g)
+	{
+		lane_group& lg = groups[g];
+		for (int l = 0; l < 4; ++l)
+		{
+			const int c = static_cast<int>(g) * 4 + l;
+			if (c < channels)
+			{
+				e += weights[c] * lg.weighted_sq[l];
+			}
+			lg.weighted_sq[l] = 0.0;
+
+			// Keep the states of silent channels from decaying into denormals.
+			for (double* s : { lg.z1 + l, lg.z2 + l, lg.w1 + l, lg.w2 + l })
+			{
+				if (std::fabs(*s) < 1e-30)
+				{
+					*s = 0.0;
+				}
+			}
+		}
+	}
+
+	step_energy[num_steps % step_energy.size()] = e;
+	++num_steps;
+
+	// The mean square of the last num steps.
+	auto mean_of_last = [this](int num)
+	{
+		double sum = 0.0;
+		for (int i = 1; i <= num; ++i)
+		{
+			sum += step_energy[(num_steps - i) % step_energy.size()];
+		}
+		return sum / (static_cast<double>(num) * step_len);
+	};
+
+	// Momentary: 400 ms blocks every 100 ms, which are also the gating blocks of the integrated loudness.
+	if (num_steps >= 4)
+	{
+		const double z = mean_of_last(4);
+		last_momentary = to_loudness(z);
+		max_momentary = std::max(max_momentary, last_momentary);
+		if (last_momentary >= min_loudness)
+		{
+			const int b = bin_of(last_momentary);
+			++momentary_count[b];
+			momentary_energy[b] += z;
+		}
+	}
+	// Short-term: 3 s blocks every 100 ms.
+	if (num_steps >= static_cast<int64_t>(step_energy.size()))
+	{
+		const double z = mean_of_last(static_cast<int>(step_energy.size()));
+		last_short_term = to_loudness(z);
+		max_short_term = std::max(max_short_term, last_short_term);
+		if (last_short_term >= min_loudness)
+		{
+			const int b = bin_of(last_short_term);
+			++short_count[b];
+			short_energy[b] += z;
+		}
+	}
+}
+
+void ff::loudness_meter::internal_true_peak(int c, const float* x, int n)
+{
+	if (1 == oversampling)
+	{
+		// The rate is high enough already. The sample peak is the true peak.
+		return;
+	}
+
+	// The history is kept twice over, so that the taps read it without wrapping around.
+	double* hist = tp_history[c].data();
+	int pos = tp_pos[c];
+	double pk = tp_peak[c];
+	const int t = taps_per_phase;
+	for (int i = 0; i < n; ++i)
+	{
+		pos = (0 == pos ? t : pos) - 1;
+		hist[pos] = hist[pos + t] = x[i];
+
+		const double* h = hist + pos;
+		for (int p = 0; p < oversampling; ++p)
+		{
+			const double* f = tp_filter.data() + p * t;
+			double y = 0.0;
+			for (int j = 0; j < t; ++j)
+			{
+				y += f[j] * h[j];
+			}
+			pk = std::max(pk, std::fabs(y));
+		}
+	}
+	tp_pos[c] = pos;
+	tp_peak[c] = pk;
+}
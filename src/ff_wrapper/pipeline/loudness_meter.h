@@ -0,0 +1,214 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/channel_layout.h"
+#include "../data/frame.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* Measures the loudness of an audio stream as it goes by (EBU R128 / ITU-R BS.1770),
+	* so that loudness normalization doesn't need a decode pass of its own before the encode:
+	* feed it the frames on their way to the encoder (e.g. through transcode_pipeline::set_loudness_meter()),
+	* and the results are there at signal_no_more_food().
+	* Then a second, encoding-only pass applies normalization_gain() (e.g. through a volume filter).
+	*
+	* What is measured:
+	*	integrated loudness (gated), loudness range, the highest momentary and short-term loudness,
+	*	true peak (4x oversampled below 96 kHz, 2x below 192 kHz), and the sample peak and RMS of each channel.
+	*
+	* The channels are weighted by what the channel layout says they are:
+	* the LFE channels are left out, and the surround and back ones count 1.41 times (+1.5 dB), as BS.1770 says.
+	* The K-weighting filters run on groups of 4 channels at once, vectorized as frame_ops::active_simd_level() says.
+	*
+	* Memory is bounded whatever the length: the gating works on histograms of 0.1 LU bins,
+	* which puts the integrated loudness and the range within 0.1 LU of what keeping every block would give.
+	*
+	* Frames may be planar or interleaved float, double, s16, or s32, of the rate and layout given at construction.
+	* Not thread-safe.
+	*/
+	class FF_WRAPPER_API loudness_meter final
+	{
+	public:
+		/*
+		* What's measured. Loudness is in LUFS, ranges in LU, and peaks and RMS in dBFS (true peak in dBTP).
+		* Those with nothing to go by (e.g. too short, or silent) are -infinity.
+		*/
+		struct results
+		{
+			double integrated;
+			double range;
+			double max_momentary;
+			double max_short_term;
+			double true_peak;
+			double sample_peak;
+			// One per channel, not weighted.
+			std::vector<double> channel_peak;
+			std::vector<double> channel_rms;
+			int64_t num_samples;
+		};
+
+		// The histograms cover [min_loudness, max_loudness) LUFS in bins of 0.1 LU.
+		static constexpr double min_loudness = -70.0;
+		static constexpr double max_loudness = 5.0;
+		static constexpr int num_bins = 750;
+
+	public:
+		loudness_meter() = delete;
+
+		/*
+		* @param sample_rate of the frames.
+		* @param layout of the frames. I copy it.
+		* @throws std::invalid_argument if sample_rate < 100 or layout has no channels.
+		*/
+		loudness_meter(int sample_rate, const channel_layout& layout);
+
+		loudness_meter(const loudness_meter&) = delete;
+		loudness_meter& operator=(const loudness_meter&) = delete;
+
+		~loudness_meter() noexcept = default;
+
+	public:
+		/*
+		* Measures the samples of f. Only its data is read, and it's untouched.
+		*
+		* @throws std::logic_error if signal_no_more_food() has been called.
+		* @throws std::invalid_argument if f is not a ready audio frame of my sample rate and number of channels.
+		* @throws std::domain_error if its sample format is not supported.
+		*/
+		void feed_frame(const frame& f);
+
+		/*
+		* Finishes the measurement. Samples short of the last 100 ms step are only counted in the peaks and RMS,
+		* as BS.1770 does.
+		*
+		* @returns the results, which stay valid as long as I do.
+		* @throws std::logic_error if it has been called.
+		*/
+		const results& signal_no_more_food();
+
+		/*
+		* @returns the results. Only valid after signal_no_more_food().
+		*/
+		const results& get_results() const noexcept { return res; }
+
+		/*
+		* @returns the loudness of the last 400 ms and 3 s. -infinity until that much has been fed.
+		*/
+		double momentary() const noexcept { return last_momentary; }
+		double short_term() const noexcept { return last_short_term; }
+
+		/*
+		* @returns the gain in dB that brings the integrated loudness to target,
+		* lowered if needed so that the true peak stays at or below max_true_peak.
+		* @throws std::logic_error if signal_no_more_food() has not been called, or if the integrated loudness is -infinity.
+		*/
+		double normalization_gain(double target = -23.0, double max_true_peak = -1.0) const;
+
+		int sample_rate() const noexcept { return rate; }
+		int num_channels() const noexcept { return channels; }
+		/*
+		* @returns the weight of channel i, e.g. 0 for an LFE channel.
+		*/
+		double weight(int i) const { return weights.at(i); }
+
+	private:
+		/*
+		* The state of 4 channels through the K-weighting, and what's summed of them.
+		*/
+		struct lane_group
+		{
+			// The two biquads' states, lane by lane (direct form II transposed).
+			alignas(32) double z1[4] = {};
+			alignas(32) double z2[4] = {};
+			alignas(32) double w1[4] = {};
+			alignas(32) double w2[4] = {};
+			// Of the K-weighted samples since the last 100 ms step.
+			alignas(32) double weighted_sq[4] = {};
+			// Of the raw samples, all along.
+			alignas(32) double raw_sq[4] = {};
+			alignas(32) double peak[4] = {};
+		};
+
+		/*
+		* Runs n samples of each channel (planar float) through the K-weighting, the peaks, and the sums.
+		*/
+		void internal_process(const float* const* planes, int n);
+
+		/*
+		* Closes a 100 ms step: updates the momentary and short-term loudness and the histograms.
+		*/
+		void internal_step();
+
+		/*
+		* Runs n samples of channel c through the oversampling for the true peak.
+		*/
+		void internal_true_peak(int c, const float* x, int n);
+
+	private:
+		int rate;
+		int channels;
+		std::vector<double> weights;
+
+		// The biquads' coefficients: b0, b1, b2, a1, a2 of the pre-filter, then a1, a2 of the high-pass.
+		std::array<double, 7> coeffs;
+		std::vector<lane_group> groups;
+		// So that a group with fewer than 4 channels reads zeros for the rest.
+		std::vector<float> zeros;
+
+		// The samples of a 100 ms step, and how many have come.
+		int step_len;
+		int step_filled = 0;
+		// The weighted energies of the last 30 steps (3 s), as a ring.
+		std::array<double, 30> step_energy{};
+		int64_t num_steps = 0;
+
+		double last_momentary;
+		double last_short_term;
+		double max_momentary;
+		double max_short_term;
+
+		// Momentary blocks: how many, and their summed mean energy, per bin.
+		std::vector<uint64_t> momentary_count;
+		std::vector<double> momentary_energy;
+		// The same of short-term blocks, for the range.
+		std::vector<uint64_t> short_count;
+		std::vector<double> short_energy;
+
+		// The true peak: how many times oversampled, the polyphase filter (phase by phase), and the history of each channel.
+		int oversampling;
+		int taps_per_phase;
+		std::vector<double> tp_filter;
+		std::vector<std::vector<double>> tp_history;
+		std::vector<int> tp_pos;
+		std::vector<double> tp_peak;
+
+		// For the formats other than planar float.
+		std::vector<std::vector<float>> converted;
+		std::vector<const float*> plane_ptrs;
+
+		int64_t num_samples = 0;
+		results res;
+		bool finished = false;
+	};
+}
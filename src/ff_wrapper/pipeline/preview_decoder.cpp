@@ -0,0 +1,91 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "preview_decoder.h"
+#include "../data/packet.h"
+#include "../formats/stream.h"
+
+#include <stdexcept>
+
+ff::preview_decoder::preview_decoder
+(
+	const stream& s,
+	int dst_w, int dst_h, AVPixelFormat dst_fmt,
+	frame_transformer::algorithms algorithm,
+	const codec_base::threading_policy& policy
+)
+	: dec(s.codec_id()), dst_w(dst_w), dst_h(dst_h), dst_fmt(dst_fmt), algorithm(algorithm)
+{
+	if (!s.is_video())
+	{
+		throw std::invalid_argument("Previews can only be decoded from a video stream.");
+	}
+	if (dst_w <= 0 || dst_h <= 0)
+	{
+		throw std::invalid_argument("The target size must be positive.");
+	}
+
+	const codec_properties p = s.properties();
+	dec.set_codec_properties(p);
+	dec.set_threading_policy(policy);
+
+	// The size may be unknown until the first frame, in which case decode at full size.
+	if (p.v_width() > 0 && p.v_height() > 0)
+	{
+		dec.set_lowres(decoder::lowres_for_size(p.v_width(), p.v_height(), dst_w, dst_h, dec.max_lowres()));
+	}
+
+	dec.create_codec_context();
+}
+
+bool ff::preview_decoder::decode_frame(frame& f)
+{
+	if (!dec.decode_frame(decoded))
+	{
+		return false;
+	}
+
+	const auto dp = decoded.get_data_properties();
+	const AVPixelFormat src_fmt = static_cast<AVPixelFormat>(dp.fmt);
+	const AVPixelFormat out_fmt = AV_PIX_FMT_NONE == dst_fmt ? src_fmt : dst_fmt;
+	if (dp.width == dst_w && dp.height == dst_h && src_fmt == out_fmt)
+	{
+		// Already the target. Only reference it.
+		f = decoded;
+		last_scaled = false;
+		return true;
+	}
+
+	if (nullptr == trans || trans->src_properties() != dp)
+	{
+		// One thread, as what's left to scale is small after lowres.
+		trans = std::make_unique<frame_transformer>
+		(
+			dst_w, dst_h, out_fmt, dp.width, dp.height, src_fmt,
+			algorithm, 1
+		);
+	}
+
+	f = trans->convert_frame(decoded);
+	last_scaled = true;
+	return true;
+}
+
+ff::frame ff::preview_decoder::decode_frame()
+{
+	frame f(false);
+	decode_frame(f);
+	return f;
+}
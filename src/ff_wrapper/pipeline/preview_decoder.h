@@ -0,0 +1,138 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../data/frame.h"
+#include "../codec/decoder.h"
+#include "../sws/frame_transformer.h"
+
+extern "C"
+{
+#include <libavutil/pixfmt.h>
+}
+
+#include <memory>
+
+namespace ff
+{
+	class packet;
+	class stream;
+
+	/*
+	* Decodes a video stream straight into frames of a target size (e.g. for proxies and previews),
+	* doing as little of the full-size work as it can:
+	* if the decoder supports reduced resolution (decoder::set_lowres()), it decodes at the smallest
+	* 1/2^k of the size that is still no smaller than the target, and then a frame_transformer
+	* scales what's left down to the target. For MJPEG or MPEG-2, that means
+	* decoding and scaling a quarter or less of the pixels.
+	* If the decoded frames already are of the target, they are given out without scaling.
+	*
+	* It's fed like a decoder (see codec_base): feed_packet() until it's full, decode_frame() until it's hungry,
+	* and signal_no_more_food() at the end.
+	*
+	* It decodes in software. The transformer is made at the first frame, and again if the decoded size changes.
+	*/
+	class FF_WRAPPER_API preview_decoder final
+	{
+	public:
+		preview_decoder() = delete;
+
+		/*
+		* @param s the video stream from a demuxer.
+		* @param dst_w, dst_h the size of the frames given out.
+		* @param dst_fmt the pixel format of the frames given out. AV_PIX_FMT_NONE to keep the decoded one.
+		* @param algorithm the scaling algorithm. Area averaging suits large downscaling.
+		* @param policy how the decoder uses threads.
+		* @throws std::invalid_argument if s is not video, if dst_w or dst_h <= 0,
+		* or if the codec of s is not supported.
+		*/
+		preview_decoder
+		(
+			const stream& s,
+			int dst_w, int dst_h, AVPixelFormat dst_fmt = AV_PIX_FMT_NONE,
+			frame_transformer::algorithms algorithm = frame_transformer::FF_SWS_AREA,
+			const codec_base::threading_policy& policy = codec_base::threading_policy()
+		);
+
+		preview_decoder(const preview_decoder&) = delete;
+		preview_decoder& operator=(const preview_decoder&) = delete;
+
+	public:
+		/*
+		* Same as decoder::feed_packet().
+		*/
+		bool feed_packet(const packet& pkt) { return dec.feed_packet(pkt); }
+
+		/*
+		* Decodes the next frame and scales it to the target.
+		*
+		* @param f where the frame goes. Ready with it if one is given; otherwise left as it was.
+		* @returns true if a frame is given; false if the decoder is hungry or drained.
+		* @throws std::domain_error if the decoded pixel format cannot be scaled.
+		* @throws what decoder::decode_frame() throws.
+		*/
+		bool decode_frame(frame& f);
+		/*
+		* Same as the one above, but returns a DESTROYED frame if nothing is given.
+		*/
+		frame decode_frame();
+
+		/*
+		* Same as decoder::signal_no_more_food().
+		*/
+		void signal_no_more_food() { dec.signal_no_more_food(); }
+		/*
+		* Same as decoder::reset().
+		*/
+		void reset() { dec.reset(); }
+
+		bool hungry() const noexcept { return dec.hungry(); }
+		bool full() const noexcept { return dec.full(); }
+		bool no_more_food() const noexcept { return dec.no_more_food(); }
+
+	public:
+		/*
+		* @returns the reduced resolution factor the decoder uses. 0 if it decodes at full size.
+		*/
+		int lowres() const { return dec.get_lowres(); }
+
+		/*
+		* @returns true iff the last frame given out was scaled, i.e. it wasn't decoded at the target already.
+		*/
+		bool scaled() const noexcept { return last_scaled; }
+
+		int width() const noexcept { return dst_w; }
+		int height() const noexcept { return dst_h; }
+
+		decoder& get_decoder() noexcept { return dec; }
+		const decoder& get_decoder() const noexcept { return dec; }
+
+	private:
+		decoder dec;
+
+		int dst_w, dst_h;
+		AVPixelFormat dst_fmt;
+		frame_transformer::algorithms algorithm;
+
+		// Made for the decoded size at the first frame that needs it.
+		std::unique_ptr<frame_transformer> trans;
+		// Reused for every frame decoded.
+		frame decoded;
+
+		bool last_scaled = false;
+	};
+}
@@ -0,0 +1,210 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "quality_meter.h"
+#include "../data/packet.h"
+#include "../codec/decoder.h"
+#include "../codec/encoder.h"
+
+extern "C"
+{
+#include <libavutil/avutil.h>
+}
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+ff::quality_meter::quality_meter(const encoder& enc, int num_threads, frame_metric extra)
+	: num_threads(num_threads), extra(std::move(extra))
+{
+	if (!enc.ready())
+	{
+		throw std::invalid_argument("The encoder must be ready.");
+	}
+	if (num_threads < 1)
+	{
+		throw std::invalid_argument("At least one thread is needed.");
+	}
+
+	const codec_properties p = enc.get_codec_properties();
+	if (!p.is_video())
+	{
+		throw std::invalid_argument("Quality can only be measured on videos.");
+	}
+
+	// Throws std::invalid_argument if no decoder of the ID can be found.
+	dec = std::make_unique<decoder>(p.id());
+	// Its time base is the encoder's, so that the frames come out with the pts of their references.
+	dec->set_codec_properties(p);
+	dec->create_codec_context();
+}
+
+ff::quality_meter::~quality_meter() noexcept = default;
+
+void ff::quality_meter::add_reference(const frame& f)
+{
+	if (finished)
+	{
+		throw std::logic_error("The quality meter has been finished.");
+	}
+	if (!f.ready())
+	{
+		throw std::invalid_argument("The reference must be ready.");
+	}
+
+	references.push_back(f);
+}
+
+void ff::quality_meter::add_packet(const packet& pkt)
+{
+	if (finished)
+	{
+		throw std::logic_error("The quality meter has been finished.");
+	}
+
+	while (!dec->feed_packet(pkt))
+	{
+		// It's full. Take out its frames to make room.
+		internal_measure_decoded();
+	}
+	internal_measure_decoded();
+}
+
+void ff::quality_meter::finish()
+{
+	if (finished)
+	{
+		throw std::logic_error("The quality meter has been finished.");
+	}
+	finished = true;
+
+	dec->signal_no_more_food();
+	internal_measure_decoded();
+
+	unmatched += references.size();
+	references.clear();
+}
+
+const ff::quality_meter::frame_quality& ff::quality_meter::measure(const frame& ref, const frame& dist)
+{
+	frame_quality q;
+	q.pts = dist->pts;
+	q.psnr = frame_ops::psnr(ref, dist, num_threads);
+	q.ssim = frame_ops::ssim(ref, dist, num_threads);
+	q.extra = extra ? extra(ref, dist) : std::numeric_limits<double>::quiet_NaN();
+
+	scores.push_back(q);
+	return scores.back();
+}
+
+double ff::quality_meter::mean_psnr() const noexcept
+{
+	if (scores.empty())
+	{
+		return 0.0;
+	}
+
+	double sum = 0.0;
+	for (const auto& q : scores)
+	{
+		sum += std::min(q.psnr.combined, max_psnr);
+	}
+	return sum / static_cast<double>(scores.size());
+}
+
+double ff::quality_meter::min_psnr() const noexcept
+{
+	if (scores.empty())
+	{
+		return 0.0;
+	}
+
+	double res = scores.front().psnr.combined;
+	for (const auto& q : scores)
+	{
+		res = std::min(res, q.psnr.combined);
+	}
+	return res;
+}
+
+double ff::quality_meter::mean_ssim() const noexcept
+{
+	if (scores.empty())
+	{
+		return 0.0;
+	}
+
+	double sum = 0.0;
+	for (const auto& q : scores)
+	{
+		sum += q.ssim.combined;
+	}
+	return sum / static_cast<double>(scores.size());
+}
+
+double ff::quality_meter::min_ssim() const noexcept
+{
+	if (scores.empty())
+	{
+		return 0.0;
+	}
+
+	double res = scores.front().ssim.combined;
+	for (const auto& q : scores)
+	{
+		res = std::min(res, q.ssim.combined);
+	}
+	return res;
+}
+
+double ff::quality_meter::mean_extra() const noexcept
+{
+	if (!extra || scores.empty())
+	{
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+
+	double sum = 0.0;
+	for (const auto& q : scores)
+	{
+		sum += q.extra;
+	}
+	return sum / static_cast<double>(scores.size());
+}
+
+void ff::quality_meter::internal_measure_decoded()
+{
+	while (dec->decode_frame(decoded))
+	{
+		const int64_t pts = AV_NOPTS_VALUE != decoded->pts ? decoded->pts : decoded->best_effort_timestamp;
+
+		// References before pts that have no frame were dropped by the encoder.
+		while (!references.empty() && references.front()->pts < pts)
+		{
+			references.pop_front();
+			++unmatched;
+		}
+		if (references.empty() || references.front()->pts != pts)
+		{
+			++unmatched;
+			continue;
+		}
+
+		measure(references.front(), decoded);
+		references.pop_front();
+	}
+}
@@ -0,0 +1,185 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../data/frame.h"
+#include "../data/frame_ops.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace ff
+{
+	class packet;
+	class decoder;
+	class encoder;
+
+	/*
+	* Measures the quality of an encode while it runs, instead of in a second pass:
+	* the frames fed to the encoder are kept as references, the packets it gives out are decoded by a decoder of my own,
+	* and each decoded frame is compared with the reference of the same pts through
+	* frame_ops::psnr(), frame_ops::ssim(), and, if given, an extra metric
+	* (e.g. a wrapper around libvmaf, which this library doesn't link).
+	* 
+	* Use:
+	*	1. add_reference() with each frame right before it's fed to the encoder.
+	*	2. add_packet() with each packet the encoder gives out, before it's prepared for muxing,
+	*	while its timestamps are still in the encoder's time base.
+	*	3. finish() after the encoder is drained.
+	* Or through transcode_pipeline::set_quality_meter(), which does all of these on the encoding thread.
+	* Frames that only need comparing (e.g. two decodes) can be given to measure() directly.
+	* 
+	* The references hold their data (by reference counting, not copies) until their decoded frames come out,
+	* that is, for as long as the encoder and the decoder delay them.
+	* Give the frames distinct increasing pts. A reference whose frame never comes out
+	* (e.g. the encoder dropped it) is counted in num_unmatched().
+	* 
+	* I don't keep the encoder after the constructor. It is not thread-safe.
+	*/
+	class FF_WRAPPER_API quality_meter final
+	{
+	public:
+		/*
+		* An extra metric, e.g. VMAF. It returns the score of dist against ref.
+		*/
+		using frame_metric = std::function<double(const frame& ref, const frame& dist)>;
+
+		/*
+		* The scores of one frame.
+		*/
+		struct frame_quality
+		{
+			int64_t pts;
+			frame_ops::quality_score psnr;
+			frame_ops::quality_score ssim;
+			// What the extra metric gives. NaN if there is none.
+			double extra;
+		};
+
+		/*
+		* The combined PSNR of a frame counts as at most this much in mean_psnr(),
+		* so that a frame that is encoded without loss doesn't make the mean infinite.
+		*/
+		static constexpr double max_psnr = 100.0;
+
+	public:
+		quality_meter() = delete;
+
+		/*
+		* @param enc a ready video encoder. I make a decoder of the same properties for its packets.
+		* @param num_threads up to how many threads each frame is measured on. See frame_ops::psnr().
+		* @param extra an extra metric run on each pair of frames. Can be empty.
+		* @throws std::invalid_argument if enc is not ready or not for video, or if num_threads < 1.
+		* @throws std::invalid_argument if no decoder can decode what enc encodes.
+		*/
+		explicit quality_meter(const encoder& enc, int num_threads = 1, frame_metric extra = frame_metric());
+
+		quality_meter(const quality_meter&) = delete;
+		quality_meter& operator=(const quality_meter&) = delete;
+
+		~quality_meter() noexcept;
+
+	public:
+		/*
+		* Keeps f as the reference for the frame of its pts.
+		* 
+		* @throws std::invalid_argument if f is not ready.
+		* @throws std::logic_error if finish() has been called.
+		*/
+		void add_reference(const frame& f);
+
+		/*
+		* Decodes pkt, and measures each frame that comes out against its reference.
+		* 
+		* @param pkt a packet the encoder gave out, in the encoder's time base.
+		* @throws std::logic_error if finish() has been called.
+		* @throws what decoder::feed_packet() and measure() throw.
+		*/
+		void add_packet(const packet& pkt);
+
+		/*
+		* Drains the decoder, measures what it had left, and drops the references left unmatched.
+		* 
+		* @throws std::logic_error if it has been called.
+		*/
+		void finish();
+
+		/*
+		* Measures dist against ref and records the scores.
+		* 
+		* @returns the scores, which stay valid until the next measurement.
+		* @throws what frame_ops::psnr(), frame_ops::ssim(), and the extra metric throw.
+		*/
+		const frame_quality& measure(const frame& ref, const frame& dist);
+
+	public:
+		/*
+		* @returns the scores of every frame measured so far, in the order they were measured.
+		*/
+		const std::vector<frame_quality>& results() const noexcept { return scores; }
+
+		/*
+		* @returns the mean of the combined PSNR of the frames, each capped at max_psnr. 0 if none.
+		*/
+		double mean_psnr() const noexcept;
+		/*
+		* @returns the lowest combined PSNR of the frames. 0 if none.
+		*/
+		double min_psnr() const noexcept;
+		/*
+		* @returns the mean of the combined SSIM of the frames. 0 if none.
+		*/
+		double mean_ssim() const noexcept;
+		/*
+		* @returns the lowest combined SSIM of the frames. 0 if none.
+		*/
+		double min_ssim() const noexcept;
+		/*
+		* @returns the mean of what the extra metric gave. NaN if there is none or if no frames were measured.
+		*/
+		double mean_extra() const noexcept;
+
+		/*
+		* @returns how many references had no decoded frame and how many decoded frames had no reference.
+		*/
+		size_t num_unmatched() const noexcept { return unmatched; }
+
+	private:
+		/*
+		* Measures each frame the decoder has ready against its reference.
+		*/
+		void internal_measure_decoded();
+
+	private:
+		std::unique_ptr<decoder> dec;
+		int num_threads;
+		frame_metric extra;
+
+		// The references whose decoded frames have not come out, in the order they were added.
+		std::deque<frame> references;
+		std::vector<frame_quality> scores;
+		size_t unmatched = 0;
+		bool finished = false;
+
+		// Reused for every decoded frame.
+		frame decoded;
+	};
+}
@@ -0,0 +1,208 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "scene_detector.h"
+#include "lazy_codecs.h"
+#include "../data/frame_ops.h"
+#include "../codec/decoder.h"
+#include "../formats/demuxer.h"
+#include "../sws/frame_transformer.h"
+
+extern "C"
+{
+#include <libavutil/avutil.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+	// Puts back the discard level of a stream when it goes, however the scan ends.
+	class discard_restorer final
+	{
+	public:
+		discard_restorer(ff::demuxer& dem, int stream_ind)
+			: dem(dem), stream_ind(stream_ind), level(dem.get_discard(stream_ind)) {}
+
+		discard_restorer(const discard_restorer&) = delete;
+		discard_restorer& operator=(const discard_restorer&) = delete;
+
+		~discard_restorer() noexcept
+		{
+			try
+			{
+				dem.set_discard(stream_ind, level);
+			}
+			catch (...)
+			{
+				// The index was checked when I was made.
+			}
+		}
+
+	private:
+		ff::demuxer& dem;
+		int stream_ind;
+		AVDiscard level;
+	};
+}
+
+ff::scene_detector::scene_detector(rational time_base, const options& opts)
+	: tb(time_base), opts(opts)
+{
+	if (time_base <= zero_rational)
+	{
+		throw std::invalid_argument("The time base must be positive.");
+	}
+	if (opts.analysis_width < 16 || opts.window < 1)
+	{
+		throw std::invalid_argument("The analysis width must be at least 16, and the window at least 1.");
+	}
+	if (opts.min_difference < 0 || opts.adaptive_ratio < 0 || opts.min_histogram_distance < 0 || opts.min_scene_duration < 0)
+	{
+		throw std::invalid_argument("The thresholds cannot be negative.");
+	}
+}
+
+ff::scene_detector::~scene_detector() noexcept = default;
+
+std::optional<ff::time> ff::scene_detector::push_frame(const frame& f)
+{
+	if (!f.ready() || !f.v_or_a())
+	{
+		throw std::logic_error("Only a ready video frame can be pushed.");
+	}
+	if (f.is_hardware())
+	{
+		throw std::logic_error("The data of a hardware frame cannot be compared.");
+	}
+	const int64_t pts = AV_NOPTS_VALUE != f->pts ? f->pts : f->best_effort_timestamp;
+	if (AV_NOPTS_VALUE == pts)
+	{
+		throw std::invalid_argument("The frame has no pts.");
+	}
+
+	const ff::time t(rational_64(pts, 1), tb);
+	const double seconds = t.to_absolute_double();
+	frame cur = internal_analysis_frame(f);
+	const std::array<uint64_t, 256> hist = frame_ops::luma_histogram(cur);
+	++num_frames;
+
+	if (prev.destroyed())
+	{
+		prev = std::move(cur);
+		prev_hist = hist;
+		scene_start = seconds;
+		return std::nullopt;
+	}
+
+	auto luma = view_plane<AV_PIX_FMT_YUV420P, 0>(cur);
+	const double num_samples = static_cast<double>(luma.width()) * luma.height();
+	last_diff = static_cast<double>(frame_ops::sad(luma, view_plane<AV_PIX_FMT_YUV420P, 0>(prev))) / num_samples;
+
+	uint64_t hist_l1 = 0;
+	for (size_t v = 0; v < hist.size(); ++v)
+	{
+		hist_l1 += hist[v] > prev_hist[v] ? hist[v] - prev_hist[v] : prev_hist[v] - hist[v];
+	}
+	last_hist_dist = static_cast<double>(hist_l1) / (2 * num_samples);
+
+	const double recent_mean = recent.empty() ? 0.0 :
+		std::accumulate(recent.begin(), recent.end(), 0.0) / static_cast<double>(recent.size());
+	const bool cut =
+		last_diff >= opts.min_difference &&
+		last_diff >= opts.adaptive_ratio * recent_mean &&
+		last_hist_dist >= opts.min_histogram_distance &&
+		seconds - scene_start >= opts.min_scene_duration;
+
+	prev = std::move(cur);
+	prev_hist = hist;
+	if (cut)
+	{
+		// The new scene is measured against itself.
+		recent.clear();
+		scene_start = seconds;
+		return t;
+	}
+
+	recent.push_back(last_diff);
+	if (recent.size() > static_cast<size_t>(opts.window))
+	{
+		recent.pop_front();
+	}
+	return std::nullopt;
+}
+
+void ff::scene_detector::reset() noexcept
+{
+	prev = frame(false);
+	recent.clear();
+	last_diff = 0.0;
+	last_hist_dist = 0.0;
+}
+
+ff::generator<ff::time> ff::scene_detector::scan(demuxer& dem, int stream_ind, options opts, bool keyframes_only)
+{
+	// Throws std::out_of_range if stream_ind is wrong.
+	const stream s = dem.get_stream(stream_ind);
+	if (!s.is_video())
+	{
+		throw std::invalid_argument("Scenes can only be detected in a video stream.");
+	}
+
+	decoder dec(s);
+	const discard_restorer restorer(dem, stream_ind);
+	if (keyframes_only)
+	{
+		dec.set_skip_policy(decoder::skip_policy::fast_keyframes());
+		dem.set_discard(stream_ind, AVDISCARD_NONKEY);
+	}
+
+	scene_detector det(s.time_base(), opts);
+	for (frame& f : decoded_frames(dem, dec, stream_ind))
+	{
+		if (auto t = det.push_frame(f))
+		{
+			co_yield *t;
+		}
+	}
+}
+
+ff::frame ff::scene_detector::internal_analysis_frame(const frame& f)
+{
+	const auto dp = f.get_data_properties();
+	const AVPixelFormat fmt = static_cast<AVPixelFormat>(dp.fmt);
+	if (nullptr == trans || trans->src_properties() != dp)
+	{
+		// Even, so that the chroma of yuv420p is exactly half. Never larger than the frame.
+		const int w = std::max(2, std::min(opts.analysis_width, dp.width) & ~1);
+		const int h = std::max(2, static_cast<int>(std::lround(static_cast<double>(dp.height) * w / dp.width)) & ~1);
+		// One thread, as the pictures are tiny. Area averaging keeps the noise out of the differences.
+		trans = std::make_unique<frame_transformer>
+		(
+			w, h, AV_PIX_FMT_YUV420P, dp.width, dp.height, fmt,
+			frame_transformer::FF_SWS_AREA, 1
+		);
+
+		// The last picture is of the old size.
+		prev = frame(false);
+		recent.clear();
+	}
+
+	return trans->convert_frame(f);
+}
@@ -0,0 +1,178 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/ff_math.h"
+#include "../util/ff_time.h"
+#include "../util/generator.h"
+#include "../data/frame.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+
+namespace ff
+{
+	class demuxer;
+	class frame_transformer;
+
+	/*
+	* When scene_detector cuts. See the comments for it.
+	*/
+	struct scene_detection_options
+	{
+		// How wide the luma is scaled to before it's compared. The height keeps the aspect ratio.
+		int analysis_width = 160;
+		// The least mean absolute difference (out of 255) between two frames for a cut.
+		double min_difference = 12.0;
+		// How many times the recent mean difference a cut must be.
+		double adaptive_ratio = 3.0;
+		// Over how many frames before it the recent mean difference is taken.
+		int window = 8;
+		// The least distance between the luma histograms for a cut: half the L1 distance
+		// of the normalized histograms, 0 for the same and 1 for disjoint.
+		double min_histogram_distance = 0.1;
+		// The shortest a scene can be, in seconds.
+		double min_scene_duration = 0.5;
+	};
+
+	/*
+	* Finds scene cuts in a video, one frame at a time, for splitting work into chunks and picking thumbnails.
+	* 
+	* Each frame is scaled down to a small luma picture (options::analysis_width wide), and compared with the one before it
+	* by the mean absolute difference of the samples (frame_ops::sad()) and the distance between their luma histograms.
+	* A frame starts a new scene iff
+	*	1. the difference is at least options::min_difference,
+	*	2. and it's at least options::adaptive_ratio times the mean difference of the frames before it in the scene
+	*	(up to options::window of them), so that a scene that is busy all along doesn't cut at every frame,
+	*	3. and the histograms are at least options::min_histogram_distance apart,
+	*	so that fast motion over the same content doesn't count,
+	*	4. and the scene before it has lasted at least options::min_scene_duration.
+	* 
+	* Memory is bounded: I only keep the small picture of the last frame and the differences in the window,
+	* however long the video is.
+	* 
+	* It's not thread-safe.
+	*/
+	class FF_WRAPPER_API scene_detector final
+	{
+	public:
+		using options = scene_detection_options;
+
+	public:
+		scene_detector() = delete;
+
+		/*
+		* @param time_base what the pts of the frames pushed are in.
+		* @param opts see options.
+		* @throws std::invalid_argument if time_base <= 0, analysis_width < 16, window < 1,
+		* or any of the others is negative.
+		*/
+		explicit scene_detector(rational time_base, const options& opts = options());
+
+		scene_detector(const scene_detector&) = delete;
+		scene_detector& operator=(const scene_detector&) = delete;
+
+		~scene_detector() noexcept;
+
+	public:
+		/*
+		* Compares f with the frame pushed before it.
+		* The first frame pushed never starts a scene, as the video starts with one anyway.
+		* 
+		* @param f a ready software video frame of any format the scaler accepts, whose pts is in the time base.
+		* Its size and format may change between frames.
+		* @returns where the scene f starts begins, if it does.
+		* @throws std::logic_error if f is not a ready video frame, or if it is a hardware frame.
+		* @throws std::invalid_argument if f has no pts.
+		*/
+		std::optional<ff::time> push_frame(const frame& f);
+
+		/*
+		* Forgets the frames pushed, e.g. after seeking. The next frame pushed is the first again.
+		*/
+		void reset() noexcept;
+
+	public:
+		/*
+		* @returns the mean absolute difference between the last two frames pushed. 0 if there are not two.
+		*/
+		double last_difference() const noexcept { return last_diff; }
+		/*
+		* @returns the distance between the histograms of the last two frames pushed. 0 if there are not two.
+		*/
+		double last_histogram_distance() const noexcept { return last_hist_dist; }
+
+		/*
+		* @returns how many frames have been pushed.
+		*/
+		size_t number_frames() const noexcept { return num_frames; }
+
+		const options& get_options() const noexcept { return opts; }
+
+	public:
+		/*
+		* Decodes the video stream of dem at stream_ind and yields each scene cut as soon as it's found,
+		* so a chunk planner can start on the first scenes while the rest are being scanned.
+		* 
+		* With keyframes_only, only the keyframes are decoded (see decoder::skip_policy::fast_keyframes()),
+		* and the packets of other frames are discarded by dem at AVDISCARD_NONKEY.
+		* The level set before is put back when the generator ends or is destroyed.
+		* That is many times faster, and each cut found is the first keyframe of the new scene,
+		* which is also where a chunk can start.
+		* 
+		* To cut chunks there, convert the cuts to the time base of the stream
+		* and give them to chunked_transcoder::plan_chunks().
+		* 
+		* dem must outlive the generator, and must not be used while it's being iterated.
+		* Nothing is checked until it's iterated. Iterating throws
+		*	1. std::out_of_range if stream_ind is wrong,
+		*	2. std::invalid_argument if the stream is not a video, or if opts is invalid,
+		*	3. what demuxing, decoding, and push_frame() throw.
+		*/
+		static generator<ff::time> scan(demuxer& dem, int stream_ind, options opts = options(), bool keyframes_only = false);
+
+	private:
+		/*
+		* Scales f down to the luma it's compared by.
+		*/
+		frame internal_analysis_frame(const frame& f);
+
+	private:
+		rational tb;
+		options opts;
+
+		// Made for the size and format of the frames, and remade when they change.
+		std::unique_ptr<frame_transformer> trans;
+
+		// The small picture and the luma histogram of the last frame. DESTROYED if none.
+		frame prev{ false };
+		std::array<uint64_t, 256> prev_hist{};
+
+		// The differences of the recent frames in the scene, at most opts.window.
+		std::deque<double> recent;
+		// When the scene began, in seconds.
+		double scene_start = 0.0;
+
+		double last_diff = 0.0;
+		double last_hist_dist = 0.0;
+		size_t num_frames = 0;
+	};
+}
@@ -0,0 +1,234 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "smart_cutter.h"
+#include "../formats/muxer.h"
+#include "../codec/decoder.h"
+#include "../codec/encoder.h"
+
+extern "C"
+{
+#include <libavutil/mathematics.h>
+}
+
+#include <algorithm>
+#include <stdexcept>
+
+ff::smart_cutter::smart_cutter
+(
+	const std::filesystem::path& input, demuxer::keyframe_index index, int stream_ind,
+	encoder_factory make_encoder
+)
+	: input(input), index(std::move(index)), stream_ind(stream_ind),
+	make_encoder(std::move(make_encoder))
+{
+	if (stream_ind < 0 || stream_ind >= static_cast<int>(this->index.size()))
+	{
+		throw std::out_of_range("The index has no such stream.");
+	}
+
+	if (!this->make_encoder)
+	{
+		this->make_encoder = &default_encoder;
+	}
+}
+
+ff::cut_plan ff::smart_cutter::plan_cut(int64_t start_pts, int64_t end_pts) const
+{
+	return plan_cut(index, stream_ind, start_pts, end_pts);
+}
+
+ff::cut_plan ff::smart_cutter::plan_cut
+(
+	const demuxer::keyframe_index& index, int stream_ind, int64_t start_pts, int64_t end_pts
+)
+{
+	// Also checks stream_ind.
+	const std::vector<int64_t> boundaries = chunked_transcoder::closed_gop_boundaries(index, stream_ind);
+	if (AV_NOPTS_VALUE != end_pts && end_pts <= start_pts)
+	{
+		throw std::invalid_argument("The clip must end after it starts.");
+	}
+
+	cut_plan plan;
+	plan.start_pts = start_pts;
+	plan.end_pts = end_pts;
+
+	// A clip that ends after the last frame goes to the end, and so does its last GOP.
+	int64_t last_pts = AV_NOPTS_VALUE;
+	for (const auto& e : index[stream_ind])
+	{
+		last_pts = std::max(last_pts, e.pts);
+	}
+	const bool to_the_end = AV_NOPTS_VALUE == end_pts || end_pts > last_pts;
+
+	// The boundaries are increasing. Copy from the first at or after the start
+	// to the last at or before the end.
+	auto first = std::lower_bound(boundaries.begin(), boundaries.end(), start_pts);
+	if (first != boundaries.end())
+	{
+		if (to_the_end)
+		{
+			plan.copies = true;
+			plan.copy_start = *first;
+		}
+		else
+		{
+			auto last = std::upper_bound(first, boundaries.end(), end_pts);
+			if (last != first && *std::prev(last) > *first)
+			{
+				plan.copies = true;
+				plan.copy_start = *first;
+				// Unless the clip ends at the end of the last GOP, the tail starts there.
+				plan.copy_end = *std::prev(last);
+			}
+		}
+	}
+
+	for (const auto& e : index[stream_ind])
+	{
+		if (AV_NOPTS_VALUE == e.pts || e.pts < start_pts || (AV_NOPTS_VALUE != end_pts && e.pts >= end_pts))
+		{
+			continue;
+		}
+
+		if (!plan.copies || e.pts < plan.copy_start)
+		{
+			++plan.num_head_frames;
+		}
+		else if (AV_NOPTS_VALUE == plan.copy_end || e.pts < plan.copy_end)
+		{
+			++plan.num_copied_frames;
+		}
+		else
+		{
+			++plan.num_tail_frames;
+		}
+	}
+
+	return plan;
+}
+
+ff::cut_result ff::smart_cutter::run(const cut_plan& plan, muxer& mux, const stream& out_stream)
+{
+	// For the copied part, and for the time base. Only the stream is probed and read.
+	demuxer dem(input, false);
+	dem.select_streams({ stream_ind }, true);
+	dem.load_keyframe_index(index);
+	const AVRational stream_tb = dem.get_stream(stream_ind).time_base().av_rational();
+
+	cut_result res;
+	int64_t last_dts = INT64_MIN;
+
+	// Re-encodes the frames with start <= pts < end, and muxes them
+	// as if the clip started at plan.start_pts.
+	auto encode_part = [&](int64_t start, int64_t end)
+	{
+		chunk_description part;
+		part.start_pts = start;
+		part.end_pts = end;
+		encoded_chunk encoded = chunked_transcoder::transcode_chunk(input, index, stream_ind, part, make_encoder);
+
+		// The chunk's packets start from 0.
+		const int64_t offset = av_rescale_q(start - plan.start_pts, stream_tb, encoded.time_base.av_rational());
+		for (auto& pkt : encoded.packets)
+		{
+			internal_mux(pkt, offset, mux, out_stream, last_dts);
+		}
+		res.num_encoded_packets += encoded.packets.size();
+	};
+
+	if (!plan.copies || plan.start_pts < plan.copy_start)
+	{
+		encode_part(plan.start_pts, plan.copies ? plan.copy_start : plan.end_pts);
+	}
+
+	if (plan.copies)
+	{
+		// The copy starts at a keyframe, so it lands right there.
+		dem.seek_accurate(stream_ind, plan.copy_start);
+
+		// The copy ends at a closed-GOP keyframe: all packets before it in the file order
+		// are presented before it, and all after it at or after it.
+		packet pkt;
+		while (dem.demux_next_packet(pkt))
+		{
+			if (AV_NOPTS_VALUE != plan.copy_end && AV_NOPTS_VALUE != pkt->pts && pkt->pts >= plan.copy_end)
+			{
+				break;
+			}
+
+			internal_mux(pkt, -plan.start_pts, mux, out_stream, last_dts);
+			++res.num_copied_packets;
+		}
+
+		if (AV_NOPTS_VALUE != plan.copy_end && (AV_NOPTS_VALUE == plan.end_pts || plan.copy_end < plan.end_pts))
+		{
+			encode_part(plan.copy_end, plan.end_pts);
+		}
+	}
+
+	return res;
+}
+
+std::unique_ptr<ff::encoder> ff::smart_cutter::default_encoder(const decoder& dec)
+{
+	const codec_properties dp = dec.get_codec_properties();
+
+	auto enc = std::make_unique<encoder>(dp.id());
+	enc->set_properties_from_decoder(dec);
+	if (dp.bit_rate() > 0)
+	{
+		codec_properties ep = enc->get_codec_properties();
+		ep.set_bit_rate(dp.bit_rate());
+		enc->set_codec_properties(ep);
+	}
+	enc->create_codec_context();
+
+	return enc;
+}
+
+void ff::smart_cutter::internal_mux(packet& pkt, int64_t offset, muxer& mux, const stream& out_stream, int64_t& last_dts)
+{
+	if (AV_NOPTS_VALUE != pkt->pts)
+	{
+		pkt->pts += offset;
+	}
+	if (AV_NOPTS_VALUE != pkt->dts)
+	{
+		pkt->dts += offset;
+	}
+	// The position is that in the input.
+	pkt->pos = -1;
+
+	pkt.prepare_for_muxing(out_stream);
+
+	// Keep the dts increasing across the splices, which the muxer requires.
+	if (AV_NOPTS_VALUE != pkt->dts)
+	{
+		if (INT64_MIN != last_dts && pkt->dts <= last_dts)
+		{
+			pkt->dts = last_dts + 1;
+			if (AV_NOPTS_VALUE != pkt->pts && pkt->pts < pkt->dts)
+			{
+				pkt->pts = pkt->dts;
+			}
+		}
+		last_dts = pkt->dts;
+	}
+
+	mux.mux_packet_manual(pkt);
+}
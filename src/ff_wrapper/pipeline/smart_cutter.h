@@ -0,0 +1,179 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class smart_cutter.
+*/
+
+#include "../util/util.h"
+#include "../formats/demuxer.h"
+#include "../formats/stream.h"
+#include "chunked_transcoder.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace ff
+{
+	class muxer;
+	class packet;
+	class decoder;
+	class encoder;
+
+	/*
+	* How a clip of a stream is cut: the frames with start_pts <= pts < end_pts,
+	* in the time base of the stream.
+	* The whole GOPs inside are copied, and the frames before and after them re-encoded.
+	*/
+	struct cut_plan
+	{
+		int64_t start_pts = 0;
+		// AV_NOPTS_VALUE to go to the end.
+		int64_t end_pts = AV_NOPTS_VALUE;
+
+		// false if no whole GOP is inside, and then all frames are re-encoded.
+		bool copies = false;
+		// Copied are the frames with copy_start <= pts < copy_end.
+		// copy_end is AV_NOPTS_VALUE if the copy goes to the end, which it does if the clip ends after the last frame.
+		int64_t copy_start = AV_NOPTS_VALUE;
+		int64_t copy_end = AV_NOPTS_VALUE;
+
+		// From the keyframe index.
+		int num_head_frames = 0;
+		int num_copied_frames = 0;
+		int num_tail_frames = 0;
+	};
+
+	/*
+	* What cutting a clip gives.
+	*/
+	struct cut_result
+	{
+		size_t num_copied_packets = 0;
+		size_t num_encoded_packets = 0;
+	};
+
+	/*
+	* Cuts a clip out of a video stream without re-encoding all of it (smart cut).
+	* Using the keyframe index (see demuxer::build_keyframe_index()),
+	* I copy the packets of every closed GOP inside the clip as they are,
+	* and only decode and re-encode the frames before the first of them (the head)
+	* and after the last (the tail), each with an encoder of its own.
+	* So a clip costs about two GOPs of encoding, however long it is.
+	* 
+	* In the output, the clip starts at 0.
+	* 
+	* Notes:
+	*	1. The copied packets are decoded with the parameters of the output stream,
+	*	so add it with muxer::add_stream(const stream&) from the input stream, and make the encoder
+	*	give packets that decode with the same: the same codec and size, and the headers in each keyframe
+	*	rather than in the extradata. default_encoder() does so for codecs that put them there by default (e.g. mpeg4).
+	*	2. The dts of the output are kept increasing across the splices, which may move some by a tick.
+	*	3. Only the video stream is cut. Cut other streams yourself.
+	* 
+	* See chunked_transcoder for the pieces this reuses.
+	*/
+	class FF_WRAPPER_API smart_cutter final
+	{
+	public:
+		/*
+		* Creates a ready encoder for the head or the tail. See chunked_transcoder::encoder_factory.
+		*/
+		using encoder_factory = chunked_transcoder::encoder_factory;
+
+	public:
+		smart_cutter() = delete;
+
+		/*
+		* @param input the file to cut from.
+		* @param index a keyframe index of the file (see demuxer::build_keyframe_index()).
+		* @param stream_ind which stream to cut. It must be a video stream.
+		* @param make_encoder see encoder_factory. Empty for default_encoder().
+		* @throws std::out_of_range if index has no stream of stream_ind.
+		*/
+		smart_cutter
+		(
+			const std::filesystem::path& input, demuxer::keyframe_index index, int stream_ind,
+			encoder_factory make_encoder = encoder_factory()
+		);
+
+		smart_cutter(const smart_cutter&) = delete;
+		smart_cutter& operator=(const smart_cutter&) = delete;
+
+	public:
+		/*
+		* Works out how to cut the frames with start_pts <= pts < end_pts.
+		* 
+		* @param start_pts in the time base of the stream.
+		* @param end_pts in the time base of the stream. AV_NOPTS_VALUE to go to the end.
+		* @throws std::invalid_argument if end_pts <= start_pts.
+		*/
+		cut_plan plan_cut(int64_t start_pts, int64_t end_pts) const;
+
+		/*
+		* Cuts the clip as planned into out_stream of mux.
+		* The muxer must be prepared, and is not finalized afterwards.
+		* 
+		* @param plan what plan_cut() gives.
+		* @param out_stream the stream of mux the packets go to.
+		* @throws std::invalid_argument if make_encoder gives no encoder or one not ready.
+		* @throws what the demuxer, the codecs, and the muxer throw.
+		*/
+		cut_result run(const cut_plan& plan, muxer& mux, const stream& out_stream);
+
+		/*
+		* The same as run(plan_cut(start_pts, end_pts), mux, out_stream).
+		*/
+		cut_result cut(int64_t start_pts, int64_t end_pts, muxer& mux, const stream& out_stream)
+		{
+			return run(plan_cut(start_pts, end_pts), mux, out_stream);
+		}
+
+	public:
+		/*
+		* The static version of plan_cut().
+		* 
+		* @throws std::out_of_range if index has no stream of stream_ind.
+		* @throws std::invalid_argument if end_pts <= start_pts.
+		*/
+		static cut_plan plan_cut(const demuxer::keyframe_index& index, int stream_ind, int64_t start_pts, int64_t end_pts);
+
+		/*
+		* An encoder of the decoder's codec, configured from it by encoder::set_properties_from_decoder(),
+		* with the bit rate of the input stream if it's known.
+		* 
+		* @throws std::invalid_argument if there is no encoder for the codec.
+		*/
+		static std::unique_ptr<encoder> default_encoder(const decoder& dec);
+
+	private:
+		/*
+		* Moves the time fields of pkt by offset, in its time base,
+		* and muxes it into out_stream, keeping the dts after last_dts.
+		*/
+		static void internal_mux(packet& pkt, int64_t offset, muxer& mux, const stream& out_stream, int64_t& last_dts);
+
+	private:
+		std::filesystem::path input;
+		demuxer::keyframe_index index;
+		int stream_ind;
+		encoder_factory make_encoder;
+	};
+}
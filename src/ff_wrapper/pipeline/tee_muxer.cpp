@@ -0,0 +1,216 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "tee_muxer.h"
+#include "../formats/muxer.h"
+
+#include <functional>
+#include <stdexcept>
+
+ff::tee_muxer::tee_muxer(size_t queue_capacity, overflow_policy policy)
+	: capacity(queue_capacity), policy(policy)
+{
+	if (0 == queue_capacity)
+	{
+		throw std::invalid_argument("The capacity must be > 0.");
+	}
+}
+
+ff::tee_muxer::~tee_muxer() noexcept
+{
+	if (!finished)
+	{
+		internal_stop(true);
+	}
+}
+
+size_t ff::tee_muxer::add_destination(muxer& mux, const std::vector<stream>& out_streams)
+{
+	if (pushed || finished)
+	{
+		throw std::logic_error("Destinations can only be added before the first packet.");
+	}
+	if (out_streams.empty())
+	{
+		throw std::invalid_argument("A destination needs streams.");
+	}
+
+	auto d = std::make_unique<destination>(mux, out_streams, capacity);
+	d->writer = std::thread(&tee_muxer::write_loop, std::ref(*d));
+	dests.push_back(std::move(d));
+
+	return dests.size() - 1;
+}
+
+void ff::tee_muxer::push_packet(const packet& pkt, int in_stream)
+{
+	if (finished)
+	{
+		throw std::logic_error("The tee muxer has been finished.");
+	}
+	if (dests.empty())
+	{
+		throw std::logic_error("There is no destination.");
+	}
+	if (!pkt.ready())
+	{
+		throw std::invalid_argument("The packet must be ready.");
+	}
+	if (pkt.time_base() <= zero_rational)
+	{
+		throw std::invalid_argument("The packet must have a valid time base.");
+	}
+	// Check them all before giving it to any, so that they stay in step.
+	for (const auto& d : dests)
+	{
+		if (in_stream < 0 || in_stream >= static_cast<int>(d->out_streams.size()))
+		{
+			throw std::out_of_range("A destination has no such stream.");
+		}
+	}
+	pushed = true;
+
+	for (const auto& d : dests)
+	{
+		if (d->has_failed.load(std::memory_order_acquire))
+		{
+			continue;
+		}
+
+		// Only references the data.
+		std::pair<packet, int> item(packet(pkt), in_stream);
+		if (overflow_policy::wait == policy)
+		{
+			// Only fails if the queue has been aborted, i.e. the destination has failed.
+			d->queue.push(std::move(item));
+		}
+		else if (!d->queue.try_push(std::move(item)) && !d->queue.is_closed())
+		{
+			fail(*d, std::make_exception_ptr(std::runtime_error("The destination fell behind and has been dropped.")));
+		}
+	}
+}
+
+size_t ff::tee_muxer::finish()
+{
+	if (finished)
+	{
+		throw std::logic_error("The tee muxer has been finished.");
+	}
+	finished = true;
+
+	// The writers finalize their muxers after muxing what's left.
+	internal_stop(false);
+
+	size_t n = 0;
+	for (const auto& d : dests)
+	{
+		if (!d->has_failed.load(std::memory_order_acquire))
+		{
+			++n;
+		}
+	}
+
+	return n;
+}
+
+bool ff::tee_muxer::failed(size_t i) const
+{
+	return dests.at(i)->has_failed.load(std::memory_order_acquire);
+}
+
+std::exception_ptr ff::tee_muxer::error(size_t i) const
+{
+	const destination& d = *dests.at(i);
+	std::lock_guard<std::mutex> lock(d.err_mtx);
+	return d.err;
+}
+
+size_t ff::tee_muxer::num_muxed_packets(size_t i) const
+{
+	return dests.at(i)->num_muxed.load(std::memory_order_relaxed);
+}
+
+void ff::tee_muxer::write_loop(destination& d) noexcept
+{
+	try
+	{
+		std::pair<packet, int> item;
+		while (d.queue.pop(item))
+		{
+			packet& pkt = item.first;
+			const int s = item.second;
+
+			// The stream's time base is final, as the muxer has been prepared.
+			auto& rescaler = d.rescalers[s];
+			if (!rescaler.has_value())
+			{
+				rescaler.emplace(pkt.time_base(), d.out_streams[s].time_base());
+			}
+			pkt.prepare_for_muxing(d.out_streams[s], *rescaler);
+
+			// Each muxer keeps its own dts in order.
+			d.mux->mux_packet_auto(pkt);
+			d.num_muxed.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Aborted means stopped early or dropped. Only finalize after a normal close.
+		if (!d.queue.is_aborted())
+		{
+			d.mux->finalize();
+		}
+	}
+	catch (...)
+	{
+		fail(d, std::current_exception());
+	}
+}
+
+void ff::tee_muxer::fail(destination& d, std::exception_ptr e) noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(d.err_mtx);
+		if (nullptr == d.err)
+		{
+			d.err = e;
+		}
+	}
+	d.has_failed.store(true, std::memory_order_release);
+
+	// Whoever waits on it returns, and the packets held are released.
+	d.queue.abort();
+}
+
+void ff::tee_muxer::internal_stop(bool abort) noexcept
+{
+	for (const auto& d : dests)
+	{
+		if (abort)
+		{
+			d->queue.abort();
+		}
+		else
+		{
+			d->queue.close();
+		}
+	}
+	for (const auto& d : dests)
+	{
+		if (d->writer.joinable())
+		{
+			d->writer.join();
+		}
+	}
+}
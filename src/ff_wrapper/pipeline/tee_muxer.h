@@ -0,0 +1,187 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/ff_time.h"
+#include "../util/bounded_queue.h"
+#include "../data/packet.h"
+#include "../formats/stream.h"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ff
+{
+	class muxer;
+
+	/*
+	* Muxes the packets of one encode into several muxers at once (e.g. an MP4 file and an MPEG-TS stream
+	* through a custom_io), so that the encoder runs only once.
+	*
+	* Each packet pushed is referenced, not copied, into a queue per destination,
+	* and each destination has its own thread that takes the packets out of its queue
+	* and muxes them with mux_packet_auto(). So each muxer keeps its own interleaving and timestamp fixing,
+	* and a slow destination (e.g. a network sink) doesn't hold back the others:
+	* with overflow_policy::drop_destination, one whose queue overflows is dropped, and the rest go on.
+	*
+	* How to use:
+	*	1. For each destination, add the streams to its muxer, prepare it, and add_destination() with its streams.
+	*	2. push_packet() each packet the encoders give out, in the order they give them out.
+	*	3. finish(), which waits for every destination to mux what it has and finalizes the muxers.
+	*
+	* A destination that fails (its muxer throws, or it's dropped) stops on its own; failed() and error() tell.
+	* push_packet() and finish() only throw for misuse, never for what happens in a destination.
+	*
+	* I don't own the muxers, and they must outlive me. Don't touch them until finish() returns.
+	* push_packet() and finish() must be called from one thread.
+	*/
+	class FF_WRAPPER_API tee_muxer final
+	{
+	public:
+		/*
+		* What push_packet() does when a destination's queue is full.
+		*/
+		enum class overflow_policy
+		{
+			// Waits for the destination to catch up, which holds back the others too.
+			wait,
+			// Drops the destination (it fails with std::runtime_error), so that the others go on.
+			drop_destination
+		};
+
+		/*
+		* @param queue_capacity at most how many packets can wait for each destination.
+		* @param policy see overflow_policy.
+		* @throws std::invalid_argument if queue_capacity is 0.
+		*/
+		explicit tee_muxer(size_t queue_capacity = 256, overflow_policy policy = overflow_policy::drop_destination);
+
+		tee_muxer(const tee_muxer&) = delete;
+		tee_muxer& operator=(const tee_muxer&) = delete;
+
+		/*
+		* If finish() has not been called, stops every destination without finalizing their muxers.
+		*/
+		~tee_muxer() noexcept;
+
+	public:
+		/*
+		* Adds a destination and starts its thread.
+		*
+		* @param mux a prepared muxer.
+		* @param out_streams out_streams[i] is the stream in mux that the packets pushed for stream i go to.
+		* @returns the index of the destination.
+		* @throws std::logic_error if a packet has been pushed.
+		* @throws std::invalid_argument if out_streams is empty.
+		*/
+		size_t add_destination(muxer& mux, const std::vector<stream>& out_streams);
+
+		/*
+		* Gives a packet to every destination that has not failed.
+		*
+		* @param pkt a ready packet, e.g. from encoder::encode_packet(), in its encoder's time base.
+		* It's untouched; each destination gets a reference to its data.
+		* @param in_stream which stream the packet is of, i.e. the index into out_streams of add_destination().
+		* @throws std::logic_error if there's no destination, or if finish() has been called.
+		* @throws std::invalid_argument if pkt is not ready or has no valid time base.
+		* @throws std::out_of_range if a destination has no stream of in_stream.
+		*/
+		void push_packet(const packet& pkt, int in_stream);
+
+		/*
+		* Waits for every destination to mux what it has, and finalizes the muxer of each that has not failed.
+		*
+		* @returns how many destinations succeeded.
+		* @throws std::logic_error if it has been called.
+		*/
+		size_t finish();
+
+	public:
+		size_t num_destinations() const noexcept { return dests.size(); }
+
+		/*
+		* @returns true iff destination i has failed. Can be called from any thread.
+		* @throws std::out_of_range if i is out of range.
+		*/
+		bool failed(size_t i) const;
+		/*
+		* @returns why destination i failed. nullptr if it has not failed.
+		* Only call it after finish(), or after failed(i) has returned true.
+		* @throws std::out_of_range if i is out of range.
+		*/
+		std::exception_ptr error(size_t i) const;
+		/*
+		* @returns how many packets destination i has muxed so far. Can be called from any thread.
+		* @throws std::out_of_range if i is out of range.
+		*/
+		size_t num_muxed_packets(size_t i) const;
+
+	private:
+		struct destination
+		{
+			destination(muxer& mux, const std::vector<stream>& out_streams, size_t capacity)
+				: mux(&mux), out_streams(out_streams), rescalers(out_streams.size()), queue(capacity) {}
+
+			muxer* mux;
+			std::vector<stream> out_streams;
+			// One for each stream, worked out at its first packet.
+			std::vector<std::optional<time_rescaler>> rescalers;
+
+			// (the packet, in_stream)
+			bounded_queue<std::pair<packet, int>> queue;
+			std::thread writer;
+
+			std::atomic<bool> has_failed{ false };
+			std::atomic<size_t> num_muxed{ 0 };
+			// Either the writer or push_packet() can fail it, so the first error is kept under a lock.
+			mutable std::mutex err_mtx;
+			std::exception_ptr err;
+		};
+
+		/*
+		* What each destination's thread runs.
+		*/
+		static void write_loop(destination& d) noexcept;
+
+		/*
+		* Marks d failed because of e, and discards what it has queued.
+		*/
+		static void fail(destination& d, std::exception_ptr e) noexcept;
+
+		/*
+		* Closes or aborts every queue, and joins every thread.
+		*/
+		void internal_stop(bool abort) noexcept;
+
+	private:
+		const size_t capacity;
+		const overflow_policy policy;
+
+		// Pointers, so that the threads' references stay valid as more are added.
+		std::vector<std::unique_ptr<destination>> dests;
+
+		bool pushed = false;
+		bool finished = false;
+	};
+}
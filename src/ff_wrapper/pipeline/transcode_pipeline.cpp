@@ -0,0 +1,627 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "transcode_pipeline.h"
+#include "../formats/demuxer.h"
+#include "../formats/muxer.h"
+#include "../codec/decoder.h"
+#include "../codec/encoder.h"
+#include "../sws/frame_transformer.h"
+#include "../filter/filter_graph.h"
+#include "quality_meter.h"
+#include "loudness_meter.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h> // For accessing AVCodecContext.
+#include <libavcodec/packet.h>
+}
+
+#include <functional> // For std::ref
+#include <stdexcept>
+
+ff::transcode_pipeline::transcode_pipeline(demuxer& dem, muxer& mux, size_t queue_capacity, memory_budget* budget)
+	: dem(&dem), mux(&mux), queue_capacity(queue_capacity),
+	// The muxer takes from all the routes, so give it more room.
+	// It throws std::invalid_argument if queue_capacity is 0.
+	to_mux(2 * queue_capacity),
+	budget(nullptr == budget ? &memory_budget::process_wide() : budget)
+{
+	routes.resize(dem.num_streams());
+}
+
+ff::transcode_pipeline::~transcode_pipeline() noexcept
+{
+	stop_all();
+}
+
+void ff::transcode_pipeline::add_transcode_route
+(
+	int in_stream_ind, decoder& dec, encoder& enc,
+	const stream& out_stream, frame_transformer* trans
+)
+{
+	internal_check_new_route(in_stream_ind);
+	if (!dec.ready() || !enc.ready())
+	{
+		throw std::invalid_argument("The decoder and the encoder must be ready.");
+	}
+
+	auto r = std::make_unique<route>(out_stream, queue_capacity);
+	r->dec = &dec;
+	r->enc = &enc;
+	r->trans = trans;
+	r->frames_tb = dem->get_stream(in_stream_ind).time_base();
+	routes[in_stream_ind] = std::move(r);
+}
+
+void ff::transcode_pipeline::add_transcode_route
+(
+	int in_stream_ind, decoder& dec, encoder& enc,
+	const stream& out_stream, filter_graph& filter
+)
+{
+	internal_check_new_route(in_stream_ind);
+	if (!dec.ready() || !enc.ready())
+	{
+		throw std::invalid_argument("The decoder and the encoder must be ready.");
+	}
+	if (filter.no_more_food())
+	{
+		throw std::invalid_argument("The filter graph has been signaled no more food.");
+	}
+
+	auto r = std::make_unique<route>(out_stream, queue_capacity);
+	r->dec = &dec;
+	r->enc = &enc;
+	r->filter = &filter;
+	r->frames_tb = filter.dst_time_base();
+	routes[in_stream_ind] = std::move(r);
+}
+
+void ff::transcode_pipeline::add_copy_route(int in_stream_ind, const stream& out_stream)
+{
+	internal_check_new_route(in_stream_ind);
+
+	routes[in_stream_ind] = std::make_unique<route>(out_stream, queue_capacity);
+}
+
+void ff::transcode_pipeline::set_quality_meter(int in_stream_ind, quality_meter& meter)
+{
+	if (has_run)
+	{
+		throw std::logic_error("Cannot set quality meters after run().");
+	}
+	if (in_stream_ind < 0 || in_stream_ind >= static_cast<int>(routes.size()))
+	{
+		throw std::out_of_range("Stream index is out of range.");
+	}
+	if (nullptr == routes[in_stream_ind] || routes[in_stream_ind]->is_copy())
+	{
+		throw std::invalid_argument("The stream has no transcoding route.");
+	}
+
+	routes[in_stream_ind]->meter = &meter;
+}
+
+void ff::transcode_pipeline::set_loudness_meter(int in_stream_ind, loudness_meter& meter)
+{
+	if (has_run)
+	{
+		throw std::logic_error("Cannot set loudness meters after run().");
+	}
+	if (in_stream_ind < 0 || in_stream_ind >= static_cast<int>(routes.size()))
+	{
+		throw std::out_of_range("Stream index is out of range.");
+	}
+	if (nullptr == routes[in_stream_ind] || routes[in_stream_ind]->is_copy())
+	{
+		throw std::invalid_argument("The stream has no transcoding route.");
+	}
+
+	routes[in_stream_ind]->loudness = &meter;
+}
+
+void ff::transcode_pipeline::run()
+{
+	if (has_run)
+	{
+		throw std::logic_error("A pipeline can only be run once.");
+	}
+
+	int num_transcodes = 0;
+	bool has_copy = false;
+	for (const auto& r : routes)
+	{
+		if (nullptr == r)
+		{
+			continue;
+		}
+
+		if (r->is_copy())
+		{
+			has_copy = true;
+		}
+		else
+		{
+			++num_transcodes;
+		}
+	}
+	if (0 == num_transcodes && !has_copy)
+	{
+		throw std::logic_error("The pipeline has no routes.");
+	}
+
+	has_run = true;
+	// The encoders, and the demuxer if it pushes copied packets.
+	num_producers.store(num_transcodes + (has_copy ? 1 : 0), std::memory_order_relaxed);
+
+	try
+	{
+		workers.emplace_back(&transcode_pipeline::demux_loop, this);
+		for (auto& r : routes)
+		{
+			if (nullptr == r || r->is_copy())
+			{
+				continue;
+			}
+
+			workers.emplace_back(&transcode_pipeline::decode_loop, this, std::ref(*r));
+			if (nullptr != r->trans)
+			{
+				workers.emplace_back(&transcode_pipeline::transform_loop, this, std::ref(*r));
+			}
+			else if (nullptr != r->filter)
+			{
+				workers.emplace_back(&transcode_pipeline::filter_loop, this, std::ref(*r));
+			}
+			workers.emplace_back(&transcode_pipeline::encode_loop, this, std::ref(*r));
+		}
+	}
+	catch (...)
+	{
+		// Could not start a thread.
+		stop_all();
+		throw;
+	}
+
+	try
+	{
+		mux_loop();
+	}
+	catch (...)
+	{
+		on_error(std::current_exception());
+	}
+
+	for (auto& t : workers)
+	{
+		t.join();
+	}
+	workers.clear();
+
+	if (nullptr != first_error)
+	{
+		std::rethrow_exception(first_error);
+	}
+
+	mux->finalize();
+}
+
+void ff::transcode_pipeline::demux_loop() noexcept
+{
+	try
+	{
+		while (true)
+		{
+			packet pkt = dem->demux_next_packet();
+			if (pkt.destroyed())
+			{
+				// EOF
+				break;
+			}
+
+			const int ind = pkt->stream_index;
+			if (ind < 0 || ind >= static_cast<int>(routes.size()) || nullptr == routes[ind])
+			{
+				// No route.
+				continue;
+			}
+
+			// New data comes in only here, so wait here while the budget is used up.
+			memory_budget::charge c = budget->acquire
+			(
+				pkt.memory_size(),
+				[this] { return aborted.load(std::memory_order_acquire); }
+			);
+			if (c.empty())
+			{
+				return;
+			}
+
+			route& r = *routes[ind];
+			if (r.is_copy())
+			{
+				pkt.prepare_for_muxing(r.out_stream);
+				if (!to_mux.push(held<packet>{ std::move(pkt), std::move(c) }))
+				{
+					return;
+				}
+			}
+			else if (!r.packets.push(held<packet>{ std::move(pkt), std::move(c) }))
+			{
+				return;
+			}
+		}
+
+		bool has_copy = false;
+		for (auto& r : routes)
+		{
+			if (nullptr == r)
+			{
+				continue;
+			}
+
+			if (r->is_copy())
+			{
+				has_copy = true;
+			}
+			else
+			{
+				r->packets.close();
+			}
+		}
+		if (has_copy)
+		{
+			producer_done();
+		}
+	}
+	catch (...)
+	{
+		on_error(std::current_exception());
+	}
+}
+
+void ff::transcode_pipeline::decode_loop(route& r) noexcept
+{
+	try
+	{
+		decoder& dec = *r.dec;
+
+		held<packet> h;
+		while (r.packets.pop(h))
+		{
+			packet& pkt = h.item;
+			while (!dec.feed_packet(pkt))
+			{
+				// It's full. Take out its frames to make room.
+				FF_ASSERT(dec.full(), "A decoder refuses a packet only when it's full.");
+				if (!output_decoded(r))
+				{
+					return;
+				}
+			}
+			// The decoder has it now. Holding the charge while waiting for the next could starve the demuxer.
+			h.charge.release();
+
+			if (!output_decoded(r))
+			{
+				return;
+			}
+		}
+		if (r.packets.is_aborted())
+		{
+			return;
+		}
+
+		// Drain it.
+		dec.signal_no_more_food();
+		if (!output_decoded(r))
+		{
+			return;
+		}
+
+		r.decoded.close();
+	}
+	catch (...)
+	{
+		on_error(std::current_exception());
+	}
+}
+
+void ff::transcode_pipeline::transform_loop(route& r) noexcept
+{
+	try
+	{
+		held<frame> h;
+		while (r.decoded.pop(h))
+		{
+			frame f = r.trans->convert_frame(h.item);
+			h.charge.release();
+			if (!r.transformed.push(internal_hold(std::move(f))))
+			{
+				return;
+			}
+		}
+		if (r.decoded.is_aborted())
+		{
+			return;
+		}
+
+		r.transformed.close();
+	}
+	catch (...)
+	{
+		on_error(std::current_exception());
+	}
+}
+
+void ff::transcode_pipeline::filter_loop(route& r) noexcept
+{
+	try
+	{
+		held<frame> h;
+		while (r.decoded.pop(h))
+		{
+			r.filter->feed_frame(h.item);
+			h.charge.release();
+			if (!output_filtered(r))
+			{
+				return;
+			}
+		}
+		if (r.decoded.is_aborted())
+		{
+			return;
+		}
+
+		// Drain it.
+		r.filter->signal_no_more_food();
+		if (!output_filtered(r))
+		{
+			return;
+		}
+
+		r.transformed.close();
+	}
+	catch (...)
+	{
+		on_error(std::current_exception());
+	}
+}
+
+void ff::transcode_pipeline::encode_loop(route& r) noexcept
+{
+	try
+	{
+		encoder& enc = *r.enc;
+		frame_queue& in = r.has_transform_stage() ? r.transformed : r.decoded;
+
+		held<frame> h;
+		while (in.pop(h))
+		{
+			if (nullptr != r.meter)
+			{
+				r.meter->add_reference(h.item);
+			}
+			if (nullptr != r.loudness)
+			{
+				r.loudness->feed_frame(h.item);
+			}
+			internal_rescale_to_encoder(r, h.item);
+			while (!enc.feed_frame(h.item))
+			{
+				// It's full. Take out its packets to make room.
+				FF_ASSERT(enc.full(), "An encoder refuses a frame only when it's full.");
+				if (!output_encoded(r))
+				{
+					return;
+				}
+			}
+			h.charge.release();
+
+			if (!output_encoded(r))
+			{
+				return;
+			}
+		}
+		if (in.is_aborted())
+		{
+			return;
+		}
+
+		// Drain it.
+		enc.signal_no_more_food();
+		if (!output_encoded(r))
+		{
+			return;
+		}
+		if (nullptr != r.meter)
+		{
+			r.meter->finish();
+		}
+		if (nullptr != r.loudness)
+		{
+			r.loudness->signal_no_more_food();
+		}
+
+		producer_done();
+	}
+	catch (...)
+	{
+		on_error(std::current_exception());
+	}
+}
+
+void ff::transcode_pipeline::internal_rescale_to_encoder(route& r, frame& f)
+{
+	const ff::rational src_tb =
+		av_rational_invalid_or_zero(f->time_base) ? r.frames_tb : ff::rational(f->time_base);
+	const ff::rational enc_tb = (*r.enc)->time_base;
+	if (!r.to_enc_tb || r.to_enc_tb->from_time_base() != src_tb)
+	{
+		r.to_enc_tb.emplace(src_tb, enc_tb);
+	}
+
+	// Only the AVFrame of the held frame is changed, not the data others may share.
+	r.to_enc_tb->rescale(f->pts, f->pkt_dts, f->duration);
+	f->time_base = enc_tb.av_rational();
+}
+
+void ff::transcode_pipeline::mux_loop()
+{
+	held<packet> h;
+	while (to_mux.pop(h))
+	{
+		mux->mux_packet_auto(h.item);
+		// It's in the muxer's hands now.
+		h.charge.release();
+		num_muxed.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+bool ff::transcode_pipeline::output_decoded(route& r)
+{
+	// A DESTROYED frame means it's hungry again,
+	// or, after signal_no_more_food(), that nothing is left.
+	while (true)
+	{
+		frame f = r.dec->decode_frame();
+		if (f.destroyed())
+		{
+			FF_ASSERT(r.dec->hungry() || r.dec->no_more_food(), "Should be hungry if it outputs nothing.");
+			return true;
+		}
+
+		if (!r.decoded.push(internal_hold(std::move(f))))
+		{
+			return false;
+		}
+	}
+}
+
+bool ff::transcode_pipeline::output_filtered(route& r)
+{
+	// A DESTROYED frame means it's hungry again,
+	// or, after signal_no_more_food(), that it's drained.
+	while (true)
+	{
+		frame f = r.filter->filter_frame();
+		if (f.destroyed())
+		{
+			return true;
+		}
+
+		if (!r.transformed.push(internal_hold(std::move(f))))
+		{
+			return false;
+		}
+	}
+}
+
+bool ff::transcode_pipeline::output_encoded(route& r)
+{
+	// A DESTROYED packet means it's hungry again,
+	// or, after signal_no_more_food(), that nothing is left.
+	while (true)
+	{
+		packet pkt = r.enc->encode_packet();
+		if (pkt.destroyed())
+		{
+			FF_ASSERT(r.enc->hungry() || r.enc->no_more_food(), "Should be hungry if it outputs nothing.");
+			return true;
+		}
+
+		if (nullptr != r.meter)
+		{
+			// While it's still in the encoder's time base.
+			r.meter->add_packet(pkt);
+		}
+		pkt.prepare_for_muxing(r.out_stream);
+		if (!to_mux.push(internal_hold(std::move(pkt))))
+		{
+			return false;
+		}
+	}
+}
+
+void ff::transcode_pipeline::on_error(std::exception_ptr e) noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(error_mtx);
+		if (nullptr == first_error)
+		{
+			first_error = e;
+		}
+	}
+
+	aborted.store(true, std::memory_order_release);
+	memory_budget::wake_waiters();
+	to_mux.abort();
+	for (auto& r : routes)
+	{
+		if (nullptr == r)
+		{
+			continue;
+		}
+
+		r->packets.abort();
+		r->decoded.abort();
+		r->transformed.abort();
+	}
+}
+
+void ff::transcode_pipeline::producer_done() noexcept
+{
+	if (1 == num_producers.fetch_sub(1, std::memory_order_acq_rel))
+	{
+		to_mux.close();
+	}
+}
+
+void ff::transcode_pipeline::stop_all() noexcept
+{
+	if (workers.empty())
+	{
+		return;
+	}
+
+	on_error(nullptr);
+	for (auto& t : workers)
+	{
+		if (t.joinable())
+		{
+			t.join();
+		}
+	}
+	workers.clear();
+}
+
+void ff::transcode_pipeline::internal_check_new_route(int in_stream_ind) const
+{
+	if (has_run)
+	{
+		throw std::logic_error("Cannot add routes after run().");
+	}
+	if (in_stream_ind < 0 || in_stream_ind >= static_cast<int>(routes.size()))
+	{
+		throw std::out_of_range("Stream index is out of range.");
+	}
+	if (nullptr != routes[in_stream_ind])
+	{
+		throw std::invalid_argument("The stream already has a route.");
+	}
+}
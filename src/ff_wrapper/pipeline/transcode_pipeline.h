@@ -0,0 +1,333 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../util/util.h"
+#include "../util/bounded_queue.h"
+#include "../util/memory_budget.h"
+#include "../util/ff_time.h"
+#include "../data/frame.h"
+#include "../data/packet.h"
+#include "../formats/stream.h"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace ff
+{
+	class demuxer;
+	class muxer;
+	class decoder;
+	class encoder;
+	class frame_transformer;
+	class filter_graph;
+	class quality_meter;
+	class loudness_meter;
+
+	/*
+	* Runs demuxing, decoding, transforming, encoding, and muxing at the same time,
+	* each on its own thread, so that the stages overlap instead of waiting for each other.
+	* 
+	* Routes define what happens to each input stream:
+	*	1. A transcoding route goes demuxer -> decoder -> (frame_transformer or filter_graph) -> encoder -> muxer.
+	*	2. A copying route goes demuxer -> muxer.
+	* Packets of streams without a route are discarded.
+	* 
+	* Threads:
+	*	1. One demuxes and hands the packets to the routes.
+	*	2. Each transcoding route has one to decode, one to transform (if it has a transformer or a filter graph),
+	*	and one to encode.
+	*	3. The thread that calls run() muxes.
+	* Between each two stages is a bounded_queue. A stage waits when the queue after it is full,
+	* so a slow stage holds back those before it instead of letting the queues grow.
+	* A decoder/encoder is fed through the protocol described in codec_base:
+	* when it's full, its outputs are taken out before it's fed again,
+	* and after each feeding, its outputs are taken out until it's hungry.
+	* 
+	* Timestamps:
+	* The frames are rescaled into the time base of the encoder just before they're fed to it,
+	* from their own AVFrame::time_base if it's set, or else from the time base of the input stream
+	* (or of the filter graph's output, for a route with one).
+	* 
+	* When the demuxer reaches eof, the end flows through the stages:
+	* each closes the queue after it once it has drained its codec through signal_no_more_food(),
+	* and the muxer is finalized after everything is muxed.
+	* 
+	* If any stage throws, all the queues are aborted, all the stages stop,
+	* and run() rethrows the first exception after the threads have gone.
+	* 
+	* Memory:
+	* Each packet/frame is charged to a memory_budget while it's queued or being worked on,
+	* and the charge is released as soon as the next stage has fed or converted it.
+	* The demuxing stage waits while the budget is at its hard cap,
+	* and the later stages charge what they make without waiting, so that they keep freeing memory.
+	* Give each pipeline a budget of its own to count and cap it alone;
+	* what it charges also counts for the budget's parents (e.g. the process-wide one).
+	* 
+	* I don't own the demuxer, codecs, transformers, filter graphs, or the muxer,
+	* and they must outlive the pipeline. Don't touch them while run() is running.
+	*/
+	class FF_WRAPPER_API transcode_pipeline final
+	{
+	public:
+		transcode_pipeline() = delete;
+
+		/*
+		* @param dem where the packets come from.
+		* @param mux where the packets go. Add the output streams to it and prepare it before run().
+		* @param queue_capacity at most how many packets/frames can wait between two stages.
+		* @param budget what the packets and frames are charged to. It must outlive the pipeline.
+		* nullptr for memory_budget::process_wide().
+		* @throws std::invalid_argument if queue_capacity is 0.
+		*/
+		transcode_pipeline(demuxer& dem, muxer& mux, size_t queue_capacity = 8, memory_budget* budget = nullptr);
+
+		transcode_pipeline(const transcode_pipeline&) = delete;
+		transcode_pipeline& operator=(const transcode_pipeline&) = delete;
+
+		~transcode_pipeline() noexcept;
+
+	public:
+		/*
+		* Adds a route that decodes the input stream, optionally transforms the frames,
+		* encodes them, and muxes the packets into the output stream.
+		* 
+		* @param in_stream_ind the index of the input stream in the demuxer.
+		* @param dec a ready decoder for the input stream.
+		* @param enc a ready encoder that accepts what dec (or trans) outputs.
+		* @param out_stream the stream in the muxer the packets go to.
+		* @param trans if not nullptr, the transformer that converts each decoded frame before it's encoded.
+		* @throws std::logic_error if run() has been called.
+		* @throws std::out_of_range if in_stream_ind is out of range.
+		* @throws std::invalid_argument if the input stream already has a route.
+		* @throws std::invalid_argument if dec or enc is not ready.
+		*/
+		void add_transcode_route
+		(
+			int in_stream_ind, decoder& dec, encoder& enc,
+			const stream& out_stream, frame_transformer* trans = nullptr
+		);
+
+		/*
+		* Adds a route that decodes the input stream, runs the frames through a filter graph,
+		* encodes them, and muxes the packets into the output stream.
+		* The graph is drained after the decoder, before the encoder.
+		* 
+		* @param in_stream_ind the index of the input stream in the demuxer.
+		* @param dec a ready decoder for the input stream.
+		* @param enc a ready encoder that accepts what filter outputs.
+		* @param out_stream the stream in the muxer the packets go to.
+		* @param filter the graph that filters what dec outputs. It must not have been fed.
+		* @throws std::logic_error if run() has been called.
+		* @throws std::out_of_range if in_stream_ind is out of range.
+		* @throws std::invalid_argument if the input stream already has a route.
+		* @throws std::invalid_argument if dec or enc is not ready, or if filter has been signaled no more food.
+		*/
+		void add_transcode_route
+		(
+			int in_stream_ind, decoder& dec, encoder& enc,
+			const stream& out_stream, filter_graph& filter
+		);
+
+		/*
+		* Adds a route that muxes the packets of the input stream into the output stream unchanged.
+		* 
+		* @param in_stream_ind the index of the input stream in the demuxer.
+		* @param out_stream the stream in the muxer the packets go to.
+		* It should have been added through muxer::add_stream(const stream&).
+		* @throws std::logic_error if run() has been called.
+		* @throws std::out_of_range if in_stream_ind is out of range.
+		* @throws std::invalid_argument if the input stream already has a route.
+		*/
+		void add_copy_route(int in_stream_ind, const stream& out_stream);
+
+		/*
+		* Measures the quality of a transcoding route while it runs:
+		* on the encoding thread, each frame is added to meter as a reference before it's encoded,
+		* each packet is added to it before it's muxed, and it's finished after the encoder is drained.
+		* This slows the encoding thread by a decode and the measuring of each frame.
+		* 
+		* @param in_stream_ind the index of the input stream of the route.
+		* @param meter made for the route's encoder. I don't own it, and it must outlive the pipeline.
+		* @throws std::logic_error if run() has been called.
+		* @throws std::out_of_range if in_stream_ind is out of range.
+		* @throws std::invalid_argument if the input stream has no transcoding route.
+		*/
+		void set_quality_meter(int in_stream_ind, quality_meter& meter);
+
+		/*
+		* Measures the loudness of an audio transcoding route while it runs, so that no pass of its own is needed:
+		* on the encoding thread, each frame is fed to meter before it's encoded,
+		* and meter is signaled after the encoder is drained. Then its results are there when run() returns.
+		* 
+		* @param in_stream_ind the index of the input stream of the route.
+		* @param meter made for the sample rate and layout of the frames the route's encoder takes.
+		* I don't own it, and it must outlive the pipeline.
+		* @throws std::logic_error if run() has been called.
+		* @throws std::out_of_range if in_stream_ind is out of range.
+		* @throws std::invalid_argument if the input stream has no transcoding route.
+		*/
+		void set_loudness_meter(int in_stream_ind, loudness_meter& meter);
+
+		/*
+		* Runs the pipeline until everything is muxed and the muxer is finalized.
+		* A pipeline can only be run once.
+		* 
+		* @throws std::logic_error if it has been run or if it has no routes.
+		* @throws whatever the first failing stage throws.
+		*/
+		void run();
+
+		/*
+		* @returns how many packets have been muxed so far. Can be called from any thread.
+		*/
+		size_t num_muxed_packets() const noexcept { return num_muxed.load(std::memory_order_relaxed); }
+
+		/*
+		* @returns what the packets and frames are charged to.
+		*/
+		memory_budget& get_memory_budget() const noexcept { return *budget; }
+
+	private:
+		// A packet/frame with what it's charged.
+		template <typename T>
+		struct held
+		{
+			T item;
+			memory_budget::charge charge;
+		};
+
+		// What flows between decoding and encoding.
+		using frame_queue = bounded_queue<held<frame>>;
+		// What flows between demuxing and decoding, and into the muxer.
+		using packet_queue = bounded_queue<held<packet>>;
+
+		struct route
+		{
+			route(const stream& out, size_t queue_capacity)
+				: out_stream(out), packets(queue_capacity), decoded(queue_capacity), transformed(queue_capacity) {}
+
+			// nullptr for a copying route.
+			decoder* dec = nullptr;
+			encoder* enc = nullptr;
+			frame_transformer* trans = nullptr;
+			filter_graph* filter = nullptr;
+			quality_meter* meter = nullptr;
+			loudness_meter* loudness = nullptr;
+			stream out_stream;
+			// What the frames to encode are in if they don't say.
+			ff::rational frames_tb;
+			// From the frames' time base to the encoder's. Made when the first frame comes.
+			std::optional<time_rescaler> to_enc_tb;
+
+			packet_queue packets;
+			frame_queue decoded;
+			// Only used when has_transform_stage().
+			frame_queue transformed;
+
+			bool is_copy() const noexcept { return nullptr == dec; }
+			bool has_transform_stage() const noexcept { return nullptr != trans || nullptr != filter; }
+		};
+
+	private:
+		void demux_loop() noexcept;
+		void decode_loop(route& r) noexcept;
+		void transform_loop(route& r) noexcept;
+		void filter_loop(route& r) noexcept;
+		void encode_loop(route& r) noexcept;
+		void mux_loop();
+
+		/*
+		* Takes the frames out of the decoder until it's hungry (or empty if draining).
+		* @returns false if the pipeline is aborted.
+		*/
+		bool output_decoded(route& r);
+		/*
+		* Takes the frames out of the filter graph until it's hungry (or drained).
+		* @returns false if the pipeline is aborted.
+		*/
+		bool output_filtered(route& r);
+		/*
+		* Takes the packets out of the encoder until it's hungry (or empty if draining).
+		* @returns false if the pipeline is aborted.
+		*/
+		bool output_encoded(route& r);
+		/*
+		* Rescales the time of f into the time base of r's encoder. See the comments for the class.
+		*/
+		void internal_rescale_to_encoder(route& r, frame& f);
+
+		/*
+		* Records e if it's the first error and aborts every queue, so that all stages stop.
+		*/
+		void on_error(std::exception_ptr e) noexcept;
+
+		/*
+		* Called by each stage that pushes into to_mux when it has nothing more.
+		* The last one closes to_mux.
+		*/
+		void producer_done() noexcept;
+
+		/*
+		* Aborts all the queues and waits for all the threads.
+		*/
+		void stop_all() noexcept;
+
+		/*
+		* Charges what a stage after the demuxer makes, without waiting.
+		*/
+		template <typename T>
+		held<T> internal_hold(T&& item) noexcept
+		{
+			memory_budget::charge c = budget->force_acquire(item.memory_size());
+			return held<T>{ std::move(item), std::move(c) };
+		}
+
+		/*
+		* Checks what add_*_route() has in common.
+		*/
+		void internal_check_new_route(int in_stream_ind) const;
+
+	private:
+		demuxer* dem;
+		muxer* mux;
+		const size_t queue_capacity;
+
+		// Indexed by input stream. nullptr for streams without a route.
+		std::vector<std::unique_ptr<route>> routes;
+		packet_queue to_mux;
+
+		std::vector<std::thread> workers;
+		// How many stages still push into to_mux.
+		std::atomic<int> num_producers = 0;
+		std::atomic<size_t> num_muxed = 0;
+
+		memory_budget* budget;
+		// Set by on_error(), so that the demuxing stage stops waiting for the budget.
+		std::atomic<bool> aborted = false;
+
+		std::mutex error_mtx;
+		std::exception_ptr first_error;
+
+		bool has_run = false;
+	};
+}
@@ -0,0 +1,178 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "audio_reframer.h"
+#include "../util/ff_helpers.h"
+#include "../codec/encoder.h"
+
+extern "C"
+{
+#include <libavutil/audio_fifo.h>
+#include <libavutil/mathematics.h>
+#include <libavcodec/avcodec.h> // For accessing AVCodecContext.
+}
+
+#include <algorithm>
+#include <stdexcept>
+
+ff::audio_reframer::audio_reframer(const frame::data_properties& properties, int sample_rate)
+{
+	if (properties.v_or_a)
+	{
+		throw std::invalid_argument("The properties are not for audio.");
+	}
+	if (properties.num_samples <= 0)
+	{
+		throw std::invalid_argument("The frames must have > 0 samples.");
+	}
+	if (sample_rate <= 0)
+	{
+		throw std::invalid_argument("The sample rate must be > 0.");
+	}
+
+	fmt = (AVSampleFormat)properties.fmt;
+	layout = channel_layout(properties.ch_layout, false);
+	out_samples = properties.num_samples;
+	rate = sample_rate;
+
+	internal_allocate_fifo();
+}
+
+ff::audio_reframer::audio_reframer(const encoder& enc)
+{
+	if (!enc.ready())
+	{
+		throw std::logic_error("The encoder is not ready.");
+	}
+	if (!enc.is_audio())
+	{
+		throw std::invalid_argument("The encoder is not for audio.");
+	}
+	if (enc->frame_size <= 0)
+	{
+		throw std::invalid_argument("The encoder accepts frames of any size.");
+	}
+
+	fmt = enc->sample_fmt;
+	layout = channel_layout(enc->ch_layout, false);
+	out_samples = enc->frame_size;
+	rate = enc->sample_rate;
+
+	internal_allocate_fifo();
+}
+
+ff::audio_reframer::~audio_reframer()
+{
+	ffhelpers::safely_free_audio_fifo(&fifo);
+}
+
+void ff::audio_reframer::feed_frame(const frame& f)
+{
+	if (no_more_food)
+	{
+		throw std::logic_error("No more frames are supposed to be fed.");
+	}
+	if (!f.ready())
+	{
+		throw std::invalid_argument("The frame has no data.");
+	}
+	auto dp = f.get_data_properties();
+	if (dp.v_or_a || dp.fmt != fmt || dp.ch_layout != layout)
+	{
+		throw std::invalid_argument("The frame does not match the properties.");
+	}
+	// 0 means not set.
+	if (0 != f->sample_rate && rate != f->sample_rate)
+	{
+		throw std::invalid_argument("The frame does not match the sample rate.");
+	}
+
+	if (!pts_known && AV_NOPTS_VALUE != f->pts)
+	{
+		AVRational tb = f->time_base.num > 0 && f->time_base.den > 0 ?
+			f->time_base : AVRational{ 1, rate };
+		// The first buffered sample is before this frame's first.
+		next_pts = av_rescale_q(f->pts, tb, AVRational{ 1, rate }) - av_audio_fifo_size(fifo);
+		pts_known = true;
+	}
+
+	// It grows the fifo when needed.
+	int ret = av_audio_fifo_write(fifo, reinterpret_cast<void* const*>(f->extended_data), f->nb_samples);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error happened: Could not buffer the samples", ret);
+		}
+	}
+}
+
+ff::frame ff::audio_reframer::get_frame()
+{
+	const int buffered = av_audio_fifo_size(fifo);
+	if (0 == buffered || (buffered < out_samples && !no_more_food))
+	{
+		return frame(false);
+	}
+
+	const int n = std::min(buffered, out_samples);
+	// Always of out_samples, so that the pool reuses them.
+	frame f = pool.get_frame(frame::data_properties(fmt, out_samples, layout.av_ch_layout()));
+
+	int ret = av_audio_fifo_read(fifo, reinterpret_cast<void* const*>(f->extended_data), n);
+	if (ret < 0)
+	{
+		ON_FF_ERROR_WITH_CODE("Unexpected error happened: Could not read the buffered samples", ret);
+	}
+
+	f->nb_samples = n;
+	f->sample_rate = rate;
+	f->duration = n;
+	f->time_base = AVRational{ 1, rate };
+	if (pts_known)
+	{
+		f->pts = next_pts;
+		next_pts += n;
+	}
+
+	return f;
+}
+
+void ff::audio_reframer::reset() noexcept
+{
+	av_audio_fifo_reset(fifo);
+	pts_known = false;
+	no_more_food = false;
+}
+
+int ff::audio_reframer::buffered_samples() const noexcept
+{
+	return av_audio_fifo_size(fifo);
+}
+
+void ff::audio_reframer::internal_allocate_fifo()
+{
+	// Room for two frames first. It grows when needed.
+	fifo = av_audio_fifo_alloc(fmt, layout.av_ch_layout().nb_channels, 2 * out_samples);
+	if (nullptr == fifo)
+	{
+		throw std::bad_alloc();
+	}
+}
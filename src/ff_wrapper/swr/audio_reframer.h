@@ -0,0 +1,145 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class audio_reframer
+*/
+
+#include "../util/util.h"
+#include "../util/channel_layout.h"
+#include "../data/frame.h"
+#include "../data/frame_pool.h"
+
+extern "C"
+{
+#include <libavutil/samplefmt.h>
+}
+
+struct AVAudioFifo;
+
+namespace ff
+{
+	class encoder;
+
+	/*
+	* Cuts audio frames of any number of samples into frames of a fixed number of samples,
+	* which most audio encoders (e.g. AAC, Opus) require (AVCodecContext::frame_size).
+	* 
+	* The samples are buffered in an AVAudioFifo, which only grows when the frames you feed
+	* are larger than ever before, and the output frames come from a frame_pool,
+	* so a steady stream of frames doesn't allocate.
+	* 
+	* how to use:
+	*	1. feed_frame() the frames as they come (e.g. from an audio_transformer).
+	*	2. After each feeding, call get_frame() until it returns a DESTROYED frame.
+	*	3. After the last frame, call signal_no_more_food(), and get_frame() gives
+	*	what's left as a last, shorter frame.
+	* 
+	* Timestamps:
+	* If the first frame fed has pts, the output frames have contiguous pts after it,
+	* in the time base of 1 / sample rate (their time_base is set to that).
+	* The time base of the frames fed is taken from their time_base, or 1 / sample rate if they don't have one.
+	* 
+	* Invariants:
+	*	1. fifo != nullptr,
+	*	2. out_samples > 0, rate > 0.
+	*/
+	class FF_WRAPPER_API audio_reframer final
+	{
+	public:
+		audio_reframer() = delete;
+
+		/*
+		* @param properties the fmt and ch_layout of the frames, and, in num_samples,
+		* how many samples each output frame has.
+		* @param sample_rate the sample rate of the frames.
+		* @throws std::invalid_argument if properties is not for audio, if properties.num_samples <= 0,
+		* or if sample_rate <= 0.
+		*/
+		audio_reframer(const frame::data_properties& properties, int sample_rate);
+
+		/*
+		* Makes frames for the encoder.
+		* 
+		* @throws std::logic_error if enc is not ready.
+		* @throws std::invalid_argument if enc is not for audio, or if it accepts frames of any
+		* size (its frame_size is 0), in which case you don't need me.
+		*/
+		explicit audio_reframer(const encoder& enc);
+
+		audio_reframer(const audio_reframer&) = delete;
+		audio_reframer& operator=(const audio_reframer&) = delete;
+
+		~audio_reframer();
+
+	public:
+		/*
+		* Buffers the samples of f.
+		* 
+		* @throws std::invalid_argument if f does not match the properties.
+		* @throws std::logic_error if you have called signal_no_more_food().
+		*/
+		void feed_frame(const frame& f);
+
+		/*
+		* @returns a frame of frame_size() samples, or a shorter last one after signal_no_more_food();
+		* a DESTROYED frame if not enough samples are buffered.
+		*/
+		frame get_frame();
+
+		/*
+		* No more frames will be fed. get_frame() will give out the remaining samples.
+		*/
+		inline void signal_no_more_food() noexcept { no_more_food = true; }
+
+		/*
+		* Forgets all the buffered samples and the timestamps, so that I can be used again
+		* (e.g. after a seek).
+		*/
+		void reset() noexcept;
+
+		/*
+		* @returns how many samples are buffered.
+		*/
+		int buffered_samples() const noexcept;
+
+		inline int frame_size() const noexcept { return out_samples; }
+
+	private:
+		AVAudioFifo* fifo = nullptr;
+
+		AVSampleFormat fmt;
+		// A deep copy.
+		channel_layout layout;
+		int out_samples;
+		int rate;
+
+		// The pts of the first buffered sample, in 1 / rate. Only meaningful if pts_known.
+		int64_t next_pts = 0;
+		bool pts_known = false;
+		bool no_more_food = false;
+
+		// Where the output frames get their data.
+		frame_pool pool;
+
+	private:
+		/*
+		* Common piece of code among constructors.
+		*/
+		void internal_allocate_fifo();
+	};
+}
@@ -0,0 +1,238 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "audio_transformer.h"
+#include "../util/ff_helpers.h"
+#include "../codec/encoder.h"
+#include "../codec/decoder.h"
+
+extern "C"
+{
+#include <libswresample/swresample.h>
+#include <libavcodec/avcodec.h> // For accessing AVCodecContext.
+#include <libavutil/mathematics.h>
+}
+
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+ff::audio_transformer::audio_transformer
+(
+	const frame::data_properties& dst_properties, int dst_sample_rate,
+	const frame::data_properties& src_properties, int src_sample_rate
+)
+{
+	if (src_properties.v_or_a)
+	{
+		throw std::invalid_argument("The src properties are not for audio.");
+	}
+	if (dst_properties.v_or_a)
+	{
+		throw std::invalid_argument("The dst properties are not for audio.");
+	}
+	if (src_sample_rate <= 0 || dst_sample_rate <= 0)
+	{
+		throw std::invalid_argument("The sample rates must be > 0.");
+	}
+
+	src_fmt = (AVSampleFormat)src_properties.fmt;
+	dst_fmt = (AVSampleFormat)dst_properties.fmt;
+	src_layout = channel_layout(src_properties.ch_layout, false);
+	dst_layout = channel_layout(dst_properties.ch_layout, false);
+	src_rate = src_sample_rate;
+	dst_rate = dst_sample_rate;
+
+	internal_create_swr_context();
+}
+
+ff::audio_transformer::audio_transformer(const encoder& enc, const decoder& dec)
+{
+	if (!dec.ready())
+	{
+		throw std::logic_error("The decoder is not ready.");
+	}
+	if (!enc.ready())
+	{
+		throw std::logic_error("The encoder is not ready.");
+	}
+
+	if (!dec.is_audio())
+	{
+		throw std::invalid_argument("The decoder is not for audio.");
+	}
+	if (!enc.is_audio())
+	{
+		throw std::invalid_argument("The encoder is not for audio.");
+	}
+
+	src_fmt = dec->sample_fmt;
+	dst_fmt = enc->sample_fmt;
+	src_layout = channel_layout(dec->ch_layout, false);
+	dst_layout = channel_layout(enc->ch_layout, false);
+	src_rate = dec->sample_rate;
+	dst_rate = enc->sample_rate;
+
+	internal_create_swr_context();
+}
+
+ff::audio_transformer::~audio_transformer()
+{
+	ffhelpers::safely_free_swr_context(&swr_ctx);
+}
+
+ff::frame ff::audio_transformer::convert_frame(const ff::frame& src)
+{
+	if (!src.ready())
+	{
+		throw std::invalid_argument("Src has no data.");
+	}
+	auto sp = src.get_data_properties();
+	if (sp.v_or_a || sp.fmt != src_fmt || sp.ch_layout != src_layout)
+	{
+		throw std::invalid_argument("Src does not match the properties you gave at first.");
+	}
+	// 0 means not set.
+	if (0 != src->sample_rate && src_rate != src->sample_rate)
+	{
+		throw std::invalid_argument("Src does not match the sample rate you gave at first.");
+	}
+
+	int64_t src_pts = INT64_MIN;
+	if (AV_NOPTS_VALUE != src->pts)
+	{
+		AVRational tb = src->time_base.num > 0 && src->time_base.den > 0 ?
+			src->time_base : AVRational{ 1, src_rate };
+		// In the swr time base.
+		src_pts = av_rescale_q(src->pts, tb, AVRational{ 1, src_rate }) * dst_rate;
+		has_pts = true;
+	}
+
+	ff::frame dst = internal_convert
+	(
+		const_cast<const uint8_t**>(src->extended_data), src->nb_samples, src_pts
+	);
+
+	// Keep what swr has set.
+	const int64_t pts = dst->pts;
+	const int64_t duration = dst->duration;
+	frame::av_frame_copy_props(dst, src);
+	dst->pts = pts;
+	dst->duration = duration;
+	dst->sample_rate = dst_rate;
+	dst->time_base = AVRational{ 1, dst_rate };
+
+	return dst;
+}
+
+ff::frame ff::audio_transformer::flush()
+{
+	ff::frame dst = internal_convert(nullptr, 0, INT64_MIN);
+	if (0 == dst->nb_samples)
+	{
+		return ff::frame(false);
+	}
+	dst->time_base = AVRational{ 1, dst_rate };
+
+	return dst;
+}
+
+int64_t ff::audio_transformer::delay() const
+{
+	return swr_get_delay(swr_ctx, dst_rate);
+}
+
+void ff::audio_transformer::internal_create_swr_context()
+{
+	int ret = swr_alloc_set_opts2
+	(
+		&swr_ctx,
+		&dst_layout.av_ch_layout(), dst_fmt, dst_rate,
+		&src_layout.av_ch_layout(), src_fmt, src_rate,
+		0, nullptr
+	);
+	if (ret >= 0)
+	{
+		ret = swr_init(swr_ctx);
+	}
+
+	if (ret < 0)
+	{
+		ffhelpers::safely_free_swr_context(&swr_ctx);
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		case AVERROR(EINVAL):
+			throw std::domain_error("libswresample cannot perform the transformation.");
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error happened: Could not create a swr ctx", ret);
+		}
+	}
+}
+
+ff::frame ff::audio_transformer::internal_convert(const uint8_t** src_data, int num_samples, int64_t src_pts)
+{
+	// Must be called before swr_convert().
+	// Only when the src had pts; otherwise the predicted ones mean nothing.
+	const int64_t next_pts = has_pts ? swr_next_pts(swr_ctx, src_pts) : INT64_MIN;
+
+	// At most this many can come out.
+	int max_out = swr_get_out_samples(swr_ctx, num_samples);
+	if (max_out < 0)
+	{
+		ON_FF_ERROR_WITH_CODE("Unexpected error happened during transforming frames", max_out);
+	}
+
+	// swr_get_out_samples() differs from call to call, so the frames are always of dst_capacity,
+	// which is raised to the next power of 2 on the rare call that needs more.
+	if (max_out > dst_capacity)
+	{
+		int cap = std::max(dst_capacity, 1024);
+		while (cap < max_out)
+		{
+			cap = cap > INT_MAX / 2 ? max_out : cap * 2;
+		}
+		dst_capacity = cap;
+	}
+	ff::frame dst = dst_pool.get_frame
+	(
+		frame::data_properties(dst_fmt, dst_capacity, dst_layout.av_ch_layout())
+	);
+
+	int ret = swr_convert(swr_ctx, dst->extended_data, dst_capacity, src_data, num_samples);
+	if (ret < 0) // Failure
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error happened during transforming frames", ret);
+		}
+	}
+
+	dst->nb_samples = ret;
+	dst->sample_rate = dst_rate;
+	dst->duration = ret;
+	// From the swr time base to 1 / dst_rate.
+	dst->pts = INT64_MIN == next_pts ? AV_NOPTS_VALUE : next_pts / src_rate;
+
+	return dst;
+}
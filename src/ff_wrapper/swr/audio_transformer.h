@@ -0,0 +1,173 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class audio_transformer
+*/
+
+#include "../util/util.h"
+#include "../util/channel_layout.h"
+#include "../data/frame.h"
+#include "../data/frame_pool.h"
+
+extern "C"
+{
+#include <libavutil/samplefmt.h>
+}
+
+struct SwrContext;
+
+namespace ff
+{
+	class decoder;
+	class encoder;
+
+	/*
+	* Transforms an audio ff::frame in one or more of the following ways:
+	*	1. Changes the sample format of the frame (e.g. packed s16 to planar float).
+	*	2. Changes the sample rate of the frame.
+	*	3. Changes the channel layout of the frame (e.g. downmixes 5.1 to stereo).
+	* It's the audio counterpart of frame_transformer, built on libswresample,
+	* which has optimized (SIMD) paths for the common conversions.
+	* 
+	* An object of audio_transformer performs a fixed transformation.
+	* The transformation is defined by the arguments you give to one of its constructors.
+	* In the data_properties you give, only fmt and ch_layout matter; num_samples is ignored.
+	* 
+	* Unlike video, resampling keeps some samples inside (the delay of its filters),
+	* so a converted frame may have fewer samples than the source or even none.
+	* After you have converted the last source frame, call flush() for what's left.
+	* 
+	* Timestamps:
+	* If the src frames have pts, the dst frames have pts in the time base of 1 / the dst sample rate,
+	* and their time_base is set to that. The time base of the src is taken from their time_base,
+	* or 1 / the src sample rate if they don't have one.
+	* 
+	* Invariants:
+	*	1. swr_ctx != nullptr and is initialized,
+	*	2. src_rate, dst_rate > 0,
+	*	3. src_fmt and dst_fmt are valid.
+	*/
+	class FF_WRAPPER_API audio_transformer final
+	{
+	public:
+		// You must provide transformation information.
+		audio_transformer() = delete;
+
+		/*
+		* Performs such a transformation that transforms
+		* audio frames of src_properties at src_sample_rate to those of dst_properties at dst_sample_rate.
+		* 
+		* @throws std::invalid_argument if either src_properties or dst_properties
+		* is not for audio frames, or if either sample rate <= 0.
+		* @throws std::domain_error if libswresample cannot perform such a transformation.
+		*/
+		audio_transformer
+		(
+			const frame::data_properties& dst_properties, int dst_sample_rate,
+			const frame::data_properties& src_properties, int src_sample_rate
+		);
+
+		/*
+		* Performs such a transformation that transforms
+		* audio frames from decoder to audio frames into encoder.
+		*
+		* @throws std::invalid_argument if either decoder or encoder
+		* is not for audio.
+		* @throws std::logic_error if either decoder or encoder
+		* is not ready.
+		* @throws std::domain_error if libswresample cannot perform such a transformation.
+		*/
+		audio_transformer(const encoder& enc, const decoder& dec);
+
+		audio_transformer(const audio_transformer&) = delete;
+		audio_transformer& operator=(const audio_transformer&) = delete;
+
+		~audio_transformer();
+
+	public:
+		/*
+		* Converts src.
+		* The data of the dst frames come from a frame_pool of the transformer.
+		* 
+		* @param src the frame to be converted. src's properties will also be
+		* copied to it.
+		* @returns the dst frame converted. It may have 0 samples, as some 
+		* may be kept inside until more come.
+		* @throws std::invalid_argument if src does not match the properties you gave
+		* to a constructor.
+		*/
+		ff::frame convert_frame(const ff::frame& src);
+
+		/*
+		* Takes out the samples kept inside after the last src frame.
+		* 
+		* @returns a frame with what's left, or a DESTROYED frame if nothing is left.
+		*/
+		ff::frame flush();
+
+		/*
+		* @returns how many samples, at the dst sample rate, are kept inside now.
+		*/
+		int64_t delay() const;
+
+	public:
+		inline ff::frame::data_properties src_properties() const noexcept
+		{
+			return ff::frame::data_properties(src_fmt, 0, src_layout.av_ch_layout());
+		}
+		inline ff::frame::data_properties dst_properties() const noexcept
+		{
+			return ff::frame::data_properties(dst_fmt, 0, dst_layout.av_ch_layout());
+		}
+		inline int src_sample_rate() const noexcept { return src_rate; }
+		inline int dst_sample_rate() const noexcept { return dst_rate; }
+
+	private:
+		SwrContext* swr_ctx = nullptr;
+
+		// These are recorded to check if frames to be converted have the same properties.
+
+		AVSampleFormat src_fmt, dst_fmt;
+		// Deep copies.
+		channel_layout src_layout, dst_layout;
+		int src_rate, dst_rate;
+		// If any src frame has had pts, so that the dst frames should have them.
+		bool has_pts = false;
+
+		// Where the dst frames get their data.
+		frame_pool dst_pool;
+		// How many samples each dst frame from dst_pool can hold. Only grows,
+		// so that the pool keeps reusing frames of one size instead of making new ones per call.
+		int dst_capacity = 0;
+
+	private:
+		/*
+		* Common piece of code among constructors.
+		*/
+		void internal_create_swr_context();
+
+		/*
+		* Converts num_samples from src_data (nullptr to flush) into
+		* a frame from dst_pool.
+		* 
+		* @param src_pts the pts of the src in the swr time base (1 / (src_rate * dst_rate)),
+		* or INT64_MIN if not known.
+		*/
+		ff::frame internal_convert(const uint8_t** src_data, int num_samples, int64_t src_pts);
+	};
+}
@@ -0,0 +1,106 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "abr_transformer.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+ff::abr_transformer::abr_transformer
+(
+	const std::vector<frame::data_properties>& rungs,
+	const frame::data_properties& src_properties,
+	frame_transformer::algorithms algorithm,
+	int num_threads,
+	bool cascade
+)
+	: src_props(src_properties), rungs(rungs)
+{
+	if (rungs.empty())
+	{
+		throw std::invalid_argument("There must be at least one rung.");
+	}
+	if (!src_properties.v_or_a)
+	{
+		throw std::invalid_argument("The src properties are not for video.");
+	}
+	for (const auto& r : rungs)
+	{
+		if (!r.v_or_a)
+		{
+			throw std::invalid_argument("The rungs must be for video.");
+		}
+	}
+
+	// Larger rungs first, so that when a rung is planned,
+	// all the rungs it may be scaled from have been planned.
+	order.resize(rungs.size());
+	std::iota(order.begin(), order.end(), size_t(0));
+	std::stable_sort(order.begin(), order.end(),
+		[&rungs](size_t a, size_t b)
+		{
+			return (int64_t)rungs[a].width * rungs[a].height > (int64_t)rungs[b].width * rungs[b].height;
+		});
+
+	sources.assign(rungs.size(), -1);
+	transformers.resize(rungs.size());
+	for (size_t k = 0; k < order.size(); ++k)
+	{
+		const size_t i = order[k];
+		const auto& r = rungs[i];
+
+		if (cascade)
+		{
+			// The nearest larger one is the last one planned that is eligible.
+			for (size_t l = k; l-- > 0;)
+			{
+				const auto& c = rungs[order[l]];
+				if (c.width >= r.width && c.height >= r.height && c.fmt == r.fmt)
+				{
+					sources[i] = static_cast<int>(order[l]);
+					break;
+				}
+			}
+		}
+
+		const auto& from = -1 == sources[i] ? src_props : rungs[sources[i]];
+		transformers[i] = std::make_unique<frame_transformer>(r, from, algorithm, num_threads);
+	}
+}
+
+std::vector<ff::frame> ff::abr_transformer::convert_frame(const frame& src)
+{
+	std::vector<frame> dst;
+	convert_frame(dst, src);
+	return dst;
+}
+
+void ff::abr_transformer::convert_frame(std::vector<frame>& dst, const frame& src)
+{
+	if (src.get_data_properties() != src_props)
+	{
+		throw std::invalid_argument("Src does not match the properties you gave at first.");
+	}
+
+	dst.resize(rungs.size());
+	for (size_t i : order)
+	{
+		const frame& from = -1 == sources[i] ? src : dst[sources[i]];
+		// Each comes from the pool of its transformer.
+		dst[i] = transformers[i]->convert_frame(from);
+	}
+}
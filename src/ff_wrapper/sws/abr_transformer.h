@@ -0,0 +1,123 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class abr_transformer
+*/
+
+#include "../util/util.h"
+#include "../data/frame.h"
+#include "frame_transformer.h"
+
+#include <memory>
+#include <vector>
+
+namespace ff
+{
+	/*
+	* Transforms one video frame into several (e.g. the rungs of an HLS/DASH ABR ladder) at once.
+	* 
+	* Instead of scaling every rung from the source, which reads the full resolution
+	* source once per rung, I cascade: a rung is scaled from the nearest larger rung
+	* if quality allows, that is, if the larger rung
+	*	1. is at least as large in both width and height, and
+	*	2. has the same pixel format as the rung (so no chroma or depth is lost on the way).
+	* Otherwise, it is scaled from the source.
+	* You can also turn cascading off to scale every rung from the source.
+	* 
+	* Each rung has its own frame_transformer, so the output frames come from pools
+	* and are reused once you release them.
+	* 
+	* Invariants:
+	*	transformers.size() == rungs.size() == sources.size() > 0,
+	*	order lists the rungs so that each comes after its source.
+	*/
+	class FF_WRAPPER_API abr_transformer final
+	{
+	public:
+		abr_transformer() = delete;
+
+		/*
+		* @param rungs the properties of the frames to produce. They can be in any order.
+		* @param src_properties the properties of the frames to convert.
+		* @param algorithm the algorithm used for each scaling.
+		* @param num_threads how many threads each scaling uses, see frame_transformer.
+		* @param cascade whether to scale rungs from larger rungs when quality allows.
+		* @throws std::invalid_argument if rungs is empty,
+		* or if any of rungs or src_properties is not for video.
+		* @throws std::invalid_argument if num_threads < 0.
+		* @throws std::domain_error if any pixel format is not supported.
+		*/
+		abr_transformer
+		(
+			const std::vector<frame::data_properties>& rungs,
+			const frame::data_properties& src_properties,
+			frame_transformer::algorithms algorithm = frame_transformer::FF_SWS_BICUBIC,
+			int num_threads = 0,
+			bool cascade = true
+		);
+
+		abr_transformer(const abr_transformer&) = delete;
+		abr_transformer& operator=(const abr_transformer&) = delete;
+
+	public:
+		/*
+		* Converts src into every rung.
+		* 
+		* @param src the frame to be converted. Its properties are copied to every output.
+		* @returns one frame per rung, in the order you gave the rungs to the constructor.
+		* @throws std::invalid_argument if src does not match the src properties.
+		*/
+		std::vector<frame> convert_frame(const frame& src);
+
+		/*
+		* Converts src into every rung and writes the results to dst,
+		* so that the vector is reused.
+		* 
+		* @param dst will have one frame per rung, in the order you gave the rungs to the constructor.
+		* @param src the frame to be converted. Its properties are copied to every output.
+		* @throws std::invalid_argument if src does not match the src properties.
+		*/
+		void convert_frame(std::vector<frame>& dst, const frame& src);
+
+	public:
+		inline size_t num_rungs() const noexcept { return rungs.size(); }
+
+		/*
+		* @throws std::out_of_range if i >= num_rungs().
+		*/
+		const frame::data_properties& rung_properties(size_t i) const { return rungs.at(i); }
+
+		/*
+		* @returns the index of the rung rung i is scaled from, or -1 if it's scaled from the source.
+		* @throws std::out_of_range if i >= num_rungs().
+		*/
+		int source_of(size_t i) const { return sources.at(i); }
+
+		inline frame::data_properties src_properties() const noexcept { return src_props; }
+
+	private:
+		frame::data_properties src_props;
+		std::vector<frame::data_properties> rungs;
+
+		// transformers[i] converts sources[i] (or the source frame if -1) into rung i.
+		std::vector<std::unique_ptr<frame_transformer>> transformers;
+		std::vector<int> sources;
+		// The order in which the rungs are converted.
+		std::vector<size_t> order;
+	};
+}
@@ -0,0 +1,239 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "frame_rate_converter.h"
+
+extern "C"
+{
+#include <libavutil/common.h> // For AV_CEIL_RSHIFT
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	/*
+	* @returns true iff every component of fmt is 8 bits in memory that can be blended byte by byte.
+	*/
+	bool can_blend(AVPixelFormat fmt) noexcept
+	{
+		const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(fmt);
+		if (nullptr == desc || 0 == desc->nb_components ||
+			(desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_FLOAT)))
+		{
+			return false;
+		}
+		for (int i = 0; i < desc->nb_components; ++i)
+		{
+			if (8 != desc->comp[i].depth || 0 != desc->comp[i].shift)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+ff::frame_rate_converter::frame_rate_converter
+(
+	const frame::data_properties& properties,
+	ff::rational src_time_base, ff::rational dst_frame_rate,
+	modes mode
+)
+	: props(properties), src_tb(src_time_base), dst_rate(dst_frame_rate), mode(mode)
+{
+	if (!properties.v_or_a)
+	{
+		throw std::invalid_argument("The properties are not for video.");
+	}
+	if (src_time_base <= 0 || dst_frame_rate <= 0)
+	{
+		throw std::invalid_argument("The time base and the frame rate must be > 0.");
+	}
+	if (modes::blend == mode && !can_blend((AVPixelFormat)properties.fmt))
+	{
+		throw std::domain_error("Frames of the pixel format can't be blended.");
+	}
+
+	dst_tb = ff::rational(dst_rate.get_den(), dst_rate.get_num());
+	to_ticks = rational_64(src_tb.get_num(), src_tb.get_den()) * rational_64(dst_rate.get_num(), dst_rate.get_den());
+}
+
+void ff::frame_rate_converter::feed_frame(const frame& f)
+{
+	if (no_more_food)
+	{
+		throw std::logic_error("No more frames are supposed to be fed.");
+	}
+	if (!f.ready() || f.get_data_properties() != props)
+	{
+		throw std::invalid_argument("The frame does not match the properties.");
+	}
+	if (AV_NOPTS_VALUE == f->pts)
+	{
+		throw std::invalid_argument("The frame has no pts.");
+	}
+
+	++num_fed;
+
+	const rational_64 pos(to_ticks * f->pts);
+	if (started && pos <= last_pos)
+	{
+		++num_dropped;
+		return;
+	}
+	last_pos = pos;
+
+	if (!started)
+	{
+		next_tick = std::max<int64_t>(0, pos.to_int64());
+		started = true;
+	}
+
+	// A new reference, as f may be reused by whoever fed it.
+	held.push_back(held_frame{ f.shared_ref(), pos, pos.to_int64() });
+}
+
+ff::frame ff::frame_rate_converter::get_frame()
+{
+	while (!held.empty())
+	{
+		held_frame& a = held.front();
+
+		if (held.size() >= 2)
+		{
+			const held_frame& b = held[1];
+			// From b on, the ticks are b's.
+			const bool b_reached = modes::blend == mode ? b.pos <= next_tick : b.tick <= next_tick;
+			if (b_reached)
+			{
+				internal_pop_front();
+				continue;
+			}
+			return internal_emit(a, &b);
+		}
+
+		if (!no_more_food)
+		{
+			// Until the next frame comes, I can't know if a lasts till the next tick.
+			return frame(false);
+		}
+
+		// The last one lasts till its end, and at least a tick.
+		int64_t end_tick = a.tick + 1;
+		if (a.f->duration > 0)
+		{
+			end_tick = std::max(end_tick, (to_ticks * (a.f->pts + a.f->duration)).to_int64());
+		}
+		if (next_tick < end_tick)
+		{
+			return internal_emit(a, nullptr);
+		}
+		internal_pop_front();
+	}
+
+	return frame(false);
+}
+
+void ff::frame_rate_converter::reset() noexcept
+{
+	held.clear();
+	next_tick = 0;
+	started = false;
+	last_pos = zero_rational_64;
+	no_more_food = false;
+}
+
+ff::frame ff::frame_rate_converter::internal_emit(held_frame& a, const held_frame* b)
+{
+	frame out(false);
+	int weight = 0;
+	if (nullptr != b && modes::blend == mode && a.pos < next_tick)
+	{
+		// How far the tick is from a towards b, in 1/256.
+		const rational_64 w((rational_64(next_tick) - a.pos) / (b->pos - a.pos));
+		weight = static_cast<int>(std::clamp<int64_t>((w * (int64_t)256).to_int64(), 0, 256));
+	}
+
+	if (0 == weight)
+	{
+		out = a.f.shared_ref();
+		if (a.out)
+		{
+			++num_duplicated;
+		}
+		a.out = true;
+	}
+	else if (256 == weight)
+	{
+		// Rounds to b, which will go out at its own tick, too.
+		out = b->f.shared_ref();
+	}
+	else
+	{
+		out = internal_blend(a.f, b->f, weight);
+		++num_blended;
+	}
+
+	// Only the AVFrame of out is changed, not the frames fed.
+	out.reset_time(next_tick, dst_tb, 1);
+	++next_tick;
+	++num_output;
+	return out;
+}
+
+ff::frame ff::frame_rate_converter::internal_blend(const frame& a, const frame& b, int weight)
+{
+	frame out = pool.get_frame(props);
+
+	const AVPixelFormat fmt = (AVPixelFormat)props.fmt;
+	const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(fmt);
+	const int num_planes = av_pix_fmt_count_planes(fmt);
+	const int wa = 256 - weight;
+	for (int p = 0; p < num_planes; ++p)
+	{
+		// The same as av_image_copy() works them out.
+		const int row_bytes = av_image_get_linesize(fmt, props.width, p);
+		const int rows = (1 == p || 2 == p) ? AV_CEIL_RSHIFT(props.height, desc->log2_chroma_h) : props.height;
+
+		for (int y = 0; y < rows; ++y)
+		{
+			const uint8_t* ra = a->data[p] + (ptrdiff_t)y * a->linesize[p];
+			const uint8_t* rb = b->data[p] + (ptrdiff_t)y * b->linesize[p];
+			uint8_t* ro = out->data[p] + (ptrdiff_t)y * out->linesize[p];
+			// Simple enough for the compiler to vectorize.
+			for (int x = 0; x < row_bytes; ++x)
+			{
+				ro[x] = static_cast<uint8_t>((ra[x] * wa + rb[x] * weight + 128) >> 8);
+			}
+		}
+	}
+
+	frame::av_frame_copy_props(out, a);
+	return out;
+}
+
+void ff::frame_rate_converter::internal_pop_front() noexcept
+{
+	if (!held.front().out)
+	{
+		++num_dropped;
+	}
+	held.pop_front();
+}
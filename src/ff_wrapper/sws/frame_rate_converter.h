@@ -0,0 +1,194 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains the definition of class frame_rate_converter
+*/
+
+#include "../util/util.h"
+#include "../util/ff_math.h"
+#include "../data/frame.h"
+#include "../data/frame_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+namespace ff
+{
+	/*
+	* Conforms video frames of any timing (e.g. 59.94 fps, or variable) to a constant frame rate (e.g. 29.97 or 25 fps),
+	* deciding for each tick of the dst rate which frame goes there, from the timestamps only.
+	*
+	* In modes::duplicate_drop, each tick gets the last frame whose pts, rounded to the nearest tick, is not after it.
+	* So a frame is duplicated when the src is slower, and dropped when another frame rounds to the same tick.
+	* The frames given out are only new references to the frames fed (see frame::shared_ref()), with their time reset,
+	* so nothing is copied however many times a frame goes out.
+	*
+	* In modes::blend, a tick that falls between two frames gets the two blended by how close it is to each,
+	* which is smoother than duplicating but costs a pass over the pixels. Blended frames come from a frame_pool.
+	* Ticks that fall on a frame, or after the last one, still get a reference.
+	* Only formats whose components are all 8 bits (e.g. yuv420p, nv12, rgb24) can be blended.
+	*
+	* how to use:
+	*	1. feed_frame() the frames as they come (e.g. from a decoder).
+	*	2. After each feeding, call get_frame() until it returns a DESTROYED frame.
+	*	A frame can only go out once the next one is fed, as until then I can't know how long it lasts.
+	*	3. After the last frame, call signal_no_more_food(), and get_frame() gives
+	*	the last frame until its end (pts + duration, or one tick if it has no duration).
+	*
+	* Timestamps:
+	* The frames fed must have pts in the src time base you give to the constructor, and it's their pts that count,
+	* not their order. A frame whose pts is not after that of the previous one fed is dropped.
+	* The frames given out have pts of consecutive ticks in dst_time_base() (i.e. 1 / the dst rate),
+	* starting from the tick of the first frame fed (or 0 if that is negative), and a duration of 1.
+	*
+	* Invariants:
+	*	1. src_tb > 0, dst_rate > 0,
+	*	2. the frames in held are in increasing order of pos.
+	*/
+	class FF_WRAPPER_API frame_rate_converter final
+	{
+	public:
+		enum class modes
+		{
+			// Duplicates and drops references to the frames.
+			duplicate_drop,
+			// Blends the two frames around a tick that falls between them.
+			blend
+		};
+
+	public:
+		frame_rate_converter() = delete;
+
+		/*
+		* @param properties of the frames fed.
+		* @param src_time_base the time base of the pts of the frames fed.
+		* @param dst_frame_rate the constant frame rate to conform to, e.g. 30000/1001.
+		* @param mode see the comments for the class.
+		* @throws std::invalid_argument if properties is not for video, if src_time_base <= 0,
+		* or if dst_frame_rate <= 0.
+		* @throws std::domain_error if mode is modes::blend and the pixel format can't be blended.
+		*/
+		frame_rate_converter
+		(
+			const frame::data_properties& properties,
+			ff::rational src_time_base, ff::rational dst_frame_rate,
+			modes mode = modes::duplicate_drop
+		);
+
+		frame_rate_converter(const frame_rate_converter&) = delete;
+		frame_rate_converter& operator=(const frame_rate_converter&) = delete;
+
+	public:
+		/*
+		* Holds a reference to f until it has gone out, or has been dropped.
+		*
+		* @throws std::invalid_argument if f is not ready, does not match the properties, or has no pts.
+		* @throws std::logic_error if you have called signal_no_more_food().
+		*/
+		void feed_frame(const frame& f);
+
+		/*
+		* @returns the frame of the next tick; a DESTROYED frame if it can't be known yet,
+		* or if everything has gone out after signal_no_more_food().
+		*/
+		frame get_frame();
+
+		/*
+		* No more frames will be fed. get_frame() will give out the last frame until its end.
+		*/
+		inline void signal_no_more_food() noexcept { no_more_food = true; }
+
+		/*
+		* Forgets the frames held and the ticks, so that I can be used again (e.g. after a seek).
+		* The counts are kept.
+		*/
+		void reset() noexcept;
+
+	public:
+		inline modes get_mode() const noexcept { return mode; }
+		inline ff::rational dst_frame_rate() const noexcept { return dst_rate; }
+		// 1 / dst_frame_rate().
+		inline ff::rational dst_time_base() const noexcept { return dst_tb; }
+
+		// How many frames have been fed.
+		inline size_t number_fed() const noexcept { return num_fed; }
+		// How many frames have gone out, blended or not.
+		inline size_t number_output() const noexcept { return num_output; }
+		// How many frames fed never went out, except in a blend.
+		inline size_t number_dropped() const noexcept { return num_dropped; }
+		// How many times a frame went out again after its first time.
+		inline size_t number_duplicated() const noexcept { return num_duplicated; }
+		// How many frames went out blended.
+		inline size_t number_blended() const noexcept { return num_blended; }
+
+	private:
+		struct held_frame
+		{
+			frame f;
+			// Where its pts is on the dst ticks, exactly.
+			rational_64 pos;
+			// pos rounded to the nearest tick.
+			int64_t tick;
+			// Has it gone out, not counting blends.
+			bool out = false;
+		};
+
+		/*
+		* @returns a's frame for the next tick, or a and b blended if b is not nullptr and the tick falls between them.
+		*/
+		frame internal_emit(held_frame& a, const held_frame* b);
+
+		/*
+		* @returns a blend of a and b, weight / 256 of b.
+		*/
+		frame internal_blend(const frame& a, const frame& b, int weight);
+
+		/*
+		* Lets the front of held go, counting it as dropped if it never went out.
+		*/
+		void internal_pop_front() noexcept;
+
+	private:
+		frame::data_properties props;
+		ff::rational src_tb;
+		ff::rational dst_rate;
+		ff::rational dst_tb;
+		// src_tb / dst_tb, which takes a pts to its pos on the ticks.
+		rational_64 to_ticks;
+		modes mode;
+
+		// The frames that may still go out. Rarely more than two.
+		std::deque<held_frame> held;
+		// The tick of the next frame to go out.
+		int64_t next_tick = 0;
+		bool started = false;
+		// The pos of the last frame fed.
+		rational_64 last_pos;
+		bool no_more_food = false;
+
+		size_t num_fed = 0;
+		size_t num_output = 0;
+		size_t num_dropped = 0;
+		size_t num_duplicated = 0;
+		size_t num_blended = 0;
+
+		// Where the blended frames get their data.
+		frame_pool pool;
+	};
+}
@@ -18,18 +18,97 @@
 #include "../util/ff_helpers.h"
 #include "../codec/encoder.h"
 #include "../codec/decoder.h"
+#include "../filter/filter_graph.h"
 
 extern "C"
 {
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h> // For accessing AVCodecContext.
+#include <libavfilter/avfilter.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <stdexcept>
+
+namespace
+{
+	/*
+	* @returns true iff fmt is the pixel format of a hardware device.
+	*/
+	bool is_hw_pixel_format(AVPixelFormat fmt) noexcept
+	{
+		const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(fmt);
+		return nullptr != desc && (desc->flags & AV_PIX_FMT_FLAG_HWACCEL);
+	}
+
+	/*
+	* @returns the name of the filter that scales frames of the device whose pixel format is fmt;
+	* nullptr if I know none.
+	*/
+	const char* hw_scale_filter_name(AVPixelFormat fmt) noexcept
+	{
+		switch (fmt)
+		{
+		case AV_PIX_FMT_CUDA:
+			return "scale_cuda";
+		case AV_PIX_FMT_VAAPI:
+			return "scale_vaapi";
+		case AV_PIX_FMT_QSV:
+			return "vpp_qsv";
+		default:
+			return nullptr;
+		}
+	}
+
+	/*
+	* @returns the option of the filter that is nearest to algorithm, e.g. ":interp_algo=lanczos";
+	* empty if the filter's default is the nearest.
+	*/
+	std::string hw_scale_algorithm_option(AVPixelFormat fmt, ff::frame_transformer::algorithms algorithm)
+	{
+		switch (fmt)
+		{
+		case AV_PIX_FMT_CUDA:
+			switch (algorithm)
+			{
+			case ff::frame_transformer::FF_SWS_POINT:
+				return ":interp_algo=nearest";
+			case ff::frame_transformer::FF_SWS_FAST_BILINEAR:
+			case ff::frame_transformer::FF_SWS_BILINEAR:
+				return ":interp_algo=bilinear";
+			case ff::frame_transformer::FF_SWS_BICUBIC:
+				return ":interp_algo=bicubic";
+			case ff::frame_transformer::FF_SWS_LANCZOS:
+				return ":interp_algo=lanczos";
+			default:
+				return std::string();
+			}
+		case AV_PIX_FMT_VAAPI:
+			switch (algorithm)
+			{
+			case ff::frame_transformer::FF_SWS_POINT:
+			case ff::frame_transformer::FF_SWS_FAST_BILINEAR:
+				return ":mode=fast";
+			case ff::frame_transformer::FF_SWS_LANCZOS:
+			case ff::frame_transformer::FF_SWS_SPLINE:
+			case ff::frame_transformer::FF_SWS_SINC:
+				return ":mode=hq";
+			default:
+				return std::string();
+			}
+		default:
+			// vpp_qsv only chooses between low power and quality, which the driver knows better.
+			return std::string();
+		}
+	}
 }
 
 ff::frame_transformer::frame_transformer
 (
 	const frame::data_properties& dst_properties,
 	const frame::data_properties& src_properties,
-	algorithms algorithm
+	algorithms algorithm, int num_threads
 )
 {
 	if (!src_properties.v_or_a)
@@ -41,15 +120,51 @@ ff::frame_transformer::frame_transformer
 		throw std::invalid_argument("The dst properties are not for video.");
 	}
 
+	if (is_hw_pixel_format((AVPixelFormat)src_properties.fmt))
+	{
+		internal_create_hw_filters
+		(
+			dst_properties.width, dst_properties.height, (AVPixelFormat)dst_properties.fmt,
+			src_properties.width, src_properties.height, (AVPixelFormat)src_properties.fmt,
+			AV_PIX_FMT_NONE, algorithm, num_threads
+		);
+		return;
+	}
+
 	internal_create_sws_context
 	(
 		dst_properties.width, dst_properties.height, (AVPixelFormat)dst_properties.fmt,
 		src_properties.width, src_properties.height, (AVPixelFormat)src_properties.fmt,
-		algorithm
+		algorithm, num_threads
+	);
+}
+
+ff::frame_transformer::frame_transformer
+(
+	const frame::data_properties& dst_properties,
+	const frame::data_properties& src_properties,
+	AVPixelFormat dst_sw_format,
+	algorithms algorithm, int num_threads
+)
+{
+	if (!src_properties.v_or_a)
+	{
+		throw std::invalid_argument("The src properties are not for video.");
+	}
+	if (!dst_properties.v_or_a)
+	{
+		throw std::invalid_argument("The dst properties are not for video.");
+	}
+
+	internal_create_hw_filters
+	(
+		dst_properties.width, dst_properties.height, (AVPixelFormat)dst_properties.fmt,
+		src_properties.width, src_properties.height, (AVPixelFormat)src_properties.fmt,
+		dst_sw_format, algorithm, num_threads
 	);
 }
 
-ff::frame_transformer::frame_transformer(const encoder& enc, const decoder& dec, algorithms algorithm)
+ff::frame_transformer::frame_transformer(const encoder& enc, const decoder& dec, algorithms algorithm, int num_threads)
 {
 	if (!dec.ready())
 	{
@@ -69,11 +184,23 @@ ff::frame_transformer::frame_transformer(const encoder& enc, const decoder& dec,
 		throw std::invalid_argument("The encoder is not for video.");
 	}
 
+	if (is_hw_pixel_format(dec->pix_fmt))
+	{
+		// The encoder takes frames on the device, too, laid out in its sw_pix_fmt.
+		internal_create_hw_filters
+		(
+			enc->width, enc->height, enc->pix_fmt,
+			dec->width, dec->height, dec->pix_fmt,
+			enc->sw_pix_fmt, algorithm, num_threads
+		);
+		return;
+	}
+
 	internal_create_sws_context
 	(
 		enc->width, enc->height, enc->pix_fmt,
 		dec->width, dec->height, dec->pix_fmt,
-		algorithm
+		algorithm, num_threads
 	);
 }
 
@@ -81,14 +208,25 @@ ff::frame_transformer::frame_transformer
 (
 	int dst_w, int dst_h, AVPixelFormat dst_fmt, 
 	int src_w, int src_h, AVPixelFormat src_fmt, 
-	algorithms algorithm
+	algorithms algorithm, int num_threads
 )
 {
+	if (is_hw_pixel_format(src_fmt))
+	{
+		internal_create_hw_filters
+		(
+			dst_w, dst_h, dst_fmt,
+			src_w, src_h, src_fmt,
+			AV_PIX_FMT_NONE, algorithm, num_threads
+		);
+		return;
+	}
+
 	internal_create_sws_context
 	(
 		dst_w, dst_h, dst_fmt,
 		src_w, src_h, src_fmt,
-		algorithm
+		algorithm, num_threads
 	);
 }
 
@@ -104,31 +242,17 @@ ff::frame ff::frame_transformer::convert_frame(const ff::frame& src)
 		throw std::invalid_argument("Src does not match the properties you gave at first.");
 	}
 
-	ff::frame dst(true);
-	dst.allocate_data(dst_properties());
-
-	// I don't know what sws_scale_frame does exactly,
-	// so I use this just to be safe.
-	int ret = sws_scale
-	(
-		sws_ctx, 
-		src->data, src->linesize,
-		0, src->height,
-		dst->data, dst->linesize
-	);
-
-	if (ret < 0) // Failure
+	if (hardware())
 	{
-		switch (ret)
-		{
-		case AVERROR(ENOMEM):
-			throw std::bad_alloc();
-			break;
-		default:
-			ON_FF_ERROR_WITH_CODE("Unexpected error happened during transforming frames", ret);
-		}
+		ff::frame dst(true);
+		internal_hw_scale(dst, src);
+		return dst;
 	}
 
+	ff::frame dst = dst_pool.get_frame(dst_properties());
+
+	internal_scale(dst.av_frame(), src.av_frame());
+
 	// Copy src's properties to dst
 	frame::av_frame_copy_props(dst, src);
 
@@ -142,6 +266,16 @@ void ff::frame_transformer::convert_frame(ff::frame& dst, const ff::frame& src)
 		throw std::invalid_argument("Src does not match the properties you gave at first.");
 	}
 
+	if (hardware())
+	{
+		if (dst.ready() && dst.get_data_properties() != dst_properties())
+		{
+			throw std::invalid_argument("Dst does not match the properties you gave at first.");
+		}
+		internal_hw_scale(dst, src);
+		return;
+	}
+
 	if (dst.destroyed())
 	{
 		dst.allocate_object_memory();
@@ -159,18 +293,7 @@ void ff::frame_transformer::convert_frame(ff::frame& dst, const ff::frame& src)
 		}
 	}
 
-	int ret = sws_scale_frame(sws_ctx, dst.av_frame(), src.av_frame());
-	if (ret < 0) // Failure
-	{
-		switch (ret)
-		{
-		case AVERROR(ENOMEM):
-			throw std::bad_alloc();
-			break;
-		default:
-			ON_FF_ERROR_WITH_CODE("Unexpected error happened during transforming frames", ret);
-		}
-	}
+	internal_scale(dst.av_frame(), src.av_frame());
 
 	// Copy src's properties to dst
 	frame::av_frame_copy_props(dst, src);
@@ -188,11 +311,17 @@ bool ff::frame_transformer::query_output_pixel_format_support(AVPixelFormat fmt)
 	return 0 != sws_isSupportedOutput(fmt);
 }
 
+bool ff::frame_transformer::query_hardware_pixel_format_support(AVPixelFormat fmt)
+{
+	const char* name = hw_scale_filter_name(fmt);
+	return nullptr != name && nullptr != avfilter_get_by_name(name);
+}
+
 void ff::frame_transformer::internal_create_sws_context
 (
 	int dst_w, int dst_h, AVPixelFormat dst_fmt, 
 	int src_w, int src_h, AVPixelFormat src_fmt, 
-	algorithms algorithm
+	algorithms algorithm, int num_threads
 )
 {
 	if (!query_input_pixel_format_support((AVPixelFormat)src_fmt))
@@ -204,17 +333,116 @@ void ff::frame_transformer::internal_create_sws_context
 		throw std::domain_error("The output pixel format is not supported.");
 	}
 
-	sws_ctx = sws_getContext
-	(
-		src_w, src_h, src_fmt,
-		dst_w, dst_h, dst_fmt,
-		(int)algorithm,
-		nullptr, nullptr, nullptr
-	);
+	if (num_threads < 0)
+	{
+		throw std::invalid_argument("The number of threads cannot be negative.");
+	}
 
+	// sws_getContext() cannot take the number of threads,
+	// so set everything through the options.
+	sws_ctx = sws_alloc_context();
 	if (!sws_ctx)
 	{
-		throw std::runtime_error("Unexpected error happened: Could not create a sws ctx.");
+		throw std::bad_alloc();
+	}
+
+	int ret = 0;
+	if
+	(
+		(ret = av_opt_set_int(sws_ctx, "srcw", src_w, 0)) < 0 ||
+		(ret = av_opt_set_int(sws_ctx, "srch", src_h, 0)) < 0 ||
+		(ret = av_opt_set_int(sws_ctx, "src_format", src_fmt, 0)) < 0 ||
+		(ret = av_opt_set_int(sws_ctx, "dstw", dst_w, 0)) < 0 ||
+		(ret = av_opt_set_int(sws_ctx, "dsth", dst_h, 0)) < 0 ||
+		(ret = av_opt_set_int(sws_ctx, "dst_format", dst_fmt, 0)) < 0 ||
+		(ret = av_opt_set_int(sws_ctx, "sws_flags", (int)algorithm, 0)) < 0 ||
+		(ret = av_opt_set_int(sws_ctx, "threads", num_threads, 0)) < 0 ||
+		(ret = sws_init_context(sws_ctx, nullptr, nullptr)) < 0
+	)
+	{
+		ffhelpers::safely_free_sws_context(&sws_ctx);
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error happened: Could not create a sws ctx", ret);
+		}
+	}
+
+	this->src_w = src_w;
+	this->src_h = src_h;
+	this->dst_w = dst_w;
+	this->dst_h = dst_h;
+	this->src_fmt = src_fmt;
+	this->dst_fmt = dst_fmt;
+	this->num_threads = num_threads;
+}
+
+void ff::frame_transformer::internal_scale(AVFrame* dst, const AVFrame* src)
+{
+	FF_METRICS_SAMPLE(metrics_probe, 0);
+
+	// dst has its data, so sws_scale_frame() writes into it instead of allocating.
+	// Unlike sws_scale(), it scales the slices on the threads of the context.
+	int ret = sws_scale_frame(sws_ctx, dst, src);
+	if (ret < 0) // Failure
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Unexpected error happened during transforming frames", ret);
+		}
+	}
+
+	FF_METRICS_ADD(1, 0);
+}
+
+void ff::frame_transformer::internal_create_hw_filters
+(
+	int dst_w, int dst_h, AVPixelFormat dst_fmt,
+	int src_w, int src_h, AVPixelFormat src_fmt,
+	AVPixelFormat dst_sw_fmt, algorithms algorithm, int num_threads
+)
+{
+	if (!query_hardware_pixel_format_support(src_fmt))
+	{
+		throw std::domain_error("The input pixel format is not of a hardware device supported.");
+	}
+	if (dst_fmt != src_fmt)
+	{
+		throw std::domain_error("Hardware frames can only be transformed into frames on the same device.");
+	}
+	if (AV_PIX_FMT_NONE != dst_sw_fmt && (nullptr == av_get_pix_fmt_name(dst_sw_fmt) || is_hw_pixel_format(dst_sw_fmt)))
+	{
+		throw std::domain_error("The output sw format is not a software pixel format.");
+	}
+
+	if (num_threads < 0)
+	{
+		throw std::invalid_argument("The number of threads cannot be negative.");
+	}
+	if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0)
+	{
+		throw std::invalid_argument("The sizes must be > 0.");
+	}
+
+	// e.g. scale_cuda=w=1280:h=720:format=yuv420p:interp_algo=bicubic
+	hw_filters = std::string(hw_scale_filter_name(src_fmt))
+		+ "=w=" + std::to_string(dst_w) + ":h=" + std::to_string(dst_h);
+	if (AV_PIX_FMT_NONE != dst_sw_fmt)
+	{
+		hw_filters += std::string(":format=") + av_get_pix_fmt_name(dst_sw_fmt);
+	}
+	hw_filters += hw_scale_algorithm_option(src_fmt, algorithm);
+	// vpp_qsv keeps up to 4 frames in flight by default, which would leave me with no frame to give back.
+	if (AV_PIX_FMT_QSV == src_fmt)
+	{
+		hw_filters += ":async_depth=1";
 	}
 
 	this->src_w = src_w;
@@ -223,4 +451,45 @@ void ff::frame_transformer::internal_create_sws_context
 	this->dst_h = dst_h;
 	this->src_fmt = src_fmt;
 	this->dst_fmt = dst_fmt;
+	this->dst_sw_fmt = dst_sw_fmt;
+	this->num_threads = num_threads;
+}
+
+void ff::frame_transformer::internal_hw_scale(frame& dst, const frame& src)
+{
+	if (!src.is_hardware())
+	{
+		throw std::invalid_argument("Src is not a hardware frame.");
+	}
+
+	FF_METRICS_SAMPLE(metrics_probe, 0);
+
+	// The graph is bound to the device and the frames pool of the frames it was set up with.
+	if (!hw_graph || hw_frames_data != src->hw_frames_ctx->data)
+	{
+		hw_graph.reset();
+		try
+		{
+			// The time doesn't matter, as src's properties are copied to dst anyway.
+			hw_graph = std::make_unique<filter_graph>(hw_filters, src, ff::rational(1, AV_TIME_BASE), num_threads);
+		}
+		catch (const std::invalid_argument&)
+		{
+			// The frames are right, so it's the device that can't do it (e.g. a format it can't convert to).
+			throw std::domain_error("The device cannot scale or convert the frames as asked.");
+		}
+		hw_frames_data = src->hw_frames_ctx->data;
+	}
+
+	hw_graph->feed_frame(src);
+	// scale_cuda and scale_vaapi give out a frame for each one fed, and so does vpp_qsv with async_depth=1.
+	if (!hw_graph->filter_frame(dst))
+	{
+		throw std::runtime_error("The device gave no frame.");
+	}
+
+	// Copy src's properties to dst
+	frame::av_frame_copy_props(dst, src);
+
+	FF_METRICS_ADD(1, 0);
 }
@@ -21,6 +21,11 @@
 
 #include "../util/util.h"
 #include "../data/frame.h"
+#include "../data/frame_pool.h"
+#include "../util/metrics.h"
+
+#include <memory>
+#include <string>
 
 struct SwsContext;
 
@@ -28,6 +33,7 @@ namespace ff
 {
 	class decoder;
 	class encoder;
+	class filter_graph;
 
 	/*
 	* Transforms a video ff::frame in one or more of the following ways:
@@ -37,8 +43,25 @@ namespace ff
 	* An object of frame_transformer performs a fixed transformation.
 	* The transformation is defined by the arguments you give to one of its constructors.
 	* 
+	* Threading:
+	* Each frame is cut into horizontal slices that are scaled on num_threads threads at once,
+	* num_threads being what you give to a constructor.
+	* 0 (the default) lets FFmpeg decide (usually as many as the CPU has cores), and 1 uses only the calling thread.
+	* When many transformers run at once (e.g. one per rung of an ABR ladder),
+	* give each fewer threads so that they don't fight for the cores.
+	* 
+	* Hardware frames:
+	* If the src pixel format is that of a hardware device (e.g. AV_PIX_FMT_CUDA for frames a decoder decoded
+	* on a GPU), then the frames are scaled and converted on the device by its scaling filter
+	* (scale_cuda, scale_vaapi, or vpp_qsv) instead of by libswscale, so they never leave the device's memory.
+	* The dst pixel format must then be the same, and how the dst data are laid out on the device
+	* can be given as dst_sw_format (see the constructor). The algorithm is mapped to the filter's nearest one.
+	* The filter is set up at the first frame converted, as it needs the device and the frames pool of the frame.
+	* The dst frames come from the filter's pool on the device, instead of a frame_pool.
+	* query_hardware_pixel_format_support() tells if a device's pixel format is supported.
+	* 
 	* Invariants: 
-		1. sws_ctx != nullptr,
+		1. sws_ctx != nullptr, unless the transformer is for hardware frames, in which case hw_filters is not empty,
 		2. src_w, src_h, dst_w, dst_h > 0,
 		3. src_fmt and dst_fmt are supported.
 	*/
@@ -75,6 +98,8 @@ namespace ff
 		* 
 		* @throws std::invalid_argument if either src_properties or dst_properties
 		* is not for video frames.
+		* @param num_threads see the comments for the class.
+		* @throws std::invalid_argument if num_threads < 0.
 		* @throws std::domain_error if either src's pixel format is not supported as input
 		* or dst's pixel format is not supported as output.
 		* You can query if a pixel format is supported as input/output by calling
@@ -85,7 +110,8 @@ namespace ff
 			const frame::data_properties& dst_properties,
 			const frame::data_properties& src_properties,
 			// bicubic is widely applicable and has good performance.
-			algorithms algorithm = FF_SWS_BICUBIC 
+			algorithms algorithm = FF_SWS_BICUBIC,
+			int num_threads = 0
 		);
 
 		/*
@@ -96,6 +122,8 @@ namespace ff
 		* is not for video.
 		* @throws std::logic_error if either decoder or encoder
 		* is not ready.
+		* @param num_threads see the comments for the class.
+		* @throws std::invalid_argument if num_threads < 0.
 		* @throws std::domain_error if either decoder's pixel format is not supported as input
 		* or encoder's pixel format is not supported as output.
 		* You can query if a pixel format is supported as input/output by calling
@@ -106,7 +134,8 @@ namespace ff
 			const encoder& enc,
 			const decoder& dec,
 			// bicubic is widely applicable and has good performance.
-			algorithms algorithm = FF_SWS_BICUBIC
+			algorithms algorithm = FF_SWS_BICUBIC,
+			int num_threads = 0
 		);
 
 		/*
@@ -115,6 +144,8 @@ namespace ff
 		*
 		* @throws std::invalid_argument if either decoder or encoder
 		* is not for video.
+		* @param num_threads see the comments for the class.
+		* @throws std::invalid_argument if num_threads < 0.
 		* @throws std::domain_error if either decoder's pixel format is not supported as input
 		* or encoder's pixel format is not supported as output.
 		* You can query if a pixel format is supported as input/output by calling
@@ -125,7 +156,31 @@ namespace ff
 			int dst_w, int dst_h, AVPixelFormat dst_fmt,
 			int src_w, int src_h, AVPixelFormat src_fmt,
 			// bicubic is widely applicable and has good performance.
-			algorithms algorithm = FF_SWS_BICUBIC
+			algorithms algorithm = FF_SWS_BICUBIC,
+			int num_threads = 0
+		);
+
+		/*
+		* Performs such a transformation that transforms hardware frames of src_properties
+		* to hardware frames of dst_properties on the same device, whose data are laid out in dst_sw_format.
+		* See the comments for the class.
+		* 
+		* @param dst_sw_format e.g. AV_PIX_FMT_NV12 or AV_PIX_FMT_YUV420P.
+		* AV_PIX_FMT_NONE to keep that of the src frames.
+		* @throws std::invalid_argument if either src_properties or dst_properties
+		* is not for video.
+		* @param num_threads see the comments for the class.
+		* @throws std::invalid_argument if num_threads < 0.
+		* @throws std::domain_error if src's pixel format is not that of a hardware device supported,
+		* or if dst's pixel format is not the same.
+		*/
+		frame_transformer
+		(
+			const frame::data_properties& dst_properties,
+			const frame::data_properties& src_properties,
+			AVPixelFormat dst_sw_format,
+			algorithms algorithm = FF_SWS_BICUBIC,
+			int num_threads = 0
 		);
 
 		~frame_transformer();
@@ -133,12 +188,16 @@ namespace ff
 	public:
 		/*
 		* Converts src.
+		* The data of the dst frames come from a frame_pool of the transformer,
+		* so that converting many frames doesn't allocate memory for each.
 		* 
 		* @param src the frame to be converted. src's properties will also be 
 		* copied to it.
 		* @returns the dst frame converted.
 		* @throws std::invalid_argument if src does not match the properties you gave
 		* to a constructor.
+		* @throws std::domain_error if the transformer is for hardware frames,
+		* and the device cannot scale or convert src as asked.
 		*/
 		ff::frame convert_frame(const ff::frame& src);
 
@@ -149,8 +208,11 @@ namespace ff
 		* @param dst the frame where the result will be contained in. If dst is destroyed()
 		* or created(), then it will be made ready with the dst properties. 
 		* src's properties will also be copied to it.
+		* For hardware frames, dst references the data the device gives, instead of its data being written to.
 		* @throws std::invalid_argument if src/dst does not match the properties you gave
 		* to a constructor.
+		* @throws std::domain_error if the transformer is for hardware frames,
+		* and the device cannot scale or convert src as asked.
 		*/
 		void convert_frame(ff::frame& dst, const ff::frame& src);
 
@@ -163,6 +225,22 @@ namespace ff
 		{
 			return ff::frame::data_properties(dst_fmt, dst_w, dst_h);
 		}
+
+		/*
+		* @returns the number of threads you gave to the constructor. 0 means FFmpeg decides.
+		*/
+		inline int get_num_threads() const noexcept { return num_threads; }
+
+		/*
+		* @returns true iff the transformer is for hardware frames. See the comments for the class.
+		*/
+		inline bool hardware() const noexcept { return !hw_filters.empty(); }
+
+		/*
+		* @returns how the dst data are laid out on the device. AV_PIX_FMT_NONE if it's the same as the src,
+		* or if the transformer is not for hardware frames.
+		*/
+		inline AVPixelFormat get_dst_sw_format() const noexcept { return dst_sw_fmt; }
 		
 	public:
 		// @returns true iff fmt is supported as an input pixel format
@@ -171,14 +249,36 @@ namespace ff
 		// @returns true iff fmt is supported as an output pixel format
 		static bool query_output_pixel_format_support(AVPixelFormat fmt);
 
+		// @returns true iff fmt is the pixel format of a hardware device
+		// whose frames can be scaled on the device by this build of FFmpeg
+		static bool query_hardware_pixel_format_support(AVPixelFormat fmt);
+
 	private:
-		SwsContext* sws_ctx;
+		SwsContext* sws_ctx = nullptr;
 
 		// These are recorded to check if frames to be converted have the same properties.
 
 		int src_w, src_h;
 		int dst_w, dst_h;
 		AVPixelFormat src_fmt, dst_fmt;
+		int num_threads;
+
+		// For hardware frames only.
+		AVPixelFormat dst_sw_fmt = AV_PIX_FMT_NONE;
+		// The description of the filter that scales on the device. Empty if not for hardware frames.
+		std::string hw_filters;
+		// Set up at the first frame, and again whenever the frames come from another pool.
+		std::unique_ptr<filter_graph> hw_graph;
+		// The data of the AVHWFramesContext that hw_graph was set up with. Only compared.
+		const void* hw_frames_data = nullptr;
+
+		// Where the dst frames returned by convert_frame(src) get their data.
+		frame_pool dst_pool;
+
+#ifdef FF_WRAPPER_ENABLE_METRICS
+		// Stages: convert_frame. See metrics.h.
+		metrics::probe metrics_probe{ "frame_transformer", { "convert_frame" } };
+#endif // FF_WRAPPER_ENABLE_METRICS
 
 	private:
 		/*
@@ -188,7 +288,29 @@ namespace ff
 		(
 			int dst_w, int dst_h, AVPixelFormat dst_fmt,
 			int src_w, int src_h, AVPixelFormat src_fmt,
-			algorithms algorithm
+			algorithms algorithm, int num_threads
+		);
+
+		/*
+		* Common piece of code of the constructors for hardware frames.
+		*/
+		void internal_create_hw_filters
+		(
+			int dst_w, int dst_h, AVPixelFormat dst_fmt,
+			int src_w, int src_h, AVPixelFormat src_fmt,
+			AVPixelFormat dst_sw_fmt, algorithms algorithm, int num_threads
 		);
+
+		/*
+		* Scales src into dst, whose data must have been allocated.
+		* Threads are only used through sws_scale_frame(), so both versions of convert_frame() call this.
+		*/
+		void internal_scale(AVFrame* dst, const AVFrame* src);
+
+		/*
+		* Scales the hardware frame src on its device.
+		* dst is made ready with what the device gives.
+		*/
+		void internal_hw_scale(frame& dst, const frame& src);
 	};
 }
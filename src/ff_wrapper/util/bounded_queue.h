@@ -0,0 +1,194 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* bounded_queue.h:
+* Defines a bounded blocking queue that can be closed.
+* 
+* Header only.
+*/
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace ff
+{
+	/*
+	* A bounded queue that any number of threads can push to and pop from.
+	* push() waits while it's full and pop() waits while it's empty,
+	* which is how a fast producer is held back by a slow consumer.
+	* 
+	* When producers have nothing more to push, close() it,
+	* and consumers pop what's left until pop() returns false.
+	* When something goes wrong, abort() it, which also discards what's left
+	* so that everyone waiting on it returns immediately.
+	* 
+	* No need to be DLL imported/exported, because this is a template
+	* and header only.
+	* 
+	* Invariants:
+	*	items.size() <= max_size,
+	*	aborted -> closed && items.empty().
+	*/
+	template <typename T>
+	class bounded_queue final
+	{
+	public:
+		/*
+		* @param capacity at most how many elements can be queued.
+		* @throws std::invalid_argument if capacity is 0.
+		*/
+		explicit bounded_queue(size_t capacity)
+			: max_size(capacity)
+		{
+			if (0 == capacity)
+			{
+				throw std::invalid_argument("The capacity must be > 0.");
+			}
+		}
+
+		bounded_queue(const bounded_queue&) = delete;
+		bounded_queue& operator=(const bounded_queue&) = delete;
+
+	public:
+		/*
+		* Moves v into the queue. Waits while the queue is full.
+		* 
+		* @returns true if v has been queued; false if the queue has been closed, and v is untouched.
+		*/
+		bool push(T&& v)
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			not_full.wait(lock, [this] { return closed || items.size() < max_size; });
+			if (closed)
+			{
+				return false;
+			}
+
+			items.push_back(std::move(v));
+			lock.unlock();
+			not_empty.notify_one();
+			return true;
+		}
+
+		/*
+		* Moves v into the queue if there's room, without waiting.
+		*
+		* @returns true if v has been queued; false if the queue is full or has been closed, and v is untouched.
+		*/
+		bool try_push(T&& v)
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			if (closed || items.size() >= max_size)
+			{
+				return false;
+			}
+
+			items.push_back(std::move(v));
+			lock.unlock();
+			not_empty.notify_one();
+			return true;
+		}
+
+		/*
+		* Moves the element at the front to out and removes it. Waits while the queue is empty.
+		* 
+		* @returns true if an element has been moved to out; false if the queue has been closed
+		* and nothing is left, or if it has been aborted.
+		*/
+		bool pop(T& out)
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			not_empty.wait(lock, [this] { return closed || !items.empty(); });
+			if (items.empty())
+			{
+				return false;
+			}
+
+			out = std::move(items.front());
+			items.pop_front();
+			lock.unlock();
+			not_full.notify_one();
+			return true;
+		}
+
+		/*
+		* No more elements can be pushed after this.
+		* The elements already queued can still be popped.
+		*/
+		void close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				closed = true;
+			}
+			not_full.notify_all();
+			not_empty.notify_all();
+		}
+
+		/*
+		* Closes the queue and discards everything in it.
+		*/
+		void abort()
+		{
+			std::deque<T> discarded;
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				closed = true;
+				aborted = true;
+				discarded.swap(items);
+			}
+			not_full.notify_all();
+			not_empty.notify_all();
+			// Elements are destroyed here, outside of the lock.
+		}
+
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return items.size();
+		}
+
+		bool is_closed() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return closed;
+		}
+
+		bool is_aborted() const
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			return aborted;
+		}
+
+		size_t capacity() const noexcept { return max_size; }
+
+	private:
+		const size_t max_size;
+
+		mutable std::mutex mtx;
+		std::condition_variable not_full;
+		std::condition_variable not_empty;
+		std::deque<T> items;
+		bool closed = false;
+		bool aborted = false;
+	};
+}
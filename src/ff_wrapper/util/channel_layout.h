@@ -233,6 +233,16 @@ namespace ff
 		const AVChannelLayout& av_ch_layout() { return *p_cl; }
 		const AVChannelLayout& av_ch_layout() const { return *p_cl; }
 
+		int num_channels() const noexcept { return p_cl->nb_channels; }
+		/*
+		* @returns which channel (e.g. AV_CHAN_FRONT_LEFT) is at index i. AV_CHAN_NONE if i is out of range
+		* or if the order doesn't tell.
+		*/
+		AVChannel channel_at(int i) const noexcept
+		{
+			return i < 0 ? AV_CHAN_NONE : av_channel_layout_channel_from_index(p_cl, static_cast<unsigned>(i));
+		}
+
 	public:
 		/*
 		* Copy this to dst.
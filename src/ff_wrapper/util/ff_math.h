@@ -128,7 +128,7 @@ namespace ff
 
 		constexpr rational_temp& operator=(T integer) noexcept
 		{
-			num = T;
+			num = integer;
 			den = 1;
 			return *this;
 		}
@@ -16,7 +16,8 @@
 */
 
 /*
-* Defines class time that represents a timestamp in a multimedia file
+* Defines class time that represents a timestamp in a multimedia file,
+* class time_rescaler that converts timestamps between two fixed time bases,
 * as well as some helpers around it.
 */
 
@@ -24,6 +25,7 @@
 #include "util.h"
 
 #include <string>
+#include <cstdint>
 
 extern "C"
 {
@@ -288,4 +290,233 @@ namespace ff
 		rational b;
 	};
 
-}
\ No newline at end of file
+	/*
+	* Converts timestamps from one fixed time base to another.
+	* 
+	* ff::time::change_time_base() works out (ts * from) / to with rationals every time it's called,
+	* which is wasteful for a stream of packets whose time bases don't change.
+	* The class works out the reduced factor from / to once, at construction,
+	* and then rescales each timestamp with integer arithmetic only.
+	* 
+	* When one time base is a multiple of the other, which is the common case
+	* (e.g. 1/1200 to 1/600, or 1/25 to 1/90000), the factor is an integer or its reciprocal
+	* and the rescale is a single multiplication or division.
+	* 
+	* Rounding is to the nearest, halfway cases away from zero,
+	* the same as ff::rational_64::to_int64() and AV_ROUND_NEAR_INF.
+	* Results that would not fit in int64_t are saturated.
+	* 
+	* Everything is constexpr.
+	*/
+	class time_rescaler final
+	{
+	public:
+		/*
+		* How the factor looks like, which decides the path rescale() goes.
+		*/
+		enum class kind
+		{
+			// from == to.
+			identity,
+			// from / to is an integer.
+			multiply,
+			// to / from is an integer.
+			divide,
+			// Neither.
+			general
+		};
+
+	public:
+		/*
+		* @param from the time base of the timestamps to rescale.
+		* @param to the time base to rescale them to.
+		* @throws std::invalid_argument if from <= 0 or to <= 0.
+		*/
+		constexpr time_rescaler(const rational from, const rational to)
+			: from_tb(from), to_tb(to)
+		{
+			if (from <= zero_rational || to <= zero_rational)
+			{
+				throw std::invalid_argument("time base must be positive.");
+			}
+
+			// In 64 bits lest it overflow. Reduced by the division.
+			const rational_64 factor =
+				rational_64(from.get_num(), from.get_den()) / rational_64(to.get_num(), to.get_den());
+			num = factor.get_num();
+			den = factor.get_den();
+
+			if (num == den)
+			{
+				k = kind::identity;
+			}
+			else if (den == 1)
+			{
+				k = kind::multiply;
+			}
+			else if (num == 1)
+			{
+				k = kind::divide;
+			}
+			else
+			{
+				k = kind::general;
+			}
+		}
+
+		constexpr time_rescaler(const time_rescaler&) noexcept = default;
+		constexpr time_rescaler& operator=(const time_rescaler&) noexcept = default;
+
+	public:
+		/*
+		* Rescales a timestamp.
+		* 
+		* @param ts the timestamp in from_time_base().
+		* @returns ts in to_time_base(). AV_NOPTS_VALUE if ts is AV_NOPTS_VALUE.
+		*/
+		constexpr int64_t rescale(const int64_t ts) const noexcept
+		{
+			if (AV_NOPTS_VALUE == ts)
+			{
+				return AV_NOPTS_VALUE;
+			}
+
+			switch (k)
+			{
+			case kind::identity:
+				return ts;
+			case kind::multiply:
+				return internal_mul_div(ts, num, 1);
+			case kind::divide:
+				return internal_mul_div(ts, 1, den);
+			default:
+				return internal_mul_div(ts, num, den);
+			}
+		}
+
+		/*
+		* Rescales the time fields of a packet or frame in one call.
+		* pts and dts are rescaled by rescale().
+		* duration is only rescaled if it is set (i.e. > 0).
+		*/
+		constexpr void rescale(int64_t& pts, int64_t& dts, int64_t& duration) const noexcept
+		{
+			pts = rescale(pts);
+			dts = rescale(dts);
+			if (duration > 0)
+			{
+				duration = rescale(duration);
+			}
+		}
+
+		/*
+		* @returns a rescaler that converts back from to_time_base() to from_time_base().
+		*/
+		constexpr time_rescaler inverse() const
+		{
+			return time_rescaler(to_tb, from_tb);
+		}
+
+	public:
+		constexpr rational from_time_base() const noexcept { return from_tb; }
+		constexpr rational to_time_base() const noexcept { return to_tb; }
+		/*
+		* @returns from_time_base() / to_time_base(), reduced.
+		*/
+		constexpr rational_64 factor() const noexcept { return rational_64(num, den); }
+		constexpr kind get_kind() const noexcept { return k; }
+
+	private:
+		/*
+		* @returns round(a * b / c), halfway cases away from zero, saturated to int64_t.
+		* b, c > 0.
+		*/
+		static constexpr int64_t internal_mul_div(const int64_t a, const int64_t b, const int64_t c) noexcept
+		{
+			const bool negative = a < 0;
+			// -INT64_MIN doesn't fit in int64_t, but fits in uint64_t.
+			const uint64_t ua = negative ? 0 - static_cast<uint64_t>(a) : static_cast<uint64_t>(a);
+			const uint64_t ub = static_cast<uint64_t>(b), uc = static_cast<uint64_t>(c);
+
+			uint64_t q = 0;
+			if (ub == 1 || ua <= UINT64_MAX / ub)
+			{
+				// a * b fits in 64 bits.
+				const uint64_t p = ua * ub;
+				q = p / uc;
+				const uint64_t r = p % uc;
+				// r >= c / 2, without overflow.
+				if (r >= uc - r)
+				{
+					++q;
+				}
+			}
+			else
+			{
+				q = internal_mul_div_128(ua, ub, uc);
+			}
+
+			constexpr uint64_t max_magnitude = static_cast<uint64_t>(INT64_MAX);
+			if (q > max_magnitude)
+			{
+				return negative ? -INT64_MAX : INT64_MAX;
+			}
+			return negative ? -static_cast<int64_t>(q) : static_cast<int64_t>(q);
+		}
+
+		/*
+		* The slow path of internal_mul_div(), when a * b needs 128 bits.
+		* I don't use __int128 because MSVC doesn't have it.
+		* 
+		* @returns round(a * b / c), halfway cases up, saturated to UINT64_MAX.
+		* c < 2^63.
+		*/
+		static constexpr uint64_t internal_mul_div_128(const uint64_t a, const uint64_t b, const uint64_t c) noexcept
+		{
+			// a * b = hi * 2^64 + lo, by 32-bit halves.
+			const uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32;
+			const uint64_t b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+
+			const uint64_t ll = a_lo * b_lo, lh = a_lo * b_hi, hl = a_hi * b_lo, hh = a_hi * b_hi;
+			const uint64_t mid = (ll >> 32) + (lh & 0xFFFFFFFFu) + (hl & 0xFFFFFFFFu);
+
+			const uint64_t lo = (mid << 32) | (ll & 0xFFFFFFFFu);
+			const uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+
+			if (hi >= c)
+			{
+				// The quotient needs more than 64 bits.
+				return UINT64_MAX;
+			}
+
+			// Long division, one bit at a time. Because r < c < 2^63, 2r + 1 never overflows.
+			uint64_t r = hi, q = 0;
+			for (int i = 63; i >= 0; --i)
+			{
+				r = (r << 1) | ((lo >> i) & 1);
+				q <<= 1;
+				if (r >= c)
+				{
+					r -= c;
+					q |= 1;
+				}
+			}
+
+			if (r >= c - r)
+			{
+				if (q == UINT64_MAX)
+				{
+					return UINT64_MAX;
+				}
+				++q;
+			}
+			return q;
+		}
+
+	private:
+		rational from_tb, to_tb;
+		// from_tb / to_tb = num / den, reduced. Both > 0.
+		int64_t num = 1, den = 1;
+		kind k = kind::identity;
+	};
+}
@@ -0,0 +1,196 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Contains generator, a minimal lazy range whose elements are produced by a C++20 coroutine,
+* because std::generator only comes with C++23.
+*/
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace ff
+{
+	/*
+	* A range of T&, whose elements are computed one by one by a coroutine as you iterate over it.
+	* Write the coroutine as a function returning generator<T> that co_yields Ts.
+	* 
+	* Nothing runs until begin() is called, and the coroutine only runs to the next co_yield
+	* each time the iterator is incremented, so stopping early (e.g. with std::views::take)
+	* saves all the work for the rest of the elements.
+	* Destroying the generator destroys the suspended coroutine, and the locals in it.
+	* 
+	* The iterator dereferences to the object co_yielded, which lives until the iterator is incremented.
+	* Copy or move it out if you need it longer.
+	* 
+	* An exception thrown in the coroutine is rethrown from begin() or operator++.
+	* It's single-pass: begin() can only be called once, and calling it again throws std::logic_error.
+	*/
+	template <typename T>
+	class generator : public std::ranges::view_interface<generator<T>>
+	{
+	public:
+		using value_type = std::remove_cvref_t<T>;
+		using reference = value_type&;
+
+		class promise_type
+		{
+		public:
+			generator get_return_object() noexcept
+			{
+				return generator(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+
+			// Lazy: does nothing until asked.
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			std::suspend_always final_suspend() noexcept { return {}; }
+
+			// The object (even a temporary) lives in the coroutine until it's resumed.
+			std::suspend_always yield_value(value_type& v) noexcept
+			{
+				p_value = std::addressof(v);
+				return {};
+			}
+			std::suspend_always yield_value(value_type&& v) noexcept
+			{
+				p_value = std::addressof(v);
+				return {};
+			}
+
+			void return_void() noexcept {}
+
+			void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+			// Forbid co_await inside generators.
+			template <typename U>
+			std::suspend_never await_transform(U&&) = delete;
+
+		private:
+			friend class generator;
+
+			value_type* p_value = nullptr;
+			std::exception_ptr exception;
+		};
+
+		class iterator
+		{
+		public:
+			using value_type = generator::value_type;
+			using difference_type = std::ptrdiff_t;
+
+			iterator() noexcept = default;
+
+			reference operator*() const noexcept { return *h.promise().p_value; }
+			value_type* operator->() const noexcept { return h.promise().p_value; }
+
+			iterator& operator++()
+			{
+				resume(h);
+				return *this;
+			}
+			void operator++(int) { ++*this; }
+
+			friend bool operator==(const iterator& it, std::default_sentinel_t) noexcept
+			{
+				return !it.h || it.h.done();
+			}
+
+		private:
+			friend class generator;
+
+			explicit iterator(std::coroutine_handle<promise_type> h) noexcept : h(h) {}
+
+			std::coroutine_handle<promise_type> h = nullptr;
+		};
+
+	public:
+		generator() noexcept = default;
+
+		generator(const generator&) = delete;
+		generator& operator=(const generator&) = delete;
+
+		generator(generator&& other) noexcept
+			: h(std::exchange(other.h, nullptr)), started(std::exchange(other.started, false)) {}
+		generator& operator=(generator&& right) noexcept
+		{
+			if (this != &right)
+			{
+				destroy();
+				h = std::exchange(right.h, nullptr);
+				started = std::exchange(right.started, false);
+			}
+			return *this;
+		}
+
+		~generator() noexcept { destroy(); }
+
+	public:
+		/*
+		* Runs the coroutine to its first co_yield.
+		* @returns the iterator to the first element.
+		* @throws std::logic_error if it has been called, as the coroutine has run on.
+		* @throws what the coroutine throws.
+		*/
+		iterator begin()
+		{
+			if (started)
+			{
+				throw std::logic_error("A generator can only be iterated once.");
+			}
+			started = true;
+			if (h)
+			{
+				resume(h);
+			}
+			return iterator(h);
+		}
+
+		std::default_sentinel_t end() const noexcept { return std::default_sentinel; }
+
+	private:
+		explicit generator(std::coroutine_handle<promise_type> h) noexcept : h(h) {}
+
+		static void resume(std::coroutine_handle<promise_type> h)
+		{
+			h.resume();
+			if (h.promise().exception)
+			{
+				std::rethrow_exception(std::exchange(h.promise().exception, nullptr));
+			}
+		}
+
+		void destroy() noexcept
+		{
+			if (h)
+			{
+				h.destroy();
+				h = nullptr;
+			}
+		}
+
+	private:
+		std::coroutine_handle<promise_type> h = nullptr;
+		// If begin() has been called.
+		bool started = false;
+	};
+}
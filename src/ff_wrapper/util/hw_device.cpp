@@ -0,0 +1,166 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "hw_device.h"
+#include "ff_helpers.h"
+
+extern "C"
+{
+#include <libavutil/buffer.h>
+}
+
+#include <stdexcept>
+
+ff::hw_device::hw_device(AVHWDeviceType type, const std::string& device, const dict& options)
+{
+	internal_create_device(type, device, options);
+}
+
+ff::hw_device::hw_device(const std::string& type_name, const std::string& device, const dict& options)
+{
+	auto type = av_hwdevice_find_type_by_name(type_name.c_str());
+	if (AV_HWDEVICE_TYPE_NONE == type)
+	{
+		throw std::invalid_argument("No hardware device type has the name.");
+	}
+
+	internal_create_device(type, device, options);
+}
+
+ff::hw_device::hw_device(const AVBufferRef* device_ref)
+{
+	if (nullptr == device_ref)
+	{
+		throw std::invalid_argument("device_ref cannot be nullptr.");
+	}
+
+	p_device_ref = ::av_buffer_ref(device_ref);
+	if (nullptr == p_device_ref)
+	{
+		throw std::bad_alloc();
+	}
+}
+
+ff::hw_device::hw_device(const hw_device& other)
+{
+	if (nullptr != other.p_device_ref)
+	{
+		p_device_ref = ::av_buffer_ref(other.p_device_ref);
+		if (nullptr == p_device_ref)
+		{
+			throw std::bad_alloc();
+		}
+	}
+}
+
+ff::hw_device::hw_device(hw_device&& other) noexcept
+	: p_device_ref(other.p_device_ref)
+{
+	other.p_device_ref = nullptr;
+}
+
+ff::hw_device& ff::hw_device::operator=(const hw_device& right)
+{
+	if (this == &right)
+	{
+		return *this;
+	}
+
+	::AVBufferRef* new_ref = nullptr;
+	if (nullptr != right.p_device_ref)
+	{
+		new_ref = ::av_buffer_ref(right.p_device_ref);
+		if (nullptr == new_ref)
+		{
+			throw std::bad_alloc();
+		}
+	}
+
+	av_buffer_unref(&p_device_ref);
+	p_device_ref = new_ref;
+
+	return *this;
+}
+
+ff::hw_device& ff::hw_device::operator=(hw_device&& right) noexcept
+{
+	av_buffer_unref(&p_device_ref);
+	p_device_ref = right.p_device_ref;
+	right.p_device_ref = nullptr;
+
+	return *this;
+}
+
+ff::hw_device::~hw_device() noexcept
+{
+	// Does nothing if it's nullptr.
+	av_buffer_unref(&p_device_ref);
+}
+
+AVHWDeviceType ff::hw_device::type() const noexcept
+{
+	if (nullptr == p_device_ref)
+	{
+		return AV_HWDEVICE_TYPE_NONE;
+	}
+
+	return reinterpret_cast<const AVHWDeviceContext*>(p_device_ref->data)->type;
+}
+
+std::string ff::hw_device::type_name() const
+{
+	const char* name = av_hwdevice_get_type_name(type());
+	return nullptr == name ? std::string() : std::string(name);
+}
+
+std::vector<AVHWDeviceType> ff::hw_device::supported_types()
+{
+	std::vector<AVHWDeviceType> res;
+
+	auto type = AV_HWDEVICE_TYPE_NONE;
+	while ((type = av_hwdevice_iterate_types(type)) != AV_HWDEVICE_TYPE_NONE)
+	{
+		res.push_back(type);
+	}
+
+	return res;
+}
+
+void ff::hw_device::internal_create_device(AVHWDeviceType type, const std::string& device, const dict& options)
+{
+	if (AV_HWDEVICE_TYPE_NONE == type)
+	{
+		throw std::invalid_argument("The type of a hardware device cannot be none.");
+	}
+
+	int ret = av_hwdevice_ctx_create
+	(
+		&p_device_ref, type,
+		device.empty() ? nullptr : device.c_str(),
+		const_cast<AVDictionary*>(options.get_av_dict()), 0
+	);
+	if (ret < 0)
+	{
+		switch (ret)
+		{
+		case AVERROR(ENOMEM):
+			throw std::bad_alloc();
+			break;
+		default:
+			ON_FF_ERROR_WITH_CODE("Could not open the hardware device", ret);
+		}
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "util.h"
+#include "dict.h"
+
+extern "C"
+{
+#include <libavutil/hwcontext.h> // For AVHWDeviceType
+}
+
+#include <string>
+#include <vector>
+
+struct AVBufferRef;
+
+namespace ff
+{
+	/*
+	* Represents a hardware device (e.g. a GPU through CUDA, VAAPI, QSV, or D3D11VA)
+	* that codecs can decode/encode frames on.
+	* It encapsulates a reference to an AVHWDeviceContext.
+	*
+	* Put it here because FFmpeg put hwcontext in libavutil.
+	*
+	* Copying a hw_device is cheap: the copy references the same device.
+	* The device is closed when the last reference to it
+	* (including those held by codecs and frames) is gone.
+	*
+	* Invariants:
+	*	p_device_ref != nullptr unless the object has been moved.
+	*/
+	class FF_WRAPPER_API hw_device final
+	{
+	public:
+		hw_device() = delete;
+
+		/*
+		* Opens a hardware device.
+		*
+		* @param type the type of the device.
+		* @param device which device of the type to open. Its meaning depends on the type
+		* (e.g. the index of a GPU for CUDA, or a DRM node for VAAPI). Empty to open the default one.
+		* @param options options for opening the device. Can be empty.
+		* @throws std::invalid_argument if type is AV_HWDEVICE_TYPE_NONE.
+		* @throws std::runtime_error if the device cannot be opened (e.g. the machine doesn't have one).
+		*/
+		explicit hw_device(AVHWDeviceType type, const std::string& device = std::string(), const dict& options = dict());
+		/*
+		* Opens a hardware device of the type whose name is type_name (e.g. "cuda", "vaapi", "qsv", "d3d11va").
+		*
+		* @throws std::invalid_argument if no type has the name.
+		* @throws std::runtime_error if the device cannot be opened (e.g. the machine doesn't have one).
+		*/
+		explicit hw_device(const std::string& type_name, const std::string& device = std::string(), const dict& options = dict());
+
+		/*
+		* References the device that device_ref references.
+		* Useful for devices that FFmpeg opened (e.g. AVCodecContext::hw_device_ctx).
+		*
+		* @throws std::invalid_argument if device_ref is nullptr.
+		*/
+		explicit hw_device(const AVBufferRef* device_ref);
+
+		/*
+		* References the same device as other.
+		*/
+		hw_device(const hw_device& other);
+		/*
+		* Takes over other's reference and sets other's to nullptr.
+		*/
+		hw_device(hw_device&& other) noexcept;
+
+		hw_device& operator=(const hw_device& right);
+		hw_device& operator=(hw_device&& right) noexcept;
+
+		/*
+		* Releases the reference to the device.
+		*/
+		~hw_device() noexcept;
+
+	public:
+		/*
+		* @returns the type of the device. AV_HWDEVICE_TYPE_NONE if the object has been moved.
+		*/
+		AVHWDeviceType type() const noexcept;
+
+		/*
+		* @returns the name of the type of the device.
+		*/
+		std::string type_name() const;
+
+		/*
+		* @returns the types of devices this build of FFmpeg supports.
+		* This doesn't mean such devices exist on the machine.
+		*/
+		static std::vector<AVHWDeviceType> supported_types();
+
+	public:
+		AVBufferRef* av_device_ref() noexcept { return p_device_ref; }
+		const AVBufferRef* av_device_ref() const noexcept { return p_device_ref; }
+
+	private:
+		/*
+		* Creates the device. Common code of the constructors that open a device.
+		*/
+		void internal_create_device(AVHWDeviceType type, const std::string& device, const dict& options);
+
+	private:
+		::AVBufferRef* p_device_ref = nullptr;
+	};
+}
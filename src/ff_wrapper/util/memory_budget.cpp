@@ -0,0 +1,254 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "memory_budget.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <stdexcept>
+
+namespace
+{
+	// One for all budgets, since a release anywhere up the chain may let a waiter through.
+	// Waiting only happens at the caps, so sharing them costs little.
+	std::mutex wait_mtx;
+	std::condition_variable wait_cv;
+	// Bumped by every wake_waiters(), under wait_mtx, so that a waiter knows if it missed one.
+	uint64_t wake_generation = 0;
+	std::atomic<int> num_waiters = 0;
+
+	void check_caps(size_t soft_cap, size_t hard_cap)
+	{
+		if (0 != soft_cap && 0 != hard_cap && soft_cap > hard_cap)
+		{
+			throw std::invalid_argument("The soft cap cannot be above the hard cap.");
+		}
+	}
+}
+
+///////////////////////////// charge /////////////////////////////
+
+ff::memory_budget::charge& ff::memory_budget::charge::operator=(charge&& right) noexcept
+{
+	if (this != &right)
+	{
+		release();
+		budget = right.budget;
+		num_bytes = right.num_bytes;
+		right.budget = nullptr;
+		right.num_bytes = 0;
+	}
+
+	return *this;
+}
+
+void ff::memory_budget::charge::release() noexcept
+{
+	if (nullptr != budget)
+	{
+		budget->internal_release(num_bytes);
+		budget = nullptr;
+		num_bytes = 0;
+	}
+}
+
+///////////////////////////// memory_budget /////////////////////////////
+
+ff::memory_budget::memory_budget(size_t soft_cap, size_t hard_cap, memory_budget* parent)
+	: parent(parent), soft(soft_cap), hard(hard_cap)
+{
+	check_caps(soft_cap, hard_cap);
+}
+
+ff::memory_budget& ff::memory_budget::process_wide() noexcept
+{
+	static memory_budget instance(0, 0, nullptr);
+	return instance;
+}
+
+ff::memory_budget::charge ff::memory_budget::try_acquire(size_t bytes) noexcept
+{
+	for (memory_budget* b = this; nullptr != b; b = b->parent)
+	{
+		if (!b->internal_add(bytes, false))
+		{
+			// Take back what has been added below it.
+			for (memory_budget* added = this; added != b; added = added->parent)
+			{
+				added->internal_sub(bytes);
+			}
+			return charge();
+		}
+	}
+
+	return charge(this, bytes);
+}
+
+ff::memory_budget::charge ff::memory_budget::acquire(size_t bytes, const std::function<bool()>& stop)
+{
+	charge c = try_acquire(bytes);
+	if (!c.empty())
+	{
+		return c;
+	}
+
+	// Counted before trying again, so that a release after the try sees it and wakes me.
+	num_waiters.fetch_add(1);
+	while (true)
+	{
+		uint64_t seen = 0;
+		{
+			std::lock_guard<std::mutex> lock(wait_mtx);
+			seen = wake_generation;
+		}
+
+		// Both run without wait_mtx: stop may release charges, and try_acquire() may call the soft cap callback,
+		// which may set_caps(). Both call wake_waiters(), which locks it.
+		if (stop && stop())
+		{
+			break;
+		}
+
+		c = try_acquire(bytes);
+		if (!c.empty())
+		{
+			break;
+		}
+
+		// A wake after seen was read, e.g. by a release after the try, means I try again right away.
+		std::unique_lock<std::mutex> lock(wait_mtx);
+		wait_cv.wait(lock, [seen]() { return wake_generation != seen; });
+	}
+	num_waiters.fetch_sub(1);
+
+	return c;
+}
+
+ff::memory_budget::charge ff::memory_budget::force_acquire(size_t bytes) noexcept
+{
+	for (memory_budget* b = this; nullptr != b; b = b->parent)
+	{
+		b->internal_add(bytes, true);
+	}
+
+	return charge(this, bytes);
+}
+
+void ff::memory_budget::wake_waiters() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(wait_mtx);
+		++wake_generation;
+	}
+	wait_cv.notify_all();
+}
+
+void ff::memory_budget::set_caps(size_t soft_cap, size_t hard_cap)
+{
+	check_caps(soft_cap, hard_cap);
+
+	soft.store(soft_cap, std::memory_order_relaxed);
+	hard.store(hard_cap, std::memory_order_relaxed);
+	wake_waiters();
+}
+
+void ff::memory_budget::set_soft_cap_callback(soft_cap_callback callback)
+{
+	std::lock_guard<std::mutex> lock(callback_mtx);
+	this->callback = std::move(callback);
+}
+
+bool ff::memory_budget::over_soft_cap() const noexcept
+{
+	const size_t cap = soft.load(std::memory_order_relaxed);
+	return 0 != cap && in_use.load(std::memory_order_relaxed) > cap;
+}
+
+bool ff::memory_budget::internal_add(size_t bytes, bool force) noexcept
+{
+	const size_t hard_cap = hard.load(std::memory_order_relaxed);
+
+	// Sequentially consistent, like num_waiters, so that a waiter never misses a release.
+	size_t cur = in_use.load();
+	do
+	{
+		if (!force && 0 != hard_cap && 0 != cur && cur + bytes > hard_cap)
+		{
+			return false;
+		}
+	} while (!in_use.compare_exchange_weak(cur, cur + bytes));
+
+	const size_t now = cur + bytes;
+	size_t p = peak.load(std::memory_order_relaxed);
+	while (p < now && !peak.compare_exchange_weak(p, now, std::memory_order_relaxed))
+	{
+	}
+
+	const size_t soft_cap = soft.load(std::memory_order_relaxed);
+	if (0 != soft_cap && cur <= soft_cap && now > soft_cap)
+	{
+		internal_notify_soft_cap(true);
+	}
+
+	return true;
+}
+
+void ff::memory_budget::internal_sub(size_t bytes) noexcept
+{
+	const size_t cur = in_use.fetch_sub(bytes);
+
+	const size_t soft_cap = soft.load(std::memory_order_relaxed);
+	if (0 != soft_cap && cur > soft_cap && cur - bytes <= soft_cap)
+	{
+		internal_notify_soft_cap(false);
+	}
+}
+
+void ff::memory_budget::internal_release(size_t bytes) noexcept
+{
+	for (memory_budget* b = this; nullptr != b; b = b->parent)
+	{
+		b->internal_sub(bytes);
+	}
+
+	// Pairs with the counting in acquire(): either the waiter's try sees the release,
+	// or I see the waiter.
+	if (0 != num_waiters.load())
+	{
+		wake_waiters();
+	}
+}
+
+void ff::memory_budget::internal_notify_soft_cap(bool over) noexcept
+{
+	soft_cap_callback cb;
+	{
+		std::lock_guard<std::mutex> lock(callback_mtx);
+		cb = callback;
+	}
+
+	if (cb)
+	{
+		try
+		{
+			cb(*this, over);
+		}
+		catch (...)
+		{
+			// A callback must not stop the accounting.
+		}
+	}
+}
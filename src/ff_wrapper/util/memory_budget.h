@@ -0,0 +1,211 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* memory_budget.h:
+* Accounts for the bytes of frames and packets that are held (e.g. queued between stages),
+* process-wide and per pipeline, with caps that hold back whoever brings more in.
+*/
+
+#include "util.h"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+namespace ff
+{
+	/*
+	* Counts the bytes charged to it, and to each of its ancestors,
+	* which is how a budget per pipeline adds up to the process-wide one.
+	* Unless told otherwise, every budget's parent is process_wide().
+	* 
+	* Caps (0 means none):
+	*	1. Over the soft cap, I tell the soft cap callback, once when it's crossed upwards,
+	*	and once when it's crossed downwards. Use it to, e.g., lower the quality or drop inputs.
+	*	2. The hard cap can't be passed by try_acquire() and acquire(): they fail or wait instead.
+	*	Even so, something is always allowed when nothing is charged, so that a huge frame doesn't stop all forever.
+	*	force_acquire() passes it, for those who must not wait.
+	* 
+	* How to hold against a budget:
+	* Whoever brings new data in (e.g. the demuxing stage) should acquire() and wait,
+	* and those downstream force_acquire() what they make from it.
+	* Then memory only stops coming in while the downstream keeps freeing it, and nobody waits forever.
+	* transcode_pipeline and async_demuxer do so with the budget you give them.
+	* 
+	* I only know what is charged: what the codecs and FFmpeg hold inside is not.
+	* 
+	* Everything is thread-safe. The counters are atomics, and only waiting locks.
+	*/
+	class FF_WRAPPER_API memory_budget final
+	{
+	public:
+		/*
+		* Called on the thread that crosses the soft cap. over is whether it's now over the cap.
+		* It must not acquire from or release to the budget, as it's called in the middle of counting.
+		* It may change the caps.
+		*/
+		using soft_cap_callback = std::function<void(const memory_budget& budget, bool over)>;
+
+		/*
+		* What is charged to a budget, released to it when destroyed. Movable, not copyable.
+		* An empty charge holds nothing.
+		*/
+		class FF_WRAPPER_API charge final
+		{
+		public:
+			charge() noexcept = default;
+			charge(const charge&) = delete;
+			charge& operator=(const charge&) = delete;
+
+			charge(charge&& other) noexcept
+				: budget(other.budget), num_bytes(other.num_bytes)
+			{
+				other.budget = nullptr;
+				other.num_bytes = 0;
+			}
+			charge& operator=(charge&& right) noexcept;
+
+			~charge() noexcept { release(); }
+
+		public:
+			/*
+			* Releases the bytes now. Does nothing if empty.
+			*/
+			void release() noexcept;
+
+			size_t bytes() const noexcept { return num_bytes; }
+			bool empty() const noexcept { return nullptr == budget; }
+
+		private:
+			friend class memory_budget;
+			charge(memory_budget* budget, size_t bytes) noexcept
+				: budget(budget), num_bytes(bytes) {}
+
+			memory_budget* budget = nullptr;
+			size_t num_bytes = 0;
+		};
+
+	public:
+		/*
+		* @param soft_cap see the class. 0 for none.
+		* @param hard_cap see the class. 0 for none.
+		* @param parent what the bytes are also charged to. nullptr for none.
+		* It must outlive me.
+		* @throws std::invalid_argument if both caps are set and soft_cap > hard_cap.
+		*/
+		explicit memory_budget(size_t soft_cap = 0, size_t hard_cap = 0, memory_budget* parent = &process_wide());
+
+		memory_budget(const memory_budget&) = delete;
+		memory_budget& operator=(const memory_budget&) = delete;
+
+		/*
+		* The charges must not outlive me.
+		*/
+		~memory_budget() noexcept = default;
+
+	public:
+		/*
+		* The budget of the whole process, without caps until you set them. It has no parent.
+		*/
+		static memory_budget& process_wide() noexcept;
+
+	public:
+		/*
+		* Charges bytes unless it would pass the hard cap of this or of an ancestor.
+		* 
+		* @returns the charge, or an empty one if it would.
+		*/
+		charge try_acquire(size_t bytes) noexcept;
+
+		/*
+		* Charges bytes, waiting while it would pass the hard cap of this or of an ancestor.
+		* 
+		* @param stop checked whenever I wake up (see wake_waiters()). If it returns true, I give up.
+		* It's called without any lock of mine held, so it may release charges.
+		* (The soft cap callback still must not; see soft_cap_callback.)
+		* @returns the charge, or an empty one if I gave up.
+		*/
+		charge acquire(size_t bytes, const std::function<bool()>& stop = std::function<bool()>());
+
+		/*
+		* Charges bytes, whatever the caps.
+		*/
+		charge force_acquire(size_t bytes) noexcept;
+
+		/*
+		* Wakes up everyone waiting in acquire(), of any budget, so that they check their stop.
+		* Call it after you have made a stop return true.
+		*/
+		static void wake_waiters() noexcept;
+
+	public:
+		/*
+		* Sets the caps. Those waiting check them again.
+		* 
+		* @throws std::invalid_argument if both caps are set and soft_cap > hard_cap.
+		*/
+		void set_caps(size_t soft_cap, size_t hard_cap);
+		size_t get_soft_cap() const noexcept { return soft.load(std::memory_order_relaxed); }
+		size_t get_hard_cap() const noexcept { return hard.load(std::memory_order_relaxed); }
+
+		/*
+		* Sets who to tell about crossing the soft cap. Empty for nobody.
+		*/
+		void set_soft_cap_callback(soft_cap_callback callback);
+
+		size_t bytes_in_use() const noexcept { return in_use.load(std::memory_order_relaxed); }
+		/*
+		* @returns the most bytes that have been in use at once.
+		*/
+		size_t peak_bytes_in_use() const noexcept { return peak.load(std::memory_order_relaxed); }
+		bool over_soft_cap() const noexcept;
+
+		memory_budget* get_parent() const noexcept { return parent; }
+
+	private:
+		/*
+		* Adds bytes to this only.
+		* @returns false if it would pass the hard cap and force is false. Then nothing is added.
+		*/
+		bool internal_add(size_t bytes, bool force) noexcept;
+		/*
+		* Subtracts bytes from this only.
+		*/
+		void internal_sub(size_t bytes) noexcept;
+		/*
+		* Subtracts bytes from this and the ancestors, and wakes up those waiting.
+		*/
+		void internal_release(size_t bytes) noexcept;
+		/*
+		* Tells the callback, if any.
+		*/
+		void internal_notify_soft_cap(bool over) noexcept;
+
+	private:
+		memory_budget* const parent;
+
+		std::atomic<size_t> in_use = 0;
+		std::atomic<size_t> peak = 0;
+		std::atomic<size_t> soft, hard;
+
+		// Guards callback only.
+		std::mutex callback_mtx;
+		soft_cap_callback callback;
+	};
+}
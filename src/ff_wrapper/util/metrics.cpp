@@ -0,0 +1,310 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "metrics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <bit>
+#include <mutex>
+#include <thread>
+
+uint64_t ff::metrics::histogram_snapshot::quantile_ns(double q) const noexcept
+{
+	if (0 == count)
+	{
+		return 0;
+	}
+
+	const double target = std::clamp(q, 0.0, 1.0) * count;
+	uint64_t cumulative = 0;
+	for (int i = 0; i < num_latency_buckets; ++i)
+	{
+		cumulative += buckets[i];
+		if (cumulative >= target && cumulative > 0)
+		{
+			const uint64_t upper = i + 1 < 64 ? (uint64_t(1) << (i + 1)) - 1 : UINT64_MAX;
+			return std::min(upper, max_ns);
+		}
+	}
+	return max_ns;
+}
+
+#ifdef FF_WRAPPER_ENABLE_METRICS
+
+namespace
+{
+	struct trace_event
+	{
+		const ff::metrics::stage_record* stage;
+		std::chrono::steady_clock::time_point start;
+		std::chrono::steady_clock::duration duration;
+		uint32_t tid;
+	};
+
+	/*
+	* All the stages and the trace events.
+	* The stages of gone objects are kept so that their last counts still show up in snapshots.
+	* Trace events point to the stages, which are only forgotten when the events are cleared too.
+	*/
+	struct registry
+	{
+		std::mutex mtx;
+		std::vector<std::shared_ptr<ff::metrics::stage_record>> stages;
+
+		std::atomic<bool> tracing{ false };
+		size_t max_events = 0;
+		std::atomic<size_t> dropped{ 0 };
+		std::vector<trace_event> events;
+		const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+		std::atomic<uint64_t> next_object_id{ 0 };
+	};
+
+	registry& get_registry()
+	{
+		// Never destroyed, as probes may still be destroyed after main() returns.
+		static registry* r = new registry;
+		return *r;
+	}
+
+	// @returns a small number unique to the calling thread, for trace events.
+	uint32_t current_tid() noexcept
+	{
+		static std::atomic<uint32_t> next_tid{ 1 };
+		thread_local const uint32_t tid = next_tid.fetch_add(1, std::memory_order_relaxed);
+		return tid;
+	}
+
+	void atomic_max(std::atomic<uint64_t>& a, uint64_t v) noexcept
+	{
+		uint64_t cur = a.load(std::memory_order_relaxed);
+		while (cur < v && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+	}
+
+	void write_json_string(std::ostream& os, const std::string& s)
+	{
+		os << '"';
+		for (char c : s)
+		{
+			if ('"' == c || '\\' == c)
+			{
+				os << '\\';
+			}
+			// Names of objects and stages are mine, so no control characters.
+			os << c;
+		}
+		os << '"';
+	}
+}
+
+void ff::metrics::stage_record::record
+(
+	std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end,
+	uint64_t num_items, uint64_t num_bytes, bool is_refused
+) noexcept
+{
+	constexpr auto relaxed = std::memory_order_relaxed;
+
+	const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	const int bucket = std::min<int>(num_latency_buckets - 1, std::max(0, (int)std::bit_width(ns) - 1));
+
+	calls.fetch_add(1, relaxed);
+	items.fetch_add(num_items, relaxed);
+	bytes.fetch_add(num_bytes, relaxed);
+	if (is_refused)
+	{
+		refused.fetch_add(1, relaxed);
+	}
+	total_ns.fetch_add(ns, relaxed);
+	atomic_max(max_ns, ns);
+	buckets[bucket].fetch_add(1, relaxed);
+
+	registry& r = get_registry();
+	if (r.tracing.load(relaxed))
+	{
+		std::lock_guard lock(r.mtx);
+		if (r.events.size() < r.max_events)
+		{
+			r.events.push_back(trace_event{ this, start, end - start, current_tid() });
+		}
+		else
+		{
+			r.dropped.fetch_add(1, relaxed);
+		}
+	}
+}
+
+#else
+
+void ff::metrics::stage_record::record
+(
+	std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point,
+	uint64_t, uint64_t, bool
+) noexcept
+{
+}
+
+#endif // FF_WRAPPER_ENABLE_METRICS
+
+ff::metrics::probe::probe(const char* kind, std::initializer_list<const char*> stage_names)
+{
+#ifdef FF_WRAPPER_ENABLE_METRICS
+	registry& r = get_registry();
+	const std::string object =
+		std::string(kind) + '#' + std::to_string(r.next_object_id.fetch_add(1, std::memory_order_relaxed));
+
+	stages.reserve(stage_names.size());
+	for (const char* name : stage_names)
+	{
+		auto s = std::make_shared<stage_record>();
+		s->object = object;
+		s->stage = name;
+		stages.push_back(std::move(s));
+	}
+
+	std::lock_guard lock(r.mtx);
+	r.stages.insert(r.stages.end(), stages.begin(), stages.end());
+#else
+	(void)kind;
+	(void)stage_names;
+#endif // FF_WRAPPER_ENABLE_METRICS
+}
+
+ff::metrics::scoped_sample::~scoped_sample() noexcept
+{
+	if (nullptr != s)
+	{
+		s->record(start, std::chrono::steady_clock::now(), items, bytes, refused);
+	}
+}
+
+std::vector<ff::metrics::stage_snapshot> ff::metrics::snapshot()
+{
+	std::vector<stage_snapshot> res;
+#ifdef FF_WRAPPER_ENABLE_METRICS
+	constexpr auto relaxed = std::memory_order_relaxed;
+
+	registry& r = get_registry();
+	std::lock_guard lock(r.mtx);
+	res.reserve(r.stages.size());
+	for (const auto& s : r.stages)
+	{
+		stage_snapshot ss;
+		ss.object = s->object;
+		ss.stage = s->stage;
+		ss.calls = s->calls.load(relaxed);
+		ss.items = s->items.load(relaxed);
+		ss.bytes = s->bytes.load(relaxed);
+		ss.refused = s->refused.load(relaxed);
+		for (int i = 0; i < num_latency_buckets; ++i)
+		{
+			ss.latency.buckets[i] = s->buckets[i].load(relaxed);
+			ss.latency.count += ss.latency.buckets[i];
+		}
+		ss.latency.total_ns = s->total_ns.load(relaxed);
+		ss.latency.max_ns = s->max_ns.load(relaxed);
+		res.push_back(std::move(ss));
+	}
+#endif // FF_WRAPPER_ENABLE_METRICS
+	return res;
+}
+
+void ff::metrics::reset() noexcept
+{
+#ifdef FF_WRAPPER_ENABLE_METRICS
+	constexpr auto relaxed = std::memory_order_relaxed;
+
+	registry& r = get_registry();
+	std::lock_guard lock(r.mtx);
+
+	// Only the registry refers to the stages of gone objects.
+	std::erase_if(r.stages, [](const auto& s) { return 1 == s.use_count(); });
+	for (const auto& s : r.stages)
+	{
+		s->calls.store(0, relaxed);
+		s->items.store(0, relaxed);
+		s->bytes.store(0, relaxed);
+		s->refused.store(0, relaxed);
+		s->total_ns.store(0, relaxed);
+		s->max_ns.store(0, relaxed);
+		for (auto& b : s->buckets)
+		{
+			b.store(0, relaxed);
+		}
+	}
+
+	r.events.clear();
+	r.dropped.store(0, relaxed);
+#endif // FF_WRAPPER_ENABLE_METRICS
+}
+
+void ff::metrics::set_tracing(bool on, size_t max_events) noexcept
+{
+#ifdef FF_WRAPPER_ENABLE_METRICS
+	registry& r = get_registry();
+	std::lock_guard lock(r.mtx);
+	r.max_events = max_events;
+	r.tracing.store(on, std::memory_order_relaxed);
+#else
+	(void)on;
+	(void)max_events;
+#endif // FF_WRAPPER_ENABLE_METRICS
+}
+
+bool ff::metrics::tracing() noexcept
+{
+#ifdef FF_WRAPPER_ENABLE_METRICS
+	return get_registry().tracing.load(std::memory_order_relaxed);
+#else
+	return false;
+#endif // FF_WRAPPER_ENABLE_METRICS
+}
+
+size_t ff::metrics::num_dropped_trace_events() noexcept
+{
+#ifdef FF_WRAPPER_ENABLE_METRICS
+	return get_registry().dropped.load(std::memory_order_relaxed);
+#else
+	return 0;
+#endif // FF_WRAPPER_ENABLE_METRICS
+}
+
+void ff::metrics::write_chrome_trace(std::ostream& os)
+{
+	os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+#ifdef FF_WRAPPER_ENABLE_METRICS
+	registry& r = get_registry();
+	std::lock_guard lock(r.mtx);
+
+	os << std::fixed << std::setprecision(3);
+	bool first = true;
+	for (const auto& e : r.events)
+	{
+		// Timestamps and durations are in microseconds, but can have fractions.
+		const double ts = std::chrono::duration<double, std::micro>(e.start - r.epoch).count();
+		const double dur = std::chrono::duration<double, std::micro>(e.duration).count();
+
+		os << (first ? "\n" : ",\n") << "{\"name\":";
+		write_json_string(os, e.stage->stage);
+		os << ",\"cat\":";
+		write_json_string(os, e.stage->object);
+		os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+			<< ",\"ts\":" << ts << ",\"dur\":" << dur << '}';
+		first = false;
+	}
+#endif // FF_WRAPPER_ENABLE_METRICS
+	os << "\n]}\n";
+}
@@ -0,0 +1,238 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* Optional instrumentation of the hot paths (decoding, encoding, scaling, and muxing).
+* 
+* It is compiled in only if FF_WRAPPER_ENABLE_METRICS is defined
+* (the CMake option of the same name defines it for the library and everything linking to it).
+* Otherwise, every class here is an empty shell, the FF_METRICS_... macros expand to nothing,
+* and the functions return nothing, so that code using them needn't change.
+* 
+* What is recorded:
+* Each instrumented object (e.g. a decoder) has a probe, which owns one stage per hot method
+* (e.g. feed_packet and decode_frame). For each stage, I count the calls, the items (frames/packets)
+* and bytes they processed, and the calls that were refused because the object was hungry or full,
+* and I keep a histogram of how long the calls took.
+* Refused calls are what a caller spends waiting for the other end, so their number tells which stage stalls.
+* 
+* snapshot() copies all of them. Optionally, set_tracing(true) records every call as a trace event too,
+* and write_chrome_trace() writes them in the Chrome trace format, which Perfetto also reads.
+* 
+* Everything here is thread-safe. Recording uses relaxed atomics only,
+* except for trace events, which are appended under a lock.
+*/
+
+#include "util.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ff
+{
+	namespace metrics
+	{
+		// Whether the metrics are compiled in.
+#ifdef FF_WRAPPER_ENABLE_METRICS
+		inline constexpr bool enabled = true;
+#else
+		inline constexpr bool enabled = false;
+#endif // FF_WRAPPER_ENABLE_METRICS
+
+		// Bucket i of a latency histogram counts the calls that took [2^i, 2^(i+1)) ns.
+		// Bucket 0 also counts those that took 0 ns, and the last one those that took longer.
+		inline constexpr int num_latency_buckets = 40;
+
+		struct histogram_snapshot
+		{
+			std::array<uint64_t, num_latency_buckets> buckets{};
+			uint64_t count = 0;
+			uint64_t total_ns = 0;
+			uint64_t max_ns = 0;
+
+			double mean_ns() const noexcept { return 0 == count ? 0.0 : (double)total_ns / count; }
+
+			/*
+			* @param q in [0, 1]. E.g. 0.99 for p99.
+			* @returns an upper bound of the q-quantile, i.e. the upper end of the bucket it's in,
+			* but no more than max_ns. 0 if there's no sample.
+			*/
+			FF_WRAPPER_API uint64_t quantile_ns(double q) const noexcept;
+		};
+
+		struct stage_snapshot
+		{
+			// E.g. "decoder#3".
+			std::string object;
+			// E.g. "feed_packet".
+			std::string stage;
+
+			uint64_t calls = 0;
+			uint64_t items = 0;
+			uint64_t bytes = 0;
+			// Calls refused because the object was hungry or full.
+			uint64_t refused = 0;
+			histogram_snapshot latency;
+		};
+
+		/*
+		* The counters of a stage. You only need it through the probe and the macros.
+		*/
+		struct stage_record
+		{
+			std::string object;
+			const char* stage;
+
+			std::atomic<uint64_t> calls{ 0 }, items{ 0 }, bytes{ 0 }, refused{ 0 };
+			std::atomic<uint64_t> total_ns{ 0 }, max_ns{ 0 };
+			std::array<std::atomic<uint64_t>, num_latency_buckets> buckets{};
+
+			/*
+			* Records one call.
+			*/
+			FF_WRAPPER_API void record
+			(
+				std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end,
+				uint64_t items, uint64_t bytes, bool refused
+			) noexcept;
+		};
+
+		/*
+		* Owns the stages of an instrumented object. It's movable, so that the object can be moved.
+		* A moved-from probe has no stages and records nothing.
+		*/
+		class FF_WRAPPER_API probe final
+		{
+		public:
+			/*
+			* Creates and registers the stages, one for each name.
+			* 
+			* @param kind the kind of the object (e.g. "decoder"). A unique number is appended to it.
+			* @param stage_names they must be string literals, or at least live as long as the program.
+			*/
+			probe(const char* kind, std::initializer_list<const char*> stage_names);
+
+			probe(const probe&) = delete;
+			probe& operator=(const probe&) = delete;
+			probe(probe&&) noexcept = default;
+			probe& operator=(probe&&) noexcept = default;
+
+			/*
+			* The stages stay in the snapshots until reset() after this is gone.
+			*/
+			~probe() noexcept = default;
+
+		public:
+			/*
+			* @returns the ind-th stage, or nullptr if it doesn't exist (e.g. the probe has been moved)
+			* or the metrics are not compiled in.
+			*/
+			stage_record* get(size_t ind) const noexcept
+			{
+#ifdef FF_WRAPPER_ENABLE_METRICS
+				return ind < stages.size() ? stages[ind].get() : nullptr;
+#else
+				(void)ind;
+				return nullptr;
+#endif // FF_WRAPPER_ENABLE_METRICS
+			}
+
+		private:
+#ifdef FF_WRAPPER_ENABLE_METRICS
+			std::vector<std::shared_ptr<stage_record>> stages;
+#endif // FF_WRAPPER_ENABLE_METRICS
+		};
+
+		/*
+		* Times the scope it's in, and records it into a stage when it ends (even by an exception).
+		*/
+		class FF_WRAPPER_API scoped_sample final
+		{
+		public:
+			explicit scoped_sample(stage_record* s) noexcept
+				: s(s), start(nullptr == s ? std::chrono::steady_clock::time_point() : std::chrono::steady_clock::now()) {}
+
+			scoped_sample(const scoped_sample&) = delete;
+			scoped_sample& operator=(const scoped_sample&) = delete;
+
+			~scoped_sample() noexcept;
+
+			// The call processed num items of num_bytes bytes in total.
+			void add(uint64_t num, uint64_t num_bytes = 0) noexcept { items += num; bytes += num_bytes; }
+			// The call was refused because the object was hungry or full.
+			void refuse() noexcept { refused = true; }
+
+		private:
+			stage_record* s;
+			std::chrono::steady_clock::time_point start;
+			uint64_t items = 0, bytes = 0;
+			bool refused = false;
+		};
+
+		/*
+		* @returns the counters of all stages, including those of objects that are gone since the last reset().
+		* Empty if the metrics are not compiled in.
+		*/
+		FF_WRAPPER_API std::vector<stage_snapshot> snapshot();
+
+		/*
+		* Zeroes all counters, forgets the stages of objects that are gone, and clears the trace events.
+		*/
+		FF_WRAPPER_API void reset() noexcept;
+
+		/*
+		* Starts/stops recording every call as a trace event. Off by default.
+		* Does nothing if the metrics are not compiled in.
+		* 
+		* @param max_events at most how many events are kept. Events beyond are dropped and counted.
+		*/
+		FF_WRAPPER_API void set_tracing(bool on, size_t max_events = 1 << 20) noexcept;
+		FF_WRAPPER_API bool tracing() noexcept;
+
+		/*
+		* @returns how many events have been dropped because there were already max_events.
+		*/
+		FF_WRAPPER_API size_t num_dropped_trace_events() noexcept;
+
+		/*
+		* Writes the trace events recorded in the Chrome trace (JSON object) format,
+		* which chrome://tracing and Perfetto open. Each call is a complete ("X") event
+		* named after its stage, whose category is its object, on the thread that made it.
+		*/
+		FF_WRAPPER_API void write_chrome_trace(std::ostream& os);
+	}
+}
+
+// These are used inside the instrumented methods.
+// FF_METRICS_SAMPLE(p, ind) times the rest of the scope into the ind-th stage of probe p.
+// FF_METRICS_ADD(items, bytes) and FF_METRICS_REFUSE() describe the call. They need a FF_METRICS_SAMPLE before them.
+#ifdef FF_WRAPPER_ENABLE_METRICS
+#define FF_METRICS_SAMPLE(p, ind) ::ff::metrics::scoped_sample ff_metrics_sample_((p).get(ind))
+#define FF_METRICS_ADD(items, bytes) ff_metrics_sample_.add((items), (bytes))
+#define FF_METRICS_REFUSE() ff_metrics_sample_.refuse()
+#else
+#define FF_METRICS_SAMPLE(p, ind) ((void)0)
+#define FF_METRICS_ADD(items, bytes) ((void)0)
+#define FF_METRICS_REFUSE() ((void)0)
+#endif // FF_WRAPPER_ENABLE_METRICS
@@ -0,0 +1,175 @@
+#pragma once
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+* spsc_queue.h:
+* Defines a bounded lock-free single-producer single-consumer queue.
+* 
+* Header only.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace ff
+{
+	/*
+	* A bounded lock-free queue (a ring buffer) for exactly one producer thread
+	* and exactly one consumer thread.
+	* 
+	* The producer may only call try_push().
+	* The consumer may only call front(), pop(), and try_pop().
+	* Anyone may call size(), empty(), and capacity(), but
+	* size() and empty() are only snapshots when the other thread is active.
+	* 
+	* It never blocks. Waiting for it to become non-empty/non-full is up to you.
+	* 
+	* No need to be DLL imported/exported, because this is a template
+	* and header only.
+	* 
+	* Invariants:
+	*	0 <= tail - head <= capacity (indices are taken modulo the number of slots),
+	*	the slots in [head, tail) hold the queued elements.
+	*/
+	template <typename T>
+	requires std::is_default_constructible_v<T> && std::is_move_assignable_v<T>
+	class spsc_queue final
+	{
+	public:
+		/*
+		* @param capacity at most how many elements can be queued.
+		* @throws std::invalid_argument if capacity is 0.
+		*/
+		explicit spsc_queue(size_t capacity)
+			: num_slots(capacity + 1)
+		{
+			if (0 == capacity)
+			{
+				throw std::invalid_argument("The capacity must be > 0.");
+			}
+
+			// One slot is always empty to tell a full queue from an empty one.
+			slots = std::make_unique<T[]>(num_slots);
+		}
+
+		spsc_queue(const spsc_queue&) = delete;
+		spsc_queue& operator=(const spsc_queue&) = delete;
+
+	public:
+		/*
+		* Producer only.
+		* Moves v into the queue if it's not full.
+		* 
+		* @returns true if v has been queued; false if the queue is full, and v is untouched.
+		*/
+		bool try_push(T&& v)
+		{
+			const size_t t = tail.load(std::memory_order_relaxed);
+			const size_t next = increment(t);
+			if (next == head.load(std::memory_order_acquire))
+			{
+				// Full
+				return false;
+			}
+
+			slots[t] = std::move(v);
+			tail.store(next, std::memory_order_release);
+			return true;
+		}
+
+		/*
+		* Consumer only.
+		* 
+		* @returns the element at the front, or nullptr if the queue is empty.
+		* It stays valid until you pop it.
+		*/
+		T* front() noexcept
+		{
+			const size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire))
+			{
+				return nullptr;
+			}
+
+			return &slots[h];
+		}
+
+		/*
+		* Consumer only.
+		* Removes the element at the front. The queue must not be empty.
+		* The slot is reset to a default constructed T, so that its resources are released now.
+		*/
+		void pop()
+		{
+			const size_t h = head.load(std::memory_order_relaxed);
+			slots[h] = T();
+			head.store(increment(h), std::memory_order_release);
+		}
+
+		/*
+		* Consumer only.
+		* Moves the element at the front to out and removes it if the queue is not empty.
+		* 
+		* @returns true if an element has been moved to out; false if the queue is empty.
+		*/
+		bool try_pop(T& out)
+		{
+			T* p = front();
+			if (nullptr == p)
+			{
+				return false;
+			}
+
+			out = std::move(*p);
+			pop();
+			return true;
+		}
+
+		size_t size() const noexcept
+		{
+			const size_t h = head.load(std::memory_order_acquire);
+			const size_t t = tail.load(std::memory_order_acquire);
+			return t >= h ? t - h : t + num_slots - h;
+		}
+
+		bool empty() const noexcept { return 0 == size(); }
+
+		size_t capacity() const noexcept { return num_slots - 1; }
+
+	private:
+		size_t increment(size_t i) const noexcept
+		{
+			return i + 1 == num_slots ? 0 : i + 1;
+		}
+
+	private:
+		// So that the producer and the consumer don't keep invalidating each other's cache line.
+		static constexpr size_t cache_line_size = 64;
+
+		const size_t num_slots;
+		std::unique_ptr<T[]> slots;
+
+		// Where the consumer pops next.
+		alignas(cache_line_size) std::atomic<size_t> head = 0;
+		// Where the producer pushes next.
+		alignas(cache_line_size) std::atomic<size_t> tail = 0;
+	};
+}
@@ -0,0 +1,113 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+
+#include "../../ff_wrapper/sws/abr_transformer.h"
+
+#include <vector>
+
+int main()
+{
+	// Test invalid arguments
+	{
+		ff::frame::data_properties ip(AV_PIX_FMT_YUV420P, 1920, 1080);
+		ff::frame::data_properties op(AV_PIX_FMT_YUV420P, 1280, 720);
+		ff::channel_layout cl;
+		ff::frame::data_properties ap(AV_SAMPLE_FMT_FLTP, 1024, cl);
+
+		TEST_ASSERT_THROWS(ff::abr_transformer(std::vector<ff::frame::data_properties>(), ip), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::abr_transformer({ op }, ap), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::abr_transformer({ op, ap }, ip), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::abr_transformer({ op }, ip, ff::frame_transformer::FF_SWS_BICUBIC, -1), std::invalid_argument);
+	}
+
+	ff::frame::data_properties ip(AV_PIX_FMT_YUV420P, 1920, 1080);
+	// Not in order on purpose.
+	std::vector<ff::frame::data_properties> rungs
+	{
+		ff::frame::data_properties(AV_PIX_FMT_YUV420P, 640, 360),
+		ff::frame::data_properties(AV_PIX_FMT_YUV420P, 1280, 720),
+		ff::frame::data_properties(AV_PIX_FMT_RGB24, 854, 480),
+		ff::frame::data_properties(AV_PIX_FMT_YUV420P, 854, 480),
+		ff::frame::data_properties(AV_PIX_FMT_YUV420P, 1920, 1080)
+	};
+
+	// Test the plan
+	{
+		ff::abr_transformer t(rungs, ip);
+		TEST_ASSERT_EQUALS(rungs.size(), t.num_rungs(), "Should have all the rungs.");
+		TEST_ASSERT_EQUALS(ip, t.src_properties(), "Should be equal.");
+		for (size_t i = 0; i < rungs.size(); ++i)
+		{
+			TEST_ASSERT_EQUALS(rungs[i], t.rung_properties(i), "Should keep the order.");
+		}
+
+		// The largest is scaled from the source.
+		TEST_ASSERT_EQUALS(-1, t.source_of(4), "Nothing is larger.");
+		TEST_ASSERT_EQUALS(4, t.source_of(1), "From the nearest larger rung.");
+		TEST_ASSERT_EQUALS(1, t.source_of(3), "From the nearest larger rung.");
+		TEST_ASSERT_EQUALS(3, t.source_of(0), "From the nearest larger rung.");
+		// A different pixel format would lose quality.
+		TEST_ASSERT_EQUALS(-1, t.source_of(2), "From the source.");
+		TEST_ASSERT_THROWS(t.source_of(rungs.size()), std::out_of_range);
+
+		ff::abr_transformer no_cascade(rungs, ip, ff::frame_transformer::FF_SWS_BICUBIC, 0, false);
+		for (size_t i = 0; i < rungs.size(); ++i)
+		{
+			TEST_ASSERT_EQUALS(-1, no_cascade.source_of(i), "Should all be from the source.");
+		}
+	}
+
+	// Test converting frames
+	{
+		ff::abr_transformer t(rungs, ip);
+
+		ff::frame invalid_in(true);
+		invalid_in.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 1280, 720));
+		TEST_ASSERT_THROWS(t.convert_frame(invalid_in), std::invalid_argument);
+
+		ff::frame in(true);
+		in.allocate_data(ip);
+		in->pts = 42;
+
+		std::vector<ff::frame> out = t.convert_frame(in);
+		TEST_ASSERT_EQUALS(rungs.size(), out.size(), "One per rung.");
+		for (size_t i = 0; i < rungs.size(); ++i)
+		{
+			TEST_ASSERT_TRUE(out[i].ready(), "Should be ready.");
+			TEST_ASSERT_EQUALS(rungs[i], out[i].get_data_properties(), "Should have the properties of the rung.");
+			TEST_ASSERT_EQUALS(42, out[i]->pts, "Should copy src's properties.");
+		}
+
+		// The outputs come from pools and are reused once released.
+		std::vector<const void*> old_data;
+		for (auto& f : out)
+		{
+			old_data.push_back(f.data());
+		}
+		out.clear();
+		t.convert_frame(out, in);
+		bool reused = true;
+		for (size_t i = 0; i < rungs.size(); ++i)
+		{
+			reused = reused && old_data[i] == out[i].data();
+		}
+		TEST_ASSERT_TRUE(reused, "Should reuse the released buffers.");
+	}
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+
+#include "../../ff_wrapper/swr/audio_reframer.h"
+
+#include <cstdint>
+
+// @returns a frame of n samples in s16 mono, each of which is its index since the start (mod 2^15).
+ff::frame make_counting(int n, int64_t start)
+{
+	ff::frame f(true);
+	f.allocate_data(ff::frame::data_properties(AV_SAMPLE_FMT_S16, n, ff::ff_AV_CHANNEL_LAYOUT_MONO));
+	int16_t* data = reinterpret_cast<int16_t*>(f->data[0]);
+	for (int i = 0; i < n; ++i)
+	{
+		data[i] = (int16_t)((start + i) % 32768);
+	}
+	f->pts = start;
+	return f;
+}
+
+int main()
+{
+	ff::frame::data_properties props(AV_SAMPLE_FMT_S16, 1024, ff::ff_AV_CHANNEL_LAYOUT_MONO);
+
+	// Test invalid arguments
+	{
+		ff::frame::data_properties vp(AV_PIX_FMT_YUV420P, 800, 600);
+		ff::frame::data_properties zero(AV_SAMPLE_FMT_S16, 0, ff::ff_AV_CHANNEL_LAYOUT_MONO);
+
+		TEST_ASSERT_THROWS(ff::audio_reframer(vp, 44100), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::audio_reframer(zero, 44100), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::audio_reframer(props, 0), std::invalid_argument);
+
+		ff::audio_reframer r(props, 44100);
+		TEST_ASSERT_EQUALS(1024, r.frame_size(), "Should be equal.");
+
+		ff::frame wrong(true);
+		wrong.allocate_data(ff::frame::data_properties(AV_SAMPLE_FMT_S16, 100, ff::ff_AV_CHANNEL_LAYOUT_STEREO));
+		TEST_ASSERT_THROWS(r.feed_frame(wrong), std::invalid_argument);
+	}
+
+	// Test reframing
+	{
+		ff::audio_reframer r(props, 44100);
+
+		const int num_in = 30, in_size = 700;
+		int64_t num_out_samples = 0;
+		int num_out = 0;
+		bool sized = true, counting = true, pts_ok = true;
+
+		auto check = [&](ff::frame& f)
+		{
+			const int16_t* data = reinterpret_cast<const int16_t*>(f->data[0]);
+			for (int i = 0; i < f->nb_samples; ++i)
+			{
+				counting = counting && data[i] == (int16_t)((num_out_samples + i) % 32768);
+			}
+			pts_ok = pts_ok && f->pts == num_out_samples;
+			num_out_samples += f->nb_samples;
+			++num_out;
+		};
+
+		for (int i = 0; i < num_in; ++i)
+		{
+			r.feed_frame(make_counting(in_size, (int64_t)i * in_size));
+			while (true)
+			{
+				ff::frame f = r.get_frame();
+				if (f.destroyed())
+				{
+					break;
+				}
+				sized = sized && 1024 == f->nb_samples;
+				check(f);
+			}
+			TEST_ASSERT_TRUE(r.buffered_samples() < 1024, "Should have given out all full frames.");
+		}
+		TEST_ASSERT_TRUE(sized, "Should all be of the frame size.");
+
+		r.signal_no_more_food();
+		TEST_ASSERT_THROWS(r.feed_frame(make_counting(10, 0)), std::logic_error);
+
+		ff::frame last = r.get_frame();
+		TEST_ASSERT_FALSE(last.destroyed(), "Should give out the rest.");
+		TEST_ASSERT_EQUALS((num_in * in_size) % 1024, last->nb_samples, "Should be the rest.");
+		check(last);
+		TEST_ASSERT_TRUE(r.get_frame().destroyed(), "Nothing is left.");
+
+		TEST_ASSERT_TRUE(counting, "Should keep the samples in order.");
+		TEST_ASSERT_TRUE(pts_ok, "Should have contiguous pts.");
+		TEST_ASSERT_EQUALS((int64_t)num_in * in_size, num_out_samples, "Should lose nothing.");
+
+		// Can be used again.
+		r.reset();
+		TEST_ASSERT_EQUALS(0, r.buffered_samples(), "Should have forgotten everything.");
+		r.feed_frame(make_counting(2048, 100));
+		ff::frame f = r.get_frame();
+		TEST_ASSERT_EQUALS(100, f->pts, "Should take the new pts.");
+	}
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+
+#include "../../ff_wrapper/swr/audio_transformer.h"
+
+#include <cmath>
+#include <cstdlib> // For std::llabs().
+#include <cstdint>
+
+// @returns a frame of n samples of a 440 Hz sine in packed s16 stereo, starting at sample start.
+ff::frame make_sine(int n, int64_t start, int rate)
+{
+	ff::frame f(true);
+	f.allocate_data(ff::frame::data_properties(AV_SAMPLE_FMT_S16, n, ff::ff_AV_CHANNEL_LAYOUT_STEREO));
+	int16_t* data = reinterpret_cast<int16_t*>(f->data[0]);
+	for (int i = 0; i < n; ++i)
+	{
+		const double t = (double)(start + i) / rate;
+		const int16_t v = (int16_t)(16384 * std::sin(2 * 3.14159265358979 * 440 * t));
+		data[2 * i] = v;
+		data[2 * i + 1] = v;
+	}
+	f->sample_rate = rate;
+	f->pts = start;
+	return f;
+}
+
+int main()
+{
+	ff::frame::data_properties s16_stereo(AV_SAMPLE_FMT_S16, 0, ff::ff_AV_CHANNEL_LAYOUT_STEREO);
+	ff::frame::data_properties flt_stereo(AV_SAMPLE_FMT_FLTP, 0, ff::ff_AV_CHANNEL_LAYOUT_STEREO);
+	ff::frame::data_properties flt_mono(AV_SAMPLE_FMT_FLTP, 0, ff::ff_AV_CHANNEL_LAYOUT_MONO);
+
+	// Test invalid arguments
+	{
+		ff::frame::data_properties vp(AV_PIX_FMT_YUV420P, 800, 600);
+
+		TEST_ASSERT_THROWS(ff::audio_transformer(vp, 44100, s16_stereo, 44100), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::audio_transformer(flt_stereo, 44100, vp, 44100), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::audio_transformer(flt_stereo, 0, s16_stereo, 44100), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::audio_transformer(flt_stereo, 44100, s16_stereo, -1), std::invalid_argument);
+
+		ff::audio_transformer t(flt_stereo, 44100, s16_stereo, 44100);
+		TEST_ASSERT_EQUALS(s16_stereo.fmt, t.src_properties().fmt, "Should be equal.");
+		TEST_ASSERT_EQUALS(flt_stereo.fmt, t.dst_properties().fmt, "Should be equal.");
+		TEST_ASSERT_EQUALS(44100, t.src_sample_rate(), "Should be equal.");
+
+		// Wrong format
+		ff::frame wrong(true);
+		wrong.allocate_data(ff::frame::data_properties(AV_SAMPLE_FMT_DBL, 100, ff::ff_AV_CHANNEL_LAYOUT_STEREO));
+		TEST_ASSERT_THROWS(t.convert_frame(wrong), std::invalid_argument);
+		// Wrong rate
+		ff::frame wrong_rate = make_sine(100, 0, 48000);
+		TEST_ASSERT_THROWS(t.convert_frame(wrong_rate), std::invalid_argument);
+	}
+
+	// Test changing only the sample format
+	{
+		ff::audio_transformer t(flt_stereo, 44100, s16_stereo, 44100);
+
+		ff::frame src = make_sine(1024, 0, 44100);
+		ff::frame dst = t.convert_frame(src);
+		TEST_ASSERT_EQUALS(1024, dst->nb_samples, "Nothing is kept inside without resampling.");
+		TEST_ASSERT_EQUALS(44100, dst->sample_rate, "Should have the dst rate.");
+		TEST_ASSERT_EQUALS(0, dst->pts, "Should have the pts.");
+
+		const int16_t* in = reinterpret_cast<const int16_t*>(src->data[0]);
+		bool same = true;
+		for (int c = 0; c < 2; ++c)
+		{
+			const float* out = reinterpret_cast<const float*>(dst->data[c]);
+			for (int i = 0; i < 1024; ++i)
+			{
+				same = same && std::fabs(out[i] - in[2 * i + c] / 32768.0f) < 1e-4f;
+			}
+		}
+		TEST_ASSERT_TRUE(same, "Should have converted each sample.");
+	}
+
+	// Test resampling and downmixing
+	{
+		ff::audio_transformer t(flt_mono, 48000, s16_stereo, 44100);
+
+		const int num_frames = 20, frame_size = 1024;
+		int64_t total = 0;
+		int64_t expected_pts = -1;
+		bool contiguous = true;
+		for (int i = 0; i < num_frames; ++i)
+		{
+			ff::frame dst = t.convert_frame(make_sine(frame_size, (int64_t)i * frame_size, 44100));
+			TEST_ASSERT_EQUALS(1, dst->ch_layout.nb_channels, "Should be downmixed.");
+			if (dst->nb_samples > 0)
+			{
+				if (-1 != expected_pts)
+				{
+					// Off by one at most because of rounding.
+					contiguous = contiguous && std::llabs(dst->pts - expected_pts) <= 1;
+				}
+				expected_pts = dst->pts + dst->nb_samples;
+			}
+			total += dst->nb_samples;
+		}
+		TEST_ASSERT_TRUE(t.delay() >= 0, "Cannot be negative.");
+
+		while (true)
+		{
+			ff::frame rest = t.flush();
+			if (rest.destroyed())
+			{
+				break;
+			}
+			contiguous = contiguous && std::llabs(rest->pts - expected_pts) <= 1;
+			expected_pts = rest->pts + rest->nb_samples;
+			total += rest->nb_samples;
+		}
+		TEST_ASSERT_TRUE(contiguous, "The pts should be contiguous.");
+
+		const int64_t expected = (int64_t)num_frames * frame_size * 48000 / 44100;
+		TEST_ASSERT_TRUE(std::llabs(total - expected) <= 1, "Should have resampled all samples.");
+	}
+
+	return 0;
+}
@@ -0,0 +1,209 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/codec/bitstream_filter.h"
+#include "../../ff_wrapper/formats/remuxer.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/formats/muxer.h"
+#include "../../ff_wrapper/formats/stream.h"
+
+extern "C"
+{
+#include <libavcodec/packet.h>
+}
+
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_h264(const std::string& file_path)
+{
+	std::string cmd(FFMPEG_EXECUTABLE_PATH
+		" -f lavfi -i testsrc=duration=2:size=320x240:rate=25"
+		" -f lavfi -i sine=duration=2:frequency=440:sample_rate=44100"
+		" -c:v libx264 -g 10 -c:a aac -y ");
+	cmd += std::string("\"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// @returns how many packets each stream in the file has.
+std::vector<int> count_packets(const fs::path& path)
+{
+	ff::demuxer d(path);
+	std::vector<int> ret(d.num_streams());
+	ff::packet pkt;
+	while (d.demux_next_packet(pkt))
+	{
+		++ret[pkt->stream_index];
+	}
+	return ret;
+}
+
+// @returns true iff the payload begins with an Annex B start code.
+bool starts_with_start_code(const ff::packet& pkt)
+{
+	const AVPacket* p = pkt.av_packet();
+	return p->size >= 4 && 0 == p->data[0] && 0 == p->data[1]
+		&& (1 == p->data[2] || (0 == p->data[2] && 1 == p->data[3]));
+}
+
+int main()
+{
+	FF_TEST_START
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "bsf_test.mp4");
+	create_test_h264(test_path.generic_string());
+	const auto in_counts = count_packets(test_path);
+
+	// Test the basics
+	{
+		TEST_ASSERT_TRUE(ff::bitstream_filter::exists("h264_mp4toannexb"), "Should have h264_mp4toannexb.");
+		TEST_ASSERT_FALSE(ff::bitstream_filter::exists("no_such_filter"), "Should not have a made-up filter.");
+
+		ff::demuxer dem(test_path);
+		const ff::stream vs = dem.get_stream(dem.get_video_ind(0));
+		const ff::stream as = dem.get_stream(dem.get_audio_ind(0));
+		TEST_ASSERT_EQUALS(std::string("h264_mp4toannexb"), ff::bitstream_filter::annexb_filter_for(vs.properties()),
+			"MP4 keeps H.264 length-prefixed.");
+		TEST_ASSERT_TRUE(ff::bitstream_filter::annexb_filter_for(as.properties()).empty(), "AAC needs no Annex B filter.");
+
+		TEST_ASSERT_THROWS(ff::bitstream_filter("no_such_filter", vs), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::bitstream_filter("h264_mp4toannexb", as), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::bitstream_filter("", vs.properties(), ff::zero_rational), std::invalid_argument);
+	}
+
+	// An empty chain passes the packets through unchanged, sharing their payloads
+	{
+		ff::demuxer dem(test_path);
+		const int iv = dem.get_video_ind(0);
+		ff::bitstream_filter bsf("", dem.get_stream(iv));
+		TEST_ASSERT_THROWS(bsf.feed_packet(ff::packet(true)), std::invalid_argument);
+
+		int n_in = 0, n_out = 0;
+		ff::packet pkt, out(true);
+		while (dem.demux_next_packet(pkt))
+		{
+			if (iv != pkt->stream_index)
+			{
+				continue;
+			}
+			++n_in;
+
+			TEST_ASSERT_TRUE(bsf.feed_packet(pkt), "The null filter should never be full.");
+			while (bsf.filter_packet(out))
+			{
+				++n_out;
+				TEST_ASSERT_EQUALS(pkt->data, out->data, "Should not copy the payload.");
+				TEST_ASSERT_EQUALS(pkt->pts, out->pts, "Should keep the timestamps.");
+			}
+		}
+		bsf.signal_no_more_food();
+		TEST_ASSERT_THROWS(bsf.signal_no_more_food(), std::logic_error);
+		TEST_ASSERT_FALSE(bsf.filter_packet(out), "Should hold nothing.");
+		TEST_ASSERT_TRUE(bsf.drained(), "Should be drained.");
+		TEST_ASSERT_EQUALS(n_in, n_out, "Should give out every packet.");
+
+		bsf.reset();
+		TEST_ASSERT_FALSE(bsf.no_more_food(), "Should be fed again after reset().");
+	}
+
+	// h264_mp4toannexb
+	{
+		ff::demuxer dem(test_path);
+		const int iv = dem.get_video_ind(0);
+		ff::bitstream_filter bsf("h264_mp4toannexb", dem.get_stream(iv));
+		TEST_ASSERT_TRUE(ff::bitstream_filter::annexb_filter_for(bsf.out_properties()).empty(),
+			"The output should already be Annex B.");
+
+		int n_out = 0;
+		ff::packet pkt;
+		while (dem.demux_next_packet(pkt))
+		{
+			if (iv != pkt->stream_index)
+			{
+				continue;
+			}
+
+			while (!bsf.feed_packet(pkt))
+			{
+				for (ff::packet out = bsf.filter_packet(); out.ready(); out = bsf.filter_packet())
+				{
+					++n_out;
+				}
+			}
+			for (ff::packet out = bsf.filter_packet(); out.ready(); out = bsf.filter_packet())
+			{
+				TEST_ASSERT_TRUE(starts_with_start_code(out), "Should begin with a start code.");
+				++n_out;
+			}
+		}
+		bsf.signal_no_more_food();
+		for (ff::packet out = bsf.filter_packet(); out.ready(); out = bsf.filter_packet())
+		{
+			++n_out;
+		}
+		TEST_ASSERT_EQUALS(in_counts[iv], n_out, "Should give out every packet.");
+	}
+
+	// Move
+	{
+		ff::demuxer dem(test_path);
+		ff::bitstream_filter b1("h264_mp4toannexb", dem.get_stream(dem.get_video_ind(0)));
+		ff::bitstream_filter b2(std::move(b1));
+		TEST_ASSERT_EQUALS(nullptr, b1.av_bsf_context(), "Should be taken over.");
+		TEST_ASSERT_TRUE(nullptr != b2.av_bsf_context(), "Should take it over.");
+	}
+
+	// MP4 to MPEG-TS through the remuxer
+	fs::path ts_path(working_dir / "bsf_test_out.ts");
+	{
+		ff::demuxer dem(test_path);
+		ff::muxer mux(ts_path);
+		ff::remuxer r(dem, mux);
+		const int iv = dem.get_video_ind(0);
+		TEST_ASSERT_THROWS(r.set_bitstream_filter(dem.num_streams(), "h264_mp4toannexb"), std::out_of_range);
+		r.set_bitstream_filter(iv, ff::bitstream_filter::annexb_filter_for(dem.get_stream(iv).properties()));
+
+		const size_t n = r.run();
+		TEST_ASSERT_EQUALS(in_counts[0] + in_counts[1], (int)n, "Should mux all the packets.");
+		TEST_ASSERT_THROWS(r.set_bitstream_filter(iv, ""), std::logic_error);
+	}
+	TEST_ASSERT_EQUALS(in_counts, count_packets(ts_path), "Should have copied every packet.");
+	{
+		ff::demuxer dem(ts_path);
+		ff::packet pkt;
+		while (dem.demux_next_packet(pkt))
+		{
+			if (dem.get_video_ind(0) == pkt->stream_index)
+			{
+				TEST_ASSERT_TRUE(starts_with_start_code(pkt), "Should be Annex B in MPEG-TS.");
+				break;
+			}
+		}
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/codec/capability_registry.h"
+#include "../../ff_wrapper/codec/encoder.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/formats/muxer.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main()
+{
+	FF_TEST_START
+
+	const ff::capability_registry& reg = ff::capability_registry::get();
+	TEST_ASSERT_EQUALS(&reg, &ff::capability_registry::get(), "Should be built only once.");
+
+	// Concurrent first use from several threads sees the same registry.
+	{
+		std::vector<const ff::capability_registry*> seen(4, nullptr);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < seen.size(); ++i)
+		{
+			threads.emplace_back([&seen, i]() { seen[i] = &ff::capability_registry::get(); });
+		}
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+		for (auto* p : seen)
+		{
+			TEST_ASSERT_EQUALS(&reg, p, "Should be the same registry.");
+		}
+	}
+
+	// Lookups
+	{
+		TEST_ASSERT_FALSE(reg.encoder_ids().empty(), "Should have some encoders.");
+		TEST_ASSERT_TRUE(std::is_sorted(reg.encoder_ids().begin(), reg.encoder_ids().end()), "Should be sorted.");
+
+		const ff::codec_capabilities* aac = reg.encoder(AV_CODEC_ID_AAC);
+		TEST_ASSERT_TRUE(nullptr != aac, "Should have an AAC encoder.");
+		TEST_ASSERT_TRUE(aac->is_encoder(), "Should be an encoder.");
+		TEST_ASSERT_EQUALS(AVMEDIA_TYPE_AUDIO, aac->type(), "AAC is audio.");
+		TEST_ASSERT_EQUALS(avcodec_find_encoder(AV_CODEC_ID_AAC), aac->av_codec(), "Should be what FFmpeg picks.");
+		TEST_ASSERT_EQUALS(aac, reg.codec(aac->av_codec()), "Should find it by pointer.");
+		TEST_ASSERT_EQUALS(reg.encoder(std::string(aac->name())), aac, "Should find it by name.");
+
+		const ff::codec_capabilities* h264_dec = reg.decoder(AV_CODEC_ID_H264);
+		TEST_ASSERT_TRUE(nullptr != h264_dec, "Should have an H.264 decoder.");
+		TEST_ASSERT_FALSE(h264_dec->is_encoder(), "Should be a decoder.");
+
+		TEST_ASSERT_EQUALS(nullptr, reg.encoder(std::string("no_such_codec")), "Should find nothing.");
+		TEST_ASSERT_EQUALS(nullptr, reg.decoder(AV_CODEC_ID_NONE), "Should find nothing.");
+		TEST_ASSERT_EQUALS(nullptr, reg.muxer(std::string("no_such_muxer")), "Should find nothing.");
+	}
+
+	// Consistent with codec_base
+	{
+		ff::encoder venc(AV_CODEC_ID_MPEG4);
+		const ff::codec_capabilities& vc = venc.capabilities();
+		TEST_ASSERT_EQUALS(reg.encoder(AV_CODEC_ID_MPEG4), &vc, "Should be the registry's entry.");
+		TEST_ASSERT_TRUE(vc.knows_v_pixel_formats(), "mpeg4 lists its pixel formats.");
+		TEST_ASSERT_EQUALS(venc.supported_v_pixel_formats().size(), vc.v_pixel_formats().size(), "Should be consistent.");
+		for (AVPixelFormat f : vc.v_pixel_formats())
+		{
+			TEST_ASSERT_TRUE(vc.supports_v_pixel_format(f), "Should be consistent.");
+			TEST_ASSERT_TRUE(venc.is_v_pixel_format_supported(f), "Should be consistent.");
+		}
+		TEST_ASSERT_FALSE(vc.supports_v_pixel_format(AV_PIX_FMT_NONE), "Should not support none.");
+		TEST_ASSERT_FALSE(vc.supports_a_sample_format(AV_SAMPLE_FMT_FLTP), "A video codec has no sample formats.");
+		TEST_ASSERT_THROWS(venc.is_a_sample_rate_supported(44100), std::logic_error);
+
+		ff::encoder aenc("aac");
+		const ff::codec_capabilities& ac = aenc.capabilities();
+		for (AVSampleFormat f : ac.a_sample_formats())
+		{
+			TEST_ASSERT_TRUE(aenc.is_a_sample_format_supported(f), "Should be consistent.");
+		}
+		for (int r : ac.a_sample_rates())
+		{
+			TEST_ASSERT_TRUE(ac.supports_a_sample_rate(r), "Should be consistent.");
+		}
+		for (const AVChannelLayout& l : ac.a_channel_layouts())
+		{
+			TEST_ASSERT_TRUE(aenc.is_a_channel_layout_supported(l), "Should be consistent.");
+		}
+		TEST_ASSERT_EQUALS(aenc.first_supported_a_sample_format(), ac.a_sample_formats()[0], "Should be consistent.");
+	}
+
+	// Muxers
+	{
+		const ff::muxer_capabilities* mp4 = reg.muxer(std::string("mp4"));
+		TEST_ASSERT_TRUE(nullptr != mp4, "Should have mp4.");
+		TEST_ASSERT_FALSE(mp4->default_codec_depends_on_url(), "mp4 doesn't look at the url.");
+		TEST_ASSERT_TRUE(mp4->knows_codecs(), "mp4 has a tag table.");
+		TEST_ASSERT_TRUE(mp4->supports_codec(AV_CODEC_ID_AAC), "mp4 stores AAC.");
+		TEST_ASSERT_TRUE(mp4->supports_codec(AV_CODEC_ID_MPEG4), "mp4 stores MPEG-4.");
+		TEST_ASSERT_FALSE(mp4->supports_codec(AV_CODEC_ID_NONE), "Should not store none.");
+		TEST_ASSERT_TRUE(std::binary_search(mp4->supported_codecs().begin(), mp4->supported_codecs().end(), AV_CODEC_ID_AAC),
+			"Should be listed in order.");
+		TEST_ASSERT_EQUALS(AV_CODEC_ID_NONE, mp4->default_codec(AVMEDIA_TYPE_DATA), "Should have no data codec.");
+
+		const ff::muxer_capabilities* image2 = reg.muxer(std::string("image2"));
+		if (nullptr != image2)
+		{
+			TEST_ASSERT_TRUE(image2->default_codec_depends_on_url(), "image2 picks by the extension.");
+		}
+
+		// muxer::desired_encoder_id() goes through the registry and should agree with av_guess_codec().
+		fs::path working_dir(fs::current_path());
+		for (const char* ext : { ".mp4", ".mkv", ".ts" })
+		{
+			fs::path path(working_dir / (std::string("capability_test") + ext));
+			ff::muxer m(path);
+			for (AVMediaType t : { AVMEDIA_TYPE_VIDEO, AVMEDIA_TYPE_AUDIO })
+			{
+				const AVCodecID expected = av_guess_codec(m.av_fmt_ctx()->oformat, nullptr,
+					path.generic_string().c_str(), nullptr, t);
+				TEST_ASSERT_EQUALS(expected, m.desired_encoder_id(t), "Should agree with av_guess_codec().");
+				TEST_ASSERT_EQUALS(expected, reg.muxer(m.av_fmt_ctx()->oformat)->default_codec(t), "Should agree with av_guess_codec().");
+			}
+		}
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,309 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/chunked_transcoder.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/formats/muxer.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/codec/encoder.h"
+#include "../../ff_wrapper/sws/frame_transformer.h"
+
+#include <algorithm>
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <format> // For std::format().
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#define LAVFI_VIDEO_FMT_STR " -f lavfi -i testsrc=duration={}:size={}x{}:rate={} "
+
+// A keyframe every second, so that there are many places to cut.
+#define TEST_VIDEO_FMT_STR \
+FFMPEG_EXECUTABLE_PATH LAVFI_VIDEO_FMT_STR " -g {} -y "
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_video(const std::string& file_path, int w, int h, int rate, int duration)
+{
+	std::string cmd
+	(
+		std::format(TEST_VIDEO_FMT_STR,
+			duration, w, h, rate, rate)
+	);
+	cmd += std::string("\"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// @returns how many frames are decoded from the first video stream in the file.
+int count_video_frames(const fs::path& path)
+{
+	ff::demuxer d(path);
+	ff::decoder dec(d.get_video(0));
+	const int ind = d.get_video_ind(0);
+
+	int num = 0;
+	ff::frame f;
+	auto take_frames = [&]()
+	{
+		while (dec.decode_frame(f))
+		{
+			++num;
+		}
+	};
+
+	ff::packet pkt;
+	while (d.demux_next_packet(pkt))
+	{
+		if (ind != pkt->stream_index)
+		{
+			continue;
+		}
+
+		while (!dec.feed_packet(pkt))
+		{
+			take_frames();
+		}
+		take_frames();
+	}
+	dec.signal_no_more_food();
+	take_frames();
+
+	return num;
+}
+
+// Sets the properties of enc for the frames of dec and creates it with options.
+void setup_encoder(ff::encoder& enc, const ff::decoder& dec, const ff::dict& options = ff::dict())
+{
+	ff::codec_properties dec_p(dec.get_codec_properties());
+	ff::codec_properties enc_p(enc.get_codec_properties());
+	enc_p.set_time_base(dec_p.time_base());
+	enc_p.set_v_width(dec_p.v_width());
+	enc_p.set_v_height(dec_p.v_height());
+	enc_p.set_v_sar(dec_p.v_sar());
+	try
+	{
+		enc_p.set_v_pixel_format(enc.first_supported_v_pixel_format());
+	}
+	catch (const std::domain_error&)
+	{
+		enc_p.set_v_pixel_format(dec_p.v_pixel_format());
+	}
+	enc_p.set_v_frame_rate(dec_p.v_frame_rate());
+	enc.set_codec_properties(enc_p);
+	enc.create_codec_context(options);
+}
+
+int main()
+{
+	FF_TEST_START
+
+	// Test planning on an artificial index
+	{
+		using entry = ff::demuxer::index_entry;
+		// Keyframes at 0, 3 (open: 2 comes after it), 5, 8. And 10 frames.
+		ff::demuxer::keyframe_index index(1);
+		index[0] =
+		{
+			entry{ 0, 0, -1, true }, entry{ 1, 1, -1, false },
+			entry{ 3, 2, -1, true }, entry{ 2, 3, -1, false }, entry{ 4, 4, -1, false },
+			entry{ 5, 5, -1, true }, entry{ 6, 6, -1, false }, entry{ 7, 7, -1, false },
+			entry{ 8, 8, -1, true }, entry{ 9, 9, -1, false }
+		};
+
+		TEST_ASSERT_THROWS(ff::chunked_transcoder::plan_chunks(index, 1, 1), std::out_of_range);
+		TEST_ASSERT_THROWS(ff::chunked_transcoder::plan_chunks(index, 0, 0), std::invalid_argument);
+
+		// As short as possible: at every closed boundary.
+		auto chunks = ff::chunked_transcoder::plan_chunks(index, 0, 1);
+		TEST_ASSERT_EQUALS(3, (int)chunks.size(), "Should cut at 5 and 8, but not at the open 3.");
+		TEST_ASSERT_EQUALS(0LL, (long long)chunks[0].start_pts, "Should start at the first keyframe.");
+		TEST_ASSERT_EQUALS(5LL, (long long)chunks[0].end_pts, "Should end at the next closed boundary.");
+		TEST_ASSERT_EQUALS(5, chunks[0].num_frames, "Should count the frames in it.");
+		TEST_ASSERT_EQUALS(8LL, (long long)chunks[2].start_pts, "Should start at the last boundary.");
+		TEST_ASSERT_EQUALS((long long)AV_NOPTS_VALUE, (long long)chunks[2].end_pts, "The last one goes to the end.");
+		TEST_ASSERT_EQUALS(2, chunks[2].num_frames, "Should count the frames in it.");
+		for (int i = 0; i < (int)chunks.size(); ++i)
+		{
+			TEST_ASSERT_EQUALS(i, chunks[i].index, "Should be numbered in order.");
+		}
+
+		// Longer.
+		chunks = ff::chunked_transcoder::plan_chunks(index, 0, 6);
+		TEST_ASSERT_EQUALS(2, (int)chunks.size(), "Should cut only at 8.");
+		TEST_ASSERT_EQUALS(8, chunks[0].num_frames, "Should count the frames in it.");
+
+		// A scene begins at 6, so the boundary at 5 is skipped for the one at 8, the first after it.
+		chunks = ff::chunked_transcoder::plan_chunks(index, 0, 1, { 6 });
+		TEST_ASSERT_EQUALS(2, (int)chunks.size(), "Should cut only after the scene cut.");
+		TEST_ASSERT_EQUALS(8LL, (long long)chunks[0].end_pts, "Should end at the first boundary after the scene cut.");
+		// But not longer than twice the minimal duration: 5 - 0 >= 2 * 2.
+		chunks = ff::chunked_transcoder::plan_chunks(index, 0, 2, { 6 });
+		TEST_ASSERT_EQUALS(3, (int)chunks.size(), "Should cut a long chunk without a scene cut anyway.");
+
+		TEST_ASSERT_TRUE(ff::chunked_transcoder::plan_chunks(ff::demuxer::keyframe_index(1), 0, 1).empty(), "Nothing to cut.");
+	}
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "chunked_test.mp4");
+	fs::path test_out_path(working_dir / "chunked_test_out.avi");
+	create_test_video(test_path.generic_string(), 320, 240, 24, 4);
+
+	ff::demuxer dem(test_path);
+	dem.build_keyframe_index();
+	const int vind = dem.get_video_ind(0);
+
+	auto make_encoder = [&](const ff::decoder& dec)
+	{
+		auto enc = std::make_unique<ff::encoder>(AV_CODEC_ID_MPEG4);
+		setup_encoder(*enc, dec);
+		return enc;
+	};
+	auto make_transformer = [](const ff::decoder& dec, const ff::encoder& enc)
+	{
+		return std::make_unique<ff::frame_transformer>(enc, dec);
+	};
+
+	TEST_ASSERT_THROWS
+	(
+		ff::chunked_transcoder(test_path, dem.get_keyframe_index(), vind, ff::chunked_transcoder::encoder_factory()),
+		std::invalid_argument
+	);
+	TEST_ASSERT_THROWS
+	(
+		ff::chunked_transcoder(test_path, dem.get_keyframe_index(), dem.num_streams(), make_encoder),
+		std::out_of_range
+	);
+
+	// Chunks of a second.
+	const auto tb = dem.get_video(0).time_base();
+	const auto chunks = ff::chunked_transcoder::plan_chunks
+	(
+		dem.get_keyframe_index(), vind, static_cast<int64_t>(tb.av_rational().den / tb.av_rational().num)
+	);
+	TEST_ASSERT_EQUALS(4, (int)chunks.size(), "Should cut at every keyframe.");
+	int num_frames = 0;
+	for (const auto& c : chunks)
+	{
+		num_frames += c.num_frames;
+	}
+	TEST_ASSERT_EQUALS(96, num_frames, "The chunks should hold all frames.");
+
+	{
+		ff::decoder template_dec(dem.get_video(0));
+		ff::muxer mux(test_out_path);
+		auto template_enc = make_encoder(template_dec);
+		auto ovs = mux.add_stream(*template_enc);
+		mux.prepare_muxer();
+
+		ff::chunked_transcoder ct(test_path, dem.get_keyframe_index(), vind, make_encoder, make_transformer, 3);
+		TEST_ASSERT_EQUALS(3, ct.get_num_workers(), "Should have the workers given.");
+		const size_t num_muxed = ct.run(chunks, mux, ovs);
+		mux.finalize();
+
+		TEST_ASSERT_EQUALS(96, (int)num_muxed, "Should have muxed a packet per frame.");
+	}
+
+	TEST_ASSERT_EQUALS(96, count_video_frames(test_out_path), "Should have all the frames transcoded.");
+
+	// A chunk that ends in the middle of a GOP of a stream with B-frames,
+	// so that the decoder still holds frames when the end comes.
+	{
+		fs::path bf_path(working_dir / "chunked_test_bf.mp4");
+		std::string cmd
+		(
+			std::format(FFMPEG_EXECUTABLE_PATH LAVFI_VIDEO_FMT_STR " -c:v libx264 -bf 3 -g 48 -y ", 2, 320, 240, 24)
+		);
+		cmd += std::string("\"") + bf_path.generic_string() + '\"';
+		std::system(cmd.c_str());
+
+		ff::demuxer bf_dem(bf_path);
+		bf_dem.build_keyframe_index();
+		const int bf_vind = bf_dem.get_video_ind(0);
+
+		std::vector<int64_t> all_pts;
+		for (const auto& e : bf_dem.get_keyframe_index()[bf_vind])
+		{
+			all_pts.push_back(e.pts);
+		}
+		std::sort(all_pts.begin(), all_pts.end());
+
+		ff::chunk_description c;
+		c.start_pts = all_pts[0];
+		c.end_pts = all_pts[10];
+		c.num_frames = 10;
+		auto res = ff::chunked_transcoder::transcode_chunk
+		(
+			bf_path, bf_dem.get_keyframe_index(), bf_vind, c, make_encoder, make_transformer
+		);
+		TEST_ASSERT_EQUALS(10, (int)res.packets.size(), "Should stop at the end of the chunk.");
+	}
+
+	// Stitching chunks encoded with B-frames, each of which starts before 0 in dts.
+	{
+		fs::path bf_path(working_dir / "chunked_test_bf_in.mp4");
+		fs::path bf_out_path(working_dir / "chunked_test_bf_out.avi");
+		std::string cmd
+		(
+			std::format(FFMPEG_EXECUTABLE_PATH LAVFI_VIDEO_FMT_STR " -c:v libx264 -bf 3 -g 24 -y ", 4, 320, 240, 24)
+		);
+		cmd += std::string("\"") + bf_path.generic_string() + '\"';
+		std::system(cmd.c_str());
+
+		ff::demuxer bf_dem(bf_path);
+		bf_dem.build_keyframe_index();
+		const int bf_vind = bf_dem.get_video_ind(0);
+		const auto bf_tb = bf_dem.get_video(0).time_base();
+		const auto bf_chunks = ff::chunked_transcoder::plan_chunks
+		(
+			bf_dem.get_keyframe_index(), bf_vind, static_cast<int64_t>(bf_tb.av_rational().den / bf_tb.av_rational().num)
+		);
+		TEST_ASSERT_TRUE(bf_chunks.size() > 1, "Should cut into several chunks.");
+
+		auto make_bf_encoder = [](const ff::decoder& dec)
+		{
+			auto enc = std::make_unique<ff::encoder>("libx264");
+			ff::dict options;
+			options.insert_entry("bf", "3");
+			setup_encoder(*enc, dec, options);
+			return enc;
+		};
+
+		{
+			ff::decoder template_dec(bf_dem.get_video(0));
+			ff::muxer mux(bf_out_path);
+			auto template_enc = make_bf_encoder(template_dec);
+			auto ovs = mux.add_stream(*template_enc);
+			mux.prepare_muxer();
+
+			ff::chunked_transcoder ct(bf_path, bf_dem.get_keyframe_index(), bf_vind, make_bf_encoder, make_transformer, 2);
+			const size_t num_muxed = ct.run(bf_chunks, mux, ovs);
+			mux.finalize();
+
+			TEST_ASSERT_EQUALS(96, (int)num_muxed, "Should have muxed a packet per frame.");
+		}
+
+		TEST_ASSERT_EQUALS(96, count_video_frames(bf_out_path), "Should have all the frames transcoded.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,173 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+#include "../../ff_wrapper/codec/codec_pool.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+int main()
+{
+	FF_TEST_START
+
+	ff::codec_properties dp;
+	dp.set_type_video();
+	dp.set_id(AVCodecID::AV_CODEC_ID_MPEG4);
+	dp.set_v_width(320);
+	dp.set_v_height(240);
+	dp.set_v_pixel_format(AVPixelFormat::AV_PIX_FMT_YUV420P);
+
+	// Test getting and recycling decoders
+	{
+		ff::codec_pool pool;
+		TEST_ASSERT_EQUALS(0, pool.number_idle_codecs(), "Should be empty initially.");
+
+		ff::decoder d1 = pool.get_decoder(dp);
+		TEST_ASSERT_TRUE(d1.ready(), "Should be ready.");
+		TEST_ASSERT_TRUE(d1.hungry(), "Should be hungry.");
+		TEST_ASSERT_EQUALS(1, pool.number_misses(), "Should have been opened.");
+		const AVCodecContext* ctx1 = d1.av_codec_ctx();
+
+		pool.recycle(d1);
+		TEST_ASSERT_TRUE(d1.destroyed(), "Should be destroyed after recycled.");
+		TEST_ASSERT_EQUALS(1, pool.number_idle_codecs(), "Should be kept.");
+		// Nothing happens.
+		pool.recycle(d1);
+		TEST_ASSERT_EQUALS(1, pool.number_idle_codecs(), "Should still be one kept.");
+
+		ff::decoder d2 = pool.get_decoder(dp);
+		TEST_ASSERT_TRUE(ctx1 == d2.av_codec_ctx(), "Should be the one kept.");
+		TEST_ASSERT_TRUE(d2.hungry() && !d2.full() && !d2.no_more_food(), "Should have been reset.");
+		TEST_ASSERT_EQUALS(1, pool.number_hits(), "Should have been served by the pool.");
+		TEST_ASSERT_EQUALS(0, pool.number_idle_codecs(), "Should be given out.");
+
+		// A decoder drained and recycled can decode again.
+		d2.signal_no_more_food();
+		pool.recycle(d2);
+		ff::decoder d3 = pool.get_decoder(dp);
+		TEST_ASSERT_FALSE(d3.no_more_food(), "Should have been reset.");
+
+		// Different properties or options give different decoders.
+		ff::codec_properties dp2(dp);
+		dp2.set_v_width(640);
+		pool.recycle(d3);
+		ff::decoder d4 = pool.get_decoder(dp2);
+		TEST_ASSERT_EQUALS(2, pool.number_misses(), "Different properties should not hit.");
+
+		ff::dict o1;
+		o1.insert_entry("threads", "1");
+		o1.insert_entry("skip_frame", "nonref");
+		ff::decoder d5 = pool.get_decoder(dp, o1);
+		TEST_ASSERT_EQUALS(3, pool.number_misses(), "Different options should not hit.");
+		pool.recycle(d5);
+
+		// The order of the options doesn't matter.
+		ff::dict o2;
+		o2.insert_entry("skip_frame", "nonref");
+		o2.insert_entry("threads", "1");
+		ff::decoder d6 = pool.get_decoder(dp, o2);
+		TEST_ASSERT_EQUALS(3, pool.number_misses(), "The same options should hit.");
+
+		pool.recycle(d4);
+		pool.recycle(d6);
+		TEST_ASSERT_EQUALS(3, pool.number_idle_codecs(), "All should be kept.");
+
+		// The key goes with the codec, even when it's moved, and only its pool takes it back.
+		{
+			ff::codec_pool other;
+			ff::decoder from_other = other.get_decoder(dp);
+			ff::decoder moved(std::move(from_other));
+			pool.recycle(moved);
+			TEST_ASSERT_TRUE(moved.destroyed(), "Should be destroyed anyway.");
+			TEST_ASSERT_EQUALS(3, pool.number_idle_codecs(), "Should not keep another pool's codec.");
+
+			ff::decoder kept = other.get_decoder(dp);
+			ff::decoder moved_again(std::move(kept));
+			other.recycle(moved_again);
+			TEST_ASSERT_EQUALS(1, other.number_idle_codecs(), "Should keep its own codec after a move.");
+
+			// Destroyed instead of recycled: nothing to clean up in the pool.
+			{
+				ff::decoder dropped = other.get_decoder(dp);
+			}
+			TEST_ASSERT_EQUALS(0, other.number_idle_codecs(), "The dropped one was the one kept.");
+		}
+		pool.clear();
+		TEST_ASSERT_EQUALS(0, pool.number_idle_codecs(), "Should be closed.");
+
+		ff::codec_properties bad(dp);
+		bad.set_id(AVCodecID::AV_CODEC_ID_NONE);
+		TEST_ASSERT_THROWS(pool.get_decoder(bad), std::invalid_argument);
+	}
+
+	// Test the limit and warming up
+	{
+		ff::codec_pool pool(2);
+
+		pool.warm_up_decoders(3, dp);
+		TEST_ASSERT_EQUALS(2, pool.number_idle_codecs(), "Should keep at most 2 per key.");
+
+		ff::decoder d1 = pool.get_decoder(dp);
+		ff::decoder d2 = pool.get_decoder(dp);
+		ff::decoder d3 = pool.get_decoder(dp);
+		TEST_ASSERT_EQUALS(2, pool.number_hits(), "Should be served by those warmed up.");
+		TEST_ASSERT_EQUALS(1, pool.number_misses(), "The third should be opened.");
+
+		pool.recycle(d1);
+		pool.recycle(d2);
+		pool.recycle(d3);
+		TEST_ASSERT_EQUALS(2, pool.number_idle_codecs(), "Should keep at most 2 per key.");
+		TEST_ASSERT_TRUE(d3.destroyed(), "Should be closed even if not kept.");
+	}
+
+	// Test encoders
+	{
+		ff::codec_pool pool;
+
+		ff::codec_properties ep;
+		ep.set_type_video();
+		ep.set_id(AVCodecID::AV_CODEC_ID_PNG);
+		ep.set_time_base(ff::common_video_time_base_600);
+		ep.set_v_pixel_format(AVPixelFormat::AV_PIX_FMT_RGB24);
+		ep.set_v_width(320);
+		ep.set_v_height(240);
+
+		TEST_ASSERT_THROWS(pool.get_encoder("no such encoder", ep), std::invalid_argument);
+		TEST_ASSERT_THROWS(pool.get_encoder(AVCodecID::AV_CODEC_ID_NONE, ep), std::invalid_argument);
+
+		// Fresh ones are kept whether or not they can be flushed.
+		pool.warm_up_encoders(1, "png", ep);
+		TEST_ASSERT_EQUALS(1, pool.number_idle_codecs(), "Should be kept.");
+
+		// By name or by ID is the same.
+		ff::encoder e1 = pool.get_encoder(AVCodecID::AV_CODEC_ID_PNG, ep);
+		TEST_ASSERT_EQUALS(1, pool.number_hits(), "Should be served by the one warmed up.");
+		TEST_ASSERT_TRUE(e1.ready(), "Should be ready.");
+
+		const bool can_flush = e1->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH;
+		e1.signal_no_more_food();
+		pool.recycle(e1);
+		TEST_ASSERT_TRUE(e1.destroyed(), "Should be destroyed after recycled.");
+		TEST_ASSERT_EQUALS(can_flush ? 1 : 0, pool.number_idle_codecs(), "Should only be kept if it can be flushed.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,230 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/formats/custom_io.h"
+#include "../../ff_wrapper/formats/mmap_io.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/formats/muxer.h"
+
+#include <algorithm>
+#include <cstdio> // For SEEK_SET etc
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <format> // For std::format().
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <libavformat/avio.h>
+}
+
+namespace fs = std::filesystem;
+
+#define LAVFI_VIDEO_FMT_STR " -f lavfi -i testsrc=duration={}:size={}x{}:rate={} "
+#define LAVFI_AUDIO_FMT_STR " -f lavfi -i sine=duration={}:frequency={}:sample_rate={} "
+
+#define TEST_AV_FMT_STR \
+FFMPEG_EXECUTABLE_PATH LAVFI_VIDEO_FMT_STR LAVFI_AUDIO_FMT_STR " -y "
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_av
+(
+	const std::string& file_path, int duration,
+	int w, int h, int rate,
+	int frequency, int sample_rate
+)
+{
+	std::string cmd
+	(
+		std::format(TEST_AV_FMT_STR,
+			duration, w, h, rate,
+			duration, frequency, sample_rate)
+	);
+	cmd += std::string("\"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// @returns how many packets the demuxer gives.
+int count_packets(ff::demuxer& dem)
+{
+	int ret = 0;
+	ff::packet pkt;
+	while (dem.demux_next_packet(pkt))
+	{
+		++ret;
+	}
+	return ret;
+}
+
+std::vector<uint8_t> read_file(const fs::path& path)
+{
+	std::ifstream is(path, std::ios::binary);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+}
+
+int main()
+{
+	FF_TEST_START
+
+	// Test memory_io by itself
+	{
+		TEST_ASSERT_THROWS(ff::memory_io(0), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::memory_io(nullptr, 10), std::invalid_argument);
+
+		ff::memory_io w;
+		const uint8_t bytes[] = { 1, 2, 3, 4, 5 };
+		TEST_ASSERT_EQUALS(5, w.write(bytes, 5), "Should write all.");
+		TEST_ASSERT_EQUALS(5, (int)w.size(), "Should grow.");
+		// Seek back and overwrite.
+		TEST_ASSERT_EQUALS(1, (int)w.seek(1, SEEK_SET), "Should seek.");
+		TEST_ASSERT_EQUALS(2, w.write(bytes, 2), "Should write all.");
+		TEST_ASSERT_EQUALS(5, (int)w.size(), "Overwriting doesn't grow.");
+		TEST_ASSERT_EQUALS(5, (int)w.seek(0, AVSEEK_SIZE), "Should give the size.");
+		// Past the end.
+		TEST_ASSERT_EQUALS(7, (int)w.seek(2, SEEK_END), "Writing can seek past the end.");
+		TEST_ASSERT_EQUALS(1, w.write(bytes, 1), "Should write all.");
+		const std::vector<uint8_t> expected{ 1, 1, 2, 4, 5, 0, 0, 1 };
+		TEST_ASSERT_EQUALS(expected, std::vector<uint8_t>(w.data(), w.data() + w.size()), "Should be what's written.");
+
+		auto taken = w.take_data();
+		TEST_ASSERT_EQUALS(expected, taken, "Should take what's written.");
+		TEST_ASSERT_EQUALS(0, (int)w.size(), "Should be empty after taking.");
+
+		ff::memory_io r(bytes, sizeof(bytes));
+		uint8_t buf[4];
+		TEST_ASSERT_EQUALS(4, r.read(buf, 4), "Should read 4.");
+		TEST_ASSERT_EQUALS(1, r.read(buf, 4), "Should read the rest.");
+		TEST_ASSERT_EQUALS(0, r.read(buf, 4), "Should be at the end.");
+		TEST_ASSERT_TRUE(r.seek(1, SEEK_END) < 0, "Reading cannot seek past the end.");
+		TEST_ASSERT_TRUE(r.seek(-1, SEEK_SET) < 0, "Cannot seek before the start.");
+		TEST_ASSERT_TRUE(r.write(bytes, 1) < 0, "Cannot write to referenced bytes.");
+		TEST_ASSERT_EQUALS(3, (int)r.seek(-2, SEEK_END), "Should seek from the end.");
+		TEST_ASSERT_EQUALS(2, r.read(buf, 4), "Should read from there.");
+		TEST_ASSERT_EQUALS(4, (int)buf[0], "Should read from there.");
+	}
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "test_custom_io.mp4");
+	create_test_av(test_path.generic_string(), 3, 320, 240, 24, 440, 44100);
+
+	ff::demuxer from_file(test_path);
+	const int num_packets = count_packets(from_file);
+
+	// Demux from memory
+	{
+		ff::memory_io io(read_file(test_path));
+		ff::demuxer dem(io);
+		TEST_ASSERT_EQUALS(from_file.num_streams(), dem.num_streams(), "Should find the same streams.");
+		TEST_ASSERT_EQUALS(num_packets, count_packets(dem), "Should demux the same packets.");
+
+		// Seeking works, too.
+		dem.seek(dem.get_video_ind(0), 0);
+		TEST_ASSERT_EQUALS(num_packets, count_packets(dem), "Should demux all again after seeking to the start.");
+	}
+
+	// Demux from a mapped file
+	{
+		TEST_ASSERT_THROWS(ff::mmap_io(working_dir / "does_not_exist.mp4"), fs::filesystem_error);
+
+		ff::mmap_io io(test_path);
+		TEST_ASSERT_EQUALS(fs::file_size(test_path), io.size(), "Should map the whole file.");
+		ff::demuxer dem(io);
+		TEST_ASSERT_EQUALS(num_packets, count_packets(dem), "Should demux the same packets.");
+	}
+
+	// Demux through callbacks
+	{
+		const auto bytes = read_file(test_path);
+		size_t pos = 0;
+		// Without seeking. mp4 needs seeking, so use another format.
+		ff::memory_io mkv_io;
+		{
+			ff::demuxer dem(test_path);
+			ff::muxer mux(mkv_io, "matroska");
+			for (int i = 0; i < dem.num_streams(); ++i)
+			{
+				mux.add_stream(dem.get_stream(i));
+			}
+			mux.prepare_muxer();
+
+			ff::packet pkt;
+			while (dem.demux_next_packet(pkt))
+			{
+				pkt.prepare_for_muxing(mux.get_stream(pkt->stream_index));
+				mux.mux_packet_auto(pkt);
+			}
+			mux.finalize();
+		}
+		TEST_ASSERT_TRUE(mkv_io.size() > 0, "Should have muxed into memory.");
+
+		const auto mkv = mkv_io.take_data();
+		ff::callback_io io
+		(
+			[&](uint8_t* buf, int size)
+			{
+				const int n = std::min<size_t>(size, mkv.size() - pos);
+				std::copy(mkv.begin() + pos, mkv.begin() + pos + n, buf);
+				pos += n;
+				return n;
+			}
+		);
+		TEST_ASSERT_FALSE(io.seekable(), "Doesn't have a seek callback.");
+		TEST_ASSERT_THROWS(ff::callback_io(ff::callback_io::read_function()), std::invalid_argument);
+
+		ff::demuxer dem(io, true, ff::dict(), "matroska");
+		TEST_ASSERT_EQUALS(from_file.num_streams(), dem.num_streams(), "Should find the same streams.");
+		TEST_ASSERT_EQUALS(num_packets, count_packets(dem), "Should demux the same packets.");
+	}
+
+	// Mux into memory, with seeking, as mp4
+	{
+		ff::memory_io unused;
+		TEST_ASSERT_THROWS(ff::muxer(unused, ""), std::invalid_argument);
+
+		ff::memory_io out;
+		{
+			ff::demuxer dem(test_path);
+			ff::muxer mux(out, "mp4");
+			for (int i = 0; i < dem.num_streams(); ++i)
+			{
+				mux.add_stream(dem.get_stream(i));
+			}
+			mux.prepare_muxer();
+
+			ff::packet pkt;
+			while (dem.demux_next_packet(pkt))
+			{
+				pkt.prepare_for_muxing(mux.get_stream(pkt->stream_index));
+				mux.mux_packet_auto(pkt);
+			}
+			mux.finalize();
+		}
+
+		ff::memory_io in(out.take_data());
+		ff::demuxer dem(in);
+		TEST_ASSERT_EQUALS(num_packets, count_packets(dem), "Should demux what was muxed.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -18,11 +18,14 @@
 
 #include "../../ff_wrapper/codec/decoder.h"
 #include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/util/hw_device.h"
 
 #include <cstdlib> // For std::system().
 #include <filesystem> // For path handling as a demuxer requires an absolute path.
 #include <format> // For std::format().
+#include <span>
 #include <string>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -834,6 +837,303 @@ int main()
 		TEST_ASSERT_TRUE(f.destroyed(), "f should have been made destroyed.");
 	}
 
+
+	// Test the threading policy
+	{
+		fs::path test1_path(working_dir / "decoder_test1.mp4");
+		// Already created.
+		//create_test_video(test1_path_str, "libx265", "green", 800, 600, 24, 5);
+
+		// Decodes the whole video and returns the number of frames.
+		auto decode_all = [](ff::demuxer& dem, ff::decoder& dec) -> int
+		{
+			int num_frames = 0;
+			ff::frame f(true);
+			while (true)
+			{
+				ff::packet pkt = dem.demux_next_packet();
+				if (pkt.destroyed())
+				{
+					break;
+				}
+				dec.feed_packet(pkt);
+				while (dec.decode_frame(f))
+				{
+					++num_frames;
+				}
+			}
+			dec.signal_no_more_food();
+			while (dec.decode_frame(f))
+			{
+				++num_frames;
+			}
+			return num_frames;
+		};
+
+		ff::demuxer dem1(test1_path);
+		ff::decoder dec1(dem1.get_stream(0), ff::decoder::threading_policy::single_threaded());
+		TEST_ASSERT_EQUALS(1, dec1.active_num_threads(), "Should use only one thread.");
+		TEST_ASSERT_EQUALS(0, dec1.frame_threading_delay(), "A single thread cannot add delay.");
+		// Cannot change the policy once ready.
+		TEST_ASSERT_THROWS(dec1.set_threading_policy(ff::decoder::threading_policy()), std::logic_error);
+		int num_single = decode_all(dem1, dec1);
+
+		ff::demuxer dem2(test1_path);
+		ff::decoder dec2(dem2.get_stream(0).codec_id());
+		TEST_ASSERT_THROWS(dec2.set_threading_policy(ff::decoder::threading_policy(-1)), std::invalid_argument);
+		TEST_ASSERT_THROWS(dec2.set_threading_policy(ff::decoder::threading_policy(2, 4)), std::invalid_argument);
+		dec2.set_codec_properties(dem2.get_stream(0).properties());
+		dec2.set_threading_policy(ff::decoder::threading_policy(4, ff::decoder::FF_THREADING_FRAME));
+		dec2.create_codec_context();
+		TEST_ASSERT_EQUALS(4, dec2.active_num_threads(), "Should use the number of threads asked.");
+		if (dec2.active_threading_types() & ff::decoder::FF_THREADING_FRAME)
+		{
+			TEST_ASSERT_EQUALS(3, dec2.frame_threading_delay(), "Should hold one frame per extra thread.");
+		}
+		// Threading must not change what is decoded.
+		TEST_ASSERT_EQUALS(num_single, decode_all(dem2, dec2), "Should decode the same number of frames.");
+
+		// Automatic
+		ff::demuxer dem3(test1_path);
+		ff::decoder dec3(dem3.get_stream(0));
+		TEST_ASSERT_TRUE(dec3.active_num_threads() >= 1, "Should have found a number of threads.");
+		TEST_ASSERT_EQUALS(num_single, decode_all(dem3, dec3), "Should decode the same number of frames.");
+	}
+
+	// Test skipping frames
+	{
+		fs::path gop_path(working_dir / "decoder_test_gop.mp4");
+		std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=4:size=320x240:rate=25 -c:v mpeg4 -g 10 -y ");
+		cmd += std::string("\"") + gop_path.generic_string() + '\"';
+		std::system(cmd.c_str());
+
+		int num_packets = 0, num_keys = 0;
+		{
+			ff::demuxer dem(gop_path);
+			ff::packet pkt;
+			while (dem.demux_next_packet(pkt))
+			{
+				++num_packets;
+				num_keys += 0 != (pkt->flags & AV_PKT_FLAG_KEY);
+			}
+		}
+		TEST_ASSERT_TRUE(num_keys > 1 && num_keys < num_packets, "Should have several GOPs.");
+
+		// Decodes what the demuxer gives and returns the number of frames.
+		auto decode_all = [](ff::demuxer& dem, ff::decoder& dec) -> int
+		{
+			int num_frames = 0;
+			ff::frame f(true);
+			ff::packet pkt;
+			while (dem.demux_next_packet(pkt))
+			{
+				dec.feed_packet(pkt);
+				while (dec.decode_frame(f))
+				{
+					++num_frames;
+				}
+			}
+			dec.signal_no_more_food();
+			while (dec.decode_frame(f))
+			{
+				++num_frames;
+			}
+			return num_frames;
+		};
+
+		// The decoder skips
+		{
+			ff::demuxer dem(gop_path);
+			ff::decoder dec(dem.get_stream(0));
+			TEST_ASSERT_THROWS(dec.set_skip_policy(ff::decoder::skip_policy((AVDiscard)5)), std::invalid_argument);
+			dec.set_skip_policy(ff::decoder::skip_policy::keyframes_only());
+			TEST_ASSERT_EQUALS(AVDISCARD_NONKEY, dec.get_skip_policy().frames, "Should have set the policy.");
+			TEST_ASSERT_EQUALS(AVDISCARD_DEFAULT, dec.get_skip_policy().loop_filter, "Should have set the policy.");
+			TEST_ASSERT_EQUALS(num_keys, decode_all(dem, dec), "Should decode only the keyframes.");
+		}
+
+		// The demuxer drops
+		{
+			ff::demuxer dem(gop_path);
+			TEST_ASSERT_THROWS(dem.set_discard(dem.num_streams(), AVDISCARD_NONKEY), std::out_of_range);
+			dem.set_discard(0, AVDISCARD_NONKEY);
+			TEST_ASSERT_EQUALS(AVDISCARD_NONKEY, dem.get_discard(0), "Should have set the level.");
+
+			// Indexing still sees every packet.
+			dem.build_keyframe_index();
+			TEST_ASSERT_EQUALS(num_packets, (int)dem.get_keyframe_index()[0].size(), "Should index every packet.");
+			TEST_ASSERT_EQUALS(AVDISCARD_NONKEY, dem.get_discard(0), "Should have restored the level.");
+
+			ff::decoder dec(dem.get_stream(0));
+			dec.set_skip_policy(ff::decoder::skip_policy::fast_keyframes());
+			TEST_ASSERT_EQUALS(num_keys, decode_all(dem, dec), "Should decode only the keyframes.");
+
+			// Drop everything.
+			dem.seek(0, 0, false);
+			dem.set_discard(0, AVDISCARD_ALL);
+			ff::packet pkt;
+			TEST_ASSERT_FALSE(dem.demux_next_packet(pkt), "Should have dropped all packets.");
+		}
+	}
+
+
+	// Test decoding in batches
+	{
+		fs::path gop_path(working_dir / "decoder_test_gop.mp4");
+		// Already created.
+
+		int expected = 0;
+		{
+			ff::demuxer dem(gop_path);
+			ff::decoder dec(dem.get_stream(0));
+			ff::packet pkt;
+			ff::frame f(true);
+			while (dem.demux_next_packet(pkt))
+			{
+				dec.feed_packet(pkt);
+				while (dec.decode_frame(f))
+				{
+					++expected;
+				}
+			}
+			dec.signal_no_more_food();
+			while (dec.decode_frame(f))
+			{
+				++expected;
+			}
+		}
+
+		ff::demuxer dem(gop_path);
+		ff::decoder dec(dem.get_stream(0));
+		// Destroyed, created and ready frames alike.
+		std::vector<ff::frame> frames(3);
+		frames[0] = ff::frame(false);
+		frames[2].allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 16, 16));
+		TEST_ASSERT_THROWS(ff::decoder(AV_CODEC_ID_MPEG4).decode_frames(frames), std::logic_error);
+
+		int num_frames = 0;
+		ff::packet pkt;
+		while (dem.demux_next_packet(pkt))
+		{
+			dec.feed_packet(pkt);
+			ff::decoder::batch_result res;
+			do
+			{
+				res = dec.decode_frames(frames);
+				TEST_ASSERT_TRUE(res.count <= frames.size(), "Cannot decode more than the room.");
+				for (size_t i = 0; i < res.count; ++i)
+				{
+					TEST_ASSERT_TRUE(frames[i].ready(), "Should be ready with the decoded data.");
+				}
+				if (res.count < frames.size())
+				{
+					TEST_ASSERT_TRUE(res.hungry, "Can only stop early when hungry if not draining.");
+					TEST_ASSERT_TRUE(frames[res.count].created(), "Should be created with no data.");
+				}
+				num_frames += (int)res.count;
+			} while (!res.hungry);
+		}
+		dec.signal_no_more_food();
+		ff::decoder::batch_result res;
+		do
+		{
+			res = dec.decode_frames(frames);
+			TEST_ASSERT_FALSE(res.hungry, "Should not be hungry while draining.");
+			num_frames += (int)res.count;
+		} while (res.count == frames.size());
+		TEST_ASSERT_EQUALS(expected, num_frames, "Should decode the same frames as decode_frame().");
+		TEST_ASSERT_EQUALS(0, dec.decode_frames(frames).count, "Should have been drained.");
+		TEST_ASSERT_EQUALS(0, dec.decode_frames(std::span<ff::frame>()).count, "Nothing fits in no room.");
+	}
+
+	// Test hardware decoding
+	{
+		TEST_ASSERT_THROWS(ff::hw_device("not a device type"), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::hw_device{ AV_HWDEVICE_TYPE_NONE }, std::invalid_argument);
+
+		fs::path test1_path(working_dir / "decoder_test1.mp4");
+		// Already created.
+		//create_test_video(test1_path_str, "libx265", "green", 800, 600, 24, 5);
+
+		// The machine running the tests may not have any devices.
+		// Test every kind of device it has.
+		for (auto type : ff::hw_device::supported_types())
+		{
+			ff::hw_device* p_device = nullptr;
+			try
+			{
+				p_device = new ff::hw_device(type);
+			}
+			catch (const std::runtime_error&)
+			{
+				// No such device on this machine.
+				continue;
+			}
+			TEST_ASSERT_EQUALS(type, p_device->type(), "Should have opened the type.");
+
+			ff::demuxer dem1(test1_path);
+			ff::decoder dec1(dem1.get_stream(0).codec_id());
+			dec1.set_codec_properties(dem1.get_stream(0).properties());
+			bool enabled = dec1.enable_hardware_decoding(*p_device);
+			TEST_ASSERT_EQUALS(enabled, dec1.hardware_decoding_enabled(), "Should be consistent.");
+			// The decoder holds its own reference to the device.
+			delete p_device;
+
+			// A moved device refers to none.
+			{
+				ff::hw_device from(type);
+				ff::hw_device to(std::move(from));
+				ff::decoder dec2(dem1.get_stream(0).codec_id());
+				TEST_ASSERT_THROWS(dec2.enable_hardware_decoding(from), std::invalid_argument);
+			}
+			if (enabled)
+			{
+				TEST_ASSERT_THROWS(dec1.enable_hardware_decoding(ff::hw_device(type)), std::logic_error);
+			}
+			dec1.create_codec_context();
+			TEST_ASSERT_THROWS(dec1.enable_hardware_decoding(ff::hw_device(type)), std::logic_error);
+
+			// Whether hardware or software, decoding must work.
+			int num_frames = 0;
+			ff::frame f(true);
+			while (true)
+			{
+				ff::packet pkt = dem1.demux_next_packet();
+				if (pkt.destroyed())
+				{
+					dec1.signal_no_more_food();
+				}
+				else
+				{
+					dec1.feed_packet(pkt);
+				}
+
+				while (dec1.decode_frame(f))
+				{
+					++num_frames;
+					if (f.is_hardware())
+					{
+						TEST_ASSERT_EQUALS(dec1.hardware_pixel_format(), f.get_data_properties().fmt, "Should be the device's format.");
+						ff::frame sw = f.transfer_to_software();
+						TEST_ASSERT_FALSE(sw.is_hardware(), "Should be in the system memory now.");
+						TEST_ASSERT_EQUALS(800, sw.get_data_properties().width, "Should keep the size.");
+						TEST_ASSERT_EQUALS(600, sw.get_data_properties().height, "Should keep the size.");
+					}
+					else
+					{
+						TEST_ASSERT_THROWS(f.transfer_to_software(), std::logic_error);
+					}
+				}
+
+				if (dec1.no_more_food())
+				{
+					break;
+				}
+			}
+			TEST_ASSERT_EQUALS(5 * 24, num_frames, "Should decode all frames.");
+		}
+	}
+
 	FF_TEST_END
 
 	return 0;
@@ -18,10 +18,19 @@
 #include "../test_util.h"
 
 #include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/data/packet_pool.h"
+#include "../../ff_wrapper/formats/async_demuxer.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/formats/stream_info_cache.h"
 
 #include <cstdlib> // For std::system().
 #include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <algorithm>
 #include <format> // For std::format().
+#include <fstream>
+#include <chrono>
+#include <tuple>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -330,6 +339,423 @@ int main()
 		TEST_ASSERT_TRUE(pkt.destroyed(), "pkt should have been made destroyed.");
 	}
 
+	// Test demuxing with a packet_pool
+	{
+		fs::path test1_path(working_dir / "test1.mp4");
+		// Already created.
+		//create_test_video(test1_path_str, 1280, 720, 24, 5);
+		ff::demuxer d1(test1_path);
+		ff::packet_pool pool(4);
+
+		int num_packets = 0;
+		while (true)
+		{
+			ff::packet pkt = d1.demux_next_packet(pool);
+			if (pkt.destroyed())
+			{
+				TEST_ASSERT_TRUE(d1.eof(), "Should only fail at eof.");
+				break;
+			}
+
+			TEST_ASSERT_TRUE(pkt.ready(), "Should be ready.");
+			TEST_ASSERT_TRUE(pkt.data_size() > 0, "Should have data.");
+			++num_packets;
+
+			const AVPacket* p = pkt.av_packet();
+			pool.recycle(pkt);
+			TEST_ASSERT_TRUE(pkt.destroyed(), "Should have been given back.");
+			TEST_ASSERT_EQUALS(1, pool.number_free_packets(), "Should keep it.");
+
+			// The same AVPacket is used again.
+			ff::packet next = pool.get_packet();
+			TEST_ASSERT_TRUE(p == next.av_packet(), "Should reuse the packet.");
+			pool.recycle(next);
+		}
+		TEST_ASSERT_EQUALS(5 * 24, num_packets, "Should demux all packets.");
+		TEST_ASSERT_EQUALS(1, pool.number_free_packets(), "The one for eof is given back, too.");
+	}
+
+	// Test selecting streams
+	{
+		fs::path test_path(working_dir / "test2.wmv");
+		// Already created.
+		//create_test_av(test_path_str, 4, 800, 600, 24, 1000, 44000);
+
+		// How many packets each stream has when all are demuxed.
+		std::vector<int> counts;
+		{
+			ff::demuxer d1(test_path);
+			counts.resize(d1.num_streams());
+			ff::packet pkt;
+			while (d1.demux_next_packet(pkt))
+			{
+				++counts[pkt->stream_index];
+			}
+		}
+
+		ff::demuxer d1(test_path, false);
+		TEST_ASSERT_THROWS(d1.select_streams(std::vector<int>()), std::invalid_argument);
+		TEST_ASSERT_THROWS(d1.select_streams({ 0, d1.num_streams() }), std::out_of_range);
+		TEST_ASSERT_THROWS(d1.select_streams_by_type(-1, -1, -1), std::invalid_argument);
+		TEST_ASSERT_THROWS(d1.select_streams_by_type(0, d1.num_audios()), std::out_of_range);
+		TEST_ASSERT_TRUE(d1.is_selected(0), "A wrong selection should change nothing.");
+		TEST_ASSERT_TRUE(d1.is_selected(1), "A wrong selection should change nothing.");
+
+		// Keep only the audio, and probe it alone.
+		const int a_ind = d1.get_audio_ind(0);
+		const int v_ind = d1.get_video_ind(0);
+		d1.select_streams_by_type(-1, 0, -1, true);
+		TEST_ASSERT_TRUE(d1.is_selected(a_ind), "Should keep the audio.");
+		TEST_ASSERT_FALSE(d1.is_selected(v_ind), "Should drop the video.");
+		TEST_ASSERT_TRUE(d1.get_audio(0)->codecpar->sample_rate > 0, "Should have probed the audio.");
+
+		int num_audio = 0;
+		ff::packet pkt;
+		while (d1.demux_next_packet(pkt))
+		{
+			TEST_ASSERT_EQUALS(a_ind, pkt->stream_index, "Should only get the audio.");
+			++num_audio;
+		}
+		TEST_ASSERT_EQUALS(counts[a_ind], num_audio, "Should get all of the audio.");
+
+		// A selected stream keeps its level.
+		d1.set_discard(v_ind, AVDISCARD_NONKEY);
+		d1.select_streams({ v_ind });
+		TEST_ASSERT_EQUALS(AVDISCARD_NONKEY, d1.get_discard(v_ind), "Should keep the level.");
+		TEST_ASSERT_EQUALS(AVDISCARD_ALL, d1.get_discard(a_ind), "Should drop the audio.");
+
+		// Keep all again.
+		ff::demuxer d2(test_path);
+		d2.select_streams({ v_ind });
+		d2.select_all_streams();
+		std::vector<int> counts_again(d2.num_streams());
+		while (d2.demux_next_packet(pkt))
+		{
+			++counts_again[pkt->stream_index];
+		}
+		TEST_ASSERT_TRUE(counts == counts_again, "Should get all packets again.");
+	}
+
+	// Test the async_demuxer
+	{
+		fs::path test_path(working_dir / "test2.wmv");
+		// Already created.
+		//create_test_av(test_path_str, 4, 800, 600, 24, 1000, 44000);
+
+		// What a packet is identified by in the tests below.
+		using packet_key = std::tuple<int, int64_t, int64_t, int>;
+		auto key_of = [](const ff::packet& pkt)
+		{
+			return packet_key(pkt->stream_index, pkt->pts, pkt->dts, pkt->size);
+		};
+
+		// The packets in file order from a normal demuxer.
+		std::vector<packet_key> expected;
+		{
+			ff::demuxer d1(test_path);
+			ff::packet pkt;
+			while (d1.demux_next_packet(pkt))
+			{
+				expected.push_back(key_of(pkt));
+			}
+		}
+		TEST_ASSERT_FALSE(expected.empty(), "Should have packets.");
+
+		// Invalid arguments
+		ff::async_demuxer::read_ahead_budget zero_budget;
+		zero_budget.max_bytes = 0;
+		TEST_ASSERT_THROWS(ff::async_demuxer(test_path, zero_budget), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::async_demuxer(test_path, ff::async_demuxer::read_ahead_budget(), { 5 }), std::out_of_range);
+
+		// A tiny budget so that the reader keeps waiting for me.
+		ff::async_demuxer::read_ahead_budget tiny;
+		tiny.max_packets_per_stream = 2;
+		tiny.max_bytes = 4096;
+
+		// Charged to a memory budget, which holds the reader back, too.
+		{
+			ff::memory_budget mem(0, 8192);
+			ff::async_demuxer::read_ahead_budget charged;
+			charged.memory = &mem;
+
+			std::vector<packet_key> actual;
+			{
+				ff::async_demuxer ad(test_path, charged);
+				while (true)
+				{
+					ff::packet pkt = ad.demux_next_packet();
+					if (pkt.destroyed())
+					{
+						break;
+					}
+					actual.push_back(key_of(pkt));
+				}
+			}
+			TEST_ASSERT_TRUE(expected == actual, "Should give all the packets in file order.");
+			TEST_ASSERT_TRUE(mem.peak_bytes_in_use() > 0, "Should have charged the packets.");
+			TEST_ASSERT_EQUALS((size_t)0, mem.bytes_in_use(), "Should have released everything.");
+		}
+
+		// Same order as the normal demuxer.
+		{
+			ff::async_demuxer ad(test_path, tiny);
+			TEST_ASSERT_EQUALS(2, ad.get_demuxer().num_streams(), "Should have the streams.");
+
+			std::vector<packet_key> actual;
+			while (true)
+			{
+				ff::packet pkt = ad.demux_next_packet();
+				if (pkt.destroyed())
+				{
+					break;
+				}
+				TEST_ASSERT_TRUE(ad.queued_packets(pkt->stream_index) <= 2, "Should keep in the budget.");
+				actual.push_back(key_of(pkt));
+			}
+			TEST_ASSERT_TRUE(ad.eof(), "Should have eof.");
+			TEST_ASSERT_TRUE(expected == actual, "Should give the packets in file order.");
+			TEST_ASSERT_TRUE(ad.demux_next_packet().destroyed(), "Should stay at eof.");
+			TEST_ASSERT_EQUALS(0, ad.queued_bytes(), "Should have nothing left.");
+
+			// Seeking back to the start flushes and restarts the reader.
+			ad.seek(0, 0, false);
+			TEST_ASSERT_FALSE(ad.eof(), "Should reset eof.");
+			int num_after_seek = 0;
+			while (!ad.demux_next_packet().destroyed())
+			{
+				++num_after_seek;
+			}
+			TEST_ASSERT_EQUALS((int)expected.size(), num_after_seek, "Should read all again from the start.");
+
+			// Seek while the reader is waiting for me.
+			ad.seek(0, 0, false);
+			TEST_ASSERT_FALSE(ad.demux_next_packet().destroyed(), "Should read after the seek.");
+			ad.seek(0, 0, false);
+			num_after_seek = 0;
+			while (!ad.demux_next_packet().destroyed())
+			{
+				++num_after_seek;
+			}
+			TEST_ASSERT_EQUALS((int)expected.size(), num_after_seek, "Should discard what was read ahead.");
+
+			// Destroying it while the reader is waiting must not hang.
+			ad.seek(0, 0, false);
+		}
+
+		// Reading only one stream.
+		{
+			int v_ind = ff::demuxer(test_path).get_video_ind(0);
+			std::vector<packet_key> expected_video;
+			for (const auto& k : expected)
+			{
+				if (std::get<0>(k) == v_ind)
+				{
+					expected_video.push_back(k);
+				}
+			}
+
+			ff::async_demuxer ad(test_path, tiny, { v_ind });
+			TEST_ASSERT_THROWS(ad.demux_next_packet(1 - v_ind), std::out_of_range);
+			TEST_ASSERT_EQUALS(0, ad.queued_packets(1 - v_ind), "Not read.");
+
+			std::vector<packet_key> actual;
+			while (true)
+			{
+				ff::packet pkt = ad.demux_next_packet(v_ind);
+				if (pkt.destroyed())
+				{
+					break;
+				}
+				actual.push_back(key_of(pkt));
+			}
+			TEST_ASSERT_TRUE(expected_video == actual, "Should give all the packets of the stream in order.");
+		}
+	}
+
+	// Test the keyframe index and seek_accurate()
+	{
+		fs::path test_path(working_dir / "test1.mp4");
+		// Already created.
+		//create_test_video(test_path_str, 1280, 720, 24, 5);
+
+		ff::demuxer d1(test_path);
+		TEST_ASSERT_FALSE(d1.has_keyframe_index(), "Not built yet.");
+		TEST_ASSERT_THROWS(d1.seek_accurate(0, 0), std::logic_error);
+
+		// Read some first, so that building has to start from the start.
+		ff::packet pkt;
+		d1.demux_next_packet(pkt);
+		d1.build_keyframe_index();
+		TEST_ASSERT_TRUE(d1.has_keyframe_index(), "Should be built.");
+		TEST_ASSERT_FALSE(d1.eof(), "Should be at the start again.");
+		TEST_ASSERT_THROWS(d1.seek_accurate(-1, 0), std::out_of_range);
+
+		const int vind = d1.get_video_ind(0);
+		const auto& entries = d1.get_keyframe_index()[vind];
+		TEST_ASSERT_EQUALS(120, (int)entries.size(), "Should record every packet.");
+		TEST_ASSERT_TRUE(entries[0].keyframe, "The first one should be a keyframe.");
+
+		// Building leaves it at the start.
+		int num_packets = 0;
+		while (d1.demux_next_packet(pkt))
+		{
+			++num_packets;
+		}
+		TEST_ASSERT_EQUALS(120, num_packets, "Should read all from the start.");
+
+		// The pts of all frames, in display order.
+		std::vector<int64_t> all_pts;
+		for (const auto& e : entries)
+		{
+			all_pts.push_back(e.pts);
+		}
+		std::sort(all_pts.begin(), all_pts.end());
+
+		// Before the first keyframe, it lands on the first one.
+		{
+			auto res = d1.seek_accurate(vind, entries[0].pts - 1000);
+			TEST_ASSERT_EQUALS(entries[0].pts, res.keyframe_pts, "Should be at the first keyframe.");
+			TEST_ASSERT_EQUALS(0, res.num_frames_to_discard, "Nothing is before the timestamp.");
+		}
+
+		// Seek to some frames and check that discarding gives exactly the frame.
+		for (int target_frame : { 0, 1, 50, 119 })
+		{
+			const int64_t target = all_pts[target_frame];
+			auto res = d1.seek_accurate(vind, target);
+			TEST_ASSERT_TRUE(res.keyframe_pts <= target, "Should be at a keyframe before.");
+			TEST_ASSERT_TRUE(res.num_frames_to_discard >= 0, "Cannot be negative.");
+
+			ff::decoder dec(d1.get_video(0));
+			int num_discarded = 0;
+			int64_t first_pts = AV_NOPTS_VALUE;
+			auto take = [&]()
+			{
+				ff::frame f;
+				while (AV_NOPTS_VALUE == first_pts && dec.decode_frame(f))
+				{
+					if (num_discarded < res.num_frames_to_discard)
+					{
+						++num_discarded;
+					}
+					else
+					{
+						first_pts = f->pts;
+					}
+				}
+			};
+			while (AV_NOPTS_VALUE == first_pts && d1.demux_next_packet(pkt))
+			{
+				if (pkt->stream_index != vind)
+				{
+					continue;
+				}
+				while (!dec.feed_packet(pkt))
+				{
+					take();
+				}
+				take();
+			}
+			if (AV_NOPTS_VALUE == first_pts)
+			{
+				dec.signal_no_more_food();
+				take();
+			}
+			TEST_ASSERT_EQUALS(target, first_pts, "Should get the frame after discarding.");
+		}
+
+		// Load it into another demuxer.
+		ff::demuxer d2(test_path);
+		TEST_ASSERT_THROWS(d2.load_keyframe_index(ff::demuxer::keyframe_index()), std::invalid_argument);
+		d2.load_keyframe_index(d1.get_keyframe_index());
+		auto r1 = d1.seek_accurate(vind, all_pts[60]);
+		auto r2 = d2.seek_accurate(vind, all_pts[60]);
+		TEST_ASSERT_EQUALS(r1.keyframe_pts, r2.keyframe_pts, "Should be the same with a loaded index.");
+		TEST_ASSERT_EQUALS(r1.num_frames_to_discard, r2.num_frames_to_discard, "Should be the same with a loaded index.");
+	}
+
+	// Test stream_info_cache and opening a demuxer with what it loads
+	{
+		fs::path test_path(working_dir / "test1.mp4");
+		// Already created.
+		//create_test_video(test_path_str, 1280, 720, 24, 5);
+		const fs::path sidecar = ff::stream_info_cache::default_sidecar_path(test_path);
+		fs::remove(sidecar);
+
+		TEST_ASSERT_FALSE(ff::stream_info_cache::load(test_path).has_value(), "Nothing saved yet.");
+
+		ff::demuxer d1(test_path);
+		d1.build_keyframe_index();
+		const auto captured = ff::stream_info_cache::capture(d1);
+		ff::stream_info_cache::save(test_path, captured);
+		TEST_ASSERT_TRUE(fs::exists(sidecar), "Should be saved to the default sidecar.");
+
+		auto loaded = ff::stream_info_cache::load(test_path);
+		TEST_ASSERT_TRUE(loaded.has_value(), "Should be loaded as the file hasn't changed.");
+		TEST_ASSERT_EQUALS(captured.streams.size(), loaded->streams.size(), "Should load all the streams.");
+		TEST_ASSERT_EQUALS(captured.duration, loaded->duration, "Should load the duration.");
+		TEST_ASSERT_EQUALS(captured.index.size(), loaded->index.size(), "Should load the index.");
+
+		// Open without probing.
+		ff::demuxer d2(test_path, *loaded);
+		TEST_ASSERT_EQUALS(d1.num_streams(), d2.num_streams(), "Should have the same streams.");
+		TEST_ASSERT_EQUALS(d1.num_videos(), d2.num_videos(), "Should have the same streams.");
+		TEST_ASSERT_TRUE(d2.has_keyframe_index(), "Should have the loaded index.");
+
+		const int vind = d1.get_video_ind(0);
+		const AVCodecParameters* par1 = d1.get_stream(vind)->codecpar;
+		const AVCodecParameters* par2 = d2.get_stream(vind)->codecpar;
+		TEST_ASSERT_EQUALS(par1->codec_id, par2->codec_id, "Should have the same codec.");
+		TEST_ASSERT_EQUALS(par1->width, par2->width, "Should have the same width.");
+		TEST_ASSERT_EQUALS(par1->height, par2->height, "Should have the same height.");
+		TEST_ASSERT_EQUALS(par1->extradata_size, par2->extradata_size, "Should have the same extradata.");
+
+		const int64_t target = d1.get_keyframe_index()[vind][60].pts;
+		auto r1 = d1.seek_accurate(vind, target);
+		auto r2 = d2.seek_accurate(vind, target);
+		TEST_ASSERT_EQUALS(r1.keyframe_pts, r2.keyframe_pts, "Should seek the same.");
+		TEST_ASSERT_EQUALS(r1.num_frames_to_discard, r2.num_frames_to_discard, "Should seek the same.");
+
+		// It can decode with the cached parameters.
+		{
+			ff::decoder dec(d2.get_video(0));
+			ff::packet pkt;
+			ff::frame f;
+			bool decoded = false;
+			while (!decoded && d2.demux_next_packet(pkt))
+			{
+				if (pkt->stream_index != vind)
+				{
+					continue;
+				}
+				dec.feed_packet(pkt);
+				decoded = dec.decode_frame(f);
+			}
+			TEST_ASSERT_TRUE(decoded, "Should decode with the cached parameters.");
+		}
+
+		// Different numbers of streams.
+		{
+			ff::cached_file_info wrong = *loaded;
+			wrong.streams.emplace_back();
+			TEST_ASSERT_THROWS(ff::demuxer(test_path, wrong), std::invalid_argument);
+		}
+
+		// A broken sidecar is ignored.
+		{
+			std::ofstream os(sidecar, std::ios::binary | std::ios::trunc);
+			os << "not a sidecar";
+		}
+		TEST_ASSERT_FALSE(ff::stream_info_cache::load(test_path).has_value(), "Should ignore a broken one.");
+
+		// A stale one is ignored.
+		ff::stream_info_cache::save(test_path, captured);
+		fs::last_write_time(test_path, fs::last_write_time(test_path) + std::chrono::seconds(10));
+		TEST_ASSERT_FALSE(ff::stream_info_cache::load(test_path).has_value(), "Should ignore a stale one.");
+
+		fs::remove(sidecar);
+	}
+
 	FF_TEST_END
 
 	return 0;
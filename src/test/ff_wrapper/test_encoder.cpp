@@ -20,11 +20,13 @@
 #include "../../ff_wrapper/formats/demuxer.h"
 #include "../../ff_wrapper/codec/decoder.h"
 #include "../../ff_wrapper/data/frame.h"
+#include "../../ff_wrapper/util/hw_device.h"
 
 #include <cstdlib> // For std::system().
 #include <filesystem> // For path handling as a demuxer requires an absolute path.
 #include <format> // For std::format().
 #include <string>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -881,6 +883,204 @@ int main()
 		TEST_ASSERT_TRUE(pkt.destroyed(), "f should have been made destroyed.");
 	}
 
+	// Test encoding in batches
+	{
+		ff::encoder e1(AVCodecID::AV_CODEC_ID_GIF);
+		ff::codec_properties ep;
+
+		ep.set_v_pixel_format(e1.supported_v_pixel_formats()[0]);
+		ep.set_v_width(320);
+		ep.set_v_height(240);
+		ep.set_v_sar(ff::rational(1, 1));
+		ep.set_v_frame_rate(ff::rational(24));
+		ep.set_time_base(ff::common_video_time_base_600);
+		ep.set_type_video();
+		ep.set_id(e1.get_id());
+
+		e1.set_codec_properties(ep);
+		e1.create_codec_context();
+
+		ff::frame f(true);
+		ff::frame::data_properties fp(ep.v_pixel_format(), ep.v_width(), ep.v_height());
+		std::vector<ff::packet> pkts;
+		constexpr int num_frames = 10;
+		int num_packets = 0;
+		for (int i = 0; i < num_frames; ++i)
+		{
+			f.allocate_data(fp);
+			f->pts = i * (600 / 24);
+			TEST_ASSERT_TRUE(e1.feed_frame(f), "Should accept a frame after being drained into hunger.");
+			f.release_resources_memory();
+
+			auto res = e1.encode_packets(pkts);
+			TEST_ASSERT_TRUE(res.hungry, "Should stop only when hungry.");
+			TEST_ASSERT_TRUE(pkts.size() >= res.count, "Should have appended enough packets.");
+			for (size_t j = 0; j < res.count; ++j)
+			{
+				TEST_ASSERT_TRUE(pkts[j].ready() && pkts[j].data_size() > 0, "Should have the encoded data.");
+			}
+			num_packets += (int)res.count;
+		}
+
+		// A hungry encoder gives nothing.
+		auto res = e1.encode_packets(pkts);
+		TEST_ASSERT_EQUALS(0, res.count, "Should encode nothing when hungry.");
+		TEST_ASSERT_TRUE(res.hungry, "Should stay hungry.");
+
+		// At most max_packets.
+		e1.signal_no_more_food();
+		const size_t capacity = pkts.size();
+		while (true)
+		{
+			res = e1.encode_packets(pkts, 1);
+			TEST_ASSERT_TRUE(res.count <= 1, "Should respect max_packets.");
+			num_packets += (int)res.count;
+			if (0 == res.count)
+			{
+				break;
+			}
+		}
+		TEST_ASSERT_FALSE(res.hungry, "Being drained is not being hungry.");
+		TEST_ASSERT_EQUALS(capacity, pkts.size(), "Should have reused the packets.");
+		TEST_ASSERT_EQUALS(num_frames, num_packets, "GIF encodes one packet per frame.");
+	}
+
+	// Test hardware encoding
+	{
+		ff::encoder e1("libx264");
+		TEST_ASSERT_FALSE(e1.hardware_encoding_enabled(), "Not enabled by default.");
+		TEST_ASSERT_THROWS(e1.set_hw_frames_context(ff::frame(true)), std::invalid_argument);
+
+		fs::path test1_path(working_dir / "encoder_test_hw.mp4");
+		std::string test1_path_str(test1_path.generic_string());
+		create_test_video(test1_path_str, "libx264", "blue", 640, 480, 24, 2);
+
+		// The machine running the tests may not have any devices.
+		// Test every kind of device it has.
+		for (auto type : ff::hw_device::supported_types())
+		{
+			ff::hw_device* p_device = nullptr;
+			try
+			{
+				p_device = new ff::hw_device(type);
+			}
+			catch (const std::runtime_error&)
+			{
+				// No such device on this machine.
+				continue;
+			}
+
+			ff::demuxer dem1(test1_path);
+			ff::decoder dec1(dem1.get_stream(0).codec_id());
+			dec1.set_codec_properties(dem1.get_stream(0).properties());
+			bool enabled = dec1.enable_hardware_decoding(*p_device);
+			delete p_device;
+			if (!enabled)
+			{
+				continue;
+			}
+			dec1.create_codec_context();
+
+			// The frames context is only known after the first frame is decoded.
+			std::vector<ff::frame> frames;
+			while (true)
+			{
+				ff::packet pkt = dem1.demux_next_packet();
+				if (pkt.destroyed())
+				{
+					dec1.signal_no_more_food();
+				}
+				else
+				{
+					dec1.feed_packet(pkt);
+				}
+
+				ff::frame f = dec1.decode_frame();
+				while (f.ready())
+				{
+					frames.push_back(std::move(f));
+					f = dec1.decode_frame();
+				}
+
+				if (dec1.no_more_food())
+				{
+					break;
+				}
+			}
+			if (frames.empty() || !frames[0].is_hardware())
+			{
+				// Fell back to software.
+				continue;
+			}
+
+			// A software encoder cannot take them directly.
+			ff::encoder sw_enc("libx264");
+			sw_enc.set_properties_from_decoder(dec1);
+			TEST_ASSERT_FALSE(sw_enc.hardware_encoding_enabled(), "libx264 cannot encode hardware frames.");
+			TEST_ASSERT_FALSE(sw_enc.set_hw_frames_context(frames[0]), "libx264 cannot encode hardware frames.");
+			sw_enc.create_codec_context();
+			TEST_ASSERT_THROWS(sw_enc.feed_frame(frames[0]), std::invalid_argument);
+			TEST_ASSERT_TRUE(sw_enc.feed_frame(frames[0].transfer_to_software()), "Should accept software frames.");
+
+			// Try the hardware encoders that may work with the device.
+			for (const char* name : { "h264_nvenc", "h264_vaapi", "h264_qsv", "h264_videotoolbox" })
+			{
+				ff::encoder* p_enc = nullptr;
+				try
+				{
+					p_enc = new ff::encoder(name);
+				}
+				catch (const std::invalid_argument&)
+				{
+					// Not in this build of FFmpeg.
+					continue;
+				}
+
+				p_enc->set_properties_from_decoder(dec1);
+				if (!p_enc->hardware_encoding_enabled())
+				{
+					// Not for this device.
+					delete p_enc;
+					continue;
+				}
+				TEST_ASSERT_EQUALS(frames[0].get_data_properties().fmt, p_enc->get_codec_properties().v_pixel_format(),
+					"Should encode in the device's format.");
+				p_enc->create_codec_context();
+				TEST_ASSERT_THROWS(p_enc->feed_frame(frames[0].transfer_to_software()), std::invalid_argument);
+
+				// Feed all the frames directly.
+				int num_packets = 0;
+				for (size_t i = 0; i <= frames.size(); ++i)
+				{
+					if (i == frames.size())
+					{
+						p_enc->signal_no_more_food();
+					}
+					else
+					{
+						TEST_ASSERT_TRUE(frames[i].is_hardware(), "Should stay on the device.");
+						while (!p_enc->feed_frame(frames[i]))
+						{
+							// Full. Make room for it.
+							while (p_enc->encode_packet().ready())
+							{
+								++num_packets;
+							}
+						}
+					}
+
+					while (p_enc->encode_packet().ready())
+					{
+						++num_packets;
+					}
+				}
+				TEST_ASSERT_EQUALS((int)frames.size(), num_packets, "Should encode all frames.");
+
+				delete p_enc;
+			}
+		}
+	}
+
 	FF_TEST_END
 
 	return 0;
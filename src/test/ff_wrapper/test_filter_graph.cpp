@@ -0,0 +1,181 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+#include "../../ff_wrapper/filter/filter_graph.h"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+	// A yuv420p frame whose luma is j at column j.
+	ff::frame make_video_frame(int w, int h, int64_t pts)
+	{
+		ff::frame f(true);
+		f.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, w, h));
+		for (int i = 0; i < h; ++i)
+		{
+			uint8_t* row = f.data<uint8_t>(0) + i * f.line_size(0);
+			for (int j = 0; j < w; ++j)
+			{
+				row[j] = static_cast<uint8_t>(j);
+			}
+		}
+		for (int p = 1; p < 3; ++p)
+		{
+			for (int i = 0; i < (h + 1) / 2; ++i)
+			{
+				uint8_t* row = f.data<uint8_t>(p) + i * f.line_size(p);
+				std::fill_n(row, (w + 1) / 2, uint8_t(128));
+			}
+		}
+		f.reset_time(pts, ff::rational(1, 25), 1);
+		return f;
+	}
+}
+
+int main()
+{
+	FF_TEST_START
+
+	const ff::frame::data_properties video_dp(AV_PIX_FMT_YUV420P, 64, 48);
+	const ff::frame::data_properties audio_dp(AV_SAMPLE_FMT_S16, 1024, ff::ff_AV_CHANNEL_LAYOUT_MONO);
+	const ff::rational video_tb(1, 25);
+	const ff::rational audio_tb(1, 48000);
+
+	// Test invalid arguments
+	{
+		TEST_ASSERT_THROWS(ff::filter_graph("hflip", audio_dp, video_tb), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::filter_graph("volume=0.5", video_dp, 48000, audio_tb), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::filter_graph("hflip", video_dp, ff::zero_rational), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::filter_graph("hflip", video_dp, video_tb, -1), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::filter_graph("volume=0.5", audio_dp, 0, audio_tb), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::filter_graph("no_such_filter", video_dp, video_tb), std::invalid_argument);
+		// A video filter for audio.
+		TEST_ASSERT_THROWS(ff::filter_graph("hflip", audio_dp, 48000, audio_tb), std::invalid_argument);
+	}
+
+	// Test that frames pass through without copies
+	{
+		ff::filter_graph g("", video_dp, video_tb);
+		TEST_ASSERT_TRUE(g.v_or_a(), "Should be for video.");
+		TEST_ASSERT_TRUE(video_dp == g.dst_properties(), "Should not change the frames.");
+		TEST_ASSERT_EQUALS(video_tb, g.dst_time_base(), "Should keep the time base.");
+
+		ff::frame src = make_video_frame(64, 48, 3);
+		g.feed_frame(src);
+		ff::frame dst;
+		TEST_ASSERT_TRUE(g.filter_frame(dst), "Should pass the frame through.");
+		TEST_ASSERT_EQUALS(src.data<uint8_t>(0), dst.data<uint8_t>(0), "Should reference the same data.");
+		TEST_ASSERT_EQUALS(3, dst->pts, "Should keep the pts.");
+		TEST_ASSERT_FALSE(g.filter_frame(dst), "Should be hungry.");
+		TEST_ASSERT_TRUE(dst.created(), "Should be created with no data.");
+		TEST_ASSERT_FALSE(g.drained(), "Should not be drained yet.");
+
+		// Not the source properties.
+		TEST_ASSERT_THROWS(g.feed_frame(make_video_frame(32, 48, 4)), std::invalid_argument);
+		TEST_ASSERT_THROWS(g.feed_frame(ff::frame(true)), std::invalid_argument);
+	}
+
+	// Test filtering video on more threads
+	{
+		ff::filter_graph g("hflip,scale=32:24,format=gray", video_dp, video_tb, 2);
+		TEST_ASSERT_EQUALS(2, g.get_num_threads(), "Should keep the number of threads.");
+		auto dst_dp = g.dst_properties();
+		TEST_ASSERT_TRUE(AV_PIX_FMT_GRAY8 == dst_dp.fmt && 32 == dst_dp.width && 24 == dst_dp.height, "Should report the output properties.");
+
+		int num = 0;
+		for (int i = 0; i < 5; ++i)
+		{
+			g.feed_frame(make_video_frame(64, 48, i));
+			ff::frame f;
+			while (g.filter_frame(f))
+			{
+				TEST_ASSERT_TRUE(32 == f->width && 24 == f->height, "Should be scaled.");
+				TEST_ASSERT_EQUALS(num, f->pts, "Should keep the pts.");
+				// Flipped: the left is now the brighter.
+				TEST_ASSERT_TRUE(f.data<uint8_t>(0)[0] > f.data<uint8_t>(0)[31], "Should be flipped.");
+				++num;
+			}
+		}
+		g.signal_no_more_food();
+		TEST_ASSERT_THROWS(g.feed_frame(make_video_frame(64, 48, 5)), std::logic_error);
+		while (!g.filter_frame().destroyed())
+		{
+			++num;
+		}
+		TEST_ASSERT_TRUE(g.drained(), "Should be drained.");
+		TEST_ASSERT_EQUALS(5, num, "Should output every frame.");
+	}
+
+	// Test draining a filter that holds frames back
+	{
+		ff::filter_graph g("yadif", video_dp, video_tb);
+		int num = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			g.feed_frame(make_video_frame(64, 48, i));
+			while (!g.filter_frame().destroyed())
+			{
+				++num;
+			}
+		}
+		TEST_ASSERT_TRUE(num < 4, "yadif should hold back frames.");
+
+		g.signal_no_more_food();
+		while (!g.filter_frame().destroyed())
+		{
+			++num;
+		}
+		TEST_ASSERT_EQUALS(4, num, "Should output what's held back when drained.");
+		TEST_ASSERT_TRUE(g.drained(), "Should be drained.");
+	}
+
+	// Test audio
+	{
+		ff::filter_graph g("volume=0.5,aformat=sample_fmts=s16", audio_dp, 48000, audio_tb);
+		TEST_ASSERT_FALSE(g.v_or_a(), "Should be for audio.");
+		TEST_ASSERT_EQUALS(48000, g.dst_sample_rate(), "Should keep the sample rate.");
+		TEST_ASSERT_TRUE(g.dst_properties().ch_layout == ff::ff_AV_CHANNEL_LAYOUT_MONO, "Should keep the layout.");
+
+		ff::frame src(true);
+		src.allocate_data(audio_dp);
+		src->sample_rate = 48000;
+		std::fill_n(src.data<int16_t>(0), 1024, int16_t(1000));
+		src.reset_time(0, audio_tb, 1024);
+
+		g.feed_frame(src);
+		g.signal_no_more_food();
+		int num_samples = 0;
+		ff::frame f;
+		while (g.filter_frame(f))
+		{
+			TEST_ASSERT_EQUALS(AV_SAMPLE_FMT_S16, f->format, "Should be s16.");
+			TEST_ASSERT_EQUALS(500, f.data<int16_t>(0)[0], "Should halve the volume.");
+			num_samples += f->nb_samples;
+		}
+		TEST_ASSERT_EQUALS(1024, num_samples, "Should output every sample.");
+		TEST_ASSERT_THROWS(g.feed_frame(src), std::logic_error);
+	}
+
+	FF_TEST_END
+}
@@ -0,0 +1,157 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/formats/fragmented_muxer.h"
+#include "../../ff_wrapper/formats/custom_io.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+
+#include <cmath>
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <format> // For std::format().
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#define LAVFI_VIDEO_FMT_STR " -f lavfi -i testsrc=duration={}:size={}x{}:rate={} "
+#define LAVFI_AUDIO_FMT_STR " -f lavfi -i sine=duration={}:frequency={}:sample_rate={} "
+
+// A keyframe every second, so that there are many places to cut.
+#define TEST_AV_FMT_STR \
+FFMPEG_EXECUTABLE_PATH LAVFI_VIDEO_FMT_STR LAVFI_AUDIO_FMT_STR " -g {} -y "
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_av
+(
+	const std::string& file_path, int duration,
+	int w, int h, int rate,
+	int frequency, int sample_rate
+)
+{
+	std::string cmd
+	(
+		std::format(TEST_AV_FMT_STR,
+			duration, w, h, rate,
+			duration, frequency, sample_rate, rate)
+	);
+	cmd += std::string("\"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// @returns how many packets the demuxer gives.
+int count_packets(ff::demuxer& dem)
+{
+	int ret = 0;
+	ff::packet pkt;
+	while (dem.demux_next_packet(pkt))
+	{
+		++ret;
+	}
+	return ret;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	auto ignore = [](ff::muxed_segment&) {};
+	TEST_ASSERT_THROWS(ff::fragmented_muxer(ff::fragmented_muxer::segment_callback(), 1.0), std::invalid_argument);
+	TEST_ASSERT_THROWS(ff::fragmented_muxer(ignore, 0.0), std::invalid_argument);
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "test_fragmented_muxer.mp4");
+	create_test_av(test_path.generic_string(), 6, 320, 240, 24, 440, 44100);
+
+	int num_packets = 0;
+	{
+		ff::demuxer dem(test_path);
+		num_packets = count_packets(dem);
+	}
+
+	// Remux into segments of at least 2 seconds.
+	std::vector<ff::muxed_segment> segments;
+	{
+		ff::fragmented_muxer fm([&](ff::muxed_segment& seg) { segments.push_back(std::move(seg)); }, 2.0);
+		ff::packet pkt;
+		TEST_ASSERT_THROWS(fm.mux_packet(pkt), std::logic_error);
+		TEST_ASSERT_THROWS(fm.finalize(), std::logic_error);
+
+		ff::demuxer dem(test_path);
+		for (int i = 0; i < dem.num_streams(); ++i)
+		{
+			fm.add_stream(dem.get_stream(i));
+		}
+		fm.prepare_muxer();
+		TEST_ASSERT_EQUALS(1, fm.num_segments(), "Should give the init segment when prepared.");
+		TEST_ASSERT_EQUALS(fm.get_muxer().get_video_ind(0), fm.get_reference_stream(), "Should cut on the video.");
+
+		while (dem.demux_next_packet(pkt))
+		{
+			pkt.prepare_for_muxing(fm.get_muxer().get_stream(pkt->stream_index));
+			fm.mux_packet(pkt);
+		}
+		fm.finalize();
+		TEST_ASSERT_THROWS(fm.finalize(), std::logic_error);
+		TEST_ASSERT_EQUALS((int)segments.size(), fm.num_segments(), "Should count what's given.");
+	}
+
+	// 6 seconds in segments of 2, with keyframes every second.
+	TEST_ASSERT_EQUALS(4, (int)segments.size(), "Should be the init segment and 3 media segments.");
+	TEST_ASSERT_TRUE(segments[0].is_init, "The first one should be the init segment.");
+	double expected_start = segments[1].start_time;
+	for (int i = 1; i < (int)segments.size(); ++i)
+	{
+		const auto& seg = segments[i];
+		TEST_ASSERT_EQUALS(i, seg.index, "Should be numbered in order.");
+		TEST_ASSERT_FALSE(seg.is_init, "Only the first one is the init segment.");
+		TEST_ASSERT_FALSE(seg.data.empty(), "Should hold some media.");
+		TEST_ASSERT_TRUE(std::abs(expected_start - seg.start_time) < 1e-3, "Should start where the last one ended.");
+		if (i + 1 < (int)segments.size())
+		{
+			TEST_ASSERT_TRUE(seg.duration >= 2.0 - 1e-3, "Should be at least the target duration.");
+		}
+		expected_start = seg.start_time + seg.duration;
+	}
+
+	// The init segment followed by the media segments is a playable file.
+	{
+		std::vector<uint8_t> whole;
+		for (const auto& seg : segments)
+		{
+			whole.insert(whole.end(), seg.data.begin(), seg.data.end());
+		}
+		ff::memory_io io(std::move(whole));
+		ff::demuxer dem(io);
+		TEST_ASSERT_EQUALS(num_packets, count_packets(dem), "Should have all the packets.");
+	}
+
+	// A media segment can be played with the init segment alone.
+	{
+		std::vector<uint8_t> one(segments[0].data);
+		one.insert(one.end(), segments[2].data.begin(), segments[2].data.end());
+		ff::memory_io io(std::move(one));
+		ff::demuxer dem(io);
+		TEST_ASSERT_TRUE(count_packets(dem) > 0, "Should have the packets of the segment.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -137,8 +137,118 @@ int main()
 		TEST_ASSERT_EQUALS(f3dp.fmt, f3dp_now.fmt, "Should not change the copied");
 		TEST_ASSERT_EQUALS(f3dp.height, f3dp_now.height, "Should not change the copied");
 		TEST_ASSERT_EQUALS(f3dp.width, f3dp_now.width, "Should not change the copied");
-		*(static_cast<uint8_t*>(c3d) + 5) = 9;
-		TEST_ASSERT_EQUALS((5 + 1) % 256, *(static_cast<uint8_t*>(f3.data()) + 5), "Should deeply copy the data");
+		TEST_ASSERT_TRUE(c3d == f3.data(), "Should share the data instead of copying it");
+		TEST_ASSERT_TRUE(c3.av_frame()->buf[0]->data == f3.av_frame()->buf[0]->data, "Should share the buffer");
+		TEST_ASSERT_FALSE(c3.is_writable(), "Shared by two frames");
+		TEST_ASSERT_FALSE(f3.is_writable(), "Shared by two frames");
+
+		// Copy on write.
+		c3.make_writable();
+		TEST_ASSERT_TRUE(c3.is_writable(), "Should have its own data now");
+		TEST_ASSERT_TRUE(f3.is_writable(), "Should be the only one referencing the previous data");
+		TEST_ASSERT_TRUE(c3.data() != f3.data(), "Should have copied the data");
+		*(static_cast<uint8_t*>(c3.data()) + 5) = 9;
+		TEST_ASSERT_EQUALS((5 + 1) % 256, *(static_cast<uint8_t*>(f3.data()) + 5), "Should not change the copied");
+		for (int i = 0; i < 800; ++i)
+		{
+			if (i != 5)
+			{
+				TEST_ASSERT_EQUALS((i + 1) % 256, *(static_cast<uint8_t*>(c3.data()) + i), "Should copy the data");
+			}
+		}
+		// Already writable. Should not copy again.
+		auto c3d_now = c3.data();
+		c3.make_writable();
+		TEST_ASSERT_TRUE(c3d_now == c3.data(), "Should not copy the data again");
+
+		// The assignment operator shares, too.
+		ff::frame a3(false);
+		a3 = f3;
+		TEST_ASSERT_TRUE(a3.ready(), "Should get the status");
+		TEST_ASSERT_TRUE(a3.data() == f3.data(), "Should share the data instead of copying it");
+		a3 = ff::frame(true);
+		TEST_ASSERT_TRUE(a3.created(), "Should get the status");
+		TEST_ASSERT_THROWS(a3.is_writable(), std::logic_error);
+		TEST_ASSERT_THROWS(a3.make_writable(), std::logic_error);
+	}
+
+	// Test deep_copy()
+	{
+		TEST_ASSERT_TRUE(ff::frame(false).deep_copy().destroyed(), "Should be destroyed");
+		TEST_ASSERT_TRUE(ff::frame(true).deep_copy().created(), "Should be created");
+
+		ff::frame f1(true);
+		f1.allocate_data(ff::frame::data_properties(AVPixelFormat::AV_PIX_FMT_RGB24, 64, 48, 0));
+		for (int i = 0; i < 64 * 3; ++i)
+		{
+			*(f1.data<uint8_t>() + i) = i % 256;
+		}
+		f1.reset_time(42, ff::rational(1, 24));
+
+		ff::frame c1 = f1.deep_copy();
+		TEST_ASSERT_TRUE(c1.ready(), "Should get the status");
+		TEST_ASSERT_TRUE(c1.data() != f1.data(), "Should have its own data");
+		TEST_ASSERT_TRUE(c1.is_writable() && f1.is_writable(), "Should not share anything");
+		TEST_ASSERT_EQUALS(f1.number_planes(), c1.number_planes(), "Should equal");
+		TEST_ASSERT_EQUALS(42, c1->pts, "Should copy the properties");
+		for (int i = 0; i < 64 * 3; ++i)
+		{
+			TEST_ASSERT_EQUALS(i % 256, *(c1.data<uint8_t>() + i), "Should copy the data");
+		}
+		*c1.data<uint8_t>() = 77;
+		TEST_ASSERT_EQUALS(0, *f1.data<uint8_t>(), "Should deeply copy the data");
+	}
+
+	// Test crop_view()
+	{
+		ff::frame f1(true);
+		TEST_ASSERT_THROWS(f1.crop_view(0, 0, 1, 1), std::logic_error);
+		f1.allocate_data(ff::frame::data_properties(AVPixelFormat::AV_PIX_FMT_YUV420P, 64, 48));
+		f1.reset_time(42, ff::rational(1, 24));
+
+		TEST_ASSERT_THROWS(f1.crop_view(-2, 0, 8, 8), std::out_of_range);
+		TEST_ASSERT_THROWS(f1.crop_view(0, 0, 0, 8), std::out_of_range);
+		TEST_ASSERT_THROWS(f1.crop_view(60, 0, 6, 8), std::out_of_range);
+		TEST_ASSERT_THROWS(f1.crop_view(0, 42, 8, 8), std::out_of_range);
+		// The chroma of 4:2:0 is halved each way.
+		TEST_ASSERT_THROWS(f1.crop_view(1, 0, 8, 8), std::invalid_argument);
+		TEST_ASSERT_THROWS(f1.crop_view(0, 3, 8, 8), std::invalid_argument);
+
+		ff::frame v1 = f1.crop_view(10, 6, 21, 31);
+		TEST_ASSERT_TRUE(v1.ready(), "Should be ready.");
+		auto vdp = v1.get_data_properties();
+		TEST_ASSERT_EQUALS(21, vdp.width, "Should have the size of the rectangle.");
+		TEST_ASSERT_EQUALS(31, vdp.height, "Should have the size of the rectangle.");
+		TEST_ASSERT_EQUALS(AV_PIX_FMT_YUV420P, vdp.fmt, "Should keep the format.");
+		TEST_ASSERT_EQUALS(42, v1->pts, "Should keep the properties.");
+		TEST_ASSERT_EQUALS(f1.number_planes(), v1.number_planes(), "Should have the same planes.");
+		for (int i = 0; i < 3; ++i)
+		{
+			const int sub = 0 == i ? 1 : 2;
+			TEST_ASSERT_EQUALS(f1.line_size(i), v1.line_size(i), "Should keep the strides.");
+			TEST_ASSERT_EQUALS
+			(
+				f1.data<uint8_t>(i) + (6 / sub) * f1.line_size(i) + 10 / sub, v1.data<uint8_t>(i),
+				"Should point into the parent's planes."
+			);
+		}
+		TEST_ASSERT_FALSE(v1.is_writable(), "Should share the data.");
+
+		// Writing through one shows in the other.
+		*v1.data<uint8_t>() = 200;
+		TEST_ASSERT_EQUALS(200, *(f1.data<uint8_t>() + 6 * f1.line_size() + 10), "Should share the data.");
+		// Unless the view gets its own.
+		v1.make_writable();
+		*v1.data<uint8_t>() = 100;
+		TEST_ASSERT_EQUALS(200, *(f1.data<uint8_t>() + 6 * f1.line_size() + 10), "Should have its own data now.");
+
+		// Cropping a view is relative to the view.
+		ff::frame v2 = f1.crop_view(10, 6, 21, 31).crop_view(2, 2, 4, 4);
+		TEST_ASSERT_EQUALS(f1.data<uint8_t>() + 8 * f1.line_size() + 12, v2.data<uint8_t>(), "Should add up.");
+
+		ff::frame a1(true);
+		a1.allocate_data(ff::frame::data_properties(AVSampleFormat::AV_SAMPLE_FMT_S16, 144, ff::ff_AV_CHANNEL_LAYOUT_STEREO));
+		TEST_ASSERT_THROWS(a1.crop_view(0, 0, 1, 1), std::logic_error);
 	}
 
 	// Test allocating memory and data accessors.
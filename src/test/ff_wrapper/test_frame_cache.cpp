@@ -0,0 +1,173 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/frame_cache.h"
+#include "../../ff_wrapper/pipeline/lazy_codecs.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/util/memory_budget.h"
+
+#include <chrono>
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main()
+{
+	FF_TEST_START
+
+	// 4 seconds at 25 fps with a keyframe every 25 frames: 4 GOPs.
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "frame_cache_test.mp4");
+	std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=4:size=320x240:rate=25 -c:v mpeg4 -g 25 -bf 2 -y ");
+	cmd += std::string("\"") + test_path.generic_string() + '\"';
+	std::system(cmd.c_str());
+
+	// Every frame's pts and its first byte, decoded straight through, to compare against.
+	std::vector<int64_t> all_pts;
+	std::vector<uint8_t> all_first_bytes;
+	ff::demuxer::keyframe_index index;
+	int iv;
+	ff::rational tb;
+	{
+		ff::demuxer dem(test_path);
+		iv = dem.get_video_ind(0);
+		tb = dem.get_stream(iv).time_base();
+		ff::decoder dec(dem.get_stream(iv));
+		for (ff::frame& f : ff::decoded_frames(dem, dec, iv))
+		{
+			all_pts.push_back(f->pts);
+			all_first_bytes.push_back(f->data[0][f->linesize[0] * 120 + 160]);
+		}
+
+		ff::demuxer indexed(test_path);
+		indexed.build_keyframe_index();
+		index = indexed.get_keyframe_index();
+	}
+	TEST_ASSERT_EQUALS(100, (int)all_pts.size(), "Should decode every frame.");
+
+	// Random access gives the same frames as decoding straight through
+	{
+		ff::memory_budget budget(0, 0, nullptr);
+		ff::frame_cache cache(test_path, iv, index, 1024 * 1024 * 1024, 1, &budget);
+		TEST_ASSERT_EQUALS(4, (int)cache.num_gops(), "Should find the GOPs.");
+		TEST_ASSERT_EQUALS(tb, cache.time_base(), "Should have the stream's time base.");
+
+		// Back and forth, as a scrub goes.
+		const std::vector<size_t> order{ 60, 10, 99, 0, 37, 38, 36, 74, 75, 24, 25, 50 };
+		for (size_t i : order)
+		{
+			ff::frame f = cache.frame_at_pts(all_pts[i]);
+			TEST_ASSERT_EQUALS(all_pts[i], f->pts, "Should give the frame at the pts.");
+			TEST_ASSERT_EQUALS(all_first_bytes[i], f->data[0][f->linesize[0] * 120 + 160], "Should have the same picture.");
+		}
+
+		// Between two frames and before the first.
+		ff::frame f = cache.frame_at_pts(all_pts[10] + 1);
+		TEST_ASSERT_EQUALS(all_pts[10], f->pts, "Should give the frame shown then.");
+		f = cache.frame_at_pts(all_pts[0] - 1);
+		TEST_ASSERT_EQUALS(all_pts[0], f->pts, "Should give the first frame.");
+		f = cache.frame_at(ff::time(all_pts[50], tb));
+		TEST_ASSERT_EQUALS(all_pts[50], f->pts, "Should take a time, too.");
+
+		TEST_ASSERT_TRUE(cache.num_hits() > 0, "Most requests should hit.");
+		TEST_ASSERT_TRUE(cache.num_misses() <= 4, "Each GOP should only be waited for once.");
+		TEST_ASSERT_EQUALS(budget.bytes_in_use(), cache.bytes_cached(), "Should charge what's cached.");
+	}
+
+	// Prefetching the neighbours
+	{
+		ff::frame_cache cache(test_path, iv, index, 1024 * 1024 * 1024, 1);
+		cache.frame_at_pts(all_pts[30]);
+		for (int i = 0; i < 200 && !(cache.cached(all_pts[60]) && cache.cached(all_pts[0])); ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		TEST_ASSERT_TRUE(cache.cached(all_pts[60]), "Should prefetch the next GOP.");
+		TEST_ASSERT_TRUE(cache.cached(all_pts[0]), "Should prefetch the previous GOP.");
+		TEST_ASSERT_FALSE(cache.cached(all_pts[90]), "Should not prefetch further.");
+	}
+
+	// The cap
+	{
+		// Room for about one GOP of 320x240 YUV420.
+		const size_t one_gop = 25 * 320 * 240 * 3 / 2;
+		ff::frame_cache cache(test_path, iv, index, one_gop + one_gop / 2, 0);
+		ff::frame kept = cache.frame_at_pts(all_pts[0]);
+		cache.frame_at_pts(all_pts[30]);
+		cache.frame_at_pts(all_pts[60]);
+		TEST_ASSERT_TRUE(cache.num_cached_gops() <= 2, "Should evict beyond the cap.");
+		TEST_ASSERT_TRUE(cache.cached(all_pts[60]), "Should keep the last requested.");
+		TEST_ASSERT_FALSE(cache.cached(all_pts[0]), "Should evict the least recently used.");
+		TEST_ASSERT_EQUALS(all_first_bytes[0], kept->data[0][kept->linesize[0] * 120 + 160], "What was given out should stay valid.");
+
+		// Too small for even one, but the requested one is still kept.
+		ff::frame_cache tiny(test_path, iv, index, 1, 1);
+		ff::frame f = tiny.frame_at_pts(all_pts[40]);
+		TEST_ASSERT_EQUALS(all_pts[40], f->pts, "Should still answer.");
+	}
+
+	// A GOP that is not the last, when the decoder still holds reordered B-frames as its end comes
+	{
+		fs::path bf_path(working_dir / "frame_cache_test_bf.mp4");
+		std::string bf_cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=3:size=320x240:rate=25 -c:v libx264 -g 25 -bf 3 -y ");
+		bf_cmd += std::string("\"") + bf_path.generic_string() + '\"';
+		std::system(bf_cmd.c_str());
+
+		std::vector<int64_t> bf_pts;
+		ff::demuxer::keyframe_index bf_index;
+		int bf_iv;
+		{
+			ff::demuxer dem(bf_path);
+			bf_iv = dem.get_video_ind(0);
+			ff::decoder dec(dem.get_stream(bf_iv));
+			for (ff::frame& f : ff::decoded_frames(dem, dec, bf_iv))
+			{
+				bf_pts.push_back(f->pts);
+			}
+
+			ff::demuxer indexed(bf_path);
+			indexed.build_keyframe_index();
+			bf_index = indexed.get_keyframe_index();
+		}
+		TEST_ASSERT_EQUALS(75, (int)bf_pts.size(), "Should decode every frame.");
+
+		ff::frame_cache cache(bf_path, bf_iv, bf_index, 1024 * 1024 * 1024, 0);
+		TEST_ASSERT_EQUALS(3, (int)cache.num_gops(), "Should find the GOPs.");
+		for (size_t i : { 24, 0, 49, 25, 74 })
+		{
+			ff::frame f = cache.frame_at_pts(bf_pts[i]);
+			TEST_ASSERT_EQUALS(bf_pts[i], f->pts, "Should give the frame at the pts.");
+		}
+	}
+
+	// Invalid use
+	{
+		TEST_ASSERT_THROWS(ff::frame_cache(test_path, iv, index, 0), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::frame_cache(test_path, iv, index, 1024, -1), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::frame_cache(test_path, 100, index, 1024), std::out_of_range);
+		TEST_ASSERT_THROWS(ff::frame_cache(test_path, iv, ff::demuxer::keyframe_index(5), 1024), std::invalid_argument);
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
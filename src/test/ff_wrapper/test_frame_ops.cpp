@@ -0,0 +1,339 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+#include "../../ff_wrapper/data/frame_ops.h"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace
+{
+	ff::frame make_frame(AVPixelFormat fmt, int w, int h)
+	{
+		ff::frame f(true);
+		f.allocate_data(ff::frame::data_properties(fmt, w, h));
+		return f;
+	}
+
+	// Fills every 8 bit plane of f with random values.
+	void randomize(ff::frame& f, std::mt19937& gen)
+	{
+		for (int p = 0; p < f.number_planes(); ++p)
+		{
+			uint8_t* row = f.data<uint8_t>(p);
+			const int plane_h = 0 == p || 3 == p ? f->height : (f->height + 1) / 2;
+			for (int i = 0; i < plane_h; ++i, row += f.line_size(p))
+			{
+				for (int j = 0; j < f.line_size(p); ++j)
+				{
+					row[j] = static_cast<uint8_t>(gen());
+				}
+			}
+		}
+	}
+
+	// Compares the visible 8 bit luma and chroma of two yuv420p frames.
+	bool same_yuv420p(const ff::frame& a, const ff::frame& b)
+	{
+		for (int p = 0; p < 3; ++p)
+		{
+			auto va = 0 == p ? ff::view_plane<AV_PIX_FMT_YUV420P, 0>(a) :
+				1 == p ? ff::view_plane<AV_PIX_FMT_YUV420P, 1>(a) : ff::view_plane<AV_PIX_FMT_YUV420P, 2>(a);
+			auto vb = 0 == p ? ff::view_plane<AV_PIX_FMT_YUV420P, 0>(b) :
+				1 == p ? ff::view_plane<AV_PIX_FMT_YUV420P, 1>(b) : ff::view_plane<AV_PIX_FMT_YUV420P, 2>(b);
+			for (int i = 0; i < va.height(); ++i)
+			{
+				for (int j = 0; j < va.width(); ++j)
+				{
+					if (va(i, j) != vb(i, j))
+					{
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+}
+
+int main()
+{
+	using namespace ff::frame_ops;
+
+	FF_TEST_START
+
+	// Test the SIMD level
+	{
+		TEST_ASSERT_EQUALS(supported_simd_level(), active_simd_level(), "Should use the best by default.");
+		set_simd_level(simd_level::scalar);
+		TEST_ASSERT_EQUALS(simd_level::scalar, active_simd_level(), "Should be set.");
+		if (simd_level::neon != supported_simd_level())
+		{
+			TEST_ASSERT_THROWS(set_simd_level(simd_level::neon), std::invalid_argument);
+		}
+		else
+		{
+			TEST_ASSERT_THROWS(set_simd_level(simd_level::avx2), std::invalid_argument);
+		}
+		set_simd_level(supported_simd_level());
+	}
+
+	// Test the checks
+	{
+		ff::frame empty(true);
+		TEST_ASSERT_THROWS(pad(empty, 0, 0, 0, 0), std::logic_error);
+		TEST_ASSERT_THROWS(luma_histogram(empty), std::logic_error);
+
+		ff::frame yuv = make_frame(AV_PIX_FMT_YUV420P, 64, 48);
+		ff::frame rgba = make_frame(AV_PIX_FMT_RGBA, 16, 16);
+		ff::frame wm = make_frame(AV_PIX_FMT_YUVA420P, 16, 16);
+		TEST_ASSERT_THROWS(pad(rgba, 0, 0, 0, 0), std::domain_error);
+		TEST_ASSERT_THROWS(pad(yuv, 1, 0, 0, 0), std::invalid_argument);
+		TEST_ASSERT_THROWS(pad(yuv, 0, -2, 0, 0), std::invalid_argument);
+		TEST_ASSERT_THROWS(overlay(yuv, rgba, 0, 0), std::domain_error);
+		TEST_ASSERT_THROWS(overlay(rgba, wm, 0, 0), std::domain_error);
+		TEST_ASSERT_THROWS(overlay(yuv, wm, 1, 0), std::invalid_argument);
+		TEST_ASSERT_THROWS(overlay(yuv, wm, 50, 0), std::out_of_range);
+		TEST_ASSERT_THROWS(overlay(yuv, wm, 0, -2), std::out_of_range);
+		TEST_ASSERT_THROWS(convert_depth(rgba, AV_PIX_FMT_YUV420P10LE), std::domain_error);
+		TEST_ASSERT_THROWS(convert_depth(yuv, AV_PIX_FMT_NV12), std::domain_error);
+		TEST_ASSERT_THROWS(luma_histogram(rgba), std::domain_error);
+		TEST_ASSERT_THROWS(copy_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 0>(yuv), ff::view_plane<AV_PIX_FMT_YUVA420P, 0>(wm)), std::invalid_argument);
+	}
+
+	// Test pad()
+	{
+		ff::frame src = make_frame(AV_PIX_FMT_YUV420P, 63, 45);
+		src.reset_time(7, ff::rational(1, 25));
+		auto sy = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(src);
+		for (int i = 0; i < sy.height(); ++i)
+		{
+			for (int j = 0; j < sy.width(); ++j)
+			{
+				sy(i, j) = static_cast<uint8_t>(i * 3 + j);
+			}
+		}
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 1>(src), 100);
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 2>(src), 200);
+
+		ff::frame dst = pad(src, 2, 4, 6, 8, { 1, 2, 3 });
+		auto dp = dst.get_data_properties();
+		TEST_ASSERT_TRUE(2 + 63 + 6 == dp.width && 4 + 45 + 8 == dp.height, "Should have the padded size.");
+		TEST_ASSERT_EQUALS(7, dst->pts, "Should copy the properties.");
+
+		auto dy = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(dst);
+		auto du = ff::view_plane<AV_PIX_FMT_YUV420P, 1>(dst);
+		auto dv = ff::view_plane<AV_PIX_FMT_YUV420P, 2>(dst);
+		TEST_ASSERT_TRUE(1 == dy(0, 0) && 1 == dy(4, 1) && 1 == dy(4, 65) && 1 == dy(49, 2), "Should fill the borders.");
+		TEST_ASSERT_TRUE(0 == dy(4, 2) && 3 * 10 + 20 == dy(14, 22) && 3 * 44 + 62 == dy(48, 64), "Should copy the picture.");
+		TEST_ASSERT_TRUE(2 == du(0, 0) && 2 == du(2, 0) && 100 == du(2, 1) && 100 == du(24, 32) && 2 == du(24, 33), "Should pad the chroma.");
+		TEST_ASSERT_TRUE(3 == dv(dv.height() - 1, dv.width() - 1) && 200 == dv(10, 10), "Should pad the chroma.");
+	}
+
+	// Test overlay()
+	{
+		ff::frame dst = make_frame(AV_PIX_FMT_YUV420P, 64, 48);
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 0>(dst), 50);
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 1>(dst), 128);
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 2>(dst), 128);
+		ff::frame shared = dst;
+
+		ff::frame wm = make_frame(AV_PIX_FMT_YUVA420P, 16, 16);
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUVA420P, 0>(wm), 250);
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUVA420P, 1>(wm), 0);
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUVA420P, 2>(wm), 255);
+		auto wa = ff::view_plane<AV_PIX_FMT_YUVA420P, 3>(wm);
+		fill_plane(wa, 255);
+		// Row 0 transparent and row 1 half.
+		std::fill_n(wa.row(0), wa.width(), uint8_t(0));
+		std::fill_n(wa.row(1), wa.width(), uint8_t(128));
+
+		overlay(dst, wm, 10, 20);
+		auto dy = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(dst);
+		auto du = ff::view_plane<AV_PIX_FMT_YUV420P, 1>(dst);
+		auto dv = ff::view_plane<AV_PIX_FMT_YUV420P, 2>(dst);
+		TEST_ASSERT_EQUALS(50, dy(20, 10), "Should keep what's under transparent pixels.");
+		// (250 * 128 + 50 * 127) / 255, rounded.
+		TEST_ASSERT_EQUALS(150, dy(21, 15), "Should blend.");
+		TEST_ASSERT_EQUALS(250, dy(22, 25), "Should cover with opaque pixels.");
+		TEST_ASSERT_EQUALS(50, dy(22, 26), "Should only blend inside the watermark.");
+		// The chroma alpha of the first row averages 0, 0, 128, 128 to 64. (0 * 64 + 128 * 191) / 255, rounded.
+		TEST_ASSERT_EQUALS(96, du(10, 5), "Should blend the chroma by the average alpha.");
+		TEST_ASSERT_EQUALS(255, dv(11, 12), "Should cover the chroma.");
+		TEST_ASSERT_EQUALS(128, du(11, 13), "Should only blend inside the watermark.");
+		auto shared_y = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(shared);
+		TEST_ASSERT_EQUALS(50, shared_y(22, 25), "Should not write to shared data.");
+	}
+
+	// Test convert_depth()
+	{
+		std::mt19937 gen(42);
+		ff::frame src = make_frame(AV_PIX_FMT_YUV420P, 67, 31);
+		randomize(src, gen);
+
+		ff::frame deep = convert_depth(src, AV_PIX_FMT_YUV420P10LE);
+		TEST_ASSERT_EQUALS(AV_PIX_FMT_YUV420P10LE, deep.get_data_properties().fmt, "Should be converted.");
+		auto y8 = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(src);
+		auto y10 = ff::view_plane<AV_PIX_FMT_YUV420P10LE, 0>(deep);
+		TEST_ASSERT_EQUALS(y8(3, 66) << 2, y10(3, 66), "Should shift left by 2.");
+
+		ff::frame back = convert_depth(deep, AV_PIX_FMT_YUV420P);
+		TEST_ASSERT_TRUE(same_yuv420p(src, back), "Should convert back losslessly.");
+
+		// Rounding and saturation
+		ff::frame ten = make_frame(AV_PIX_FMT_YUV420P10LE, 4, 2);
+		auto t = ff::view_plane<AV_PIX_FMT_YUV420P10LE, 0>(ten);
+		t(0, 0) = 5; t(0, 1) = 6; t(0, 2) = 1023; t(0, 3) = 65535;
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P10LE, 1>(ten), uint16_t(512));
+		fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P10LE, 2>(ten), uint16_t(512));
+		auto eight = convert_depth(ten, AV_PIX_FMT_YUV420P);
+		auto e = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(eight);
+		TEST_ASSERT_TRUE(1 == e(0, 0) && 2 == e(0, 1) && 255 == e(0, 2) && 255 == e(0, 3), "Should round and saturate.");
+	}
+
+	// Test luma_histogram()
+	{
+		ff::frame f = make_frame(AV_PIX_FMT_NV12, 30, 10);
+		auto y = ff::view_plane<AV_PIX_FMT_NV12, 0>(f);
+		fill_plane(y, 7);
+		y(0, 0) = 0;
+		y(9, 29) = 255;
+		auto h = luma_histogram(f);
+		TEST_ASSERT_EQUALS(1, h[0], "Should count each value.");
+		TEST_ASSERT_EQUALS(1, h[255], "Should count each value.");
+		TEST_ASSERT_EQUALS(30 * 10 - 2, h[7], "Should count each value.");
+	}
+
+	// Test psnr() and ssim()
+	{
+		ff::frame yuv = make_frame(AV_PIX_FMT_YUV420P, 64, 48);
+		ff::frame other_size = make_frame(AV_PIX_FMT_YUV420P, 64, 50);
+		ff::frame rgba = make_frame(AV_PIX_FMT_RGBA, 64, 48);
+		ff::frame tiny = make_frame(AV_PIX_FMT_YUV420P, 12, 12);
+		TEST_ASSERT_THROWS(psnr(yuv, other_size), std::invalid_argument);
+		TEST_ASSERT_THROWS(psnr(yuv, yuv, 0), std::invalid_argument);
+		TEST_ASSERT_THROWS(ssim(rgba, rgba), std::domain_error);
+		TEST_ASSERT_THROWS(ssim(tiny, tiny), std::invalid_argument);
+		TEST_ASSERT_THROWS(psnr(ff::frame(true), yuv), std::logic_error);
+
+		std::mt19937 gen(3);
+		ff::frame ref = make_frame(AV_PIX_FMT_YUV420P, 200, 150);
+		randomize(ref, gen);
+		ff::frame same = ref.deep_copy();
+		auto p_same = psnr(ref, same);
+		auto s_same = ssim(ref, same);
+		TEST_ASSERT_TRUE(3 == p_same.num_planes && std::isinf(p_same.combined), "Same frames should have infinite PSNR.");
+		TEST_ASSERT_TRUE(1.0 == s_same.combined && 1.0 == s_same.planes[2], "Same frames should have an SSIM of 1.");
+
+		// Off by 4 everywhere in the luma: mse = 16, so PSNR = 10 log10(255^2 / 16).
+		ff::frame dist = ref.deep_copy();
+		auto dy = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(dist);
+		for (int i = 0; i < dy.height(); ++i)
+		{
+			for (int j = 0; j < dy.width(); ++j)
+			{
+				dy(i, j) = static_cast<uint8_t>(dy(i, j) < 128 ? dy(i, j) + 4 : dy(i, j) - 4);
+			}
+		}
+		auto p = psnr(ref, dist);
+		TEST_ASSERT_TRUE(std::abs(p.planes[0] - 10 * std::log10(255.0 * 255.0 / 16)) < 1e-9, "Should give the PSNR of the luma.");
+		TEST_ASSERT_TRUE(std::isinf(p.planes[1]) && std::isinf(p.planes[2]), "Untouched chroma should be infinite.");
+		// Each chroma plane has a quarter of the samples, so the mse over all is 16 * 4 / 6.
+		TEST_ASSERT_TRUE(std::abs(p.combined - 10 * std::log10(255.0 * 255.0 * 6 / 64)) < 1e-9, "Should combine by samples.");
+		auto s = ssim(ref, dist);
+		TEST_ASSERT_TRUE(s.planes[0] < 1.0 && s.planes[0] > 0.9 && 1.0 == s.planes[1], "Should score the luma lower.");
+
+		// Flat planes 4 apart: each window has sums 64 * 100 and 64 * 104 and no variance,
+		// so it scores as vf_ssim's ssim_end1() with its c1 of 416.
+		ff::frame flat_ref = ref.deep_copy(), flat_dist = ref.deep_copy();
+		auto fr = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(flat_ref);
+		auto fd = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(flat_dist);
+		for (int i = 0; i < fr.height(); ++i)
+		{
+			for (int j = 0; j < fr.width(); ++j)
+			{
+				fr(i, j) = 100;
+				fd(i, j) = 104;
+			}
+		}
+		const double s1 = 64 * 100, s2 = 64 * 104;
+		const double flat = (2 * s1 * s2 + 416) / (s1 * s1 + s2 * s2 + 416);
+		TEST_ASSERT_TRUE(std::abs(ssim(flat_ref, flat_dist).planes[0] - flat) < 1e-12, "Should use the constants of vf_ssim.");
+
+		// 150 rows is not a multiple of the bands, so the threads get uneven bands.
+		auto p4 = psnr(ref, dist, 4);
+		auto s4 = ssim(ref, dist, 4);
+		TEST_ASSERT_TRUE(p4.combined == p.combined && s4.combined == s.combined, "Threads should not change the results.");
+
+		// 10 bits
+		ff::frame deep_ref = convert_depth(ref, AV_PIX_FMT_YUV420P10LE);
+		ff::frame deep_dist = convert_depth(dist, AV_PIX_FMT_YUV420P10LE);
+		auto p10 = psnr(deep_ref, deep_dist);
+		// Off by 16 in 10 bits.
+		TEST_ASSERT_TRUE(std::abs(p10.planes[0] - 10 * std::log10(1023.0 * 1023.0 / 256)) < 1e-9, "Should use the 10 bit peak.");
+		TEST_ASSERT_TRUE(ssim(deep_ref, deep_dist).planes[0] < 1.0, "Should measure 10 bit SSIM.");
+	}
+
+	// Test that every level gives the same results as scalar
+	{
+		std::vector<simd_level> levels{ simd_level::scalar, supported_simd_level() };
+		if (simd_level::avx2 == supported_simd_level())
+		{
+			levels.push_back(simd_level::sse4);
+		}
+
+		std::mt19937 gen(7);
+		// Not multiples of the vector widths, to go through the tails.
+		ff::frame base = make_frame(AV_PIX_FMT_YUV420P, 203, 51);
+		ff::frame wm = make_frame(AV_PIX_FMT_YUVA420P, 77, 33);
+		randomize(base, gen);
+		randomize(wm, gen);
+
+		std::vector<ff::frame> blended, round_tripped;
+		std::vector<quality_score> psnrs, ssims, deep_psnrs;
+		for (auto level : levels)
+		{
+			set_simd_level(level);
+			ff::frame dst = base.deep_copy();
+			overlay(dst, wm, 40, 6);
+			blended.push_back(dst);
+			round_tripped.push_back(convert_depth(convert_depth(dst, AV_PIX_FMT_YUV420P10LE), AV_PIX_FMT_YUV420P));
+			psnrs.push_back(psnr(base, dst));
+			ssims.push_back(ssim(base, dst));
+			deep_psnrs.push_back(psnr(convert_depth(base, AV_PIX_FMT_YUV420P10LE), convert_depth(dst, AV_PIX_FMT_YUV420P10LE)));
+		}
+		set_simd_level(supported_simd_level());
+
+		for (size_t i = 1; i < levels.size(); ++i)
+		{
+			TEST_ASSERT_TRUE(same_yuv420p(blended[0], blended[i]), "Should blend the same.");
+			TEST_ASSERT_TRUE(same_yuv420p(blended[0], round_tripped[i]), "Should convert the same.");
+			TEST_ASSERT_TRUE(psnrs[0].planes == psnrs[i].planes, "Should measure PSNR the same.");
+			TEST_ASSERT_TRUE(ssims[0].planes == ssims[i].planes, "Should measure SSIM the same.");
+			TEST_ASSERT_TRUE(deep_psnrs[0].planes == deep_psnrs[i].planes, "Should measure 10 bit PSNR the same.");
+		}
+	}
+
+	FF_TEST_END
+}
@@ -0,0 +1,157 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+#include "../../ff_wrapper/data/frame_pool.h"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+#include <cstdint>
+
+int main()
+{
+	FF_TEST_START
+
+	// Test invalid properties
+	{
+		ff::frame_pool pool;
+		TEST_ASSERT_THROWS(pool.get_frame(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 0, 480)), std::invalid_argument);
+		TEST_ASSERT_THROWS(pool.get_frame(ff::frame::data_properties(AV_PIX_FMT_NONE, 640, 480)), std::invalid_argument);
+		TEST_ASSERT_THROWS(pool.get_frame(ff::frame::data_properties(AV_PIX_FMT_CUDA, 640, 480)), std::invalid_argument);
+		TEST_ASSERT_THROWS
+		(
+			pool.get_frame(ff::frame::data_properties(AV_SAMPLE_FMT_FLTP, 0, ff::ff_AV_CHANNEL_LAYOUT_STEREO)),
+			std::invalid_argument
+		);
+		TEST_ASSERT_THROWS
+		(
+			ff::frame_pool{ ff::frame::data_properties(AV_PIX_FMT_YUV420P, -1, -1) },
+			std::invalid_argument
+		);
+		TEST_ASSERT_EQUALS(0, pool.number_properties(), "Should not keep invalid ones.");
+	}
+
+	// Test video frames
+	{
+		ff::frame::data_properties dp(AV_PIX_FMT_YUV420P, 640, 480);
+		ff::frame_pool pool(dp);
+		TEST_ASSERT_EQUALS(1, pool.number_properties(), "Should have prepared dp.");
+
+		ff::frame f1 = pool.get_frame(dp);
+		TEST_ASSERT_TRUE(f1.ready(), "Should be ready.");
+		TEST_ASSERT_TRUE(f1.v_or_a(), "Should be video.");
+		TEST_ASSERT_EQUALS(dp, f1.get_data_properties(), "Should have the properties.");
+		TEST_ASSERT_EQUALS(3, f1.number_planes(), "YUV420P has 3 planes.");
+		TEST_ASSERT_TRUE(f1.is_writable(), "Should be writable.");
+		TEST_ASSERT_TRUE(f1.line_size(0) >= 640, "Should hold a line.");
+		TEST_ASSERT_TRUE(f1.line_size(1) >= 320, "Should hold a line.");
+		TEST_ASSERT_EQUALS(1, pool.number_properties(), "Should reuse the properties.");
+
+		// Can write to all of the data.
+		for (int i = 0; i < f1.number_planes(); ++i)
+		{
+			int h = 0 == i ? 480 : 240;
+			for (int y = 0; y < h; ++y)
+			{
+				f1.data<uint8_t>(i)[y * f1.line_size(i)] = static_cast<uint8_t>(y);
+			}
+		}
+
+		// Two frames alive at the same time cannot share buffers.
+		ff::frame f2 = pool.get_frame(dp);
+		TEST_ASSERT_TRUE(f1.data() != f2.data(), "Should not share the buffer.");
+
+		// A released buffer is reused.
+		const void* f1_data = f1.data();
+		f1.clear_data();
+		ff::frame f3(true);
+		f3.reset_time(7, ff::rational(1, 30));
+		pool.get_frame(f3, dp);
+		TEST_ASSERT_TRUE(f1_data == f3.data(), "Should reuse the released buffer.");
+		TEST_ASSERT_EQUALS(7, f3->pts, "Should keep the other properties.");
+
+		// A ready frame releases its previous data first.
+		const void* f3_data = f3.data();
+		pool.get_frame(f3, dp);
+		TEST_ASSERT_TRUE(f3.ready(), "Should be ready.");
+		TEST_ASSERT_TRUE(f3_data == f3.data(), "Should get back the buffer it released.");
+
+		// A destroyed frame is created first.
+		ff::frame f4(false);
+		pool.get_frame(f4, dp);
+		TEST_ASSERT_TRUE(f4.ready(), "Should be ready.");
+
+		// A different alignment is a different set of properties.
+		pool.get_frame(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 640, 480, 64));
+		TEST_ASSERT_EQUALS(2, pool.number_properties(), "Should pool them separately.");
+		pool.get_frame(ff::frame::data_properties(AV_PIX_FMT_RGB24, 640, 480));
+		TEST_ASSERT_EQUALS(3, pool.number_properties(), "Should pool them separately.");
+
+		pool.clear();
+		TEST_ASSERT_EQUALS(0, pool.number_properties(), "Should have released all.");
+		// Frames are not affected.
+		f2.data<uint8_t>(0)[0] = 1;
+		TEST_ASSERT_EQUALS(1, f2.data<uint8_t>(0)[0], "Should still be accessible.");
+	}
+
+	// Test audio frames
+	{
+		ff::frame_pool pool;
+
+		ff::frame::data_properties planar(AV_SAMPLE_FMT_FLTP, 1024, ff::ff_AV_CHANNEL_LAYOUT_STEREO);
+		ff::frame f1 = pool.get_frame(planar);
+		TEST_ASSERT_TRUE(f1.ready(), "Should be ready.");
+		TEST_ASSERT_FALSE(f1.v_or_a(), "Should be audio.");
+		TEST_ASSERT_EQUALS(planar, f1.get_data_properties(), "Should have the properties.");
+		TEST_ASSERT_EQUALS(2, f1.number_planes(), "One plane per channel.");
+		TEST_ASSERT_TRUE(f1.line_size(0) >= 1024 * 4, "Should hold all the samples.");
+		TEST_ASSERT_TRUE(f1->extended_data == f1->data, "Should not need extended data.");
+
+		ff::frame::data_properties packed(AV_SAMPLE_FMT_S16, 1024, ff::ff_AV_CHANNEL_LAYOUT_STEREO);
+		ff::frame f2(true);
+		f2.allocate_data(packed, pool);
+		TEST_ASSERT_EQUALS(packed, f2.get_data_properties(), "Should have the properties.");
+		TEST_ASSERT_EQUALS(1, f2.number_planes(), "Packed samples only have one plane.");
+		TEST_ASSERT_TRUE(f2.line_size(0) >= 1024 * 2 * 2, "Should hold all the samples.");
+		TEST_ASSERT_THROWS(f2.allocate_data(packed, pool), std::logic_error);
+		TEST_ASSERT_EQUALS(2, pool.number_properties(), "Should pool them separately.");
+	}
+
+	// Test frames outliving the pool
+	{
+		ff::frame f1(false);
+		{
+			ff::frame_pool pool;
+			f1 = pool.get_frame(ff::frame::data_properties(AV_PIX_FMT_GRAY8, 32, 32));
+		}
+		for (int i = 0; i < 32; ++i)
+		{
+			f1.data<uint8_t>()[i] = static_cast<uint8_t>(i);
+		}
+		TEST_ASSERT_EQUALS(31, f1.data<uint8_t>()[31], "Should still be accessible.");
+
+		// Copies share the pooled buffer, too.
+		ff::frame c1(f1);
+		TEST_ASSERT_TRUE(c1.data() == f1.data(), "Should share the buffer.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
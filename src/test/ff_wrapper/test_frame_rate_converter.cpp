@@ -0,0 +1,193 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/sws/frame_rate_converter.h"
+#include "../../ff_wrapper/data/frame_ops.h"
+#include "../../ff_wrapper/util/channel_layout.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+const ff::frame::data_properties props(AV_PIX_FMT_YUV420P, 64, 48);
+
+// @returns a frame of a flat luma y at pts in its time base, lasting duration.
+ff::frame make_frame(int y, int64_t pts, int64_t duration = 1)
+{
+	ff::frame f(true);
+	f.allocate_data(props);
+	ff::frame_ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 0>(f), static_cast<uint8_t>(y));
+	ff::frame_ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 1>(f), 128);
+	ff::frame_ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 2>(f), 128);
+	f->pts = pts;
+	f->duration = duration;
+	return f;
+}
+
+// Feeds every frame, and then takes out all that comes out.
+std::vector<ff::frame> convert_all(ff::frame_rate_converter& conv, const std::vector<ff::frame>& in)
+{
+	std::vector<ff::frame> out;
+	for (const auto& f : in)
+	{
+		conv.feed_frame(f);
+		for (ff::frame o = conv.get_frame(); !o.destroyed(); o = conv.get_frame())
+		{
+			out.push_back(o);
+		}
+	}
+	conv.signal_no_more_food();
+	for (ff::frame o = conv.get_frame(); !o.destroyed(); o = conv.get_frame())
+	{
+		out.push_back(o);
+	}
+	return out;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	// Dropping: 75 fps to 25 fps keeps each 3rd frame, the one nearest to each tick.
+	{
+		std::vector<ff::frame> in;
+		for (int i = 0; i < 30; ++i)
+		{
+			in.push_back(make_frame(i, i));
+		}
+
+		ff::frame_rate_converter conv(props, ff::rational(1, 75), ff::rational(25, 1));
+		TEST_ASSERT_EQUALS(ff::rational(1, 25), conv.dst_time_base(), "Should tick at the dst rate.");
+		auto out = convert_all(conv, in);
+
+		// Ticks 0 to 9 get frames 1, 4, ..., 28, and the last one goes to tick 10.
+		TEST_ASSERT_EQUALS(11u, out.size(), "Should give a frame a tick.");
+		for (size_t k = 0; k < out.size(); ++k)
+		{
+			const size_t expected = k < 10 ? 3 * k + 1 : 29;
+			TEST_ASSERT_TRUE(out[k].data() == in[expected].data(), "Should reference the nearest frame, not copy it.");
+			TEST_ASSERT_EQUALS((int64_t)k, out[k]->pts, "Should be on consecutive ticks.");
+			TEST_ASSERT_EQUALS(1, (int)out[k]->duration, "Should last a tick.");
+			TEST_ASSERT_EQUALS(ff::rational(1, 25), ff::rational(out[k]->time_base), "Should be in the dst time base.");
+		}
+		// The frames fed keep their time.
+		TEST_ASSERT_EQUALS(4, (int)in[4]->pts, "Should not touch the frames fed.");
+
+		TEST_ASSERT_EQUALS(30u, conv.number_fed(), "Should count the frames fed.");
+		TEST_ASSERT_EQUALS(11u, conv.number_output(), "Should count the frames given out.");
+		TEST_ASSERT_EQUALS(19u, conv.number_dropped(), "Should count the frames dropped.");
+		TEST_ASSERT_EQUALS(0u, conv.number_duplicated(), "Nothing to duplicate.");
+	}
+
+	// Duplicating: 25 fps to 50 fps gives each frame twice.
+	{
+		std::vector<ff::frame> in;
+		for (int i = 0; i < 10; ++i)
+		{
+			in.push_back(make_frame(20 * i, i));
+		}
+
+		ff::frame_rate_converter conv(props, ff::rational(1, 25), ff::rational(50, 1));
+		auto out = convert_all(conv, in);
+		TEST_ASSERT_EQUALS(20u, out.size(), "Should give each frame twice, the last till its end.");
+		for (size_t k = 0; k < out.size(); ++k)
+		{
+			TEST_ASSERT_TRUE(out[k].data() == in[k / 2].data(), "Should reference the frame, not copy it.");
+			TEST_ASSERT_EQUALS((int64_t)k, out[k]->pts, "Should be on consecutive ticks.");
+		}
+		TEST_ASSERT_EQUALS(10u, conv.number_duplicated(), "Should count the duplicates.");
+		TEST_ASSERT_EQUALS(0u, conv.number_dropped(), "Nothing to drop.");
+
+		// Again after a reset, from a later start.
+		conv.reset();
+		conv.feed_frame(make_frame(0, 100));
+		TEST_ASSERT_TRUE(conv.get_frame().destroyed(), "Can't know how long it lasts yet.");
+		conv.signal_no_more_food();
+		ff::frame last = conv.get_frame();
+		TEST_ASSERT_EQUALS(200, (int)last->pts, "Should start from the tick of the first frame.");
+	}
+
+	// Blending: 25 fps to 50 fps puts a blend of the two frames between them.
+	{
+		std::vector<ff::frame> in;
+		for (int i = 0; i < 10; ++i)
+		{
+			in.push_back(make_frame(16 + 20 * i, i));
+		}
+
+		ff::frame_rate_converter conv(props, ff::rational(1, 25), ff::rational(50, 1), ff::frame_rate_converter::modes::blend);
+		auto out = convert_all(conv, in);
+		TEST_ASSERT_EQUALS(20u, out.size(), "Should give a frame a tick.");
+		for (size_t k = 0; k < 18; ++k)
+		{
+			if (0 == k % 2)
+			{
+				TEST_ASSERT_TRUE(out[k].data() == in[k / 2].data(), "A tick on a frame should reference it.");
+			}
+			else
+			{
+				TEST_ASSERT_FALSE(out[k].data() == in[k / 2].data(), "A tick between frames should be blended.");
+				const int luma = out[k]->data[0][out[k]->linesize[0] * 10 + 10];
+				TEST_ASSERT_TRUE(std::abs(26 + 20 * (int)(k / 2) - luma) <= 1, "Should be half of each.");
+				TEST_ASSERT_EQUALS(128, (int)out[k]->data[1][0], "The chroma should be blended, too.");
+			}
+		}
+		// Nothing after the last to blend with.
+		TEST_ASSERT_TRUE(out[19].data() == in[9].data(), "Should reference the last frame.");
+		TEST_ASSERT_EQUALS(9u, conv.number_blended(), "Should count the blends.");
+	}
+
+	// 59.94 to 29.97, with frames out of the pts order dropped.
+	{
+		ff::frame_rate_converter conv(props, ff::rational(1001, 60000), ff::rational(30000, 1001));
+		conv.feed_frame(make_frame(0, 0));
+		conv.feed_frame(make_frame(0, 3));
+		conv.feed_frame(make_frame(0, 2));
+		TEST_ASSERT_EQUALS(1u, conv.number_dropped(), "A frame not after the previous one should be dropped.");
+	}
+
+	// Invalid use
+	{
+		TEST_ASSERT_THROWS(ff::frame_rate_converter(props, ff::rational(0, 1), ff::rational(25, 1)), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::frame_rate_converter(props, ff::rational(1, 25), ff::rational(-25, 1)), std::invalid_argument);
+		TEST_ASSERT_THROWS
+		(
+			ff::frame_rate_converter(ff::frame::data_properties(AV_SAMPLE_FMT_FLTP, 1024, ff::ff_AV_CHANNEL_LAYOUT_STEREO), ff::rational(1, 25), ff::rational(25, 1)),
+			std::invalid_argument
+		);
+		TEST_ASSERT_THROWS
+		(
+			ff::frame_rate_converter(ff::frame::data_properties(AV_PIX_FMT_YUV420P10LE, 64, 48), ff::rational(1, 25), ff::rational(25, 1), ff::frame_rate_converter::modes::blend),
+			std::domain_error
+		);
+
+		ff::frame_rate_converter conv(props, ff::rational(1, 25), ff::rational(25, 1));
+		ff::frame no_pts = make_frame(0, 0);
+		no_pts->pts = AV_NOPTS_VALUE;
+		TEST_ASSERT_THROWS(conv.feed_frame(no_pts), std::invalid_argument);
+		ff::frame wrong(true);
+		wrong.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 32, 24));
+		TEST_ASSERT_THROWS(conv.feed_frame(wrong), std::invalid_argument);
+		conv.signal_no_more_food();
+		TEST_ASSERT_THROWS(conv.feed_frame(make_frame(0, 0)), std::logic_error);
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
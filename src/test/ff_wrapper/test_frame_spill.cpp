@@ -0,0 +1,214 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/formats/frame_spill.h"
+#include "../../ff_wrapper/data/frame_ops.h"
+#include "../../ff_wrapper/util/channel_layout.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Odd sizes, so that the lines of the spill need padding.
+const ff::frame::data_properties props(AV_PIX_FMT_YUV420P, 70, 46);
+
+// @returns a frame of props, its pixels a pattern of i, at pts.
+ff::frame make_frame(int i, int64_t pts, const ff::frame::data_properties& dp = props)
+{
+	ff::frame f(true);
+	f.allocate_data(dp);
+	for (int p = 0; p < 3; ++p)
+	{
+		const int w = 0 == p ? dp.width : (dp.width + 1) / 2;
+		const int h = 0 == p ? dp.height : (dp.height + 1) / 2;
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				f->data[p][y * f->linesize[p] + x] = static_cast<uint8_t>(i * 7 + p * 31 + x + y);
+			}
+		}
+	}
+	f->pts = pts;
+	f->duration = 2;
+	f->pict_type = 0 == i % 5 ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P;
+	return f;
+}
+
+// @returns true iff the visible pixels of a and b are the same.
+bool same_pixels(const ff::frame& a, const ff::frame& b)
+{
+	for (int p = 0; p < 3; ++p)
+	{
+		const int w = 0 == p ? props.width : (props.width + 1) / 2;
+		const int h = 0 == p ? props.height : (props.height + 1) / 2;
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				if (a->data[p][y * a->linesize[p] + x] != b->data[p][y * b->linesize[p] + x])
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	fs::path working_dir(fs::current_path());
+	fs::path spill_path(working_dir / "frame_spill_test.ffwspill");
+	fs::path tmp_path(spill_path);
+	tmp_path += ".tmp";
+	fs::remove(spill_path);
+
+	std::vector<ff::frame> in;
+	for (int i = 0; i < 10; ++i)
+	{
+		in.push_back(make_frame(i, 2 * i));
+	}
+
+	// Write
+	{
+		ff::frame_spill_writer w(spill_path, props, ff::rational(1, 50));
+		for (const auto& f : in)
+		{
+			w.write_frame(f);
+		}
+		// Frames of other sizes are scaled into the spill.
+		w.write_frame(make_frame(10, 20, ff::frame::data_properties(AV_PIX_FMT_YUV420P, 140, 92)));
+		w.write_frame(make_frame(11, 22, ff::frame::data_properties(AV_PIX_FMT_YUV420P, 140, 92)));
+
+		TEST_ASSERT_TRUE(fs::exists(tmp_path), "Should write to the temporary file.");
+		TEST_ASSERT_FALSE(fs::exists(spill_path), "Should not be there before finish().");
+		TEST_ASSERT_EQUALS(0u, w.frame_bytes() % 64, "Frames should take multiples of 64 bytes.");
+
+		TEST_ASSERT_THROWS(w.write_frame(make_frame(0, 22)), std::invalid_argument);
+		ff::frame no_pts = make_frame(0, 0);
+		no_pts->pts = AV_NOPTS_VALUE;
+		TEST_ASSERT_THROWS(w.write_frame(no_pts), std::invalid_argument);
+		TEST_ASSERT_THROWS(w.write_frame(ff::frame(true)), std::invalid_argument);
+
+		TEST_ASSERT_EQUALS(12u, w.finish(), "Should spill every frame.");
+		TEST_ASSERT_TRUE(fs::exists(spill_path), "Should be renamed by finish().");
+		TEST_ASSERT_FALSE(fs::exists(tmp_path), "Should be renamed by finish().");
+		TEST_ASSERT_THROWS(w.finish(), std::logic_error);
+		TEST_ASSERT_THROWS(w.write_frame(make_frame(12, 24)), std::logic_error);
+	}
+
+	// Read
+	{
+		ff::frame kept(false);
+		{
+			ff::frame_spill spill(spill_path);
+			TEST_ASSERT_EQUALS(12u, spill.num_frames(), "Should have every frame.");
+			TEST_ASSERT_TRUE(props == spill.properties(), "Should have the properties written.");
+			TEST_ASSERT_EQUALS(ff::rational(1, 50), spill.time_base(), "Should have the time base written.");
+
+			for (size_t i = 0; i < in.size(); ++i)
+			{
+				ff::frame f = spill.get_frame(i);
+				TEST_ASSERT_TRUE(f.get_data_properties() == props, "Should be of the properties.");
+				TEST_ASSERT_TRUE(same_pixels(in[i], f), "Should have the data written.");
+				TEST_ASSERT_EQUALS(2 * (int64_t)i, f->pts, "Should have the pts written.");
+				TEST_ASSERT_EQUALS(2, (int)f->duration, "Should have the duration written.");
+				TEST_ASSERT_EQUALS((int)in[i]->pict_type, (int)f->pict_type, "Should have the picture type written.");
+				for (int p = 0; p < 3; ++p)
+				{
+					TEST_ASSERT_EQUALS(0u, reinterpret_cast<uintptr_t>(f->data[p]) % 64, "Planes should be aligned.");
+					TEST_ASSERT_EQUALS(0, f->linesize[p] % 64, "Lines should be aligned.");
+				}
+				TEST_ASSERT_FALSE(f.is_writable(), "Mapped data should be read only.");
+			}
+
+			// No copy is made.
+			TEST_ASSERT_TRUE(spill.get_frame(3)->data[0] == spill.get_frame(3)->data[0], "Should give out the mapped data.");
+			ff::frame scaled = spill.get_frame(11);
+			TEST_ASSERT_TRUE(scaled.get_data_properties() == props, "Should have been scaled.");
+			TEST_ASSERT_EQUALS(22, (int)scaled->pts, "Should keep the pts when scaled.");
+
+			TEST_ASSERT_EQUALS(0u, spill.find(0), "Should find the frame at its pts.");
+			TEST_ASSERT_EQUALS(4u, spill.find(9), "Should find the frame shown at the pts.");
+			TEST_ASSERT_EQUALS(11u, spill.find(1000), "Should find the last frame after the end.");
+			TEST_ASSERT_THROWS(spill.find(-1), std::out_of_range);
+			TEST_ASSERT_THROWS(spill.get_frame(12), std::out_of_range);
+			TEST_ASSERT_THROWS(spill.get_entry(12), std::out_of_range);
+
+			kept = spill.get_frame(5);
+		}
+
+		// The frame keeps the mapping.
+		TEST_ASSERT_TRUE(same_pixels(in[5], kept), "Should stay valid after the spill is gone.");
+		kept.make_writable();
+		TEST_ASSERT_TRUE(kept.is_writable(), "Should be copied to be written.");
+		kept->data[0][0] = 0;
+		ff::frame_spill again(spill_path);
+		TEST_ASSERT_TRUE(same_pixels(in[5], again.get_frame(5)), "Writing to the copy should not touch the spill.");
+	}
+
+	// Invalid use
+	{
+		// An abandoned writer leaves nothing.
+		fs::path abandoned(working_dir / "frame_spill_abandoned.ffwspill");
+		fs::path abandoned_tmp(abandoned);
+		abandoned_tmp += ".tmp";
+		{
+			ff::frame_spill_writer w(abandoned, props, ff::rational(1, 25));
+			w.write_frame(in[0]);
+		}
+		TEST_ASSERT_FALSE(fs::exists(abandoned_tmp), "Should remove the temporary file.");
+		TEST_ASSERT_FALSE(fs::exists(abandoned), "Should not spill anything.");
+
+		TEST_ASSERT_THROWS(ff::frame_spill_writer(abandoned, props, ff::rational(0, 1)), std::invalid_argument);
+		TEST_ASSERT_THROWS
+		(
+			ff::frame_spill_writer(abandoned, ff::frame::data_properties(AV_SAMPLE_FMT_FLTP, 1024, ff::ff_AV_CHANNEL_LAYOUT_STEREO), ff::rational(1, 25)),
+			std::invalid_argument
+		);
+		TEST_ASSERT_THROWS
+		(
+			ff::frame_spill_writer(abandoned, ff::frame::data_properties(AV_PIX_FMT_CUDA, 64, 48), ff::rational(1, 25)),
+			std::invalid_argument
+		);
+
+		TEST_ASSERT_THROWS(ff::frame_spill(working_dir / "frame_spill_missing.ffwspill"), std::filesystem::filesystem_error);
+		fs::path garbage(working_dir / "frame_spill_garbage.ffwspill");
+		{
+			std::ofstream os(garbage, std::ios::binary);
+			const std::string s(4096, 'x');
+			os.write(s.data(), s.size());
+		}
+		TEST_ASSERT_THROWS(ff::frame_spill(garbage), std::invalid_argument);
+		fs::remove(garbage);
+	}
+
+	fs::remove(spill_path);
+
+	FF_TEST_END
+
+	return 0;
+}
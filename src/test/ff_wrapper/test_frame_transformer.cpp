@@ -17,6 +17,15 @@
 #include "../test_util.h"
 
 #include "../../ff_wrapper/sws/frame_transformer.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/util/hw_device.h"
+
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <string>
+
+namespace fs = std::filesystem;
 
 int main()
 {
@@ -131,6 +140,151 @@ int main()
 		t1.convert_frame(ready_out, actual_in);
 		TEST_ASSERT_TRUE(ready_out.ready(), "Should be ready.");
 		TEST_ASSERT_EQUALS(op, ready_out.get_data_properties(), "Should have the properties.");
+
+		// The dst frames come from a pool, so a released one is reused.
+		const void* res_data = res.data();
+		res.clear_data();
+		res = t1.convert_frame(actual_in);
+		TEST_ASSERT_TRUE(res_data == res.data(), "Should reuse the released buffer.");
+	}
+
+	// Test threading
+	{
+		ff::frame::data_properties ip(AV_PIX_FMT_RGB24, 1280, 720);
+		ff::frame::data_properties op(AV_PIX_FMT_YUV420P, 640, 360);
+
+		TEST_ASSERT_THROWS(ff::frame_transformer(op, ip, ff::frame_transformer::FF_SWS_BICUBIC, -1), std::invalid_argument);
+
+		ff::frame_transformer single(op, ip, ff::frame_transformer::FF_SWS_BICUBIC, 1);
+		ff::frame_transformer multi(op, ip, ff::frame_transformer::FF_SWS_BICUBIC, 4);
+		TEST_ASSERT_EQUALS(1, single.get_num_threads(), "Should record the number.");
+		TEST_ASSERT_EQUALS(4, multi.get_num_threads(), "Should record the number.");
+
+		// Something that isn't the same everywhere.
+		ff::frame in(true);
+		in.allocate_data(ip);
+		for (int y = 0; y < ip.height; ++y)
+		{
+			uint8_t* row = in->data[0] + y * in->linesize[0];
+			for (int x = 0; x < ip.width * 3; ++x)
+			{
+				row[x] = (uint8_t)((x * 7 + y * 3) & 0xff);
+			}
+		}
+
+		ff::frame out1 = single.convert_frame(in);
+		ff::frame out2 = multi.convert_frame(in);
+
+		// The slices are scaled the same way wherever they are scaled.
+		const int plane_w[3] = { op.width, op.width / 2, op.width / 2 };
+		const int plane_h[3] = { op.height, op.height / 2, op.height / 2 };
+		bool same = true;
+		for (int p = 0; p < 3; ++p)
+		{
+			for (int y = 0; y < plane_h[p]; ++y)
+			{
+				const uint8_t* r1 = out1->data[p] + y * out1->linesize[p];
+				const uint8_t* r2 = out2->data[p] + y * out2->linesize[p];
+				for (int x = 0; x < plane_w[p]; ++x)
+				{
+					same = same && r1[x] == r2[x];
+				}
+			}
+		}
+		TEST_ASSERT_TRUE(same, "Should give the same result with more threads.");
+	}
+
+	// Test hardware frames
+	{
+		ff::frame::data_properties ip(AV_PIX_FMT_YUV420P, 640, 480);
+		ff::frame::data_properties op(AV_PIX_FMT_YUV420P, 320, 240);
+
+		// Software formats never take the hardware path.
+		TEST_ASSERT_FALSE(ff::frame_transformer::query_hardware_pixel_format_support(AV_PIX_FMT_YUV420P), "Not a device's format.");
+		TEST_ASSERT_FALSE(ff::frame_transformer(op, ip).hardware(), "Should use libswscale.");
+		TEST_ASSERT_THROWS(ff::frame_transformer(op, ip, AV_PIX_FMT_NV12), std::domain_error);
+
+		fs::path test_path(fs::current_path() / "frame_transformer_test_hw.mp4");
+		std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=1:size=640x480:rate=10 "
+			"-c:v libx264 -pix_fmt yuv420p -y ");
+		cmd += std::string("\"") + test_path.generic_string() + '\"';
+		std::system(cmd.c_str());
+
+		// The machine running the tests may not have any devices.
+		// Test every kind of device it has.
+		for (auto type : ff::hw_device::supported_types())
+		{
+			ff::hw_device* p_device = nullptr;
+			try
+			{
+				p_device = new ff::hw_device(type);
+			}
+			catch (const std::runtime_error&)
+			{
+				// No such device on this machine.
+				continue;
+			}
+
+			ff::demuxer dem(test_path);
+			ff::decoder dec(dem.get_stream(0).codec_id());
+			dec.set_codec_properties(dem.get_stream(0).properties());
+			const bool enabled = dec.enable_hardware_decoding(*p_device);
+			delete p_device;
+			if (!enabled)
+			{
+				continue;
+			}
+			dec.create_codec_context();
+
+			// The first frame decoded.
+			ff::frame hw(true);
+			ff::packet pkt;
+			while (!hw.ready() && dem.demux_next_packet(pkt))
+			{
+				dec.feed_packet(pkt);
+				dec.decode_frame(hw);
+			}
+			if (!hw.ready() || !hw.is_hardware())
+			{
+				// The device may not decode the stream after all.
+				continue;
+			}
+
+			const ff::frame::data_properties hw_ip(hw.get_data_properties());
+			const ff::frame::data_properties hw_op(hw_ip.fmt, 320, 240);
+			if (!ff::frame_transformer::query_hardware_pixel_format_support((AVPixelFormat)hw_ip.fmt))
+			{
+				TEST_ASSERT_THROWS(ff::frame_transformer(hw_op, hw_ip), std::domain_error);
+				continue;
+			}
+			// Never leaves the device.
+			TEST_ASSERT_THROWS(ff::frame_transformer(op, hw_ip), std::domain_error);
+
+			ff::frame_transformer t(hw_op, hw_ip);
+			TEST_ASSERT_TRUE(t.hardware(), "Should scale on the device.");
+			TEST_ASSERT_EQUALS(AV_PIX_FMT_NONE, t.get_dst_sw_format(), "Should keep the src's layout.");
+
+			ff::frame out = t.convert_frame(hw);
+			TEST_ASSERT_TRUE(out.is_hardware(), "Should still be on the device.");
+			TEST_ASSERT_EQUALS(hw_op, out.get_data_properties(), "Should have the dst properties.");
+			TEST_ASSERT_EQUALS(hw->pts, out->pts, "Should copy the properties.");
+			TEST_ASSERT_EQUALS(hw.hardware_sw_format(), out.hardware_sw_format(), "Should keep the layout.");
+			ff::frame sw = out.transfer_to_software();
+			TEST_ASSERT_EQUALS(320, sw->width, "Should have been scaled.");
+			TEST_ASSERT_EQUALS(240, sw->height, "Should have been scaled.");
+
+			ff::frame out2(true);
+			t.convert_frame(out2, hw);
+			TEST_ASSERT_EQUALS(hw_op, out2.get_data_properties(), "Should have the dst properties.");
+			// Again, with out2 ready.
+			t.convert_frame(out2, hw);
+			TEST_ASSERT_TRUE(out2.is_hardware(), "Should still be on the device.");
+
+			TEST_ASSERT_THROWS(t.convert_frame(hw, hw), std::invalid_argument);
+			ff::frame not_hw(true);
+			not_hw.allocate_data(ip);
+			TEST_ASSERT_THROWS(t.convert_frame(not_hw), std::invalid_argument);
+		}
 	}
 
 	return 0;
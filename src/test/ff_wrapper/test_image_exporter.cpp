@@ -0,0 +1,167 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/image_exporter.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/data/frame_ops.h"
+#include "../../ff_wrapper/util/channel_layout.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// @returns a 320x240 yuv420p frame of a flat grey of luma y.
+ff::frame make_grey(int y)
+{
+	ff::frame f(true);
+	f.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 320, 240));
+	ff::frame_ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 0>(f), static_cast<uint8_t>(y));
+	ff::frame_ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 1>(f), 128);
+	ff::frame_ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 2>(f), 128);
+	return f;
+}
+
+// @returns the big-endian 32-bit number at p.
+uint32_t read_be32(const uint8_t* p)
+{
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+bool is_png(const ff::packet& pkt, uint32_t w, uint32_t h)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	return pkt->size > 24 && std::equal(signature, signature + 8, pkt->data)
+		&& w == read_be32(pkt->data + 16) && h == read_be32(pkt->data + 20);
+}
+
+int main()
+{
+	FF_TEST_START
+
+	const ff::frame::data_properties src(AV_PIX_FMT_YUV420P, 320, 240);
+	fs::path working_dir(fs::current_path());
+
+	// Many thumbnails on a few workers
+	{
+		ff::image_exporter exp(src, 80, 60, ff::image_exporter::image_format::png, ff::dict(), 4);
+		TEST_ASSERT_EQUALS(4, exp.num_workers(), "Should start the workers asked for.");
+		TEST_ASSERT_EQUALS(AV_PIX_FMT_RGB24, exp.pixel_format(), "PNG should be in rgb24.");
+
+		std::vector<std::future<ff::packet>> results;
+		for (int i = 0; i < 40; ++i)
+		{
+			results.push_back(exp.submit(make_grey(16 + 5 * i)));
+		}
+		for (auto& r : results)
+		{
+			TEST_ASSERT_TRUE(is_png(r.get(), 80, 60), "Should give 80x60 PNGs.");
+		}
+
+		fs::path png_path(working_dir / "image_exporter_test.png");
+		ff::packet written = exp.submit(make_grey(100), png_path).get();
+		TEST_ASSERT_TRUE(fs::exists(png_path), "Should write the image.");
+		TEST_ASSERT_EQUALS((uintmax_t)written->size, fs::file_size(png_path), "Should write all of it.");
+
+		exp.finish();
+		TEST_ASSERT_EQUALS(41u, exp.number_exported(), "Should count every image.");
+		TEST_ASSERT_TRUE(exp.number_encoders_opened() <= 4, "Should open an encoder per worker at most.");
+		TEST_ASSERT_THROWS(exp.submit(make_grey(16)), std::logic_error);
+		exp.finish();
+	}
+
+	// A sprite sheet: 5 tiles in rows of 3, the 6th left black
+	{
+		ff::image_exporter exp(src, 80, 60, ff::image_exporter::image_format::png, ff::dict(), 2);
+		std::vector<ff::frame> frames;
+		for (int i = 0; i < 5; ++i)
+		{
+			frames.push_back(make_grey(16 + 40 * i));
+		}
+		ff::packet sheet = exp.submit_sprite_sheet(frames, 3).get();
+		TEST_ASSERT_TRUE(is_png(sheet, 240, 120), "Should be 3 by 2 tiles.");
+
+		ff::decoder dec(AV_CODEC_ID_PNG);
+		dec.set_threading_policy(ff::codec_base::threading_policy::single_threaded());
+		dec.create_codec_context();
+		dec.feed_packet(sheet);
+		dec.signal_no_more_food();
+		ff::frame f(true);
+		TEST_ASSERT_TRUE(dec.decode_frame(f), "Should decode the sheet.");
+		TEST_ASSERT_EQUALS(AV_PIX_FMT_RGB24, (AVPixelFormat)f->format, "Should be rgb24.");
+
+		for (int i = 0; i < 6; ++i)
+		{
+			const int x = (i % 3) * 80 + 40, y = (i / 3) * 60 + 30;
+			const int got = f->data[0][y * f->linesize[0] + 3 * x];
+			// Limited range luma to full range grey.
+			const int expected = i < 5 ? (40 * i) * 255 / 219 : 0;
+			TEST_ASSERT_TRUE(std::abs(expected - got) <= 3, "Each tile should be its frame, and the one left over black.");
+		}
+
+		TEST_ASSERT_THROWS(exp.submit_sprite_sheet(std::vector<ff::frame>(), 3), std::invalid_argument);
+		TEST_ASSERT_THROWS(exp.submit_sprite_sheet(frames, 0), std::invalid_argument);
+	}
+
+	// JPEG and WebP
+	{
+		ff::image_exporter jpeg(src, 160, 120, ff::image_exporter::image_format::jpeg);
+		ff::packet j = jpeg.submit(make_grey(80)).get();
+		TEST_ASSERT_TRUE(j->size > 3 && 0xff == j->data[0] && 0xd8 == j->data[1], "Should give a JPEG.");
+		ff::packet js = jpeg.submit_sprite_sheet({ make_grey(50), make_grey(150) }, 2).get();
+		TEST_ASSERT_TRUE(js->size > 3 && 0xff == js->data[0] && 0xd8 == js->data[1], "Should give a JPEG sheet.");
+
+		ff::dict options;
+		options.insert_entry("quality", "60");
+		ff::image_exporter webp(src, 160, 120, ff::image_exporter::image_format::webp, options);
+		ff::packet w = webp.submit(make_grey(80)).get();
+		TEST_ASSERT_TRUE
+		(
+			w->size > 12 && std::string(reinterpret_cast<const char*>(w->data), 4) == "RIFF"
+			&& std::string(reinterpret_cast<const char*>(w->data) + 8, 4) == "WEBP",
+			"Should give a WebP."
+		);
+	}
+
+	// Invalid use
+	{
+		TEST_ASSERT_THROWS(ff::image_exporter(src, 0, 60, ff::image_exporter::image_format::png), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::image_exporter(src, 81, 60, ff::image_exporter::image_format::jpeg), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::image_exporter(src, 80, 60, ff::image_exporter::image_format::png, ff::dict(), -1), std::invalid_argument);
+		TEST_ASSERT_THROWS
+		(
+			ff::image_exporter(ff::frame::data_properties(AV_SAMPLE_FMT_FLTP, 1024, ff::ff_AV_CHANNEL_LAYOUT_STEREO), 80, 60, ff::image_exporter::image_format::png),
+			std::invalid_argument
+		);
+
+		ff::image_exporter exp(src, 80, 60, ff::image_exporter::image_format::png, ff::dict(), 1);
+		ff::frame wrong(true);
+		wrong.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 640, 480));
+		TEST_ASSERT_THROWS(exp.submit(wrong), std::invalid_argument);
+		TEST_ASSERT_THROWS(exp.submit(ff::frame(true)), std::invalid_argument);
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,177 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+#include "../../ff_wrapper/pipeline/job_scheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+int main()
+{
+	FF_TEST_START
+
+	// Test the fair share
+	{
+		// A lone worker gets the whole budget.
+		TEST_ASSERT_EQUALS(8, ff::job_scheduler::fair_share(8, 0, 0, 1, 1), "Should get the whole budget.");
+		// Leaves 1 for each of the other workers.
+		TEST_ASSERT_EQUALS(7, ff::job_scheduler::fair_share(8, 0, 0, 1, 2), "Should leave 1 for the other worker.");
+		TEST_ASSERT_EQUALS(1, ff::job_scheduler::fair_share(8, 0, 0, 4, 8), "Should leave 1 for each of the others.");
+		// Shared among those that can run, but only the workers count.
+		TEST_ASSERT_EQUALS(4, ff::job_scheduler::fair_share(8, 0, 0, 100, 2), "Should share among the workers.");
+		TEST_ASSERT_EQUALS(4, ff::job_scheduler::fair_share(8, 4, 1, 100, 2), "Should get the rest.");
+		TEST_ASSERT_EQUALS(6, ff::job_scheduler::fair_share(12, 3, 1, 1, 4), "Should get a half.");
+		// But always at least 1.
+		TEST_ASSERT_EQUALS(1, ff::job_scheduler::fair_share(8, 6, 1, 1, 4), "Should get at least 1.");
+	}
+
+	// Test invalid arguments
+	{
+		TEST_ASSERT_THROWS(ff::job_scheduler(-1), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::job_scheduler(1, -1), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::job_scheduler(3, 2), std::invalid_argument);
+
+		ff::job_scheduler s(1, 1);
+		TEST_ASSERT_THROWS(s.submit(ff::job_scheduler::job()), std::invalid_argument);
+	}
+
+	// Test running many jobs within the budget
+	{
+		constexpr int budget = 6;
+		ff::job_scheduler d(0, budget);
+		TEST_ASSERT_EQUALS(budget, d.get_num_workers(), "Should have as many workers as the budget by default.");
+
+		ff::job_scheduler s(3, budget);
+		TEST_ASSERT_EQUALS(budget, s.get_core_budget(), "Should have the budget.");
+
+		std::atomic<int> done{ 0 }, in_use{ 0 }, max_in_use{ 0 };
+		std::vector<std::future<void>> futures;
+		for (int i = 0; i < 200; ++i)
+		{
+			futures.push_back(s.submit([&](const ff::job_scheduler::job_context& ctx)
+			{
+				const int now = in_use += ctx.num_threads();
+				int seen = max_in_use;
+				while (now > seen && !max_in_use.compare_exchange_weak(seen, now)) {}
+
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+				in_use -= ctx.num_threads();
+				++done;
+			}));
+		}
+		for (auto& f : futures)
+		{
+			f.get();
+		}
+		TEST_ASSERT_EQUALS(200, done.load(), "Should have run all jobs.");
+		TEST_ASSERT_TRUE(max_in_use.load() <= budget, "Should never exceed the budget.");
+		// A future is ready a little before its job is counted as finished.
+		s.wait_idle();
+		TEST_ASSERT_EQUALS(0, (int)s.number_running(), "Should be idle.");
+		TEST_ASSERT_EQUALS(0, (int)s.number_waiting(), "Should be idle.");
+	}
+
+	// Test that a lone job gets the cores the other workers don't need, and the threading policy
+	{
+		ff::job_scheduler s(2, 6);
+		auto f = s.submit([](const ff::job_scheduler::job_context& ctx)
+		{
+			if (5 != ctx.num_threads() || 5 != ctx.codec_threading().num_threads)
+			{
+				throw std::runtime_error("Should get all cores but 1.");
+			}
+		});
+		f.get();
+
+		ff::job_scheduler one(1, 1);
+		auto g = one.submit([](const ff::job_scheduler::job_context& ctx)
+		{
+			if (ff::codec_base::FF_THREADING_NONE != ctx.codec_threading().types)
+			{
+				throw std::runtime_error("Should be single threaded.");
+			}
+		});
+		g.get();
+	}
+
+	// Test exceptions, jobs submitting jobs, and wait_idle()
+	{
+		ff::job_scheduler s(3, 3);
+
+		auto f = s.submit([](const ff::job_scheduler::job_context&) { throw std::domain_error("On purpose."); });
+		TEST_ASSERT_THROWS(f.get(), std::domain_error);
+
+		std::atomic<int> done{ 0 };
+		for (int i = 0; i < 10; ++i)
+		{
+			s.submit([&](const ff::job_scheduler::job_context&)
+			{
+				for (int k = 0; k < 10; ++k)
+				{
+					s.submit([&](const ff::job_scheduler::job_context&) { ++done; });
+				}
+				++done;
+			});
+		}
+		s.wait_idle();
+		TEST_ASSERT_EQUALS(110, done.load(), "Should have run the jobs and those they submitted.");
+	}
+
+	// Test tiny jobs submitted while the workers are already running, so that they are taken right away
+	{
+		ff::job_scheduler s(4, 4);
+		for (int round = 0; round < 200; ++round)
+		{
+			std::atomic<int> done{ 0 };
+			for (int i = 0; i < 8; ++i)
+			{
+				s.submit([&](const ff::job_scheduler::job_context&) { ++done; });
+			}
+			// Would hang if the counts wrapped around.
+			s.wait_idle();
+			TEST_ASSERT_EQUALS(8, done.load(), "Should have run every job.");
+			TEST_ASSERT_EQUALS((size_t)0, s.number_waiting(), "Nothing should be waiting.");
+			TEST_ASSERT_EQUALS((size_t)0, s.number_running(), "Nothing should be running.");
+		}
+	}
+
+	// Test that the destructor waits for the jobs
+	{
+		std::atomic<int> done{ 0 };
+		{
+			ff::job_scheduler s(2, 2);
+			for (int i = 0; i < 20; ++i)
+			{
+				s.submit([&](const ff::job_scheduler::job_context&)
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+					++done;
+				});
+			}
+		}
+		TEST_ASSERT_EQUALS(20, done.load(), "Should have waited for all.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
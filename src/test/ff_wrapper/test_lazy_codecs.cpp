@@ -0,0 +1,184 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/lazy_codecs.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/codec/encoder.h"
+
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// A generator that counts how far it has been driven.
+ff::generator<int> count_up(int n, int& produced)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		produced = i + 1;
+		co_yield i;
+	}
+}
+
+ff::generator<int> throw_at(int n)
+{
+	for (int i = 0; ; ++i)
+	{
+		if (i == n)
+		{
+			throw std::runtime_error("Thrown on purpose.");
+		}
+		co_yield i;
+	}
+}
+
+int main()
+{
+	FF_TEST_START
+
+	// Test the generator itself
+	{
+		int produced = 0;
+		{
+			auto g = count_up(100, produced);
+			TEST_ASSERT_EQUALS(0, produced, "Should be lazy.");
+			int sum = 0;
+			for (int i : g)
+			{
+				sum += i;
+				if (4 == i)
+				{
+					break;
+				}
+			}
+			TEST_ASSERT_EQUALS(10, sum, "Should yield in order.");
+			TEST_ASSERT_EQUALS(5, produced, "Should not run ahead.");
+		}
+
+		int num = 0;
+		for (int i : count_up(3, produced) | std::views::take(10))
+		{
+			TEST_ASSERT_EQUALS(num, i, "Should yield in order.");
+			++num;
+		}
+		TEST_ASSERT_EQUALS(3, num, "Should end with the coroutine.");
+
+		auto g = throw_at(2);
+		auto it = g.begin();
+		++it;
+		TEST_ASSERT_THROWS(++it, std::runtime_error);
+
+		// Single-pass.
+		auto once = count_up(3, produced);
+		once.begin();
+		TEST_ASSERT_THROWS(once.begin(), std::logic_error);
+		auto moved = std::move(once);
+		TEST_ASSERT_THROWS(moved.begin(), std::logic_error);
+	}
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "lazy_codecs_test.mp4");
+	std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=4:size=320x240:rate=25 -c:v mpeg4 -g 25 -y ");
+	cmd += std::string("\"") + test_path.generic_string() + '\"';
+	std::system(cmd.c_str());
+
+	// Test invalid use
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder not_ready(dem.get_video(0).codec_id());
+		TEST_ASSERT_THROWS(ff::decoded_frames(dem, not_ready, 0), std::logic_error);
+		ff::decoder dec(dem.get_video(0));
+		TEST_ASSERT_THROWS(ff::decoded_frames(dem, dec, dem.num_streams()), std::out_of_range);
+		dec.signal_no_more_food();
+		TEST_ASSERT_THROWS(ff::decoded_frames(dem, dec, 0), std::logic_error);
+	}
+
+	// Test decoding everything
+	int num_frames = 0;
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+		int64_t last_pts = INT64_MIN;
+		for (ff::frame& f : ff::decoded_frames(dem, dec, dem.get_video_ind(0)))
+		{
+			TEST_ASSERT_TRUE(f.ready(), "Should yield ready frames.");
+			TEST_ASSERT_TRUE(f->pts > last_pts, "Should yield in order.");
+			last_pts = f->pts;
+			++num_frames;
+		}
+		TEST_ASSERT_EQUALS(100, num_frames, "Should decode all 4 s at 25 fps.");
+		TEST_ASSERT_TRUE(dec.no_more_food(), "Should have drained the decoder.");
+	}
+
+	// Test stopping early: the first 3 frames from 2 s on
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+		const int iv = dem.get_video_ind(0);
+		const ff::rational tb(dem.get_video(0)->time_base);
+		const int64_t t = 2 * tb.get_den() / tb.get_num();
+
+		dem.seek(iv, t, false);
+		std::vector<ff::frame> kept;
+		for (ff::frame& f : ff::decoded_frames(dem, dec, iv)
+			| std::views::drop_while([t](const ff::frame& f) { return f->pts < t; })
+			| std::views::take(3))
+		{
+			kept.push_back(f);
+		}
+
+		TEST_ASSERT_EQUALS(3, (int)kept.size(), "Should have taken 3 frames.");
+		TEST_ASSERT_TRUE(kept[0]->pts >= t, "Should start at t.");
+		TEST_ASSERT_TRUE(kept[0]->pts < kept[1]->pts && kept[1]->pts < kept[2]->pts, "Should be in order.");
+		TEST_ASSERT_FALSE(dem.eof(), "Should not have read the rest of the file.");
+		TEST_ASSERT_FALSE(dec.no_more_food(), "Should not have drained the decoder.");
+	}
+
+	// Test encoding lazily decoded frames
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+
+		ff::encoder enc(AV_CODEC_ID_MPEG4);
+		TEST_ASSERT_THROWS(ff::encoded_packets(enc, std::vector<ff::frame>()), std::logic_error);
+		ff::codec_properties ep(dec.get_codec_properties().essential_properties());
+		ep.set_time_base(ff::rational(dem.get_video(0)->time_base));
+		ep.set_v_frame_rate(ff::rational(25));
+		enc.set_codec_properties(ep);
+		enc.create_codec_context();
+
+		int num_packets = 0;
+		for (ff::packet& pkt : ff::encoded_packets(enc, ff::decoded_frames(dem, dec, dem.get_video_ind(0))))
+		{
+			TEST_ASSERT_TRUE(pkt.ready() && pkt.data_size() > 0, "Should yield encoded packets.");
+			++num_packets;
+		}
+		// MPEG-4 Part 2 has no B-frames by default.
+		TEST_ASSERT_EQUALS(num_frames, num_packets, "Should encode every frame.");
+		TEST_ASSERT_TRUE(enc.no_more_food(), "Should have drained the encoder.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/live_encoder.h"
+#include "../../ff_wrapper/pipeline/lazy_codecs.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/formats/muxer.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/codec/encoder.h"
+
+#include <chrono>
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <string>
+
+namespace fs = std::filesystem;
+
+int main()
+{
+	FF_TEST_START
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "live_encoder_test.mp4");
+	fs::path test_out_path(working_dir / "live_encoder_test_out.ts");
+	std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=2:size=320x240:rate=25 -c:v mpeg4 -y ");
+	cmd += std::string("\"") + test_path.generic_string() + '\"';
+	std::system(cmd.c_str());
+
+	// Test the low latency settings
+	{
+		ff::encoder enc(AV_CODEC_ID_MPEG4);
+		TEST_ASSERT_FALSE(enc.low_latency(), "Should not be low latency by default.");
+		enc.set_threading_policy(ff::codec_base::threading_policy(4));
+		enc.set_low_latency();
+		TEST_ASSERT_TRUE(enc.low_latency(), "Should be low latency.");
+		TEST_ASSERT_EQUALS(0, enc->max_b_frames, "Should have no B-frames.");
+		TEST_ASSERT_EQUALS(ff::codec_base::FF_THREADING_SLICE, enc.get_threading_policy().types, "Should not use frame threading.");
+
+		ff::muxer mux(test_out_path);
+		TEST_ASSERT_FALSE(mux.low_latency(), "Should not be low latency by default.");
+		TEST_ASSERT_THROWS(mux.set_low_latency(0), std::invalid_argument);
+		mux.set_low_latency(20000);
+		TEST_ASSERT_TRUE(mux.low_latency(), "Should be low latency.");
+		TEST_ASSERT_EQUALS(20000, mux.av_fmt_ctx()->max_interleave_delta, "Should bound the interleave delay.");
+	}
+
+	// Test encoding live
+	int num_frames = 0;
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+
+		ff::encoder enc(AV_CODEC_ID_MPEG4);
+		ff::codec_properties ep(dec.get_codec_properties().essential_properties());
+		ep.set_time_base(ff::rational(dem.get_video(0)->time_base));
+		ep.set_v_frame_rate(ff::rational(25));
+		enc.set_codec_properties(ep);
+		enc.set_low_latency();
+
+		ff::muxer mux(test_out_path);
+		enc.create_codec_context();
+		TEST_ASSERT_THROWS(enc.set_low_latency(), std::logic_error);
+
+		auto os = mux.add_stream(enc);
+		ff::encoder not_ready(AV_CODEC_ID_MPEG4);
+		TEST_ASSERT_THROWS(ff::live_encoder(not_ready, mux, os), std::logic_error);
+		mux.set_low_latency();
+		mux.prepare_muxer();
+		TEST_ASSERT_THROWS(mux.set_low_latency(), std::logic_error);
+
+		ff::live_encoder live(enc, mux, os);
+		for (ff::frame& f : ff::decoded_frames(dem, dec, dem.get_video_ind(0)))
+		{
+			const auto arrived = ff::live_encoder::clock::now();
+			TEST_ASSERT_EQUALS(1, live.push_frame(f, arrived), "Should write the packet of every frame at once.");
+			TEST_ASSERT_TRUE(live.last_latency() > ff::live_encoder::clock::duration::zero(), "Should measure the latency.");
+			TEST_ASSERT_TRUE(live.last_latency() <= ff::live_encoder::clock::now() - arrived, "Should measure from the arrival.");
+			++num_frames;
+		}
+		TEST_ASSERT_EQUALS(0, live.finish(), "Should have nothing left.");
+		TEST_ASSERT_THROWS(live.finish(), std::logic_error);
+		mux.finalize();
+
+		TEST_ASSERT_EQUALS(num_frames, (int)live.number_packets(), "Should have written a packet per frame.");
+		TEST_ASSERT_TRUE(live.max_latency() >= live.last_latency(), "Should keep the largest.");
+	}
+
+	{
+		ff::demuxer dem(test_out_path);
+		ff::decoder dec(dem.get_video(0));
+		int num_out = 0;
+		for (ff::frame& f : ff::decoded_frames(dem, dec, dem.get_video_ind(0)))
+		{
+			(void)f;
+			++num_out;
+		}
+		TEST_ASSERT_EQUALS(num_frames, num_out, "Should have all the frames.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
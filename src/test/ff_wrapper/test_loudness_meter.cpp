@@ -0,0 +1,190 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/loudness_meter.h"
+#include "../../ff_wrapper/data/frame_ops.h"
+
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <vector>
+
+// @returns a planar float frame of n samples of a sine of freq Hz and peak amplitude amp,
+// in each channel with a non-zero gain (multiplied by it), starting at sample start.
+ff::frame make_sine(const AVChannelLayout& layout, const std::vector<double>& gains, int n, int64_t start, double freq, double amp)
+{
+	ff::frame f(true);
+	f.allocate_data(ff::frame::data_properties(AV_SAMPLE_FMT_FLTP, n, layout));
+	for (int c = 0; c < layout.nb_channels; ++c)
+	{
+		float* data = reinterpret_cast<float*>(f->extended_data[c]);
+		for (int i = 0; i < n; ++i)
+		{
+			data[i] = static_cast<float>(gains[c] * amp * std::sin(2.0 * std::numbers::pi * freq * (start + i) / 48000.0));
+		}
+	}
+	return f;
+}
+
+// Feeds seconds of the sine to m in frames of 1024 samples.
+void feed_sine(ff::loudness_meter& m, const AVChannelLayout& layout, const std::vector<double>& gains, double seconds, double amp)
+{
+	const int64_t total = static_cast<int64_t>(seconds * 48000);
+	for (int64_t s = 0; s < total; s += 1024)
+	{
+		const int n = static_cast<int>(std::min<int64_t>(1024, total - s));
+		m.feed_frame(make_sine(layout, gains, n, s, 1000.0, amp));
+	}
+}
+
+bool near(double expected, double actual, double tolerance)
+{
+	return std::fabs(expected - actual) <= tolerance;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	const ff::channel_layout stereo(ff::ff_AV_CHANNEL_LAYOUT_STEREO);
+	const double amp_23 = std::pow(10.0, -23.0 / 20.0);
+
+	// EBU Tech 3341, case 1: a stereo 1 kHz sine at -23 dBFS is -23 LUFS.
+	{
+		ff::loudness_meter m(48000, stereo);
+		feed_sine(m, ff::ff_AV_CHANNEL_LAYOUT_STEREO, { 1.0, 1.0 }, 20.0, amp_23);
+		TEST_ASSERT_TRUE(near(-23.0, m.momentary(), 0.1), "The momentary loudness should be -23 LUFS.");
+		TEST_ASSERT_TRUE(near(-23.0, m.short_term(), 0.1), "The short-term loudness should be -23 LUFS.");
+
+		const auto& r = m.signal_no_more_food();
+		TEST_ASSERT_TRUE(near(-23.0, r.integrated, 0.1), "The integrated loudness should be -23 LUFS.");
+		TEST_ASSERT_TRUE(near(-23.0, r.max_momentary, 0.1), "The max momentary loudness should be -23 LUFS.");
+		TEST_ASSERT_TRUE(r.range >= 0.0 && r.range <= 0.2, "A steady tone has no range.");
+		TEST_ASSERT_TRUE(near(-23.0, r.sample_peak, 0.01), "The sample peak should be the amplitude.");
+		TEST_ASSERT_TRUE(near(-23.0, r.true_peak, 0.1), "The true peak should be the amplitude.");
+		TEST_ASSERT_TRUE(r.true_peak >= r.sample_peak, "The true peak is never under the sample peak.");
+		TEST_ASSERT_TRUE(near(-26.01, r.channel_rms[0], 0.05), "The RMS of a sine is 3 dB under its peak.");
+		TEST_ASSERT_EQUALS(48000 * 20, r.num_samples, "Should count every sample.");
+
+		TEST_ASSERT_TRUE(near(7.0, m.normalization_gain(-16.0, -1.0), 0.1), "Should bring it to -16 LUFS.");
+		TEST_ASSERT_TRUE(near(3.0, m.normalization_gain(-16.0, -20.0), 0.1), "Should be held back by the true peak.");
+		TEST_ASSERT_THROWS(m.signal_no_more_food(), std::logic_error);
+		TEST_ASSERT_THROWS(m.feed_frame(make_sine(ff::ff_AV_CHANNEL_LAYOUT_STEREO, { 1.0, 1.0 }, 10, 0, 1000.0, 0.1)), std::logic_error);
+	}
+
+	// Gating: -23 for 20 s between two 10 s stretches of -36 (below the relative gate) is still -23 LUFS.
+	{
+		ff::loudness_meter m(48000, stereo);
+		const double amp_36 = std::pow(10.0, -36.0 / 20.0);
+		feed_sine(m, ff::ff_AV_CHANNEL_LAYOUT_STEREO, { 1.0, 1.0 }, 10.0, amp_36);
+		feed_sine(m, ff::ff_AV_CHANNEL_LAYOUT_STEREO, { 1.0, 1.0 }, 20.0, amp_23);
+		feed_sine(m, ff::ff_AV_CHANNEL_LAYOUT_STEREO, { 1.0, 1.0 }, 10.0, amp_36);
+		const auto& r = m.signal_no_more_food();
+		TEST_ASSERT_TRUE(near(-23.0, r.integrated, 0.1), "The quiet parts should be gated out.");
+		TEST_ASSERT_TRUE(near(13.0, r.range, 0.3), "The range should span both levels.");
+	}
+
+	// Channel weights
+	{
+		const ff::channel_layout surround(ff::ff_AV_CHANNEL_LAYOUT_5POINT1);
+		ff::loudness_meter m(48000, surround);
+		for (int c = 0; c < 6; ++c)
+		{
+			const AVChannel ch = surround.channel_at(c);
+			if (AV_CHAN_LOW_FREQUENCY == ch)
+			{
+				TEST_ASSERT_EQUALS(0.0, m.weight(c), "LFE should be left out.");
+			}
+			else if (AV_CHAN_SIDE_LEFT == ch || AV_CHAN_SIDE_RIGHT == ch)
+			{
+				TEST_ASSERT_EQUALS(1.41, m.weight(c), "Surrounds should count more.");
+			}
+			else
+			{
+				TEST_ASSERT_EQUALS(1.0, m.weight(c), "Front channels count once.");
+			}
+		}
+
+		// Only the LFE is loud.
+		std::vector<double> gains(6, 0.0);
+		for (int c = 0; c < 6; ++c)
+		{
+			gains[c] = AV_CHAN_LOW_FREQUENCY == surround.channel_at(c) ? 1.0 : 0.0;
+		}
+		feed_sine(m, ff::ff_AV_CHANNEL_LAYOUT_5POINT1, gains, 2.0, 0.5);
+		const auto& r = m.signal_no_more_food();
+		TEST_ASSERT_TRUE(std::isinf(r.integrated), "The LFE alone has no loudness.");
+		TEST_ASSERT_TRUE(near(-6.02, r.sample_peak, 0.01), "The LFE still counts in the peaks.");
+		TEST_ASSERT_THROWS(m.normalization_gain(), std::logic_error);
+	}
+
+	// The vectorized kernels agree with the scalar ones, and the other formats with planar float.
+	{
+		const ff::frame_ops::simd_level level = ff::frame_ops::active_simd_level();
+
+		ff::loudness_meter vec(48000, stereo);
+		feed_sine(vec, ff::ff_AV_CHANNEL_LAYOUT_STEREO, { 1.0, 0.5 }, 5.0, 0.3);
+		const auto& rv = vec.signal_no_more_food();
+
+		ff::frame_ops::set_simd_level(ff::frame_ops::simd_level::scalar);
+		ff::loudness_meter sca(48000, stereo);
+		feed_sine(sca, ff::ff_AV_CHANNEL_LAYOUT_STEREO, { 1.0, 0.5 }, 5.0, 0.3);
+		const auto& rs = sca.signal_no_more_food();
+		ff::frame_ops::set_simd_level(level);
+
+		TEST_ASSERT_TRUE(near(rs.integrated, rv.integrated, 1e-9), "Should measure the same.");
+		TEST_ASSERT_TRUE(near(rs.channel_rms[1], rv.channel_rms[1], 1e-9), "Should measure the same.");
+
+		// The same in interleaved s16.
+		ff::loudness_meter s16(48000, stereo);
+		for (int64_t s = 0; s < 5 * 48000; s += 1024)
+		{
+			ff::frame planar = make_sine(ff::ff_AV_CHANNEL_LAYOUT_STEREO, { 1.0, 0.5 }, 1024, s, 1000.0, 0.3);
+			ff::frame f(true);
+			f.allocate_data(ff::frame::data_properties(AV_SAMPLE_FMT_S16, 1024, ff::ff_AV_CHANNEL_LAYOUT_STEREO));
+			int16_t* data = reinterpret_cast<int16_t*>(f->data[0]);
+			for (int i = 0; i < 1024; ++i)
+			{
+				for (int c = 0; c < 2; ++c)
+				{
+					data[2 * i + c] = static_cast<int16_t>(std::lround(reinterpret_cast<const float*>(planar->extended_data[c])[i] * 32768.0));
+				}
+			}
+			s16.feed_frame(f);
+		}
+		TEST_ASSERT_TRUE(near(rv.integrated, s16.signal_no_more_food().integrated, 0.01), "Should measure s16 the same.");
+	}
+
+	// Invalid use
+	{
+		TEST_ASSERT_THROWS(ff::loudness_meter(0, stereo), std::invalid_argument);
+
+		ff::loudness_meter m(48000, stereo);
+		TEST_ASSERT_THROWS(m.normalization_gain(), std::logic_error);
+		TEST_ASSERT_THROWS(m.feed_frame(ff::frame(true)), std::invalid_argument);
+		TEST_ASSERT_THROWS(m.feed_frame(make_sine(ff::ff_AV_CHANNEL_LAYOUT_MONO, { 1.0 }, 10, 0, 1000.0, 0.1)), std::invalid_argument);
+
+		ff::frame u8(true);
+		u8.allocate_data(ff::frame::data_properties(AV_SAMPLE_FMT_U8, 10, ff::ff_AV_CHANNEL_LAYOUT_STEREO));
+		TEST_ASSERT_THROWS(m.feed_frame(u8), std::domain_error);
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+#include "../../ff_wrapper/util/memory_budget.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+int main()
+{
+	FF_TEST_START
+
+	TEST_ASSERT_THROWS(ff::memory_budget(200, 100), std::invalid_argument);
+
+	// Test counting up the chain
+	{
+		ff::memory_budget pipeline;
+		TEST_ASSERT_TRUE(&ff::memory_budget::process_wide() == pipeline.get_parent(), "Should count for the process by default.");
+		const size_t before = ff::memory_budget::process_wide().bytes_in_use();
+
+		{
+			auto c1 = pipeline.force_acquire(100);
+			auto c2 = pipeline.try_acquire(50);
+			TEST_ASSERT_FALSE(c2.empty(), "There are no caps.");
+			TEST_ASSERT_EQUALS((size_t)150, pipeline.bytes_in_use(), "Should count both.");
+			TEST_ASSERT_EQUALS(before + 150, ff::memory_budget::process_wide().bytes_in_use(), "Should count for the parent, too.");
+
+			// Moving doesn't release.
+			ff::memory_budget::charge moved(std::move(c1));
+			TEST_ASSERT_TRUE(c1.empty(), "Should have been moved.");
+			TEST_ASSERT_EQUALS((size_t)100, moved.bytes(), "Should hold the bytes.");
+			TEST_ASSERT_EQUALS((size_t)150, pipeline.bytes_in_use(), "Moving doesn't release.");
+
+			c2.release();
+			TEST_ASSERT_EQUALS((size_t)100, pipeline.bytes_in_use(), "Should have released it.");
+		}
+		TEST_ASSERT_EQUALS((size_t)0, pipeline.bytes_in_use(), "Should release when destroyed.");
+		TEST_ASSERT_EQUALS(before, ff::memory_budget::process_wide().bytes_in_use(), "Should release the parent, too.");
+		TEST_ASSERT_EQUALS((size_t)150, pipeline.peak_bytes_in_use(), "Should remember the peak.");
+	}
+
+	// Test the hard cap
+	{
+		ff::memory_budget parent(0, 100, nullptr);
+		ff::memory_budget child(0, 0, &parent);
+
+		// Something is always allowed when nothing is charged.
+		auto huge = child.try_acquire(1000);
+		TEST_ASSERT_FALSE(huge.empty(), "Should allow one when nothing is charged.");
+		huge.release();
+
+		auto c1 = child.try_acquire(80);
+		TEST_ASSERT_FALSE(c1.empty(), "Should be under the cap.");
+		auto c2 = child.try_acquire(30);
+		TEST_ASSERT_TRUE(c2.empty(), "Should stop at the parent's cap.");
+		TEST_ASSERT_EQUALS((size_t)80, child.bytes_in_use(), "A failure should take back what it added.");
+
+		auto forced = child.force_acquire(30);
+		TEST_ASSERT_EQUALS((size_t)110, parent.bytes_in_use(), "Forcing passes the cap.");
+		forced.release();
+
+		// A waiter gets through once enough is released.
+		std::atomic<bool> got = false;
+		std::thread waiter([&]
+		{
+			auto c = child.acquire(30);
+			got = !c.empty();
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		TEST_ASSERT_FALSE(got.load(), "Should wait at the cap.");
+		c1.release();
+		waiter.join();
+		TEST_ASSERT_TRUE(got.load(), "Should get through after the release.");
+
+		// Raising the cap lets a waiter through, too.
+		auto c3 = child.try_acquire(90);
+		std::thread waiter2([&]
+		{
+			auto c = child.acquire(30);
+			got = !c.empty();
+		});
+		got = false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		parent.set_caps(0, 200);
+		waiter2.join();
+		TEST_ASSERT_TRUE(got.load(), "Should get through after the cap is raised.");
+
+		// A waiter gives up when told to stop.
+		parent.set_caps(0, 100);
+		std::atomic<bool> stop = false;
+		std::thread waiter3([&]
+		{
+			auto c = child.acquire(30, [&] { return stop.load(); });
+			got = !c.empty();
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		stop = true;
+		ff::memory_budget::wake_waiters();
+		waiter3.join();
+		TEST_ASSERT_FALSE(got.load(), "Should have given up.");
+		TEST_ASSERT_EQUALS((size_t)90, child.bytes_in_use(), "Giving up charges nothing.");
+	}
+
+	// Test releasing from inside acquire(), which wakes the waiters on the same thread
+	{
+		ff::memory_budget budget(0, 100);
+		auto held = budget.force_acquire(80);
+		auto c = budget.acquire(50, [&] { held.release(); return false; });
+		TEST_ASSERT_FALSE(c.empty(), "Should get through after stop released a charge.");
+		TEST_ASSERT_EQUALS((size_t)50, budget.bytes_in_use(), "Should have only the new charge.");
+	}
+
+	// Test the soft cap
+	{
+		ff::memory_budget budget(100, 0);
+		std::vector<bool> crossings;
+		bool right_budget = true;
+		budget.set_soft_cap_callback([&](const ff::memory_budget& b, bool over)
+		{
+			right_budget = right_budget && &budget == &b;
+			crossings.push_back(over);
+		});
+
+		auto c1 = budget.force_acquire(60);
+		auto c2 = budget.force_acquire(60);
+		TEST_ASSERT_TRUE(budget.over_soft_cap(), "Should be over the soft cap.");
+		auto c3 = budget.force_acquire(10);
+		c2.release();
+		TEST_ASSERT_FALSE(budget.over_soft_cap(), "Should be under the soft cap.");
+
+		TEST_ASSERT_TRUE(right_budget, "Should tell which budget.");
+		TEST_ASSERT_EQUALS((size_t)2, crossings.size(), "Should tell once each way.");
+		TEST_ASSERT_TRUE(crossings[0], "Should tell it's over first.");
+		TEST_ASSERT_FALSE(crossings[1], "Should tell it's under then.");
+	}
+
+	// Test many threads
+	{
+		ff::memory_budget budget(0, 1000);
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 8; ++i)
+		{
+			threads.emplace_back([&]
+			{
+				for (int j = 0; j < 2000; ++j)
+				{
+					auto c = budget.acquire(100);
+				}
+			});
+		}
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+
+		TEST_ASSERT_EQUALS((size_t)0, budget.bytes_in_use(), "Should have released everything.");
+		TEST_ASSERT_TRUE(budget.peak_bytes_in_use() <= 1000, "Should never pass the hard cap.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
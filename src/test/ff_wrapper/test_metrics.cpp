@@ -0,0 +1,138 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/util/metrics.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+
+#include <algorithm>
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+int main()
+{
+	FF_TEST_START
+
+	// Test the histogram
+	{
+		ff::metrics::histogram_snapshot h;
+		TEST_ASSERT_EQUALS(0, h.quantile_ns(0.5), "No sample.");
+
+		// 90 calls of about 100 ns and 10 of about 10 us.
+		h.buckets[6] = 90; // [64, 128)
+		h.buckets[13] = 10; // [8192, 16384)
+		h.count = 100;
+		h.total_ns = 90 * 100 + 10 * 10000;
+		h.max_ns = 10000;
+		TEST_ASSERT_EQUALS(127, h.quantile_ns(0.5), "Should be the upper end of the bucket.");
+		TEST_ASSERT_EQUALS(127, h.quantile_ns(0.9), "Should be the upper end of the bucket.");
+		TEST_ASSERT_EQUALS(10000, h.quantile_ns(0.99), "Should not exceed the max.");
+		TEST_ASSERT_EQUALS(1090.0, h.mean_ns(), "Should be the mean.");
+	}
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "metrics_test.mp4");
+	std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=1:size=320x240:rate=25 -c:v mpeg4 -y ");
+	cmd += std::string("\"") + test_path.generic_string() + '\"';
+	std::system(cmd.c_str());
+
+	ff::metrics::reset();
+	ff::metrics::set_tracing(true);
+
+	int num_packets = 0, num_frames = 0;
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+		// Moving keeps the counters.
+		ff::decoder moved(std::move(dec));
+
+		ff::packet pkt;
+		ff::frame f(true);
+		while (dem.demux_next_packet(pkt))
+		{
+			++num_packets;
+			moved.feed_packet(pkt);
+			while (moved.decode_frame(f))
+			{
+				++num_frames;
+			}
+		}
+		moved.signal_no_more_food();
+		while (moved.decode_frame(f))
+		{
+			++num_frames;
+		}
+	}
+	ff::metrics::set_tracing(false);
+
+	auto stats = ff::metrics::snapshot();
+	std::ostringstream trace;
+	ff::metrics::write_chrome_trace(trace);
+
+	if constexpr (!ff::metrics::enabled)
+	{
+		// Test that nothing is recorded
+		TEST_ASSERT_TRUE(stats.empty(), "Should record nothing when compiled out.");
+		TEST_ASSERT_FALSE(ff::metrics::tracing(), "Should never trace when compiled out.");
+		TEST_ASSERT_TRUE(std::string::npos == trace.str().find("\"ph\""), "Should have no event.");
+	}
+	else
+	{
+		// Test the counters
+		auto find = [&](const std::string& stage) -> const ff::metrics::stage_snapshot*
+		{
+			auto it = std::find_if(stats.begin(), stats.end(), [&](const auto& s)
+			{
+				return 0 == s.object.rfind("decoder#", 0) && s.stage == stage && s.calls > 0;
+			});
+			return stats.end() == it ? nullptr : &*it;
+		};
+
+		const auto* feed = find("feed_packet");
+		const auto* decode = find("decode_frame");
+		TEST_ASSERT_TRUE(nullptr != feed && nullptr != decode, "Should have recorded both stages.");
+		TEST_ASSERT_EQUALS(feed->object, decode->object, "Should be of the same decoder.");
+		TEST_ASSERT_EQUALS((uint64_t)num_packets, feed->items, "Should count the packets fed.");
+		TEST_ASSERT_TRUE(feed->bytes > 0, "Should count the bytes fed.");
+		TEST_ASSERT_EQUALS((uint64_t)num_frames, decode->items, "Should count the frames decoded.");
+		// Each loop above ends with a call that finds the decoder hungry.
+		TEST_ASSERT_TRUE(decode->refused >= 1, "Should count the refused calls.");
+		TEST_ASSERT_EQUALS(decode->calls, decode->items + decode->refused, "A call either decodes or is refused.");
+		TEST_ASSERT_EQUALS(decode->calls, decode->latency.count, "Each call should be in the histogram.");
+		TEST_ASSERT_TRUE(decode->latency.max_ns >= decode->latency.quantile_ns(0.5), "The median can't exceed the max.");
+
+		// Test the trace
+		TEST_ASSERT_TRUE(std::string::npos != trace.str().find("\"name\":\"decode_frame\""), "Should have the events.");
+		TEST_ASSERT_TRUE(std::string::npos != trace.str().find("\"ph\":\"X\""), "Should be complete events.");
+
+		// Test resetting
+		ff::metrics::reset();
+		TEST_ASSERT_TRUE(ff::metrics::snapshot().empty(), "Should forget the stages of gone objects.");
+		std::ostringstream empty_trace;
+		ff::metrics::write_chrome_trace(empty_trace);
+		TEST_ASSERT_TRUE(std::string::npos == empty_trace.str().find("\"ph\""), "Should have cleared the events.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -206,6 +206,23 @@ int main()
 		TEST_ASSERT_EQUALS(ff::time(cavp->dts, ff::rational(1, 144)), p1.dts(), "should do what av_packet_rescale_ts does");
 		TEST_ASSERT_EQUALS(ff::time(cavp->pts, ff::rational(1, 144)), p1.pts(), "should do what av_packet_rescale_ts does");
 		TEST_ASSERT_EQUALS(ff::time(cavp->duration, ff::rational(1, 144)), p1.duration(), "should do what av_packet_rescale_ts does");
+
+		// with a precomputed rescaler
+		ff::time_rescaler wrong_from(ff::rational(1, 600), ff::rational(1, 1200));
+		TEST_ASSERT_THROWS(p1.change_time_base(wrong_from), std::invalid_argument);
+
+		ff::time_rescaler rescaler(ff::rational(1, 144), ff::rational(1, 90000));
+		av_packet_rescale_ts(cavp, p1.time_base().av_rational(), ff::rational(1, 90000).av_rational());
+		p1.change_time_base(rescaler);
+		TEST_ASSERT_EQUALS(ff::rational(1, 90000), p1.time_base(), "should really change the tb.");
+		TEST_ASSERT_EQUALS(cavp->dts, p1->dts, "should do what av_packet_rescale_ts does");
+		TEST_ASSERT_EQUALS(cavp->pts, p1->pts, "should do what av_packet_rescale_ts does");
+		TEST_ASSERT_EQUALS(cavp->duration, p1->duration, "should do what av_packet_rescale_ts does");
+
+		// An unset pts stays unset.
+		p1->pts = AV_NOPTS_VALUE;
+		p1.change_time_base(rescaler.inverse());
+		TEST_ASSERT_EQUALS(AV_NOPTS_VALUE, p1->pts, "should keep AV_NOPTS_VALUE");
 	}
 
 	return 0;
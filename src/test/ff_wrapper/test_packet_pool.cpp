@@ -0,0 +1,157 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+#include "../../ff_wrapper/data/packet_pool.h"
+#include "../../ff_wrapper/data/frame.h"
+#include "../../ff_wrapper/codec/encoder.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include <cstdint>
+
+int main()
+{
+	FF_TEST_START
+
+	// Test getting packets
+	{
+		ff::packet_pool pool;
+		TEST_ASSERT_EQUALS(0, pool.number_free_packets(), "Should be empty initially.");
+
+		ff::packet p1 = pool.get_packet();
+		TEST_ASSERT_TRUE(p1.created(), "Should be created without data.");
+
+		TEST_ASSERT_THROWS(pool.get_packet(0), std::invalid_argument);
+		TEST_ASSERT_THROWS(pool.get_packet(-1), std::invalid_argument);
+
+		ff::packet p2 = pool.get_packet(100);
+		TEST_ASSERT_TRUE(p2.ready(), "Should be ready.");
+		TEST_ASSERT_EQUALS(100, p2.data_size(), "Should have the size.");
+		const uint8_t* padding = static_cast<const uint8_t*>(p2.data()) + 100;
+		for (int i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; ++i)
+		{
+			TEST_ASSERT_EQUALS(0, padding[i], "The padding should be zeroed.");
+		}
+		// Can write to all of it.
+		for (int i = 0; i < 100; ++i)
+		{
+			static_cast<uint8_t*>(p2.data())[i] = static_cast<uint8_t>(i);
+		}
+
+		// Too large to be pooled, but still works.
+		ff::packet p3 = pool.get_packet(32 * 1024 * 1024);
+		TEST_ASSERT_EQUALS(32 * 1024 * 1024, p3.data_size(), "Should have the size.");
+	}
+
+	// Test recycling
+	{
+		ff::packet_pool pool(2);
+
+		ff::packet p1 = pool.get_packet(100);
+		const AVPacket* p1_av = p1.av_packet();
+		const void* p1_data = p1.data();
+		pool.recycle(p1);
+		TEST_ASSERT_TRUE(p1.destroyed(), "Should be destroyed.");
+		TEST_ASSERT_EQUALS(1, pool.number_free_packets(), "Should keep it.");
+		// Nothing happens.
+		pool.recycle(p1);
+		TEST_ASSERT_EQUALS(1, pool.number_free_packets(), "Should not keep a destroyed one.");
+
+		// Both the packet and the payload are reused.
+		// 200 is in the same size class as 100.
+		ff::packet p2 = pool.get_packet(200);
+		TEST_ASSERT_TRUE(p1_av == p2.av_packet(), "Should reuse the packet.");
+		TEST_ASSERT_TRUE(p1_data == p2.data(), "Should reuse the payload.");
+		TEST_ASSERT_EQUALS(200, p2.data_size(), "Should have the new size.");
+		TEST_ASSERT_EQUALS(0, pool.number_free_packets(), "Should have given it out.");
+
+		// A payload still referenced by a copy is not reused.
+		ff::packet c2(p2);
+		pool.recycle(p2);
+		ff::packet p3 = pool.get_packet(200);
+		TEST_ASSERT_TRUE(c2.data() != p3.data(), "Should not reuse a payload in use.");
+		TEST_ASSERT_EQUALS(200, c2.data_size(), "The copy should not be affected.");
+
+		// Keep at most 2.
+		ff::packet p4 = pool.get_packet(), p5 = pool.get_packet(), p6 = pool.get_packet();
+		pool.recycle(p4);
+		pool.recycle(p5);
+		pool.recycle(p6);
+		TEST_ASSERT_EQUALS(2, pool.number_free_packets(), "Should free the rest.");
+	}
+
+	// Test packets outliving the pool
+	{
+		ff::packet p1(false);
+		{
+			ff::packet_pool pool;
+			p1 = pool.get_packet(64);
+		}
+		static_cast<uint8_t*>(p1.data())[63] = 42;
+		TEST_ASSERT_EQUALS(42, static_cast<uint8_t*>(p1.data())[63], "Should still be accessible.");
+	}
+
+	// Test encoding with a packet pool
+	{
+		ff::packet_pool pool;
+		ff::encoder e1(AVCodecID::AV_CODEC_ID_PNG);
+
+		ff::codec_properties cp1(e1.get_codec_properties());
+		cp1.set_time_base(ff::common_video_time_base_600);
+		cp1.set_v_pixel_format(AVPixelFormat::AV_PIX_FMT_RGB24);
+		cp1.set_v_width(64);
+		cp1.set_v_height(48);
+		e1.set_codec_properties(cp1);
+		// So that a packet comes out after each frame goes in.
+		e1.set_threading_policy(ff::codec_base::threading_policy::single_threaded());
+
+		bool uses_pool = e1.use_packet_pool(pool);
+		TEST_ASSERT_EQUALS((0 != (e1->codec->capabilities & AV_CODEC_CAP_DR1)), uses_pool, "Should match the capability.");
+		e1.create_codec_context();
+		TEST_ASSERT_THROWS(e1.use_packet_pool(pool), std::logic_error);
+
+		const ff::frame::data_properties fp(AVPixelFormat::AV_PIX_FMT_RGB24, 64, 48);
+		const AVPacket* prev_av = nullptr;
+		for (int i = 0; i < 10; ++i)
+		{
+			ff::frame f(true);
+			f.allocate_data(fp);
+			f.reset_time(i * 25, ff::common_video_time_base_600);
+			TEST_ASSERT_TRUE(e1.feed_frame(f), "Should be hungry.");
+
+			ff::packet pkt = e1.encode_packet(pool);
+			TEST_ASSERT_TRUE(pkt.ready(), "PNG encodes one packet per frame.");
+			TEST_ASSERT_TRUE(pkt.data_size() > 0, "Should have data.");
+			if (nullptr != prev_av)
+			{
+				TEST_ASSERT_TRUE(prev_av == pkt.av_packet(), "Should reuse the packet.");
+			}
+			prev_av = pkt.av_packet();
+			pool.recycle(pkt);
+
+			// Hungry now.
+			TEST_ASSERT_TRUE(e1.encode_packet(pool).destroyed(), "Should be hungry.");
+		}
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,178 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/formats/packet_trace.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/pipeline/lazy_codecs.h"
+
+#include <algorithm>
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main()
+{
+	FF_TEST_START
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "packet_trace_test.mp4");
+	fs::path trace_path(working_dir / "packet_trace_test.ffwtrace");
+	std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=2:size=320x240:rate=25 "
+		"-f lavfi -i sine=duration=2 -c:v mpeg4 -bf 2 -c:a aac -y ");
+	cmd += std::string("\"") + test_path.generic_string() + '\"';
+	std::system(cmd.c_str());
+
+	// The packets and frames of the video, straight from the file.
+	std::vector<ff::packet> pkts;
+	std::vector<int64_t> frame_pts;
+	int iv;
+	ff::rational tb;
+	{
+		ff::demuxer dem(test_path);
+		iv = dem.get_video_ind(0);
+		tb = dem.get_stream(iv).time_base();
+		ff::packet pkt;
+		while (dem.demux_next_packet(pkt))
+		{
+			if (iv == pkt->stream_index)
+			{
+				pkts.push_back(pkt);
+			}
+		}
+
+		ff::demuxer dem2(test_path);
+		ff::decoder dec(dem2.get_stream(iv));
+		for (ff::frame& f : ff::decoded_frames(dem2, dec, iv))
+		{
+			frame_pts.push_back(f->pts);
+		}
+	}
+	TEST_ASSERT_EQUALS(50, (int)frame_pts.size(), "Should decode every frame.");
+
+	// Recording keeps every packet of the stream as it was
+	{
+		ff::demuxer dem(test_path);
+		TEST_ASSERT_EQUALS(pkts.size(), ff::packet_trace::record(dem, iv, trace_path), "Should record every packet of the stream.");
+		TEST_ASSERT_FALSE(fs::exists(fs::path(trace_path.generic_string() + ".tmp")), "Should not leave the temporary file.");
+
+		ff::packet_trace trace(trace_path);
+		TEST_ASSERT_EQUALS(pkts.size(), trace.num_packets(), "Should map every packet.");
+		TEST_ASSERT_EQUALS(tb, trace.time_base(), "Should have the stream's time base.");
+		TEST_ASSERT_EQUALS((int)AV_CODEC_ID_MPEG4, trace.stream_info().codec_id, "Should have the stream's codec.");
+		TEST_ASSERT_EQUALS(320, trace.stream_info().width, "Should have the stream's width.");
+
+		uint64_t total = 0;
+		for (size_t i = 0; i < pkts.size(); ++i)
+		{
+			const ff::packet p(trace.get_packet(i));
+			TEST_ASSERT_EQUALS(pkts[i]->pts, p->pts, "Should keep the pts.");
+			TEST_ASSERT_EQUALS(pkts[i]->dts, p->dts, "Should keep the dts.");
+			TEST_ASSERT_EQUALS(pkts[i]->flags, p->flags, "Should keep the flags.");
+			TEST_ASSERT_EQUALS(pkts[i]->size, p->size, "Should keep the size.");
+			TEST_ASSERT_TRUE(std::equal(p->data, p->data + p->size, pkts[i]->data), "Should keep the payload.");
+			TEST_ASSERT_EQUALS(0, p->data[p->size], "Should be padded.");
+			TEST_ASSERT_EQUALS(0u, trace.get_entry(i).offset % 64, "Should align the payloads.");
+			total += p->size;
+		}
+		TEST_ASSERT_EQUALS(total, trace.payload_bytes(), "Should count the payload bytes.");
+	}
+
+	// A packet keeps the mapping after the trace is gone
+	{
+		ff::packet kept;
+		{
+			ff::packet_trace trace(trace_path);
+			kept = trace.get_packet(3);
+		}
+		TEST_ASSERT_EQUALS(pkts[3]->size, kept->size, "Should keep the size.");
+		TEST_ASSERT_TRUE(std::equal(kept->data, kept->data + kept->size, pkts[3]->data), "Should still read the payload.");
+	}
+
+	// Replaying decodes the same frames as the file
+	{
+		ff::packet_trace trace(trace_path);
+		ff::decoder dec(trace.make_decoder());
+		TEST_ASSERT_TRUE(dec.ready(), "Should make a ready decoder.");
+
+		auto r = trace.replay(dec);
+		TEST_ASSERT_EQUALS(pkts.size(), r.packets, "Should feed every packet.");
+		TEST_ASSERT_EQUALS(frame_pts.size(), r.frames, "Should get every frame.");
+		TEST_ASSERT_TRUE(r.seconds > 0.0 && r.frames_per_second() > 0.0, "Should time it.");
+		TEST_ASSERT_TRUE(r.latency_p50_ns > 0, "Should measure the latency.");
+		TEST_ASSERT_TRUE
+		(
+			r.latency_p50_ns <= r.latency_p90_ns && r.latency_p90_ns <= r.latency_p99_ns && r.latency_p99_ns <= r.latency_max_ns,
+			"The percentiles should be in order."
+		);
+		TEST_ASSERT_TRUE(r.frame_buffers > 0 && r.frame_buffers <= r.frames, "Should count the frame buffers.");
+
+		// Again, twice over, with the same decoder.
+		dec.reset();
+		r = trace.replay(dec, ff::packet_trace::replay_options{ 0.0, 2 });
+		TEST_ASSERT_EQUALS(2 * pkts.size(), r.packets, "Should feed every packet twice.");
+		TEST_ASSERT_EQUALS(2 * frame_pts.size(), r.frames, "Should get every frame twice.");
+	}
+
+	// A fixed rate holds the feeding back
+	{
+		fs::path short_path(working_dir / "packet_trace_short.ffwtrace");
+		ff::demuxer dem(test_path);
+		TEST_ASSERT_EQUALS(10u, ff::packet_trace::record(dem, iv, short_path, 10), "Should stop at max_packets.");
+
+		ff::packet_trace trace(short_path);
+		ff::decoder dec(trace.make_decoder());
+		// 10 packets at 100 per second take at least 90 ms.
+		auto r = trace.replay(dec, ff::packet_trace::replay_options{ 100.0, 1 });
+		TEST_ASSERT_EQUALS(10u, r.packets, "Should feed every packet.");
+		TEST_ASSERT_TRUE(r.seconds >= 0.09, "Should keep to the rate.");
+	}
+
+	// Invalid use
+	{
+		ff::demuxer dem(test_path);
+		TEST_ASSERT_THROWS(ff::packet_trace::record(dem, 5, trace_path), std::out_of_range);
+
+		fs::path bogus_path(working_dir / "packet_trace_bogus.ffwtrace");
+		{
+			std::ofstream os(bogus_path, std::ios::binary);
+			os << "This is not a trace, though it is long enough to hold the header of one.";
+		}
+		TEST_ASSERT_THROWS(ff::packet_trace{ bogus_path }, std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::packet_trace{ working_dir / "packet_trace_missing.ffwtrace" }, std::filesystem::filesystem_error);
+
+		ff::packet_trace trace(trace_path);
+		TEST_ASSERT_THROWS(trace.get_packet(trace.num_packets()), std::out_of_range);
+
+		ff::decoder dec(trace.make_decoder());
+		TEST_ASSERT_THROWS(trace.replay(dec, ff::packet_trace::replay_options{ 0.0, 0 }), std::invalid_argument);
+		TEST_ASSERT_THROWS(trace.replay(dec, ff::packet_trace::replay_options{ -1.0, 1 }), std::invalid_argument);
+		dec.signal_no_more_food();
+		TEST_ASSERT_THROWS(trace.replay(dec), std::logic_error);
+
+		ff::decoder not_ready(AV_CODEC_ID_MPEG4);
+		TEST_ASSERT_THROWS(trace.replay(not_ready), std::logic_error);
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
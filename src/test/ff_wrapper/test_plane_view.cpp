@@ -0,0 +1,120 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../test_util.h"
+#include "../../ff_wrapper/data/plane_view.h"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+#include <cstdint>
+
+int main()
+{
+	FF_TEST_START
+
+	// Test the checks
+	{
+		ff::frame f(true);
+		TEST_ASSERT_THROWS((ff::view_plane<AV_PIX_FMT_YUV420P, 0>(f)), std::logic_error);
+
+		ff::frame a(true);
+		a.allocate_data(ff::frame::data_properties(AV_SAMPLE_FMT_S16, 144, ff::ff_AV_CHANNEL_LAYOUT_STEREO));
+		TEST_ASSERT_THROWS((ff::view_plane<AV_PIX_FMT_YUV420P, 0>(a)), std::logic_error);
+
+		f.allocate_data(ff::frame::data_properties(AV_PIX_FMT_NV12, 64, 48));
+		TEST_ASSERT_THROWS((ff::view_plane<AV_PIX_FMT_YUV420P, 0>(f)), std::invalid_argument);
+		TEST_ASSERT_THROWS((ff::view_plane<AV_PIX_FMT_RGBA, 0>(f)), std::invalid_argument);
+	}
+
+	// Test the geometry of the formats
+	{
+		// Odd sizes for the rounding up of the subsampled planes.
+		ff::frame f(true);
+		f.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 63, 45));
+		auto y = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(f);
+		auto u = ff::view_plane<AV_PIX_FMT_YUV420P, 1>(f);
+		auto v = ff::view_plane<AV_PIX_FMT_YUV420P, 2>(f);
+		TEST_ASSERT_TRUE(63 == y.width() && 45 == y.height(), "Luma should be full size.");
+		TEST_ASSERT_TRUE(32 == u.width() && 23 == u.height(), "Chroma should be halved, rounded up.");
+		TEST_ASSERT_TRUE(32 == v.width() && 23 == v.height(), "Chroma should be halved, rounded up.");
+		TEST_ASSERT_EQUALS(f.data<uint8_t>(1), u.data(), "Should view the plane.");
+		TEST_ASSERT_EQUALS(f.line_size(2), v.line_size(), "Should have the stride of the plane.");
+
+		ff::frame nv(true);
+		nv.allocate_data(ff::frame::data_properties(AV_PIX_FMT_NV12, 64, 48));
+		auto uv = ff::view_plane<AV_PIX_FMT_NV12, 1>(nv);
+		TEST_ASSERT_TRUE(64 == uv.width() && 24 == uv.height(), "UV should be interleaved.");
+
+		ff::frame rgba(true);
+		rgba.allocate_data(ff::frame::data_properties(AV_PIX_FMT_RGBA, 64, 48));
+		auto px = ff::view_plane<AV_PIX_FMT_RGBA, 0>(rgba);
+		TEST_ASSERT_TRUE(256 == px.width() && 48 == px.height(), "Each pixel should be 4 elements.");
+
+		ff::frame p010(true);
+		p010.allocate_data(ff::frame::data_properties(AV_PIX_FMT_P010LE, 64, 48));
+		auto p010_y = ff::view_plane<AV_PIX_FMT_P010LE, 0>(p010);
+		static_assert(std::is_same_v<decltype(p010_y)::element_type, uint16_t>);
+		TEST_ASSERT_TRUE(64 == p010_y.width() && 48 == p010_y.height(), "Luma should be full size.");
+		TEST_ASSERT_EQUALS(p010.data<uint16_t>(0), p010_y.data(), "Should view the plane.");
+	}
+
+	// Test accessing
+	{
+		ff::frame f(true);
+		f.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 64, 48));
+		auto y = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(f);
+		for (int i = 0; i < y.height(); ++i)
+		{
+			for (int j = 0; j < y.width(); ++j)
+			{
+				y(i, j) = static_cast<uint8_t>(i + j);
+			}
+		}
+
+		for (int i = 0; i < y.height(); ++i)
+		{
+			const uint8_t* row = f.data<uint8_t>(0) + i * f.line_size(0);
+			for (int j = 0; j < y.width(); ++j)
+			{
+				TEST_ASSERT_EQUALS(static_cast<uint8_t>(i + j), row[j], "Should write through the view.");
+			}
+		}
+
+		const ff::frame& cf = f;
+		auto cy = ff::view_plane<AV_PIX_FMT_YUV420P, 0>(cf);
+		static_assert(std::is_same_v<decltype(cy)::element_type, const uint8_t>);
+		ff::plane_view<const uint8_t> from_mutable = y;
+		TEST_ASSERT_EQUALS(cy.data(), from_mutable.data(), "Should view the same plane.");
+
+		int sum = 0;
+		for (uint8_t val : cy.row_span(3))
+		{
+			sum += val;
+		}
+		// 3 + 4 + ... + 66
+		TEST_ASSERT_EQUALS((3 + 66) * 64 / 2, sum, "Should read through the view.");
+
+		// Up-side-down
+		ff::plane_view<const uint8_t> flipped(cy.row(cy.height() - 1), -cy.line_size(), cy.width(), cy.height());
+		TEST_ASSERT_EQUALS(cy(0, 5), flipped(cy.height() - 1, 5), "Should walk backwards.");
+		TEST_ASSERT_EQUALS(cy(7, 5), flipped(cy.height() - 8, 5), "Should walk backwards.");
+	}
+
+	FF_TEST_END
+}
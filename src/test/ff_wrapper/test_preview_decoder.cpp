@@ -0,0 +1,173 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/preview_decoder.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/data/packet.h"
+
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <string>
+
+namespace fs = std::filesystem;
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_video(const std::string& file_path, const char* codec)
+{
+	std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=1:size=640x480:rate=25 -c:v ");
+	cmd += codec;
+	cmd += std::string(" -y \"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// Decodes all of the video with d.
+// @returns how many frames were given out, or -1 if one is not of w x h in fmt.
+int decode_all(ff::demuxer& dem, ff::preview_decoder& d, int w, int h, AVPixelFormat fmt)
+{
+	int n = 0;
+	const int iv = dem.get_video_ind(0);
+	ff::packet pkt;
+	ff::frame f;
+
+	auto take = [&]() -> bool
+		{
+			while (d.decode_frame(f))
+			{
+				if (f->width != w || f->height != h || (AV_PIX_FMT_NONE != fmt && f->format != fmt))
+				{
+					return false;
+				}
+				++n;
+			}
+			return true;
+		};
+
+	while (dem.demux_next_packet(pkt))
+	{
+		if (iv != pkt->stream_index)
+		{
+			continue;
+		}
+		while (!d.feed_packet(pkt))
+		{
+			if (!take())
+			{
+				return -1;
+			}
+		}
+		if (!take())
+		{
+			return -1;
+		}
+	}
+	d.signal_no_more_food();
+	if (!take())
+	{
+		return -1;
+	}
+
+	return n;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	// Choosing the factor
+	{
+		TEST_ASSERT_EQUALS(0, ff::decoder::lowres_for_size(640, 480, 640, 480, 3), "Full size needs no reduction.");
+		TEST_ASSERT_EQUALS(2, ff::decoder::lowres_for_size(640, 480, 160, 120, 3), "A quarter exactly.");
+		TEST_ASSERT_EQUALS(2, ff::decoder::lowres_for_size(640, 480, 100, 75, 3), "Never smaller than the target.");
+		TEST_ASSERT_EQUALS(1, ff::decoder::lowres_for_size(640, 480, 100, 75, 1), "No more than the max.");
+		TEST_ASSERT_EQUALS(1, ff::decoder::lowres_for_size(641, 481, 321, 241, 3), "Rounds the reduced sizes up.");
+		TEST_ASSERT_THROWS(ff::decoder::lowres_for_size(0, 480, 100, 75, 3), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::decoder::lowres_for_size(640, 480, 100, 75, -1), std::invalid_argument);
+	}
+
+	fs::path working_dir(fs::current_path());
+	fs::path mjpeg_path(working_dir / "preview_test_mjpeg.avi");
+	create_test_video(mjpeg_path.generic_string(), "mjpeg");
+	fs::path mpeg4_path(working_dir / "preview_test_mpeg4.mp4");
+	create_test_video(mpeg4_path.generic_string(), "mpeg4");
+
+	// set_lowres() on a decoder
+	{
+		ff::demuxer dem(mjpeg_path);
+		ff::decoder dec(dem.get_video(0).codec_id());
+		TEST_ASSERT_TRUE(dec.max_lowres() > 0, "MJPEG decoders can reduce the resolution.");
+		TEST_ASSERT_THROWS(dec.set_lowres(-1), std::invalid_argument);
+		TEST_ASSERT_THROWS(dec.set_lowres(dec.max_lowres() + 1), std::invalid_argument);
+		dec.set_codec_properties(dem.get_video(0).properties());
+		dec.set_lowres(1);
+		dec.create_codec_context();
+		TEST_ASSERT_EQUALS(1, dec.get_lowres(), "Should keep the factor.");
+		TEST_ASSERT_THROWS(dec.set_lowres(0), std::logic_error);
+
+		ff::packet pkt;
+		ff::frame f;
+		bool decoded = false;
+		while (!decoded && dem.demux_next_packet(pkt))
+		{
+			dec.feed_packet(pkt);
+			decoded = dec.decode_frame(f);
+		}
+		TEST_ASSERT_TRUE(decoded, "Should decode a frame.");
+		TEST_ASSERT_EQUALS(320, f->width, "Should decode at half the width.");
+		TEST_ASSERT_EQUALS(240, f->height, "Should decode at half the height.");
+	}
+
+	// MJPEG at exactly a quarter needs no scaling
+	{
+		ff::demuxer dem(mjpeg_path);
+		ff::preview_decoder d(dem.get_video(0), 160, 120);
+		TEST_ASSERT_EQUALS(2, d.lowres(), "Should decode at a quarter.");
+		TEST_ASSERT_EQUALS(25, decode_all(dem, d, 160, 120, AV_PIX_FMT_NONE), "Should give out every frame at the target.");
+		TEST_ASSERT_FALSE(d.scaled(), "Should not scale.");
+	}
+
+	// MJPEG to an odd size and another format
+	{
+		ff::demuxer dem(mjpeg_path);
+		ff::preview_decoder d(dem.get_video(0), 100, 76, AV_PIX_FMT_RGB24);
+		TEST_ASSERT_EQUALS(2, d.lowres(), "Should decode at the smallest size no smaller than the target.");
+		TEST_ASSERT_EQUALS(25, decode_all(dem, d, 100, 76, AV_PIX_FMT_RGB24), "Should give out every frame at the target.");
+		TEST_ASSERT_TRUE(d.scaled(), "Should scale the rest.");
+	}
+
+	// Another codec, at whatever size its decoder can reduce to
+	{
+		ff::demuxer dem(mpeg4_path);
+		ff::preview_decoder d(dem.get_video(0), 160, 120);
+		if (0 == d.get_decoder().max_lowres())
+		{
+			TEST_ASSERT_EQUALS(0, d.lowres(), "Should decode at full size.");
+		}
+		TEST_ASSERT_EQUALS(25, decode_all(dem, d, 160, 120, AV_PIX_FMT_NONE), "Should give out every frame at the target.");
+	}
+
+	// Invalid use
+	{
+		ff::demuxer dem(mjpeg_path);
+		TEST_ASSERT_THROWS(ff::preview_decoder(dem.get_video(0), 0, 120), std::invalid_argument);
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/formats/remuxer.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/formats/muxer.h"
+
+#include <cmath>
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <format> // For std::format().
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#define LAVFI_VIDEO_FMT_STR " -f lavfi -i testsrc=duration={}:size={}x{}:rate={} "
+#define LAVFI_AUDIO_FMT_STR " -f lavfi -i sine=duration={}:frequency={}:sample_rate={} "
+
+#define TEST_AV_FMT_STR \
+FFMPEG_EXECUTABLE_PATH LAVFI_VIDEO_FMT_STR LAVFI_AUDIO_FMT_STR " -y "
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_av
+(
+	const std::string& file_path, int duration,
+	int w, int h, int rate,
+	int frequency, int sample_rate
+)
+{
+	std::string cmd
+	(
+		std::format(TEST_AV_FMT_STR,
+			duration, w, h, rate,
+			duration, frequency, sample_rate)
+	);
+	cmd += std::string("\"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// @returns how many packets each stream in the file has.
+std::vector<int> count_packets(const fs::path& path)
+{
+	ff::demuxer d(path);
+	std::vector<int> ret(d.num_streams());
+	ff::packet pkt;
+	while (d.demux_next_packet(pkt))
+	{
+		++ret[pkt->stream_index];
+	}
+	return ret;
+}
+
+// @returns the duration of the file in seconds.
+double duration_of(const fs::path& path)
+{
+	ff::demuxer d(path);
+	return d.av_fmt_ctx()->duration / (double)AV_TIME_BASE;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "remux_test.mp4");
+	create_test_av(test_path.generic_string(), 3, 320, 240, 25, 440, 44100);
+	const auto in_counts = count_packets(test_path);
+
+	// Test invalid use
+	{
+		ff::demuxer dem(test_path);
+		ff::muxer mux(working_dir / "remux_test_invalid.mkv");
+		TEST_ASSERT_THROWS(ff::remuxer(dem, mux, { dem.num_streams() }), std::out_of_range);
+		TEST_ASSERT_THROWS(ff::remuxer(dem, mux, { 0, 0 }), std::invalid_argument);
+	}
+
+	// MP4 to MKV, all streams, in tiny batches
+	fs::path mkv_path(working_dir / "remux_test_out.mkv");
+	{
+		ff::demuxer dem(test_path);
+		ff::muxer mux(mkv_path);
+		ff::remuxer r(dem, mux);
+		TEST_ASSERT_EQUALS(0, r.output_index(0), "Should map the streams in order.");
+		TEST_ASSERT_EQUALS(1, r.output_index(1), "Should map the streams in order.");
+		TEST_ASSERT_THROWS(r.output_index(2), std::out_of_range);
+		TEST_ASSERT_THROWS(r.run(ff::dict(), 0), std::invalid_argument);
+
+		const size_t n = r.run(ff::dict(), 3);
+		TEST_ASSERT_EQUALS(in_counts[0] + in_counts[1], (int)n, "Should mux all the packets.");
+		TEST_ASSERT_THROWS(r.run(), std::logic_error);
+	}
+	TEST_ASSERT_EQUALS(in_counts, count_packets(mkv_path), "Should have copied every packet.");
+
+	// Back to MP4, which has other time bases than MKV
+	fs::path mp4_path(working_dir / "remux_test_out.mp4");
+	{
+		ff::demuxer dem(mkv_path);
+		ff::muxer mux(mp4_path);
+		ff::remuxer r(dem, mux);
+		r.run();
+	}
+	TEST_ASSERT_EQUALS(in_counts, count_packets(mp4_path), "Should have copied every packet.");
+	TEST_ASSERT_TRUE(std::abs(duration_of(test_path) - duration_of(mp4_path)) < 0.1, "Should keep the duration.");
+
+	// Only the audio
+	fs::path audio_path(working_dir / "remux_test_audio.mkv");
+	{
+		ff::demuxer dem(test_path);
+		ff::muxer mux(audio_path);
+		const int ia = dem.get_audio_ind(0);
+		ff::remuxer r(dem, mux, { ia });
+		TEST_ASSERT_EQUALS(-1, r.output_index(dem.get_video_ind(0)), "Should drop the video.");
+		TEST_ASSERT_EQUALS(0, r.output_index(ia), "Should map the audio to the first stream.");
+		TEST_ASSERT_EQUALS(in_counts[ia], (int)r.run(), "Should mux only the audio packets.");
+	}
+	TEST_ASSERT_EQUALS(1, (int)count_packets(audio_path).size(), "Should only have the audio.");
+
+	FF_TEST_END
+
+	return 0;
+}
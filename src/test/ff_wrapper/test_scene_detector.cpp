@@ -0,0 +1,166 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/scene_detector.h"
+#include "../../ff_wrapper/data/frame_ops.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+
+#include <cmath>
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <format> // For std::format().
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Three scenes of 2 seconds each: black, color bars, and white. A keyframe every second.
+#define TEST_VIDEO_FMT_STR \
+FFMPEG_EXECUTABLE_PATH \
+" -f lavfi -i color=c=black:size={0}x{1}:rate={2}:duration=2" \
+" -f lavfi -i smptebars=size={0}x{1}:rate={2}:duration=2" \
+" -f lavfi -i color=c=white:size={0}x{1}:rate={2}:duration=2" \
+" -filter_complex \"[0][1][2]concat=n=3:v=1\" -c:v mpeg4 -g {2} -y "
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_video(const std::string& file_path, int w, int h, int rate)
+{
+	std::string cmd(std::format(TEST_VIDEO_FMT_STR, w, h, rate));
+	cmd += std::string("\"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// A 64x48 yuv420p frame of gray y at pts.
+ff::frame make_gray_frame(uint8_t y, int64_t pts)
+{
+	ff::frame f(true);
+	f.allocate_data(ff::frame::data_properties(AV_PIX_FMT_YUV420P, 64, 48));
+	ff::frame_ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 0>(f), y);
+	ff::frame_ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 1>(f), uint8_t(128));
+	ff::frame_ops::fill_plane(ff::view_plane<AV_PIX_FMT_YUV420P, 2>(f), uint8_t(128));
+	f->pts = pts;
+	return f;
+}
+
+// @returns the cuts in seconds.
+std::vector<double> scan_seconds(ff::demuxer& dem, bool keyframes_only)
+{
+	std::vector<double> res;
+	for (const ff::time& t : ff::scene_detector::scan(dem, dem.get_video_ind(0), ff::scene_detector::options(), keyframes_only))
+	{
+		res.push_back(t.to_absolute_double());
+	}
+	return res;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	// Test the checks
+	{
+		TEST_ASSERT_THROWS(ff::scene_detector(ff::zero_rational), std::invalid_argument);
+		ff::scene_detector::options bad;
+		bad.window = 0;
+		TEST_ASSERT_THROWS(ff::scene_detector(ff::rational(1, 25), bad), std::invalid_argument);
+		bad = ff::scene_detector::options();
+		bad.min_difference = -1;
+		TEST_ASSERT_THROWS(ff::scene_detector(ff::rational(1, 25), bad), std::invalid_argument);
+
+		ff::scene_detector det(ff::rational(1, 25));
+		TEST_ASSERT_THROWS(det.push_frame(ff::frame(true)), std::logic_error);
+		ff::frame no_pts = make_gray_frame(0, AV_NOPTS_VALUE);
+		no_pts->best_effort_timestamp = AV_NOPTS_VALUE;
+		TEST_ASSERT_THROWS(det.push_frame(no_pts), std::invalid_argument);
+	}
+
+	// Test pushing frames
+	{
+		// At 25 fps, scenes of at least half a second are 13 frames or more.
+		ff::scene_detector det(ff::rational(1, 25));
+		int64_t pts = 0;
+		for (; pts < 20; ++pts)
+		{
+			TEST_ASSERT_FALSE(det.push_frame(make_gray_frame(20, pts)).has_value(), "The same picture should not cut.");
+		}
+		TEST_ASSERT_EQUALS(0.0, det.last_difference(), "The same picture has no difference.");
+
+		auto cut = det.push_frame(make_gray_frame(200, pts));
+		TEST_ASSERT_TRUE(cut.has_value(), "Black to white should cut.");
+		TEST_ASSERT_EQUALS(20LL, (long long)cut->timestamp_approximate(), "Should cut at the new frame.");
+		TEST_ASSERT_EQUALS(180.0, det.last_difference(), "Should give the mean difference.");
+		TEST_ASSERT_EQUALS(1.0, det.last_histogram_distance(), "The histograms are disjoint.");
+
+		// Too soon after the last cut.
+		TEST_ASSERT_FALSE(det.push_frame(make_gray_frame(20, ++pts)).has_value(), "Should not cut a scene this short.");
+
+		// A small change is not a cut, even if it's the largest in a while.
+		for (++pts; pts < 60; ++pts)
+		{
+			det.push_frame(make_gray_frame(20, pts));
+		}
+		TEST_ASSERT_FALSE(det.push_frame(make_gray_frame(26, pts++)).has_value(), "A small change should not cut.");
+
+		// After a reset, the next frame has nothing to be compared with.
+		det.reset();
+		TEST_ASSERT_FALSE(det.push_frame(make_gray_frame(250, pts++)).has_value(), "The first frame should never cut.");
+		TEST_ASSERT_EQUALS((size_t)62, det.number_frames(), "Should count the frames.");
+	}
+
+	// Test scanning a file
+	{
+		fs::path working_dir(fs::current_path());
+		fs::path test_path(working_dir / "scene_test.avi");
+		create_test_video(test_path.generic_string(), 320, 240, 25);
+
+		// Every frame, and only the keyframes, which begin each scene here.
+		for (bool keyframes_only : { false, true })
+		{
+			ff::demuxer dem(test_path);
+			const auto cuts = scan_seconds(dem, keyframes_only);
+			TEST_ASSERT_EQUALS((size_t)2, cuts.size(), "Should find the two cuts.");
+			TEST_ASSERT_TRUE(std::abs(cuts[0] - 2.0) < 0.01, "The second scene begins at 2 seconds.");
+			TEST_ASSERT_TRUE(std::abs(cuts[1] - 4.0) < 0.01, "The third scene begins at 4 seconds.");
+			TEST_ASSERT_EQUALS((int)AVDISCARD_DEFAULT, (int)dem.get_discard(dem.get_video_ind(0)), "Should put the discard level back.");
+		}
+
+		// Also when the scan is left early.
+		{
+			ff::demuxer dem(test_path);
+			dem.set_discard(dem.get_video_ind(0), AVDISCARD_NONREF);
+			for (const ff::time& t : ff::scene_detector::scan(dem, dem.get_video_ind(0), ff::scene_detector::options(), true))
+			{
+				(void)t;
+				break;
+			}
+			TEST_ASSERT_EQUALS((int)AVDISCARD_NONREF, (int)dem.get_discard(dem.get_video_ind(0)), "Should put the discard level back.");
+		}
+
+		// Stopping early only decodes up to the first cut.
+		ff::demuxer dem(test_path);
+		for (const ff::time& t : ff::scene_detector::scan(dem, dem.get_video_ind(0)))
+		{
+			TEST_ASSERT_TRUE(std::abs(t.to_absolute_double() - 2.0) < 0.01, "Should yield the first cut first.");
+			break;
+		}
+	}
+
+	FF_TEST_END
+}
@@ -0,0 +1,174 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/smart_cutter.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/formats/muxer.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/codec/encoder.h"
+
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <format> // For std::format().
+#include <string>
+
+namespace fs = std::filesystem;
+
+#define LAVFI_VIDEO_FMT_STR " -f lavfi -i testsrc=duration={}:size={}x{}:rate={} "
+
+// mpeg4 puts its headers in every keyframe in avi, so the re-encoded frames
+// decode with the parameters of the copied ones. A keyframe every second.
+#define TEST_VIDEO_FMT_STR \
+FFMPEG_EXECUTABLE_PATH LAVFI_VIDEO_FMT_STR " -c:v mpeg4 -g {} -y "
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_video(const std::string& file_path, int w, int h, int rate, int duration)
+{
+	std::string cmd
+	(
+		std::format(TEST_VIDEO_FMT_STR,
+			duration, w, h, rate, rate)
+	);
+	cmd += std::string("\"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// @returns how many frames are decoded from the first video stream in the file.
+int count_video_frames(const fs::path& path)
+{
+	ff::demuxer d(path);
+	ff::decoder dec(d.get_video(0));
+	const int ind = d.get_video_ind(0);
+
+	int num = 0;
+	ff::frame f;
+	auto take_frames = [&]()
+	{
+		while (dec.decode_frame(f))
+		{
+			++num;
+		}
+	};
+
+	ff::packet pkt;
+	while (d.demux_next_packet(pkt))
+	{
+		if (ind != pkt->stream_index)
+		{
+			continue;
+		}
+
+		while (!dec.feed_packet(pkt))
+		{
+			take_frames();
+		}
+		take_frames();
+	}
+	dec.signal_no_more_food();
+	take_frames();
+
+	return num;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	// Test planning on an artificial index
+	{
+		using entry = ff::demuxer::index_entry;
+		// Keyframes at 0, 3 (open: 2 comes after it), 5, 8. And 10 frames.
+		ff::demuxer::keyframe_index index(1);
+		index[0] =
+		{
+			entry{ 0, 0, -1, true }, entry{ 1, 1, -1, false },
+			entry{ 3, 2, -1, true }, entry{ 2, 3, -1, false }, entry{ 4, 4, -1, false },
+			entry{ 5, 5, -1, true }, entry{ 6, 6, -1, false }, entry{ 7, 7, -1, false },
+			entry{ 8, 8, -1, true }, entry{ 9, 9, -1, false }
+		};
+
+		TEST_ASSERT_THROWS(ff::smart_cutter::plan_cut(index, 1, 0, 5), std::out_of_range);
+		TEST_ASSERT_THROWS(ff::smart_cutter::plan_cut(index, 0, 5, 5), std::invalid_argument);
+
+		// Copy the whole GOP [5, 8), and re-encode both edges.
+		auto plan = ff::smart_cutter::plan_cut(index, 0, 1, 9);
+		TEST_ASSERT_TRUE(plan.copies, "Should copy a GOP.");
+		TEST_ASSERT_EQUALS(5LL, (long long)plan.copy_start, "Should copy from the first closed boundary inside.");
+		TEST_ASSERT_EQUALS(8LL, (long long)plan.copy_end, "Should copy to the last closed boundary inside.");
+		TEST_ASSERT_EQUALS(4, plan.num_head_frames, "Should re-encode 1 to 4.");
+		TEST_ASSERT_EQUALS(3, plan.num_copied_frames, "Should copy 5 to 7.");
+		TEST_ASSERT_EQUALS(1, plan.num_tail_frames, "Should re-encode 8.");
+
+		// No whole GOP inside.
+		plan = ff::smart_cutter::plan_cut(index, 0, 1, 7);
+		TEST_ASSERT_FALSE(plan.copies, "Nothing to copy.");
+		TEST_ASSERT_EQUALS(6, plan.num_head_frames, "Should re-encode all.");
+
+		// From a boundary to the end, everything is copied.
+		plan = ff::smart_cutter::plan_cut(index, 0, 0, AV_NOPTS_VALUE);
+		TEST_ASSERT_TRUE(plan.copies, "Should copy.");
+		TEST_ASSERT_EQUALS((long long)AV_NOPTS_VALUE, (long long)plan.copy_end, "Should copy to the end.");
+		TEST_ASSERT_EQUALS(0, plan.num_head_frames, "Nothing to re-encode.");
+		TEST_ASSERT_EQUALS(10, plan.num_copied_frames, "Should copy all.");
+
+		// Ending after the last frame is the same as going to the end.
+		plan = ff::smart_cutter::plan_cut(index, 0, 2, 100);
+		TEST_ASSERT_EQUALS((long long)AV_NOPTS_VALUE, (long long)plan.copy_end, "Should copy to the end.");
+		TEST_ASSERT_EQUALS(3, plan.num_head_frames, "Should re-encode 2 to 4, even with the open keyframe.");
+		TEST_ASSERT_EQUALS(5, plan.num_copied_frames, "Should copy 5 to 9.");
+		TEST_ASSERT_EQUALS(0, plan.num_tail_frames, "Nothing after the copy.");
+	}
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "smart_cut_test.avi");
+	fs::path test_out_path(working_dir / "smart_cut_test_out.avi");
+	create_test_video(test_path.generic_string(), 320, 240, 24, 4);
+
+	ff::demuxer dem(test_path);
+	dem.build_keyframe_index();
+	const int vind = dem.get_video_ind(0);
+
+	TEST_ASSERT_THROWS(ff::smart_cutter(test_path, dem.get_keyframe_index(), dem.num_streams()), std::out_of_range);
+
+	// Frames 10 to 59: 14 re-encoded, the GOP of 24 to 47 copied, and 12 re-encoded.
+	{
+		ff::smart_cutter cutter(test_path, dem.get_keyframe_index(), vind);
+		const auto plan = cutter.plan_cut(10, 60);
+		TEST_ASSERT_EQUALS(14, plan.num_head_frames, "Should re-encode to the second keyframe.");
+		TEST_ASSERT_EQUALS(24, plan.num_copied_frames, "Should copy a GOP.");
+		TEST_ASSERT_EQUALS(12, plan.num_tail_frames, "Should re-encode from the third keyframe.");
+
+		ff::muxer mux(test_out_path);
+		auto ovs = mux.add_stream(dem.get_video(0));
+		mux.prepare_muxer();
+
+		const auto res = cutter.run(plan, mux, ovs);
+		mux.finalize();
+
+		TEST_ASSERT_EQUALS(24, (int)res.num_copied_packets, "Should copy a packet per frame.");
+		TEST_ASSERT_EQUALS(26, (int)res.num_encoded_packets, "Should encode a packet per frame.");
+	}
+
+	TEST_ASSERT_EQUALS(50, count_video_frames(test_out_path), "Should have all the frames of the clip.");
+
+	FF_TEST_END
+
+	return 0;
+}
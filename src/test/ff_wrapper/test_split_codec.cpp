@@ -0,0 +1,182 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/codec/split_codec.h"
+#include "../../ff_wrapper/pipeline/lazy_codecs.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+
+#include <cstdlib> // For std::system().
+#include <exception>
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main()
+{
+	FF_TEST_START
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "split_codec_test.mp4");
+	std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=3:size=320x240:rate=25 -c:v mpeg4 -bf 2 -y ");
+	cmd += std::string("\"") + test_path.generic_string() + '\"';
+	std::system(cmd.c_str());
+
+	// The frames decoded on one thread, to compare against.
+	std::vector<int64_t> expected_pts;
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+		for (ff::frame& f : ff::decoded_frames(dem, dec, dem.get_video_ind(0)))
+		{
+			expected_pts.push_back(f->pts);
+		}
+	}
+	TEST_ASSERT_EQUALS(75, (int)expected_pts.size(), "Should decode every frame.");
+
+	// Decoding: demuxing and feeding on one thread, taking the frames on another.
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0), ff::codec_base::threading_policy(4));
+		ff::split_decoder split(dec);
+
+		std::exception_ptr producer_error;
+		std::thread producer([&]()
+			{
+				try
+				{
+					ff::packet pkt;
+					while (dem.demux_next_packet(pkt))
+					{
+						if (dem.get_video_ind(0) == pkt->stream_index && !split.feed(pkt))
+						{
+							return;
+						}
+					}
+					split.signal_no_more_food();
+				}
+				catch (...)
+				{
+					producer_error = std::current_exception();
+					split.abort();
+				}
+			});
+
+		std::vector<int64_t> got_pts;
+		ff::frame f;
+		while (split.receive(f))
+		{
+			got_pts.push_back(f->pts);
+		}
+		producer.join();
+
+		TEST_ASSERT_EQUALS(nullptr, producer_error, "The producer should not fail.");
+		TEST_ASSERT_FALSE(split.is_aborted(), "Should not be aborted.");
+		TEST_ASSERT_TRUE(expected_pts == got_pts, "Should give out the same frames in the same order.");
+		TEST_ASSERT_FALSE(split.receive(f), "Should stay drained.");
+		TEST_ASSERT_THROWS(split.feed(ff::packet(true)), std::logic_error);
+		TEST_ASSERT_THROWS(split.signal_no_more_food(), std::logic_error);
+	}
+
+	// Encoding: feeding the decoded frames on one thread, taking the packets on another.
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+
+		ff::encoder enc(AV_CODEC_ID_MPEG4);
+		ff::codec_properties ep(dec.get_codec_properties().essential_properties());
+		ep.set_time_base(ff::rational(dem.get_video(0)->time_base));
+		ep.set_v_frame_rate(ff::rational(25));
+		enc.set_codec_properties(ep);
+		enc.set_threading_policy(ff::codec_base::threading_policy(4));
+		enc.create_codec_context();
+		ff::split_encoder split(enc);
+
+		std::thread producer([&]()
+			{
+				try
+				{
+					for (ff::frame& f : ff::decoded_frames(dem, dec, dem.get_video_ind(0)))
+					{
+						if (!split.feed(f))
+						{
+							return;
+						}
+					}
+					split.signal_no_more_food();
+				}
+				catch (...)
+				{
+					split.abort();
+				}
+			});
+
+		int num_packets = 0;
+		ff::packet pkt;
+		while (split.receive(pkt))
+		{
+			TEST_ASSERT_TRUE(pkt.ready(), "Should give out ready packets.");
+			++num_packets;
+		}
+		producer.join();
+
+		TEST_ASSERT_FALSE(split.is_aborted(), "Should not be aborted.");
+		TEST_ASSERT_EQUALS((int)expected_pts.size(), num_packets, "Should encode every frame.");
+	}
+
+	// Aborting wakes up a waiting consumer.
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+		ff::split_decoder split(dec);
+
+		bool received = true;
+		std::thread consumer([&]()
+			{
+				ff::frame f;
+				// Nothing is ever fed, so it waits.
+				received = split.receive(f);
+			});
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		split.abort();
+		consumer.join();
+
+		TEST_ASSERT_FALSE(received, "Should return false when aborted.");
+		TEST_ASSERT_TRUE(split.is_aborted(), "Should be aborted.");
+		ff::packet pkt;
+		dem.demux_next_packet(pkt);
+		TEST_ASSERT_FALSE(split.feed(pkt), "Should refuse after aborted.");
+	}
+
+	// Invalid use
+	{
+		ff::decoder not_ready(AV_CODEC_ID_MPEG4);
+		TEST_ASSERT_THROWS(ff::split_decoder{ not_ready }, std::logic_error);
+
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+		dec.signal_no_more_food();
+		TEST_ASSERT_THROWS(ff::split_decoder{ dec }, std::logic_error);
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/tee_muxer.h"
+#include "../../ff_wrapper/pipeline/lazy_codecs.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/formats/muxer.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/codec/encoder.h"
+
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// @returns how many packets the first stream in the file has.
+int count_packets(const fs::path& path)
+{
+	ff::demuxer d(path);
+	int n = 0;
+	ff::packet pkt;
+	while (d.demux_next_packet(pkt))
+	{
+		if (0 == pkt->stream_index)
+		{
+			++n;
+		}
+	}
+	return n;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	fs::path working_dir(fs::current_path());
+	fs::path test_path(working_dir / "tee_muxer_test.mp4");
+	std::string cmd(FFMPEG_EXECUTABLE_PATH " -f lavfi -i testsrc=duration=2:size=320x240:rate=25 -c:v mpeg4 -y ");
+	cmd += std::string("\"") + test_path.generic_string() + '\"';
+	std::system(cmd.c_str());
+
+	// Invalid use
+	{
+		TEST_ASSERT_THROWS(ff::tee_muxer(0), std::invalid_argument);
+
+		ff::tee_muxer tee;
+		TEST_ASSERT_THROWS(tee.push_packet(ff::packet(true), 0), std::logic_error);
+		ff::muxer mux(working_dir / "tee_muxer_test_invalid.mkv");
+		TEST_ASSERT_THROWS(tee.add_destination(mux, {}), std::invalid_argument);
+	}
+
+	// One encode into MP4, MPEG-TS, and MKV, and one destination that fails
+	const std::vector<fs::path> out_paths
+	{
+		working_dir / "tee_muxer_test_out.mp4",
+		working_dir / "tee_muxer_test_out.ts",
+		working_dir / "tee_muxer_test_out.mkv"
+	};
+	int num_packets = 0;
+	{
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+
+		ff::encoder enc(AV_CODEC_ID_MPEG4);
+		ff::codec_properties ep(dec.get_codec_properties().essential_properties());
+		ep.set_time_base(ff::rational(dem.get_video(0)->time_base));
+		ep.set_v_frame_rate(ff::rational(25));
+		enc.set_codec_properties(ep);
+		enc.create_codec_context();
+
+		std::vector<std::unique_ptr<ff::muxer>> muxers;
+		ff::tee_muxer tee(1024);
+		for (const auto& p : out_paths)
+		{
+			muxers.push_back(std::make_unique<ff::muxer>(p));
+			auto os = muxers.back()->add_stream(enc);
+			muxers.back()->prepare_muxer();
+			TEST_ASSERT_EQUALS(muxers.size() - 1, tee.add_destination(*muxers.back(), { os }), "Should be indexed in order.");
+		}
+		// Never prepared, so its muxing throws.
+		ff::muxer broken(working_dir / "tee_muxer_test_broken.mkv");
+		auto broken_s = broken.add_stream(enc);
+		const size_t broken_ind = tee.add_destination(broken, { broken_s });
+
+		ff::packet pkt;
+		for (ff::packet& p : ff::encoded_packets(enc, ff::decoded_frames(dem, dec, dem.get_video_ind(0))))
+		{
+			TEST_ASSERT_THROWS(tee.push_packet(p, 1), std::out_of_range);
+			tee.push_packet(p, 0);
+			TEST_ASSERT_TRUE(p.ready(), "Should leave the packet untouched.");
+			++num_packets;
+		}
+		TEST_ASSERT_THROWS(tee.add_destination(*muxers[0], { broken_s }), std::logic_error);
+
+		TEST_ASSERT_EQUALS(out_paths.size(), tee.finish(), "Every good destination should succeed.");
+		TEST_ASSERT_THROWS(tee.finish(), std::logic_error);
+		TEST_ASSERT_THROWS(tee.push_packet(pkt, 0), std::logic_error);
+
+		TEST_ASSERT_TRUE(tee.failed(broken_ind), "The broken one should fail.");
+		TEST_ASSERT_TRUE(nullptr != tee.error(broken_ind), "Should keep why.");
+		for (size_t i = 0; i < out_paths.size(); ++i)
+		{
+			TEST_ASSERT_FALSE(tee.failed(i), "Should not fail.");
+			TEST_ASSERT_EQUALS(nullptr, tee.error(i), "Should have no error.");
+			TEST_ASSERT_EQUALS(num_packets, (int)tee.num_muxed_packets(i), "Should mux every packet.");
+		}
+		TEST_ASSERT_THROWS(tee.failed(out_paths.size() + 1), std::out_of_range);
+	}
+	for (const auto& p : out_paths)
+	{
+		TEST_ASSERT_EQUALS(num_packets, count_packets(p), "Every file should have every packet.");
+	}
+
+	// A destination whose queue overflows is dropped
+	{
+		ff::encoder enc(AV_CODEC_ID_MPEG4);
+		ff::demuxer dem(test_path);
+		ff::decoder dec(dem.get_video(0));
+		ff::codec_properties ep(dec.get_codec_properties().essential_properties());
+		ep.set_time_base(ff::rational(dem.get_video(0)->time_base));
+		ep.set_v_frame_rate(ff::rational(25));
+		enc.set_codec_properties(ep);
+		enc.create_codec_context();
+
+		ff::muxer mux(working_dir / "tee_muxer_test_drop.mkv");
+		auto os = mux.add_stream(enc);
+		mux.prepare_muxer();
+
+		ff::tee_muxer tee(1, ff::tee_muxer::overflow_policy::drop_destination);
+		tee.add_destination(mux, { os });
+		// Pushed far faster than a writer can take them out.
+		ff::packet first;
+		for (ff::packet& p : ff::encoded_packets(enc, ff::decoded_frames(dem, dec, dem.get_video_ind(0))))
+		{
+			if (!first.ready())
+			{
+				first = p;
+			}
+			tee.push_packet(first, 0);
+			tee.push_packet(first, 0);
+			tee.push_packet(first, 0);
+			if (tee.failed(0))
+			{
+				break;
+			}
+		}
+		TEST_ASSERT_TRUE(tee.failed(0), "Should be dropped when it falls behind.");
+		TEST_ASSERT_EQUALS(0, tee.finish(), "Nothing should succeed.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}
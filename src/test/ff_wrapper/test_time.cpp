@@ -18,6 +18,11 @@
 
 #include "../../ff_wrapper/util/ff_time.h"
 
+extern "C"
+{
+#include <libavutil/mathematics.h>
+}
+
 int main()
 {
 	// Methods that are not tested
@@ -89,5 +94,50 @@ int main()
 		TEST_ASSERT_EQUALS("-47:37:08.57", t5.to_string(), "Should be equal");
 	}
 
+	// Test time_rescaler
+	{
+		// Usable in constant expressions.
+		constexpr ff::time_rescaler to_600(ff::rational(1, 25), ff::common_video_time_base_600);
+		static_assert(to_600.get_kind() == ff::time_rescaler::kind::multiply);
+		static_assert(to_600.rescale(3) == 72);
+		static_assert(to_600.inverse().get_kind() == ff::time_rescaler::kind::divide);
+		static_assert(to_600.inverse().rescale(72) == 3);
+		static_assert(ff::time_rescaler(ff::rational(2, 50), ff::rational(1, 25)).get_kind() == ff::time_rescaler::kind::identity);
+
+		TEST_ASSERT_THROWS(ff::time_rescaler(ff::zero_rational, ff::rational(1, 2)), std::invalid_argument);
+		TEST_ASSERT_THROWS(ff::time_rescaler(ff::rational(1, 2), ff::rational(-1, 2)), std::invalid_argument);
+
+		// AV_NOPTS_VALUE is passed through.
+		TEST_ASSERT_EQUALS(AV_NOPTS_VALUE, to_600.rescale(AV_NOPTS_VALUE), "Should pass AV_NOPTS_VALUE through");
+
+		// Rounded to the nearest, halfway cases away from zero, as av_rescale_rnd(AV_ROUND_NEAR_INF) does.
+		ff::time_rescaler r1(ff::rational(1, 600), ff::rational(1, 1440));
+		TEST_ASSERT_TRUE(r1.get_kind() == ff::time_rescaler::kind::general, "12/5 is not an integer");
+		ff::time_rescaler r2(ff::rational(1, 1000), ff::rational(1, 10));
+		for (int64_t ts : { 0LL, 1LL, 2LL, 5LL, 17LL, 45LL, 50LL, 55LL, -5LL, -45LL, -55LL, 123456789LL, -987654321LL })
+		{
+			TEST_ASSERT_EQUALS(av_rescale_rnd(ts, 12, 5, AV_ROUND_NEAR_INF), r1.rescale(ts), "Should round as FFmpeg does");
+			TEST_ASSERT_EQUALS(av_rescale_rnd(ts, 1, 100, AV_ROUND_NEAR_INF), r2.rescale(ts), "Should round as FFmpeg does");
+		}
+
+		// Products that need more than 64 bits are still exact.
+		ff::time_rescaler r3(ff::rational(1, 7), ff::rational(1, 90000));
+		const int64_t big = INT64_MAX / 20000;
+		TEST_ASSERT_EQUALS(av_rescale_rnd(big, 90000, 7, AV_ROUND_NEAR_INF), r3.rescale(big), "Should not overflow");
+		TEST_ASSERT_EQUALS(av_rescale_rnd(-big, 90000, 7, AV_ROUND_NEAR_INF), r3.rescale(-big), "Should not overflow");
+		// and saturated if they can't fit.
+		TEST_ASSERT_EQUALS(INT64_MAX, r3.rescale(INT64_MAX), "Should saturate");
+
+		// The three fields in one call. Duration only if set.
+		int64_t pts = 5, dts = AV_NOPTS_VALUE, duration = 0;
+		to_600.rescale(pts, dts, duration);
+		TEST_ASSERT_EQUALS(120, pts, "pts should be rescaled");
+		TEST_ASSERT_EQUALS(AV_NOPTS_VALUE, dts, "dts should stay unset");
+		TEST_ASSERT_EQUALS(0, duration, "duration should stay unset");
+		duration = 2;
+		to_600.rescale(pts, dts, duration);
+		TEST_ASSERT_EQUALS(48, duration, "duration should be rescaled");
+	}
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,425 @@
+/*
+* Copyright (C) 2024 Guanyuming He
+* This file is licensed under the GNU General Public License v3.
+*
+* This file is part of ff_wrapper.
+* ff_wrapper is free software:
+* you can redistribute it and/or modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+*
+* ff_wrapper is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+* without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+* See the GNU General Public License for more details.
+* You should have received a copy of the GNU General Public License along with ff_wrapper.
+* If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../../ff_wrapper/util/util.h"
+#include "../test_util.h"
+
+#include "../../ff_wrapper/pipeline/transcode_pipeline.h"
+#include "../../ff_wrapper/pipeline/quality_meter.h"
+#include "../../ff_wrapper/formats/demuxer.h"
+#include "../../ff_wrapper/formats/muxer.h"
+#include "../../ff_wrapper/codec/decoder.h"
+#include "../../ff_wrapper/codec/encoder.h"
+#include "../../ff_wrapper/sws/frame_transformer.h"
+#include "../../ff_wrapper/filter/filter_graph.h"
+
+#include <cstdlib> // For std::system().
+#include <filesystem> // For path handling as a demuxer requires an absolute path.
+#include <format> // For std::format().
+#include <string>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+namespace fs = std::filesystem;
+
+#define LAVFI_VIDEO_FMT_STR " -f lavfi -i testsrc=duration={}:size={}x{}:rate={} "
+#define LAVFI_AUDIO_FMT_STR " -f lavfi -i sine=duration={}:frequency={}:sample_rate={} "
+
+#define TEST_VIDEO_FMT_STR \
+FFMPEG_EXECUTABLE_PATH LAVFI_VIDEO_FMT_STR " -y "
+
+#define TEST_AV_FMT_STR \
+FFMPEG_EXECUTABLE_PATH LAVFI_VIDEO_FMT_STR LAVFI_AUDIO_FMT_STR " -y "
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_video(const std::string& file_path, int w, int h, int rate, int duration)
+{
+	std::string cmd
+	(
+		std::format(TEST_VIDEO_FMT_STR,
+			duration, w, h, rate)
+	);
+	cmd += std::string("\"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// @returns the ffmpeg command's return value via std::system()
+int create_test_av
+(
+	const std::string& file_path, int duration,
+	int w, int h, int rate,
+	int frequency, int sample_rate
+)
+{
+	std::string cmd
+	(
+		std::format(TEST_AV_FMT_STR,
+			duration, w, h, rate,
+			duration, frequency, sample_rate)
+	);
+	cmd += std::string("\"") + file_path + '\"';
+
+	return std::system(cmd.c_str());
+}
+
+// @returns how many packets the stream of index ind in the file has.
+int count_packets(const fs::path& path, int ind)
+{
+	ff::demuxer d(path);
+	ff::packet pkt;
+	int num = 0;
+	while (d.demux_next_packet(pkt))
+	{
+		if (ind == pkt->stream_index)
+		{
+			++num;
+		}
+	}
+	return num;
+}
+
+// @returns how many frames are decoded from the first video stream in the file.
+// Checks each frame's size, too.
+int count_video_frames(const fs::path& path, int w, int h)
+{
+	ff::demuxer d(path);
+	ff::decoder dec(d.get_video(0));
+	const int ind = d.get_video_ind(0);
+
+	int num = 0;
+	ff::frame f;
+	auto take_frames = [&]()
+	{
+		while (dec.decode_frame(f))
+		{
+			TEST_ASSERT_EQUALS(w, f->width, "Should have the width from the encoder.");
+			TEST_ASSERT_EQUALS(h, f->height, "Should have the height from the encoder.");
+			++num;
+		}
+	};
+
+	ff::packet pkt;
+	while (d.demux_next_packet(pkt))
+	{
+		if (ind != pkt->stream_index)
+		{
+			continue;
+		}
+
+		while (!dec.feed_packet(pkt))
+		{
+			take_frames();
+		}
+		take_frames();
+	}
+	dec.signal_no_more_food();
+	take_frames();
+
+	return num;
+}
+
+int main()
+{
+	FF_TEST_START
+
+	fs::path working_dir(fs::current_path());
+
+	// Test invalid use
+	{
+		fs::path test_path(working_dir / "pipeline_test1.mp4");
+		create_test_video(test_path.generic_string(), 320, 240, 25, 1);
+
+		ff::demuxer dem(test_path);
+		ff::muxer mux(working_dir / "pipeline_test1_out.mkv");
+
+		TEST_ASSERT_THROWS(ff::transcode_pipeline(dem, mux, 0), std::invalid_argument);
+
+		ff::transcode_pipeline p(dem, mux);
+		// No routes.
+		TEST_ASSERT_THROWS(p.run(), std::logic_error);
+
+		auto os = mux.add_stream(dem.get_video(0));
+		TEST_ASSERT_THROWS(p.add_copy_route(-1, os), std::out_of_range);
+		TEST_ASSERT_THROWS(p.add_copy_route(dem.num_streams(), os), std::out_of_range);
+		p.add_copy_route(dem.get_video_ind(0), os);
+		TEST_ASSERT_THROWS(p.add_copy_route(dem.get_video_ind(0), os), std::invalid_argument);
+
+		ff::decoder dec(dem.get_video(0));
+		ff::encoder enc(mux.desired_encoder_id(AVMEDIA_TYPE_VIDEO));
+		// Not ready.
+		TEST_ASSERT_THROWS(p.add_transcode_route(0, dec, enc, os), std::invalid_argument);
+	}
+
+	// Test transcoding through a transformer
+	{
+		fs::path test_path(working_dir / "pipeline_test2.mp4");
+		fs::path test_out_path(working_dir / "pipeline_test2_out.wmv");
+		create_test_video(test_path.generic_string(), 640, 480, 25, 3);
+
+		ff::demuxer dem(test_path);
+		ff::decoder vdec(dem.get_video(0));
+		ff::codec_properties vdec_p(vdec.get_codec_properties());
+
+		ff::muxer mux(test_out_path);
+		ff::encoder venc(mux.desired_encoder_id(AVMEDIA_TYPE_VIDEO));
+
+		// Half the size, so that the frames must be transformed.
+		ff::codec_properties venc_p(venc.get_codec_properties());
+		venc_p.set_time_base(vdec_p.time_base());
+		venc_p.set_v_width(vdec_p.v_width() / 2);
+		venc_p.set_v_height(vdec_p.v_height() / 2);
+		venc_p.set_v_sar(vdec_p.v_sar());
+		try
+		{
+			venc_p.set_v_pixel_format(venc.first_supported_v_pixel_format());
+		}
+		catch (const std::domain_error&)
+		{
+			venc_p.set_v_pixel_format(vdec_p.v_pixel_format());
+		}
+		venc_p.set_v_frame_rate(vdec_p.v_frame_rate());
+		venc.set_codec_properties(venc_p);
+		venc.create_codec_context();
+
+		auto ovs = mux.add_stream(venc);
+		mux.prepare_muxer();
+
+		ff::frame_transformer trans(venc, vdec);
+
+		// Tiny queues so that the stages often wait for each other,
+		// and a budget of about two frames so that the demuxer waits for it.
+		ff::memory_budget budget(0, 1024 * 1024);
+		ff::transcode_pipeline p(dem, mux, 2, &budget);
+		TEST_ASSERT_TRUE(&budget == &p.get_memory_budget(), "Should charge the budget given.");
+		p.add_transcode_route(dem.get_video_ind(0), vdec, venc, ovs, &trans);
+		p.run();
+
+		TEST_ASSERT_TRUE(p.num_muxed_packets() > 0, "Should have muxed packets.");
+		TEST_ASSERT_EQUALS((size_t)0, budget.bytes_in_use(), "Should have released everything.");
+		TEST_ASSERT_TRUE(budget.peak_bytes_in_use() > 0, "Should have charged the frames.");
+		TEST_ASSERT_EQUALS((size_t)0, ff::memory_budget::process_wide().bytes_in_use(), "Should have released everything up the chain.");
+		TEST_ASSERT_THROWS(p.run(), std::logic_error);
+		TEST_ASSERT_THROWS(p.add_copy_route(0, ovs), std::logic_error);
+
+		TEST_ASSERT_TRUE(vdec.no_more_food(), "Should have drained the decoder.");
+		TEST_ASSERT_TRUE(venc.no_more_food(), "Should have drained the encoder.");
+
+		// Every frame should have gone through.
+		TEST_ASSERT_EQUALS
+		(
+			count_video_frames(test_path, vdec_p.v_width(), vdec_p.v_height()),
+			count_video_frames(test_out_path, venc_p.v_width(), venc_p.v_height()),
+			"Should have all the frames transcoded."
+		);
+	}
+
+	// Test a hard cap of about one and a half frames.
+	// The stages must not keep the charges of what they are done with while waiting,
+	// or those left over would keep the demuxer waiting forever.
+	{
+		fs::path test_path(working_dir / "pipeline_test6.mp4");
+		fs::path test_out_path(working_dir / "pipeline_test6_out.mkv");
+		create_test_video(test_path.generic_string(), 640, 480, 25, 1);
+
+		ff::demuxer dem(test_path);
+		ff::decoder vdec(dem.get_video(0));
+		ff::codec_properties vdec_p(vdec.get_codec_properties());
+
+		ff::muxer mux(test_out_path);
+		ff::encoder venc(mux.desired_encoder_id(AVMEDIA_TYPE_VIDEO));
+
+		// The same size, so that the transformed frames are charged as much as the decoded ones.
+		ff::codec_properties venc_p(venc.get_codec_properties());
+		venc_p.set_time_base(vdec_p.time_base());
+		venc_p.set_v_width(vdec_p.v_width());
+		venc_p.set_v_height(vdec_p.v_height());
+		venc_p.set_v_sar(vdec_p.v_sar());
+		venc_p.set_v_pixel_format(vdec_p.v_pixel_format());
+		venc_p.set_v_frame_rate(vdec_p.v_frame_rate());
+		venc.set_codec_properties(venc_p);
+		venc.create_codec_context();
+
+		auto ovs = mux.add_stream(venc);
+		mux.prepare_muxer();
+
+		ff::frame_transformer trans(venc, vdec);
+
+		ff::frame one(true);
+		one.allocate_data(ff::frame::data_properties(vdec_p.v_pixel_format(), vdec_p.v_width(), vdec_p.v_height()));
+		ff::memory_budget budget(0, one.memory_size() * 3 / 2);
+		ff::transcode_pipeline p(dem, mux, 2, &budget);
+		p.add_transcode_route(dem.get_video_ind(0), vdec, venc, ovs, &trans);
+		p.run();
+
+		TEST_ASSERT_EQUALS((size_t)0, budget.bytes_in_use(), "Should have released everything.");
+		TEST_ASSERT_EQUALS
+		(
+			count_video_frames(test_path, vdec_p.v_width(), vdec_p.v_height()),
+			count_video_frames(test_out_path, venc_p.v_width(), venc_p.v_height()),
+			"Should have all the frames transcoded."
+		);
+	}
+
+	// Test transcoding into an encoder of another time base
+	{
+		fs::path test_path(working_dir / "pipeline_test5.mp4");
+		fs::path test_out_path(working_dir / "pipeline_test5_out.mkv");
+		create_test_video(test_path.generic_string(), 320, 240, 25, 2);
+
+		ff::demuxer dem(test_path);
+		ff::decoder vdec(dem.get_video(0));
+		ff::codec_properties vdec_p(vdec.get_codec_properties());
+
+		ff::muxer mux(test_out_path);
+		ff::encoder venc(mux.desired_encoder_id(AVMEDIA_TYPE_VIDEO));
+
+		// 1/25, while the frames come in the time base of the mp4 stream.
+		ff::codec_properties venc_p(venc.get_codec_properties());
+		venc_p.set_time_base(ff::rational(1, 25));
+		venc_p.set_v_width(vdec_p.v_width());
+		venc_p.set_v_height(vdec_p.v_height());
+		venc_p.set_v_sar(vdec_p.v_sar());
+		venc_p.set_v_pixel_format(vdec_p.v_pixel_format());
+		venc_p.set_v_frame_rate(vdec_p.v_frame_rate());
+		venc.set_codec_properties(venc_p);
+		venc.create_codec_context();
+		TEST_ASSERT_TRUE(dem.get_video(0).time_base() != venc->time_base, "Should be of another time base.");
+
+		auto ovs = mux.add_stream(venc);
+		mux.prepare_muxer();
+
+		ff::transcode_pipeline p(dem, mux, 2);
+		p.add_transcode_route(dem.get_video_ind(0), vdec, venc, ovs);
+		p.run();
+
+		// The pts should still span the 2 seconds.
+		ff::demuxer out(test_out_path);
+		const int ind = out.get_video_ind(0);
+		const AVRational out_tb = out.get_video(0).time_base().av_rational();
+		int64_t max_pts = 0;
+		ff::packet pkt;
+		while (out.demux_next_packet(pkt))
+		{
+			if (ind == pkt->stream_index && pkt->pts > max_pts)
+			{
+				max_pts = pkt->pts;
+			}
+		}
+		const double last = max_pts * av_q2d(out_tb);
+		TEST_ASSERT_TRUE(last > 1.8 && last < 2.1, "Should have rescaled the frames into the encoder's time base.");
+	}
+
+	// Test transcoding through a filter graph
+	{
+		fs::path test_path(working_dir / "pipeline_test4.mp4");
+		fs::path test_out_path(working_dir / "pipeline_test4_out.mkv");
+		create_test_video(test_path.generic_string(), 320, 240, 25, 2);
+
+		ff::demuxer dem(test_path);
+		ff::decoder vdec(dem.get_video(0));
+		ff::codec_properties vdec_p(vdec.get_codec_properties());
+
+		ff::muxer mux(test_out_path);
+		ff::encoder venc(mux.desired_encoder_id(AVMEDIA_TYPE_VIDEO));
+
+		ff::filter_graph filter
+		(
+			std::format("hflip,scale={}:{}", vdec_p.v_width() / 2, vdec_p.v_height() / 2),
+			vdec, dem.get_video(0).time_base(), 2
+		);
+		auto filter_dp = filter.dst_properties();
+
+		ff::codec_properties venc_p(venc.get_codec_properties());
+		venc_p.set_time_base(filter.dst_time_base());
+		venc_p.set_v_width(filter_dp.width);
+		venc_p.set_v_height(filter_dp.height);
+		venc_p.set_v_sar(vdec_p.v_sar());
+		venc_p.set_v_pixel_format((AVPixelFormat)filter_dp.fmt);
+		venc_p.set_v_frame_rate(vdec_p.v_frame_rate());
+		venc.set_codec_properties(venc_p);
+		venc.create_codec_context();
+
+		auto ovs = mux.add_stream(venc);
+		mux.prepare_muxer();
+
+		// Measured while it runs, with a stand-in for an extra metric.
+		int num_extra = 0;
+		ff::quality_meter meter
+		(
+			venc, 2,
+			[&num_extra](const ff::frame&, const ff::frame&) { ++num_extra; return 42.0; }
+		);
+
+		ff::transcode_pipeline p(dem, mux, 2);
+		TEST_ASSERT_THROWS(p.set_quality_meter(dem.get_video_ind(0), meter), std::invalid_argument);
+		p.add_transcode_route(dem.get_video_ind(0), vdec, venc, ovs, filter);
+		p.set_quality_meter(dem.get_video_ind(0), meter);
+		p.run();
+		TEST_ASSERT_THROWS(p.set_quality_meter(dem.get_video_ind(0), meter), std::logic_error);
+
+		TEST_ASSERT_TRUE(filter.drained(), "Should have drained the filter graph.");
+		const int num_out = count_video_frames(test_out_path, filter_dp.width, filter_dp.height);
+		TEST_ASSERT_EQUALS
+		(
+			count_video_frames(test_path, vdec_p.v_width(), vdec_p.v_height()),
+			num_out,
+			"Should have all the frames filtered."
+		);
+
+		TEST_ASSERT_EQUALS((size_t)num_out, meter.results().size(), "Should have measured every frame.");
+		TEST_ASSERT_EQUALS((size_t)0, meter.num_unmatched(), "Should have matched every frame to its reference.");
+		TEST_ASSERT_EQUALS(num_out, num_extra, "Should have run the extra metric on every frame.");
+		TEST_ASSERT_EQUALS(42.0, meter.mean_extra(), "Should average the extra metric.");
+		TEST_ASSERT_TRUE(meter.min_psnr() > 20.0 && meter.mean_psnr() >= meter.min_psnr(), "Should be a fair encode.");
+		TEST_ASSERT_TRUE(meter.min_ssim() > 0.5 && meter.mean_ssim() <= 1.0, "Should be a fair encode.");
+		TEST_ASSERT_THROWS(meter.finish(), std::logic_error);
+	}
+
+	// Test copying
+	{
+		fs::path test_path(working_dir / "pipeline_test3.mp4");
+		fs::path test_out_path(working_dir / "pipeline_test3_out.mkv");
+		create_test_av(test_path.generic_string(), 3, 320, 240, 25, 1000, 44100);
+
+		ff::demuxer dem(test_path);
+		ff::muxer mux(test_out_path);
+
+		const int iv = dem.get_video_ind(0);
+		const int ia = dem.get_audio_ind(0);
+		auto ovs = mux.add_stream(dem.get_video(0));
+		auto oas = mux.add_stream(dem.get_audio(0));
+		mux.prepare_muxer();
+
+		ff::transcode_pipeline p(dem, mux, 4);
+		p.add_copy_route(iv, ovs);
+		p.add_copy_route(ia, oas);
+		p.run();
+
+		const int num_v = count_packets(test_path, iv);
+		const int num_a = count_packets(test_path, ia);
+		TEST_ASSERT_EQUALS(num_v + num_a, (int)p.num_muxed_packets(), "Should have muxed all packets.");
+		TEST_ASSERT_EQUALS(num_v, count_packets(test_out_path, ovs.index()), "Should have copied all video packets.");
+		TEST_ASSERT_EQUALS(num_a, count_packets(test_out_path, oas.index()), "Should have copied all audio packets.");
+	}
+
+	FF_TEST_END
+
+	return 0;
+}